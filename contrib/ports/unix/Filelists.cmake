@@ -15,6 +15,7 @@ endif()
 set(lwipcontribportunix_SRCS
     ${LWIP_CONTRIB_DIR}/ports/unix/port/sys_arch.c
     ${LWIP_CONTRIB_DIR}/ports/unix/port/perf.c
+    ${LWIP_CONTRIB_DIR}/ports/unix/port/chksum.c
 )
 
 set(lwipcontribportunixnetifs_SRCS
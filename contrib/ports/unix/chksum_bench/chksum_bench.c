@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2001-2003 Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ *
+ */
+
+/*
+ * Throughput of the Internet checksum routines: the portable
+ * lwip_standard_chksum() (LWIP_CHKSUM_ALGORITHM 3) and the kernels of
+ * port/chksum.c, checksum only and fused copy-and-checksum (compared to
+ * lwip_chksum_copy(), which is MEMCPY followed by the checksum).
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "lwip/inet_chksum.h"
+#include "arch/chksum.h"
+
+u16_t lwip_standard_chksum(const void *dataptr, int len);
+
+#define BENCH_BYTES (64 * 1024 * 1024)
+/* report the best of several runs, the machine may be busy */
+#define BENCH_RUNS  5
+
+static const int bench_lens[] = { 64, 576, 1500, 9000, 65535 };
+#define NUM_LENS ((int)(sizeof(bench_lens) / sizeof(bench_lens[0])))
+
+static unsigned char src[65536 + 64], dst[65536 + 64];
+static volatile u16_t sink;
+
+static double
+now_sec(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void
+bench_chksum(const char *name, u16_t (*fn)(const void *, int))
+{
+  int l, i, r, rounds;
+  double t, best;
+
+  printf("%-16s", name);
+  for (l = 0; l < NUM_LENS; l++) {
+    rounds = BENCH_BYTES / bench_lens[l];
+    best = 0;
+    for (r = 0; r < BENCH_RUNS; r++) {
+      t = now_sec();
+      for (i = 0; i < rounds; i++) {
+        sink = fn(&src[1], bench_lens[l]);
+      }
+      t = now_sec() - t;
+      if ((best == 0) || (t < best)) {
+        best = t;
+      }
+    }
+    printf(" %7.2f", (double)rounds * bench_lens[l] / best / 1e9);
+  }
+  printf("\n");
+}
+
+static void
+bench_chksum_copy(const char *name, u16_t (*fn)(void *, const void *, u16_t))
+{
+  int l, i, r, rounds;
+  double t, best;
+
+  printf("%-16s", name);
+  for (l = 0; l < NUM_LENS; l++) {
+    rounds = BENCH_BYTES / bench_lens[l];
+    best = 0;
+    for (r = 0; r < BENCH_RUNS; r++) {
+      t = now_sec();
+      for (i = 0; i < rounds; i++) {
+        sink = fn(dst, &src[1], (u16_t)bench_lens[l]);
+      }
+      t = now_sec() - t;
+      if ((best == 0) || (t < best)) {
+        best = t;
+      }
+    }
+    printf(" %7.2f", (double)rounds * bench_lens[l] / best / 1e9);
+  }
+  printf("\n");
+}
+
+int
+main(void)
+{
+  const struct lwip_unix_chksum_impl *impls;
+  char name[32];
+  int num, n, l;
+
+  for (l = 0; l < (int)sizeof(src); l++) {
+    src[l] = (unsigned char)(l * 7);
+  }
+  impls = lwip_unix_chksum_impls(&num);
+
+  printf("GB/s, odd source address\n%-16s", "bytes:");
+  for (l = 0; l < NUM_LENS; l++) {
+    printf(" %7d", bench_lens[l]);
+  }
+  printf("\n");
+  bench_chksum("standard", lwip_standard_chksum);
+  for (n = 0; n < num; n++) {
+    bench_chksum(impls[n].name, impls[n].chksum);
+  }
+  bench_chksum_copy("memcpy+standard", lwip_chksum_copy);
+  for (n = 0; n < num; n++) {
+    snprintf(name, sizeof(name), "copy %s", impls[n].name);
+    bench_chksum_copy(name, impls[n].chksum_copy);
+  }
+  return 0;
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2001-2003 Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ *
+ */
+
+/*
+ * Benchmark for lwip_epoll_wait(): sockets_stresstest_epoll_run() reports the
+ * event rate with 10, 100, 1000 and EPOLL_BENCH_SOCKETS idle UDP sockets
+ * registered with one epoll instance. The rate should not depend on the
+ * number of sockets.
+ */
+
+#include "lwip/tcpip.h"
+#include "lwip/sys.h"
+
+#include "sockets_stresstest.h"
+
+static void
+tcpip_init_done(void *arg)
+{
+  sys_sem_signal((sys_sem_t *)arg);
+}
+
+int
+main(void)
+{
+  sys_sem_t init_sem;
+
+  if (sys_sem_new(&init_sem, 0) != ERR_OK) {
+    return 1;
+  }
+  tcpip_init(tcpip_init_done, &init_sem);
+  sys_sem_wait(&init_sem);
+  sys_sem_free(&init_sem);
+
+  sockets_stresstest_epoll_run(EPOLL_BENCH_SOCKETS);
+  return 0;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2001-2003 Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ *
+ */
+#ifndef LWIP_EPOLL_BENCH_LWIPOPTS_H
+#define LWIP_EPOLL_BENCH_LWIPOPTS_H
+
+/* IPv4 UDP sockets over the loopback netif only */
+#define NO_SYS                  0
+#define SYS_LIGHTWEIGHT_PROT    1
+#define LWIP_IPV4               1
+#define LWIP_IPV6               0
+#define LWIP_TCP                0
+#define LWIP_ARP                0
+#define LWIP_ETHERNET           0
+#define LWIP_DNS                0
+#define LWIP_HAVE_LOOPIF        1
+#define LWIP_NETIF_LOOPBACK     1
+#define LWIP_STATS              0
+
+/* no lwip_select(): the number of sockets is not limited by FD_SETSIZE */
+#define LWIP_SOCKET             1
+#define LWIP_SOCKET_SELECT      0
+#define LWIP_SOCKET_POLL        1
+#define LWIP_SOCKET_EPOLL       1
+#define LWIP_NETCONN_SEM_PER_THREAD 0
+
+#define EPOLL_BENCH_SOCKETS     4000
+#define MEMP_NUM_NETCONN        (EPOLL_BENCH_SOCKETS + 2)
+#define MEMP_NUM_UDP_PCB        (EPOLL_BENCH_SOCKETS + 2)
+#define MEMP_NUM_EPOLL_ITEM     EPOLL_BENCH_SOCKETS
+#define MEM_SIZE                (256 * 1024)
+
+/* keep the UDP demux out of the measurement */
+#define LWIP_UDP_PCB_HASH       1
+#define UDP_PCB_HASH_SIZE       4096
+
+#define TCPIP_MBOX_SIZE         128
+#define DEFAULT_UDP_RECVMBOX_SIZE 4
+
+/* print the rates measured by sockets_stresstest_epoll_run() */
+#define LWIP_DEBUG              1
+#define TEST_SOCKETS_STRESS     LWIP_DBG_ON
+
+#endif /* LWIP_EPOLL_BENCH_LWIPOPTS_H */
@@ -0,0 +1,43 @@
+#!/bin/bash
+#
+# Measure the receive throughput of the lwiperf server in example_app over a
+# tap interface, built with and without LWIP_GRO.
+#
+# Needs root (to create the tap device) and iperf (version 2) on the host.
+# lwipcfg.h must enable LWIP_LWIPERF_APP and use the default addresses
+# (e.g. copy contrib/examples/example_app/lwipcfg.h.ci):
+# lwIP is 192.168.1.200, the host is 192.168.1.1 on tap0.
+#
+# Usage: gro_iperf.sh [seconds]
+
+DURATION=${1:-10}
+TAPIF=tap0
+HOSTADDR=192.168.1.1/24
+LWIPADDR=192.168.1.200
+
+pushd `dirname "$0"` > /dev/null
+
+ip tuntap add dev $TAPIF mode tap || exit 1
+ip addr add $HOSTADDR dev $TAPIF
+ip link set $TAPIF up
+
+for GRO in 0 1
+do
+    echo "=== LWIP_GRO=$GRO ==="
+    make clean > /dev/null
+    make TESTFLAGS="-DLWIP_GRO=$GRO" -j 4 example_app > /dev/null || break
+    PRECONFIGURED_TAPIF=$TAPIF ./example_app > /dev/null 2>&1 &
+    APP=$!
+    # wait for the stack to come up
+    for i in $(seq 1 50)
+    do
+        ping -c 1 -W 1 $LWIPADDR > /dev/null 2>&1 && break
+    done
+    iperf -c $LWIPADDR -t $DURATION -f m
+    kill $APP
+    wait $APP 2> /dev/null
+done
+
+make clean > /dev/null
+ip tuntap del dev $TAPIF mode tap
+popd > /dev/null
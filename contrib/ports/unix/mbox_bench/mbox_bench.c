@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2001-2003 Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ *
+ */
+
+/*
+ * Microbenchmark for the mbox implementation of the unix port's sys_arch.c:
+ * - throughput: PRODUCERS threads post messages that one thread fetches
+ *   (like netif and API threads posting to tcpip_thread)
+ * - latency: two threads bounce one message between two mboxes
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "lwip/sys.h"
+
+#define MSGS_PER_PRODUCER 1000000
+#define PINGPONG_ROUNDS   100000
+#define MAX_PRODUCERS     4
+
+static sys_mbox_t mbox_a, mbox_b;
+
+static double
+now_sec(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void *
+producer(void *arg)
+{
+  long i;
+  LWIP_UNUSED_ARG(arg);
+  for (i = 1; i <= MSGS_PER_PRODUCER; i++) {
+    sys_mbox_post(&mbox_a, (void *)i);
+  }
+  return NULL;
+}
+
+static void
+bench_throughput(int producers)
+{
+  pthread_t threads[MAX_PRODUCERS];
+  long total = (long)producers * MSGS_PER_PRODUCER;
+  long i;
+  double start, t;
+  void *msg;
+  int p;
+
+  start = now_sec();
+  for (p = 0; p < producers; p++) {
+    pthread_create(&threads[p], NULL, producer, NULL);
+  }
+  for (i = 0; i < total; i++) {
+    sys_arch_mbox_fetch(&mbox_a, &msg, 0);
+  }
+  t = now_sec() - start;
+  for (p = 0; p < producers; p++) {
+    pthread_join(threads[p], NULL);
+  }
+  printf("throughput, %d producer(s): %8.2f Mmsg/s\n", producers, (double)total / t / 1e6);
+}
+
+static void *
+ponger(void *arg)
+{
+  void *msg;
+  int i;
+  LWIP_UNUSED_ARG(arg);
+  for (i = 0; i < PINGPONG_ROUNDS; i++) {
+    sys_arch_mbox_fetch(&mbox_a, &msg, 0);
+    sys_mbox_post(&mbox_b, msg);
+  }
+  return NULL;
+}
+
+static void
+bench_latency(void)
+{
+  pthread_t thread;
+  double start, t;
+  void *msg;
+  int i;
+
+  pthread_create(&thread, NULL, ponger, NULL);
+  start = now_sec();
+  for (i = 0; i < PINGPONG_ROUNDS; i++) {
+    sys_mbox_post(&mbox_a, &msg);
+    sys_arch_mbox_fetch(&mbox_b, &msg, 0);
+  }
+  t = now_sec() - start;
+  pthread_join(thread, NULL);
+  printf("latency (post to fetch):    %8.0f ns\n", t / (2 * PINGPONG_ROUNDS) * 1e9);
+}
+
+int
+main(void)
+{
+  void *msg;
+
+  sys_init();
+  if ((sys_mbox_new(&mbox_a, 0) != ERR_OK) || (sys_mbox_new(&mbox_b, 0) != ERR_OK)) {
+    return 1;
+  }
+  /* sanity check: empty mbox times out */
+  if (sys_arch_mbox_fetch(&mbox_a, &msg, 10) != SYS_ARCH_TIMEOUT) {
+    printf("fetch from an empty mbox did not time out\n");
+    return 1;
+  }
+  bench_throughput(1);
+  bench_throughput(MAX_PRODUCERS);
+  bench_latency();
+  sys_mbox_free(&mbox_a);
+  sys_mbox_free(&mbox_b);
+  return 0;
+}
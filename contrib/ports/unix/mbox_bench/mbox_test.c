@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2001-2003 Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ *
+ */
+
+/*
+ * Test for the mbox implementation of the unix port's sys_arch.c with
+ * several threads fetching from one mbox (like netconn mboxes): every
+ * message must be fetched exactly once and no blocked fetcher may miss a
+ * wakeup.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "lwip/sys.h"
+
+#define PRODUCERS         4
+#define FETCHERS          4
+#define MSGS_PER_PRODUCER 200000
+#define TOTAL_MSGS        (PRODUCERS * MSGS_PER_PRODUCER)
+
+static sys_mbox_t mbox;
+static unsigned char seen[TOTAL_MSGS];
+static int fetched;
+static int failed;
+
+static void *
+producer(void *arg)
+{
+  long base = (long)arg * MSGS_PER_PRODUCER;
+  long i;
+  for (i = 0; i < MSGS_PER_PRODUCER; i++) {
+    sys_mbox_post(&mbox, (void *)(base + i + 1));
+  }
+  return NULL;
+}
+
+static void *
+fetcher(void *arg)
+{
+  long n = (long)arg;
+  void *msg;
+  u32_t ret;
+
+  while (__atomic_load_n(&fetched, __ATOMIC_SEQ_CST) < TOTAL_MSGS) {
+    /* mix blocking fetches (with a timeout to see the end) and tryfetch */
+    if ((n & 1) == 0) {
+      ret = sys_arch_mbox_fetch(&mbox, &msg, 10);
+      if (ret == SYS_ARCH_TIMEOUT) {
+        continue;
+      }
+    } else {
+      ret = sys_arch_mbox_tryfetch(&mbox, &msg);
+      if (ret == SYS_MBOX_EMPTY) {
+        sched_yield();
+        continue;
+      }
+    }
+    if (((long)msg < 1) || ((long)msg > TOTAL_MSGS) ||
+        (__atomic_add_fetch(&seen[(long)msg - 1], 1, __ATOMIC_RELAXED) != 1)) {
+      printf("message %ld fetched twice or invalid\n", (long)msg);
+      __atomic_store_n(&failed, 1, __ATOMIC_SEQ_CST);
+    }
+    __atomic_add_fetch(&fetched, 1, __ATOMIC_SEQ_CST);
+  }
+  return NULL;
+}
+
+/* several threads fetch what several threads post */
+static int
+test_many_fetchers(void)
+{
+  pthread_t producers[PRODUCERS], fetchers[FETCHERS];
+  long i;
+
+  memset(seen, 0, sizeof(seen));
+  fetched = 0;
+  for (i = 0; i < FETCHERS; i++) {
+    pthread_create(&fetchers[i], NULL, fetcher, (void *)i);
+  }
+  for (i = 0; i < PRODUCERS; i++) {
+    pthread_create(&producers[i], NULL, producer, (void *)i);
+  }
+  for (i = 0; i < PRODUCERS; i++) {
+    pthread_join(producers[i], NULL);
+  }
+  for (i = 0; i < FETCHERS; i++) {
+    pthread_join(fetchers[i], NULL);
+  }
+  for (i = 0; i < TOTAL_MSGS; i++) {
+    if (seen[i] != 1) {
+      printf("message %ld fetched %d times\n", i + 1, seen[i]);
+      return 1;
+    }
+  }
+  return failed;
+}
+
+static void *
+blocked_fetcher(void *arg)
+{
+  void *msg;
+  LWIP_UNUSED_ARG(arg);
+  sys_arch_mbox_fetch(&mbox, &msg, 0);
+  __atomic_add_fetch(&fetched, 1, __ATOMIC_SEQ_CST);
+  return NULL;
+}
+
+/* one message per blocked fetcher wakes all of them (as done by
+   netconn_mark_mbox_invalid()) */
+static int
+test_wake_blocked_fetchers(void)
+{
+  pthread_t fetchers[FETCHERS];
+  long i;
+
+  fetched = 0;
+  for (i = 0; i < FETCHERS; i++) {
+    pthread_create(&fetchers[i], NULL, blocked_fetcher, NULL);
+  }
+  /* let them block */
+  usleep(100000);
+  for (i = 0; i < FETCHERS; i++) {
+    sys_mbox_post(&mbox, (void *)(i + 1));
+  }
+  for (i = 0; i < FETCHERS; i++) {
+    pthread_join(fetchers[i], NULL);
+  }
+  return fetched != FETCHERS;
+}
+
+int
+main(void)
+{
+  void *msg;
+
+  /* a lost wakeup hangs: fail instead */
+  alarm(60);
+  sys_init();
+  if (sys_mbox_new(&mbox, 0) != ERR_OK) {
+    return 1;
+  }
+  if (test_many_fetchers()) {
+    printf("test_many_fetchers failed\n");
+    return 1;
+  }
+  if (test_wake_blocked_fetchers()) {
+    printf("test_wake_blocked_fetchers failed\n");
+    return 1;
+  }
+  if (sys_arch_mbox_tryfetch(&mbox, &msg) != SYS_MBOX_EMPTY) {
+    printf("mbox not empty\n");
+    return 1;
+  }
+  sys_mbox_free(&mbox);
+  printf("mbox test passed\n");
+  return 0;
+}
@@ -0,0 +1,296 @@
+/*
+ * Copyright (c) 2001-2003 Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ *
+ */
+
+
+/*
+ * Fragmentation/latency benchmark for mem_malloc()/mem_free()/mem_trim():
+ * replays an allocation trace and reports the time per operation, the
+ * allocations that failed and the largest block still available at the end.
+ *
+ * Trace format (one operation per line, ids are slots 0..MAX_IDS-1):
+ *   a <id> <size>     mem_malloc(size), store the result in slot id
+ *   f <id>            mem_free(slot id)
+ *   t <id> <size>     mem_trim(slot id, size)
+ *
+ * Without a trace file, a synthetic trace is generated: many small
+ * PBUF_RAM-like allocations (headers, ACKs, short replies) mixed with large
+ * TX buffers, some of which are trimmed after being filled. "-g" prints
+ * that trace instead of running it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lwip/mem.h"
+#include "lwip/stats.h"
+
+#define MAX_IDS     1024
+#define SYNTH_OPS   2000000
+#define SYNTH_IDS   512
+
+struct trace_op {
+  char op;
+  u16_t id;
+  u32_t size;
+};
+
+static struct trace_op *trace;
+static size_t trace_len, trace_max;
+static void *slots[MAX_IDS];
+
+static void
+trace_add(char op, u32_t id, u32_t size)
+{
+  if (trace_len == trace_max) {
+    trace_max = trace_max ? (trace_max * 2) : 65536;
+    trace = (struct trace_op *)realloc(trace, trace_max * sizeof(struct trace_op));
+    if (trace == NULL) {
+      printf("out of memory\n");
+      exit(1);
+    }
+  }
+  trace[trace_len].op = op;
+  trace[trace_len].id = (u16_t)id;
+  trace[trace_len].size = size;
+  trace_len++;
+}
+
+static int
+trace_read(const char *name)
+{
+  FILE *f = fopen(name, "r");
+  char line[128];
+  char op;
+  unsigned id, size;
+
+  if (f == NULL) {
+    perror(name);
+    return -1;
+  }
+  while (fgets(line, sizeof(line), f) != NULL) {
+    size = 0;
+    if ((sscanf(line, " %c %u %u", &op, &id, &size) < 2) || (id >= MAX_IDS) ||
+        ((op != 'a') && (op != 'f') && (op != 't'))) {
+      continue;
+    }
+    trace_add(op, id, size);
+  }
+  fclose(f);
+  return 0;
+}
+
+static u32_t synth_seed = 0x12345678;
+
+static u32_t
+synth_rand(u32_t max)
+{
+  synth_seed = synth_seed * 1103515245 + 12345;
+  return (synth_seed >> 8) % max;
+}
+
+static void
+trace_synth(void)
+{
+  static u32_t sizes[SYNTH_IDS];
+  u32_t i, id, r;
+
+  for (i = 0; i < SYNTH_OPS; i++) {
+    id = synth_rand(SYNTH_IDS);
+    r = synth_rand(100);
+    if (sizes[id] == 0) {
+      if (r < 80) {
+        /* small: header-only pbufs, ACKs, short replies */
+        sizes[id] = 40 + synth_rand(600);
+      } else {
+        /* large: TX buffers */
+        sizes[id] = 1460 + synth_rand(6 * 1460);
+      }
+      trace_add('a', id, sizes[id]);
+    } else if ((r < 20) && (sizes[id] > 128)) {
+      /* shrink to what was actually filled in */
+      sizes[id] = 64 + synth_rand(sizes[id] - 64);
+      trace_add('t', id, sizes[id]);
+    } else {
+      sizes[id] = 0;
+      trace_add('f', id, 0);
+    }
+  }
+}
+
+static u64_t
+now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u64_t)ts.tv_sec * 1000000000ULL + (u64_t)ts.tv_nsec;
+}
+
+/** Largest block mem_malloc() can currently hand out (bisection, untimed) */
+static u32_t
+largest_free(void)
+{
+  u32_t lo = 0, hi = MEM_SIZE;
+  void *p;
+
+  while (lo < hi) {
+    u32_t mid = (lo + hi + 1) / 2;
+    p = mem_malloc((mem_size_t)mid);
+    if (p != NULL) {
+      mem_free(p);
+      lo = mid;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  return lo;
+}
+
+struct op_stats {
+  u64_t count;
+  u64_t total_ns;
+  u64_t max_ns;
+};
+
+static void
+op_account(struct op_stats *s, u64_t ns)
+{
+  s->count++;
+  s->total_ns += ns;
+  if (ns > s->max_ns) {
+    s->max_ns = ns;
+  }
+}
+
+static void
+op_print(const char *name, const struct op_stats *s)
+{
+  printf("%-6s %9lu ops  avg %6.1f ns  max %8lu ns\n", name, (unsigned long)s->count,
+         s->count ? (double)s->total_ns / (double)s->count : 0.0, (unsigned long)s->max_ns);
+}
+
+static void
+replay(void)
+{
+  struct op_stats st_alloc, st_free, st_trim;
+  u64_t start, t;
+  u32_t failed = 0, min_largest = MEM_SIZE;
+  size_t i;
+  void *p;
+
+  memset(&st_alloc, 0, sizeof(st_alloc));
+  memset(&st_free, 0, sizeof(st_free));
+  memset(&st_trim, 0, sizeof(st_trim));
+
+  for (i = 0; i < trace_len; i++) {
+    const struct trace_op *op = &trace[i];
+    switch (op->op) {
+      case 'a':
+        if (slots[op->id] != NULL) {
+          mem_free(slots[op->id]);
+        }
+        start = now_ns();
+        p = mem_malloc((mem_size_t)op->size);
+        t = now_ns() - start;
+        op_account(&st_alloc, t);
+        if (p == NULL) {
+          failed++;
+        }
+        slots[op->id] = p;
+        break;
+      case 'f':
+        if (slots[op->id] != NULL) {
+          start = now_ns();
+          mem_free(slots[op->id]);
+          t = now_ns() - start;
+          op_account(&st_free, t);
+          slots[op->id] = NULL;
+        }
+        break;
+      case 't':
+        if (slots[op->id] != NULL) {
+          start = now_ns();
+          p = mem_trim(slots[op->id], (mem_size_t)op->size);
+          t = now_ns() - start;
+          op_account(&st_trim, t);
+          if (p != NULL) {
+            slots[op->id] = p;
+          }
+        }
+        break;
+      default:
+        break;
+    }
+    if ((i % 4096) == 4095) {
+      u32_t largest = largest_free();
+      if (largest < min_largest) {
+        min_largest = largest;
+      }
+    }
+  }
+
+  op_print("malloc", &st_alloc);
+  op_print("free", &st_free);
+  op_print("trim", &st_trim);
+  printf("failed allocations: %u, max heap used: %lu of %lu bytes\n", failed,
+         (unsigned long)lwip_stats.mem.max, (unsigned long)lwip_stats.mem.avail);
+  printf("largest free block: %u bytes at the end, %u bytes minimum\n",
+         largest_free(), min_largest);
+}
+
+int
+main(int argc, char **argv)
+{
+  size_t i;
+
+  if ((argc > 1) && (strcmp(argv[1], "-g") != 0)) {
+    if (trace_read(argv[1]) != 0) {
+      return 1;
+    }
+  } else {
+    trace_synth();
+    if (argc > 1) {
+      for (i = 0; i < trace_len; i++) {
+        if (trace[i].op == 'f') {
+          printf("f %u\n", (unsigned)trace[i].id);
+        } else {
+          printf("%c %u %u\n", trace[i].op, (unsigned)trace[i].id, (unsigned)trace[i].size);
+        }
+      }
+      return 0;
+    }
+  }
+
+  stats_init();
+  mem_init();
+  replay();
+  return 0;
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2001-2003 Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ *
+ */
+
+/*
+ * Microbenchmark for memp_malloc()/memp_free() from several threads at once
+ * (like application threads using the socket API while tcpip_thread runs):
+ * each thread allocates BURST pool elements and frees them again.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "lwip/sys.h"
+#include "lwip/memp.h"
+
+#define ROUNDS      1000000
+#define BURST       8
+#define MAX_THREADS 4
+
+static sys_sem_t done;
+
+static double
+now_sec(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void
+worker(void *arg)
+{
+  void *elems[BURST];
+  int i, j;
+  LWIP_UNUSED_ARG(arg);
+
+  for (i = 0; i < ROUNDS; i++) {
+    for (j = 0; j < BURST; j++) {
+      elems[j] = memp_malloc(MEMP_PBUF_POOL);
+      if (elems[j] == NULL) {
+        printf("pool empty\n");
+        abort();
+      }
+    }
+    for (j = 0; j < BURST; j++) {
+      memp_free(MEMP_PBUF_POOL, elems[j]);
+    }
+  }
+  sys_sem_signal(&done);
+}
+
+static void
+bench(int threads)
+{
+  double start, t;
+  int i;
+
+  start = now_sec();
+  for (i = 0; i < threads; i++) {
+    sys_thread_new("worker", worker, NULL, 0, 0);
+  }
+  for (i = 0; i < threads; i++) {
+    sys_arch_sem_wait(&done, 0);
+  }
+  t = now_sec() - start;
+  printf("%d thread(s): %8.2f M alloc+free/s\n", threads,
+         (double)threads * ROUNDS * BURST / t / 1e6);
+}
+
+int
+main(void)
+{
+  sys_init();
+  memp_init();
+  if (sys_sem_new(&done, 0) != ERR_OK) {
+    return 1;
+  }
+  bench(1);
+  bench(MAX_THREADS);
+  sys_sem_free(&done);
+  return 0;
+}
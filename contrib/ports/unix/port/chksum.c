@@ -0,0 +1,347 @@
+/*
+ * Copyright (c) 2001-2003 Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ *
+ */
+
+/*
+ * Internet checksum kernels for the unix port.
+ *
+ * The data is summed as 32-bit words into 64-bit accumulators: since
+ * 2^16 == 1 (mod 0xffff), folding the result gives the same one's complement
+ * sum as adding 16-bit words, without carry handling in the inner loops.
+ * Loads are unaligned, so the start address does not matter. The SIMD kernels
+ * are picked at runtime (CPUID on x86), the portable one is the reference.
+ */
+
+#include "arch/chksum.h"
+
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CHKSUM_X86 1
+#include <immintrin.h>
+#else
+#define CHKSUM_X86 0
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define CHKSUM_NEON 1
+#include <arm_neon.h>
+#else
+#define CHKSUM_NEON 0
+#endif
+
+/* Fold a 64-bit sum to 16 bits (end-around carry) */
+static uint16_t
+chksum_fold(uint64_t sum)
+{
+  while (sum >> 16) {
+    sum = (sum & 0xffff) + (sum >> 16);
+  }
+  return (uint16_t)sum;
+}
+
+/* Add the remaining bytes (less than 8 after the main loops), a trailing
+ * odd byte is the first byte of a zero-padded 16-bit word */
+static uint64_t
+chksum_add_tail(uint64_t sum, const uint8_t *src, uint8_t *dst, int len)
+{
+  uint32_t w;
+  uint16_t t;
+
+  if (len >= 4) {
+    memcpy(&w, src, 4);
+    sum += w;
+    if (dst != NULL) {
+      memcpy(dst, &w, 4);
+      dst += 4;
+    }
+    src += 4;
+    len -= 4;
+  }
+  if (len >= 2) {
+    memcpy(&t, src, 2);
+    sum += t;
+    if (dst != NULL) {
+      memcpy(dst, &t, 2);
+      dst += 2;
+    }
+    src += 2;
+    len -= 2;
+  }
+  if (len > 0) {
+    t = 0;
+    ((uint8_t *)&t)[0] = *src;
+    sum += t;
+    if (dst != NULL) {
+      *dst = *src;
+    }
+  }
+  return sum;
+}
+
+/* Portable kernel: 16 bytes per iteration. dst may be NULL (no copy). */
+static uint64_t
+chksum_add_scalar(uint64_t sum, const uint8_t *src, uint8_t *dst, int len)
+{
+  uint64_t d0, d1, sum1 = 0;
+
+  while (len >= 16) {
+    memcpy(&d0, src, 8);
+    memcpy(&d1, src + 8, 8);
+    sum += (d0 & 0xffffffffUL) + (d0 >> 32);
+    sum1 += (d1 & 0xffffffffUL) + (d1 >> 32);
+    if (dst != NULL) {
+      memcpy(dst, &d0, 8);
+      memcpy(dst + 8, &d1, 8);
+      dst += 16;
+    }
+    src += 16;
+    len -= 16;
+  }
+  if (len >= 8) {
+    memcpy(&d0, src, 8);
+    sum += (d0 & 0xffffffffUL) + (d0 >> 32);
+    if (dst != NULL) {
+      memcpy(dst, &d0, 8);
+      dst += 8;
+    }
+    src += 8;
+    len -= 8;
+  }
+  return chksum_add_tail(sum + sum1, src, dst, len);
+}
+
+static uint16_t
+chksum_scalar(const void *dataptr, int len)
+{
+  return chksum_fold(chksum_add_scalar(0, (const uint8_t *)dataptr, NULL, len));
+}
+
+static uint16_t
+chksum_copy_scalar(void *dst, const void *src, uint16_t len)
+{
+  return chksum_fold(chksum_add_scalar(0, (const uint8_t *)src, (uint8_t *)dst, len));
+}
+
+#if CHKSUM_X86
+/* SSE2: 32 bytes per iteration, 32-bit words zero-extended to 64-bit lanes */
+__attribute__((target("sse2")))
+static uint64_t
+chksum_add_sse2(const uint8_t *src, uint8_t *dst, int len)
+{
+  const __m128i zero = _mm_setzero_si128();
+  __m128i acc0 = zero, acc1 = zero, v0, v1;
+  uint64_t lanes[2];
+
+  while (len >= 32) {
+    v0 = _mm_loadu_si128((const __m128i *)(const void *)src);
+    v1 = _mm_loadu_si128((const __m128i *)(const void *)(src + 16));
+    if (dst != NULL) {
+      _mm_storeu_si128((__m128i *)(void *)dst, v0);
+      _mm_storeu_si128((__m128i *)(void *)(dst + 16), v1);
+      dst += 32;
+    }
+    acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v0, zero));
+    acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v0, zero));
+    acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v1, zero));
+    acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v1, zero));
+    src += 32;
+    len -= 32;
+  }
+  _mm_storeu_si128((__m128i *)(void *)lanes, _mm_add_epi64(acc0, acc1));
+  return chksum_add_scalar(lanes[0] + lanes[1], src, dst, len);
+}
+
+static uint16_t
+chksum_sse2(const void *dataptr, int len)
+{
+  return chksum_fold(chksum_add_sse2((const uint8_t *)dataptr, NULL, len));
+}
+
+static uint16_t
+chksum_copy_sse2(void *dst, const void *src, uint16_t len)
+{
+  return chksum_fold(chksum_add_sse2((const uint8_t *)src, (uint8_t *)dst, len));
+}
+
+/* AVX2: 64 bytes per iteration */
+__attribute__((target("avx2")))
+static uint64_t
+chksum_add_avx2(const uint8_t *src, uint8_t *dst, int len)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i acc0 = zero, acc1 = zero, v0, v1;
+  uint64_t lanes[2];
+
+  while (len >= 64) {
+    v0 = _mm256_loadu_si256((const __m256i *)(const void *)src);
+    v1 = _mm256_loadu_si256((const __m256i *)(const void *)(src + 32));
+    if (dst != NULL) {
+      _mm256_storeu_si256((__m256i *)(void *)dst, v0);
+      _mm256_storeu_si256((__m256i *)(void *)(dst + 32), v1);
+      dst += 64;
+    }
+    acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v0, zero));
+    acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v0, zero));
+    acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v1, zero));
+    acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v1, zero));
+    src += 64;
+    len -= 64;
+  }
+  if (len >= 32) {
+    v0 = _mm256_loadu_si256((const __m256i *)(const void *)src);
+    if (dst != NULL) {
+      _mm256_storeu_si256((__m256i *)(void *)dst, v0);
+      dst += 32;
+    }
+    acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v0, zero));
+    acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v0, zero));
+    src += 32;
+    len -= 32;
+  }
+  acc0 = _mm256_add_epi64(acc0, acc1);
+  /* through memory: the 64-bit lane extracts do not exist on i386 */
+  _mm_storeu_si128((__m128i *)(void *)lanes,
+                   _mm_add_epi64(_mm256_castsi256_si128(acc0), _mm256_extracti128_si256(acc0, 1)));
+  /* gcc does not clear the upper halves before the tail call, the SSE code
+     in the scalar tail would pay for the state transition on every call */
+  _mm256_zeroupper();
+  return chksum_add_scalar(lanes[0] + lanes[1], src, dst, len);
+}
+
+static uint16_t
+chksum_avx2(const void *dataptr, int len)
+{
+  return chksum_fold(chksum_add_avx2((const uint8_t *)dataptr, NULL, len));
+}
+
+static uint16_t
+chksum_copy_avx2(void *dst, const void *src, uint16_t len)
+{
+  return chksum_fold(chksum_add_avx2((const uint8_t *)src, (uint8_t *)dst, len));
+}
+#endif /* CHKSUM_X86 */
+
+#if CHKSUM_NEON
+/* NEON: 32 bytes per iteration, pairwise widening adds into 64-bit lanes */
+static uint64_t
+chksum_add_neon(const uint8_t *src, uint8_t *dst, int len)
+{
+  uint64x2_t acc0 = vdupq_n_u64(0), acc1 = vdupq_n_u64(0);
+  uint8x16_t v0, v1;
+
+  while (len >= 32) {
+    v0 = vld1q_u8(src);
+    v1 = vld1q_u8(src + 16);
+    if (dst != NULL) {
+      vst1q_u8(dst, v0);
+      vst1q_u8(dst + 16, v1);
+      dst += 32;
+    }
+    acc0 = vpadalq_u32(acc0, vreinterpretq_u32_u8(v0));
+    acc1 = vpadalq_u32(acc1, vreinterpretq_u32_u8(v1));
+    src += 32;
+    len -= 32;
+  }
+  acc0 = vaddq_u64(acc0, acc1);
+  return chksum_add_scalar(vgetq_lane_u64(acc0, 0) + vgetq_lane_u64(acc0, 1), src, dst, len);
+}
+
+static uint16_t
+chksum_neon(const void *dataptr, int len)
+{
+  return chksum_fold(chksum_add_neon((const uint8_t *)dataptr, NULL, len));
+}
+
+static uint16_t
+chksum_copy_neon(void *dst, const void *src, uint16_t len)
+{
+  return chksum_fold(chksum_add_neon((const uint8_t *)src, (uint8_t *)dst, len));
+}
+#endif /* CHKSUM_NEON */
+
+/* All kernels, each one needs the CPU features of the ones before it */
+static const struct lwip_unix_chksum_impl chksum_impls[] = {
+  { "scalar", chksum_scalar, chksum_copy_scalar },
+#if CHKSUM_X86
+  { "sse2", chksum_sse2, chksum_copy_sse2 },
+  { "avx2", chksum_avx2, chksum_copy_avx2 },
+#endif /* CHKSUM_X86 */
+#if CHKSUM_NEON
+  { "neon", chksum_neon, chksum_copy_neon },
+#endif /* CHKSUM_NEON */
+};
+
+/* kernels used by lwip_unix_chksum(), set on first use */
+static const struct lwip_unix_chksum_impl *chksum_impl;
+static int chksum_num_impls;
+
+const struct lwip_unix_chksum_impl *
+lwip_unix_chksum_impls(int *num)
+{
+  int n = 1;
+
+  if (chksum_num_impls == 0) {
+#if CHKSUM_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+      n++;
+      if (__builtin_cpu_supports("avx2")) {
+        n++;
+      }
+    }
+#elif CHKSUM_NEON
+    n++;
+#endif
+    chksum_impl = &chksum_impls[n - 1];
+    chksum_num_impls = n;
+  }
+  if (num != NULL) {
+    *num = chksum_num_impls;
+  }
+  return chksum_impls;
+}
+
+uint16_t
+lwip_unix_chksum(const void *dataptr, int len)
+{
+  if (chksum_impl == NULL) {
+    lwip_unix_chksum_impls(NULL);
+  }
+  return chksum_impl->chksum(dataptr, len);
+}
+
+uint16_t
+lwip_unix_chksum_copy(void *dst, const void *src, uint16_t len)
+{
+  if (chksum_impl == NULL) {
+    lwip_unix_chksum_impls(NULL);
+  }
+  return chksum_impl->chksum_copy(dst, src, len);
+}
@@ -61,6 +61,14 @@
 extern unsigned int lwip_port_rand(void);
 #define LWIP_RAND() (lwip_port_rand())
 
+/* LWIP_UNIX_CHKSUM==1 (in lwipopts.h): use the checksum routines of
+   port/chksum.c, which pick SIMD kernels for this CPU at runtime */
+#if defined(LWIP_UNIX_CHKSUM) && LWIP_UNIX_CHKSUM
+#include "arch/chksum.h"
+#define LWIP_CHKSUM lwip_unix_chksum
+#define LWIP_CHKSUM_COPY(dst, src, len) lwip_unix_chksum_copy(dst, src, len)
+#endif
+
 /* different handling for unit test, normally not needed */
 #ifdef LWIP_NOASSERT_ON_ERROR
 #define LWIP_ERROR(message, expression, handler) do { if (!(expression)) { \
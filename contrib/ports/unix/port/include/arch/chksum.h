@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2001-2003 Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ *
+ */
+#ifndef LWIP_ARCH_CHKSUM_H
+#define LWIP_ARCH_CHKSUM_H
+
+#include <stdint.h>
+
+/* Internet checksum routines with SIMD kernels selected at runtime
+ * (port/chksum.c), used as LWIP_CHKSUM and LWIP_CHKSUM_COPY if
+ * LWIP_UNIX_CHKSUM is defined to 1 in lwipopts.h */
+uint16_t lwip_unix_chksum(const void *dataptr, int len);
+uint16_t lwip_unix_chksum_copy(void *dst, const void *src, uint16_t len);
+
+/* One set of kernels */
+struct lwip_unix_chksum_impl {
+  const char *name;
+  uint16_t (*chksum)(const void *dataptr, int len);
+  uint16_t (*chksum_copy)(void *dst, const void *src, uint16_t len);
+};
+
+/* Get the kernels this CPU supports: the first one is the portable
+ * reference, the last one is used by lwip_unix_chksum() */
+const struct lwip_unix_chksum_impl *lwip_unix_chksum_impls(int *num);
+
+#endif /* LWIP_ARCH_CHKSUM_H */
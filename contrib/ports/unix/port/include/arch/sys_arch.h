@@ -78,4 +78,11 @@ void sys_unlock_tcpip_core(void);
 #define UNLOCK_TCPIP_CORE()        sys_unlock_tcpip_core()
 #endif
 
+#if MEMP_CACHE && !defined(LWIP_HOOK_MEMP_CACHE)
+/* Threads created with sys_thread_new() get a memp cache of their own */
+#define LWIP_UNIX_MEMP_CACHE       1
+extern __thread struct memp_cache *sys_arch_memp_cache;
+#define LWIP_HOOK_MEMP_CACHE()     sys_arch_memp_cache
+#endif
+
 #endif /* LWIP_ARCH_SYS_ARCH_H */
@@ -30,6 +30,7 @@
  *
  */
 
+#include <errno.h>
 #include <fcntl.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -53,6 +54,7 @@
 #include "lwip/pbuf.h"
 #include "lwip/sys.h"
 #include "lwip/timeouts.h"
+#include "lwip/tcpip.h"
 #include "netif/etharp.h"
 #include "lwip/ethip6.h"
 
@@ -80,6 +82,16 @@
 #endif
 #define NETMASK_ARGS "netmask %d.%d.%d.%d"
 #define IFCONFIG_ARGS "tap0 inet %d.%d.%d.%d " NETMASK_ARGS
+#if LWIP_NETIF_TSO
+/* Exchange a virtio_net_hdr with the kernel in front of every frame: this
+ * lets us hand TCP super-segments to the kernel for segmentation (TSO) */
+#define TAPIF_VNET_HDR 1
+#include <linux/virtio_net.h>
+#include "lwip/inet_chksum.h"
+#include "lwip/prot/ethernet.h"
+#include "lwip/prot/ip4.h"
+#include "lwip/prot/tcp.h"
+#endif /* LWIP_NETIF_TSO */
 #elif defined(LWIP_UNIX_OPENBSD)
 #define DEVTAP "/dev/tun0"
 #define NETMASK_ARGS "netmask %d.%d.%d.%d"
@@ -98,6 +110,20 @@
 #define TAPIF_DEBUG LWIP_DBG_OFF
 #endif
 
+#ifndef TAPIF_VNET_HDR
+#define TAPIF_VNET_HDR 0
+#endif
+
+#ifndef TAPIF_RX_BATCH
+/* max. number of frames read per wakeup of tapif_thread */
+#define TAPIF_RX_BATCH TCPIP_INPUT_BATCH_SIZE
+#endif
+
+#if TAPIF_VNET_HDR
+/* max. number of pbufs written with one writev() call */
+#define TAPIF_MAX_IOV 64
+#endif /* TAPIF_VNET_HDR */
+
 struct tapif {
   /* Add whatever per-interface state that is needed here. */
   int fd;
@@ -135,6 +161,9 @@ low_level_init(struct netif *netif)
 
   /* device capabilities */
   netif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP | NETIF_FLAG_IGMP;
+#if TAPIF_VNET_HDR
+  netif->flags |= NETIF_FLAG_TSO;
+#endif /* TAPIF_VNET_HDR */
 
   tapif->fd = open(DEVTAP, O_RDWR);
   LWIP_DEBUGF(TAPIF_DEBUG, ("tapif_init: fd %d\n", tapif->fd));
@@ -160,6 +189,9 @@ low_level_init(struct netif *netif)
     ifr.ifr_name[sizeof(ifr.ifr_name)-1] = 0; /* ensure \0 termination */
 
     ifr.ifr_flags = IFF_TAP|IFF_NO_PI;
+#if TAPIF_VNET_HDR
+    ifr.ifr_flags |= IFF_VNET_HDR;
+#endif /* TAPIF_VNET_HDR */
     if (ioctl(tapif->fd, TUNSETIFF, (void *) &ifr) < 0) {
       perror("tapif_init: "DEVTAP" ioctl TUNSETIFF");
       exit(1);
@@ -167,6 +199,14 @@ low_level_init(struct netif *netif)
   }
 #endif /* LWIP_UNIX_LINUX */
 
+#if !NO_SYS
+  /* tapif_thread reads until the device is drained */
+  if (fcntl(tapif->fd, F_SETFL, fcntl(tapif->fd, F_GETFL) | O_NONBLOCK) < 0) {
+    perror("tapif_init: fcntl O_NONBLOCK");
+    exit(1);
+  }
+#endif /* !NO_SYS */
+
   netif_set_link_up(netif);
 
   if (preconfigured_tapif == NULL) {
@@ -215,6 +255,100 @@ low_level_init(struct netif *netif)
  */
 /*-----------------------------------------------------------------------------------*/
 
+#if TAPIF_VNET_HDR
+/* Fill in the virtio_net_hdr for a frame: TCP super-segments (see
+ * LWIP_NETIF_TSO) are segmented and checksummed by the kernel, which
+ * expects the TCP checksum field to contain the pseudo header sum. */
+static err_t
+tapif_vnet_hdr(struct pbuf *p, struct virtio_net_hdr *hdr)
+{
+  struct eth_hdr *ethhdr;
+  struct ip_hdr *iphdr;
+  struct tcp_hdr *tcphdr;
+  u16_t ip_hlen, hdr_len;
+  ip4_addr_t src, dest;
+
+  memset(hdr, 0, sizeof(*hdr));
+  if (p->gso_size == 0) {
+    return ERR_OK;
+  }
+  ethhdr = (struct eth_hdr *)p->payload;
+  if ((p->len < SIZEOF_ETH_HDR + IP_HLEN) || (ethhdr->type != PP_HTONS(ETHTYPE_IP))) {
+    return ERR_VAL;
+  }
+  iphdr = (struct ip_hdr *)((u8_t *)p->payload + SIZEOF_ETH_HDR);
+  ip_hlen = IPH_HL_BYTES(iphdr);
+  if (p->len < SIZEOF_ETH_HDR + ip_hlen + TCP_HLEN) {
+    return ERR_VAL;
+  }
+  tcphdr = (struct tcp_hdr *)((u8_t *)iphdr + ip_hlen);
+  hdr_len = (u16_t)(SIZEOF_ETH_HDR + ip_hlen + TCPH_HDRLEN_BYTES(tcphdr));
+  if (p->len < hdr_len) {
+    return ERR_VAL;
+  }
+
+  hdr->flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+  hdr->gso_type = VIRTIO_NET_HDR_GSO_TCPV4;
+  hdr->hdr_len = hdr_len;
+  hdr->gso_size = p->gso_size;
+  hdr->csum_start = (u16_t)(SIZEOF_ETH_HDR + ip_hlen);
+  hdr->csum_offset = 16; /* offsetof(struct tcp_hdr, chksum) */
+  ip4_addr_copy(src, iphdr->src);
+  ip4_addr_copy(dest, iphdr->dest);
+  tcphdr->chksum = (u16_t)~inet_chksum_pseudo_partial(p, IP_PROTO_TCP,
+                     (u16_t)(p->tot_len - SIZEOF_ETH_HDR - ip_hlen), 0, &src, &dest);
+  return ERR_OK;
+}
+
+static err_t
+low_level_output(struct netif *netif, struct pbuf *p)
+{
+  struct tapif *tapif = (struct tapif *)netif->state;
+  struct virtio_net_hdr hdr;
+  struct iovec iov[TAPIF_MAX_IOV];
+  struct pbuf *q, *linear = NULL;
+  int iovcnt;
+  ssize_t written;
+
+  if (tapif_vnet_hdr(p, &hdr) != ERR_OK) {
+    MIB2_STATS_NETIF_INC(netif, ifoutdiscards);
+    LWIP_DEBUGF(TAPIF_DEBUG, ("tapif: invalid super-segment\n"));
+    return ERR_IF;
+  }
+  if (pbuf_clen(p) >= TAPIF_MAX_IOV) {
+    /* too many pbufs for one writev(): copy into one */
+    linear = pbuf_clone(PBUF_RAW, PBUF_RAM, p);
+    if (linear == NULL) {
+      MIB2_STATS_NETIF_INC(netif, ifoutdiscards);
+      return ERR_MEM;
+    }
+    p = linear;
+  }
+
+  /* scatter-gather: write the header followed by all pbufs */
+  iov[0].iov_base = &hdr;
+  iov[0].iov_len = sizeof(hdr);
+  iovcnt = 1;
+  for (q = p; q != NULL; q = q->next) {
+    iov[iovcnt].iov_base = q->payload;
+    iov[iovcnt].iov_len = q->len;
+    iovcnt++;
+  }
+
+  written = writev(tapif->fd, iov, iovcnt);
+  if (linear != NULL) {
+    pbuf_free(linear);
+  }
+  if (written < (ssize_t)(sizeof(hdr) + p->tot_len)) {
+    MIB2_STATS_NETIF_INC(netif, ifoutdiscards);
+    perror("tapif: writev");
+    return ERR_IF;
+  } else {
+    MIB2_STATS_NETIF_ADD(netif, ifoutoctets, (u32_t)(written - sizeof(hdr)));
+    return ERR_OK;
+  }
+}
+#else /* TAPIF_VNET_HDR */
 static err_t
 low_level_output(struct netif *netif, struct pbuf *p)
 {
@@ -249,6 +383,7 @@ low_level_output(struct netif *netif, struct pbuf *p)
     return ERR_OK;
   }
 }
+#endif /* TAPIF_VNET_HDR */
 /*-----------------------------------------------------------------------------------*/
 /*
  * low_level_input():
@@ -269,8 +404,28 @@ low_level_input(struct netif *netif)
 
   /* Obtain the size of the packet and put it into the "len"
      variable. */
+#if TAPIF_VNET_HDR
+  {
+    /* no offloads are enabled for receiving: the header can be ignored */
+    struct virtio_net_hdr hdr;
+    struct iovec iov[2];
+    iov[0].iov_base = &hdr;
+    iov[0].iov_len = sizeof(hdr);
+    iov[1].iov_base = buf;
+    iov[1].iov_len = sizeof(buf);
+    readlen = readv(tapif->fd, iov, 2);
+    if (readlen >= (ssize_t)sizeof(hdr)) {
+      readlen -= (ssize_t)sizeof(hdr);
+    }
+  }
+#else /* TAPIF_VNET_HDR */
   readlen = read(tapif->fd, buf, sizeof(buf));
+#endif /* TAPIF_VNET_HDR */
   if (readlen < 0) {
+    if (errno == EAGAIN) {
+      /* no more frames (non-blocking mode) */
+      return NULL;
+    }
     perror("read returned -1");
     exit(1);
   }
@@ -402,6 +557,32 @@ tapif_select(struct netif *netif)
 
 #else /* NO_SYS */
 
+/* Pass a batch of received frames to netif->input */
+static void
+tapif_input_batch(struct netif *netif, struct pbuf **p, u16_t num)
+{
+  u16_t i;
+
+#if LWIP_TCPIP_INPUT_BATCH
+  if (netif->input == tcpip_input) {
+    /* one message to tcpip_thread for all of them */
+    if (tcpip_input_batch(p, num, netif) != ERR_OK) {
+      LWIP_DEBUGF(NETIF_DEBUG, ("tapif_input: netif input error\n"));
+      for (i = 0; i < num; i++) {
+        pbuf_free(p[i]);
+      }
+    }
+    return;
+  }
+#endif /* LWIP_TCPIP_INPUT_BATCH */
+  for (i = 0; i < num; i++) {
+    if (netif->input(p[i], netif) != ERR_OK) {
+      LWIP_DEBUGF(NETIF_DEBUG, ("tapif_input: netif input error\n"));
+      pbuf_free(p[i]);
+    }
+  }
+}
+
 static void
 tapif_thread(void *arg)
 {
@@ -409,6 +590,8 @@ tapif_thread(void *arg)
   struct tapif *tapif;
   fd_set fdset;
   int ret;
+  struct pbuf *batch[TAPIF_RX_BATCH];
+  u16_t num;
 
   netif = (struct netif *)arg;
   tapif = (struct tapif *)netif->state;
@@ -421,8 +604,17 @@ tapif_thread(void *arg)
     ret = select(tapif->fd + 1, &fdset, NULL, NULL, NULL);
 
     if(ret == 1) {
-      /* Handle incoming packet. */
-      tapif_input(netif);
+      /* Handle incoming packets: read what is there (up to TAPIF_RX_BATCH
+         frames, stopping early if no pbuf is left) and pass it on at once. */
+      for (num = 0; num < TAPIF_RX_BATCH; num++) {
+        batch[num] = low_level_input(netif);
+        if (batch[num] == NULL) {
+          break;
+        }
+      }
+      if (num > 0) {
+        tapif_input_batch(netif, batch, num);
+      }
     } else if(ret == -1) {
       perror("tapif_thread: select");
     }
@@ -67,10 +67,33 @@
 #include "lwip/opt.h"
 #include "lwip/stats.h"
 #include "lwip/tcpip.h"
+#include "lwip/memp.h"
 
 /* Return code for an interrupted timed wait */
 #define SYS_ARCH_INTR 0xfffffffeUL
 
+/* LWIP_UNIX_MBOX_LOCKFREE==1: use a lock-free ring for mboxes (multiple
+ * posting and fetching threads). Waiting threads spin for
+ * LWIP_UNIX_MBOX_SPIN rounds (on multi-core systems only) before they block
+ * on a futex, the other side only makes a system call to wake up a blocked
+ * thread. Linux only. */
+#ifndef LWIP_UNIX_MBOX_LOCKFREE
+#define LWIP_UNIX_MBOX_LOCKFREE 0
+#endif
+
+#ifndef LWIP_UNIX_MBOX_SPIN
+#define LWIP_UNIX_MBOX_SPIN 1000
+#endif
+
+#if LWIP_UNIX_MBOX_LOCKFREE
+#ifndef LWIP_UNIX_LINUX
+#error "LWIP_UNIX_MBOX_LOCKFREE needs futex support (Linux)"
+#endif
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif /* LWIP_UNIX_MBOX_LOCKFREE */
+
 u32_t
 lwip_port_rand(void)
 {
@@ -106,6 +129,10 @@ static int lwprot_count = 0;
 static struct sys_thread *threads = NULL;
 static pthread_mutex_t threads_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+#ifdef LWIP_UNIX_MEMP_CACHE
+__thread struct memp_cache *sys_arch_memp_cache;
+#endif
+
 struct sys_mbox_msg {
   struct sys_mbox_msg *next;
   void *msg;
@@ -113,6 +140,33 @@ struct sys_mbox_msg {
 
 #define SYS_MBOX_SIZE 128
 
+#if LWIP_UNIX_MBOX_LOCKFREE
+/* A bounded queue with one sequence number per slot (D. Vyukov): a slot
+ * with seq == pos is free for the poster claiming pos, seq == pos + 1 means
+ * it holds the message for pos. All counters wrap. */
+struct sys_mbox_slot {
+  u32_t seq;
+  void *msg;
+};
+
+struct sys_mbox {
+  /* next position to post to, claimed by posting threads with CAS */
+  u32_t head;
+  /* number of posting threads sleeping on a full mbox */
+  u32_t post_wait;
+  /* bumped to wake posting threads (futex word) */
+  u32_t post_seq;
+  char pad1[64 - 3 * sizeof(u32_t)];
+  /* next position to fetch from, claimed by fetching threads with CAS */
+  u32_t tail;
+  /* number of fetching threads sleeping on an empty mbox */
+  u32_t fetch_wait;
+  /* bumped to wake fetching threads (futex word) */
+  u32_t fetch_seq;
+  char pad2[64 - 3 * sizeof(u32_t)];
+  struct sys_mbox_slot slots[SYS_MBOX_SIZE];
+};
+#else /* LWIP_UNIX_MBOX_LOCKFREE */
 struct sys_mbox {
   int first, last;
   void *msgs[SYS_MBOX_SIZE];
@@ -121,6 +175,7 @@ struct sys_mbox {
   struct sys_sem *mutex;
   int wait_send;
 };
+#endif /* LWIP_UNIX_MBOX_LOCKFREE */
 
 struct sys_sem {
   unsigned int c;
@@ -175,8 +230,21 @@ thread_wrapper(void *arg)
 {
   struct thread_wrapper_data *thread_data = (struct thread_wrapper_data *)arg;
 
+#ifdef LWIP_UNIX_MEMP_CACHE
+  /* without a cache (out of memory) the thread uses the pools directly */
+  sys_arch_memp_cache = (struct memp_cache *)calloc(1, sizeof(struct memp_cache));
+#endif
+
   thread_data->function(thread_data->arg);
 
+#ifdef LWIP_UNIX_MEMP_CACHE
+  if (sys_arch_memp_cache != NULL) {
+    memp_cache_flush(sys_arch_memp_cache);
+    free(sys_arch_memp_cache);
+    sys_arch_memp_cache = NULL;
+  }
+#endif
+
   /* we should never get here */
   free(arg);
   return NULL;
@@ -255,6 +323,288 @@ void sys_check_core_locking(void)
 
 /*-----------------------------------------------------------------------------------*/
 /* Mailbox */
+#if LWIP_UNIX_MBOX_LOCKFREE
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SYS_MBOX_CPU_RELAX() __builtin_ia32_pause()
+#else
+#define SYS_MBOX_CPU_RELAX()
+#endif
+
+/* spinning only helps if the other side can run at the same time */
+static int mbox_spin = -1;
+
+static int
+mbox_futex_wait(u32_t *addr, u32_t val, const struct timespec *timeout)
+{
+  return (int)syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, timeout, NULL, 0);
+}
+
+static void
+mbox_futex_wake(u32_t *addr, int num)
+{
+  syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, num, NULL, NULL, 0);
+}
+
+/* Claim a slot and store the message, returns 0 if the mbox is full */
+static int
+mbox_enqueue(struct sys_mbox *mbox, void *msg)
+{
+  struct sys_mbox_slot *slot;
+  u32_t pos, seq;
+  s32_t dif;
+
+  pos = __atomic_load_n(&mbox->head, __ATOMIC_RELAXED);
+  for (;;) {
+    slot = &mbox->slots[pos % SYS_MBOX_SIZE];
+    seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    dif = (s32_t)(seq - pos);
+    if (dif == 0) {
+      if (__atomic_compare_exchange_n(&mbox->head, &pos, pos + 1, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+    } else if (dif < 0) {
+      return 0;
+    } else {
+      pos = __atomic_load_n(&mbox->head, __ATOMIC_RELAXED);
+    }
+  }
+  slot->msg = msg;
+  /* publish, then see if fetching threads need a wakeup: seq_cst pairs
+     with the counter and the check in mbox_wait_not_empty() */
+  __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&mbox->fetch_wait, __ATOMIC_SEQ_CST)) {
+    /* wake all of them: one that is about to time out must not swallow
+       the wakeup, the others go back to sleep if the message is taken */
+    __atomic_add_fetch(&mbox->fetch_seq, 1, __ATOMIC_SEQ_CST);
+    mbox_futex_wake(&mbox->fetch_seq, INT_MAX);
+  }
+  return 1;
+}
+
+/* Claim the next message, returns 0 if the mbox is empty */
+static int
+mbox_dequeue(struct sys_mbox *mbox, void **msg)
+{
+  struct sys_mbox_slot *slot;
+  u32_t pos, seq;
+  s32_t dif;
+
+  pos = __atomic_load_n(&mbox->tail, __ATOMIC_RELAXED);
+  for (;;) {
+    slot = &mbox->slots[pos % SYS_MBOX_SIZE];
+    seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    dif = (s32_t)(seq - (pos + 1));
+    if (dif == 0) {
+      if (__atomic_compare_exchange_n(&mbox->tail, &pos, pos + 1, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+    } else if (dif < 0) {
+      return 0;
+    } else {
+      pos = __atomic_load_n(&mbox->tail, __ATOMIC_RELAXED);
+    }
+  }
+  if (msg != NULL) {
+    *msg = slot->msg;
+  }
+  /* free the slot, then see if posting threads need a wakeup: seq_cst pairs
+     with the counter and the retry in sys_mbox_post() */
+  __atomic_store_n(&slot->seq, pos + SYS_MBOX_SIZE, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&mbox->post_wait, __ATOMIC_SEQ_CST)) {
+    /* wake blocked posters once there is room for a burst of messages,
+       not for every single free slot (fetching threads do not block
+       before the mbox is empty) */
+    if ((u32_t)(__atomic_load_n(&mbox->head, __ATOMIC_RELAXED) - (pos + 1)) <= SYS_MBOX_SIZE / 2) {
+      __atomic_add_fetch(&mbox->post_seq, 1, __ATOMIC_SEQ_CST);
+      mbox_futex_wake(&mbox->post_seq, INT_MAX);
+    }
+  }
+  return 1;
+}
+
+static int
+mbox_has_msg(struct sys_mbox *mbox)
+{
+  u32_t pos = __atomic_load_n(&mbox->tail, __ATOMIC_SEQ_CST);
+  return __atomic_load_n(&mbox->slots[pos % SYS_MBOX_SIZE].seq, __ATOMIC_SEQ_CST) == pos + 1;
+}
+
+/* Wait until a message is available or the (absolute) deadline passed.
+ * Another fetching thread may still take the message first.
+ * Returns 0 on timeout. */
+static int
+mbox_wait_not_empty(struct sys_mbox *mbox, const struct timespec *deadline)
+{
+  struct timespec now, rel;
+  u32_t seq;
+  int i, ret;
+
+  for (i = 0; i < mbox_spin; i++) {
+    if (mbox_has_msg(mbox)) {
+      return 1;
+    }
+    SYS_MBOX_CPU_RELAX();
+  }
+  __atomic_add_fetch(&mbox->fetch_wait, 1, __ATOMIC_SEQ_CST);
+  for (;;) {
+    seq = __atomic_load_n(&mbox->fetch_seq, __ATOMIC_SEQ_CST);
+    if (mbox_has_msg(mbox)) {
+      ret = 1;
+      break;
+    }
+    if (deadline != NULL) {
+      get_monotonic_time(&now);
+      rel.tv_sec = deadline->tv_sec - now.tv_sec;
+      rel.tv_nsec = deadline->tv_nsec - now.tv_nsec;
+      if (rel.tv_nsec < 0) {
+        rel.tv_sec--;
+        rel.tv_nsec += 1000000000L;
+      }
+      if (rel.tv_sec < 0) {
+        ret = 0;
+        break;
+      }
+      mbox_futex_wait(&mbox->fetch_seq, seq, &rel);
+    } else {
+      mbox_futex_wait(&mbox->fetch_seq, seq, NULL);
+    }
+  }
+  __atomic_sub_fetch(&mbox->fetch_wait, 1, __ATOMIC_SEQ_CST);
+  return ret;
+}
+
+err_t
+sys_mbox_new(struct sys_mbox **mb, int size)
+{
+  struct sys_mbox *mbox;
+  u32_t i;
+  LWIP_UNUSED_ARG(size);
+
+  if (mbox_spin < 0) {
+    mbox_spin = (sysconf(_SC_NPROCESSORS_ONLN) > 1) ? LWIP_UNIX_MBOX_SPIN : 0;
+  }
+  mbox = (struct sys_mbox *)malloc(sizeof(struct sys_mbox));
+  if (mbox == NULL) {
+    return ERR_MEM;
+  }
+  memset(mbox, 0, sizeof(struct sys_mbox));
+  for (i = 0; i < SYS_MBOX_SIZE; i++) {
+    mbox->slots[i].seq = i;
+  }
+
+  SYS_STATS_INC_USED(mbox);
+  *mb = mbox;
+  return ERR_OK;
+}
+
+void
+sys_mbox_free(struct sys_mbox **mb)
+{
+  if ((mb != NULL) && (*mb != SYS_MBOX_NULL)) {
+    SYS_STATS_DEC(mbox.used);
+    free(*mb);
+  }
+}
+
+err_t
+sys_mbox_trypost(struct sys_mbox **mb, void *msg)
+{
+  LWIP_ASSERT("invalid mbox", (mb != NULL) && (*mb != NULL));
+
+  LWIP_DEBUGF(SYS_DEBUG, ("sys_mbox_trypost: mbox %p msg %p\n",
+                          (void *)*mb, (void *)msg));
+
+  if (!mbox_enqueue(*mb, msg)) {
+    return ERR_MEM;
+  }
+  return ERR_OK;
+}
+
+err_t
+sys_mbox_trypost_fromisr(sys_mbox_t *q, void *msg)
+{
+  return sys_mbox_trypost(q, msg);
+}
+
+void
+sys_mbox_post(struct sys_mbox **mb, void *msg)
+{
+  struct sys_mbox *mbox;
+  u32_t seq;
+  int i;
+  LWIP_ASSERT("invalid mbox", (mb != NULL) && (*mb != NULL));
+  mbox = *mb;
+
+  LWIP_DEBUGF(SYS_DEBUG, ("sys_mbox_post: mbox %p msg %p\n", (void *)mbox, (void *)msg));
+
+  for (i = 0; i < mbox_spin; i++) {
+    if (mbox_enqueue(mbox, msg)) {
+      return;
+    }
+    SYS_MBOX_CPU_RELAX();
+  }
+  /* full: sleep until fetching threads made room */
+  __atomic_add_fetch(&mbox->post_wait, 1, __ATOMIC_SEQ_CST);
+  for (;;) {
+    seq = __atomic_load_n(&mbox->post_seq, __ATOMIC_SEQ_CST);
+    if (mbox_enqueue(mbox, msg)) {
+      break;
+    }
+    mbox_futex_wait(&mbox->post_seq, seq, NULL);
+  }
+  __atomic_sub_fetch(&mbox->post_wait, 1, __ATOMIC_SEQ_CST);
+}
+
+u32_t
+sys_arch_mbox_tryfetch(struct sys_mbox **mb, void **msg)
+{
+  LWIP_ASSERT("invalid mbox", (mb != NULL) && (*mb != NULL));
+
+  if (!mbox_dequeue(*mb, msg)) {
+    return SYS_MBOX_EMPTY;
+  }
+  LWIP_DEBUGF(SYS_DEBUG, ("sys_mbox_tryfetch: mbox %p msg %p\n", (void *)*mb,
+                          (msg != NULL) ? *msg : NULL));
+  return 0;
+}
+
+u32_t
+sys_arch_mbox_fetch(struct sys_mbox **mb, void **msg, u32_t timeout)
+{
+  struct sys_mbox *mbox;
+  struct timespec start, deadline, now;
+  LWIP_ASSERT("invalid mbox", (mb != NULL) && (*mb != NULL));
+  mbox = *mb;
+
+  if (mbox_dequeue(mbox, msg)) {
+    return 0;
+  }
+  get_monotonic_time(&start);
+  if (timeout != 0) {
+    deadline.tv_sec = start.tv_sec + timeout / 1000L;
+    deadline.tv_nsec = start.tv_nsec + (timeout % 1000L) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+  }
+  do {
+    if (!mbox_wait_not_empty(mbox, (timeout != 0) ? &deadline : NULL)) {
+      return SYS_ARCH_TIMEOUT;
+    }
+    /* another fetching thread may have been faster */
+  } while (!mbox_dequeue(mbox, msg));
+  LWIP_DEBUGF(SYS_DEBUG, ("sys_mbox_fetch: mbox %p msg %p\n", (void *)mbox,
+                          (msg != NULL) ? *msg : NULL));
+
+  get_monotonic_time(&now);
+  return (u32_t)((now.tv_sec - start.tv_sec) * 1000L + (now.tv_nsec - start.tv_nsec) / 1000000L);
+}
+
+#else /* LWIP_UNIX_MBOX_LOCKFREE */
 err_t
 sys_mbox_new(struct sys_mbox **mb, int size)
 {
@@ -397,6 +747,12 @@ sys_arch_mbox_tryfetch(struct sys_mbox **mb, void **msg)
 
   mbox->first++;
 
+  /* Posters only signal not_empty on the first message; hand the wakeup
+     on so another blocked fetcher picks up what is left. */
+  if (mbox->first != mbox->last) {
+    sys_sem_signal(&mbox->not_empty);
+  }
+
   if (mbox->wait_send) {
     sys_sem_signal(&mbox->not_full);
   }
@@ -446,6 +802,12 @@ sys_arch_mbox_fetch(struct sys_mbox **mb, void **msg, u32_t timeout)
 
   mbox->first++;
 
+  /* Posters only signal not_empty on the first message; hand the wakeup
+     on so another blocked fetcher picks up what is left. */
+  if (mbox->first != mbox->last) {
+    sys_sem_signal(&mbox->not_empty);
+  }
+
   if (mbox->wait_send) {
     sys_sem_signal(&mbox->not_full);
   }
@@ -454,6 +816,7 @@ sys_arch_mbox_fetch(struct sys_mbox **mb, void **msg, u32_t timeout)
 
   return time_needed;
 }
+#endif /* LWIP_UNIX_MBOX_LOCKFREE */
 
 /*-----------------------------------------------------------------------------------*/
 /* Semaphore */
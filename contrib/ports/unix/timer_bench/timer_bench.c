@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2001-2003 Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ *
+ */
+
+
+/*
+ * Microbenchmark for the timeout implementation in core/timeouts.c with many
+ * timeouts armed (like per-connection timers): starting, restarting
+ * (stop + start), stopping and expiring NUM timeouts with random delays of up
+ * to 10 minutes. sys_now() is a virtual clock.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lwip/memp.h"
+#include "lwip/timeouts.h"
+
+#define MAX_TIMEOUTS  10000
+#define MAX_DELAY     600000
+
+static struct sys_timeo timeouts[MAX_TIMEOUTS];
+static u32_t virtual_now;
+static u32_t num_expired;
+static u32_t seed = 1;
+
+u32_t
+sys_now(void)
+{
+  return virtual_now;
+}
+
+static u32_t
+bench_rand(void)
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 8;
+}
+
+static double
+now_sec(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void
+handler(void *arg)
+{
+  LWIP_UNUSED_ARG(arg);
+  num_expired++;
+}
+
+static void
+start_all(int num)
+{
+  int i;
+  for (i = 0; i < num; i++) {
+    sys_timeout_start(&timeouts[i], 1 + bench_rand() % MAX_DELAY, handler, &timeouts[i]);
+  }
+}
+
+static void
+bench(int num)
+{
+  double t0, t_start, t_restart, t_stop, t_expire;
+  int i;
+
+  memset(timeouts, 0, sizeof(timeouts));
+  virtual_now = 0;
+
+  t0 = now_sec();
+  start_all(num);
+  t_start = now_sec() - t0;
+
+  t0 = now_sec();
+  start_all(num);
+  t_restart = now_sec() - t0;
+
+  t0 = now_sec();
+  for (i = 0; i < num; i++) {
+    sys_timeout_stop(&timeouts[i]);
+  }
+  t_stop = now_sec() - t0;
+
+  start_all(num);
+  num_expired = 0;
+  t0 = now_sec();
+  while (sys_timeouts_sleeptime() != SYS_TIMEOUTS_SLEEPTIME_INFINITE) {
+    virtual_now += sys_timeouts_sleeptime();
+    sys_check_timeouts();
+  }
+  t_expire = now_sec() - t0;
+  if (num_expired != (u32_t)num) {
+    printf("expired %u of %d timeouts\n", (unsigned)num_expired, num);
+    exit(1);
+  }
+
+  printf("%5d timeouts: start %8.1f  restart %8.1f  stop %8.1f  expire %8.1f ns/timeout\n", num,
+         t_start * 1e9 / num, t_restart * 1e9 / num, t_stop * 1e9 / num, t_expire * 1e9 / num);
+}
+
+int
+main(void)
+{
+  memp_init();
+  bench(100);
+  bench(1000);
+  bench(MAX_TIMEOUTS);
+  return 0;
+}
@@ -39,6 +39,7 @@ set(lwipcore_SRCS
     ${LWIP_DIR}/src/core/init.c
     ${LWIP_DIR}/src/core/def.c
     ${LWIP_DIR}/src/core/dns.c
+    ${LWIP_DIR}/src/core/gro.c
     ${LWIP_DIR}/src/core/inet_chksum.c
     ${LWIP_DIR}/src/core/ip.c
     ${LWIP_DIR}/src/core/mem.c
@@ -52,8 +53,11 @@ set(lwipcore_SRCS
     ${LWIP_DIR}/src/core/altcp_alloc.c
     ${LWIP_DIR}/src/core/altcp_tcp.c
     ${LWIP_DIR}/src/core/tcp.c
+    ${LWIP_DIR}/src/core/tcp_cc.c
     ${LWIP_DIR}/src/core/tcp_in.c
     ${LWIP_DIR}/src/core/tcp_out.c
+    ${LWIP_DIR}/src/core/tcp_rack.c
+    ${LWIP_DIR}/src/core/tcp_tw.c
     ${LWIP_DIR}/src/core/timeouts.c
     ${LWIP_DIR}/src/core/udp.c
 )
@@ -64,6 +68,7 @@ set(lwipcore4_SRCS
     ${LWIP_DIR}/src/core/ipv4/etharp.c
     ${LWIP_DIR}/src/core/ipv4/icmp.c
     ${LWIP_DIR}/src/core/ipv4/igmp.c
+    ${LWIP_DIR}/src/core/ipv4/ip4_fib.c
     ${LWIP_DIR}/src/core/ipv4/ip4_frag.c
     ${LWIP_DIR}/src/core/ipv4/ip4.c
     ${LWIP_DIR}/src/core/ipv4/ip4_addr.c
@@ -33,6 +33,7 @@
 COREFILES=$(LWIPDIR)/core/init.c \
 	$(LWIPDIR)/core/def.c \
 	$(LWIPDIR)/core/dns.c \
+	$(LWIPDIR)/core/gro.c \
 	$(LWIPDIR)/core/inet_chksum.c \
 	$(LWIPDIR)/core/ip.c \
 	$(LWIPDIR)/core/mem.c \
@@ -46,8 +47,11 @@ COREFILES=$(LWIPDIR)/core/init.c \
 	$(LWIPDIR)/core/altcp_alloc.c \
 	$(LWIPDIR)/core/altcp_tcp.c \
 	$(LWIPDIR)/core/tcp.c \
+	$(LWIPDIR)/core/tcp_cc.c \
 	$(LWIPDIR)/core/tcp_in.c \
 	$(LWIPDIR)/core/tcp_out.c \
+	$(LWIPDIR)/core/tcp_rack.c \
+	$(LWIPDIR)/core/tcp_tw.c \
 	$(LWIPDIR)/core/timeouts.c \
 	$(LWIPDIR)/core/udp.c
 
@@ -57,6 +61,7 @@ CORE4FILES=$(LWIPDIR)/core/ipv4/acd.c \
 	$(LWIPDIR)/core/ipv4/etharp.c \
 	$(LWIPDIR)/core/ipv4/icmp.c \
 	$(LWIPDIR)/core/ipv4/igmp.c \
+	$(LWIPDIR)/core/ipv4/ip4_fib.c \
 	$(LWIPDIR)/core/ipv4/ip4_frag.c \
 	$(LWIPDIR)/core/ipv4/ip4.c \
 	$(LWIPDIR)/core/ipv4/ip4_addr.c
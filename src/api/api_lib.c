@@ -104,6 +104,8 @@
 #endif /* LWIP_NETCONN_FULLDUPLEX */
 
 static err_t netconn_close_shutdown(struct netconn *conn, u8_t how);
+static err_t netconn_write_vectors_internal(struct netconn *conn, struct netvector *vectors, u16_t vectorcnt,
+                                            u8_t apiflags, struct pbuf *ref, size_t *bytes_written);
 
 /**
  * Call the lower part of a netconn_* function
@@ -847,6 +849,47 @@ netconn_recv_udp_raw_netbuf_flags(struct netconn *conn, struct netbuf **new_buf,
   return netconn_recv_data(conn, (void **)new_buf, apiflags);
 }
 
+/**
+ * @ingroup netconn_udp
+ * Receive several netbufs from a UDP or RAW netconn in one call: waits for
+ * the first one (unless apiflags contains NETCONN_DONTBLOCK), then takes
+ * whatever else is already queued in the recvmbox without waiting.
+ *
+ * @param conn the netconn from which to receive data
+ * @param new_bufs array where the received netbufs are stored
+ * @param count in: size of new_bufs, out: number of netbufs received
+ * @param apiflags flags that control function behaviour. For now only:
+ * - NETCONN_DONTBLOCK: only read data that is available now, don't wait for more data
+ * @return ERR_OK if at least one netbuf has been received, otherwise the
+ *         error of netconn_recv_udp_raw_netbuf_flags()
+ */
+err_t
+netconn_recv_udp_raw_netbufs(struct netconn *conn, struct netbuf **new_bufs, u16_t *count, u8_t apiflags)
+{
+  u16_t i, max;
+  err_t err;
+
+  LWIP_ERROR("netconn_recv_udp_raw_netbufs: invalid count", (count != NULL) && (*count > 0), return ERR_ARG;);
+  LWIP_ERROR("netconn_recv_udp_raw_netbufs: invalid conn", (conn != NULL) &&
+             NETCONNTYPE_GROUP(netconn_type(conn)) != NETCONN_TCP, return ERR_ARG;);
+
+  max = *count;
+  *count = 0;
+  err = netconn_recv_data(conn, (void **)&new_bufs[0], apiflags);
+  if (err != ERR_OK) {
+    return err;
+  }
+  /* UDP and RAW netconns don't get pending errors, so stopping at the
+     first error (normally ERR_WOULDBLOCK) does not lose one */
+  for (i = 1; i < max; i++) {
+    if (netconn_recv_data(conn, (void **)&new_bufs[i], NETCONN_DONTBLOCK) != ERR_OK) {
+      break;
+    }
+  }
+  *count = i;
+  return ERR_OK;
+}
+
 /**
  * @ingroup netconn_common
  * Receive data (in form of a netbuf containing a packet buffer) from a netconn
@@ -956,6 +999,40 @@ netconn_send(struct netconn *conn, struct netbuf *buf)
   return err;
 }
 
+/**
+ * @ingroup netconn_udp
+ * Send several netbufs over a UDP or RAW netconn with a single call into
+ * the tcpip_thread. The netbufs are sent in order, sending stops at the
+ * first error.
+ *
+ * @param conn the UDP or RAW netconn over which to send data
+ * @param bufs the netbufs to send (each like for netconn_send())
+ * @param count in: number of netbufs, out: number of netbufs sent
+ * @return ERR_OK if at least one netbuf was sent, otherwise the error of
+ *         the first one
+ */
+err_t
+netconn_send_batch(struct netconn *conn, struct netbuf *const *bufs, u16_t *count)
+{
+  API_MSG_VAR_DECLARE(msg);
+  err_t err;
+
+  LWIP_ERROR("netconn_send_batch: invalid conn",  (conn != NULL), return ERR_ARG;);
+  LWIP_ERROR("netconn_send_batch: invalid count", (bufs != NULL) && (count != NULL) && (*count > 0), return ERR_ARG;);
+
+  LWIP_DEBUGF(API_LIB_DEBUG, ("netconn_send_batch: sending %"U16_F" netbufs\n", *count));
+
+  API_MSG_VAR_ALLOC(msg);
+  API_MSG_VAR_REF(msg).conn = conn;
+  API_MSG_VAR_REF(msg).msg.sb.bufs = bufs;
+  API_MSG_VAR_REF(msg).msg.sb.count = *count;
+  err = netconn_apimsg(lwip_netconn_do_send_batch, &API_MSG_VAR_REF(msg));
+  *count = API_MSG_VAR_REF(msg).msg.sb.count;
+  API_MSG_VAR_FREE(msg);
+
+  return err;
+}
+
 /**
  * @ingroup netconn_tcp
  * Send data over a TCP netconn.
@@ -980,6 +1057,34 @@ netconn_write_partly(struct netconn *conn, const void *dataptr, size_t size,
   return netconn_write_vectors_partly(conn, &vector, 1, apiflags, bytes_written);
 }
 
+#if LWIP_TCP_WRITE_REF
+/**
+ * @ingroup netconn_tcp
+ * Send data over a TCP netconn without copying it, holding references on
+ * the pbuf owning the data until it has been ACKed (see tcp_write_ref()).
+ *
+ * @param conn the TCP netconn over which to send data
+ * @param dataptr pointer to the data to send (owned by 'ref')
+ * @param size size of the application data to send
+ * @param apiflags combination of NETCONN_MORE and NETCONN_DONTBLOCK
+ *                 (NETCONN_COPY is ignored)
+ * @param ref pbuf owning the data: it may be freed by the caller on return
+ * @param bytes_written pointer to a location that receives the number of written bytes
+ * @return ERR_OK if data was sent, any other err_t on error
+ */
+err_t
+netconn_write_ref_partly(struct netconn *conn, const void *dataptr, size_t size,
+                         u8_t apiflags, struct pbuf *ref, size_t *bytes_written)
+{
+  struct netvector vector;
+  LWIP_ERROR("netconn_write_ref: invalid ref", (ref != NULL), return ERR_ARG;);
+  vector.ptr = dataptr;
+  vector.len = size;
+  return netconn_write_vectors_internal(conn, &vector, 1, (u8_t)(apiflags & ~NETCONN_COPY),
+                                        ref, bytes_written);
+}
+#endif /* LWIP_TCP_WRITE_REF */
+
 /**
  * Send vectorized data atomically over a TCP netconn.
  *
@@ -996,6 +1101,18 @@ netconn_write_partly(struct netconn *conn, const void *dataptr, size_t size,
 err_t
 netconn_write_vectors_partly(struct netconn *conn, struct netvector *vectors, u16_t vectorcnt,
                              u8_t apiflags, size_t *bytes_written)
+{
+  return netconn_write_vectors_internal(conn, vectors, vectorcnt, apiflags, NULL, bytes_written);
+}
+
+/**
+ * Common code for netconn_write_vectors_partly() and netconn_write_ref_partly().
+ *
+ * @param ref pbuf owning the data (passed to tcp_write_ref()) or NULL
+ */
+static err_t
+netconn_write_vectors_internal(struct netconn *conn, struct netvector *vectors, u16_t vectorcnt,
+                               u8_t apiflags, struct pbuf *ref, size_t *bytes_written)
 {
   API_MSG_VAR_DECLARE(msg);
   err_t err;
@@ -1048,6 +1165,11 @@ netconn_write_vectors_partly(struct netconn *conn, struct netvector *vectors, u1
   API_MSG_VAR_REF(msg).msg.w.apiflags = apiflags;
   API_MSG_VAR_REF(msg).msg.w.len = size;
   API_MSG_VAR_REF(msg).msg.w.offset = 0;
+#if LWIP_TCP_WRITE_REF
+  API_MSG_VAR_REF(msg).msg.w.ref = ref;
+#else /* LWIP_TCP_WRITE_REF */
+  LWIP_UNUSED_ARG(ref);
+#endif /* LWIP_TCP_WRITE_REF */
 #if LWIP_SO_SNDTIMEO
   if (conn->send_timeout != 0) {
     /* get the time we started, which is later compared to
@@ -59,6 +59,14 @@
 /* netconns are polled once per second (e.g. continue write on memory error) */
 #define NETCONN_TCP_POLL_INTERVAL 2
 
+/* With per-pcb TCP timers, poll_tcp is only registered while a write or
+   writable-space check is pending, so idle connections are not polled */
+#if LWIP_TCP_PCB_TIMERS
+#define NETCONN_TCP_POLL_NEEDED(conn) tcp_poll((conn)->pcb.tcp, poll_tcp, NETCONN_TCP_POLL_INTERVAL)
+#else /* LWIP_TCP_PCB_TIMERS */
+#define NETCONN_TCP_POLL_NEEDED(conn)
+#endif /* LWIP_TCP_PCB_TIMERS */
+
 #define SET_NONBLOCKING_CONNECT(conn, val)  do { if (val) { \
   netconn_set_flags(conn, NETCONN_FLAG_IN_NONBLOCKING_CONNECT); \
 } else { \
@@ -387,6 +395,15 @@ poll_tcp(void *arg, struct tcp_pcb *pcb)
     }
   }
 
+#if LWIP_TCP_PCB_TIMERS
+  /* Nothing left to retry: stop polling so that an idle connection does not
+     wake up periodically (NETCONN_TCP_POLL_NEEDED() starts it again) */
+  if ((conn->pcb.tcp != NULL) && (conn->state != NETCONN_WRITE) &&
+      (conn->state != NETCONN_CLOSE) && !(conn->flags & NETCONN_FLAG_CHECK_WRITESPACE)) {
+    tcp_poll(conn->pcb.tcp, NULL, 0);
+  }
+#endif /* LWIP_TCP_PCB_TIMERS */
+
   return ERR_OK;
 }
 
@@ -522,7 +539,9 @@ setup_tcp(struct netconn *conn)
   tcp_arg(pcb, conn);
   tcp_recv(pcb, recv_tcp);
   tcp_sent(pcb, sent_tcp);
+#if !LWIP_TCP_PCB_TIMERS
   tcp_poll(pcb, poll_tcp, NETCONN_TCP_POLL_INTERVAL);
+#endif /* !LWIP_TCP_PCB_TIMERS */
   tcp_err(pcb, err_tcp);
 }
 
@@ -1527,45 +1546,44 @@ lwip_netconn_do_listen(void *m)
 #endif /* LWIP_TCP */
 
 /**
- * Send some data on a RAW or UDP pcb contained in a netconn
- * Called from netconn_send
+ * Send one netbuf on a RAW or UDP pcb contained in a netconn
  *
- * @param m the api_msg pointing to the connection
+ * @param conn the netconn to send on
+ * @param buf the netbuf to send
+ * @return ERR_OK if sent, any other err_t on error
  */
-void
-lwip_netconn_do_send(void *m)
+static err_t
+lwip_netconn_send_netbuf(struct netconn *conn, struct netbuf *buf)
 {
-  struct api_msg *msg = (struct api_msg *)m;
-
-  err_t err = netconn_err(msg->conn);
+  err_t err = netconn_err(conn);
   if (err == ERR_OK) {
-    if (msg->conn->pcb.tcp != NULL) {
-      switch (NETCONNTYPE_GROUP(msg->conn->type)) {
+    if (conn->pcb.tcp != NULL) {
+      switch (NETCONNTYPE_GROUP(conn->type)) {
 #if LWIP_RAW
         case NETCONN_RAW:
-          if (ip_addr_isany(&msg->msg.b->addr) || IP_IS_ANY_TYPE_VAL(msg->msg.b->addr)) {
-            err = raw_send(msg->conn->pcb.raw, msg->msg.b->p);
+          if (ip_addr_isany(&buf->addr) || IP_IS_ANY_TYPE_VAL(buf->addr)) {
+            err = raw_send(conn->pcb.raw, buf->p);
           } else {
-            err = raw_sendto(msg->conn->pcb.raw, msg->msg.b->p, &msg->msg.b->addr);
+            err = raw_sendto(conn->pcb.raw, buf->p, &buf->addr);
           }
           break;
 #endif
 #if LWIP_UDP
         case NETCONN_UDP:
 #if LWIP_CHECKSUM_ON_COPY
-          if (ip_addr_isany(&msg->msg.b->addr) || IP_IS_ANY_TYPE_VAL(msg->msg.b->addr)) {
-            err = udp_send_chksum(msg->conn->pcb.udp, msg->msg.b->p,
-                                  msg->msg.b->flags & NETBUF_FLAG_CHKSUM, msg->msg.b->toport_chksum);
+          if (ip_addr_isany(&buf->addr) || IP_IS_ANY_TYPE_VAL(buf->addr)) {
+            err = udp_send_chksum(conn->pcb.udp, buf->p,
+                                  buf->flags & NETBUF_FLAG_CHKSUM, buf->toport_chksum);
           } else {
-            err = udp_sendto_chksum(msg->conn->pcb.udp, msg->msg.b->p,
-                                    &msg->msg.b->addr, msg->msg.b->port,
-                                    msg->msg.b->flags & NETBUF_FLAG_CHKSUM, msg->msg.b->toport_chksum);
+            err = udp_sendto_chksum(conn->pcb.udp, buf->p,
+                                    &buf->addr, buf->port,
+                                    buf->flags & NETBUF_FLAG_CHKSUM, buf->toport_chksum);
           }
 #else /* LWIP_CHECKSUM_ON_COPY */
-          if (ip_addr_isany_val(msg->msg.b->addr) || IP_IS_ANY_TYPE_VAL(msg->msg.b->addr)) {
-            err = udp_send(msg->conn->pcb.udp, msg->msg.b->p);
+          if (ip_addr_isany_val(buf->addr) || IP_IS_ANY_TYPE_VAL(buf->addr)) {
+            err = udp_send(conn->pcb.udp, buf->p);
           } else {
-            err = udp_sendto(msg->conn->pcb.udp, msg->msg.b->p, &msg->msg.b->addr, msg->msg.b->port);
+            err = udp_sendto(conn->pcb.udp, buf->p, &buf->addr, buf->port);
           }
 #endif /* LWIP_CHECKSUM_ON_COPY */
           break;
@@ -1578,7 +1596,47 @@ lwip_netconn_do_send(void *m)
       err = ERR_CONN;
     }
   }
-  msg->err = err;
+  return err;
+}
+
+/**
+ * Send some data on a RAW or UDP pcb contained in a netconn
+ * Called from netconn_send
+ *
+ * @param m the api_msg pointing to the connection
+ */
+void
+lwip_netconn_do_send(void *m)
+{
+  struct api_msg *msg = (struct api_msg *)m;
+
+  msg->err = lwip_netconn_send_netbuf(msg->conn, msg->msg.b);
+  TCPIP_APIMSG_ACK(msg);
+}
+
+/**
+ * Send several netbufs on a RAW or UDP pcb contained in a netconn,
+ * stopping at the first error.
+ * Called from netconn_send_batch
+ *
+ * @param m the api_msg pointing to the connection
+ */
+void
+lwip_netconn_do_send_batch(void *m)
+{
+  struct api_msg *msg = (struct api_msg *)m;
+  err_t err = ERR_OK;
+  u16_t i;
+
+  for (i = 0; i < msg->msg.sb.count; i++) {
+    err = lwip_netconn_send_netbuf(msg->conn, msg->msg.sb.bufs[i]);
+    if (err != ERR_OK) {
+      break;
+    }
+  }
+  msg->msg.sb.count = i;
+  /* report the error only if nothing was sent */
+  msg->err = (i > 0) ? ERR_OK : err;
   TCPIP_APIMSG_ACK(msg);
 }
 
@@ -1713,7 +1771,14 @@ lwip_netconn_do_writemore(struct netconn *conn  WRITE_DELAYED_PARAM)
       } else {
         write_more = 0;
       }
-      err = tcp_write(conn->pcb.tcp, dataptr, len, apiflags);
+#if LWIP_TCP_WRITE_REF
+      if (conn->current_msg->msg.w.ref != NULL) {
+        err = tcp_write_ref(conn->pcb.tcp, dataptr, len, apiflags, conn->current_msg->msg.w.ref);
+      } else
+#endif /* LWIP_TCP_WRITE_REF */
+      {
+        err = tcp_write(conn->pcb.tcp, dataptr, len, apiflags);
+      }
       if (err == ERR_OK) {
         conn->current_msg->msg.w.offset += len;
         conn->current_msg->msg.w.vector_off += len;
@@ -1736,6 +1801,7 @@ err_mem:
            and let poll_tcp check writable space to mark the pcb writable again */
         API_EVENT(conn, NETCONN_EVT_SENDMINUS, 0);
         conn->flags |= NETCONN_FLAG_CHECK_WRITESPACE;
+        NETCONN_TCP_POLL_NEEDED(conn);
       } else if ((tcp_sndbuf(conn->pcb.tcp) <= TCP_SNDLOWAT) ||
                  (tcp_sndqueuelen(conn->pcb.tcp) >= TCP_SNDQUEUELOWAT)) {
         /* The queued byte- or pbuf-count exceeds the configured low-water limit,
@@ -1827,6 +1893,7 @@ lwip_netconn_do_write(void *m)
         err = ERR_INPROGRESS;
       } else if (msg->conn->pcb.tcp != NULL) {
         msg->conn->state = NETCONN_WRITE;
+        NETCONN_TCP_POLL_NEEDED(msg->conn);
         /* set all the variables used by lwip_netconn_do_writemore */
         LWIP_ASSERT("already writing or closing", msg->conn->current_msg == NULL);
         LWIP_ASSERT("msg->msg.w.len != 0", msg->msg.w.len != 0);
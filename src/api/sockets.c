@@ -330,6 +330,12 @@ static void select_check_waiters(int s, int has_recvevent, int has_sendevent, in
 #else
 #define DEFAULT_SOCKET_EVENTCB NULL
 #endif
+#if LWIP_SOCKET_EPOLL
+static void lwip_epoll_sock_event(struct lwip_sock *sock, struct lwip_select_cb **wake);
+static void lwip_epoll_wake(struct lwip_select_cb *wake);
+static void lwip_epoll_sock_close(struct lwip_sock *sock);
+static int lwip_epoll_close(int epfd);
+#endif /* LWIP_SOCKET_EPOLL */
 #if !LWIP_TCPIP_CORE_LOCKING
 static void lwip_getsockopt_callback(void *arg);
 static void lwip_setsockopt_callback(void *arg);
@@ -569,6 +575,9 @@ alloc_socket(struct netconn *newconn, int accepted)
       sockets[i].sendevent  = (NETCONNTYPE_GROUP(newconn->type) == NETCONN_TCP ? (accepted != 0) : 1);
       sockets[i].errevent   = 0;
 #endif /* LWIP_SOCKET_SELECT || LWIP_SOCKET_POLL */
+#if LWIP_SOCKET_EPOLL
+      LWIP_ASSERT("sockets[i].epoll_items == NULL", sockets[i].epoll_items == NULL);
+#endif /* LWIP_SOCKET_EPOLL */
       return i + LWIP_SOCKET_OFFSET;
     }
     SYS_ARCH_UNPROTECT(lev);
@@ -815,6 +824,12 @@ lwip_close(int s)
 
   LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_close(%d)\n", s));
 
+#if LWIP_SOCKET_EPOLL
+  if (s >= LWIP_SOCKET_OFFSET + NUM_SOCKETS) {
+    return lwip_epoll_close(s);
+  }
+#endif /* LWIP_SOCKET_EPOLL */
+
   sock = get_socket(s);
   if (!sock) {
     return -1;
@@ -842,6 +857,11 @@ lwip_close(int s)
     return -1;
   }
 
+#if LWIP_SOCKET_EPOLL
+  /* remove the socket from all epoll instances */
+  lwip_epoll_sock_close(sock);
+#endif /* LWIP_SOCKET_EPOLL */
+
   free_socket(sock, is_tcp);
   set_errno(0);
   return 0;
@@ -1315,6 +1335,27 @@ lwip_recv(int s, void *mem, size_t len, int flags)
   return lwip_recvfrom(s, mem, len, flags, NULL, NULL);
 }
 
+/* Helper function to check the receive vectors of a msghdr.
+ *
+ * @return the total length of the vectors or -1 if a vector is invalid
+ */
+static ssize_t
+lwip_recvmsg_iov_len(const struct msghdr *message)
+{
+  msg_iovlen_t i;
+  ssize_t buflen = 0;
+
+  for (i = 0; i < message->msg_iovlen; i++) {
+    if ((message->msg_iov[i].iov_base == NULL) || ((ssize_t)message->msg_iov[i].iov_len <= 0) ||
+        ((size_t)(ssize_t)message->msg_iov[i].iov_len != message->msg_iov[i].iov_len) ||
+        ((ssize_t)(buflen + (ssize_t)message->msg_iov[i].iov_len) <= 0)) {
+      return -1;
+    }
+    buflen = (ssize_t)(buflen + (ssize_t)message->msg_iov[i].iov_len);
+  }
+  return buflen;
+}
+
 ssize_t
 lwip_recvmsg(int s, struct msghdr *message, int flags)
 {
@@ -1338,16 +1379,11 @@ lwip_recvmsg(int s, struct msghdr *message, int flags)
   }
 
   /* check for valid vectors */
-  buflen = 0;
-  for (i = 0; i < message->msg_iovlen; i++) {
-    if ((message->msg_iov[i].iov_base == NULL) || ((ssize_t)message->msg_iov[i].iov_len <= 0) ||
-        ((size_t)(ssize_t)message->msg_iov[i].iov_len != message->msg_iov[i].iov_len) ||
-        ((ssize_t)(buflen + (ssize_t)message->msg_iov[i].iov_len) <= 0)) {
-      set_errno(err_to_errno(ERR_VAL));
-      done_socket(sock);
-      return -1;
-    }
-    buflen = (ssize_t)(buflen + (ssize_t)message->msg_iov[i].iov_len);
+  buflen = lwip_recvmsg_iov_len(message);
+  if (buflen < 0) {
+    set_errno(err_to_errno(ERR_VAL));
+    done_socket(sock);
+    return -1;
   }
 
   if (NETCONNTYPE_GROUP(netconn_type(sock->conn)) == NETCONN_TCP) {
@@ -1416,6 +1452,265 @@ lwip_recvmsg(int s, struct msghdr *message, int flags)
 #endif /* LWIP_UDP || LWIP_RAW */
 }
 
+#if LWIP_SOCKET_MMSG
+#if LWIP_UDP || LWIP_RAW
+/* Helper function for lwip_recvmmsg(): copy the datagram in sock->lastdata
+ * into one message and free it */
+static void
+lwip_recvmmsg_udp_raw_one(struct lwip_sock *sock, struct mmsghdr *mmsg, int dbg_s)
+{
+  u16_t datagram_len = 0;
+  err_t err;
+
+  err = lwip_recvfrom_udp_raw(sock, 0, &mmsg->msg_hdr, &datagram_len, dbg_s);
+  LWIP_ASSERT("datagram was queued", err == ERR_OK);
+  LWIP_UNUSED_ARG(err);
+  if (datagram_len > lwip_recvmsg_iov_len(&mmsg->msg_hdr)) {
+    mmsg->msg_hdr.msg_flags |= MSG_TRUNC;
+  }
+  mmsg->msg_len = datagram_len;
+}
+#endif /* LWIP_UDP || LWIP_RAW */
+
+/**
+ * @ingroup socket
+ * Receive up to 'vlen' datagrams with one call on a UDP or RAW socket.
+ * Waits for the first datagram (unless MSG_DONTWAIT is passed or the socket
+ * is nonblocking), then only returns datagrams that are already queued, i.e.
+ * MSG_WAITFORONE is implied. The receive mbox is drained in batches of
+ * LWIP_SOCKET_MMSG_BATCH.
+ * 'timeout' is not supported and must be NULL (use SO_RCVTIMEO instead).
+ *
+ * @return the number of messages received or -1 on error
+ */
+int
+lwip_recvmmsg(int s, struct mmsghdr *msgvec, unsigned int vlen, int flags,
+              struct timeval *timeout)
+{
+  struct lwip_sock *sock;
+  unsigned int n;
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_recvmmsg(%d, msgvec=%p, vlen=%u, flags=0x%x)\n", s, (void *)msgvec, vlen, flags));
+  LWIP_ERROR("lwip_recvmmsg: invalid msgvec", (msgvec != NULL) && (vlen > 0),
+             set_errno(EINVAL); return -1;);
+  LWIP_ERROR("lwip_recvmmsg: unsupported flags", (flags & ~(MSG_DONTWAIT | MSG_WAITFORONE)) == 0,
+             set_errno(EOPNOTSUPP); return -1;);
+  LWIP_ERROR("lwip_recvmmsg: timeout not supported", timeout == NULL,
+             set_errno(EINVAL); return -1;);
+
+  sock = get_socket(s);
+  if (!sock) {
+    return -1;
+  }
+
+  if (NETCONNTYPE_GROUP(netconn_type(sock->conn)) == NETCONN_TCP) {
+    set_errno(EOPNOTSUPP);
+    done_socket(sock);
+    return -1;
+  }
+
+  /* check for valid vectors */
+  for (n = 0; n < vlen; n++) {
+    if ((msgvec[n].msg_hdr.msg_iovlen <= 0) || (msgvec[n].msg_hdr.msg_iovlen > IOV_MAX) ||
+        (lwip_recvmsg_iov_len(&msgvec[n].msg_hdr) < 0)) {
+      set_errno(err_to_errno(ERR_VAL));
+      done_socket(sock);
+      return -1;
+    }
+  }
+
+#if LWIP_UDP || LWIP_RAW
+  {
+    struct netbuf *bufs[LWIP_SOCKET_MMSG_BATCH];
+    u8_t apiflags = (flags & MSG_DONTWAIT) ? NETCONN_DONTBLOCK : 0;
+    err_t err = ERR_OK;
+
+    n = 0;
+    if (sock->lastdata.netbuf != NULL) {
+      /* a datagram left by MSG_PEEK comes first */
+      lwip_recvmmsg_udp_raw_one(sock, &msgvec[0], s);
+      n = 1;
+      apiflags = NETCONN_DONTBLOCK;
+    }
+    while (n < vlen) {
+      u16_t i;
+      u16_t requested = (u16_t)LWIP_MIN(vlen - n, LWIP_SOCKET_MMSG_BATCH);
+      u16_t count = requested;
+
+      err = netconn_recv_udp_raw_netbufs(sock->conn, bufs, &count, apiflags);
+      if (err != ERR_OK) {
+        break;
+      }
+      for (i = 0; i < count; i++, n++) {
+        sock->lastdata.netbuf = bufs[i];
+        lwip_recvmmsg_udp_raw_one(sock, &msgvec[n], s);
+      }
+      if (count < requested) {
+        /* the mbox is empty */
+        break;
+      }
+      apiflags = NETCONN_DONTBLOCK;
+    }
+
+    if (n == 0) {
+      LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_recvmmsg[UDP/RAW](%d): error is \"%s\"!\n",
+                                  s, lwip_strerr(err)));
+      set_errno(err_to_errno(err));
+      done_socket(sock);
+      return -1;
+    }
+    set_errno(0);
+    done_socket(sock);
+    return (int)n;
+  }
+#else /* LWIP_UDP || LWIP_RAW */
+  set_errno(err_to_errno(ERR_ARG));
+  done_socket(sock);
+  return -1;
+#endif /* LWIP_UDP || LWIP_RAW */
+}
+#endif /* LWIP_SOCKET_MMSG */
+
+#if LWIP_SOCKET_ZEROCOPY_RECV
+/**
+ * @ingroup socket
+ * Zero-copy variant of lwip_recvfrom(): instead of copying the received data,
+ * a reference to the pbuf chain received by the stack is returned in '*p'.
+ * For TCP, this is all data currently queued (a segment or the remainder of
+ * a partially read one), for UDP and RAW, it is one datagram.
+ * The chain must be returned unchanged via lwip_recv_zc_done() when the
+ * application is done with it. For TCP, the receive window is only updated
+ * then, so holding on to received data throttles the sender.
+ *
+ * @return the number of bytes in '*p', 0 if the connection was closed by the
+ *         remote end (with '*p' set to NULL) or -1 on error
+ */
+ssize_t
+lwip_recv_zc(int s, struct pbuf **p, int flags,
+             struct sockaddr *from, socklen_t *fromlen)
+{
+  struct lwip_sock *sock;
+  struct pbuf *q;
+  u8_t apiflags;
+  err_t err;
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_recv_zc(%d, %p, 0x%x, ..)\n", s, (void *)p, flags));
+  LWIP_ERROR("lwip_recv_zc: invalid pbuf pointer", p != NULL,
+             set_errno(EINVAL); return -1;);
+  LWIP_ERROR("lwip_recv_zc: unsupported flags", (flags & ~MSG_DONTWAIT) == 0,
+             set_errno(EOPNOTSUPP); return -1;);
+  *p = NULL;
+
+  sock = get_socket(s);
+  if (!sock) {
+    return -1;
+  }
+
+  if (flags & MSG_DONTWAIT) {
+    apiflags = NETCONN_DONTBLOCK;
+  } else {
+    apiflags = 0;
+  }
+
+  if (NETCONNTYPE_GROUP(netconn_type(sock->conn)) == NETCONN_TCP) {
+#if LWIP_TCP
+    /* data left from a previous lwip_recv() has not been acknowledged to
+       the window yet, so it can be handed out like new data */
+    q = sock->lastdata.pbuf;
+    if (q != NULL) {
+      sock->lastdata.pbuf = NULL;
+    } else {
+      err = netconn_recv_tcp_pbuf_flags(sock->conn, &q, (u8_t)(apiflags | NETCONN_NOAUTORCVD));
+      LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_recv_zc: netconn_recv err=%d, pbuf=%p\n",
+                                  err, (void *)q));
+      if (err != ERR_OK) {
+        done_socket(sock);
+        if (err == ERR_CLSD) {
+          /* closed by remote end */
+          set_errno(0);
+          return 0;
+        }
+        set_errno(err_to_errno(err));
+        return -1;
+      }
+      LWIP_ASSERT("q != NULL", q != NULL);
+    }
+    lwip_recv_tcp_from(sock, from, fromlen, "lwip_recv_zc", s, q->tot_len);
+#else /* LWIP_TCP */
+    LWIP_UNUSED_ARG(apiflags);
+    LWIP_UNUSED_ARG(err);
+    set_errno(err_to_errno(ERR_ARG));
+    done_socket(sock);
+    return -1;
+#endif /* LWIP_TCP */
+  } else {
+#if LWIP_UDP || LWIP_RAW
+    struct netbuf *buf = sock->lastdata.netbuf;
+    if (buf != NULL) {
+      /* hand out the datagram left by a previous MSG_PEEK */
+      sock->lastdata.netbuf = NULL;
+    } else {
+      err = netconn_recv_udp_raw_netbuf_flags(sock->conn, &buf, apiflags);
+      LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_recv_zc: netconn_recv err=%d, netbuf=%p\n",
+                                  err, (void *)buf));
+      if (err != ERR_OK) {
+        set_errno(err_to_errno(err));
+        done_socket(sock);
+        return -1;
+      }
+      LWIP_ASSERT("buf != NULL", buf != NULL);
+    }
+    if (from && fromlen) {
+      lwip_sock_make_addr(sock->conn, netbuf_fromaddr(buf), netbuf_fromport(buf),
+                          from, fromlen);
+    }
+    /* detach the pbuf chain from the netbuf */
+    q = buf->p;
+    buf->p = buf->ptr = NULL;
+    netbuf_delete(buf);
+#else /* LWIP_UDP || LWIP_RAW */
+    LWIP_UNUSED_ARG(apiflags);
+    LWIP_UNUSED_ARG(err);
+    set_errno(err_to_errno(ERR_ARG));
+    done_socket(sock);
+    return -1;
+#endif /* LWIP_UDP || LWIP_RAW */
+  }
+
+  *p = q;
+  set_errno(0);
+  done_socket(sock);
+  return (ssize_t)q->tot_len;
+}
+
+/**
+ * @ingroup socket
+ * Return a pbuf chain received via lwip_recv_zc() to the stack.
+ * For TCP, this opens the receive window by the length of the chain.
+ * The chain is freed even if the socket has been closed in the meantime.
+ */
+int
+lwip_recv_zc_done(int s, struct pbuf *p)
+{
+  struct lwip_sock *sock;
+
+  LWIP_ERROR("lwip_recv_zc_done: invalid pbuf", p != NULL,
+             set_errno(EINVAL); return -1;);
+
+  sock = get_socket(s);
+  if (sock != NULL) {
+#if LWIP_TCP
+    if (NETCONNTYPE_GROUP(netconn_type(sock->conn)) == NETCONN_TCP) {
+      netconn_tcp_recvd(sock->conn, p->tot_len);
+    }
+#endif /* LWIP_TCP */
+    done_socket(sock);
+  }
+  pbuf_free(p);
+  return (sock != NULL) ? 0 : -1;
+}
+#endif /* LWIP_SOCKET_ZEROCOPY_RECV */
+
 ssize_t
 lwip_send(int s, const void *data, size_t size, int flags)
 {
@@ -1456,6 +1751,106 @@ lwip_send(int s, const void *data, size_t size, int flags)
   return (err == ERR_OK ? (ssize_t)written : -1);
 }
 
+#if LWIP_UDP || LWIP_RAW
+/* Helper function to build a netbuf from a msghdr for sending on a UDP or
+ * RAW netconn. The netbuf has to be freed with netbuf_free() in any case.
+ *
+ * @return ERR_VAL if the datagram is too big, ERR_MEM if out of memory
+ */
+static err_t
+lwip_sendmsg_udp_raw_netbuf(const struct msghdr *msg, struct netbuf *chain_buf, ssize_t *size)
+{
+  msg_iovlen_t i;
+  err_t err = ERR_OK;
+#if LWIP_NETIF_TX_SINGLE_PBUF
+  ssize_t len = 0;
+#endif /* LWIP_NETIF_TX_SINGLE_PBUF */
+
+  /* initialize chain buffer with destination */
+  memset(chain_buf, 0, sizeof(struct netbuf));
+  if (msg->msg_name) {
+    u16_t remote_port;
+    SOCKADDR_TO_IPADDR_PORT((const struct sockaddr *)msg->msg_name, &chain_buf->addr, remote_port);
+    netbuf_fromport(chain_buf) = remote_port;
+  }
+#if LWIP_NETIF_TX_SINGLE_PBUF
+  for (i = 0; i < msg->msg_iovlen; i++) {
+    len += msg->msg_iov[i].iov_len;
+    if ((msg->msg_iov[i].iov_len > INT_MAX) || (len < (int)msg->msg_iov[i].iov_len)) {
+      /* overflow */
+      return ERR_VAL;
+    }
+  }
+  if (len > 0xFFFF) {
+    /* overflow */
+    return ERR_VAL;
+  }
+  /* Allocate a new netbuf and copy the data into it. */
+  if (netbuf_alloc(chain_buf, (u16_t)len) == NULL) {
+    err = ERR_MEM;
+  } else {
+    /* flatten the IO vectors */
+    size_t offset = 0;
+    for (i = 0; i < msg->msg_iovlen; i++) {
+      MEMCPY(&((u8_t *)chain_buf->p->payload)[offset], msg->msg_iov[i].iov_base, msg->msg_iov[i].iov_len);
+      offset += msg->msg_iov[i].iov_len;
+    }
+#if LWIP_CHECKSUM_ON_COPY
+    {
+      /* This can be improved by using LWIP_CHKSUM_COPY() and aggregating the checksum for each IO vector */
+      u16_t chksum = ~inet_chksum_pbuf(chain_buf->p);
+      netbuf_set_chksum(chain_buf, chksum);
+    }
+#endif /* LWIP_CHECKSUM_ON_COPY */
+    *size = len;
+    err = ERR_OK;
+  }
+#else /* LWIP_NETIF_TX_SINGLE_PBUF */
+  /* create a chained netbuf from the IO vectors. NOTE: we assemble a pbuf chain
+     manually to avoid having to allocate, chain, and delete a netbuf for each iov */
+  for (i = 0; i < msg->msg_iovlen; i++) {
+    struct pbuf *p;
+    if (msg->msg_iov[i].iov_len > 0xFFFF) {
+      /* overflow */
+      return ERR_VAL;
+    }
+    p = pbuf_alloc(PBUF_TRANSPORT, 0, PBUF_REF);
+    if (p == NULL) {
+      err = ERR_MEM; /* let netbuf_delete() cleanup chain_buf */
+      break;
+    }
+    p->payload = msg->msg_iov[i].iov_base;
+    p->len = p->tot_len = (u16_t)msg->msg_iov[i].iov_len;
+    /* netbuf empty, add new pbuf */
+    if (chain_buf->p == NULL) {
+      chain_buf->p = chain_buf->ptr = p;
+      /* add pbuf to existing pbuf chain */
+    } else {
+      if (chain_buf->p->tot_len + p->len > 0xffff) {
+        /* overflow */
+        pbuf_free(p);
+        return ERR_VAL;
+      }
+      pbuf_cat(chain_buf->p, p);
+    }
+  }
+  /* save size of total chain */
+  if (err == ERR_OK) {
+    *size = netbuf_len(chain_buf);
+  }
+#endif /* LWIP_NETIF_TX_SINGLE_PBUF */
+
+#if LWIP_IPV4 && LWIP_IPV6
+  /* Dual-stack: Unmap IPv4 mapped IPv6 addresses */
+  if (IP_IS_V6_VAL(chain_buf->addr) && ip6_addr_isipv4mappedipv6(ip_2_ip6(&chain_buf->addr))) {
+    unmap_ipv4_mapped_ipv6(ip_2_ip4(&chain_buf->addr), ip_2_ip6(&chain_buf->addr));
+    IP_SET_TYPE_VAL(chain_buf->addr, IPADDR_TYPE_V4);
+  }
+#endif /* LWIP_IPV4 && LWIP_IPV6 */
+  return err;
+}
+#endif /* LWIP_UDP || LWIP_RAW */
+
 ssize_t
 lwip_sendmsg(int s, const struct msghdr *msg, int flags)
 {
@@ -1506,7 +1901,6 @@ lwip_sendmsg(int s, const struct msghdr *msg, int flags)
 #if LWIP_UDP || LWIP_RAW
   {
     struct netbuf chain_buf;
-    msg_iovlen_t i;
     ssize_t size = 0;
 
     LWIP_UNUSED_ARG(flags);
@@ -1514,90 +1908,16 @@ lwip_sendmsg(int s, const struct msghdr *msg, int flags)
                IS_SOCK_ADDR_LEN_VALID(msg->msg_namelen)),
                set_errno(err_to_errno(ERR_ARG)); done_socket(sock); return -1;);
 
-    /* initialize chain buffer with destination */
-    memset(&chain_buf, 0, sizeof(struct netbuf));
-    if (msg->msg_name) {
-      u16_t remote_port;
-      SOCKADDR_TO_IPADDR_PORT((const struct sockaddr *)msg->msg_name, &chain_buf.addr, remote_port);
-      netbuf_fromport(&chain_buf) = remote_port;
-    }
-#if LWIP_NETIF_TX_SINGLE_PBUF
-    for (i = 0; i < msg->msg_iovlen; i++) {
-      size += msg->msg_iov[i].iov_len;
-      if ((msg->msg_iov[i].iov_len > INT_MAX) || (size < (int)msg->msg_iov[i].iov_len)) {
-        /* overflow */
-        goto sendmsg_emsgsize;
-      }
-    }
-    if (size > 0xFFFF) {
-      /* overflow */
-      goto sendmsg_emsgsize;
-    }
-    /* Allocate a new netbuf and copy the data into it. */
-    if (netbuf_alloc(&chain_buf, (u16_t)size) == NULL) {
-      err = ERR_MEM;
-    } else {
-      /* flatten the IO vectors */
-      size_t offset = 0;
-      for (i = 0; i < msg->msg_iovlen; i++) {
-        MEMCPY(&((u8_t *)chain_buf.p->payload)[offset], msg->msg_iov[i].iov_base, msg->msg_iov[i].iov_len);
-        offset += msg->msg_iov[i].iov_len;
-      }
-#if LWIP_CHECKSUM_ON_COPY
-      {
-        /* This can be improved by using LWIP_CHKSUM_COPY() and aggregating the checksum for each IO vector */
-        u16_t chksum = ~inet_chksum_pbuf(chain_buf.p);
-        netbuf_set_chksum(&chain_buf, chksum);
-      }
-#endif /* LWIP_CHECKSUM_ON_COPY */
-      err = ERR_OK;
-    }
-#else /* LWIP_NETIF_TX_SINGLE_PBUF */
-    /* create a chained netbuf from the IO vectors. NOTE: we assemble a pbuf chain
-       manually to avoid having to allocate, chain, and delete a netbuf for each iov */
-    for (i = 0; i < msg->msg_iovlen; i++) {
-      struct pbuf *p;
-      if (msg->msg_iov[i].iov_len > 0xFFFF) {
-        /* overflow */
-        goto sendmsg_emsgsize;
-      }
-      p = pbuf_alloc(PBUF_TRANSPORT, 0, PBUF_REF);
-      if (p == NULL) {
-        err = ERR_MEM; /* let netbuf_delete() cleanup chain_buf */
-        break;
-      }
-      p->payload = msg->msg_iov[i].iov_base;
-      p->len = p->tot_len = (u16_t)msg->msg_iov[i].iov_len;
-      /* netbuf empty, add new pbuf */
-      if (chain_buf.p == NULL) {
-        chain_buf.p = chain_buf.ptr = p;
-        /* add pbuf to existing pbuf chain */
-      } else {
-        if (chain_buf.p->tot_len + p->len > 0xffff) {
-          /* overflow */
-          pbuf_free(p);
-          goto sendmsg_emsgsize;
-        }
-        pbuf_cat(chain_buf.p, p);
-      }
-    }
-    /* save size of total chain */
+    err = lwip_sendmsg_udp_raw_netbuf(msg, &chain_buf, &size);
     if (err == ERR_OK) {
-      size = netbuf_len(&chain_buf);
-    }
-#endif /* LWIP_NETIF_TX_SINGLE_PBUF */
-
-    if (err == ERR_OK) {
-#if LWIP_IPV4 && LWIP_IPV6
-      /* Dual-stack: Unmap IPv4 mapped IPv6 addresses */
-      if (IP_IS_V6_VAL(chain_buf.addr) && ip6_addr_isipv4mappedipv6(ip_2_ip6(&chain_buf.addr))) {
-        unmap_ipv4_mapped_ipv6(ip_2_ip4(&chain_buf.addr), ip_2_ip6(&chain_buf.addr));
-        IP_SET_TYPE_VAL(chain_buf.addr, IPADDR_TYPE_V4);
-      }
-#endif /* LWIP_IPV4 && LWIP_IPV6 */
-
       /* send the data */
       err = netconn_send(sock->conn, &chain_buf);
+    } else if (err == ERR_VAL) {
+      /* overflow */
+      netbuf_free(&chain_buf);
+      set_errno(EMSGSIZE);
+      done_socket(sock);
+      return -1;
     }
 
     /* deallocated the buffer */
@@ -1606,11 +1926,110 @@ lwip_sendmsg(int s, const struct msghdr *msg, int flags)
     set_errno(err_to_errno(err));
     done_socket(sock);
     return (err == ERR_OK ? size : -1);
-sendmsg_emsgsize:
-    set_errno(EMSGSIZE);
-    netbuf_free(&chain_buf);
+  }
+#else /* LWIP_UDP || LWIP_RAW */
+  set_errno(err_to_errno(ERR_ARG));
+  done_socket(sock);
+  return -1;
+#endif /* LWIP_UDP || LWIP_RAW */
+}
+
+#if LWIP_SOCKET_MMSG
+/**
+ * @ingroup socket
+ * Send up to 'vlen' datagrams with one call on a UDP or RAW socket.
+ * The datagrams are passed to the tcpip_thread in batches of
+ * LWIP_SOCKET_MMSG_BATCH instead of one message per datagram.
+ * msg_len of each message sent is set to the number of bytes sent.
+ *
+ * @return the number of messages sent (less than 'vlen' if an error occurred
+ *         after the first one) or -1 if no message could be sent
+ */
+int
+lwip_sendmmsg(int s, struct mmsghdr *msgvec, unsigned int vlen, int flags)
+{
+  struct lwip_sock *sock;
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_sendmmsg(%d, msgvec=%p, vlen=%u, flags=0x%x)\n", s, (void *)msgvec, vlen, flags));
+  LWIP_ERROR("lwip_sendmmsg: invalid msgvec", (msgvec != NULL) && (vlen > 0),
+             set_errno(EINVAL); return -1;);
+  LWIP_ERROR("lwip_sendmmsg: unsupported flags", (flags & ~(MSG_DONTWAIT | MSG_MORE)) == 0,
+             set_errno(EOPNOTSUPP); return -1;);
+
+  sock = get_socket(s);
+  if (!sock) {
+    return -1;
+  }
+
+  if (NETCONNTYPE_GROUP(netconn_type(sock->conn)) == NETCONN_TCP) {
+    set_errno(EOPNOTSUPP);
+    done_socket(sock);
+    return -1;
+  }
+
+#if LWIP_UDP || LWIP_RAW
+  {
+    struct netbuf bufs[LWIP_SOCKET_MMSG_BATCH];
+    struct netbuf *bufp[LWIP_SOCKET_MMSG_BATCH];
+    ssize_t sizes[LWIP_SOCKET_MMSG_BATCH];
+    unsigned int n = 0;
+    int sock_err = 0;
+
+    while ((n < vlen) && (sock_err == 0)) {
+      u16_t i, built, sent;
+      u16_t requested = (u16_t)LWIP_MIN(vlen - n, LWIP_SOCKET_MMSG_BATCH);
+      err_t err;
+
+      /* build the netbufs of this batch */
+      for (built = 0; built < requested; built++) {
+        const struct msghdr *msg = &msgvec[n + built].msg_hdr;
+        if ((msg->msg_iov == NULL) ||
+            (((msg->msg_name != NULL) || (msg->msg_namelen != 0)) && !IS_SOCK_ADDR_LEN_VALID(msg->msg_namelen))) {
+          sock_err = err_to_errno(ERR_ARG);
+          break;
+        }
+        if ((msg->msg_iovlen <= 0) || (msg->msg_iovlen > IOV_MAX)) {
+          sock_err = EMSGSIZE;
+          break;
+        }
+        bufp[built] = &bufs[built];
+        err = lwip_sendmsg_udp_raw_netbuf(msg, &bufs[built], &sizes[built]);
+        if (err != ERR_OK) {
+          netbuf_free(&bufs[built]);
+          sock_err = (err == ERR_VAL) ? EMSGSIZE : err_to_errno(err);
+          break;
+        }
+      }
+      if (built == 0) {
+        break;
+      }
+
+      /* send them with one call to the tcpip_thread */
+      sent = built;
+      err = netconn_send_batch(sock->conn, bufp, &sent);
+      for (i = 0; i < built; i++) {
+        if (i < sent) {
+          msgvec[n + i].msg_len = (unsigned int)sizes[i];
+        }
+        netbuf_free(&bufs[i]);
+      }
+      n += sent;
+      if (sent < built) {
+        if (sock_err == 0) {
+          sock_err = err_to_errno(err);
+        }
+        break;
+      }
+    }
+
+    if (n == 0) {
+      set_errno(sock_err);
+      done_socket(sock);
+      return -1;
+    }
+    set_errno(0);
     done_socket(sock);
-    return -1;
+    return (int)n;
   }
 #else /* LWIP_UDP || LWIP_RAW */
   set_errno(err_to_errno(ERR_ARG));
@@ -1618,6 +2037,7 @@ sendmsg_emsgsize:
   return -1;
 #endif /* LWIP_UDP || LWIP_RAW */
 }
+#endif /* LWIP_SOCKET_MMSG */
 
 ssize_t
 lwip_sendto(int s, const void *data, size_t size, int flags,
@@ -2523,6 +2943,9 @@ event_callback(struct netconn *conn, enum netconn_evt evt, u16_t len)
 {
   int s, check_waiters;
   struct lwip_sock *sock;
+#if LWIP_SOCKET_EPOLL
+  struct lwip_select_cb *epoll_wake = NULL;
+#endif /* LWIP_SOCKET_EPOLL */
   SYS_ARCH_DECL_PROTECT(lev);
 
   LWIP_UNUSED_ARG(len);
@@ -2590,6 +3013,14 @@ event_callback(struct netconn *conn, enum netconn_evt evt, u16_t len)
       break;
   }
 
+#if LWIP_SOCKET_EPOLL
+  if ((sock->epoll_items != NULL) &&
+      (evt != NETCONN_EVT_RCVMINUS) && (evt != NETCONN_EVT_SENDMINUS)) {
+    /* queue the socket on the epoll instances watching it */
+    lwip_epoll_sock_event(sock, &epoll_wake);
+  }
+#endif /* LWIP_SOCKET_EPOLL */
+
   if (sock->select_waiting && check_waiters) {
     /* Save which events are active */
     int has_recvevent, has_sendevent, has_errevent;
@@ -2602,6 +3033,9 @@ event_callback(struct netconn *conn, enum netconn_evt evt, u16_t len)
   } else {
     SYS_ARCH_UNPROTECT(lev);
   }
+#if LWIP_SOCKET_EPOLL
+  lwip_epoll_wake(epoll_wake);
+#endif /* LWIP_SOCKET_EPOLL */
   done_socket(sock);
 }
 
@@ -2693,6 +3127,536 @@ again:
 }
 #endif /* LWIP_SOCKET_SELECT || LWIP_SOCKET_POLL */
 
+#if LWIP_SOCKET_EPOLL
+/*
+ * epoll: each epoll instance has an interest list of lwip_epoll_items and
+ * each socket links the items registered for it. event_callback() appends
+ * the items of a socket to their instance's ready list and wakes up the
+ * tasks waiting on that instance, so the cost per event only depends on the
+ * number of epoll instances watching that socket.
+ * lwip_epoll_wait() checks the actual socket state of the items on the ready
+ * list: level-triggered items stay on the list as long as they are ready,
+ * edge-triggered items are removed once reported.
+ *
+ * The lists are protected like select_cb_list (core lock or SYS_ARCH_PROTECT).
+ * Socket state is read with SYS_ARCH_PROTECT held, like in lwip_pollscan().
+ */
+
+/** The epoll instances; their descriptors follow the socket descriptors */
+static struct lwip_epoll epoll_instances[LWIP_SOCKET_MAX_EPOLL];
+
+/* Translate an epoll descriptor into an instance (list protection held) */
+static struct lwip_epoll *
+lwip_epoll_get(int epfd)
+{
+  int i = epfd - (LWIP_SOCKET_OFFSET + NUM_SOCKETS);
+  if ((i < 0) || (i >= LWIP_SOCKET_MAX_EPOLL) || !epoll_instances[i].used) {
+    return NULL;
+  }
+  return &epoll_instances[i];
+}
+
+/* Get the EPOLL* events currently pending on a socket
+ * (SYS_ARCH_PROTECT must be held) */
+static u32_t
+lwip_epoll_sock_state(const struct lwip_sock *sock)
+{
+  u32_t state = 0;
+  if ((sock->lastdata.pbuf != NULL) || (sock->rcvevent > 0)) {
+    state |= EPOLLIN;
+  }
+  if (sock->sendevent != 0) {
+    state |= EPOLLOUT;
+  }
+  if (sock->errevent != 0) {
+    state |= EPOLLERR;
+  }
+  return state;
+}
+
+/* Events of 'state' an item is interested in: EPOLLERR is always reported
+   (unless disabled by EPOLLONESHOT) */
+#define LWIP_EPOLL_ITEM_REVENTS(item, state) \
+  ((item)->disabled ? 0 : ((state) & ((item)->events | EPOLLERR)))
+
+/* Append an item to its instance's ready list */
+static void
+lwip_epoll_item_queue(struct lwip_epoll_item *item)
+{
+  struct lwip_epoll *ep = item->ep;
+
+  if (!item->ready) {
+    item->ready = 1;
+    item->rdy_next = NULL;
+    item->rdy_prev = ep->rdy_tail;
+    if (ep->rdy_tail != NULL) {
+      ep->rdy_tail->rdy_next = item;
+    } else {
+      ep->rdy_head = item;
+    }
+    ep->rdy_tail = item;
+  }
+}
+
+/* Move the tasks waiting on an instance to 'wake'. They are signalled by
+ * lwip_epoll_wake() once the lock is released, so that no semaphore is
+ * signalled with SYS_ARCH_PROTECT held. */
+static void
+lwip_epoll_take_waiters(struct lwip_epoll *ep, struct lwip_select_cb **wake)
+{
+  struct lwip_select_cb *scb;
+
+  while (ep->waiters != NULL) {
+    scb = ep->waiters;
+    ep->waiters = scb->next;
+    scb->sem_signalled = 1;
+    scb->prev = NULL;
+    scb->next = *wake;
+    *wake = scb;
+  }
+}
+
+/* Signal the tasks collected by lwip_epoll_take_waiters() (called unlocked) */
+static void
+lwip_epoll_wake(struct lwip_select_cb *wake)
+{
+  struct lwip_select_cb *scb;
+
+  while (wake != NULL) {
+    scb = wake;
+    /* the waiter may return as soon as it is signalled */
+    wake = scb->next;
+    sys_sem_signal(SELECT_SEM_PTR(scb->sem));
+  }
+}
+
+/* Queue an item and take the waiters of its instance to 'wake' */
+static void
+lwip_epoll_item_ready(struct lwip_epoll_item *item, struct lwip_select_cb **wake)
+{
+  lwip_epoll_item_queue(item);
+  lwip_epoll_take_waiters(item->ep, wake);
+}
+
+/* Remove an item from its instance's ready list */
+static void
+lwip_epoll_item_unready(struct lwip_epoll_item *item)
+{
+  struct lwip_epoll *ep = item->ep;
+
+  if (item->ready) {
+    if (item->rdy_prev != NULL) {
+      item->rdy_prev->rdy_next = item->rdy_next;
+    } else {
+      ep->rdy_head = item->rdy_next;
+    }
+    if (item->rdy_next != NULL) {
+      item->rdy_next->rdy_prev = item->rdy_prev;
+    } else {
+      ep->rdy_tail = item->rdy_prev;
+    }
+    item->ready = 0;
+  }
+}
+
+/* Check the socket state of an item and queue it if it has events */
+static void
+lwip_epoll_item_check(struct lwip_epoll_item *item, struct lwip_select_cb **wake)
+{
+  u32_t state;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  SYS_ARCH_PROTECT(lev);
+  state = lwip_epoll_sock_state(item->sock);
+  SYS_ARCH_UNPROTECT(lev);
+  if (LWIP_EPOLL_ITEM_REVENTS(item, state)) {
+    lwip_epoll_item_ready(item, wake);
+  }
+}
+
+/* Unlink an item from its socket and instance and free it */
+static void
+lwip_epoll_item_free(struct lwip_epoll_item *item)
+{
+  struct lwip_epoll *ep = item->ep;
+  struct lwip_epoll_item **pitem;
+
+  for (pitem = &item->sock->epoll_items; *pitem != NULL; pitem = &(*pitem)->sock_next) {
+    if (*pitem == item) {
+      *pitem = item->sock_next;
+      break;
+    }
+  }
+  lwip_epoll_item_unready(item);
+  if (item->prev != NULL) {
+    item->prev->next = item->next;
+  } else {
+    ep->items = item->next;
+  }
+  if (item->next != NULL) {
+    item->next->prev = item->prev;
+  }
+  memp_free(MEMP_EPOLL_ITEM, item);
+}
+
+/* Called by event_callback() with SYS_ARCH_PROTECT held (and the core lock
+ * for LWIP_TCPIP_CORE_LOCKING) when a socket got readable, writable or an
+ * error */
+static void
+lwip_epoll_sock_event(struct lwip_sock *sock, struct lwip_select_cb **wake)
+{
+  struct lwip_epoll_item *item;
+  u32_t state = lwip_epoll_sock_state(sock);
+
+  LWIP_ASSERT_CORE_LOCKED();
+  for (item = sock->epoll_items; item != NULL; item = item->sock_next) {
+    if (LWIP_EPOLL_ITEM_REVENTS(item, state)) {
+      lwip_epoll_item_ready(item, wake);
+    }
+  }
+}
+
+/* Remove a socket that is being closed from all epoll instances */
+static void
+lwip_epoll_sock_close(struct lwip_sock *sock)
+{
+  LWIP_SOCKET_SELECT_DECL_PROTECT(lev);
+
+  LWIP_SOCKET_SELECT_PROTECT(lev);
+  while (sock->epoll_items != NULL) {
+    lwip_epoll_item_free(sock->epoll_items);
+  }
+  LWIP_SOCKET_SELECT_UNPROTECT(lev);
+}
+
+/* Move events of the ready list to 'events'; returns the number of events */
+static int
+lwip_epoll_collect(struct lwip_epoll *ep, struct epoll_event *events, int maxevents)
+{
+  struct lwip_epoll_item *item, *last;
+  int nready = 0;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  /* items re-queued (level-triggered) go behind 'last', so each item is
+     looked at only once */
+  last = ep->rdy_tail;
+  item = ep->rdy_head;
+  while ((item != NULL) && (nready < maxevents)) {
+    struct lwip_epoll_item *next = item->rdy_next;
+    u32_t revents;
+
+    SYS_ARCH_PROTECT(lev);
+    revents = LWIP_EPOLL_ITEM_REVENTS(item, lwip_epoll_sock_state(item->sock));
+    SYS_ARCH_UNPROTECT(lev);
+
+    lwip_epoll_item_unready(item);
+    if (revents) {
+      events[nready].events = revents;
+      events[nready].data = item->data;
+      nready++;
+      if (item->events & EPOLLONESHOT) {
+        /* disabled until rearmed by EPOLL_CTL_MOD */
+        item->disabled = 1;
+      } else if (!(item->events & EPOLLET)) {
+        /* level-triggered: report again while still ready (the other
+           waiters were woken up when it was queued first) */
+        lwip_epoll_item_queue(item);
+      }
+    }
+    if (item == last) {
+      break;
+    }
+    item = next;
+  }
+  return nready;
+}
+
+/**
+ * @ingroup socket
+ * Create an epoll instance. 'size' is ignored but must be positive.
+ * The instance is closed with lwip_close().
+ */
+int
+lwip_epoll_create(int size)
+{
+  int i;
+  LWIP_SOCKET_SELECT_DECL_PROTECT(lev);
+
+  if (size <= 0) {
+    set_errno(EINVAL);
+    return -1;
+  }
+  LWIP_SOCKET_SELECT_PROTECT(lev);
+  for (i = 0; i < LWIP_SOCKET_MAX_EPOLL; i++) {
+    if (!epoll_instances[i].used) {
+      memset(&epoll_instances[i], 0, sizeof(struct lwip_epoll));
+      epoll_instances[i].used = 1;
+      LWIP_SOCKET_SELECT_UNPROTECT(lev);
+      LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_epoll_create() = %d\n", i + LWIP_SOCKET_OFFSET + NUM_SOCKETS));
+      set_errno(0);
+      return i + LWIP_SOCKET_OFFSET + NUM_SOCKETS;
+    }
+  }
+  LWIP_SOCKET_SELECT_UNPROTECT(lev);
+  set_errno(EMFILE);
+  return -1;
+}
+
+/* Close an epoll instance (called by lwip_close()) */
+static int
+lwip_epoll_close(int epfd)
+{
+  struct lwip_epoll *ep;
+  struct lwip_select_cb *wake = NULL;
+  LWIP_SOCKET_SELECT_DECL_PROTECT(lev);
+
+  LWIP_SOCKET_SELECT_PROTECT(lev);
+  ep = lwip_epoll_get(epfd);
+  if (ep == NULL) {
+    LWIP_SOCKET_SELECT_UNPROTECT(lev);
+    set_errno(EBADF);
+    return -1;
+  }
+  while (ep->items != NULL) {
+    lwip_epoll_item_free(ep->items);
+  }
+  ep->used = 0;
+  /* wake up tasks still waiting, they will see the instance is gone */
+  lwip_epoll_take_waiters(ep, &wake);
+  LWIP_SOCKET_SELECT_UNPROTECT(lev);
+  lwip_epoll_wake(wake);
+  set_errno(0);
+  return 0;
+}
+
+/**
+ * @ingroup socket
+ * Add (EPOLL_CTL_ADD), modify (EPOLL_CTL_MOD) or remove (EPOLL_CTL_DEL) the
+ * registration of socket 'fd' with the epoll instance 'epfd'.
+ * Supported events are EPOLLIN, EPOLLOUT and EPOLLERR (always reported),
+ * supported flags are EPOLLET and EPOLLONESHOT.
+ */
+int
+lwip_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event)
+{
+  struct lwip_epoll *ep;
+  struct lwip_epoll_item *item, *new_item = NULL;
+  struct lwip_select_cb *wake = NULL;
+  struct lwip_sock *sock;
+  int err = 0;
+  LWIP_SOCKET_SELECT_DECL_PROTECT(lev);
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_epoll_ctl(%d, %d, %d)\n", epfd, op, fd));
+  if ((op != EPOLL_CTL_DEL) && (event == NULL)) {
+    set_errno(EFAULT);
+    return -1;
+  }
+  sock = get_socket(fd);
+  if (sock == NULL) {
+    return -1;
+  }
+  if (op == EPOLL_CTL_ADD) {
+    /* allocate outside of the lock */
+    new_item = (struct lwip_epoll_item *)memp_malloc(MEMP_EPOLL_ITEM);
+    if (new_item == NULL) {
+      set_errno(ENOMEM);
+      done_socket(sock);
+      return -1;
+    }
+  }
+
+  LWIP_SOCKET_SELECT_PROTECT(lev);
+  ep = lwip_epoll_get(epfd);
+  if (ep == NULL) {
+    err = EBADF;
+    goto out;
+  }
+  for (item = sock->epoll_items; item != NULL; item = item->sock_next) {
+    if (item->ep == ep) {
+      break;
+    }
+  }
+  switch (op) {
+    case EPOLL_CTL_ADD:
+      if (item != NULL) {
+        err = EEXIST;
+        break;
+      }
+      item = new_item;
+      new_item = NULL;
+      memset(item, 0, sizeof(struct lwip_epoll_item));
+      item->ep = ep;
+      item->sock = sock;
+      item->events = event->events;
+      item->data = event->data;
+      item->next = ep->items;
+      if (ep->items != NULL) {
+        ep->items->prev = item;
+      }
+      ep->items = item;
+      item->sock_next = sock->epoll_items;
+      sock->epoll_items = item;
+      lwip_epoll_item_check(item, &wake);
+      break;
+    case EPOLL_CTL_MOD:
+      if (item == NULL) {
+        err = ENOENT;
+        break;
+      }
+      item->events = event->events;
+      item->data = event->data;
+      item->disabled = 0;
+      lwip_epoll_item_unready(item);
+      lwip_epoll_item_check(item, &wake);
+      break;
+    case EPOLL_CTL_DEL:
+      if (item == NULL) {
+        err = ENOENT;
+        break;
+      }
+      lwip_epoll_item_free(item);
+      break;
+    default:
+      err = EINVAL;
+      break;
+  }
+out:
+  LWIP_SOCKET_SELECT_UNPROTECT(lev);
+  lwip_epoll_wake(wake);
+  if (new_item != NULL) {
+    memp_free(MEMP_EPOLL_ITEM, new_item);
+  }
+  done_socket(sock);
+  if (err != 0) {
+    set_errno(err);
+    return -1;
+  }
+  set_errno(0);
+  return 0;
+}
+
+/**
+ * @ingroup socket
+ * Wait for events on the sockets registered with the epoll instance 'epfd'.
+ *
+ * @param timeout milliseconds to wait, -1 to wait forever, 0 to return
+ *        immediately
+ * @return number of events stored in 'events' (0 on timeout), -1 on error
+ */
+int
+lwip_epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout)
+{
+  struct lwip_epoll *ep;
+  int nready;
+  u32_t waitres = 0;
+  u32_t start, msectimeout;
+  LWIP_SOCKET_SELECT_DECL_PROTECT(lev);
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_epoll_wait(%d, %d, %d)\n", epfd, maxevents, timeout));
+  LWIP_ERROR("lwip_epoll_wait: invalid events", (events != NULL) && (maxevents > 0),
+             set_errno(EINVAL); return -1;);
+
+  LWIP_SOCKET_SELECT_PROTECT(lev);
+  ep = lwip_epoll_get(epfd);
+  if (ep == NULL) {
+    LWIP_SOCKET_SELECT_UNPROTECT(lev);
+    set_errno(EBADF);
+    return -1;
+  }
+  nready = lwip_epoll_collect(ep, events, maxevents);
+  LWIP_SOCKET_SELECT_UNPROTECT(lev);
+
+  if ((nready == 0) && (timeout != 0)) {
+    API_SELECT_CB_VAR_DECLARE(select_cb);
+
+    API_SELECT_CB_VAR_ALLOC(select_cb, set_errno(EAGAIN); return -1);
+    memset(&API_SELECT_CB_VAR_REF(select_cb), 0, sizeof(struct lwip_select_cb));
+#if LWIP_NETCONN_SEM_PER_THREAD
+    API_SELECT_CB_VAR_REF(select_cb).sem = LWIP_NETCONN_THREAD_SEM_GET();
+#else /* LWIP_NETCONN_SEM_PER_THREAD */
+    if (sys_sem_new(&API_SELECT_CB_VAR_REF(select_cb).sem, 0) != ERR_OK) {
+      /* failed to create semaphore */
+      set_errno(EAGAIN);
+      API_SELECT_CB_VAR_FREE(select_cb);
+      return -1;
+    }
+#endif /* LWIP_NETCONN_SEM_PER_THREAD */
+
+    start = sys_now();
+    msectimeout = (timeout < 0) ? 0 : (u32_t)timeout;
+    LWIP_SOCKET_SELECT_PROTECT(lev);
+    while (nready == 0) {
+      ep = lwip_epoll_get(epfd);
+      if (ep == NULL) {
+        /* closed while waiting */
+        nready = -1;
+        break;
+      }
+      /* items might have been queued since the last check */
+      nready = lwip_epoll_collect(ep, events, maxevents);
+      if ((nready != 0) || (waitres == SYS_ARCH_TIMEOUT)) {
+        break;
+      }
+      API_SELECT_CB_VAR_REF(select_cb).sem_signalled = 0;
+      API_SELECT_CB_VAR_REF(select_cb).prev = NULL;
+      API_SELECT_CB_VAR_REF(select_cb).next = ep->waiters;
+      if (ep->waiters != NULL) {
+        ep->waiters->prev = &API_SELECT_CB_VAR_REF(select_cb);
+      }
+      ep->waiters = &API_SELECT_CB_VAR_REF(select_cb);
+      LWIP_SOCKET_SELECT_UNPROTECT(lev);
+
+      waitres = sys_arch_sem_wait(SELECT_SEM_PTR(API_SELECT_CB_VAR_REF(select_cb).sem), msectimeout);
+
+      LWIP_SOCKET_SELECT_PROTECT(lev);
+      if (!API_SELECT_CB_VAR_REF(select_cb).sem_signalled) {
+        /* still linked: waking up (or lwip_epoll_close()) takes waiters
+           off the list, so 'ep' is still valid here */
+        if (API_SELECT_CB_VAR_REF(select_cb).prev != NULL) {
+          API_SELECT_CB_VAR_REF(select_cb).prev->next = API_SELECT_CB_VAR_REF(select_cb).next;
+        } else {
+          ep->waiters = API_SELECT_CB_VAR_REF(select_cb).next;
+        }
+        if (API_SELECT_CB_VAR_REF(select_cb).next != NULL) {
+          API_SELECT_CB_VAR_REF(select_cb).next->prev = API_SELECT_CB_VAR_REF(select_cb).prev;
+        }
+      } else if (waitres == SYS_ARCH_TIMEOUT) {
+        /* taken off the list but timed out before the signal came: wait
+           for it, so the semaphore is neither left signalled nor freed
+           while it is being signalled */
+        LWIP_SOCKET_SELECT_UNPROTECT(lev);
+        sys_arch_sem_wait(SELECT_SEM_PTR(API_SELECT_CB_VAR_REF(select_cb).sem), 0);
+        LWIP_SOCKET_SELECT_PROTECT(lev);
+      }
+      if ((waitres != SYS_ARCH_TIMEOUT) && (timeout > 0)) {
+        /* woken up: wait for the rest of the time if nothing is ready */
+        u32_t elapsed = sys_now() - start;
+        if (elapsed >= (u32_t)timeout) {
+          waitres = SYS_ARCH_TIMEOUT;
+        } else {
+          msectimeout = (u32_t)timeout - elapsed;
+        }
+      }
+    }
+    LWIP_SOCKET_SELECT_UNPROTECT(lev);
+
+#if !LWIP_NETCONN_SEM_PER_THREAD
+    sys_sem_free(&API_SELECT_CB_VAR_REF(select_cb).sem);
+#endif /* LWIP_NETCONN_SEM_PER_THREAD */
+    API_SELECT_CB_VAR_FREE(select_cb);
+
+    if (nready < 0) {
+      set_errno(EBADF);
+      return -1;
+    }
+  }
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_epoll_wait: nready=%d\n", nready));
+  set_errno(0);
+  return nready;
+}
+#endif /* LWIP_SOCKET_EPOLL */
+
 /**
  * Close one end of a full-duplex connection.
  */
@@ -3387,6 +4351,11 @@ lwip_setsockopt_impl(int s, int level, int optname, const void *optval, socklen_
           } else {
             ip_reset_option(sock->conn->pcb.ip, optname);
           }
+#if LWIP_TCP && LWIP_TCP_PCB_TIMERS
+          if ((optname == SOF_KEEPALIVE) && (NETCONNTYPE_GROUP(sock->conn->type) == NETCONN_TCP)) {
+            tcp_timers_update(sock->conn->pcb.tcp);
+          }
+#endif /* LWIP_TCP && LWIP_TCP_PCB_TIMERS */
           LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_setsockopt(%d, SOL_SOCKET, optname=0x%x, ..) -> %s\n",
                                       s, optname, (*(const int *)optval ? "on" : "off")));
           break;
@@ -3639,6 +4608,10 @@ lwip_setsockopt_impl(int s, int level, int optname, const void *optval, socklen_
           err = ENOPROTOOPT;
           break;
       }  /* switch (optname) */
+#if LWIP_TCP_PCB_TIMERS
+      /* the keepalive settings move the deadline of the pcb timer */
+      tcp_timers_update(sock->conn->pcb.tcp);
+#endif /* LWIP_TCP_PCB_TIMERS */
       break;
 #endif /* LWIP_TCP*/
 
@@ -48,8 +48,11 @@
 #include "lwip/ip.h"
 #include "lwip/pbuf.h"
 #include "lwip/etharp.h"
+#include "lwip/gro.h"
 #include "netif/ethernet.h"
 
+#include <string.h>
+
 #define TCPIP_MSG_VAR_REF(name)     API_VAR_REF(name)
 #define TCPIP_MSG_VAR_DECLARE(name) API_VAR_DECLARE(struct tcpip_msg, name)
 #define TCPIP_MSG_VAR_ALLOC(name)   API_VAR_ALLOC(struct tcpip_msg, MEMP_TCPIP_MSG_API, name, ERR_MEM)
@@ -66,13 +69,18 @@ sys_mutex_t lock_tcpip_core;
 #endif /* LWIP_TCPIP_CORE_LOCKING */
 
 static void tcpip_thread_handle_msg(struct tcpip_msg *msg);
+#if !LWIP_TCPIP_CORE_LOCKING_INPUT
+static void tcpip_thread_input(struct pbuf *p, struct netif *inp, netif_input_fn input_fn);
+#endif /* !LWIP_TCPIP_CORE_LOCKING_INPUT */
 
 #if !LWIP_TIMERS
 /* wait for a message with timers disabled (e.g. pass a timer-check trigger into tcpip_thread) */
-#define TCPIP_MBOX_FETCH(mbox, msg) sys_mbox_fetch(mbox, msg)
+#define TCPIP_MBOX_WAIT(mbox, msg) sys_mbox_fetch(mbox, msg)
+#define TCPIP_TIMEOUTS_DUE()       0
 #else /* !LWIP_TIMERS */
 /* wait for a message, timeouts are processed while waiting */
-#define TCPIP_MBOX_FETCH(mbox, msg) tcpip_timeouts_mbox_fetch(mbox, msg)
+#define TCPIP_MBOX_WAIT(mbox, msg) tcpip_timeouts_mbox_fetch(mbox, msg)
+#define TCPIP_TIMEOUTS_DUE()       (sys_timeouts_sleeptime() == 0)
 /**
  * Wait (forever) for a message to arrive in an mbox.
  * While waiting, timeouts are processed.
@@ -113,6 +121,31 @@ again:
 }
 #endif /* !LWIP_TIMERS */
 
+#if LWIP_GRO
+#define TCPIP_MBOX_FETCH(mbox, msg) tcpip_gro_mbox_fetch(mbox, msg)
+/**
+ * Fetch the next message without waiting while packets are held for
+ * coalescing. They are passed on when the mbox runs empty (the end of an
+ * input batch) or timeouts are due, before waiting for a message.
+ *
+ * @param mbox the mbox to fetch the message from
+ * @param msg the place to store the message
+ */
+static void
+tcpip_gro_mbox_fetch(sys_mbox_t *mbox, void **msg)
+{
+  if (gro_pending()) {
+    if (!TCPIP_TIMEOUTS_DUE() && (sys_arch_mbox_tryfetch(mbox, msg) != SYS_MBOX_EMPTY)) {
+      return;
+    }
+    gro_flush();
+  }
+  TCPIP_MBOX_WAIT(mbox, msg);
+}
+#else /* LWIP_GRO */
+#define TCPIP_MBOX_FETCH(mbox, msg) TCPIP_MBOX_WAIT(mbox, msg)
+#endif /* LWIP_GRO */
+
 /**
  * The main lwIP thread. This thread has exclusive access to lwIP core functions
  * (unless access to them is not locked). Other threads communicate with this
@@ -155,6 +188,16 @@ tcpip_thread(void *arg)
 static void
 tcpip_thread_handle_msg(struct tcpip_msg *msg)
 {
+#if LWIP_GRO
+  if ((msg->type != TCPIP_MSG_INPKT)
+#if LWIP_TCPIP_INPUT_BATCH
+      && (msg->type != TCPIP_MSG_INBATCH)
+#endif /* LWIP_TCPIP_INPUT_BATCH */
+     ) {
+    /* other messages may look at the state held packets would change */
+    gro_flush();
+  }
+#endif /* LWIP_GRO */
   switch (msg->type) {
 #if !LWIP_TCPIP_CORE_LOCKING
     case TCPIP_MSG_API:
@@ -176,11 +219,21 @@ tcpip_thread_handle_msg(struct tcpip_msg *msg)
 #if !LWIP_TCPIP_CORE_LOCKING_INPUT
     case TCPIP_MSG_INPKT:
       LWIP_DEBUGF(TCPIP_DEBUG, ("tcpip_thread: PACKET %p\n", (void *)msg));
-      if (msg->msg.inp.input_fn(msg->msg.inp.p, msg->msg.inp.netif) != ERR_OK) {
-        pbuf_free(msg->msg.inp.p);
-      }
+      tcpip_thread_input(msg->msg.inp.p, msg->msg.inp.netif, msg->msg.inp.input_fn);
       memp_free(MEMP_TCPIP_MSG_INPKT, msg);
       break;
+#if LWIP_TCPIP_INPUT_BATCH
+    case TCPIP_MSG_INBATCH: {
+      struct tcpip_msg_inbatch *batch = (struct tcpip_msg_inbatch *)msg;
+      u16_t i;
+      LWIP_DEBUGF(TCPIP_DEBUG, ("tcpip_thread: PACKET BATCH %p (%"U16_F")\n", (void *)msg, msg->msg.inbatch.num));
+      for (i = 0; i < msg->msg.inbatch.num; i++) {
+        tcpip_thread_input(batch->p[i], msg->msg.inbatch.netif, msg->msg.inbatch.input_fn);
+      }
+      memp_free(MEMP_TCPIP_MSG_INBATCH, batch);
+      break;
+    }
+#endif /* LWIP_TCPIP_INPUT_BATCH */
 #endif /* !LWIP_TCPIP_CORE_LOCKING_INPUT */
 
 #if LWIP_TCPIP_TIMEOUT && LWIP_TIMERS
@@ -214,6 +267,21 @@ tcpip_thread_handle_msg(struct tcpip_msg *msg)
   }
 }
 
+#if !LWIP_TCPIP_CORE_LOCKING_INPUT
+/* Input one packet received in a message, free it if it was not taken */
+static void
+tcpip_thread_input(struct pbuf *p, struct netif *inp, netif_input_fn input_fn)
+{
+#if LWIP_GRO
+  if (gro_input(p, inp, input_fn) != ERR_OK) {
+#else /* LWIP_GRO */
+  if (input_fn(p, inp) != ERR_OK) {
+#endif /* LWIP_GRO */
+    pbuf_free(p);
+  }
+}
+#endif /* !LWIP_TCPIP_CORE_LOCKING_INPUT */
+
 #ifdef TCPIP_THREAD_TEST
 /** Work on queued items in single-threaded test mode */
 int
@@ -230,6 +298,14 @@ tcpip_thread_poll_one(void)
     }
     UNLOCK_TCPIP_CORE();
   }
+#if LWIP_GRO
+  if (!ret && gro_pending()) {
+    /* end of the input batch */
+    LOCK_TCPIP_CORE();
+    gro_flush();
+    UNLOCK_TCPIP_CORE();
+  }
+#endif /* LWIP_GRO */
   return ret;
 }
 #endif
@@ -295,6 +371,75 @@ tcpip_input(struct pbuf *p, struct netif *inp)
     return tcpip_inpkt(p, inp, ip_input);
 }
 
+#if LWIP_TCPIP_INPUT_BATCH
+/**
+ * @ingroup lwip_os
+ * Pass several received packets to tcpip_thread for input processing with
+ * ethernet_input or ip_input in one message. This is for netif drivers
+ * using tcpip_input() as netif->input that can receive more than one
+ * packet per wakeup.
+ *
+ * @param p array of received packets, see tcpip_input()
+ * @param num number of packets in the array (at most TCPIP_INPUT_BATCH_SIZE)
+ * @param inp the network interface on which the packets were received
+ * @return ERR_OK if all packets were taken, ERR_MEM if none of them were
+ *         taken (the caller has to free them), ERR_ARG if num is too big
+ */
+err_t
+tcpip_input_batch(struct pbuf **p, u16_t num, struct netif *inp)
+{
+  netif_input_fn input_fn = ip_input;
+#if LWIP_TCPIP_CORE_LOCKING_INPUT
+  u16_t i;
+#else /* LWIP_TCPIP_CORE_LOCKING_INPUT */
+  struct tcpip_msg_inbatch *batch;
+#endif /* LWIP_TCPIP_CORE_LOCKING_INPUT */
+
+  LWIP_ERROR("tcpip_input_batch: invalid packets", (p != NULL) || (num == 0), return ERR_ARG;);
+  if (num > TCPIP_INPUT_BATCH_SIZE) {
+    return ERR_ARG;
+  }
+  if (num == 0) {
+    return ERR_OK;
+  }
+#if LWIP_ETHERNET
+  if (inp->flags & (NETIF_FLAG_ETHARP | NETIF_FLAG_ETHERNET)) {
+    input_fn = ethernet_input;
+  }
+#endif /* LWIP_ETHERNET */
+
+#if LWIP_TCPIP_CORE_LOCKING_INPUT
+  LWIP_DEBUGF(TCPIP_DEBUG, ("tcpip_input_batch: %"U16_F" PACKETS %p\n", num, (void *)inp));
+  LOCK_TCPIP_CORE();
+  for (i = 0; i < num; i++) {
+    if (input_fn(p[i], inp) != ERR_OK) {
+      pbuf_free(p[i]);
+    }
+  }
+  UNLOCK_TCPIP_CORE();
+  return ERR_OK;
+#else /* LWIP_TCPIP_CORE_LOCKING_INPUT */
+  LWIP_ASSERT("Invalid mbox", sys_mbox_valid_val(tcpip_mbox));
+
+  batch = (struct tcpip_msg_inbatch *)memp_malloc(MEMP_TCPIP_MSG_INBATCH);
+  if (batch == NULL) {
+    return ERR_MEM;
+  }
+
+  batch->msg.type = TCPIP_MSG_INBATCH;
+  batch->msg.msg.inbatch.netif = inp;
+  batch->msg.msg.inbatch.input_fn = input_fn;
+  batch->msg.msg.inbatch.num = num;
+  MEMCPY(batch->p, p, num * sizeof(struct pbuf *));
+  if (sys_mbox_trypost(&tcpip_mbox, &batch->msg) != ERR_OK) {
+    memp_free(MEMP_TCPIP_MSG_INBATCH, batch);
+    return ERR_MEM;
+  }
+  return ERR_OK;
+#endif /* LWIP_TCPIP_CORE_LOCKING_INPUT */
+}
+#endif /* LWIP_TCPIP_INPUT_BATCH */
+
 /**
  * @ingroup lwip_os
  * Call a specific function in the thread context of
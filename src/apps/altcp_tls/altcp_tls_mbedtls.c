@@ -1359,6 +1359,9 @@ const struct altcp_functions altcp_mbedtls_functions = {
 #ifdef LWIP_DEBUG
   , altcp_default_dbg_get_tcp_state
 #endif
+#if LWIP_TCP_WRITE_REF
+  , NULL /* data is encrypted into new buffers: altcp_write_ref() copies */
+#endif
 };
 
 #endif /* LWIP_ALTCP_TLS && LWIP_ALTCP_TLS_MBEDTLS */
@@ -579,6 +579,9 @@ const struct altcp_functions altcp_proxyconnect_functions = {
 #ifdef LWIP_DEBUG
   , altcp_default_dbg_get_tcp_state
 #endif
+#if LWIP_TCP_WRITE_REF
+  , altcp_default_write_ref
+#endif
 };
 
 #endif /* LWIP_ALTCP */
@@ -385,6 +385,26 @@ altcp_write(struct altcp_pcb *conn, const void *dataptr, u16_t len, u8_t apiflag
   return ERR_VAL;
 }
 
+#if LWIP_TCP_WRITE_REF
+/**
+ * @ingroup altcp
+ * @see tcp_write_ref()
+ * Layers that cannot pass the reference on (e.g. TLS) fall back to copying
+ * the data, so 'ref' may be released as soon as this returns in any case.
+ */
+err_t
+altcp_write_ref(struct altcp_pcb *conn, const void *dataptr, u16_t len, u8_t apiflags, struct pbuf *ref)
+{
+  if (conn && conn->fns) {
+    if (conn->fns->write_ref) {
+      return conn->fns->write_ref(conn, dataptr, len, apiflags, ref);
+    }
+    return altcp_write(conn, dataptr, len, (u8_t)(apiflags | TCP_WRITE_FLAG_COPY));
+  }
+  return ERR_VAL;
+}
+#endif /* LWIP_TCP_WRITE_REF */
+
 /**
  * @ingroup altcp
  * @see tcp_output()
@@ -581,6 +601,17 @@ altcp_default_write(struct altcp_pcb *conn, const void *dataptr, u16_t len, u8_t
   return ERR_VAL;
 }
 
+#if LWIP_TCP_WRITE_REF
+err_t
+altcp_default_write_ref(struct altcp_pcb *conn, const void *dataptr, u16_t len, u8_t apiflags, struct pbuf *ref)
+{
+  if (conn && conn->inner_conn) {
+    return altcp_write_ref(conn->inner_conn, dataptr, len, apiflags, ref);
+  }
+  return ERR_VAL;
+}
+#endif /* LWIP_TCP_WRITE_REF */
+
 err_t
 altcp_default_output(struct altcp_pcb *conn)
 {
@@ -363,6 +363,20 @@ altcp_tcp_write(struct altcp_pcb *conn, const void *dataptr, u16_t len, u8_t api
   return tcp_write(pcb, dataptr, len, apiflags);
 }
 
+#if LWIP_TCP_WRITE_REF
+static err_t
+altcp_tcp_write_ref(struct altcp_pcb *conn, const void *dataptr, u16_t len, u8_t apiflags, struct pbuf *ref)
+{
+  struct tcp_pcb *pcb;
+  if (conn == NULL) {
+    return ERR_VAL;
+  }
+  ALTCP_TCP_ASSERT_CONN(conn);
+  pcb = (struct tcp_pcb *)conn->state;
+  return tcp_write_ref(pcb, dataptr, len, apiflags, ref);
+}
+#endif /* LWIP_TCP_WRITE_REF */
+
 static err_t
 altcp_tcp_output(struct altcp_pcb *conn)
 {
@@ -573,6 +587,9 @@ const struct altcp_functions altcp_tcp_functions = {
 #ifdef LWIP_DEBUG
   , altcp_tcp_dbg_get_tcp_state
 #endif
+#if LWIP_TCP_WRITE_REF
+  , altcp_tcp_write_ref
+#endif
 };
 
 #endif /* LWIP_ALTCP */
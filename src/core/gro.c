@@ -0,0 +1,442 @@
+/**
+ * @file
+ * Generic receive offload (GRO)
+ *
+ * Consecutive in-order TCP/IPv4 segments of the same flow that arrive in one
+ * input batch are coalesced into one packet before they are passed to the
+ * stack: the headers of all but the first segment are stripped and their
+ * payload is chained to the first one. TCP then sees one big segment and
+ * sends one ACK and does one recv upcall for it.
+ *
+ * Segments are only coalesced if they are addressed to the input netif,
+ * carry no IP options, are not fragmented, have only ACK (and PSH on the
+ * last one) set, are full-sized (except the last one) and have the same
+ * ACK number, window and TCP options. Everything else is passed through
+ * (after flushing the flow it belongs to, to keep segments in order).
+ *
+ * The TCP checksum of the coalesced packet is derived from the checksums of
+ * the segments without touching their payload: a corrupted segment makes the
+ * coalesced packet fail the checksum check in tcp_input().
+ *
+ * With tcpip_thread, a batch ends when the mbox runs empty or a message
+ * other than an input packet is processed. NO_SYS ports call gro_input()
+ * for received packets and gro_flush() once per batch.
+ */
+
+/*
+ * Copyright (c) 2001-2004 Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ *
+ */
+
+#include "lwip/opt.h"
+
+#if LWIP_GRO /* don't build if not configured for use in lwipopts.h */
+
+#include "lwip/gro.h"
+#include "lwip/def.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/ip.h"
+#include "lwip/stats.h"
+#include "lwip/prot/ip4.h"
+#include "lwip/prot/tcp.h"
+#include "netif/ethernet.h"
+
+#include <string.h>
+
+/** Pointers into the headers of a received TCP/IPv4 packet */
+struct gro_hdrs {
+  struct ip_hdr *iphdr;
+  struct tcp_hdr *tcphdr;
+  /** length of the link header preceding the IP header */
+  u16_t l2_len;
+  /** length of all headers */
+  u16_t hdr_len;
+  /** length of the TCP payload */
+  u16_t data_len;
+};
+
+/** A flow for which a coalesced packet is being built */
+struct gro_flow {
+  /** held packet (starting with the link header), NULL if this slot is free */
+  struct pbuf *p;
+  struct netif *inp;
+  netif_input_fn input_fn;
+  /** headers of the held packet */
+  struct gro_hdrs hdrs;
+  /** ones-complement sum of the TCP payload held so far */
+  u32_t data_sum;
+  /** sequence number expected for the next segment */
+  u32_t next_seqno;
+  /** payload length of the first segment, later segments must not be longer */
+  u16_t seg_len;
+  u8_t num_segs;
+};
+
+static struct gro_flow gro_flows[LWIP_GRO_MAX_FLOWS];
+static u8_t gro_num_held;
+static u8_t gro_next_evict;
+
+/**
+ * Locate the IPv4 and TCP headers of a received packet.
+ *
+ * @return 1 if p is a TCP/IPv4 packet with all headers in the first pbuf,
+ *         0 otherwise
+ */
+static int
+gro_parse(struct pbuf *p, netif_input_fn input_fn, struct gro_hdrs *h)
+{
+  u16_t ip_len, tcphdr_len;
+
+  if (input_fn == ip_input) {
+    h->l2_len = 0;
+#if LWIP_ARP || LWIP_ETHERNET
+  } else if (input_fn == ethernet_input) {
+    if ((p->len < SIZEOF_ETH_HDR) ||
+        (((struct eth_hdr *)p->payload)->type != PP_HTONS(ETHTYPE_IP))) {
+      return 0;
+    }
+    h->l2_len = SIZEOF_ETH_HDR;
+#endif /* LWIP_ARP || LWIP_ETHERNET */
+  } else {
+    return 0;
+  }
+  if (p->len < h->l2_len + IP_HLEN + TCP_HLEN) {
+    return 0;
+  }
+  h->iphdr = (struct ip_hdr *)((u8_t *)p->payload + h->l2_len);
+  if ((IPH_V(h->iphdr) != 4) || (IPH_HL_BYTES(h->iphdr) != IP_HLEN) ||
+      (IPH_PROTO(h->iphdr) != IP_PROTO_TCP) ||
+      ((IPH_OFFSET(h->iphdr) & PP_HTONS(IP_OFFMASK | IP_MF)) != 0)) {
+    return 0;
+  }
+  h->tcphdr = (struct tcp_hdr *)((u8_t *)h->iphdr + IP_HLEN);
+  ip_len = lwip_ntohs(IPH_LEN(h->iphdr));
+  tcphdr_len = TCPH_HDRLEN_BYTES(h->tcphdr);
+  if ((tcphdr_len < TCP_HLEN) || (ip_len < IP_HLEN + tcphdr_len) ||
+      (ip_len > p->tot_len - h->l2_len) || (p->len < h->l2_len + IP_HLEN + tcphdr_len)) {
+    return 0;
+  }
+  h->hdr_len = (u16_t)(h->l2_len + IP_HLEN + tcphdr_len);
+  h->data_len = (u16_t)(ip_len - IP_HLEN - tcphdr_len);
+  return 1;
+}
+
+/**
+ * Check if a parsed packet may be coalesced at all: in-order data for us
+ * without anything TCP has to look at separately.
+ */
+static int
+gro_is_candidate(struct netif *inp, const struct gro_hdrs *h)
+{
+  ip4_addr_t dest;
+
+  if ((h->data_len == 0) || ((TCPH_FLAGS(h->tcphdr) & ~TCP_PSH) != TCP_ACK)) {
+    return 0;
+  }
+  ip4_addr_copy(dest, h->iphdr->dest);
+  if (!ip4_addr_eq(&dest, netif_ip4_addr(inp))) {
+    /* not for us (e.g. to be forwarded) */
+    return 0;
+  }
+#if CHECKSUM_CHECK_IP
+  IF__NETIF_CHECKSUM_ENABLED(inp, NETIF_CHECKSUM_CHECK_IP) {
+    /* the IP header of all but the first segment is discarded */
+    if (inet_chksum(h->iphdr, IP_HLEN) != 0) {
+      return 0;
+    }
+  }
+#endif /* CHECKSUM_CHECK_IP */
+  return 1;
+}
+
+/** Ones-complement sum of the IPv4 pseudo header */
+static u32_t
+gro_pseudo_sum(const struct gro_hdrs *h, u16_t tcp_len)
+{
+  ip4_addr_t src, dest;
+  u32_t acc;
+
+  ip4_addr_copy(src, h->iphdr->src);
+  ip4_addr_copy(dest, h->iphdr->dest);
+  acc = (ip4_addr_get_u32(&src) & 0xffffUL) + (ip4_addr_get_u32(&src) >> 16);
+  acc += (ip4_addr_get_u32(&dest) & 0xffffUL) + (ip4_addr_get_u32(&dest) >> 16);
+  acc += (u32_t)lwip_htons(IP_PROTO_TCP);
+  acc += (u32_t)lwip_htons(tcp_len);
+  return acc;
+}
+
+/**
+ * Ones-complement sum of the TCP payload of a segment, derived from the
+ * checksum in its header (the sum over a valid segment is 0xffff).
+ */
+static u32_t
+gro_data_sum(const struct gro_hdrs *h)
+{
+  u16_t tcphdr_len = (u16_t)(h->hdr_len - h->l2_len - IP_HLEN);
+  u32_t acc;
+
+  acc = gro_pseudo_sum(h, (u16_t)(tcphdr_len + h->data_len));
+  acc += (u16_t)~inet_chksum(h->tcphdr, tcphdr_len);
+  acc = FOLD_U32T(acc);
+  acc = FOLD_U32T(acc);
+  return (u16_t)~acc;
+}
+
+/** Find the flow a TCP/IPv4 packet belongs to */
+static struct gro_flow *
+gro_find_flow(struct netif *inp, const struct gro_hdrs *h)
+{
+  u8_t i;
+
+  for (i = 0; i < LWIP_GRO_MAX_FLOWS; i++) {
+    struct gro_flow *flow = &gro_flows[i];
+    if ((flow->p != NULL) && (flow->inp == inp) &&
+        (flow->hdrs.tcphdr->src == h->tcphdr->src) &&
+        (flow->hdrs.tcphdr->dest == h->tcphdr->dest) &&
+        (flow->hdrs.iphdr->src.addr == h->iphdr->src.addr) &&
+        (flow->hdrs.iphdr->dest.addr == h->iphdr->dest.addr)) {
+      return flow;
+    }
+  }
+  return NULL;
+}
+
+/** Pass the packet held for a flow to the stack */
+static void
+gro_flush_flow(struct gro_flow *flow)
+{
+  struct pbuf *p = flow->p;
+
+  if (flow->num_segs > 1) {
+    struct ip_hdr *iphdr = flow->hdrs.iphdr;
+    struct tcp_hdr *tcphdr = flow->hdrs.tcphdr;
+    u16_t ip_len = (u16_t)(p->tot_len - flow->hdrs.l2_len);
+    u16_t tcphdr_len = (u16_t)(flow->hdrs.hdr_len - flow->hdrs.l2_len - IP_HLEN);
+    u32_t acc;
+
+    IPH_LEN_SET(iphdr, lwip_htons(ip_len));
+    IPH_CHKSUM_SET(iphdr, 0);
+    IPH_CHKSUM_SET(iphdr, inet_chksum(iphdr, IP_HLEN));
+
+    tcphdr->chksum = 0;
+    acc = gro_pseudo_sum(&flow->hdrs, (u16_t)(ip_len - IP_HLEN));
+    acc += (u16_t)~inet_chksum(tcphdr, tcphdr_len);
+    acc += flow->data_sum;
+    acc = FOLD_U32T(acc);
+    acc = FOLD_U32T(acc);
+    tcphdr->chksum = (u16_t)~acc;
+
+    /* tell TCP to acknowledge this right away */
+    p->flags |= PBUF_FLAG_GRO;
+  }
+  flow->p = NULL;
+  gro_num_held--;
+  GRO_STATS_INC(gro.flush);
+  LWIP_DEBUGF(GRO_DEBUG, ("gro_flush_flow: %"U16_F" segments, %"U16_F" bytes\n",
+                          (u16_t)flow->num_segs, p->tot_len));
+  if (flow->input_fn(p, flow->inp) != ERR_OK) {
+    pbuf_free(p);
+  }
+}
+
+/** Start holding a packet for a flow */
+static void
+gro_hold(struct pbuf *p, struct netif *inp, netif_input_fn input_fn, const struct gro_hdrs *h)
+{
+  struct gro_flow *flow = NULL;
+  u8_t i;
+
+  for (i = 0; i < LWIP_GRO_MAX_FLOWS; i++) {
+    if (gro_flows[i].p == NULL) {
+      flow = &gro_flows[i];
+      break;
+    }
+  }
+  if (flow == NULL) {
+    /* all slots in use: pass on one of the held packets */
+    flow = &gro_flows[gro_next_evict];
+    gro_next_evict = (u8_t)((gro_next_evict + 1) % LWIP_GRO_MAX_FLOWS);
+    gro_flush_flow(flow);
+  }
+  if (p->tot_len > h->hdr_len + h->data_len) {
+    /* remove link layer padding */
+    pbuf_realloc(p, (u16_t)(h->hdr_len + h->data_len));
+  }
+  flow->p = p;
+  flow->inp = inp;
+  flow->input_fn = input_fn;
+  flow->hdrs = *h;
+  flow->next_seqno = lwip_ntohl(h->tcphdr->seqno) + h->data_len;
+  flow->seg_len = h->data_len;
+  flow->num_segs = 1;
+  gro_num_held++;
+}
+
+/**
+ * Append a segment to the packet held for its flow.
+ *
+ * @return 1 if the segment was appended (p is consumed), 0 if it does not
+ *         continue the held packet
+ */
+static int
+gro_append(struct gro_flow *flow, struct pbuf *p, const struct gro_hdrs *h)
+{
+  const struct gro_hdrs *fh = &flow->hdrs;
+  u16_t tcphdr_len = (u16_t)(h->hdr_len - h->l2_len - IP_HLEN);
+  u16_t data_len = (u16_t)(flow->p->tot_len - fh->hdr_len);
+  u8_t flags;
+  u32_t sum;
+
+  if ((flow->num_segs >= LWIP_GRO_MAX_SEGS) ||
+      (lwip_ntohl(h->tcphdr->seqno) != flow->next_seqno) ||
+      (h->data_len > flow->seg_len) ||
+      ((u32_t)flow->p->tot_len + h->data_len > 0xFFFFUL) ||
+      (h->hdr_len != fh->hdr_len) ||
+      (h->tcphdr->ackno != fh->tcphdr->ackno) ||
+      (h->tcphdr->wnd != fh->tcphdr->wnd) ||
+      (IPH_TOS(h->iphdr) != IPH_TOS(fh->iphdr)) ||
+      (IPH_TTL(h->iphdr) != IPH_TTL(fh->iphdr)) ||
+      (memcmp(p->payload, flow->p->payload, h->l2_len) != 0) ||
+      (memcmp(h->tcphdr + 1, fh->tcphdr + 1, tcphdr_len - TCP_HLEN) != 0)) {
+    return 0;
+  }
+
+  if (flow->num_segs == 1) {
+    flow->data_sum = gro_data_sum(fh);
+  }
+  sum = gro_data_sum(h);
+  if (data_len & 1) {
+    /* this payload starts at an odd offset */
+    sum = SWAP_BYTES_IN_WORD(sum);
+  }
+  flow->data_sum = FOLD_U32T(flow->data_sum + sum);
+
+  flags = TCPH_FLAGS(h->tcphdr);
+  if (p->tot_len > h->hdr_len + h->data_len) {
+    pbuf_realloc(p, (u16_t)(h->hdr_len + h->data_len));
+  }
+  pbuf_remove_header(p, h->hdr_len);
+  pbuf_cat(flow->p, p);
+  flow->next_seqno += h->data_len;
+  flow->num_segs++;
+  GRO_STATS_INC(gro.merged);
+
+  if ((flags & TCP_PSH) || (h->data_len < flow->seg_len) ||
+      (flow->num_segs >= LWIP_GRO_MAX_SEGS)) {
+    /* nothing can follow this segment in the same packet */
+    if (flags & TCP_PSH) {
+      TCPH_SET_FLAG(fh->tcphdr, TCP_PSH);
+    }
+    gro_flush_flow(flow);
+  }
+  return 1;
+}
+
+/**
+ * Pass a received packet to the stack via GRO. Consecutive TCP segments of
+ * one flow are held and coalesced until gro_flush() is called.
+ *
+ * @param p the received packet
+ * @param inp the network interface on which the packet was received
+ * @param input_fn input function to call (ethernet_input or ip_input
+ *        for packets that may be coalesced)
+ * @return ERR_OK if the packet was taken over, the result of input_fn
+ *         otherwise (p has to be freed by the caller if this is not ERR_OK)
+ */
+err_t
+gro_input(struct pbuf *p, struct netif *inp, netif_input_fn input_fn)
+{
+  struct gro_hdrs h;
+  struct gro_flow *flow;
+
+  LWIP_ASSERT_CORE_LOCKED();
+
+  if (!gro_parse(p, input_fn, &h)) {
+    return input_fn(p, inp);
+  }
+  GRO_STATS_INC(gro.recv);
+  flow = (gro_num_held > 0) ? gro_find_flow(inp, &h) : NULL;
+  if (gro_is_candidate(inp, &h)) {
+    if (flow != NULL) {
+      if (gro_append(flow, p, &h)) {
+        return ERR_OK;
+      }
+      gro_flush_flow(flow);
+    }
+    if ((TCPH_FLAGS(h.tcphdr) & TCP_PSH) == 0) {
+      gro_hold(p, inp, input_fn, &h);
+      return ERR_OK;
+    }
+  } else if (flow != NULL) {
+    /* keep the segments of this flow in order */
+    gro_flush_flow(flow);
+  }
+  return input_fn(p, inp);
+}
+
+/**
+ * Pass all held packets to the stack. Call this at the end of each input
+ * batch.
+ */
+void
+gro_flush(void)
+{
+  u8_t i;
+
+  LWIP_ASSERT_CORE_LOCKED();
+
+  for (i = 0; (i < LWIP_GRO_MAX_FLOWS) && (gro_num_held > 0); i++) {
+    if (gro_flows[i].p != NULL) {
+      gro_flush_flow(&gro_flows[i]);
+    }
+  }
+}
+
+/** Check if packets are held for coalescing */
+u8_t
+gro_pending(void)
+{
+  return (u8_t)(gro_num_held > 0);
+}
+
+/** Drop the packets held for a netif that is removed */
+void
+gro_netif_remove(struct netif *netif)
+{
+  u8_t i;
+
+  for (i = 0; i < LWIP_GRO_MAX_FLOWS; i++) {
+    if ((gro_flows[i].p != NULL) && (gro_flows[i].inp == netif)) {
+      pbuf_free(gro_flows[i].p);
+      gro_flows[i].p = NULL;
+      gro_num_held--;
+    }
+  }
+}
+
+#endif /* LWIP_GRO */
@@ -157,6 +157,24 @@ PACK_STRUCT_END
 #if (LWIP_TCP && (TCP_SND_QUEUELEN < 2))
 #error "TCP_SND_QUEUELEN must be at least 2 for no-copy TCP writes to work"
 #endif
+#if (LWIP_UDP && LWIP_UDP_PCB_HASH && (UDP_PCB_HASH_SIZE & (UDP_PCB_HASH_SIZE - 1)))
+#error "UDP_PCB_HASH_SIZE must be a power of 2"
+#endif
+#if (LWIP_TCP && LWIP_TCP_PCB_HASH && ((TCP_PCB_HASH_SIZE & (TCP_PCB_HASH_SIZE - 1)) || (TCP_LISTEN_PCB_HASH_SIZE & (TCP_LISTEN_PCB_HASH_SIZE - 1))))
+#error "TCP_PCB_HASH_SIZE and TCP_LISTEN_PCB_HASH_SIZE must be powers of 2"
+#endif
+#if (LWIP_TCP && LWIP_TCP_TW_BUCKETS && (TCP_TW_HASH_SIZE & (TCP_TW_HASH_SIZE - 1)))
+#error "TCP_TW_HASH_SIZE must be a power of 2"
+#endif
+#if (LWIP_TCP && LWIP_TCP_TW_BUCKETS && (MEMP_NUM_TCP_TW < 1))
+#error "LWIP_TCP_TW_BUCKETS needs at least one tw-bucket (MEMP_NUM_TCP_TW)"
+#endif
+#if (LWIP_TCP && LWIP_TCP_CC_CUBIC && !LWIP_TCP_CC)
+#error "LWIP_TCP_CC_CUBIC needs LWIP_TCP_CC enabled"
+#endif
+#if (LWIP_TCP && LWIP_TCP_CC_CUBIC && !LWIP_HAVE_INT64)
+#error "LWIP_TCP_CC_CUBIC needs LWIP_HAVE_INT64 (64-bit arithmetic)"
+#endif
 #if (LWIP_TCP && ((TCP_MAXRTX > 12) || (TCP_SYNMAXRTX > 12)))
 #error "If you want to use TCP, TCP_MAXRTX and TCP_SYNMAXRTX must less or equal to 12 (due to tcp_backoff table), so, you have to reduce them in your lwipopts.h"
 #endif
@@ -166,6 +184,15 @@ PACK_STRUCT_END
 #if (LWIP_TCP && LWIP_TCP_SACK_OUT && !TCP_QUEUE_OOSEQ)
 #error "To use LWIP_TCP_SACK_OUT, TCP_QUEUE_OOSEQ needs to be enabled"
 #endif
+#if (LWIP_TCP && LWIP_TCP_SACK_IN && !LWIP_TCP_SACK_OUT)
+#error "To use LWIP_TCP_SACK_IN, LWIP_TCP_SACK_OUT needs to be enabled"
+#endif
+#if (LWIP_TCP && LWIP_TCP_RACK && !LWIP_TCP_SACK_IN)
+#error "To use LWIP_TCP_RACK, LWIP_TCP_SACK_IN needs to be enabled"
+#endif
+#if (LWIP_TCP && LWIP_TCP_PCB_TIMERS && (!LWIP_TIMERS || LWIP_TIMERS_CUSTOM))
+#error "To use LWIP_TCP_PCB_TIMERS, LWIP_TIMERS needs to be enabled and LWIP_TIMERS_CUSTOM disabled"
+#endif
 #if (LWIP_TCP && LWIP_TCP_SACK_OUT && (LWIP_TCP_MAX_SACK_NUM < 1))
 #error "LWIP_TCP_MAX_SACK_NUM must be greater than 0"
 #endif
@@ -175,6 +202,12 @@ PACK_STRUCT_END
 #if ((LWIP_SOCKET || LWIP_NETCONN) && (NO_SYS==1))
 #error "If you want to use Sequential API, you have to define NO_SYS=0 in your lwipopts.h"
 #endif
+#if (LWIP_SOCKET && LWIP_SOCKET_EPOLL && !(LWIP_SOCKET_SELECT || LWIP_SOCKET_POLL))
+#error "If you want to use LWIP_SOCKET_EPOLL, you have to enable LWIP_SOCKET_SELECT or LWIP_SOCKET_POLL in your lwipopts.h"
+#endif
+#if (LWIP_SOCKET && LWIP_SOCKET_EPOLL && (LWIP_SOCKET_MAX_EPOLL < 1))
+#error "LWIP_SOCKET_MAX_EPOLL must be greater than 0"
+#endif
 #if (LWIP_PPP_API && (NO_SYS==1))
 #error "If you want to use PPP API, you have to define NO_SYS=0 in your lwipopts.h"
 #endif
@@ -199,6 +232,12 @@ PACK_STRUCT_END
 #if (MEM_LIBC_MALLOC && MEM_USE_POOLS)
 #error "MEM_LIBC_MALLOC and MEM_USE_POOLS may not both be simultaneously enabled in your lwipopts.h"
 #endif
+#if MEM_TLSF && (MEM_LIBC_MALLOC || MEM_USE_POOLS)
+#error "MEM_TLSF cannot be used together with MEM_LIBC_MALLOC or MEM_USE_POOLS"
+#endif
+#if MEM_TLSF && ((MEM_TLSF_SL_LOG2 < 1) || (MEM_TLSF_SL_LOG2 > 5))
+#error "MEM_TLSF_SL_LOG2 must be in the range 1..5"
+#endif
 #if (MEM_USE_POOLS && !MEMP_USE_CUSTOM_POOLS)
 #error "MEM_USE_POOLS requires custom pools (MEMP_USE_CUSTOM_POOLS) to be enabled in your lwipopts.h"
 #endif
@@ -229,6 +268,30 @@ PACK_STRUCT_END
 #if LWIP_TCPIP_CORE_LOCKING_INPUT && !LWIP_TCPIP_CORE_LOCKING
 #error "When using LWIP_TCPIP_CORE_LOCKING_INPUT, LWIP_TCPIP_CORE_LOCKING must be enabled, too"
 #endif
+#if LWIP_NETIF_TSO && LWIP_NETIF_TX_SINGLE_PBUF
+#error "LWIP_NETIF_TSO sends scatter-gather super-segments, it cannot be used with LWIP_NETIF_TX_SINGLE_PBUF"
+#endif
+#if IP_FRAG_BATCH && LWIP_NETIF_TX_SINGLE_PBUF
+#error "IP_FRAG_BATCH references the datagram from the fragments, it cannot be used with LWIP_NETIF_TX_SINGLE_PBUF"
+#endif
+#if LWIP_NETIF_TSO && !LWIP_TCP
+#error "LWIP_NETIF_TSO needs LWIP_TCP"
+#endif
+#if LWIP_NETIF_TSO && ((TCP_TSO_MAX_SIZE + 200) > 0xFFFF)
+#error "TCP_TSO_MAX_SIZE is too big to fit a super-segment including headers into a pbuf"
+#endif
+#if LWIP_TCPIP_INPUT_BATCH && ((TCPIP_INPUT_BATCH_SIZE < 1) || (TCPIP_INPUT_BATCH_SIZE > 0xffff))
+#error "LWIP_TCPIP_INPUT_BATCH needs TCPIP_INPUT_BATCH_SIZE in the range 1..65535"
+#endif
+#if LWIP_GRO && (!LWIP_IPV4 || !LWIP_TCP)
+#error "LWIP_GRO coalesces TCP/IPv4 segments, it needs LWIP_IPV4 and LWIP_TCP"
+#endif
+#if LWIP_GRO && LWIP_TCPIP_CORE_LOCKING_INPUT
+#error "LWIP_GRO holds packets in tcpip_thread, it cannot be used with LWIP_TCPIP_CORE_LOCKING_INPUT"
+#endif
+#if LWIP_GRO && ((LWIP_GRO_MAX_FLOWS < 1) || (LWIP_GRO_MAX_SEGS < 2) || (LWIP_GRO_MAX_SEGS > 255))
+#error "LWIP_GRO needs LWIP_GRO_MAX_FLOWS >= 1 and LWIP_GRO_MAX_SEGS in the range 2..255"
+#endif
 #if LWIP_TCP && LWIP_NETIF_TX_SINGLE_PBUF && !TCP_OVERSIZE
 #error "LWIP_NETIF_TX_SINGLE_PBUF needs TCP_OVERSIZE enabled to create single-pbuf TCP packets"
 #endif
@@ -292,8 +355,15 @@ PACK_STRUCT_END
 #ifdef LWIP_HOOK_MEMP_AVAILABLE
 #error "LWIP_HOOK_MEMP_AVAILABLE doesn't make sense with MEMP_MEM_MALLOC"
 #endif
+#if MEMP_CACHE
+#error "MEMP_CACHE doesn't make sense with MEMP_MEM_MALLOC"
+#endif
 #endif /* MEMP_MEM_MALLOC */
 
+#if MEMP_CACHE && (MEMP_CACHE_SIZE < 2)
+#error "MEMP_CACHE_SIZE must be at least 2"
+#endif
+
 /* TCP sanity checks */
 #if !LWIP_DISABLE_TCP_SANITY_CHECKS
 #if LWIP_TCP
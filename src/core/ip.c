@@ -59,6 +59,9 @@
 
 #include "lwip/ip_addr.h"
 #include "lwip/ip.h"
+#include "lwip/priv/ip_frag_priv.h"
+#include "lwip/mem.h"
+#include "lwip/sys.h"
 
 /** Global data for both IPv4 and IPv6 */
 struct ip_globals ip_data;
@@ -164,4 +167,192 @@ ip_input(struct pbuf *p, struct netif *inp)
 
 #endif /* LWIP_IPV4 && LWIP_IPV6 */
 
+#if IP_FRAG_BATCH && ((LWIP_IPV4 && IP_FRAG) || (LWIP_IPV6 && LWIP_IPV6_FRAG))
+
+/** A header pbuf or payload slice handed out by ip_frag_batch_next() */
+struct ip_frag_batch_pbuf {
+  /** 'base class' */
+  struct pbuf_custom pc;
+  /** batch this pbuf was sliced from */
+  struct ip_frag_batch *batch;
+};
+
+struct ip_frag_batch {
+  /** referenced datagram */
+  struct pbuf *original;
+  /** pbuf and offset of the next payload byte to slice */
+  struct pbuf *p;
+  u16_t poff;
+  /** payload bytes not yet sliced */
+  u16_t left;
+  u16_t hdr_len;
+  u16_t hdr_stride;
+  u16_t num_hdrs;
+  u16_t used_hdrs;
+  u16_t num_slices;
+  u16_t used_slices;
+  /** header pbufs (each followed by its link and IP header room) */
+  u8_t *hdrs;
+  struct ip_frag_batch_pbuf *slices;
+  /** fragment pbufs not yet freed, plus one for the builder */
+  u32_t refs;
+};
+
+#define IP_FRAG_BATCH_PBUF_SIZE LWIP_MEM_ALIGN_SIZE(sizeof(struct ip_frag_batch_pbuf))
+
+static void
+ip_frag_batch_unref(struct ip_frag_batch *batch)
+{
+  u32_t refs;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  /* fragments may be freed by the netif driver in another context */
+  SYS_ARCH_PROTECT(lev);
+  LWIP_ASSERT("batch->refs > 0", batch->refs > 0);
+  refs = --batch->refs;
+  SYS_ARCH_UNPROTECT(lev);
+  if (refs == 0) {
+    pbuf_free(batch->original);
+    mem_free(batch);
+  }
+}
+
+/** Free-callback function of header pbufs and slices, called by pbuf_free. */
+static void
+ip_frag_batch_free_pbuf(struct pbuf *p)
+{
+  struct ip_frag_batch_pbuf *bp = (struct ip_frag_batch_pbuf *)p;
+  LWIP_ASSERT("bp != NULL", bp != NULL);
+  ip_frag_batch_unref(bp->batch);
+}
+
+static void
+ip_frag_batch_ref(struct ip_frag_batch *batch, struct ip_frag_batch_pbuf *bp)
+{
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  bp->batch = batch;
+  bp->pc.custom_free_function = ip_frag_batch_free_pbuf;
+  SYS_ARCH_PROTECT(lev);
+  batch->refs++;
+  SYS_ARCH_UNPROTECT(lev);
+}
+
+/**
+ * Prepare slicing a datagram into fragments.
+ *
+ * @param p datagram to fragment (it is referenced, not copied)
+ * @param poff offset of the fragmentable part in p
+ * @param fragsize maximum payload length of one fragment
+ * @param hdr_len length of the header pbuf of each fragment
+ * @return the new batch or NULL if it could not be allocated
+ */
+struct ip_frag_batch *
+ip_frag_batch_alloc(struct pbuf *p, u16_t poff, u16_t fragsize, u16_t hdr_len)
+{
+  struct ip_frag_batch *batch;
+  size_t num_hdrs, num_slices, hdr_stride, size;
+
+  LWIP_ASSERT("fragsize > 0", fragsize > 0);
+  LWIP_ASSERT("p->len >= poff", p->len >= poff);
+
+  num_hdrs = ((size_t)(p->tot_len - poff) + fragsize - 1) / fragsize;
+  /* every fragment boundary starts at most one additional slice */
+  num_slices = num_hdrs + pbuf_clen(p);
+  hdr_stride = IP_FRAG_BATCH_PBUF_SIZE + LWIP_MEM_ALIGN_SIZE((size_t)PBUF_LINK) + LWIP_MEM_ALIGN_SIZE((size_t)hdr_len);
+  size = LWIP_MEM_ALIGN_SIZE(sizeof(struct ip_frag_batch)) + (num_hdrs * hdr_stride) +
+         (num_slices * sizeof(struct ip_frag_batch_pbuf));
+  if ((num_slices > 0xFFFF) || ((size_t)(mem_size_t)size != size)) {
+    return NULL;
+  }
+  batch = (struct ip_frag_batch *)mem_malloc((mem_size_t)size);
+  if (batch == NULL) {
+    return NULL;
+  }
+  batch->original = p;
+  batch->p = p;
+  batch->poff = poff;
+  batch->left = (u16_t)(p->tot_len - poff);
+  batch->hdr_len = hdr_len;
+  batch->hdr_stride = (u16_t)hdr_stride;
+  batch->num_hdrs = (u16_t)num_hdrs;
+  batch->used_hdrs = 0;
+  batch->num_slices = (u16_t)num_slices;
+  batch->used_slices = 0;
+  batch->hdrs = (u8_t *)batch + LWIP_MEM_ALIGN_SIZE(sizeof(struct ip_frag_batch));
+  batch->slices = (struct ip_frag_batch_pbuf *)(void *)(batch->hdrs + (num_hdrs * hdr_stride));
+  batch->refs = 1;
+  pbuf_ref(p);
+  return batch;
+}
+
+/**
+ * Slice the next fragment off the datagram.
+ *
+ * @param batch batch returned by ip_frag_batch_alloc()
+ * @param len payload length of this fragment
+ * @return a PBUF_LINK header pbuf of hdr_len bytes (left for the caller to
+ *         fill in), chained to PBUF_REFs for len bytes of payload
+ */
+struct pbuf *
+ip_frag_batch_next(struct ip_frag_batch *batch, u16_t len)
+{
+  struct ip_frag_batch_pbuf *hdr;
+  struct pbuf *rambuf;
+
+  LWIP_ASSERT("batch != NULL", batch != NULL);
+  LWIP_ASSERT("len <= batch->left", len <= batch->left);
+  LWIP_ASSERT("no header left", batch->used_hdrs < batch->num_hdrs);
+
+  hdr = (struct ip_frag_batch_pbuf *)(void *)(batch->hdrs + (batch->used_hdrs * batch->hdr_stride));
+  batch->used_hdrs++;
+  rambuf = pbuf_alloced_custom(PBUF_LINK, batch->hdr_len, PBUF_RAM, &hdr->pc,
+                               (u8_t *)hdr + IP_FRAG_BATCH_PBUF_SIZE,
+                               (u16_t)(batch->hdr_stride - IP_FRAG_BATCH_PBUF_SIZE));
+  LWIP_ASSERT("header room too short", rambuf != NULL);
+  ip_frag_batch_ref(batch, hdr);
+
+  batch->left = (u16_t)(batch->left - len);
+  while (len) {
+    struct ip_frag_batch_pbuf *slice;
+    struct pbuf *newpbuf;
+    u16_t plen = (u16_t)(batch->p->len - batch->poff);
+
+    LWIP_ASSERT("batch->p->len >= batch->poff", batch->p->len >= batch->poff);
+    if (plen == 0) {
+      batch->p = batch->p->next;
+      batch->poff = 0;
+      LWIP_ASSERT("datagram too short", batch->p != NULL);
+      continue;
+    }
+    plen = LWIP_MIN(plen, len);
+    LWIP_ASSERT("no slice left", batch->used_slices < batch->num_slices);
+    slice = &batch->slices[batch->used_slices++];
+    newpbuf = pbuf_alloced_custom(PBUF_RAW, plen, PBUF_REF, &slice->pc,
+                                  (u8_t *)batch->p->payload + batch->poff, plen);
+    ip_frag_batch_ref(batch, slice);
+    /* Add it to end of rambuf's chain, but using pbuf_cat, not pbuf_chain
+     * so that it is removed when pbuf_dechain is later called on rambuf.
+     */
+    pbuf_cat(rambuf, newpbuf);
+    batch->poff = (u16_t)(batch->poff + plen);
+    len = (u16_t)(len - plen);
+  }
+  return rambuf;
+}
+
+/**
+ * Release the builder's reference to a batch. The batch (and its reference
+ * to the datagram) is freed once all fragments returned by
+ * ip_frag_batch_next() have been freed, too.
+ */
+void
+ip_frag_batch_free(struct ip_frag_batch *batch)
+{
+  LWIP_ASSERT("batch != NULL", batch != NULL);
+  ip_frag_batch_unref(batch);
+}
+
+#endif /* IP_FRAG_BATCH && ((LWIP_IPV4 && IP_FRAG) || (LWIP_IPV6 && LWIP_IPV6_FRAG)) */
+
 #endif /* LWIP_IPV4 || LWIP_IPV6 */
@@ -48,6 +48,7 @@
 #if LWIP_IPV4 && LWIP_ARP /* don't build if not configured for use in lwipopts.h */
 
 #include "lwip/etharp.h"
+#include "lwip/ip4_fib.h"
 #include "lwip/stats.h"
 #include "lwip/snmp.h"
 #include "lwip/dhcp.h"
@@ -101,6 +102,12 @@ struct etharp_entry {
   struct eth_addr ethaddr;
   u16_t ctime;
   u8_t state;
+#if ETHARP_TABLE_HASH
+  /** next entry in the same hash bucket or on the free list */
+  netif_addr_idx_t hash_next;
+  /** neighbours on the LRU list */
+  netif_addr_idx_t lru_prev, lru_next;
+#endif /* ETHARP_TABLE_HASH */
 };
 
 static struct etharp_entry arp_table[ARP_TABLE_SIZE];
@@ -130,6 +137,180 @@ static netif_addr_idx_t etharp_cached_entry;
 #error "ARP_TABLE_SIZE must fit in an s16_t, you have to reduce it in your lwipopts.h"
 #endif
 
+#if ETHARP_TABLE_HASH
+#if (ETHARP_TABLE_HASH_SIZE < 1) || (ETHARP_TABLE_HASH_SIZE & (ETHARP_TABLE_HASH_SIZE - 1))
+#error "ETHARP_TABLE_HASH_SIZE must be a power of 2"
+#endif
+
+/* Links between ARP table entries are stored as index + 1, so that the
+   zero-initialized lists are empty: 0 terminates a list */
+#define ETHARP_LINK(i)  ((netif_addr_idx_t)((i) + 1))
+#define ETHARP_INDEX(l) ((netif_addr_idx_t)((l) - 1))
+
+/** first entry of every hash bucket */
+static netif_addr_idx_t etharp_hash_table[ETHARP_TABLE_HASH_SIZE];
+/** entries that have been freed */
+static netif_addr_idx_t etharp_free_list;
+/** number of entries at the start of arp_table that have ever been used */
+static netif_addr_idx_t etharp_num_used;
+/** entries in use, most recently used first */
+static netif_addr_idx_t etharp_lru_head, etharp_lru_tail;
+
+static netif_addr_idx_t *
+etharp_hash_bucket(const ip4_addr_t *ipaddr)
+{
+  u32_t addr = ip4_addr_get_u32(ipaddr);
+  addr ^= addr >> 16;
+  addr ^= addr >> 8;
+  return &etharp_hash_table[addr & (ETHARP_TABLE_HASH_SIZE - 1)];
+}
+
+/** Find the (pending or stable) entry of an IP address, -1 if there is none */
+static s16_t
+etharp_hash_find(const ip4_addr_t *ipaddr, struct netif *netif)
+{
+  netif_addr_idx_t link;
+
+  LWIP_UNUSED_ARG(netif);
+
+  for (link = *etharp_hash_bucket(ipaddr); link != 0; link = arp_table[ETHARP_INDEX(link)].hash_next) {
+    struct etharp_entry *entry = &arp_table[ETHARP_INDEX(link)];
+    if (ip4_addr_eq(ipaddr, &entry->ipaddr)
+#if ETHARP_TABLE_MATCH_NETIF
+        && ((netif == NULL) || (netif == entry->netif))
+#endif /* ETHARP_TABLE_MATCH_NETIF */
+       ) {
+      return (s16_t)ETHARP_INDEX(link);
+    }
+  }
+  return -1;
+}
+
+static void
+etharp_lru_unlink(netif_addr_idx_t i)
+{
+  struct etharp_entry *entry = &arp_table[i];
+
+  if (entry->lru_prev != 0) {
+    arp_table[ETHARP_INDEX(entry->lru_prev)].lru_next = entry->lru_next;
+  } else {
+    etharp_lru_head = entry->lru_next;
+  }
+  if (entry->lru_next != 0) {
+    arp_table[ETHARP_INDEX(entry->lru_next)].lru_prev = entry->lru_prev;
+  } else {
+    etharp_lru_tail = entry->lru_prev;
+  }
+}
+
+static void
+etharp_lru_push(netif_addr_idx_t i)
+{
+  arp_table[i].lru_prev = 0;
+  arp_table[i].lru_next = etharp_lru_head;
+  if (etharp_lru_head != 0) {
+    arp_table[ETHARP_INDEX(etharp_lru_head)].lru_prev = ETHARP_LINK(i);
+  } else {
+    etharp_lru_tail = ETHARP_LINK(i);
+  }
+  etharp_lru_head = ETHARP_LINK(i);
+}
+
+/** Mark an entry as most recently used */
+static void
+etharp_lru_touch(netif_addr_idx_t i)
+{
+  if (etharp_lru_head != ETHARP_LINK(i)) {
+    etharp_lru_unlink(i);
+    etharp_lru_push(i);
+  }
+}
+
+/** Get an unused entry, -1 if the table is full */
+static s16_t
+etharp_hash_alloc(void)
+{
+  netif_addr_idx_t i;
+
+  if (etharp_free_list != 0) {
+    i = ETHARP_INDEX(etharp_free_list);
+    etharp_free_list = arp_table[i].hash_next;
+  } else if (etharp_num_used < ARP_TABLE_SIZE) {
+    i = etharp_num_used++;
+  } else {
+    return -1;
+  }
+  return (s16_t)i;
+}
+
+/** Add a new entry (ipaddr set) to its hash bucket and the LRU list */
+static void
+etharp_hash_insert(netif_addr_idx_t i)
+{
+  netif_addr_idx_t *bucket = etharp_hash_bucket(&arp_table[i].ipaddr);
+
+  arp_table[i].hash_next = *bucket;
+  *bucket = ETHARP_LINK(i);
+  etharp_lru_push(i);
+}
+
+/** Remove an entry from its hash bucket and the LRU list and free it */
+static void
+etharp_hash_remove(netif_addr_idx_t i)
+{
+  netif_addr_idx_t *link;
+
+  for (link = etharp_hash_bucket(&arp_table[i].ipaddr); *link != 0; link = &arp_table[ETHARP_INDEX(*link)].hash_next) {
+    if (*link == ETHARP_LINK(i)) {
+      *link = arp_table[i].hash_next;
+      break;
+    }
+  }
+  etharp_lru_unlink(i);
+  arp_table[i].hash_next = etharp_free_list;
+  etharp_free_list = ETHARP_LINK(i);
+}
+
+/**
+ * Select the least recently used entry to recycle: stable entries first,
+ * then pending entries without and finally with queued packets. Static
+ * entries are never recycled.
+ *
+ * @return the entry to recycle, -1 if there is none
+ */
+static s16_t
+etharp_lru_victim(void)
+{
+  s16_t old_pending = -1, old_queue = -1;
+  netif_addr_idx_t link;
+
+  for (link = etharp_lru_tail; link != 0; link = arp_table[ETHARP_INDEX(link)].lru_prev) {
+    netif_addr_idx_t i = ETHARP_INDEX(link);
+    u8_t state = arp_table[i].state;
+    if (state == ETHARP_STATE_PENDING) {
+      if (arp_table[i].q != NULL) {
+        if (old_queue < 0) {
+          old_queue = (s16_t)i;
+        }
+      } else if (old_pending < 0) {
+        old_pending = (s16_t)i;
+      }
+    }
+#if ETHARP_SUPPORT_STATIC_ENTRIES
+    else if (state == ETHARP_STATE_STATIC) {
+      /* static entries don't expire */
+    }
+#endif /* ETHARP_SUPPORT_STATIC_ENTRIES */
+    else {
+      /* no queued packets should exist on stable entries */
+      LWIP_ASSERT("arp_table[i].q == NULL", arp_table[i].q == NULL);
+      return (s16_t)i;
+    }
+  }
+  return (old_pending >= 0) ? old_pending : old_queue;
+}
+#endif /* ETHARP_TABLE_HASH */
+
 
 static err_t etharp_request_dst(struct netif *netif, const ip4_addr_t *ipaddr, const struct eth_addr *hw_dst_addr);
 static err_t etharp_raw(struct netif *netif,
@@ -168,6 +349,9 @@ free_etharp_q(struct etharp_q_entry *q)
 static void
 etharp_free_entry(int i)
 {
+#if ETHARP_TABLE_HASH
+  etharp_hash_remove((netif_addr_idx_t)i);
+#endif /* ETHARP_TABLE_HASH */
   /* remove from SNMP ARP index tree */
   mib2_remove_arp_entry(arp_table[i].netif, &arp_table[i].ipaddr);
   /* and empty packet queue */
@@ -253,6 +437,55 @@ etharp_tmr(void)
  * @return The ARP entry index that matched or is created, ERR_MEM if no
  * entry is found or could be recycled.
  */
+#if ETHARP_TABLE_HASH
+static s16_t
+etharp_find_entry(const ip4_addr_t *ipaddr, u8_t flags, struct netif *netif)
+{
+  s16_t i;
+
+  LWIP_ASSERT("ipaddr != NULL", ipaddr != NULL);
+
+  i = etharp_hash_find(ipaddr, netif);
+  if (i >= 0) {
+    LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("etharp_find_entry: found matching entry %d\n", (int)i));
+    if ((flags & ETHARP_FLAG_FIND_ONLY) == 0) {
+      etharp_lru_touch((netif_addr_idx_t)i);
+    }
+    return i;
+  }
+  if ((flags & ETHARP_FLAG_FIND_ONLY) != 0) {
+    return (s16_t)ERR_MEM;
+  }
+
+  i = etharp_hash_alloc();
+  if (i < 0) {
+    if ((flags & ETHARP_FLAG_TRY_HARD) == 0) {
+      LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("etharp_find_entry: no empty entry found and not allowed to recycle\n"));
+      return (s16_t)ERR_MEM;
+    }
+    i = etharp_lru_victim();
+    if (i < 0) {
+      LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("etharp_find_entry: no empty or recyclable entries found\n"));
+      return (s16_t)ERR_MEM;
+    }
+    LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("etharp_find_entry: recycling least recently used entry %d\n", (int)i));
+    etharp_free_entry(i);
+    i = etharp_hash_alloc();
+  }
+
+  LWIP_ASSERT("i < ARP_TABLE_SIZE", (i >= 0) && (i < ARP_TABLE_SIZE));
+  LWIP_ASSERT("arp_table[i].state == ETHARP_STATE_EMPTY",
+              arp_table[i].state == ETHARP_STATE_EMPTY);
+
+  ip4_addr_copy(arp_table[i].ipaddr, *ipaddr);
+  arp_table[i].ctime = 0;
+#if ETHARP_TABLE_MATCH_NETIF
+  arp_table[i].netif = netif;
+#endif /* ETHARP_TABLE_MATCH_NETIF */
+  etharp_hash_insert((netif_addr_idx_t)i);
+  return i;
+}
+#else /* ETHARP_TABLE_HASH */
 static s16_t
 etharp_find_entry(const ip4_addr_t *ipaddr, u8_t flags, struct netif *netif)
 {
@@ -400,6 +633,7 @@ etharp_find_entry(const ip4_addr_t *ipaddr, u8_t flags, struct netif *netif)
 #endif /* ETHARP_TABLE_MATCH_NETIF */
   return (s16_t)i;
 }
+#endif /* ETHARP_TABLE_HASH */
 
 /**
  * Update (or insert) a IP/MAC address pair in the ARP cache.
@@ -750,6 +984,10 @@ etharp_output_to_arp_index(struct netif *netif, struct pbuf *q, netif_addr_idx_t
 {
   LWIP_ASSERT("arp_table[arp_idx].state >= ETHARP_STATE_STABLE",
               arp_table[arp_idx].state >= ETHARP_STATE_STABLE);
+
+#if ETHARP_TABLE_HASH
+  etharp_lru_touch(arp_idx);
+#endif /* ETHARP_TABLE_HASH */
   /* if arp table entry is about to expire: re-request it,
      but only if its state is ETHARP_STATE_STABLE to prevent flooding the
      network with ARP requests if this address is used frequently. */
@@ -821,6 +1059,9 @@ etharp_output(struct netif *netif, struct pbuf *q, const ip4_addr_t *ipaddr)
     /* unicast destination IP address? */
   } else {
     netif_addr_idx_t i;
+#if ETHARP_TABLE_HASH
+    s16_t i_hash;
+#endif /* ETHARP_TABLE_HASH */
     /* outside local network? if so, this can neither be a global broadcast nor
        a subnet broadcast. */
     if (!ip4_addr_net_eq(ipaddr, netif_ip4_addr(netif), netif_ip4_netmask(netif)) &&
@@ -834,6 +1075,11 @@ etharp_output(struct netif *netif, struct pbuf *q, const ip4_addr_t *ipaddr)
       if (!ip4_addr_islinklocal(&iphdr->src))
 #endif /* LWIP_AUTOIP */
       {
+#if LWIP_IPV4_FIB
+        /* next hop of a route via this netif */
+        dst_addr = ip4_fib_gateway(netif, ipaddr);
+        if (dst_addr == NULL)
+#endif /* LWIP_IPV4_FIB */
 #ifdef LWIP_HOOK_ETHARP_GET_GW
         /* For advanced routing, a single default gateway might not be enough, so get
            the IP address of the gateway to handle the current destination address. */
@@ -853,6 +1099,15 @@ etharp_output(struct netif *netif, struct pbuf *q, const ip4_addr_t *ipaddr)
         }
       }
     }
+#if LWIP_IPV4_FIB
+    else if (!ip4_addr_islinklocal(ipaddr)) {
+      /* a route more specific than the subnet may lead to a gateway */
+      const ip4_addr_t *gw_addr = ip4_fib_gateway(netif, ipaddr);
+      if (gw_addr != NULL) {
+        dst_addr = gw_addr;
+      }
+    }
+#endif /* LWIP_IPV4_FIB */
 #if LWIP_NETIF_HWADDRHINT
     if (netif->hints != NULL) {
       /* per-pcb cached entry was given */
@@ -873,6 +1128,15 @@ etharp_output(struct netif *netif, struct pbuf *q, const ip4_addr_t *ipaddr)
     }
 #endif /* LWIP_NETIF_HWADDRHINT */
 
+#if ETHARP_TABLE_HASH
+    /* find stable entry in its hash bucket */
+    i_hash = etharp_hash_find(dst_addr, netif);
+    if ((i_hash >= 0) && (arp_table[i_hash].state >= ETHARP_STATE_STABLE)) {
+      i = (netif_addr_idx_t)i_hash;
+      ETHARP_SET_ADDRHINT(netif, i);
+      return etharp_output_to_arp_index(netif, q, i);
+    }
+#else /* ETHARP_TABLE_HASH */
     /* find stable entry: do this here since this is a critical path for
        throughput and etharp_find_entry() is kind of slow */
     for (i = 0; i < ARP_TABLE_SIZE; i++) {
@@ -886,6 +1150,7 @@ etharp_output(struct netif *netif, struct pbuf *q, const ip4_addr_t *ipaddr)
         return etharp_output_to_arp_index(netif, q, i);
       }
     }
+#endif /* ETHARP_TABLE_HASH */
     /* no stable entry found, use the (slower) query function:
        queue on destination Ethernet address belonging to ipaddr */
     return etharp_query(netif, dst_addr, q);
@@ -46,6 +46,7 @@
 #include "lwip/def.h"
 #include "lwip/mem.h"
 #include "lwip/ip4_frag.h"
+#include "lwip/ip4_fib.h"
 #include "lwip/inet_chksum.h"
 #include "lwip/netif.h"
 #include "lwip/icmp.h"
@@ -144,6 +145,8 @@ ip4_route_src(const ip4_addr_t *src, const ip4_addr_t *dest)
  * searches the list of network interfaces linearly. A match is found
  * if the masked IP address of the network interface equals the masked
  * IP address given to the function.
+ * With LWIP_IPV4_FIB, the longest prefix of the netif subnets and the
+ * routing table wins instead (see ip4_fib_route()).
  *
  * @param dest the destination IP address for which to find the route
  * @return the netif on which to send to reach dest
@@ -166,6 +169,12 @@ ip4_route(const ip4_addr_t *dest)
   /* bug #54569: in case LWIP_SINGLE_NETIF=1 and LWIP_DEBUGF() disabled, the following loop is optimized away */
   LWIP_UNUSED_ARG(dest);
 
+#if LWIP_IPV4_FIB
+  netif = ip4_fib_route(dest);
+  if (netif != NULL) {
+    return netif;
+  }
+#else /* LWIP_IPV4_FIB */
   /* iterate through netifs */
   NETIF_FOREACH(netif) {
     /* is the netif up, does it have a link and a valid address? */
@@ -182,6 +191,7 @@ ip4_route(const ip4_addr_t *dest)
       }
     }
   }
+#endif /* LWIP_IPV4_FIB */
 
 #if LWIP_NETIF_LOOPBACK && !LWIP_HAVE_LOOPIF
   /* loopif is disabled, loopback traffic is passed through any netif */
@@ -792,6 +802,172 @@ ip4_input(struct pbuf *p, struct netif *inp)
   return ERR_OK;
 }
 
+static err_t ip4_output_netif(struct pbuf *p, const ip4_addr_t *dest, struct netif *netif);
+
+#if LWIP_NETIF_TSO
+
+/**
+ * Software GSO: split a TCP super-segment (p->gso_size != 0, see
+ * LWIP_NETIF_TSO) into packets of at most p->gso_size bytes of payload
+ * and send them. The headers are copied and fixed up (IP length, id and
+ * checksum; TCP seqno, flags and checksum), the payload is referenced
+ * (holding a reference on p, so drivers may queue the packets).
+ *
+ * @param p super-segment, p->payload points to the IP header
+ * @param dest destination IP address
+ * @param netif the netif on which to send
+ */
+static err_t
+ip4_gso_output(struct pbuf *p, const ip4_addr_t *dest, struct netif *netif)
+{
+  struct ip_hdr *iphdr = (struct ip_hdr *)p->payload;
+  struct tcp_hdr *tcphdr;
+  struct pbuf *q, *r, *src;
+  u16_t ip_hlen, hdr_len, data_len, off, seglen, left, n, src_off;
+  u32_t seqno;
+  u16_t flags;
+  ip4_addr_t src_addr;
+  err_t err = ERR_OK;
+
+  ip_hlen = IPH_HL_BYTES(iphdr);
+  LWIP_ASSERT("ip4_gso_output: TCP expected", IPH_PROTO(iphdr) == IP_PROTO_TCP);
+  LWIP_ASSERT("ip4_gso_output: headers must be in the first pbuf",
+              p->len >= ip_hlen + TCP_HLEN);
+  tcphdr = (struct tcp_hdr *)((u8_t *)p->payload + ip_hlen);
+  hdr_len = (u16_t)(ip_hlen + TCPH_HDRLEN_BYTES(tcphdr));
+  LWIP_ASSERT("ip4_gso_output: headers must be in the first pbuf", p->len >= hdr_len);
+  data_len = (u16_t)(p->tot_len - hdr_len);
+  seqno = lwip_ntohl(tcphdr->seqno);
+  flags = TCPH_FLAGS(tcphdr);
+  ip4_addr_copy(src_addr, iphdr->src);
+
+  /* source position of the payload */
+  src = p;
+  src_off = hdr_len;
+
+  for (off = 0; off < data_len; off = (u16_t)(off + seglen)) {
+    seglen = LWIP_MIN(p->gso_size, (u16_t)(data_len - off));
+
+    q = pbuf_alloc(PBUF_LINK, hdr_len, PBUF_RAM);
+    if (q == NULL) {
+      IP_STATS_INC(ip.memerr);
+      err = ERR_MEM;
+      break;
+    }
+    MEMCPY(q->payload, p->payload, hdr_len);
+    for (left = seglen; left > 0; left = (u16_t)(left - n)) {
+      while (src_off >= src->len) {
+        src_off = (u16_t)(src_off - src->len);
+        src = src->next;
+      }
+      n = LWIP_MIN(left, (u16_t)(src->len - src_off));
+      r = pbuf_alloc_tso_ref(p, (u8_t *)src->payload + src_off, n);
+      if (r == NULL) {
+        IP_STATS_INC(ip.memerr);
+        err = ERR_MEM;
+        break;
+      }
+      pbuf_cat(q, r);
+      src_off = (u16_t)(src_off + n);
+    }
+    if (err != ERR_OK) {
+      pbuf_free(q);
+      break;
+    }
+
+    /* fix up the IP header */
+    iphdr = (struct ip_hdr *)q->payload;
+    IPH_LEN_SET(iphdr, lwip_htons(q->tot_len));
+    if (off != 0) {
+      IPH_ID_SET(iphdr, lwip_htons(ip_id));
+      ++ip_id;
+    }
+    IPH_CHKSUM_SET(iphdr, 0);
+#if CHECKSUM_GEN_IP
+    IF__NETIF_CHECKSUM_ENABLED(netif, NETIF_CHECKSUM_GEN_IP) {
+      IPH_CHKSUM_SET(iphdr, inet_chksum(iphdr, ip_hlen));
+    }
+#endif /* CHECKSUM_GEN_IP */
+
+    /* fix up the TCP header: PSH and FIN only on the last segment */
+    tcphdr = (struct tcp_hdr *)((u8_t *)q->payload + ip_hlen);
+    tcphdr->seqno = lwip_htonl(seqno + off);
+    if (off + seglen < data_len) {
+      TCPH_FLAGS_SET(tcphdr, (u16_t)(flags & ~(TCP_PSH | TCP_FIN)));
+    }
+    tcphdr->chksum = 0;
+#if CHECKSUM_GEN_TCP
+    IF__NETIF_CHECKSUM_ENABLED(netif, NETIF_CHECKSUM_GEN_TCP) {
+      pbuf_remove_header(q, ip_hlen);
+      tcphdr->chksum = inet_chksum_pseudo(q, IP_PROTO_TCP, q->tot_len, &src_addr, dest);
+      pbuf_add_header(q, ip_hlen);
+    }
+#endif /* CHECKSUM_GEN_TCP */
+
+    err = ip4_output_netif(q, dest, netif);
+    pbuf_free(q);
+    if (err != ERR_OK) {
+      break;
+    }
+  }
+  if (off != 0) {
+    /* Some packets are out and may get acknowledged: failing now would keep
+       snd_nxt behind the peer's ACKs (and cause an ACK storm). Report success
+       and let TCP retransmit the rest as if it was lost on the link. */
+    return ERR_OK;
+  }
+  return err;
+}
+#endif /* LWIP_NETIF_TSO */
+
+/**
+ * Hand a packet with a complete IP header to loopback, IP fragmentation,
+ * software GSO or netif->output.
+ */
+static err_t
+ip4_output_netif(struct pbuf *p, const ip4_addr_t *dest, struct netif *netif)
+{
+#if ENABLE_LOOPBACK
+  if (ip4_addr_eq(dest, netif_ip4_addr(netif))
+#if !LWIP_HAVE_LOOPIF
+      || ip4_addr_isloopback(dest)
+#endif /* !LWIP_HAVE_LOOPIF */
+     ) {
+#if LWIP_NETIF_TSO
+    if (p->gso_size != 0) {
+      return ip4_gso_output(p, dest, netif);
+    }
+#endif /* LWIP_NETIF_TSO */
+    /* Packet to self, enqueue it for loopback */
+    LWIP_DEBUGF(IP_DEBUG, ("netif_loop_output()"));
+    return netif_loop_output(netif, p);
+  }
+#if LWIP_MULTICAST_TX_OPTIONS
+  if ((p->flags & PBUF_FLAG_MCASTLOOP) != 0) {
+    netif_loop_output(netif, p);
+  }
+#endif /* LWIP_MULTICAST_TX_OPTIONS */
+#endif /* ENABLE_LOOPBACK */
+#if LWIP_NETIF_TSO
+  if ((p->gso_size != 0) && !(netif->flags & NETIF_FLAG_TSO)) {
+    return ip4_gso_output(p, dest, netif);
+  }
+#endif /* LWIP_NETIF_TSO */
+#if IP_FRAG
+  /* don't fragment if interface has mtu set to 0 [loopif] or segments itself */
+  if (netif->mtu && (p->tot_len > netif->mtu)
+#if LWIP_NETIF_TSO
+      && (p->gso_size == 0)
+#endif /* LWIP_NETIF_TSO */
+     ) {
+    return ip4_frag(p, netif, dest);
+  }
+#endif /* IP_FRAG */
+
+  LWIP_DEBUGF(IP_DEBUG, ("ip4_output_if: call netif->output()\n"));
+  return netif->output(netif, p, dest);
+}
+
 /**
  * Sends an IP packet on a network interface. This function constructs
  * the IP header and calculates the IP header checksum. If the source
@@ -1014,31 +1190,7 @@ ip4_output_if_opt_src(struct pbuf *p, const ip4_addr_t *src, const ip4_addr_t *d
   LWIP_DEBUGF(IP_DEBUG, ("ip4_output_if: %c%c%"U16_F"\n", netif->name[0], netif->name[1], (u16_t)netif->num));
   ip4_debug_print(p);
 
-#if ENABLE_LOOPBACK
-  if (ip4_addr_eq(dest, netif_ip4_addr(netif))
-#if !LWIP_HAVE_LOOPIF
-      || ip4_addr_isloopback(dest)
-#endif /* !LWIP_HAVE_LOOPIF */
-     ) {
-    /* Packet to self, enqueue it for loopback */
-    LWIP_DEBUGF(IP_DEBUG, ("netif_loop_output()"));
-    return netif_loop_output(netif, p);
-  }
-#if LWIP_MULTICAST_TX_OPTIONS
-  if ((p->flags & PBUF_FLAG_MCASTLOOP) != 0) {
-    netif_loop_output(netif, p);
-  }
-#endif /* LWIP_MULTICAST_TX_OPTIONS */
-#endif /* ENABLE_LOOPBACK */
-#if IP_FRAG
-  /* don't fragment if interface has mtu set to 0 [loopif] */
-  if (netif->mtu && (p->tot_len > netif->mtu)) {
-    return ip4_frag(p, netif, dest);
-  }
-#endif /* IP_FRAG */
-
-  LWIP_DEBUGF(IP_DEBUG, ("ip4_output_if: call netif->output()\n"));
-  return netif->output(netif, p, dest);
+  return ip4_output_netif(p, dest, netif);
 }
 
 /**
@@ -0,0 +1,460 @@
+/**
+ * @file
+ * IPv4 routing table (FIB) with longest-prefix match
+ *
+ * Built with LWIP_IPV4_FIB: static routes are kept in a path-compressed
+ * binary trie (one node per route plus one per branch), so a lookup visits
+ * at most one node per prefix length on the path to the destination.
+ * ip4_route() combines this with the subnets of the netifs, the longer
+ * prefix wins. Results are kept in a small direct-mapped cache per
+ * destination that is also used by etharp_output() to find the next hop,
+ * and flushed whenever a route or a netif changes.
+ */
+
+/*
+ * Copyright (c) 2001-2004 Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ *
+ */
+
+#include "lwip/opt.h"
+
+#if LWIP_IPV4 && LWIP_IPV4_FIB /* don't build if not configured for use in lwipopts.h */
+
+#include "lwip/ip4_fib.h"
+#include "lwip/ip4.h"
+#include "lwip/memp.h"
+#include "lwip/def.h"
+#include "lwip/debug.h"
+
+#include <string.h>
+
+#if LWIP_SINGLE_NETIF
+#error "LWIP_IPV4_FIB needs LWIP_SINGLE_NETIF==0"
+#endif
+#if (IP4_FIB_CACHE_SIZE < 1) || (IP4_FIB_CACHE_SIZE & (IP4_FIB_CACHE_SIZE - 1))
+#error "IP4_FIB_CACHE_SIZE must be a power of 2"
+#endif
+
+/** Mask of the first 'len' bits of a host order address */
+#define IP4_FIB_MASK(len)     (((len) == 0) ? 0 : (0xFFFFFFFFUL << (32 - (len))))
+/** Bit 'pos' (0: most significant) of a host order address */
+#define IP4_FIB_BIT(key, pos) (((key) >> (31 - (pos))) & 1)
+/** Does the prefix of node 'n' contain the host order address 'key'? */
+#define IP4_FIB_MATCH(n, key) ((((key) ^ (n)->prefix) & IP4_FIB_MASK((n)->prefix_len)) == 0)
+
+/** A cached routing decision */
+struct ip4_fib_cache_entry {
+  ip4_addr_t dest;
+  struct netif *netif;
+  /** the route used, NULL for the subnet of a netif */
+  const struct ip4_fib_node *route;
+  u8_t valid;
+};
+
+static struct ip4_fib_node *ip4_fib_root;
+static struct ip4_fib_cache_entry ip4_fib_cache[IP4_FIB_CACHE_SIZE];
+
+/** Number of leading bits 'a' and 'b' have in common, at most 'max' */
+static u8_t
+ip4_fib_common_len(u32_t a, u32_t b, u8_t max)
+{
+  u8_t len = 0;
+  while ((len < max) && (IP4_FIB_BIT(a, len) == IP4_FIB_BIT(b, len))) {
+    len++;
+  }
+  return len;
+}
+
+/** Prefix length of a netmask */
+static s16_t
+ip4_fib_mask_len(const ip4_addr_t *netmask)
+{
+  u32_t mask = lwip_ntohl(ip4_addr_get_u32(netmask));
+  s16_t len = 0;
+  while ((len < 32) && IP4_FIB_BIT(mask, len)) {
+    len++;
+  }
+  return len;
+}
+
+static int
+ip4_fib_netif_usable(const struct netif *netif)
+{
+  return netif_is_up(netif) && netif_is_link_up(netif);
+}
+
+/** Longest-prefix match over the routes with a usable netif */
+static struct ip4_fib_node *
+ip4_fib_lpm(u32_t key)
+{
+  struct ip4_fib_node *n, *best = NULL;
+
+  for (n = ip4_fib_root; (n != NULL) && IP4_FIB_MATCH(n, key); ) {
+    if (n->is_route && ip4_fib_netif_usable(n->netif)) {
+      best = n;
+    }
+    if (n->prefix_len == 32) {
+      break;
+    }
+    n = n->child[IP4_FIB_BIT(key, n->prefix_len)];
+  }
+  return best;
+}
+
+/** Find the netif whose subnet (or point-to-point peer) contains 'dest' with
+ * the longest prefix. Returns the prefix length in 'len' (-1 if none). */
+static struct netif *
+ip4_fib_subnet(const ip4_addr_t *dest, s16_t *len)
+{
+  struct netif *netif, *best = NULL;
+
+  *len = -1;
+  NETIF_FOREACH(netif) {
+    /* is the netif up, does it have a link and a valid address? */
+    if (ip4_fib_netif_usable(netif) && !ip4_addr_isany_val(*netif_ip4_addr(netif))) {
+      s16_t netif_len = -1;
+      if (ip4_addr_net_eq(dest, netif_ip4_addr(netif), netif_ip4_netmask(netif))) {
+        netif_len = ip4_fib_mask_len(netif_ip4_netmask(netif));
+      } else if (((netif->flags & NETIF_FLAG_BROADCAST) == 0) && ip4_addr_eq(dest, netif_ip4_gw(netif))) {
+        /* peer of a point to point interface */
+        netif_len = 32;
+      }
+      if (netif_len > *len) {
+        best = netif;
+        *len = netif_len;
+      }
+    }
+  }
+  return best;
+}
+
+/** Look up 'dest' in the cache, filling the entry on a miss */
+static const struct ip4_fib_cache_entry *
+ip4_fib_cache_lookup(const ip4_addr_t *dest)
+{
+  u32_t addr = ip4_addr_get_u32(dest);
+  struct ip4_fib_cache_entry *entry;
+  struct ip4_fib_node *route = NULL;
+  struct netif *netif;
+  s16_t len;
+
+  addr ^= addr >> 16;
+  addr ^= addr >> 8;
+  entry = &ip4_fib_cache[addr & (IP4_FIB_CACHE_SIZE - 1)];
+  if (entry->valid && ip4_addr_eq(&entry->dest, dest)) {
+    return entry;
+  }
+
+  netif = ip4_fib_subnet(dest, &len);
+  /* loopback traffic must not follow a route */
+  if (!ip4_addr_isloopback(dest)) {
+    route = ip4_fib_lpm(lwip_ntohl(ip4_addr_get_u32(dest)));
+  }
+  if ((route != NULL) && (route->prefix_len > len)) {
+    netif = route->netif;
+  } else {
+    route = NULL;
+  }
+  ip4_addr_copy(entry->dest, *dest);
+  entry->netif = netif;
+  entry->route = route;
+  entry->valid = 1;
+  return entry;
+}
+
+/**
+ * Find the netif for 'dest': the longest prefix of the routing table and
+ * the subnets of the netifs. Called by ip4_route().
+ *
+ * @param dest the destination address
+ * @return the netif to send on or NULL if no route or subnet matches
+ */
+struct netif *
+ip4_fib_route(const ip4_addr_t *dest)
+{
+  LWIP_ASSERT_CORE_LOCKED();
+  return ip4_fib_cache_lookup(dest)->netif;
+}
+
+/**
+ * Get the next hop of a route for 'dest' on 'netif'. Called by
+ * etharp_output() for all unicast destinations that are not link-local,
+ * a route more specific than the subnet of the netif may exist for
+ * destinations inside it.
+ *
+ * @param netif the netif the packet is sent on
+ * @param dest the destination address
+ * @return the gateway, 'dest' itself for an on-link route, or NULL if no
+ *         route via 'netif' matches (use the gateway of the netif then)
+ */
+const ip4_addr_t *
+ip4_fib_gateway(struct netif *netif, const ip4_addr_t *dest)
+{
+  const struct ip4_fib_cache_entry *entry;
+
+  LWIP_ASSERT_CORE_LOCKED();
+  entry = ip4_fib_cache_lookup(dest);
+  if ((entry->route == NULL) || (entry->route->netif != netif)) {
+    return NULL;
+  }
+  if (ip4_addr_isany_val(entry->route->gw)) {
+    return dest;
+  }
+  return &entry->route->gw;
+}
+
+/**
+ * Invalidate all cached routing decisions. Called when a route or the
+ * address, state or link of a netif changes.
+ */
+void
+ip4_fib_cache_flush(void)
+{
+  memset(ip4_fib_cache, 0, sizeof(ip4_fib_cache));
+}
+
+/**
+ * @ingroup ip4
+ * Add a route to the IPv4 routing table.
+ *
+ * @param prefix the destination network (host bits must be 0)
+ * @param prefix_len the prefix length (0..32, 0 for a default route)
+ * @param gw the next hop or NULL/any for destinations directly on the link
+ * @param netif the netif to send on or NULL to use the netif whose subnet
+ *        contains 'gw'
+ * @return ERR_OK, ERR_ARG for an invalid prefix, ERR_RTE if no netif can
+ *         reach 'gw', ERR_USE if the route exists or ERR_MEM if out of nodes
+ */
+err_t
+ip4_fib_add(const ip4_addr_t *prefix, u8_t prefix_len, const ip4_addr_t *gw, struct netif *netif)
+{
+  struct ip4_fib_node **link = &ip4_fib_root;
+  struct ip4_fib_node *n, *node = NULL;
+  u32_t key;
+
+  LWIP_ASSERT_CORE_LOCKED();
+  LWIP_ERROR("ip4_fib_add: invalid prefix", (prefix != NULL) && (prefix_len <= 32), return ERR_ARG;);
+  key = lwip_ntohl(ip4_addr_get_u32(prefix));
+  LWIP_ERROR("ip4_fib_add: host bits set in prefix", (key & ~IP4_FIB_MASK(prefix_len)) == 0, return ERR_ARG;);
+
+  if (netif == NULL) {
+    LWIP_ERROR("ip4_fib_add: need gw or netif", (gw != NULL) && !ip4_addr_isany(gw), return ERR_ARG;);
+    NETIF_FOREACH(netif) {
+      if (!ip4_addr_isany_val(*netif_ip4_addr(netif)) &&
+          ip4_addr_net_eq(gw, netif_ip4_addr(netif), netif_ip4_netmask(netif))) {
+        break;
+      }
+    }
+    if (netif == NULL) {
+      return ERR_RTE;
+    }
+  }
+
+  /* walk down to where the prefix belongs */
+  for (n = *link; n != NULL; n = *link) {
+    if ((n->prefix_len > prefix_len) || !IP4_FIB_MATCH(n, key)) {
+      break;
+    }
+    if (n->prefix_len == prefix_len) {
+      if (n->is_route) {
+        return ERR_USE;
+      }
+      /* a branch node becomes a route */
+      node = n;
+      break;
+    }
+    link = &n->child[IP4_FIB_BIT(key, n->prefix_len)];
+  }
+
+  if (node == NULL) {
+    node = (struct ip4_fib_node *)memp_malloc(MEMP_IP4_FIB_NODE);
+    if (node == NULL) {
+      return ERR_MEM;
+    }
+    memset(node, 0, sizeof(struct ip4_fib_node));
+    node->prefix = key;
+    node->prefix_len = prefix_len;
+    if (n != NULL) {
+      u8_t common = ip4_fib_common_len(key, n->prefix, (u8_t)LWIP_MIN(prefix_len, n->prefix_len));
+      if (common == prefix_len) {
+        /* the new prefix contains n */
+        node->child[IP4_FIB_BIT(n->prefix, prefix_len)] = n;
+        *link = node;
+      } else {
+        /* branch where the prefixes differ */
+        struct ip4_fib_node *branch = (struct ip4_fib_node *)memp_malloc(MEMP_IP4_FIB_NODE);
+        if (branch == NULL) {
+          memp_free(MEMP_IP4_FIB_NODE, node);
+          return ERR_MEM;
+        }
+        memset(branch, 0, sizeof(struct ip4_fib_node));
+        branch->prefix = key & IP4_FIB_MASK(common);
+        branch->prefix_len = common;
+        branch->child[IP4_FIB_BIT(key, common)] = node;
+        branch->child[IP4_FIB_BIT(n->prefix, common)] = n;
+        *link = branch;
+      }
+    } else {
+      *link = node;
+    }
+  }
+
+  node->is_route = 1;
+  node->netif = netif;
+  if (gw != NULL) {
+    ip4_addr_copy(node->gw, *gw);
+  } else {
+    ip4_addr_set_any(&node->gw);
+  }
+  ip4_fib_cache_flush();
+  return ERR_OK;
+}
+
+/** Remove the node at 'link' if it is neither a route nor a branch any more.
+ * @return 1 if the node was removed */
+static int
+ip4_fib_collapse(struct ip4_fib_node **link)
+{
+  struct ip4_fib_node *n = *link;
+
+  if (n->is_route || ((n->child[0] != NULL) && (n->child[1] != NULL))) {
+    return 0;
+  }
+  *link = (n->child[0] != NULL) ? n->child[0] : n->child[1];
+  memp_free(MEMP_IP4_FIB_NODE, n);
+  return 1;
+}
+
+/**
+ * @ingroup ip4
+ * Delete a route from the IPv4 routing table.
+ *
+ * @param prefix the destination network of the route
+ * @param prefix_len the prefix length of the route
+ * @return ERR_OK or ERR_VAL if there is no such route
+ */
+err_t
+ip4_fib_delete(const ip4_addr_t *prefix, u8_t prefix_len)
+{
+  /* links to the nodes on the path, prefix lengths increase along it */
+  struct ip4_fib_node **path[33];
+  struct ip4_fib_node *n;
+  int depth = 0;
+  u32_t key;
+
+  LWIP_ASSERT_CORE_LOCKED();
+  LWIP_ERROR("ip4_fib_delete: invalid prefix", (prefix != NULL) && (prefix_len <= 32), return ERR_ARG;);
+  key = lwip_ntohl(ip4_addr_get_u32(prefix));
+  LWIP_ERROR("ip4_fib_delete: host bits set in prefix", (key & ~IP4_FIB_MASK(prefix_len)) == 0, return ERR_ARG;);
+
+  path[0] = &ip4_fib_root;
+  for (n = *path[0]; n != NULL; n = *path[depth]) {
+    if ((n->prefix_len > prefix_len) || !IP4_FIB_MATCH(n, key)) {
+      return ERR_VAL;
+    }
+    if (n->prefix_len == prefix_len) {
+      break;
+    }
+    path[++depth] = &n->child[IP4_FIB_BIT(key, n->prefix_len)];
+  }
+  if ((n == NULL) || !n->is_route) {
+    return ERR_VAL;
+  }
+
+  ip4_fib_cache_flush();
+  n->is_route = 0;
+  n->netif = NULL;
+  /* remove the node if it is not needed as a branch, then the branch nodes
+     above it that are left with a single child */
+  while ((depth >= 0) && ip4_fib_collapse(path[depth])) {
+    depth--;
+  }
+  return ERR_OK;
+}
+
+/**
+ * @ingroup ip4
+ * Longest-prefix match in the IPv4 routing table only (without the subnets
+ * of the netifs and without the route cache).
+ *
+ * @param dest the destination address
+ * @param gw if not NULL, the next hop of the route is stored here (any for
+ *        an on-link route)
+ * @return the netif of the route or NULL if no route with a netif that is
+ *         up matches
+ */
+struct netif *
+ip4_fib_lookup(const ip4_addr_t *dest, ip4_addr_t *gw)
+{
+  struct ip4_fib_node *route;
+
+  LWIP_ASSERT_CORE_LOCKED();
+  LWIP_ERROR("ip4_fib_lookup: invalid dest", dest != NULL, return NULL;);
+
+  route = ip4_fib_lpm(lwip_ntohl(ip4_addr_get_u32(dest)));
+  if (route == NULL) {
+    return NULL;
+  }
+  if (gw != NULL) {
+    ip4_addr_copy(*gw, route->gw);
+  }
+  return route->netif;
+}
+
+/** Delete the routes via 'netif' below 'link', children first so that
+ * branch nodes left over can be removed on the way back up */
+static void
+ip4_fib_delete_netif(struct ip4_fib_node **link, const struct netif *netif)
+{
+  struct ip4_fib_node *n = *link;
+
+  if (n == NULL) {
+    return;
+  }
+  ip4_fib_delete_netif(&n->child[0], netif);
+  ip4_fib_delete_netif(&n->child[1], netif);
+  if (n->is_route && (n->netif == netif)) {
+    n->is_route = 0;
+    n->netif = NULL;
+  }
+  ip4_fib_collapse(link);
+}
+
+/**
+ * Delete all routes via a netif that is removed. Called by netif_remove().
+ *
+ * @param netif the netif being removed
+ */
+void
+ip4_fib_netif_removed(struct netif *netif)
+{
+  ip4_fib_delete_netif(&ip4_fib_root, netif);
+  ip4_fib_cache_flush();
+}
+
+#endif /* LWIP_IPV4 && LWIP_IPV4_FIB */
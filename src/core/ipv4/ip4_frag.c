@@ -48,6 +48,7 @@
 #include "lwip/netif.h"
 #include "lwip/stats.h"
 #include "lwip/icmp.h"
+#include "lwip/priv/ip_frag_priv.h"
 
 #include <string.h>
 
@@ -106,13 +107,35 @@ PACK_STRUCT_END
 #endif
 
 #define IP_ADDRESSES_AND_ID_MATCH(iphdrA, iphdrB)  \
-  (ip4_addr_eq(&(iphdrA)->src, &(iphdrB)->src) && \
-   ip4_addr_eq(&(iphdrA)->dest, &(iphdrB)->dest) && \
-   IPH_ID(iphdrA) == IPH_ID(iphdrB)) ? 1 : 0
+  ((ip4_addr_eq(&(iphdrA)->src, &(iphdrB)->src) && \
+    ip4_addr_eq(&(iphdrA)->dest, &(iphdrB)->dest) && \
+    IPH_ID(iphdrA) == IPH_ID(iphdrB)) ? 1 : 0)
+
+/** Fragment 'b' may be chained behind fragment 'a' */
+#if IP_REASS_CHECK_OVERLAP
+#define IP_REASS_FRAG_FOLLOWS(a, b) (((b)->start > (a)->start) && ((b)->start >= (a)->end))
+#else /* IP_REASS_CHECK_OVERLAP */
+#define IP_REASS_FRAG_FOLLOWS(a, b) ((b)->start > (a)->start)
+#endif /* IP_REASS_CHECK_OVERLAP */
+
+#if (IP_REASS_HASH_SIZE & (IP_REASS_HASH_SIZE - 1)) != 0
+#error "IP_REASS_HASH_SIZE must be a power of 2"
+#endif
+
+/** Index of the list datagrams from the source address of 'iphdr' are kept in */
+#if IP_REASS_HASH_SIZE > 1
+#define IP_REASS_HASH(iphdr) ip_reass_hash(iphdr)
+#else /* IP_REASS_HASH_SIZE > 1 */
+#define IP_REASS_HASH(iphdr) 0
+#endif /* IP_REASS_HASH_SIZE > 1 */
 
 /* global variables */
-static struct ip_reassdata *reassdatagrams;
+static struct ip_reassdata *reassdatagrams[IP_REASS_HASH_SIZE];
 static u16_t ip_reass_pbufcount;
+#if IP_REASS_MAX_PBUFS_PER_SOURCE < IP_REASS_MAX_PBUFS
+/** pbufs enqueued for the datagrams of each list */
+static u16_t ip_reass_list_pbufcount[IP_REASS_HASH_SIZE];
+#endif /* IP_REASS_MAX_PBUFS_PER_SOURCE < IP_REASS_MAX_PBUFS */
 
 /* function prototypes */
 static void ip_reass_dequeue_datagram(struct ip_reassdata *ipr, struct ip_reassdata *prev);
@@ -127,29 +150,73 @@ static int ip_reass_free_complete_datagram(struct ip_reassdata *ipr, struct ip_r
 void
 ip_reass_tmr(void)
 {
-  struct ip_reassdata *r, *prev = NULL;
-
-  r = reassdatagrams;
-  while (r != NULL) {
-    /* Decrement the timer. Once it reaches 0,
-     * clean up the incomplete fragment assembly */
-    if (r->timer > 0) {
-      r->timer--;
-      LWIP_DEBUGF(IP_REASS_DEBUG, ("ip_reass_tmr: timer dec %"U16_F"\n", (u16_t)r->timer));
-      prev = r;
-      r = r->next;
-    } else {
-      /* reassembly timed out */
-      struct ip_reassdata *tmp;
-      LWIP_DEBUGF(IP_REASS_DEBUG, ("ip_reass_tmr: timer timed out\n"));
-      tmp = r;
-      /* get the next pointer before freeing */
-      r = r->next;
-      /* free the helper struct and all enqueued pbufs */
-      ip_reass_free_complete_datagram(tmp, prev);
+  struct ip_reassdata *r, *prev;
+  u16_t i;
+
+  for (i = 0; i < IP_REASS_HASH_SIZE; i++) {
+    prev = NULL;
+    r = reassdatagrams[i];
+    while (r != NULL) {
+      /* Decrement the timer. Once it reaches 0,
+       * clean up the incomplete fragment assembly */
+      if (r->timer > 0) {
+        r->timer--;
+        LWIP_DEBUGF(IP_REASS_DEBUG, ("ip_reass_tmr: timer dec %"U16_F"\n", (u16_t)r->timer));
+        prev = r;
+        r = r->next;
+      } else {
+        /* reassembly timed out */
+        struct ip_reassdata *tmp;
+        LWIP_DEBUGF(IP_REASS_DEBUG, ("ip_reass_tmr: timer timed out\n"));
+        tmp = r;
+        /* get the next pointer before freeing */
+        r = r->next;
+        /* free the helper struct and all enqueued pbufs */
+        ip_reass_free_complete_datagram(tmp, prev);
+      }
+    }
+  }
+}
+
+#if IP_REASS_HASH_SIZE > 1
+/**
+ * Hash the source address of an IP header into the datagram lists.
+ * All datagrams from one source are kept in the same list.
+ */
+static u16_t
+ip_reass_hash(const struct ip_hdr *iphdr)
+{
+  u32_t h = iphdr->src.addr;
+  h ^= h >> 16;
+  h ^= h >> 8;
+  return (u16_t)(h & (IP_REASS_HASH_SIZE - 1));
+}
+#endif /* IP_REASS_HASH_SIZE > 1 */
+
+#if IP_REASS_MAX_PBUFS_PER_SOURCE < IP_REASS_MAX_PBUFS
+/**
+ * Check if the source address of 'fraghdr' would exceed its quota
+ * (IP_REASS_MAX_PBUFS_PER_SOURCE) by enqueueing 'clen' more pbufs.
+ * Its datagrams are only counted if the list they are kept in exceeds it.
+ */
+static int
+ip_reass_source_over_quota(const struct ip_hdr *fraghdr, u16_t clen)
+{
+  struct ip_reassdata *r;
+  u16_t idx = (u16_t)IP_REASS_HASH(fraghdr);
+  u16_t count = 0;
+
+  if ((ip_reass_list_pbufcount[idx] + clen) <= IP_REASS_MAX_PBUFS_PER_SOURCE) {
+    return 0;
+  }
+  for (r = reassdatagrams[idx]; r != NULL; r = r->next) {
+    if (ip4_addr_eq(&r->iphdr.src, &fraghdr->src)) {
+      count = (u16_t)(count + r->pbufcount);
     }
   }
+  return (count + clen) > IP_REASS_MAX_PBUFS_PER_SOURCE;
 }
+#endif /* IP_REASS_MAX_PBUFS_PER_SOURCE < IP_REASS_MAX_PBUFS */
 
 /**
  * Free a datagram (struct ip_reassdata) and all its pbufs.
@@ -221,43 +288,46 @@ ip_reass_free_complete_datagram(struct ip_reassdata *ipr, struct ip_reassdata *p
  * @param fraghdr IP header of the current fragment
  * @param pbufs_needed number of pbufs needed to enqueue
  *        (used for freeing other datagrams if not enough space)
+ * @param same_source only free datagrams from the source of 'fraghdr'
  * @return the number of pbufs freed
  */
 static int
-ip_reass_remove_oldest_datagram(struct ip_hdr *fraghdr, int pbufs_needed)
+ip_reass_remove_oldest_datagram(struct ip_hdr *fraghdr, int pbufs_needed, int same_source)
 {
-  /* @todo Can't we simply remove the last datagram in the
-   *       linked list behind reassdatagrams?
-   */
   struct ip_reassdata *r, *oldest, *prev, *oldest_prev;
   int pbufs_freed = 0, pbufs_freed_current;
   int other_datagrams;
+  u16_t i, first, last;
+
+  if (same_source) {
+    first = (u16_t)IP_REASS_HASH(fraghdr);
+    last = (u16_t)(first + 1);
+  } else {
+    first = 0;
+    last = IP_REASS_HASH_SIZE;
+  }
 
   /* Free datagrams until being allowed to enqueue 'pbufs_needed' pbufs,
    * but don't free the datagram that 'fraghdr' belongs to! */
   do {
     oldest = NULL;
-    prev = NULL;
     oldest_prev = NULL;
     other_datagrams = 0;
-    r = reassdatagrams;
-    while (r != NULL) {
-      if (!IP_ADDRESSES_AND_ID_MATCH(&r->iphdr, fraghdr)) {
-        /* Not the same datagram as fraghdr */
-        other_datagrams++;
-        if (oldest == NULL) {
-          oldest = r;
-          oldest_prev = prev;
-        } else if (r->timer <= oldest->timer) {
-          /* older than the previous oldest */
-          oldest = r;
-          oldest_prev = prev;
+    for (i = first; i < last; i++) {
+      prev = NULL;
+      for (r = reassdatagrams[i]; r != NULL; r = r->next) {
+        if (!IP_ADDRESSES_AND_ID_MATCH(&r->iphdr, fraghdr) &&
+            (!same_source || ip4_addr_eq(&r->iphdr.src, &fraghdr->src))) {
+          /* Not the same datagram as fraghdr */
+          other_datagrams++;
+          if ((oldest == NULL) || (r->timer <= oldest->timer)) {
+            /* older than the previous oldest */
+            oldest = r;
+            oldest_prev = prev;
+          }
         }
-      }
-      if (r->next != NULL) {
         prev = r;
       }
-      r = r->next;
     }
     if (oldest != NULL) {
       pbufs_freed_current = ip_reass_free_complete_datagram(oldest, oldest_prev);
@@ -286,7 +356,7 @@ ip_reass_enqueue_new_datagram(struct ip_hdr *fraghdr, int clen)
   ipr = (struct ip_reassdata *)memp_malloc(MEMP_REASSDATA);
   if (ipr == NULL) {
 #if IP_REASS_FREE_OLDEST
-    if (ip_reass_remove_oldest_datagram(fraghdr, clen) >= clen) {
+    if (ip_reass_remove_oldest_datagram(fraghdr, clen, 0) >= clen) {
       ipr = (struct ip_reassdata *)memp_malloc(MEMP_REASSDATA);
     }
     if (ipr == NULL)
@@ -301,8 +371,8 @@ ip_reass_enqueue_new_datagram(struct ip_hdr *fraghdr, int clen)
   ipr->timer = IP_REASS_MAXAGE;
 
   /* enqueue the new structure to the front of the list */
-  ipr->next = reassdatagrams;
-  reassdatagrams = ipr;
+  ipr->next = reassdatagrams[IP_REASS_HASH(fraghdr)];
+  reassdatagrams[IP_REASS_HASH(fraghdr)] = ipr;
   /* copy the ip header for later tests and input */
   /* @todo: no ip options supported? */
   SMEMCPY(&(ipr->iphdr), fraghdr, IP_HLEN);
@@ -316,10 +386,18 @@ ip_reass_enqueue_new_datagram(struct ip_hdr *fraghdr, int clen)
 static void
 ip_reass_dequeue_datagram(struct ip_reassdata *ipr, struct ip_reassdata *prev)
 {
+  u16_t idx = (u16_t)IP_REASS_HASH(&ipr->iphdr);
+  struct ip_reassdata **list = &reassdatagrams[idx];
+
+#if IP_REASS_MAX_PBUFS_PER_SOURCE < IP_REASS_MAX_PBUFS
+  LWIP_ASSERT("list pbufcount >= ipr->pbufcount", ip_reass_list_pbufcount[idx] >= ipr->pbufcount);
+  ip_reass_list_pbufcount[idx] = (u16_t)(ip_reass_list_pbufcount[idx] - ipr->pbufcount);
+#endif /* IP_REASS_MAX_PBUFS_PER_SOURCE < IP_REASS_MAX_PBUFS */
+
   /* dequeue the reass struct  */
-  if (reassdatagrams == ipr) {
+  if (*list == ipr) {
     /* it was the first in the list */
-    reassdatagrams = ipr->next;
+    *list = ipr->next;
   } else {
     /* it wasn't the first, so it must have a valid 'prev' */
     LWIP_ASSERT("sanity check linked list", prev != NULL);
@@ -348,7 +426,6 @@ ip_reass_chain_frag_into_datagram_and_validate(struct ip_reassdata *ipr, struct
   u16_t offset, len;
   u8_t hlen;
   struct ip_hdr *fraghdr;
-  int valid = 1;
 
   /* Extract length and fragment offset from current fragment */
   fraghdr = (struct ip_hdr *)new_p->payload;
@@ -375,119 +452,85 @@ ip_reass_chain_frag_into_datagram_and_validate(struct ip_reassdata *ipr, struct
     return IP_REASS_VALIDATE_PBUF_DROPPED;
   }
 
-  /* Iterate through until we either get to the end of the list (append),
-   * or we find one with a larger offset (insert). */
-  for (q = ipr->p; q != NULL;) {
-    iprh_tmp = (struct ip_reass_helper *)q->payload;
-    if (iprh->start < iprh_tmp->start) {
-      /* the new pbuf should be inserted before this */
-      iprh->next_pbuf = q;
-      if (iprh_prev != NULL) {
-        /* not the fragment with the lowest offset */
 #if IP_REASS_CHECK_OVERLAP
-        if ((iprh->start < iprh_prev->end) || (iprh->end > iprh_tmp->start)) {
-          /* fragment overlaps with previous or following, throw away */
-          return IP_REASS_VALIDATE_PBUF_DROPPED;
-        }
-#endif /* IP_REASS_CHECK_OVERLAP */
-        iprh_prev->next_pbuf = new_p;
-        if (iprh_prev->end != iprh->start) {
-          /* There is a fragment missing between the current
-           * and the previous fragment */
-          valid = 0;
-        }
-      } else {
-#if IP_REASS_CHECK_OVERLAP
-        if (iprh->end > iprh_tmp->start) {
-          /* fragment overlaps with following, throw away */
-          return IP_REASS_VALIDATE_PBUF_DROPPED;
-        }
-#endif /* IP_REASS_CHECK_OVERLAP */
-        /* fragment with the lowest offset */
-        ipr->p = new_p;
-      }
-      break;
-    } else if (iprh->start == iprh_tmp->start) {
-      /* received the same datagram twice: no need to keep the datagram */
-      return IP_REASS_VALIDATE_PBUF_DROPPED;
-#if IP_REASS_CHECK_OVERLAP
-    } else if (iprh->start < iprh_tmp->end) {
-      /* overlap: no need to keep the new datagram */
+  if ((ipr->flags & IP_REASS_FLAG_LASTFRAG) != 0) {
+    if ((iprh->end > ipr->datagram_len) || (is_last && (iprh->end != ipr->datagram_len))) {
+      /* fragment exceeds the length given by the last fragment, throw away */
       return IP_REASS_VALIDATE_PBUF_DROPPED;
+    }
+  } else if (is_last && (ipr->p_last != NULL) &&
+             (((struct ip_reass_helper *)ipr->p_last->payload)->end > iprh->end)) {
+    /* data was received beyond the end of the datagram, throw away */
+    return IP_REASS_VALIDATE_PBUF_DROPPED;
+  }
 #endif /* IP_REASS_CHECK_OVERLAP */
+
+  if (ipr->p == NULL) {
+    /* this is the first fragment we ever received for this ip datagram */
+    ipr->p = new_p;
+    ipr->p_last = new_p;
+  } else {
+    iprh_prev = (struct ip_reass_helper *)ipr->p_last->payload;
+    iprh_tmp = (struct ip_reass_helper *)ipr->p->payload;
+    if (IP_REASS_FRAG_FOLLOWS(iprh_prev, iprh)) {
+      /* this is (for now), the fragment with the highest offset
+       * (fragments arriving in order): chain it to the last fragment */
+      iprh_prev->next_pbuf = new_p;
+      ipr->p_last = new_p;
+    } else if (IP_REASS_FRAG_FOLLOWS(iprh, iprh_tmp)) {
+      /* fragment with the lowest offset (fragments arriving in reverse order) */
+      iprh->next_pbuf = ipr->p;
+      ipr->p = new_p;
     } else {
-      /* Check if the fragments received so far have no holes. */
-      if (iprh_prev != NULL) {
-        if (iprh_prev->end != iprh_tmp->start) {
-          /* There is a fragment missing between the current
-           * and the previous fragment */
-          valid = 0;
+      /* Iterate through until we find one with a larger or equal offset. */
+      iprh_prev = NULL;
+      for (q = ipr->p; q != NULL; q = iprh_tmp->next_pbuf) {
+        iprh_tmp = (struct ip_reass_helper *)q->payload;
+        if (iprh->start <= iprh_tmp->start) {
+          break;
         }
+        iprh_prev = iprh_tmp;
       }
+      if ((q == NULL) || (iprh_prev == NULL) ||
+          !IP_REASS_FRAG_FOLLOWS(iprh_prev, iprh) || !IP_REASS_FRAG_FOLLOWS(iprh, iprh_tmp)) {
+        /* received the same fragment twice or fragment overlaps with
+         * previous or following: no need to keep the new fragment */
+        return IP_REASS_VALIDATE_PBUF_DROPPED;
+      }
+      /* the new pbuf should be inserted before q */
+      iprh->next_pbuf = q;
+      iprh_prev->next_pbuf = new_p;
     }
-    q = iprh_tmp->next_pbuf;
-    iprh_prev = iprh_tmp;
   }
 
-  /* If q is NULL, then we made it to the end of the list. Determine what to do now */
-  if (q == NULL) {
-    if (iprh_prev != NULL) {
-      /* this is (for now), the fragment with the highest offset:
-       * chain it to the last fragment */
 #if IP_REASS_CHECK_OVERLAP
-      LWIP_ASSERT("check fragments don't overlap", iprh_prev->end <= iprh->start);
+  ipr->recv_len = (u16_t)(ipr->recv_len + len);
 #endif /* IP_REASS_CHECK_OVERLAP */
-      iprh_prev->next_pbuf = new_p;
-      if (iprh_prev->end != iprh->start) {
-        valid = 0;
-      }
-    } else {
-#if IP_REASS_CHECK_OVERLAP
-      LWIP_ASSERT("no previous fragment, this must be the first fragment!",
-                  ipr->p == NULL);
-#endif /* IP_REASS_CHECK_OVERLAP */
-      /* this is the first fragment we ever received for this ip datagram */
-      ipr->p = new_p;
-    }
-  }
 
   /* At this point, the validation part begins: */
   /* If we already received the last fragment */
   if (is_last || ((ipr->flags & IP_REASS_FLAG_LASTFRAG) != 0)) {
-    /* and had no holes so far */
-    if (valid) {
-      /* then check if the rest of the fragments is here */
-      /* Check if the queue starts with the first datagram */
-      if ((ipr->p == NULL) || (((struct ip_reass_helper *)ipr->p->payload)->start != 0)) {
-        valid = 0;
-      } else {
-        /* and check that there are no holes after this datagram */
-        iprh_prev = iprh;
-        q = iprh->next_pbuf;
-        while (q != NULL) {
-          iprh = (struct ip_reass_helper *)q->payload;
-          if (iprh_prev->end != iprh->start) {
-            valid = 0;
-            break;
-          }
-          iprh_prev = iprh;
-          q = iprh->next_pbuf;
-        }
-        /* if still valid, all fragments are received
-         * (because to the MF==0 already arrived */
-        if (valid) {
-          LWIP_ASSERT("sanity check", ipr->p != NULL);
-          LWIP_ASSERT("sanity check",
-                      ((struct ip_reass_helper *)ipr->p->payload) != iprh);
-          LWIP_ASSERT("validate_datagram:next_pbuf!=NULL",
-                      iprh->next_pbuf == NULL);
-        }
+#if IP_REASS_CHECK_OVERLAP
+    /* Fragments don't overlap and don't exceed the datagram, so all of them
+     * are here when the received lengths add up to the datagram length. */
+    if (ipr->recv_len == (is_last ? iprh->end : ipr->datagram_len)) {
+      return IP_REASS_VALIDATE_TELEGRAM_FINISHED;
+    }
+#else /* IP_REASS_CHECK_OVERLAP */
+    /* Check that the queue starts with the first fragment and has no holes */
+    iprh_prev = NULL;
+    for (q = ipr->p; q != NULL; q = iprh_tmp->next_pbuf) {
+      iprh_tmp = (struct ip_reass_helper *)q->payload;
+      if (iprh_tmp->start != ((iprh_prev != NULL) ? iprh_prev->end : 0)) {
+        /* If we come here, there are some fragments missing (since MF == 0
+         * has already arrived). Such datagrams simply time out if no more
+         * fragments are received... */
+        return IP_REASS_VALIDATE_PBUF_QUEUED;
       }
+      iprh_prev = iprh_tmp;
     }
-    /* If valid is 0 here, there are some fragments missing in the middle
-     * (since MF == 0 has already arrived). Such datagrams simply time out if
-     * no more fragments are received... */
-    return valid ? IP_REASS_VALIDATE_TELEGRAM_FINISHED : IP_REASS_VALIDATE_PBUF_QUEUED;
+    return IP_REASS_VALIDATE_TELEGRAM_FINISHED;
+#endif /* IP_REASS_CHECK_OVERLAP */
   }
   /* If we come here, not all fragments were received, yet! */
   return IP_REASS_VALIDATE_PBUF_QUEUED; /* not yet valid! */
@@ -531,11 +574,28 @@ ip4_reass(struct pbuf *p)
   }
   len = (u16_t)(len - hlen);
 
-  /* Check if we are allowed to enqueue more datagrams. */
   clen = pbuf_clen(p);
+#if IP_REASS_MAX_PBUFS_PER_SOURCE < IP_REASS_MAX_PBUFS
+  /* Check if the source is allowed to enqueue more datagrams. This is done
+   * first, so that a source exceeding its quota frees its own datagrams. */
+  if (ip_reass_source_over_quota(fraghdr, clen)) {
+#if IP_REASS_FREE_OLDEST
+    if (!ip_reass_remove_oldest_datagram(fraghdr, clen, 1) ||
+        ip_reass_source_over_quota(fraghdr, clen))
+#endif /* IP_REASS_FREE_OLDEST */
+    {
+      LWIP_DEBUGF(IP_REASS_DEBUG, ("ip4_reass: Source overflow condition: clen=%d, MAX=%d\n",
+                                   clen, IP_REASS_MAX_PBUFS_PER_SOURCE));
+      IPFRAG_STATS_INC(ip_frag.memerr);
+      goto nullreturn;
+    }
+  }
+#endif /* IP_REASS_MAX_PBUFS_PER_SOURCE < IP_REASS_MAX_PBUFS */
+
+  /* Check if we are allowed to enqueue more datagrams. */
   if ((ip_reass_pbufcount + clen) > IP_REASS_MAX_PBUFS) {
 #if IP_REASS_FREE_OLDEST
-    if (!ip_reass_remove_oldest_datagram(fraghdr, clen) ||
+    if (!ip_reass_remove_oldest_datagram(fraghdr, clen, 0) ||
         ((ip_reass_pbufcount + clen) > IP_REASS_MAX_PBUFS))
 #endif /* IP_REASS_FREE_OLDEST */
     {
@@ -551,7 +611,7 @@ ip4_reass(struct pbuf *p)
 
   /* Look for the datagram the fragment belongs to in the current datagram queue,
    * remembering the previous in the queue for later dequeueing. */
-  for (ipr = reassdatagrams; ipr != NULL; ipr = ipr->next) {
+  for (ipr = reassdatagrams[IP_REASS_HASH(fraghdr)]; ipr != NULL; ipr = ipr->next) {
     /* Check if the incoming fragment matches the one currently present
        in the reassembly buffer. If so, we proceed with copying the
        fragment into the buffer. */
@@ -605,6 +665,11 @@ ip4_reass(struct pbuf *p)
      the number of fragments that may be enqueued at any one time
      (overflow checked by testing against IP_REASS_MAX_PBUFS) */
   ip_reass_pbufcount = (u16_t)(ip_reass_pbufcount + clen);
+  ipr->pbufcount = (u16_t)(ipr->pbufcount + clen);
+#if IP_REASS_MAX_PBUFS_PER_SOURCE < IP_REASS_MAX_PBUFS
+  ip_reass_list_pbufcount[IP_REASS_HASH(&ipr->iphdr)] =
+    (u16_t)(ip_reass_list_pbufcount[IP_REASS_HASH(&ipr->iphdr)] + clen);
+#endif /* IP_REASS_MAX_PBUFS_PER_SOURCE < IP_REASS_MAX_PBUFS */
   if (is_last) {
     u16_t datagram_len = (u16_t)(offset + len);
     ipr->datagram_len = datagram_len;
@@ -615,7 +680,7 @@ ip4_reass(struct pbuf *p)
   }
 
   if (valid == IP_REASS_VALIDATE_TELEGRAM_FINISHED) {
-    struct ip_reassdata *ipr_prev;
+    struct ip_reassdata *ipr_prev, *list;
     /* the totally last fragment (flag more fragments = 0) was received at least
      * once AND all fragments are received */
     u16_t datagram_len = (u16_t)(ipr->datagram_len + IP_HLEN);
@@ -649,10 +714,11 @@ ip4_reass(struct pbuf *p)
     }
 
     /* find the previous entry in the linked list */
-    if (ipr == reassdatagrams) {
+    list = reassdatagrams[IP_REASS_HASH(&ipr->iphdr)];
+    if (ipr == list) {
       ipr_prev = NULL;
     } else {
-      for (ipr_prev = reassdatagrams; ipr_prev != NULL; ipr_prev = ipr_prev->next) {
+      for (ipr_prev = list; ipr_prev != NULL; ipr_prev = ipr_prev->next) {
         if (ipr_prev->next == ipr) {
           break;
         }
@@ -680,7 +746,7 @@ nullreturn_ipr:
   LWIP_ASSERT("ipr != NULL", ipr != NULL);
   if (ipr->p == NULL) {
     /* dropped pbuf after creating a new datagram entry: remove the entry, too */
-    LWIP_ASSERT("not firstalthough just enqueued", ipr == reassdatagrams);
+    LWIP_ASSERT("not firstalthough just enqueued", ipr == reassdatagrams[IP_REASS_HASH(&ipr->iphdr)]);
     ip_reass_dequeue_datagram(ipr, NULL);
   }
 
@@ -744,6 +810,9 @@ ip4_frag(struct pbuf *p, struct netif *netif, const ip4_addr_t *dest)
   struct pbuf *newpbuf;
   u16_t newpbuflen = 0;
   u16_t left_to_copy;
+#endif
+#if IP_FRAG_BATCH
+  struct ip_frag_batch *batch;
 #endif
   struct ip_hdr *original_iphdr;
   struct ip_hdr *iphdr;
@@ -771,6 +840,11 @@ ip4_frag(struct pbuf *p, struct netif *netif, const ip4_addr_t *dest)
 
   left = (u16_t)(p->tot_len - IP_HLEN);
 
+#if IP_FRAG_BATCH
+  /* Try to slice all fragments at once, fall back to allocating them one by one */
+  batch = ip_frag_batch_alloc(p, IP_HLEN, (u16_t)(nfb * 8), IP_HLEN);
+#endif /* IP_FRAG_BATCH */
+
   while (left) {
     /* Fill this fragment */
     fragsize = LWIP_MIN(left, (u16_t)(nfb * 8));
@@ -782,6 +856,8 @@ ip4_frag(struct pbuf *p, struct netif *netif, const ip4_addr_t *dest)
     }
     LWIP_ASSERT("this needs a pbuf in one piece!",
                 (rambuf->len == rambuf->tot_len) && (rambuf->next == NULL));
+    /* don't walk the chain from its start for every fragment */
+    p = pbuf_skip(p, poff, &poff);
     poff += pbuf_copy_partial(p, rambuf->payload, fragsize, poff);
     /* make room for the IP header */
     if (pbuf_add_header(rambuf, IP_HLEN)) {
@@ -792,60 +868,69 @@ ip4_frag(struct pbuf *p, struct netif *netif, const ip4_addr_t *dest)
     SMEMCPY(rambuf->payload, original_iphdr, IP_HLEN);
     iphdr = (struct ip_hdr *)rambuf->payload;
 #else /* LWIP_NETIF_TX_SINGLE_PBUF */
-    /* When not using a static buffer, create a chain of pbufs.
-     * The first will be a PBUF_RAM holding the link and IP header.
-     * The rest will be PBUF_REFs mirroring the pbuf chain to be fragged,
-     * but limited to the size of an mtu.
-     */
-    rambuf = pbuf_alloc(PBUF_LINK, IP_HLEN, PBUF_RAM);
-    if (rambuf == NULL) {
-      goto memerr;
-    }
-    LWIP_ASSERT("this needs a pbuf in one piece!",
-                (rambuf->len >= (IP_HLEN)));
-    SMEMCPY(rambuf->payload, original_iphdr, IP_HLEN);
-    iphdr = (struct ip_hdr *)rambuf->payload;
-
-    left_to_copy = fragsize;
-    while (left_to_copy) {
-      struct pbuf_custom_ref *pcr;
-      u16_t plen = (u16_t)(p->len - poff);
-      LWIP_ASSERT("p->len >= poff", p->len >= poff);
-      newpbuflen = LWIP_MIN(left_to_copy, plen);
-      /* Is this pbuf already empty? */
-      if (!newpbuflen) {
-        poff = 0;
-        p = p->next;
-        continue;
-      }
-      pcr = ip_frag_alloc_pbuf_custom_ref();
-      if (pcr == NULL) {
-        pbuf_free(rambuf);
-        goto memerr;
-      }
-      /* Mirror this pbuf, although we might not need all of it. */
-      newpbuf = pbuf_alloced_custom(PBUF_RAW, newpbuflen, PBUF_REF, &pcr->pc,
-                                    (u8_t *)p->payload + poff, newpbuflen);
-      if (newpbuf == NULL) {
-        ip_frag_free_pbuf_custom_ref(pcr);
-        pbuf_free(rambuf);
+#if IP_FRAG_BATCH
+    if (batch != NULL) {
+      rambuf = ip_frag_batch_next(batch, fragsize);
+      SMEMCPY(rambuf->payload, original_iphdr, IP_HLEN);
+      iphdr = (struct ip_hdr *)rambuf->payload;
+    } else
+#endif /* IP_FRAG_BATCH */
+    {
+      /* When not using a static buffer, create a chain of pbufs.
+       * The first will be a PBUF_RAM holding the link and IP header.
+       * The rest will be PBUF_REFs mirroring the pbuf chain to be fragged,
+       * but limited to the size of an mtu.
+       */
+      rambuf = pbuf_alloc(PBUF_LINK, IP_HLEN, PBUF_RAM);
+      if (rambuf == NULL) {
         goto memerr;
       }
-      pbuf_ref(p);
-      pcr->original = p;
-      pcr->pc.custom_free_function = ipfrag_free_pbuf_custom;
-
-      /* Add it to end of rambuf's chain, but using pbuf_cat, not pbuf_chain
-       * so that it is removed when pbuf_dechain is later called on rambuf.
-       */
-      pbuf_cat(rambuf, newpbuf);
-      left_to_copy = (u16_t)(left_to_copy - newpbuflen);
-      if (left_to_copy) {
-        poff = 0;
-        p = p->next;
+      LWIP_ASSERT("this needs a pbuf in one piece!",
+                  (rambuf->len >= (IP_HLEN)));
+      SMEMCPY(rambuf->payload, original_iphdr, IP_HLEN);
+      iphdr = (struct ip_hdr *)rambuf->payload;
+
+      left_to_copy = fragsize;
+      while (left_to_copy) {
+        struct pbuf_custom_ref *pcr;
+        u16_t plen = (u16_t)(p->len - poff);
+        LWIP_ASSERT("p->len >= poff", p->len >= poff);
+        newpbuflen = LWIP_MIN(left_to_copy, plen);
+        /* Is this pbuf already empty? */
+        if (!newpbuflen) {
+          poff = 0;
+          p = p->next;
+          continue;
+        }
+        pcr = ip_frag_alloc_pbuf_custom_ref();
+        if (pcr == NULL) {
+          pbuf_free(rambuf);
+          goto memerr;
+        }
+        /* Mirror this pbuf, although we might not need all of it. */
+        newpbuf = pbuf_alloced_custom(PBUF_RAW, newpbuflen, PBUF_REF, &pcr->pc,
+                                      (u8_t *)p->payload + poff, newpbuflen);
+        if (newpbuf == NULL) {
+          ip_frag_free_pbuf_custom_ref(pcr);
+          pbuf_free(rambuf);
+          goto memerr;
+        }
+        pbuf_ref(p);
+        pcr->original = p;
+        pcr->pc.custom_free_function = ipfrag_free_pbuf_custom;
+
+        /* Add it to end of rambuf's chain, but using pbuf_cat, not pbuf_chain
+         * so that it is removed when pbuf_dechain is later called on rambuf.
+         */
+        pbuf_cat(rambuf, newpbuf);
+        left_to_copy = (u16_t)(left_to_copy - newpbuflen);
+        if (left_to_copy) {
+          poff = 0;
+          p = p->next;
+        }
       }
+      poff = (u16_t)(poff + newpbuflen);
     }
-    poff = (u16_t)(poff + newpbuflen);
 #endif /* LWIP_NETIF_TX_SINGLE_PBUF */
 
     /* Correct header */
@@ -883,6 +968,11 @@ ip4_frag(struct pbuf *p, struct netif *netif, const ip4_addr_t *dest)
     left = (u16_t)(left - fragsize);
     ofo = (u16_t)(ofo + nfb);
   }
+#if IP_FRAG_BATCH
+  if (batch != NULL) {
+    ip_frag_batch_free(batch);
+  }
+#endif /* IP_FRAG_BATCH */
   MIB2_STATS_INC(mib2.ipfragoks);
   return ERR_OK;
 memerr:
@@ -45,6 +45,7 @@
 #include "lwip/icmp6.h"
 #include "lwip/nd6.h"
 #include "lwip/ip.h"
+#include "lwip/priv/ip_frag_priv.h"
 
 #include "lwip/pbuf.h"
 #include "lwip/memp.h"
@@ -99,42 +100,143 @@ PACK_STRUCT_END
 #  include "arch/epstruct.h"
 #endif
 
+/** A fragment starting at 'b_start' may be chained behind the fragment
+ * from 'a_start' to 'a_end' */
+#if IP_REASS_CHECK_OVERLAP
+#define IP6_REASS_FRAG_FOLLOWS(a_start, a_end, b_start) (((b_start) > (a_start)) && ((b_start) >= (a_end)))
+#else /* IP_REASS_CHECK_OVERLAP */
+#define IP6_REASS_FRAG_FOLLOWS(a_start, a_end, b_start) ((b_start) > (a_start))
+#endif /* IP_REASS_CHECK_OVERLAP */
+
+#if (IP_REASS_HASH_SIZE & (IP_REASS_HASH_SIZE - 1)) != 0
+#error "IP_REASS_HASH_SIZE must be a power of 2"
+#endif
+
+/** Index of the list datagrams from the source address 'addr' are kept in */
+#if IP_REASS_HASH_SIZE > 1
+#define IP6_REASS_HASH(addr) ip6_reass_hash((addr)[0] ^ (addr)[1] ^ (addr)[2] ^ (addr)[3])
+#else /* IP_REASS_HASH_SIZE > 1 */
+#define IP6_REASS_HASH(addr) 0
+#endif /* IP_REASS_HASH_SIZE > 1 */
+
 /* static variables */
-static struct ip6_reassdata *reassdatagrams;
+static struct ip6_reassdata *reassdatagrams[IP_REASS_HASH_SIZE];
 static u16_t ip6_reass_pbufcount;
+#if IP_REASS_MAX_PBUFS_PER_SOURCE < IP_REASS_MAX_PBUFS
+/** pbufs enqueued for the datagrams of each list */
+static u16_t ip6_reass_list_pbufcount[IP_REASS_HASH_SIZE];
+#endif /* IP_REASS_MAX_PBUFS_PER_SOURCE < IP_REASS_MAX_PBUFS */
 
 /* Forward declarations. */
 static void ip6_reass_free_complete_datagram(struct ip6_reassdata *ipr);
 #if IP_REASS_FREE_OLDEST
-static void ip6_reass_remove_oldest_datagram(struct ip6_reassdata *ipr, int pbufs_needed);
+static void ip6_reass_remove_oldest_datagram(struct ip6_reassdata *ipr, int pbufs_needed, int same_source);
 #endif /* IP_REASS_FREE_OLDEST */
 
 void
 ip6_reass_tmr(void)
 {
   struct ip6_reassdata *r, *tmp;
+  u16_t i;
 
 #if !IPV6_FRAG_COPYHEADER
   LWIP_ASSERT("sizeof(struct ip6_reass_helper) <= IP6_FRAG_HLEN, set IPV6_FRAG_COPYHEADER to 1",
     sizeof(struct ip6_reass_helper) <= IP6_FRAG_HLEN);
 #endif /* !IPV6_FRAG_COPYHEADER */
 
-  r = reassdatagrams;
-  while (r != NULL) {
-    /* Decrement the timer. Once it reaches 0,
-     * clean up the incomplete fragment assembly */
-    if (r->timer > 0) {
-      r->timer--;
-      r = r->next;
-    } else {
-      /* reassembly timed out */
-      tmp = r;
-      /* get the next pointer before freeing */
-      r = r->next;
-      /* free the helper struct and all enqueued pbufs */
-      ip6_reass_free_complete_datagram(tmp);
-     }
-   }
+  for (i = 0; i < IP_REASS_HASH_SIZE; i++) {
+    r = reassdatagrams[i];
+    while (r != NULL) {
+      /* Decrement the timer. Once it reaches 0,
+       * clean up the incomplete fragment assembly */
+      if (r->timer > 0) {
+        r->timer--;
+        r = r->next;
+      } else {
+        /* reassembly timed out */
+        tmp = r;
+        /* get the next pointer before freeing */
+        r = r->next;
+        /* free the helper struct and all enqueued pbufs */
+        ip6_reass_free_complete_datagram(tmp);
+      }
+    }
+  }
+}
+
+#if IP_REASS_HASH_SIZE > 1
+/**
+ * Fold a source address (xor of its words) into the datagram lists.
+ * All datagrams from one source are kept in the same list.
+ */
+static u16_t
+ip6_reass_hash(u32_t h)
+{
+  h ^= h >> 16;
+  h ^= h >> 8;
+  return (u16_t)(h & (IP_REASS_HASH_SIZE - 1));
+}
+#endif /* IP_REASS_HASH_SIZE > 1 */
+
+#if IP_REASS_MAX_PBUFS_PER_SOURCE < IP_REASS_MAX_PBUFS
+/**
+ * Check if the source address of the packet currently being processed would
+ * exceed its quota (IP_REASS_MAX_PBUFS_PER_SOURCE) by enqueueing 'clen' more
+ * pbufs. Its datagrams are only counted if the list they are kept in exceeds it.
+ */
+static int
+ip6_reass_source_over_quota(int clen)
+{
+  struct ip6_reassdata *r;
+  u16_t idx = (u16_t)IP6_REASS_HASH(ip6_current_src_addr()->addr);
+  int count = 0;
+
+  if ((ip6_reass_list_pbufcount[idx] + clen) <= IP_REASS_MAX_PBUFS_PER_SOURCE) {
+    return 0;
+  }
+  for (r = reassdatagrams[idx]; r != NULL; r = r->next) {
+    if (ip6_addr_packed_eq(ip6_current_src_addr(), &(IPV6_FRAG_SRC(r)), r->src_zone)) {
+      count += r->pbufcount;
+    }
+  }
+  return (count + clen) > IP_REASS_MAX_PBUFS_PER_SOURCE;
+}
+#endif /* IP_REASS_MAX_PBUFS_PER_SOURCE < IP_REASS_MAX_PBUFS */
+
+/**
+ * Dequeues a datagram from the datagram queue. Doesn't deallocate anything.
+ * Must be called while the source address of the datagram is still valid.
+ *
+ * @param ipr datagram to dequeue
+ */
+static void
+ip6_reass_dequeue_datagram(struct ip6_reassdata *ipr)
+{
+  struct ip6_reassdata *prev;
+  u16_t idx = (u16_t)IP6_REASS_HASH(IPV6_FRAG_SRC(ipr).addr);
+  struct ip6_reassdata **list = &reassdatagrams[idx];
+
+#if IP_REASS_MAX_PBUFS_PER_SOURCE < IP_REASS_MAX_PBUFS
+  LWIP_ASSERT("list pbufcount >= ipr->pbufcount", ip6_reass_list_pbufcount[idx] >= ipr->pbufcount);
+  ip6_reass_list_pbufcount[idx] = (u16_t)(ip6_reass_list_pbufcount[idx] - ipr->pbufcount);
+#endif /* IP_REASS_MAX_PBUFS_PER_SOURCE < IP_REASS_MAX_PBUFS */
+
+  if (*list == ipr) {
+    /* it was the first in the list */
+    *list = ipr->next;
+  } else {
+    prev = *list;
+    while (prev != NULL) {
+      if (prev->next == ipr) {
+        break;
+      }
+      prev = prev->next;
+    }
+    LWIP_ASSERT("sanity check linked list", prev != NULL);
+    if (prev != NULL) {
+      prev->next = ipr->next;
+    }
+  }
 }
 
 /**
@@ -147,12 +249,15 @@ ip6_reass_tmr(void)
 static void
 ip6_reass_free_complete_datagram(struct ip6_reassdata *ipr)
 {
-  struct ip6_reassdata *prev;
   u16_t pbufs_freed = 0;
   u16_t clen;
   struct pbuf *p;
   struct ip6_reass_helper *iprh;
 
+  /* First, unchain the struct ip6_reassdata from the list (the source
+   * address may be located in the pbufs freed below). */
+  ip6_reass_dequeue_datagram(ipr);
+
 #if LWIP_ICMP6
   iprh = (struct ip6_reass_helper *)ipr->p->payload;
   if (iprh->start == 0) {
@@ -186,7 +291,7 @@ ip6_reass_free_complete_datagram(struct ip6_reassdata *ipr)
   }
 #endif /* LWIP_ICMP6 */
 
-  /* First, free all received pbufs.  The individual pbufs need to be released
+  /* Then, free all received pbufs.  The individual pbufs need to be released
      separately as they have not yet been chained */
   p = ipr->p;
   while (p != NULL) {
@@ -201,24 +306,10 @@ ip6_reass_free_complete_datagram(struct ip6_reassdata *ipr)
     pbuf_free(pcur);
   }
 
-  /* Then, unchain the struct ip6_reassdata from the list and free it. */
-  if (ipr == reassdatagrams) {
-    reassdatagrams = ipr->next;
-  } else {
-    prev = reassdatagrams;
-    while (prev != NULL) {
-      if (prev->next == ipr) {
-        break;
-      }
-      prev = prev->next;
-    }
-    if (prev != NULL) {
-      prev->next = ipr->next;
-    }
-  }
+  /* Finally, free the struct ip6_reassdata. */
   memp_free(MEMP_IP6_REASSDATA, ipr);
 
-  /* Finally, update number of pbufs in reassembly queue */
+  /* and update number of pbufs in reassembly queue */
   LWIP_ASSERT("ip_reass_pbufcount >= clen", ip6_reass_pbufcount >= pbufs_freed);
   ip6_reass_pbufcount = (u16_t)(ip6_reass_pbufcount - pbufs_freed);
 }
@@ -231,33 +322,48 @@ ip6_reass_free_complete_datagram(struct ip6_reassdata *ipr)
  * @param ipr ip6_reassdata for the current fragment
  * @param pbufs_needed number of pbufs needed to enqueue
  *        (used for freeing other datagrams if not enough space)
+ * @param same_source only free datagrams from the source of the current
+ *        fragment, until it is below IP_REASS_MAX_PBUFS_PER_SOURCE
  */
 static void
-ip6_reass_remove_oldest_datagram(struct ip6_reassdata *ipr, int pbufs_needed)
+ip6_reass_remove_oldest_datagram(struct ip6_reassdata *ipr, int pbufs_needed, int same_source)
 {
   struct ip6_reassdata *r, *oldest;
+  u16_t i, first, last;
+
+  if (same_source) {
+    first = (u16_t)IP6_REASS_HASH(ip6_current_src_addr()->addr);
+    last = (u16_t)(first + 1);
+  } else {
+    first = 0;
+    last = IP_REASS_HASH_SIZE;
+  }
 
   /* Free datagrams until being allowed to enqueue 'pbufs_needed' pbufs,
    * but don't free the current datagram! */
   do {
-    r = oldest = reassdatagrams;
-    while (r != NULL) {
-      if (r != ipr) {
-        if (r->timer <= oldest->timer) {
-          /* older than the previous oldest */
-          oldest = r;
+    oldest = NULL;
+    for (i = first; i < last; i++) {
+      for (r = reassdatagrams[i]; r != NULL; r = r->next) {
+        if ((r != ipr) &&
+            (!same_source || ip6_addr_packed_eq(ip6_current_src_addr(), &(IPV6_FRAG_SRC(r)), r->src_zone))) {
+          if ((oldest == NULL) || (r->timer <= oldest->timer)) {
+            /* older than the previous oldest */
+            oldest = r;
+          }
         }
       }
-      r = r->next;
     }
-    if (oldest == ipr) {
+    if (oldest == NULL) {
       /* nothing to free, ipr is the only element on the list */
       return;
     }
-    if (oldest != NULL) {
-      ip6_reass_free_complete_datagram(oldest);
-    }
-  } while (((ip6_reass_pbufcount + pbufs_needed) > IP_REASS_MAX_PBUFS) && (reassdatagrams != NULL));
+    ip6_reass_free_complete_datagram(oldest);
+  } while (
+#if IP_REASS_MAX_PBUFS_PER_SOURCE < IP_REASS_MAX_PBUFS
+           same_source ? ip6_reass_source_over_quota(pbufs_needed) :
+#endif /* IP_REASS_MAX_PBUFS_PER_SOURCE < IP_REASS_MAX_PBUFS */
+           ((ip6_reass_pbufcount + pbufs_needed) > IP_REASS_MAX_PBUFS));
 }
 #endif /* IP_REASS_FREE_OLDEST */
 
@@ -271,13 +377,14 @@ ip6_reass_remove_oldest_datagram(struct ip6_reassdata *ipr, int pbufs_needed)
 struct pbuf *
 ip6_reass(struct pbuf *p)
 {
-  struct ip6_reassdata *ipr, *ipr_prev;
-  struct ip6_reass_helper *iprh, *iprh_tmp, *iprh_prev=NULL;
+  struct ip6_reassdata *ipr;
+  struct ip6_reass_helper *iprh, *iprh_tmp, *iprh_prev;
   struct ip6_frag_hdr *frag_hdr;
   u16_t offset, len, start, end;
   ptrdiff_t hdrdiff;
   u16_t clen;
-  u8_t valid = 1;
+  u8_t valid;
+  int is_last;
   struct pbuf *q, *next_pbuf;
 
   IP6_FRAG_STATS_INC(ip6_frag.recv);
@@ -313,9 +420,10 @@ ip6_reass(struct pbuf *p)
     goto nullreturn;
   }
 
-  /* Look for the datagram the fragment belongs to in the current datagram queue,
-   * remembering the previous in the queue for later dequeueing. */
-  for (ipr = reassdatagrams, ipr_prev = NULL; ipr != NULL; ipr = ipr->next) {
+  is_last = (offset & IP6_FRAG_MORE_FLAG) == 0;
+
+  /* Look for the datagram the fragment belongs to in the current datagram queue. */
+  for (ipr = reassdatagrams[IP6_REASS_HASH(ip6_current_src_addr()->addr)]; ipr != NULL; ipr = ipr->next) {
     /* Check if the incoming fragment matches the one currently present
        in the reassembly buffer. If so, we proceed with copying the
        fragment into the buffer. */
@@ -325,7 +433,6 @@ ip6_reass(struct pbuf *p)
       IP6_FRAG_STATS_INC(ip6_frag.cachehit);
       break;
     }
-    ipr_prev = ipr;
   }
 
   if (ipr == NULL) {
@@ -334,16 +441,9 @@ ip6_reass(struct pbuf *p)
     if (ipr == NULL) {
 #if IP_REASS_FREE_OLDEST
       /* Make room and try again. */
-      ip6_reass_remove_oldest_datagram(ipr, clen);
+      ip6_reass_remove_oldest_datagram(ipr, clen, 0);
       ipr = (struct ip6_reassdata *)memp_malloc(MEMP_IP6_REASSDATA);
-      if (ipr != NULL) {
-        /* re-search ipr_prev since it might have been removed */
-        for (ipr_prev = reassdatagrams; ipr_prev != NULL; ipr_prev = ipr_prev->next) {
-          if (ipr_prev->next == ipr) {
-            break;
-          }
-        }
-      } else
+      if (ipr == NULL)
 #endif /* IP_REASS_FREE_OLDEST */
       {
         IP6_FRAG_STATS_INC(ip6_frag.memerr);
@@ -355,8 +455,8 @@ ip6_reass(struct pbuf *p)
     ipr->timer = IPV6_REASS_MAXAGE;
 
     /* enqueue the new structure to the front of the list */
-    ipr->next = reassdatagrams;
-    reassdatagrams = ipr;
+    ipr->next = reassdatagrams[IP6_REASS_HASH(ip6_current_src_addr()->addr)];
+    reassdatagrams[IP6_REASS_HASH(ip6_current_src_addr()->addr)] = ipr;
 
     /* Use the current IPv6 header for src/dest address reference.
      * Eventually, we will replace it when we get the first fragment
@@ -384,24 +484,32 @@ ip6_reass(struct pbuf *p)
     ipr->nexth = frag_hdr->_nexth;
   }
 
+#if IP_REASS_MAX_PBUFS_PER_SOURCE < IP_REASS_MAX_PBUFS
+  /* Check if the source is allowed to enqueue more datagrams. This is done
+   * first, so that a source exceeding its quota frees its own datagrams. */
+  if (ip6_reass_source_over_quota(clen)) {
+#if IP_REASS_FREE_OLDEST
+    ip6_reass_remove_oldest_datagram(ipr, clen, 1);
+    if (ip6_reass_source_over_quota(clen))
+#endif /* IP_REASS_FREE_OLDEST */
+    {
+      IP6_FRAG_STATS_INC(ip6_frag.memerr);
+      goto nullreturn_ipr;
+    }
+  }
+#endif /* IP_REASS_MAX_PBUFS_PER_SOURCE < IP_REASS_MAX_PBUFS */
+
   /* Check if we are allowed to enqueue more datagrams. */
   if ((ip6_reass_pbufcount + clen) > IP_REASS_MAX_PBUFS) {
 #if IP_REASS_FREE_OLDEST
-    ip6_reass_remove_oldest_datagram(ipr, clen);
-    if ((ip6_reass_pbufcount + clen) <= IP_REASS_MAX_PBUFS) {
-      /* re-search ipr_prev since it might have been removed */
-      for (ipr_prev = reassdatagrams; ipr_prev != NULL; ipr_prev = ipr_prev->next) {
-        if (ipr_prev->next == ipr) {
-          break;
-        }
-      }
-    } else
+    ip6_reass_remove_oldest_datagram(ipr, clen, 0);
+    if ((ip6_reass_pbufcount + clen) > IP_REASS_MAX_PBUFS)
 #endif /* IP_REASS_FREE_OLDEST */
     {
       /* @todo: send ICMPv6 time exceeded here? */
       /* drop this pbuf */
       IP6_FRAG_STATS_INC(ip6_frag.memerr);
-      goto nullreturn;
+      goto nullreturn_ipr;
     }
   }
 
@@ -427,84 +535,74 @@ ip6_reass(struct pbuf *p)
   next_pbuf = NULL;
   end = (u16_t)(start + len);
 
-  /* find the right place to insert this pbuf */
-  /* Iterate through until we either get to the end of the list (append),
-   * or we find on with a larger offset (insert). */
-  for (q = ipr->p; q != NULL;) {
-    iprh_tmp = (struct ip6_reass_helper*)q->payload;
-    if (start < iprh_tmp->start) {
 #if IP_REASS_CHECK_OVERLAP
-      if (end > iprh_tmp->start) {
-        /* fragment overlaps with following, throw away */
-        IP6_FRAG_STATS_INC(ip6_frag.proterr);
-        goto nullreturn;
-      }
-      if (iprh_prev != NULL) {
-        if (start < iprh_prev->end) {
-          /* fragment overlaps with previous, throw away */
-          IP6_FRAG_STATS_INC(ip6_frag.proterr);
-          goto nullreturn;
-        }
-      }
-#endif /* IP_REASS_CHECK_OVERLAP */
-      /* the new pbuf should be inserted before this */
-      next_pbuf = q;
-      if (iprh_prev != NULL) {
-        /* not the fragment with the lowest offset */
-        iprh_prev->next_pbuf = p;
-      } else {
-        /* fragment with the lowest offset */
-        ipr->p = p;
-      }
-      break;
-    } else if (start == iprh_tmp->start) {
-      /* received the same datagram twice: no need to keep the datagram */
-      goto nullreturn;
-#if IP_REASS_CHECK_OVERLAP
-    } else if (start < iprh_tmp->end) {
-      /* overlap: no need to keep the new datagram */
+  if (ipr->datagram_len != 0) {
+    if ((end > ipr->datagram_len) || (is_last && (end != ipr->datagram_len))) {
+      /* fragment exceeds the length given by the last fragment, throw away */
       IP6_FRAG_STATS_INC(ip6_frag.proterr);
-      goto nullreturn;
-#endif /* IP_REASS_CHECK_OVERLAP */
-    } else {
-      /* Check if the fragments received so far have no gaps. */
-      if (iprh_prev != NULL) {
-        if (iprh_prev->end != iprh_tmp->start) {
-          /* There is a fragment missing between the current
-           * and the previous fragment */
-          valid = 0;
-        }
-      }
+      goto nullreturn_ipr;
     }
-    q = iprh_tmp->next_pbuf;
-    iprh_prev = iprh_tmp;
+  } else if (is_last && (ipr->p_last != NULL) &&
+             (((struct ip6_reass_helper *)ipr->p_last->payload)->end > end)) {
+    /* data was received beyond the end of the datagram, throw away */
+    IP6_FRAG_STATS_INC(ip6_frag.proterr);
+    goto nullreturn_ipr;
   }
-
-  /* If q is NULL, then we made it to the end of the list. Determine what to do now */
-  if (q == NULL) {
-    if (iprh_prev != NULL) {
-      /* this is (for now), the fragment with the highest offset:
-       * chain it to the last fragment */
-#if IP_REASS_CHECK_OVERLAP
-      LWIP_ASSERT("check fragments don't overlap", iprh_prev->end <= start);
 #endif /* IP_REASS_CHECK_OVERLAP */
+
+  /* find the right place to insert this pbuf */
+  if (ipr->p == NULL) {
+    /* this is the first fragment we ever received for this ip datagram */
+    ipr->p = p;
+    ipr->p_last = p;
+  } else {
+    iprh_prev = (struct ip6_reass_helper *)ipr->p_last->payload;
+    iprh_tmp = (struct ip6_reass_helper *)ipr->p->payload;
+    if (IP6_REASS_FRAG_FOLLOWS(iprh_prev->start, iprh_prev->end, start)) {
+      /* this is (for now), the fragment with the highest offset
+       * (fragments arriving in order): chain it to the last fragment */
       iprh_prev->next_pbuf = p;
-      if (iprh_prev->end != start) {
-        valid = 0;
-      }
+      ipr->p_last = p;
+    } else if (IP6_REASS_FRAG_FOLLOWS(start, end, iprh_tmp->start)) {
+      /* fragment with the lowest offset (fragments arriving in reverse order) */
+      next_pbuf = ipr->p;
+      ipr->p = p;
     } else {
+      /* Iterate through until we find one with a larger or equal offset. */
+      iprh_prev = NULL;
+      for (q = ipr->p; q != NULL; q = iprh_tmp->next_pbuf) {
+        iprh_tmp = (struct ip6_reass_helper *)q->payload;
+        if (start <= iprh_tmp->start) {
+          break;
+        }
+        iprh_prev = iprh_tmp;
+      }
+      if ((q == NULL) || (iprh_prev == NULL) ||
+          !IP6_REASS_FRAG_FOLLOWS(iprh_prev->start, iprh_prev->end, start) ||
+          !IP6_REASS_FRAG_FOLLOWS(start, end, iprh_tmp->start)) {
 #if IP_REASS_CHECK_OVERLAP
-      LWIP_ASSERT("no previous fragment, this must be the first fragment!",
-        ipr->p == NULL);
+        if (start != iprh_tmp->start) {
+          /* fragment overlaps with previous or following */
+          IP6_FRAG_STATS_INC(ip6_frag.proterr);
+        }
 #endif /* IP_REASS_CHECK_OVERLAP */
-      /* this is the first fragment we ever received for this ip datagram */
-      ipr->p = p;
+        /* received the same fragment twice or overlap: no need to keep it */
+        goto nullreturn_ipr;
+      }
+      /* the new pbuf should be inserted before q */
+      next_pbuf = q;
+      iprh_prev->next_pbuf = p;
     }
   }
 
   /* Track the current number of pbufs current 'in-flight', in order to limit
   the number of fragments that may be enqueued at any one time */
   ip6_reass_pbufcount = (u16_t)(ip6_reass_pbufcount + clen);
+  ipr->pbufcount = (u16_t)(ipr->pbufcount + clen);
+#if IP_REASS_MAX_PBUFS_PER_SOURCE < IP_REASS_MAX_PBUFS
+  ip6_reass_list_pbufcount[IP6_REASS_HASH(ip6_current_src_addr()->addr)] =
+    (u16_t)(ip6_reass_list_pbufcount[IP6_REASS_HASH(ip6_current_src_addr()->addr)] + clen);
+#endif /* IP_REASS_MAX_PBUFS_PER_SOURCE < IP_REASS_MAX_PBUFS */
 
   /* Remember IPv6 header if this is the first fragment. */
   if (start == 0) {
@@ -523,36 +621,36 @@ ip6_reass(struct pbuf *p)
   iprh->end = end;
 
   /* If this is the last fragment, calculate total packet length. */
-  if ((offset & IP6_FRAG_MORE_FLAG) == 0) {
+  if (is_last) {
     ipr->datagram_len = iprh->end;
   }
 
-  /* Additional validity tests: we have received first and last fragment. */
-  iprh_tmp = (struct ip6_reass_helper*)ipr->p->payload;
-  if (iprh_tmp->start != 0) {
-    valid = 0;
-  }
-  if (ipr->datagram_len == 0) {
-    valid = 0;
-  }
-
-  /* Final validity test: no gaps between current and last fragment. */
-  iprh_prev = iprh;
-  q = iprh->next_pbuf;
-  while ((q != NULL) && valid) {
-    iprh = (struct ip6_reass_helper*)q->payload;
-    if (iprh_prev->end != iprh->start) {
+#if IP_REASS_CHECK_OVERLAP
+  /* Fragments don't overlap and don't exceed the datagram, so all of them
+   * are here when the received lengths add up to the datagram length. */
+  ipr->recv_len = (u16_t)(ipr->recv_len + len);
+  valid = (ipr->datagram_len != 0) && (ipr->recv_len == ipr->datagram_len);
+#else /* IP_REASS_CHECK_OVERLAP */
+  /* Validity tests: we have received the last fragment, and the fragments
+   * start with the first one and have no gaps. */
+  valid = (ipr->datagram_len != 0);
+  iprh_prev = NULL;
+  for (q = ipr->p; (q != NULL) && valid; q = iprh_tmp->next_pbuf) {
+    iprh_tmp = (struct ip6_reass_helper *)q->payload;
+    if (iprh_tmp->start != ((iprh_prev != NULL) ? iprh_prev->end : 0)) {
       valid = 0;
-      break;
     }
-    iprh_prev = iprh;
-    q = iprh->next_pbuf;
+    iprh_prev = iprh_tmp;
   }
+#endif /* IP_REASS_CHECK_OVERLAP */
 
   if (valid) {
     /* All fragments have been received */
     struct ip6_hdr* iphdr_ptr;
 
+    /* dequeue the fragment queue entry before the headers are moved */
+    ip6_reass_dequeue_datagram(ipr);
+
     /* chain together the pbufs contained within the ip6_reassdata list. */
     iprh = (struct ip6_reass_helper*) ipr->p->payload;
     while (iprh != NULL) {
@@ -635,14 +733,6 @@ ip6_reass(struct pbuf *p)
     }
 
     /* release the resources allocated for the fragment queue entry */
-    if (reassdatagrams == ipr) {
-      /* it was the first in the list */
-      reassdatagrams = ipr->next;
-    } else {
-      /* it wasn't the first, so it must have a valid 'prev' */
-      LWIP_ASSERT("sanity check linked list", ipr_prev != NULL);
-      ipr_prev->next = ipr->next;
-    }
     memp_free(MEMP_IP6_REASSDATA, ipr);
 
     /* adjust the number of pbufs currently queued for reassembly. */
@@ -663,6 +753,13 @@ ip6_reass(struct pbuf *p)
   /* the datagram is not (yet?) reassembled completely */
   return NULL;
 
+nullreturn_ipr:
+  if (ipr->p == NULL) {
+    /* dropped pbuf after creating a new datagram entry: remove the entry, too */
+    ip6_reass_dequeue_datagram(ipr);
+    memp_free(MEMP_IP6_REASSDATA, ipr);
+  }
+
 nullreturn:
   IP6_FRAG_STATS_INC(ip6_frag.drop);
   pbuf_free(p);
@@ -727,6 +824,9 @@ ip6_frag(struct pbuf *p, struct netif *netif, const ip6_addr_t *dest)
   struct pbuf *newpbuf;
   u16_t newpbuflen = 0;
   u16_t left_to_copy;
+#endif
+#if IP_FRAG_BATCH
+  struct ip_frag_batch *batch;
 #endif
   static u32_t identification;
   u16_t left, cop;
@@ -744,6 +844,11 @@ ip6_frag(struct pbuf *p, struct netif *netif, const ip6_addr_t *dest)
   LWIP_ASSERT("p->tot_len >= IP6_HLEN", p->tot_len >= IP6_HLEN);
   left = (u16_t)(p->tot_len - IP6_HLEN);
 
+#if IP_FRAG_BATCH
+  /* Try to slice all fragments at once, fall back to allocating them one by one */
+  batch = ip_frag_batch_alloc(p, IP6_HLEN, nfb, IP6_HLEN + IP6_FRAG_HLEN);
+#endif /* IP_FRAG_BATCH */
+
   while (left) {
     last = (left <= nfb);
 
@@ -758,6 +863,8 @@ ip6_frag(struct pbuf *p, struct netif *netif, const ip6_addr_t *dest)
     }
     LWIP_ASSERT("this needs a pbuf in one piece!",
       (rambuf->len == rambuf->tot_len) && (rambuf->next == NULL));
+    /* don't walk the chain from its start for every fragment */
+    p = pbuf_skip(p, poff, &poff);
     poff += pbuf_copy_partial(p, (u8_t*)rambuf->payload + IP6_FRAG_HLEN, cop, poff);
     /* make room for the IP header */
     if (pbuf_add_header(rambuf, IP6_HLEN)) {
@@ -770,64 +877,74 @@ ip6_frag(struct pbuf *p, struct netif *netif, const ip6_addr_t *dest)
     ip6hdr = (struct ip6_hdr *)rambuf->payload;
     frag_hdr = (struct ip6_frag_hdr *)((u8_t*)rambuf->payload + IP6_HLEN);
 #else
-    /* When not using a static buffer, create a chain of pbufs.
-     * The first will be a PBUF_RAM holding the link, IPv6, and Fragment header.
-     * The rest will be PBUF_REFs mirroring the pbuf chain to be fragged,
-     * but limited to the size of an mtu.
-     */
-    rambuf = pbuf_alloc(PBUF_LINK, IP6_HLEN + IP6_FRAG_HLEN, PBUF_RAM);
-    if (rambuf == NULL) {
-      IP6_FRAG_STATS_INC(ip6_frag.memerr);
-      return ERR_MEM;
-    }
-    LWIP_ASSERT("this needs a pbuf in one piece!",
-                (rambuf->len >= (IP6_HLEN)));
-    SMEMCPY(rambuf->payload, original_ip6hdr, IP6_HLEN);
-    ip6hdr = (struct ip6_hdr *)rambuf->payload;
-    frag_hdr = (struct ip6_frag_hdr *)((u8_t*)rambuf->payload + IP6_HLEN);
-
-    /* Can just adjust p directly for needed offset. */
-    p->payload = (u8_t *)p->payload + poff;
-    p->len = (u16_t)(p->len - poff);
-    p->tot_len = (u16_t)(p->tot_len - poff);
-
-    left_to_copy = cop;
-    while (left_to_copy) {
-      struct pbuf_custom_ref *pcr;
-      newpbuflen = (left_to_copy < p->len) ? left_to_copy : p->len;
-      /* Is this pbuf already empty? */
-      if (!newpbuflen) {
-        p = p->next;
-        continue;
-      }
-      pcr = ip6_frag_alloc_pbuf_custom_ref();
-      if (pcr == NULL) {
-        pbuf_free(rambuf);
-        IP6_FRAG_STATS_INC(ip6_frag.memerr);
-        return ERR_MEM;
-      }
-      /* Mirror this pbuf, although we might not need all of it. */
-      newpbuf = pbuf_alloced_custom(PBUF_RAW, newpbuflen, PBUF_REF, &pcr->pc, p->payload, newpbuflen);
-      if (newpbuf == NULL) {
-        ip6_frag_free_pbuf_custom_ref(pcr);
-        pbuf_free(rambuf);
+#if IP_FRAG_BATCH
+    if (batch != NULL) {
+      rambuf = ip_frag_batch_next(batch, cop);
+      SMEMCPY(rambuf->payload, original_ip6hdr, IP6_HLEN);
+      ip6hdr = (struct ip6_hdr *)rambuf->payload;
+      frag_hdr = (struct ip6_frag_hdr *)((u8_t*)rambuf->payload + IP6_HLEN);
+    } else
+#endif /* IP_FRAG_BATCH */
+    {
+      /* When not using a static buffer, create a chain of pbufs.
+       * The first will be a PBUF_RAM holding the link, IPv6, and Fragment header.
+       * The rest will be PBUF_REFs mirroring the pbuf chain to be fragged,
+       * but limited to the size of an mtu.
+       */
+      rambuf = pbuf_alloc(PBUF_LINK, IP6_HLEN + IP6_FRAG_HLEN, PBUF_RAM);
+      if (rambuf == NULL) {
         IP6_FRAG_STATS_INC(ip6_frag.memerr);
         return ERR_MEM;
       }
-      pbuf_ref(p);
-      pcr->original = p;
-      pcr->pc.custom_free_function = ip6_frag_free_pbuf_custom;
-
-      /* Add it to end of rambuf's chain, but using pbuf_cat, not pbuf_chain
-       * so that it is removed when pbuf_dechain is later called on rambuf.
-       */
-      pbuf_cat(rambuf, newpbuf);
-      left_to_copy = (u16_t)(left_to_copy - newpbuflen);
-      if (left_to_copy) {
-        p = p->next;
+      LWIP_ASSERT("this needs a pbuf in one piece!",
+                  (rambuf->len >= (IP6_HLEN)));
+      SMEMCPY(rambuf->payload, original_ip6hdr, IP6_HLEN);
+      ip6hdr = (struct ip6_hdr *)rambuf->payload;
+      frag_hdr = (struct ip6_frag_hdr *)((u8_t*)rambuf->payload + IP6_HLEN);
+
+      /* Can just adjust p directly for needed offset. */
+      p->payload = (u8_t *)p->payload + poff;
+      p->len = (u16_t)(p->len - poff);
+      p->tot_len = (u16_t)(p->tot_len - poff);
+
+      left_to_copy = cop;
+      while (left_to_copy) {
+        struct pbuf_custom_ref *pcr;
+        newpbuflen = (left_to_copy < p->len) ? left_to_copy : p->len;
+        /* Is this pbuf already empty? */
+        if (!newpbuflen) {
+          p = p->next;
+          continue;
+        }
+        pcr = ip6_frag_alloc_pbuf_custom_ref();
+        if (pcr == NULL) {
+          pbuf_free(rambuf);
+          IP6_FRAG_STATS_INC(ip6_frag.memerr);
+          return ERR_MEM;
+        }
+        /* Mirror this pbuf, although we might not need all of it. */
+        newpbuf = pbuf_alloced_custom(PBUF_RAW, newpbuflen, PBUF_REF, &pcr->pc, p->payload, newpbuflen);
+        if (newpbuf == NULL) {
+          ip6_frag_free_pbuf_custom_ref(pcr);
+          pbuf_free(rambuf);
+          IP6_FRAG_STATS_INC(ip6_frag.memerr);
+          return ERR_MEM;
+        }
+        pbuf_ref(p);
+        pcr->original = p;
+        pcr->pc.custom_free_function = ip6_frag_free_pbuf_custom;
+
+        /* Add it to end of rambuf's chain, but using pbuf_cat, not pbuf_chain
+         * so that it is removed when pbuf_dechain is later called on rambuf.
+         */
+        pbuf_cat(rambuf, newpbuf);
+        left_to_copy = (u16_t)(left_to_copy - newpbuflen);
+        if (left_to_copy) {
+          p = p->next;
+        }
       }
+      poff = newpbuflen;
     }
-    poff = newpbuflen;
 #endif /* LWIP_NETIF_TX_SINGLE_PBUF */
 
     /* Set headers */
@@ -856,6 +973,11 @@ ip6_frag(struct pbuf *p, struct netif *netif, const ip6_addr_t *dest)
     left = (u16_t)(left - cop);
     fragment_offset = (u16_t)(fragment_offset + cop);
   }
+#if IP_FRAG_BATCH
+  if (batch != NULL) {
+    ip_frag_batch_free(batch);
+  }
+#endif /* IP_FRAG_BATCH */
   return ERR_OK;
 }
 
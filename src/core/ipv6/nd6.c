@@ -84,6 +84,14 @@
 #if LWIP_ND6_NUM_ROUTERS > 127
 #error LWIP_ND6_NUM_ROUTERS must fit into an s8_t (max value: 127)
 #endif
+#if LWIP_ND6_CACHE_HASH
+#if (LWIP_ND6_NEIGHBOR_HASH_SIZE < 1) || (LWIP_ND6_NEIGHBOR_HASH_SIZE & (LWIP_ND6_NEIGHBOR_HASH_SIZE - 1))
+#error LWIP_ND6_NEIGHBOR_HASH_SIZE must be a power of 2
+#endif
+#if (LWIP_ND6_DESTINATION_HASH_SIZE < 1) || (LWIP_ND6_DESTINATION_HASH_SIZE & (LWIP_ND6_DESTINATION_HASH_SIZE - 1))
+#error LWIP_ND6_DESTINATION_HASH_SIZE must be a power of 2
+#endif
+#endif /* LWIP_ND6_CACHE_HASH */
 
 /* Router tables. */
 struct nd6_neighbor_cache_entry neighbor_cache[LWIP_ND6_NUM_NEIGHBORS];
@@ -102,6 +110,33 @@ static u8_t nd6_queue_size = 0;
 /* Index for cache entries. */
 static netif_addr_idx_t nd6_cached_destination_index;
 
+#if LWIP_ND6_CACHE_HASH
+/* Hash tables for the caches: first entry (index + 1) of every bucket. */
+static u8_t nd6_neighbor_hash[LWIP_ND6_NEIGHBOR_HASH_SIZE];
+static u16_t nd6_destination_hash[LWIP_ND6_DESTINATION_HASH_SIZE];
+/* Neighbor cache entries that have been freed and the number of entries at
+ * the start of neighbor_cache that have ever been used (all index + 1). */
+static u8_t nd6_neighbor_free_list;
+static u8_t nd6_neighbor_num_used;
+/* Destination cache entries that have been freed, the number of entries at
+ * the start of destination_cache that have ever been used and the entries
+ * in use, most recently used first (all index + 1). */
+static u16_t nd6_destination_free_list;
+static u16_t nd6_destination_num_used;
+static u16_t nd6_destination_lru_head, nd6_destination_lru_tail;
+
+static u32_t
+nd6_addr_hash(const ip6_addr_t *ip6addr)
+{
+  u32_t hash = ip6addr->addr[0] ^ ip6addr->addr[1] ^ ip6addr->addr[2] ^ ip6addr->addr[3];
+  hash ^= hash >> 16;
+  hash ^= hash >> 8;
+  return hash;
+}
+#define ND6_NEIGHBOR_HASH_BUCKET(addr)    nd6_neighbor_hash[nd6_addr_hash(addr) & (LWIP_ND6_NEIGHBOR_HASH_SIZE - 1)]
+#define ND6_DESTINATION_HASH_BUCKET(addr) nd6_destination_hash[nd6_addr_hash(addr) & (LWIP_ND6_DESTINATION_HASH_SIZE - 1)]
+#endif /* LWIP_ND6_CACHE_HASH */
+
 /* Multicast address holder. */
 static ip6_addr_t multicast_address;
 
@@ -121,9 +156,13 @@ static union ra_options nd6_ra_buffer;
 /* Forward declarations. */
 static s8_t nd6_find_neighbor_cache_entry(const ip6_addr_t *ip6addr);
 static s8_t nd6_new_neighbor_cache_entry(void);
+static s8_t nd6_recycle_neighbor_cache_entry(s8_t i);
+static void nd6_set_neighbor_cache_address(s8_t i, const ip6_addr_t *ip6addr);
 static void nd6_free_neighbor_cache_entry(s8_t i);
 static s16_t nd6_find_destination_cache_entry(const ip6_addr_t *ip6addr);
 static s16_t nd6_new_destination_cache_entry(void);
+static void nd6_set_destination_cache_address(s16_t i, const ip6_addr_t *ip6addr);
+static void nd6_free_destination_cache_entry(s16_t i);
 static int nd6_is_prefix_in_netif(const ip6_addr_t *ip6addr, struct netif *netif);
 static s8_t nd6_select_router(const ip6_addr_t *ip6addr, struct netif *netif);
 static s8_t nd6_get_router(const ip6_addr_t *router_addr, struct netif *netif);
@@ -552,7 +591,7 @@ nd6_input(struct pbuf *p, struct netif *inp)
         }
         neighbor_cache[i].netif = inp;
         MEMCPY(neighbor_cache[i].lladdr, lladdr_opt->addr, inp->hwaddr_len);
-        ip6_addr_set(&(neighbor_cache[i].next_hop_address), ip6_current_src_addr());
+        nd6_set_neighbor_cache_address(i, ip6_current_src_addr());
 
         /* Receiving a message does not prove reachability: only in one direction.
          * Delay probe in case we get confirmation of reachability from upper layer (TCP). */
@@ -886,7 +925,7 @@ nd6_input(struct pbuf *p, struct netif *inp)
           if (i >= 0) {
             neighbor_cache[i].netif = inp;
             MEMCPY(neighbor_cache[i].lladdr, lladdr_opt->addr, inp->hwaddr_len);
-            ip6_addr_copy(neighbor_cache[i].next_hop_address, target_address);
+            nd6_set_neighbor_cache_address(i, &target_address);
 
             /* Receiving a message does not prove reachability: only in one direction.
              * Delay probe in case we get confirmation of reachability from upper layer (TCP). */
@@ -1033,10 +1072,12 @@ nd6_tmr(void)
     }
   }
 
+#if !LWIP_ND6_CACHE_HASH
   /* Process destination entries. */
   for (i = 0; i < LWIP_ND6_NUM_DESTINATIONS; i++) {
     destination_cache[i].age++;
   }
+#endif /* !LWIP_ND6_CACHE_HASH */
 
   /* Process router entries. */
   for (i = 0; i < LWIP_ND6_NUM_ROUTERS; i++) {
@@ -1045,11 +1086,11 @@ nd6_tmr(void)
       if (default_router_list[i].invalidation_timer <= ND6_TMR_INTERVAL / 1000) {
         /* No more than 1 second remaining. Clear this entry. Also clear any of
          * its destination cache entries, as per RFC 4861 Sec. 5.3 and 6.3.5. */
-        s8_t j;
+        s16_t j;
         for (j = 0; j < LWIP_ND6_NUM_DESTINATIONS; j++) {
           if (ip6_addr_eq(&destination_cache[j].next_hop_addr,
                &default_router_list[i].neighbor_entry->next_hop_address)) {
-             ip6_addr_set_any(&destination_cache[j].destination_addr);
+             nd6_free_destination_cache_entry(j);
           }
         }
         default_router_list[i].neighbor_entry->isrouter = 0;
@@ -1427,12 +1468,21 @@ nd6_send_rs(struct netif *netif)
 static s8_t
 nd6_find_neighbor_cache_entry(const ip6_addr_t *ip6addr)
 {
+#if LWIP_ND6_CACHE_HASH
+  u8_t link;
+  for (link = ND6_NEIGHBOR_HASH_BUCKET(ip6addr); link != 0; link = neighbor_cache[link - 1].hash_next) {
+    if (ip6_addr_eq(ip6addr, &(neighbor_cache[link - 1].next_hop_address))) {
+      return (s8_t)(link - 1);
+    }
+  }
+#else /* LWIP_ND6_CACHE_HASH */
   s8_t i;
   for (i = 0; i < LWIP_ND6_NUM_NEIGHBORS; i++) {
     if (ip6_addr_eq(ip6addr, &(neighbor_cache[i].next_hop_address))) {
       return i;
     }
   }
+#endif /* LWIP_ND6_CACHE_HASH */
   return -1;
 }
 
@@ -1454,20 +1504,31 @@ nd6_new_neighbor_cache_entry(void)
 
 
   /* First, try to find an empty entry. */
+#if LWIP_ND6_CACHE_HASH
+  if (nd6_neighbor_free_list != 0) {
+    i = (s8_t)(nd6_neighbor_free_list - 1);
+    nd6_neighbor_free_list = neighbor_cache[i].hash_next;
+    return i;
+  }
+  if (nd6_neighbor_num_used < LWIP_ND6_NUM_NEIGHBORS) {
+    return (s8_t)nd6_neighbor_num_used++;
+  }
+#else /* LWIP_ND6_CACHE_HASH */
   for (i = 0; i < LWIP_ND6_NUM_NEIGHBORS; i++) {
     if (neighbor_cache[i].state == ND6_NO_ENTRY) {
       return i;
     }
   }
+#endif /* LWIP_ND6_CACHE_HASH */
 
-  /* We need to recycle an entry. in general, do not recycle if it is a router. */
+  /* We need to recycle an entry. in general, do not recycle if it is a router.
+   * This scans the full cache by state and age. */
 
   /* Next, try to find a Stale entry. */
   for (i = 0; i < LWIP_ND6_NUM_NEIGHBORS; i++) {
     if ((neighbor_cache[i].state == ND6_STALE) &&
         (!neighbor_cache[i].isrouter)) {
-      nd6_free_neighbor_cache_entry(i);
-      return i;
+      return nd6_recycle_neighbor_cache_entry(i);
     }
   }
 
@@ -1475,8 +1536,7 @@ nd6_new_neighbor_cache_entry(void)
   for (i = 0; i < LWIP_ND6_NUM_NEIGHBORS; i++) {
     if ((neighbor_cache[i].state == ND6_PROBE) &&
         (!neighbor_cache[i].isrouter)) {
-      nd6_free_neighbor_cache_entry(i);
-      return i;
+      return nd6_recycle_neighbor_cache_entry(i);
     }
   }
 
@@ -1484,8 +1544,7 @@ nd6_new_neighbor_cache_entry(void)
   for (i = 0; i < LWIP_ND6_NUM_NEIGHBORS; i++) {
     if ((neighbor_cache[i].state == ND6_DELAY) &&
         (!neighbor_cache[i].isrouter)) {
-      nd6_free_neighbor_cache_entry(i);
-      return i;
+      return nd6_recycle_neighbor_cache_entry(i);
     }
   }
 
@@ -1502,8 +1561,7 @@ nd6_new_neighbor_cache_entry(void)
     }
   }
   if (j >= 0) {
-    nd6_free_neighbor_cache_entry(j);
-    return j;
+    return nd6_recycle_neighbor_cache_entry(j);
   }
 
   /* Next, find oldest incomplete entry without queued packets. */
@@ -1521,8 +1579,7 @@ nd6_new_neighbor_cache_entry(void)
     }
   }
   if (j >= 0) {
-    nd6_free_neighbor_cache_entry(j);
-    return j;
+    return nd6_recycle_neighbor_cache_entry(j);
   }
 
   /* Next, find oldest incomplete entry with queued packets. */
@@ -1538,14 +1595,47 @@ nd6_new_neighbor_cache_entry(void)
     }
   }
   if (j >= 0) {
-    nd6_free_neighbor_cache_entry(j);
-    return j;
+    return nd6_recycle_neighbor_cache_entry(j);
   }
 
   /* No more entries to try. */
   return -1;
 }
 
+/**
+ * Free a neighbor cache entry for reuse by nd6_new_neighbor_cache_entry().
+ *
+ * @param i the neighbor cache entry index to recycle (not a router)
+ * @return i
+ */
+static s8_t
+nd6_recycle_neighbor_cache_entry(s8_t i)
+{
+  nd6_free_neighbor_cache_entry(i);
+#if LWIP_ND6_CACHE_HASH
+  /* take it off the free list again, it was pushed last */
+  LWIP_ASSERT("recycled entry not on the free list", nd6_neighbor_free_list == i + 1);
+  nd6_neighbor_free_list = neighbor_cache[i].hash_next;
+#endif /* LWIP_ND6_CACHE_HASH */
+  return i;
+}
+
+/**
+ * Set the address of a new neighbor cache entry.
+ *
+ * @param i the neighbor cache entry index
+ * @param ip6addr the IPv6 address of the neighbor
+ */
+static void
+nd6_set_neighbor_cache_address(s8_t i, const ip6_addr_t *ip6addr)
+{
+  ip6_addr_set(&(neighbor_cache[i].next_hop_address), ip6addr);
+#if LWIP_ND6_CACHE_HASH
+  neighbor_cache[i].hash_next = ND6_NEIGHBOR_HASH_BUCKET(ip6addr);
+  ND6_NEIGHBOR_HASH_BUCKET(ip6addr) = (u8_t)(i + 1);
+#endif /* LWIP_ND6_CACHE_HASH */
+}
+
 /**
  * Will free any resources associated with a neighbor cache
  * entry, and will mark it as unused.
@@ -1569,6 +1659,21 @@ nd6_free_neighbor_cache_entry(s8_t i)
     neighbor_cache[i].q = NULL;
   }
 
+#if LWIP_ND6_CACHE_HASH
+  if (neighbor_cache[i].state != ND6_NO_ENTRY) {
+    u8_t *link;
+    for (link = &ND6_NEIGHBOR_HASH_BUCKET(&neighbor_cache[i].next_hop_address); *link != 0;
+         link = &neighbor_cache[*link - 1].hash_next) {
+      if (*link == i + 1) {
+        *link = neighbor_cache[i].hash_next;
+        break;
+      }
+    }
+    neighbor_cache[i].hash_next = nd6_neighbor_free_list;
+    nd6_neighbor_free_list = (u8_t)(i + 1);
+  }
+#endif /* LWIP_ND6_CACHE_HASH */
+
   neighbor_cache[i].state = ND6_NO_ENTRY;
   neighbor_cache[i].isrouter = 0;
   neighbor_cache[i].netif = NULL;
@@ -1586,6 +1691,17 @@ nd6_free_neighbor_cache_entry(s8_t i)
 static s16_t
 nd6_find_destination_cache_entry(const ip6_addr_t *ip6addr)
 {
+#if LWIP_ND6_CACHE_HASH
+  u16_t link;
+
+  IP6_ADDR_ZONECHECK(ip6addr);
+
+  for (link = ND6_DESTINATION_HASH_BUCKET(ip6addr); link != 0; link = destination_cache[link - 1].hash_next) {
+    if (ip6_addr_eq(ip6addr, &(destination_cache[link - 1].destination_addr))) {
+      return (s16_t)(link - 1);
+    }
+  }
+#else /* LWIP_ND6_CACHE_HASH */
   s16_t i;
 
   IP6_ADDR_ZONECHECK(ip6addr);
@@ -1595,12 +1711,56 @@ nd6_find_destination_cache_entry(const ip6_addr_t *ip6addr)
       return i;
     }
   }
+#endif /* LWIP_ND6_CACHE_HASH */
   return -1;
 }
 
+#if LWIP_ND6_CACHE_HASH
+static void
+nd6_destination_lru_unlink(netif_addr_idx_t i)
+{
+  struct nd6_destination_cache_entry *dest = &destination_cache[i];
+
+  if (dest->lru_prev != 0) {
+    destination_cache[dest->lru_prev - 1].lru_next = dest->lru_next;
+  } else {
+    nd6_destination_lru_head = dest->lru_next;
+  }
+  if (dest->lru_next != 0) {
+    destination_cache[dest->lru_next - 1].lru_prev = dest->lru_prev;
+  } else {
+    nd6_destination_lru_tail = dest->lru_prev;
+  }
+}
+
+static void
+nd6_destination_lru_push(netif_addr_idx_t i)
+{
+  destination_cache[i].lru_prev = 0;
+  destination_cache[i].lru_next = nd6_destination_lru_head;
+  if (nd6_destination_lru_head != 0) {
+    destination_cache[nd6_destination_lru_head - 1].lru_prev = (u16_t)(i + 1);
+  } else {
+    nd6_destination_lru_tail = (u16_t)(i + 1);
+  }
+  nd6_destination_lru_head = (u16_t)(i + 1);
+}
+
+/** Mark a destination cache entry as most recently used */
+static void
+nd6_destination_lru_touch(netif_addr_idx_t i)
+{
+  if (nd6_destination_lru_head != i + 1) {
+    nd6_destination_lru_unlink(i);
+    nd6_destination_lru_push(i);
+  }
+}
+#endif /* LWIP_ND6_CACHE_HASH */
+
 /**
  * Create a new destination cache entry. If no unused entry is found,
- * will recycle oldest entry.
+ * will recycle oldest entry (the least recently used one if
+ * LWIP_ND6_CACHE_HASH is enabled).
  *
  * @return The destination cache entry index that was created, -1 if no
  * entry was created
@@ -1608,6 +1768,22 @@ nd6_find_destination_cache_entry(const ip6_addr_t *ip6addr)
 static s16_t
 nd6_new_destination_cache_entry(void)
 {
+#if LWIP_ND6_CACHE_HASH
+  s16_t i;
+
+  if ((nd6_destination_free_list == 0) && (nd6_destination_num_used >= LWIP_ND6_NUM_DESTINATIONS)) {
+    /* Recycle the least recently used entry. */
+    LWIP_ASSERT("destination cache LRU list empty", nd6_destination_lru_tail != 0);
+    nd6_free_destination_cache_entry((s16_t)(nd6_destination_lru_tail - 1));
+  }
+  if (nd6_destination_free_list != 0) {
+    i = (s16_t)(nd6_destination_free_list - 1);
+    nd6_destination_free_list = destination_cache[i].hash_next;
+  } else {
+    i = (s16_t)nd6_destination_num_used++;
+  }
+  return i;
+#else /* LWIP_ND6_CACHE_HASH */
   s16_t i, j;
   u32_t age;
 
@@ -1624,10 +1800,58 @@ nd6_new_destination_cache_entry(void)
   for (i = 0; i < LWIP_ND6_NUM_DESTINATIONS; i++) {
     if (destination_cache[i].age > age) {
       j = i;
+      age = destination_cache[i].age;
     }
   }
 
   return j;
+#endif /* LWIP_ND6_CACHE_HASH */
+}
+
+/**
+ * Set the destination address of a new destination cache entry.
+ *
+ * @param i the destination cache entry index
+ * @param ip6addr the IPv6 address of the destination
+ */
+static void
+nd6_set_destination_cache_address(s16_t i, const ip6_addr_t *ip6addr)
+{
+  ip6_addr_set(&destination_cache[i].destination_addr, ip6addr);
+#if LWIP_ND6_CACHE_HASH
+  destination_cache[i].hash_next = ND6_DESTINATION_HASH_BUCKET(ip6addr);
+  ND6_DESTINATION_HASH_BUCKET(ip6addr) = (u16_t)(i + 1);
+  nd6_destination_lru_push((netif_addr_idx_t)i);
+#endif /* LWIP_ND6_CACHE_HASH */
+}
+
+/**
+ * Mark a destination cache entry as unused.
+ *
+ * @param i the destination cache entry index to free
+ */
+static void
+nd6_free_destination_cache_entry(s16_t i)
+{
+  if (ip6_addr_isany(&destination_cache[i].destination_addr)) {
+    return;
+  }
+#if LWIP_ND6_CACHE_HASH
+  {
+    u16_t *link;
+    for (link = &ND6_DESTINATION_HASH_BUCKET(&destination_cache[i].destination_addr); *link != 0;
+         link = &destination_cache[*link - 1].hash_next) {
+      if (*link == i + 1) {
+        *link = destination_cache[i].hash_next;
+        break;
+      }
+    }
+  }
+  nd6_destination_lru_unlink((netif_addr_idx_t)i);
+  destination_cache[i].hash_next = nd6_destination_free_list;
+  nd6_destination_free_list = (u16_t)(i + 1);
+#endif /* LWIP_ND6_CACHE_HASH */
+  ip6_addr_set_any(&destination_cache[i].destination_addr);
 }
 
 /**
@@ -1644,6 +1868,13 @@ nd6_clear_destination_cache(void)
   for (i = 0; i < LWIP_ND6_NUM_DESTINATIONS; i++) {
     ip6_addr_set_any(&destination_cache[i].destination_addr);
   }
+#if LWIP_ND6_CACHE_HASH
+  memset(nd6_destination_hash, 0, sizeof(nd6_destination_hash));
+  nd6_destination_free_list = 0;
+  nd6_destination_num_used = 0;
+  nd6_destination_lru_head = 0;
+  nd6_destination_lru_tail = 0;
+#endif /* LWIP_ND6_CACHE_HASH */
 }
 
 /**
@@ -1783,7 +2014,9 @@ nd6_find_route(const ip6_addr_t *ip6addr)
     }
   }
 
-  /* No on-link prefix match. Find a router that can forward the packet. */
+  /* No on-link prefix match. Find a router that can forward the packet.
+   * Any router may forward any destination, so this walks the (small)
+   * router list by preference even with LWIP_ND6_CACHE_HASH. */
   i = nd6_select_router(ip6addr, NULL);
   if (i >= 0) {
     LWIP_ASSERT("selected router must have a neighbor entry",
@@ -1846,7 +2079,7 @@ nd6_new_router(const ip6_addr_t *router_addr, struct netif *netif)
       /* Could not create neighbor entry for this router. */
       return -1;
     }
-    ip6_addr_set(&(neighbor_cache[neighbor_index].next_hop_address), router_addr);
+    nd6_set_neighbor_cache_address(neighbor_index, router_addr);
     neighbor_cache[neighbor_index].netif = netif;
     neighbor_cache[neighbor_index].q = NULL;
     neighbor_cache[neighbor_index].state = ND6_INCOMPLETE;
@@ -1999,7 +2232,7 @@ nd6_get_next_hop_entry(const ip6_addr_t *ip6addr, struct netif *netif)
       }
 
       /* Copy dest address to destination cache. */
-      ip6_addr_set(&dest->destination_addr, ip6addr);
+      nd6_set_destination_cache_address(dst_idx, ip6addr);
 
       /* Now find the next hop. is it a neighbor? */
       if (ip6_addr_islinklocal(ip6addr) ||
@@ -2018,7 +2251,7 @@ nd6_get_next_hop_entry(const ip6_addr_t *ip6addr, struct netif *netif)
         i = nd6_select_router(ip6addr, netif);
         if (i < 0) {
           /* No router found. */
-          ip6_addr_set_any(&dest->destination_addr);
+          nd6_free_destination_cache_entry(dst_idx);
           return ERR_RTE;
         }
         dest->pmtu = netif_mtu6(netif); /* Start with netif mtu, correct through ICMPv6 if necessary */
@@ -2056,7 +2289,7 @@ nd6_get_next_hop_entry(const ip6_addr_t *ip6addr, struct netif *netif)
       }
 
       /* Initialize fields. */
-      ip6_addr_copy(neighbor_cache[i].next_hop_address, dest->next_hop_addr);
+      nd6_set_neighbor_cache_address(i, &dest->next_hop_addr);
       neighbor_cache[i].isrouter = 0;
       neighbor_cache[i].netif = netif;
       neighbor_cache[i].state = ND6_INCOMPLETE;
@@ -2067,6 +2300,9 @@ nd6_get_next_hop_entry(const ip6_addr_t *ip6addr, struct netif *netif)
 
   /* Reset this destination's age. */
   dest->age = 0;
+#if LWIP_ND6_CACHE_HASH
+  nd6_destination_lru_touch(nd6_cached_destination_index);
+#endif /* LWIP_ND6_CACHE_HASH */
 
   return dest->cached_neighbor_idx;
 }
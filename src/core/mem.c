@@ -392,7 +392,9 @@ static sys_mutex_t mem_mutex;
 
 #if LWIP_ALLOW_MEM_FREE_FROM_OTHER_CONTEXT
 
+#if !MEM_TLSF
 static volatile u8_t mem_free_count;
+#endif /* !MEM_TLSF */
 
 /* Allow mem_free from other (e.g. interrupt) context */
 #define LWIP_MEM_FREE_DECL_PROTECT()  SYS_ARCH_DECL_PROTECT(lev_free)
@@ -417,11 +419,16 @@ static volatile u8_t mem_free_count;
 
 #endif /* LWIP_ALLOW_MEM_FREE_FROM_OTHER_CONTEXT */
 
+#if !MEM_TLSF
 /** pointer to the lowest free block, this is used for faster search */
 static struct mem * LWIP_MEM_LFREE_VOLATILE lfree;
+#endif /* !MEM_TLSF */
 
 #if MEM_SANITY_CHECK
 static void mem_sanity(void);
+#if MEM_TLSF
+static void mem_tlsf_sanity(void);
+#endif /* MEM_TLSF */
 #define MEM_SANITY() mem_sanity()
 #else
 #define MEM_SANITY()
@@ -459,6 +466,7 @@ mem_to_ptr(void *mem)
   return (mem_size_t)((u8_t *)mem - ram);
 }
 
+#if !MEM_TLSF
 /**
  * "Plug holes" by combining adjacent empty struct mems.
  * After this function is through, there should not exist
@@ -543,6 +551,7 @@ mem_init(void)
     LWIP_ASSERT("failed to create mem_mutex", 0);
   }
 }
+#endif /* !MEM_TLSF */
 
 /* Check if a struct mem is correctly linked.
  * If not, double-free is a possible reason.
@@ -604,9 +613,13 @@ mem_sanity(void)
   LWIP_ASSERT("heap element used valid", mem->used == 1);
   LWIP_ASSERT("heap element prev ptr valid", mem->prev == MEM_SIZE_ALIGNED);
   LWIP_ASSERT("heap element next ptr valid", mem->next == MEM_SIZE_ALIGNED);
+#if MEM_TLSF
+  mem_tlsf_sanity();
+#endif /* MEM_TLSF */
 }
 #endif /* MEM_SANITY_CHECK */
 
+#if !MEM_TLSF
 /**
  * Put a struct mem back on the heap
  *
@@ -787,7 +800,7 @@ mem_trim(void *rmem, mem_size_t new_size)
      *       region that couldn't hold data, but when mem->next gets freed,
      *       the 2 regions would be combined, resulting in more free memory */
     ptr2 = (mem_size_t)(ptr + SIZEOF_STRUCT_MEM + newsize);
-    LWIP_ASSERT("invalid next ptr", mem->next != MEM_SIZE_ALIGNED);
+    LWIP_ASSERT("invalid next ptr", ptr2 != MEM_SIZE_ALIGNED);
     mem2 = ptr_to_mem(ptr2);
     if (mem2 < lfree) {
       lfree = mem2;
@@ -975,6 +988,550 @@ mem_malloc_adjust_lfree:
   return NULL;
 }
 
+#else /* !MEM_TLSF */
+/* Two-level segregated fit (TLSF) heap:
+ * The blocks are laid out exactly as in the first-fit heap above (struct mem,
+ * linked by index, ram_end as used sentinel). Free blocks are additionally
+ * kept in one of MEM_TLSF_FL_COUNT * MEM_TLSF_SL_COUNT doubly linked free
+ * lists: the first level selects the power of two of the block size, the
+ * second level splits that range into MEM_TLSF_SL_COUNT linear steps. Two
+ * levels of bitmaps tell which lists are non-empty, so finding a free block
+ * that is big enough is O(1), as are splitting and merging neighbours.
+ * The free list links are stored in the data area of free blocks.
+ */
+
+#define MEM_TLSF_SL_COUNT     (1 << MEM_TLSF_SL_LOG2)
+
+/* compile-time floor(log2(x)) for 32-bit x, used for table sizes */
+#define MEM_TLSF_LOG2_2(x)    (((x) & 0x2) ? 1 : 0)
+#define MEM_TLSF_LOG2_4(x)    (((x) & 0xC) ? (2 + MEM_TLSF_LOG2_2((x) >> 2)) : MEM_TLSF_LOG2_2(x))
+#define MEM_TLSF_LOG2_8(x)    (((x) & 0xF0) ? (4 + MEM_TLSF_LOG2_4((x) >> 4)) : MEM_TLSF_LOG2_4(x))
+#define MEM_TLSF_LOG2_16(x)   (((x) & 0xFF00) ? (8 + MEM_TLSF_LOG2_8((x) >> 8)) : MEM_TLSF_LOG2_8(x))
+#define MEM_TLSF_LOG2(x)      (((x) & 0xFFFF0000UL) ? (16 + MEM_TLSF_LOG2_16((x) >> 16)) : MEM_TLSF_LOG2_16(x))
+
+/** number of first level lists: enough for a block spanning the whole heap */
+#define MEM_TLSF_FL_COUNT     (MEM_TLSF_LOG2((u32_t)MEM_SIZE_ALIGNED) - MEM_TLSF_SL_LOG2 + 2)
+
+/** free list links, stored in the data area of a free block */
+struct mem_tlsf_links {
+  /** index of the next free block in the same list, MEM_SIZE_ALIGNED: none */
+  mem_size_t next_free;
+  /** index of the previous free block in the same list, MEM_SIZE_ALIGNED: none */
+  mem_size_t prev_free;
+};
+
+/** heads of the free lists, MEM_SIZE_ALIGNED (ram_end) marks an empty list */
+static mem_size_t mem_tlsf_heads[MEM_TLSF_FL_COUNT][MEM_TLSF_SL_COUNT];
+/** bit n set: mem_tlsf_sl_bitmap[n] is non-zero */
+static u32_t mem_tlsf_fl_bitmap;
+/** bit n of entry m set: mem_tlsf_heads[m][n] is not empty */
+static u32_t mem_tlsf_sl_bitmap[MEM_TLSF_FL_COUNT];
+
+#if defined(__GNUC__)
+#define mem_tlsf_fls(x)       (31 - __builtin_clz(x))
+#define mem_tlsf_ffs(x)       __builtin_ctz(x)
+#else /* __GNUC__ */
+/** index of the most significant bit set in x (x != 0) */
+static int
+mem_tlsf_fls(u32_t x)
+{
+  int n = 0;
+  if (x & 0xFFFF0000UL) {
+    n += 16;
+    x >>= 16;
+  }
+  if (x & 0xFF00) {
+    n += 8;
+    x >>= 8;
+  }
+  if (x & 0xF0) {
+    n += 4;
+    x >>= 4;
+  }
+  if (x & 0xC) {
+    n += 2;
+    x >>= 2;
+  }
+  if (x & 0x2) {
+    n += 1;
+  }
+  return n;
+}
+
+/** index of the least significant bit set in x (x != 0) */
+#define mem_tlsf_ffs(x)       mem_tlsf_fls((x) & (~(x) + 1))
+#endif /* __GNUC__ */
+
+static struct mem_tlsf_links *
+mem_tlsf_links(struct mem *mem)
+{
+  return (struct mem_tlsf_links *)(void *)((u8_t *)mem + SIZEOF_STRUCT_MEM);
+}
+
+/** data size of a block (what mem_malloc() could hand out, with sanity regions) */
+static mem_size_t
+mem_tlsf_size(struct mem *mem)
+{
+  return (mem_size_t)(mem->next - mem_to_ptr(mem) - SIZEOF_STRUCT_MEM);
+}
+
+/** Get the free list a block of 'size' bytes belongs to */
+static void
+mem_tlsf_mapping(u32_t size, int *fl, int *sl)
+{
+  int t;
+  if (size < MEM_TLSF_SL_COUNT) {
+    *fl = 0;
+    *sl = (int)size;
+  } else {
+    t = mem_tlsf_fls(size);
+    *sl = (int)(size >> (t - MEM_TLSF_SL_LOG2)) ^ MEM_TLSF_SL_COUNT;
+    *fl = t - MEM_TLSF_SL_LOG2 + 1;
+  }
+}
+
+/** Put a free block on its free list */
+static void
+mem_tlsf_insert(struct mem *mem)
+{
+  struct mem_tlsf_links *links = mem_tlsf_links(mem);
+  mem_size_t ptr = mem_to_ptr(mem);
+  int fl, sl;
+
+  mem_tlsf_mapping(mem_tlsf_size(mem), &fl, &sl);
+  links->prev_free = MEM_SIZE_ALIGNED;
+  links->next_free = mem_tlsf_heads[fl][sl];
+  if (links->next_free != MEM_SIZE_ALIGNED) {
+    mem_tlsf_links(ptr_to_mem(links->next_free))->prev_free = ptr;
+  }
+  mem_tlsf_heads[fl][sl] = ptr;
+  mem_tlsf_fl_bitmap |= (u32_t)1 << fl;
+  mem_tlsf_sl_bitmap[fl] |= (u32_t)1 << sl;
+}
+
+/** Take a free block off its free list */
+static void
+mem_tlsf_remove(struct mem *mem)
+{
+  struct mem_tlsf_links *links = mem_tlsf_links(mem);
+  int fl, sl;
+
+  mem_tlsf_mapping(mem_tlsf_size(mem), &fl, &sl);
+  if (links->next_free != MEM_SIZE_ALIGNED) {
+    mem_tlsf_links(ptr_to_mem(links->next_free))->prev_free = links->prev_free;
+  }
+  if (links->prev_free != MEM_SIZE_ALIGNED) {
+    mem_tlsf_links(ptr_to_mem(links->prev_free))->next_free = links->next_free;
+  } else {
+    LWIP_ASSERT("mem_tlsf_remove: list head", mem_tlsf_heads[fl][sl] == mem_to_ptr(mem));
+    mem_tlsf_heads[fl][sl] = links->next_free;
+    if (links->next_free == MEM_SIZE_ALIGNED) {
+      mem_tlsf_sl_bitmap[fl] &= ~((u32_t)1 << sl);
+      if (mem_tlsf_sl_bitmap[fl] == 0) {
+        mem_tlsf_fl_bitmap &= ~((u32_t)1 << fl);
+      }
+    }
+  }
+}
+
+/**
+ * Find a free block of at least 'size' bytes (without taking it off its list).
+ *
+ * @return the block found or NULL if there is none
+ */
+static struct mem *
+mem_tlsf_find(mem_size_t size)
+{
+  u32_t rounded = size;
+  u32_t map;
+  mem_size_t ptr;
+  int fl, sl;
+
+  /* round up to the next size class: every block in that list or in any
+     list above is big enough */
+  if (rounded >= MEM_TLSF_SL_COUNT) {
+    rounded += ((u32_t)1 << (mem_tlsf_fls(rounded) - MEM_TLSF_SL_LOG2)) - 1;
+  }
+  mem_tlsf_mapping(rounded, &fl, &sl);
+  if (fl < MEM_TLSF_FL_COUNT) {
+    map = mem_tlsf_sl_bitmap[fl] & (~(u32_t)0 << sl);
+    if (map == 0) {
+      map = (fl + 1 < MEM_TLSF_FL_COUNT) ? (mem_tlsf_fl_bitmap & (~(u32_t)0 << (fl + 1))) : 0;
+      if (map != 0) {
+        fl = mem_tlsf_ffs(map);
+        map = mem_tlsf_sl_bitmap[fl];
+      }
+    }
+    if (map != 0) {
+      sl = mem_tlsf_ffs(map);
+      return ptr_to_mem(mem_tlsf_heads[fl][sl]);
+    }
+  }
+  /* The list 'size' itself maps to may still hold a block that is big
+     enough: only check its first block to stay O(1) */
+  mem_tlsf_mapping(size, &fl, &sl);
+  ptr = mem_tlsf_heads[fl][sl];
+  if ((ptr != MEM_SIZE_ALIGNED) && (mem_tlsf_size(ptr_to_mem(ptr)) >= size)) {
+    return ptr_to_mem(ptr);
+  }
+  return NULL;
+}
+
+#if MEM_SANITY_CHECK
+static void
+mem_tlsf_sanity(void)
+{
+  struct mem *mem;
+  mem_size_t ptr, prev;
+  int fl, sl, bfl, bsl;
+  u32_t num_listed = 0, num_free = 0;
+
+  for (fl = 0; fl < MEM_TLSF_FL_COUNT; fl++) {
+    LWIP_ASSERT("tlsf fl bitmap valid",
+                ((mem_tlsf_fl_bitmap & ((u32_t)1 << fl)) != 0) == (mem_tlsf_sl_bitmap[fl] != 0));
+    for (sl = 0; sl < MEM_TLSF_SL_COUNT; sl++) {
+      LWIP_ASSERT("tlsf sl bitmap valid",
+                  ((mem_tlsf_sl_bitmap[fl] & ((u32_t)1 << sl)) != 0) == (mem_tlsf_heads[fl][sl] != MEM_SIZE_ALIGNED));
+      prev = MEM_SIZE_ALIGNED;
+      for (ptr = mem_tlsf_heads[fl][sl]; ptr != MEM_SIZE_ALIGNED; ptr = mem_tlsf_links(mem)->next_free) {
+        mem = ptr_to_mem(ptr);
+        LWIP_ASSERT("tlsf listed block unused", mem->used == 0);
+        LWIP_ASSERT("tlsf listed block prev link", mem_tlsf_links(mem)->prev_free == prev);
+        mem_tlsf_mapping(mem_tlsf_size(mem), &bfl, &bsl);
+        LWIP_ASSERT("tlsf listed block in the right list", (bfl == fl) && (bsl == sl));
+        prev = ptr;
+        num_listed++;
+      }
+    }
+  }
+  for (mem = (struct mem *)(void *)ram; mem != ram_end; mem = ptr_to_mem(mem->next)) {
+    if (!mem->used) {
+      num_free++;
+    }
+  }
+  LWIP_ASSERT("tlsf all free blocks listed", num_listed == num_free);
+}
+#endif /* MEM_SANITY_CHECK */
+
+/**
+ * Zero the heap and initialize start, end and the free lists
+ */
+void
+mem_init(void)
+{
+  struct mem *mem;
+  int fl, sl;
+
+  LWIP_ASSERT("Sanity check alignment",
+              (SIZEOF_STRUCT_MEM & (MEM_ALIGNMENT - 1)) == 0);
+  LWIP_ASSERT("MIN_SIZE too small for free list links",
+              MIN_SIZE_ALIGNED >= sizeof(struct mem_tlsf_links));
+
+  /* align the heap */
+  ram = (u8_t *)LWIP_MEM_ALIGN(LWIP_RAM_HEAP_POINTER);
+  /* initialize the end of the heap */
+  ram_end = ptr_to_mem(MEM_SIZE_ALIGNED);
+  ram_end->used = 1;
+  ram_end->next = MEM_SIZE_ALIGNED;
+  ram_end->prev = MEM_SIZE_ALIGNED;
+  for (fl = 0; fl < MEM_TLSF_FL_COUNT; fl++) {
+    for (sl = 0; sl < MEM_TLSF_SL_COUNT; sl++) {
+      mem_tlsf_heads[fl][sl] = MEM_SIZE_ALIGNED;
+    }
+    mem_tlsf_sl_bitmap[fl] = 0;
+  }
+  mem_tlsf_fl_bitmap = 0;
+  /* the whole heap is one free block */
+  mem = (struct mem *)(void *)ram;
+  mem->next = MEM_SIZE_ALIGNED;
+  mem->prev = 0;
+  mem->used = 0;
+  mem_tlsf_insert(mem);
+  MEM_SANITY();
+
+  MEM_STATS_AVAIL(avail, MEM_SIZE_ALIGNED);
+
+  if (sys_mutex_new(&mem_mutex) != ERR_OK) {
+    LWIP_ASSERT("failed to create mem_mutex", 0);
+  }
+}
+
+/**
+ * Put a struct mem back on the heap
+ *
+ * @param rmem is the data portion of a struct mem as returned by a previous
+ *             call to mem_malloc()
+ */
+void
+mem_free(void *rmem)
+{
+  struct mem *mem, *nmem, *pmem;
+  LWIP_MEM_FREE_DECL_PROTECT();
+
+  if (rmem == NULL) {
+    LWIP_DEBUGF(MEM_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_LEVEL_SERIOUS, ("mem_free(p == NULL) was called.\n"));
+    return;
+  }
+  if ((((mem_ptr_t)rmem) & (MEM_ALIGNMENT - 1)) != 0) {
+    LWIP_MEM_ILLEGAL_FREE("mem_free: sanity check alignment");
+    LWIP_DEBUGF(MEM_DEBUG | LWIP_DBG_LEVEL_SEVERE, ("mem_free: sanity check alignment\n"));
+    /* protect mem stats from concurrent access */
+    MEM_STATS_INC_LOCKED(illegal);
+    return;
+  }
+
+  /* Get the corresponding struct mem: */
+  /* cast through void* to get rid of alignment warnings */
+  mem = (struct mem *)(void *)((u8_t *)rmem - (SIZEOF_STRUCT_MEM + MEM_SANITY_OFFSET));
+
+  if ((u8_t *)mem < ram || (u8_t *)rmem + MIN_SIZE_ALIGNED > (u8_t *)ram_end) {
+    LWIP_MEM_ILLEGAL_FREE("mem_free: illegal memory");
+    LWIP_DEBUGF(MEM_DEBUG | LWIP_DBG_LEVEL_SEVERE, ("mem_free: illegal memory\n"));
+    /* protect mem stats from concurrent access */
+    MEM_STATS_INC_LOCKED(illegal);
+    return;
+  }
+#if MEM_OVERFLOW_CHECK
+  mem_overflow_check_element(mem);
+#endif
+  /* protect the heap from concurrent access */
+  LWIP_MEM_FREE_PROTECT();
+  /* mem has to be in a used state */
+  if (!mem->used) {
+    LWIP_MEM_ILLEGAL_FREE("mem_free: illegal memory: double free");
+    LWIP_MEM_FREE_UNPROTECT();
+    LWIP_DEBUGF(MEM_DEBUG | LWIP_DBG_LEVEL_SEVERE, ("mem_free: illegal memory: double free?\n"));
+    /* protect mem stats from concurrent access */
+    MEM_STATS_INC_LOCKED(illegal);
+    return;
+  }
+
+  if (!mem_link_valid(mem)) {
+    LWIP_MEM_ILLEGAL_FREE("mem_free: illegal memory: non-linked: double free");
+    LWIP_MEM_FREE_UNPROTECT();
+    LWIP_DEBUGF(MEM_DEBUG | LWIP_DBG_LEVEL_SEVERE, ("mem_free: illegal memory: non-linked: double free?\n"));
+    /* protect mem stats from concurrent access */
+    MEM_STATS_INC_LOCKED(illegal);
+    return;
+  }
+
+  /* mem is now unused. */
+  mem->used = 0;
+  MEM_STATS_DEC_USED(used, mem->next - mem_to_ptr(mem));
+
+  /* merge with the next block if that is free */
+  nmem = ptr_to_mem(mem->next);
+  if ((nmem != ram_end) && !nmem->used) {
+    mem_tlsf_remove(nmem);
+    mem->next = nmem->next;
+    if (nmem->next != MEM_SIZE_ALIGNED) {
+      ptr_to_mem(nmem->next)->prev = mem_to_ptr(mem);
+    }
+  }
+  /* merge with the previous block if that is free */
+  pmem = ptr_to_mem(mem->prev);
+  if ((pmem != mem) && !pmem->used) {
+    mem_tlsf_remove(pmem);
+    pmem->next = mem->next;
+    if (mem->next != MEM_SIZE_ALIGNED) {
+      ptr_to_mem(mem->next)->prev = mem_to_ptr(pmem);
+    }
+    mem = pmem;
+  }
+  mem_tlsf_insert(mem);
+  MEM_SANITY();
+  LWIP_MEM_FREE_UNPROTECT();
+}
+
+/**
+ * Shrink memory returned by mem_malloc().
+ *
+ * @param rmem pointer to memory allocated by mem_malloc the is to be shrunk
+ * @param new_size required size after shrinking (needs to be smaller than or
+ *                equal to the previous size)
+ * @return for compatibility reasons: is always == rmem, at the moment
+ *         or NULL if newsize is > old size, in which case rmem is NOT touched
+ *         or freed!
+ */
+void *
+mem_trim(void *rmem, mem_size_t new_size)
+{
+  mem_size_t size, newsize;
+  mem_size_t ptr, ptr2;
+  struct mem *mem, *mem2;
+  LWIP_MEM_FREE_DECL_PROTECT();
+
+  /* Expand the size of the allocated memory region so that we can
+     adjust for alignment. */
+  newsize = (mem_size_t)LWIP_MEM_ALIGN_SIZE(new_size);
+  if (newsize < MIN_SIZE_ALIGNED) {
+    /* every data block must be at least MIN_SIZE_ALIGNED long */
+    newsize = MIN_SIZE_ALIGNED;
+  }
+#if MEM_OVERFLOW_CHECK
+  newsize += MEM_SANITY_REGION_BEFORE_ALIGNED + MEM_SANITY_REGION_AFTER_ALIGNED;
+#endif
+  if ((newsize > MEM_SIZE_ALIGNED) || (newsize < new_size)) {
+    return NULL;
+  }
+
+  LWIP_ASSERT("mem_trim: legal memory", (u8_t *)rmem >= (u8_t *)ram &&
+              (u8_t *)rmem < (u8_t *)ram_end);
+
+  if ((u8_t *)rmem < (u8_t *)ram || (u8_t *)rmem >= (u8_t *)ram_end) {
+    LWIP_DEBUGF(MEM_DEBUG | LWIP_DBG_LEVEL_SEVERE, ("mem_trim: illegal memory\n"));
+    /* protect mem stats from concurrent access */
+    MEM_STATS_INC_LOCKED(illegal);
+    return rmem;
+  }
+  /* Get the corresponding struct mem ... */
+  /* cast through void* to get rid of alignment warnings */
+  mem = (struct mem *)(void *)((u8_t *)rmem - (SIZEOF_STRUCT_MEM + MEM_SANITY_OFFSET));
+#if MEM_OVERFLOW_CHECK
+  mem_overflow_check_element(mem);
+#endif
+  /* ... and its offset pointer */
+  ptr = mem_to_ptr(mem);
+
+  size = (mem_size_t)((mem_size_t)(mem->next - ptr) - (SIZEOF_STRUCT_MEM + MEM_SANITY_OVERHEAD));
+  LWIP_ASSERT("mem_trim can only shrink memory", newsize <= size);
+  if (newsize > size) {
+    /* not supported */
+    return NULL;
+  }
+  if (newsize == size) {
+    /* No change in size, simply return */
+    return rmem;
+  }
+
+  /* protect the heap from concurrent access */
+  LWIP_MEM_FREE_PROTECT();
+
+  mem2 = ptr_to_mem(mem->next);
+  if ((mem2 != ram_end) && (mem2->used == 0)) {
+    /* The next block is free: move its start down and re-list it */
+    mem_size_t next = mem2->next;
+    mem_tlsf_remove(mem2);
+    ptr2 = (mem_size_t)(ptr + SIZEOF_STRUCT_MEM + newsize);
+    mem2 = ptr_to_mem(ptr2);
+    mem2->used = 0;
+    mem2->next = next;
+    mem2->prev = ptr;
+    mem->next = ptr2;
+    if (mem2->next != MEM_SIZE_ALIGNED) {
+      ptr_to_mem(mem2->next)->prev = ptr2;
+    }
+    mem_tlsf_insert(mem2);
+    MEM_STATS_DEC_USED(used, (size - newsize));
+  } else if (newsize + SIZEOF_STRUCT_MEM + MIN_SIZE_ALIGNED <= size) {
+    /* Next block is used but there's room for a free block with at least
+     * MIN_SIZE_ALIGNED of data in between */
+    ptr2 = (mem_size_t)(ptr + SIZEOF_STRUCT_MEM + newsize);
+    LWIP_ASSERT("invalid next ptr", ptr2 != MEM_SIZE_ALIGNED);
+    mem2 = ptr_to_mem(ptr2);
+    mem2->used = 0;
+    mem2->next = mem->next;
+    mem2->prev = ptr;
+    mem->next = ptr2;
+    if (mem2->next != MEM_SIZE_ALIGNED) {
+      ptr_to_mem(mem2->next)->prev = ptr2;
+    }
+    mem_tlsf_insert(mem2);
+    MEM_STATS_DEC_USED(used, (size - newsize));
+  }
+  /* else: the remaining space is too small for a block, it stays with mem */
+#if MEM_OVERFLOW_CHECK
+  mem_overflow_init_element(mem, new_size);
+#endif
+  MEM_SANITY();
+  LWIP_MEM_FREE_UNPROTECT();
+  return rmem;
+}
+
+/**
+ * Allocate a block of memory with a minimum of 'size' bytes.
+ *
+ * @param size_in is the minimum size of the requested block in bytes.
+ * @return pointer to allocated memory or NULL if no free memory was found.
+ *
+ * Note that the returned value will always be aligned (as defined by MEM_ALIGNMENT).
+ */
+void *
+mem_malloc(mem_size_t size_in)
+{
+  mem_size_t ptr, ptr2, size;
+  struct mem *mem, *mem2;
+  LWIP_MEM_ALLOC_DECL_PROTECT();
+
+  if (size_in == 0) {
+    return NULL;
+  }
+
+  /* Expand the size of the allocated memory region so that we can
+     adjust for alignment. */
+  size = (mem_size_t)LWIP_MEM_ALIGN_SIZE(size_in);
+  if (size < MIN_SIZE_ALIGNED) {
+    /* every data block must be at least MIN_SIZE_ALIGNED long */
+    size = MIN_SIZE_ALIGNED;
+  }
+#if MEM_OVERFLOW_CHECK
+  size += MEM_SANITY_REGION_BEFORE_ALIGNED + MEM_SANITY_REGION_AFTER_ALIGNED;
+#endif
+  if ((size > MEM_SIZE_ALIGNED) || (size < size_in)) {
+    return NULL;
+  }
+
+  /* protect the heap from concurrent access: all steps below are O(1), so
+     mem_free from other context is simply locked out for the whole time */
+  sys_mutex_lock(&mem_mutex);
+  LWIP_MEM_ALLOC_PROTECT();
+
+  mem = mem_tlsf_find(size);
+  if (mem == NULL) {
+    MEM_STATS_INC(err);
+    LWIP_MEM_ALLOC_UNPROTECT();
+    sys_mutex_unlock(&mem_mutex);
+    LWIP_DEBUGF(MEM_DEBUG | LWIP_DBG_LEVEL_SERIOUS, ("mem_malloc: could not allocate %"S16_F" bytes\n", (s16_t)size));
+    return NULL;
+  }
+  mem_tlsf_remove(mem);
+  ptr = mem_to_ptr(mem);
+
+  if (mem_tlsf_size(mem) >= (size + SIZEOF_STRUCT_MEM + MIN_SIZE_ALIGNED)) {
+    /* split the block, the remainder goes back to a free list (its next
+       block is used, otherwise it would have been merged) */
+    ptr2 = (mem_size_t)(ptr + SIZEOF_STRUCT_MEM + size);
+    LWIP_ASSERT("invalid next ptr", ptr2 != MEM_SIZE_ALIGNED);
+    mem2 = ptr_to_mem(ptr2);
+    mem2->used = 0;
+    mem2->next = mem->next;
+    mem2->prev = ptr;
+    mem->next = ptr2;
+    if (mem2->next != MEM_SIZE_ALIGNED) {
+      ptr_to_mem(mem2->next)->prev = ptr2;
+    }
+    mem_tlsf_insert(mem2);
+  }
+  mem->used = 1;
+  MEM_STATS_INC_USED(used, mem->next - ptr);
+
+  LWIP_MEM_ALLOC_UNPROTECT();
+  sys_mutex_unlock(&mem_mutex);
+  LWIP_ASSERT("mem_malloc: allocated memory not above ram_end.",
+              (mem_ptr_t)mem + SIZEOF_STRUCT_MEM + size <= (mem_ptr_t)ram_end);
+  LWIP_ASSERT("mem_malloc: allocated memory properly aligned.",
+              ((mem_ptr_t)mem + SIZEOF_STRUCT_MEM) % MEM_ALIGNMENT == 0);
+  LWIP_ASSERT("mem_malloc: sanity check alignment",
+              (((mem_ptr_t)mem) & (MEM_ALIGNMENT - 1)) == 0);
+
+#if MEM_OVERFLOW_CHECK
+  mem_overflow_init_element(mem, size_in);
+#endif
+  MEM_SANITY();
+  return (u8_t *)mem + SIZEOF_STRUCT_MEM + MEM_SANITY_OFFSET;
+}
+#endif /* !MEM_TLSF */
+
 #endif /* MEM_USE_POOLS */
 
 #if MEM_LIBC_MALLOC && (!LWIP_STATS || !MEM_STATS)
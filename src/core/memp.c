@@ -59,6 +59,7 @@
 #include "lwip/priv/tcp_priv.h"
 #include "lwip/altcp.h"
 #include "lwip/ip4_frag.h"
+#include "lwip/ip4_fib.h"
 #include "lwip/netbuf.h"
 #include "lwip/api.h"
 #include "lwip/priv/tcpip_priv.h"
@@ -93,6 +94,14 @@ const struct memp_desc *const memp_pools[MEMP_MAX] = {
 #define MEMP_OVERFLOW_CHECK 1
 #endif
 
+/* The cache stores elements without struct memp header, so it is bypassed
+   for MEMP_OVERFLOW_CHECK to keep the per-element checks */
+#define MEMP_CACHE_ENABLED (MEMP_CACHE && !MEMP_MEM_MALLOC && !MEMP_OVERFLOW_CHECK)
+
+#if MEMP_CACHE_ENABLED && !defined(LWIP_HOOK_MEMP_CACHE)
+#error "MEMP_CACHE needs LWIP_HOOK_MEMP_CACHE to find the cache of the calling thread"
+#endif
+
 #if MEMP_SANITY_CHECK && !MEMP_MEM_MALLOC
 /**
  * Check that memp-lists don't form a circle, using "Floyd's cycle-finding algorithm".
@@ -325,6 +334,127 @@ memp_malloc_pool_fn(const struct memp_desc *desc, const char *file, const int li
 #endif
 }
 
+#if MEMP_CACHE_ENABLED
+/**
+ * Number of elements moved between a thread cache and a pool at once.
+ * A thread cache holds at most twice this, 0 means the pool is not cached.
+ */
+static u16_t
+memp_cache_batch(const struct memp_desc *desc)
+{
+  if (desc->num < 16) {
+    return 0;
+  }
+  return (u16_t)LWIP_MIN(desc->num / 8, MEMP_CACHE_SIZE / 2);
+}
+
+/**
+ * Refill an empty thread cache from its pool.
+ *
+ * @return number of elements now in the cache (0 if the pool is empty)
+ */
+static u16_t
+memp_cache_refill(struct memp_cache *cache, memp_t type, u16_t batch)
+{
+  const struct memp_desc *desc = memp_pools[type];
+  struct memp *memp;
+  u16_t n = 0;
+  SYS_ARCH_DECL_PROTECT(old_level);
+
+  SYS_ARCH_PROTECT(old_level);
+  while ((n < batch) && ((memp = *desc->tab) != NULL)) {
+    *desc->tab = memp->next;
+    cache->elems[type][n++] = memp;
+  }
+#if MEMP_STATS
+  if (n > 0) {
+    desc->stats->used = (mem_size_t)(desc->stats->used + n);
+    if (desc->stats->used > desc->stats->max) {
+      desc->stats->max = desc->stats->used;
+    }
+  } else {
+    desc->stats->err++;
+  }
+#endif
+  SYS_ARCH_UNPROTECT(old_level);
+
+  if (n == 0) {
+    LWIP_DEBUGF(MEMP_DEBUG | LWIP_DBG_LEVEL_SERIOUS, ("memp_malloc: out of memory in pool %s\n", desc->desc));
+  }
+  cache->num[type] = n;
+  return n;
+}
+
+/**
+ * Return the oldest elements of a thread cache to their pool, keeping
+ * the 'keep' most recently freed ones (which are likely still in the CPU cache).
+ */
+static void
+memp_cache_drain(struct memp_cache *cache, memp_t type, u16_t keep)
+{
+  const struct memp_desc *desc = memp_pools[type];
+  struct memp *memp;
+  u16_t i, n = (u16_t)(cache->num[type] - keep);
+#ifdef LWIP_HOOK_MEMP_AVAILABLE
+  struct memp *old_first;
+#endif
+  SYS_ARCH_DECL_PROTECT(old_level);
+
+  SYS_ARCH_PROTECT(old_level);
+#ifdef LWIP_HOOK_MEMP_AVAILABLE
+  old_first = *desc->tab;
+#endif
+  for (i = 0; i < n; i++) {
+    memp = (struct memp *)cache->elems[type][i];
+    memp->next = *desc->tab;
+    *desc->tab = memp;
+  }
+#if MEMP_STATS
+  desc->stats->used = (mem_size_t)(desc->stats->used - n);
+#endif
+#if MEMP_SANITY_CHECK
+  LWIP_ASSERT("memp sanity", memp_sanity(desc));
+#endif /* MEMP_SANITY_CHECK */
+  SYS_ARCH_UNPROTECT(old_level);
+
+  memmove(&cache->elems[type][0], &cache->elems[type][n], keep * sizeof(cache->elems[type][0]));
+  cache->num[type] = keep;
+
+#ifdef LWIP_HOOK_MEMP_AVAILABLE
+  if ((old_first == NULL) && (n > 0)) {
+    LWIP_HOOK_MEMP_AVAILABLE(type);
+  }
+#endif
+}
+#endif /* MEMP_CACHE_ENABLED */
+
+#if MEMP_CACHE
+/**
+ * @ingroup mempool
+ * Return all elements held in a thread cache to their pools. Call this before
+ * the cache is discarded (e.g. when its thread exits) or to get exact
+ * MEMP_STATS.
+ *
+ * @param cache the thread cache to empty
+ */
+void
+memp_cache_flush(struct memp_cache *cache)
+{
+#if MEMP_CACHE_ENABLED
+  u16_t i;
+
+  LWIP_ASSERT("invalid cache", cache != NULL);
+  for (i = 0; i < MEMP_MAX; i++) {
+    if (cache->num[i] > 0) {
+      memp_cache_drain(cache, (memp_t)i, 0);
+    }
+  }
+#else /* MEMP_CACHE_ENABLED */
+  LWIP_UNUSED_ARG(cache);
+#endif /* MEMP_CACHE_ENABLED */
+}
+#endif /* MEMP_CACHE */
+
 /**
  * Get an element from a specific pool.
  *
@@ -340,12 +470,29 @@ memp_malloc_fn(memp_t type, const char *file, const int line)
 #endif
 {
   void *memp;
+#if MEMP_CACHE_ENABLED
+  struct memp_cache *cache;
+  u16_t batch;
+#endif
   LWIP_ERROR("memp_malloc: type < MEMP_MAX", (type < MEMP_MAX), return NULL;);
 
 #if MEMP_OVERFLOW_CHECK >= 2
   memp_overflow_check_all();
 #endif /* MEMP_OVERFLOW_CHECK >= 2 */
 
+#if MEMP_CACHE_ENABLED
+  cache = LWIP_HOOK_MEMP_CACHE();
+  if (cache != NULL) {
+    batch = memp_cache_batch(memp_pools[type]);
+    if (batch > 0) {
+      if ((cache->num[type] == 0) && (memp_cache_refill(cache, type, batch) == 0)) {
+        return NULL;
+      }
+      return cache->elems[type][--cache->num[type]];
+    }
+  }
+#endif /* MEMP_CACHE_ENABLED */
+
 #if !MEMP_OVERFLOW_CHECK
   memp = do_memp_malloc_pool(memp_pools[type]);
 #else
@@ -422,6 +569,10 @@ memp_free(memp_t type, void *mem)
 #ifdef LWIP_HOOK_MEMP_AVAILABLE
   struct memp *old_first;
 #endif
+#if MEMP_CACHE_ENABLED
+  struct memp_cache *cache;
+  u16_t batch;
+#endif
 
   LWIP_ERROR("memp_free: type < MEMP_MAX", (type < MEMP_MAX), return;);
 
@@ -433,6 +584,22 @@ memp_free(memp_t type, void *mem)
   memp_overflow_check_all();
 #endif /* MEMP_OVERFLOW_CHECK >= 2 */
 
+#if MEMP_CACHE_ENABLED
+  cache = LWIP_HOOK_MEMP_CACHE();
+  if (cache != NULL) {
+    batch = memp_cache_batch(memp_pools[type]);
+    if (batch > 0) {
+      LWIP_ASSERT("memp_free: mem properly aligned",
+                  ((mem_ptr_t)mem % MEM_ALIGNMENT) == 0);
+      if (cache->num[type] >= 2 * batch) {
+        memp_cache_drain(cache, type, batch);
+      }
+      cache->elems[type][cache->num[type]++] = mem;
+      return;
+    }
+  }
+#endif /* MEMP_CACHE_ENABLED */
+
 #ifdef LWIP_HOOK_MEMP_AVAILABLE
   old_first = *memp_pools[type]->tab;
 #endif
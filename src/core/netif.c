@@ -66,6 +66,8 @@
 #include "lwip/stats.h"
 #include "lwip/sys.h"
 #include "lwip/ip.h"
+#include "lwip/ip4_fib.h"
+#include "lwip/gro.h"
 #if ENABLE_LOOPBACK
 #if LWIP_NETIF_LOOPBACK_MULTITHREADING
 #include "lwip/tcpip.h"
@@ -496,6 +498,7 @@ netif_do_set_ipaddr(struct netif *netif, const ip4_addr_t *ipaddr, ip_addr_t *ol
     /* set new IP address to netif */
     ip4_addr_set(ip_2_ip4(&netif->ip_addr), ipaddr);
     IP_SET_TYPE_VAL(netif->ip_addr, IPADDR_TYPE_V4);
+    IP4_FIB_CACHE_FLUSH();
     mib2_add_ip4(netif);
     mib2_add_route_ip4(0, netif);
 
@@ -555,6 +558,7 @@ netif_do_set_netmask(struct netif *netif, const ip4_addr_t *netmask, ip_addr_t *
     /* set new netmask to netif */
     ip4_addr_set(ip_2_ip4(&netif->netmask), netmask);
     IP_SET_TYPE_VAL(netif->netmask, IPADDR_TYPE_V4);
+    IP4_FIB_CACHE_FLUSH();
     mib2_add_route_ip4(0, netif);
     LWIP_DEBUGF(NETIF_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_STATE, ("netif: netmask of interface %c%c set to %"U16_F".%"U16_F".%"U16_F".%"U16_F"\n",
                 netif->name[0], netif->name[1],
@@ -618,6 +622,7 @@ netif_do_set_gw(struct netif *netif, const ip4_addr_t *gw, ip_addr_t *old_gw)
 
     ip4_addr_set(ip_2_ip4(&netif->gw), gw);
     IP_SET_TYPE_VAL(netif->gw, IPADDR_TYPE_V4);
+    IP4_FIB_CACHE_FLUSH();
     LWIP_DEBUGF(NETIF_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_STATE, ("netif: GW address of interface %c%c set to %"U16_F".%"U16_F".%"U16_F".%"U16_F"\n",
                 netif->name[0], netif->name[1],
                 ip4_addr1_16(netif_ip4_gw(netif)),
@@ -786,6 +791,11 @@ netif_remove(struct netif *netif)
     igmp_stop(netif);
   }
 #endif /* LWIP_IGMP */
+
+#if LWIP_GRO
+  /* drop packets held for coalescing */
+  gro_netif_remove(netif);
+#endif /* LWIP_GRO */
 #endif /* LWIP_IPV4*/
 
 #if LWIP_IPV6
@@ -829,6 +839,10 @@ netif_remove(struct netif *netif)
     }
   }
 #endif /* !LWIP_SINGLE_NETIF */
+#if LWIP_IPV4 && LWIP_IPV4_FIB
+  /* delete the routes via this netif */
+  ip4_fib_netif_removed(netif);
+#endif /* LWIP_IPV4 && LWIP_IPV4_FIB */
   mib2_netif_removed(netif);
 #if LWIP_NETIF_REMOVE_CALLBACK
   if (netif->remove_callback) {
@@ -876,6 +890,7 @@ netif_set_up(struct netif *netif)
 
   if (!(netif->flags & NETIF_FLAG_UP)) {
     netif_set_flags(netif, NETIF_FLAG_UP);
+    IP4_FIB_CACHE_FLUSH();
 
     MIB2_COPY_SYSUPTIME_TO(&netif->ts);
 
@@ -962,6 +977,7 @@ netif_set_down(struct netif *netif)
 #endif
 
     netif_clear_flags(netif, NETIF_FLAG_UP);
+    IP4_FIB_CACHE_FLUSH();
     MIB2_COPY_SYSUPTIME_TO(&netif->ts);
 
 #if LWIP_IPV4 && LWIP_ARP
@@ -1023,6 +1039,7 @@ netif_set_link_up(struct netif *netif)
 
   if (!(netif->flags & NETIF_FLAG_LINK_UP)) {
     netif_set_flags(netif, NETIF_FLAG_LINK_UP);
+    IP4_FIB_CACHE_FLUSH();
 
 #if LWIP_DHCP
     dhcp_network_changed_link_up(netif);
@@ -1061,6 +1078,7 @@ netif_set_link_down(struct netif *netif)
 
   if (netif->flags & NETIF_FLAG_LINK_UP) {
     netif_clear_flags(netif, NETIF_FLAG_LINK_UP);
+    IP4_FIB_CACHE_FLUSH();
 
 #if LWIP_AUTOIP
     autoip_network_changed_link_down(netif);
@@ -174,6 +174,222 @@ pbuf_pool_is_empty(void)
 }
 #endif /* !LWIP_TCP || !TCP_QUEUE_OOSEQ || !PBUF_POOL_FREE_OOSEQ */
 
+#if PBUF_POOL_TELEMETRY
+static struct pbuf_pool_telemetry pbuf_pool_tm;
+static u32_t pbuf_pool_tm_window_start;
+/** time when the pool last fell to the low watermark */
+static u32_t pbuf_pool_tm_low_since;
+static u16_t pbuf_pool_low_watermark = PBUF_POOL_LOW_WATERMARK;
+static u16_t pbuf_pool_high_watermark = PBUF_POOL_HIGH_WATERMARK;
+/** 1 between reaching the low and the high watermark */
+static u8_t pbuf_pool_low;
+static pbuf_pool_watermark_fn pbuf_pool_watermark_cb;
+static void *pbuf_pool_watermark_arg;
+
+#define PBUF_POOL_TM_FREE() ((pbuf_pool_tm.used < PBUF_POOL_SIZE) ? \
+                             (u16_t)(PBUF_POOL_SIZE - pbuf_pool_tm.used) : 0)
+
+/* Move on to the current time window. Must be called with SYS_ARCH_PROTECT held. */
+static void
+pbuf_pool_tm_windows(u32_t now)
+{
+  u32_t elapsed = now - pbuf_pool_tm_window_start;
+  if (elapsed >= PBUF_POOL_TELEMETRY_WINDOW) {
+    u32_t windows = elapsed / PBUF_POOL_TELEMETRY_WINDOW;
+    u32_t shift = LWIP_MIN(windows, PBUF_POOL_TELEMETRY_WINDOWS);
+    u32_t i;
+    for (i = PBUF_POOL_TELEMETRY_WINDOWS; i > shift; i--) {
+      pbuf_pool_tm.window_max[i - 1] = pbuf_pool_tm.window_max[i - 1 - shift];
+    }
+    /* windows without allocations had the current use all the time */
+    for (i = 0; i < shift; i++) {
+      pbuf_pool_tm.window_max[i] = pbuf_pool_tm.used;
+    }
+    pbuf_pool_tm_window_start += windows * PBUF_POOL_TELEMETRY_WINDOW;
+  }
+}
+
+/* Account for a pbuf allocated from PBUF_POOL */
+static void
+pbuf_pool_tm_alloced(void)
+{
+  pbuf_pool_watermark_fn cb = NULL;
+  void *cb_arg = NULL;
+  u16_t free_pbufs;
+  u32_t now = sys_now();
+  SYS_ARCH_DECL_PROTECT(old_level);
+
+  SYS_ARCH_PROTECT(old_level);
+  pbuf_pool_tm_windows(now);
+  pbuf_pool_tm.used++;
+  if (pbuf_pool_tm.used > pbuf_pool_tm.max_used) {
+    pbuf_pool_tm.max_used = pbuf_pool_tm.used;
+  }
+  if (pbuf_pool_tm.used > pbuf_pool_tm.window_max[0]) {
+    pbuf_pool_tm.window_max[0] = pbuf_pool_tm.used;
+  }
+  free_pbufs = PBUF_POOL_TM_FREE();
+  if (!pbuf_pool_low && (free_pbufs <= pbuf_pool_low_watermark)) {
+    pbuf_pool_low = 1;
+    pbuf_pool_tm_low_since = now;
+    cb = pbuf_pool_watermark_cb;
+    cb_arg = pbuf_pool_watermark_arg;
+  }
+  if (free_pbufs == 0) {
+    u32_t tte = now - pbuf_pool_tm_low_since;
+    pbuf_pool_tm.exhausted++;
+    pbuf_pool_tm.time_to_exhaustion_last = tte;
+    if ((pbuf_pool_tm.exhausted == 1) || (tte < pbuf_pool_tm.time_to_exhaustion_min)) {
+      pbuf_pool_tm.time_to_exhaustion_min = tte;
+    }
+  }
+  SYS_ARCH_UNPROTECT(old_level);
+
+  if (cb != NULL) {
+    cb(PBUF_POOL_WATERMARK_LOW, free_pbufs, cb_arg);
+  }
+}
+
+/* Account for a pbuf returned to PBUF_POOL */
+static void
+pbuf_pool_tm_freed(void)
+{
+  pbuf_pool_watermark_fn cb = NULL;
+  void *cb_arg = NULL;
+  u16_t free_pbufs;
+  u32_t now = sys_now();
+  SYS_ARCH_DECL_PROTECT(old_level);
+
+  SYS_ARCH_PROTECT(old_level);
+  pbuf_pool_tm_windows(now);
+  LWIP_ASSERT("pbuf_pool_tm.used > 0", pbuf_pool_tm.used > 0);
+  pbuf_pool_tm.used--;
+  free_pbufs = PBUF_POOL_TM_FREE();
+  if (pbuf_pool_low && (free_pbufs >= pbuf_pool_high_watermark)) {
+    pbuf_pool_low = 0;
+    cb = pbuf_pool_watermark_cb;
+    cb_arg = pbuf_pool_watermark_arg;
+  }
+  SYS_ARCH_UNPROTECT(old_level);
+
+  if (cb != NULL) {
+    cb(PBUF_POOL_WATERMARK_HIGH, free_pbufs, cb_arg);
+  }
+}
+
+/* Count a failed PBUF_POOL allocation for 'layer' */
+static void
+pbuf_pool_tm_failed(pbuf_layer layer)
+{
+  pbuf_pool_layer idx;
+  SYS_ARCH_DECL_PROTECT(old_level);
+
+  /* PBUF_RAW_TX equals PBUF_RAW without link encapsulation, count it as RX then */
+  if (layer == PBUF_TRANSPORT) {
+    idx = PBUF_POOL_LAYER_TRANSPORT;
+  } else if (layer == PBUF_IP) {
+    idx = PBUF_POOL_LAYER_IP;
+  } else if (layer == PBUF_LINK) {
+    idx = PBUF_POOL_LAYER_LINK;
+  } else if (layer == PBUF_RAW) {
+    idx = PBUF_POOL_LAYER_RAW;
+  } else if (layer == PBUF_RAW_TX) {
+    idx = PBUF_POOL_LAYER_RAW_TX;
+  } else {
+    idx = PBUF_POOL_LAYER_OTHER;
+  }
+  SYS_ARCH_PROTECT(old_level);
+  pbuf_pool_tm.alloc_fail[idx]++;
+  SYS_ARCH_UNPROTECT(old_level);
+}
+
+/**
+ * @ingroup pbuf
+ * Get a snapshot of the PBUF_POOL telemetry.
+ *
+ * @param telemetry where to store the snapshot
+ */
+void
+pbuf_pool_telemetry_get(struct pbuf_pool_telemetry *telemetry)
+{
+  u32_t now = sys_now();
+  SYS_ARCH_DECL_PROTECT(old_level);
+
+  LWIP_ASSERT("telemetry != NULL", telemetry != NULL);
+
+  SYS_ARCH_PROTECT(old_level);
+  pbuf_pool_tm_windows(now);
+  *telemetry = pbuf_pool_tm;
+  SYS_ARCH_UNPROTECT(old_level);
+}
+
+/**
+ * @ingroup pbuf
+ * Reset the PBUF_POOL telemetry. The high-water marks start again at the
+ * number of pbufs currently allocated.
+ */
+void
+pbuf_pool_telemetry_reset(void)
+{
+  u16_t used;
+  u32_t i, now = sys_now();
+  SYS_ARCH_DECL_PROTECT(old_level);
+
+  SYS_ARCH_PROTECT(old_level);
+  used = pbuf_pool_tm.used;
+  memset(&pbuf_pool_tm, 0, sizeof(pbuf_pool_tm));
+  pbuf_pool_tm.used = used;
+  pbuf_pool_tm.max_used = used;
+  for (i = 0; i < PBUF_POOL_TELEMETRY_WINDOWS; i++) {
+    pbuf_pool_tm.window_max[i] = used;
+  }
+  pbuf_pool_tm_window_start = now;
+  SYS_ARCH_UNPROTECT(old_level);
+}
+
+/**
+ * @ingroup pbuf
+ * Set the PBUF_POOL watermarks and the function called when they are crossed:
+ * with PBUF_POOL_WATERMARK_LOW when the number of free pbufs falls to 'low',
+ * then with PBUF_POOL_WATERMARK_HIGH when it rises to 'high' again.
+ * This can be used to apply back-pressure before pbufs run out, and to adapt
+ * the watermarks at runtime based on the telemetry.
+ *
+ * @param low number of free pbufs at or below which the pool is low
+ * @param high number of free pbufs at or above which the pool has recovered
+ * @param fn function to call on crossing a watermark (may be NULL)
+ * @param arg argument passed to fn
+ * @return ERR_OK or ERR_VAL if the watermarks are invalid
+ */
+err_t
+pbuf_pool_set_watermarks(u16_t low, u16_t high, pbuf_pool_watermark_fn fn, void *arg)
+{
+  SYS_ARCH_DECL_PROTECT(old_level);
+
+  LWIP_ERROR("pbuf_pool_set_watermarks: invalid watermarks", (low < high) && (high <= PBUF_POOL_SIZE),
+             return ERR_VAL;);
+
+  SYS_ARCH_PROTECT(old_level);
+  pbuf_pool_low_watermark = low;
+  pbuf_pool_high_watermark = high;
+  pbuf_pool_watermark_cb = fn;
+  pbuf_pool_watermark_arg = arg;
+  if (pbuf_pool_low && (PBUF_POOL_TM_FREE() >= high)) {
+    pbuf_pool_low = 0;
+  }
+  SYS_ARCH_UNPROTECT(old_level);
+  return ERR_OK;
+}
+
+#define PBUF_POOL_TM_ALLOCED()     pbuf_pool_tm_alloced()
+#define PBUF_POOL_TM_FREED()       pbuf_pool_tm_freed()
+#define PBUF_POOL_TM_FAILED(layer) pbuf_pool_tm_failed(layer)
+#else /* PBUF_POOL_TELEMETRY */
+#define PBUF_POOL_TM_ALLOCED()
+#define PBUF_POOL_TM_FREED()
+#define PBUF_POOL_TM_FAILED(layer)
+#endif /* PBUF_POOL_TELEMETRY */
+
 /* Initialize members of struct pbuf after allocation */
 static void
 pbuf_init_alloced_pbuf(struct pbuf *p, void *payload, u16_t tot_len, u16_t len, pbuf_type type, u8_t flags)
@@ -186,6 +402,9 @@ pbuf_init_alloced_pbuf(struct pbuf *p, void *payload, u16_t tot_len, u16_t len,
   p->flags = flags;
   p->ref = 1;
   p->if_idx = NETIF_NO_INDEX;
+#if LWIP_NETIF_TSO
+  p->gso_size = 0;
+#endif /* LWIP_NETIF_TSO */
 }
 
 /**
@@ -242,6 +461,7 @@ pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type)
         u16_t qlen;
         q = (struct pbuf *)memp_malloc(MEMP_PBUF_POOL);
         if (q == NULL) {
+          PBUF_POOL_TM_FAILED(layer);
           PBUF_POOL_IS_EMPTY();
           /* free chain so far allocated */
           if (p) {
@@ -250,6 +470,7 @@ pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type)
           /* bail out unsuccessfully */
           return NULL;
         }
+        PBUF_POOL_TM_ALLOCED();
         qlen = LWIP_MIN(rem_len, (u16_t)(PBUF_POOL_BUFSIZE_ALIGNED - LWIP_MEM_ALIGN_SIZE(offset)));
         pbuf_init_alloced_pbuf(q, LWIP_MEM_ALIGN((void *)((u8_t *)q + SIZEOF_STRUCT_PBUF + offset)),
                                rem_len, qlen, type, 0);
@@ -382,6 +603,48 @@ pbuf_alloced_custom(pbuf_layer l, u16_t length, pbuf_type type, struct pbuf_cust
 }
 #endif /* LWIP_SUPPORT_CUSTOM_PBUF */
 
+#if LWIP_NETIF_TSO
+/** Free-callback function to free a 'struct pbuf_custom_ref' created by
+ * pbuf_alloc_tso_ref(), called by pbuf_free. */
+static void
+pbuf_free_tso_ref(struct pbuf *p)
+{
+  struct pbuf_custom_ref *pcr = (struct pbuf_custom_ref *)p;
+  LWIP_ASSERT("pcr != NULL", pcr != NULL);
+  LWIP_ASSERT("pcr == p", (void *)pcr == (void *)p);
+  pbuf_free(pcr->original);
+  memp_free(MEMP_TSO_PBUF_REF, pcr);
+}
+
+/**
+ * @ingroup pbuf
+ * Allocate a PBUF_REF for 'len' bytes at 'payload' in the pbuf chain
+ * 'original'. It holds a reference on 'original' until it is freed, so the
+ * data stays valid while a netif driver still queues it. TCP passes the
+ * first pbuf of a segment, so that tcp_output_segment_busy() sees the
+ * reference.
+ * Used for TSO super-segments and the packets software GSO splits them into
+ * (see LWIP_NETIF_TSO).
+ *
+ * @return the new pbuf or NULL if out of memory
+ */
+struct pbuf *
+pbuf_alloc_tso_ref(struct pbuf *original, void *payload, u16_t len)
+{
+  struct pbuf *p;
+  struct pbuf_custom_ref *pcr = (struct pbuf_custom_ref *)memp_malloc(MEMP_TSO_PBUF_REF);
+  if (pcr == NULL) {
+    return NULL;
+  }
+  p = pbuf_alloced_custom(PBUF_RAW, len, PBUF_REF, &pcr->pc, payload, len);
+  LWIP_ASSERT("pbuf_alloc_tso_ref: pbuf_alloced_custom failed", p != NULL);
+  pbuf_ref(original);
+  pcr->original = original;
+  pcr->pc.custom_free_function = pbuf_free_tso_ref;
+  return p;
+}
+#endif /* LWIP_NETIF_TSO */
+
 /**
  * @ingroup pbuf
  * Shrink a pbuf chain to a desired length.
@@ -774,6 +1037,7 @@ pbuf_free(struct pbuf *p)
         /* is this a pbuf from the pool? */
         if (alloc_src == PBUF_TYPE_ALLOC_SRC_MASK_STD_MEMP_PBUF_POOL) {
           memp_free(MEMP_PBUF_POOL, p);
+          PBUF_POOL_TM_FREED();
           /* is this a ROM or RAM referencing pbuf? */
         } else if (alloc_src == PBUF_TYPE_ALLOC_SRC_MASK_STD_MEMP_PBUF) {
           memp_free(MEMP_PBUF, p);
@@ -1345,6 +1609,9 @@ pbuf_clone(pbuf_layer layer, pbuf_type type, struct pbuf *p)
   err = pbuf_copy(q, p);
   LWIP_UNUSED_ARG(err); /* in case of LWIP_NOASSERT */
   LWIP_ASSERT("pbuf_copy failed", err == ERR_OK);
+#if LWIP_NETIF_TSO
+  q->gso_size = p->gso_size;
+#endif /* LWIP_NETIF_TSO */
   return q;
 }
 
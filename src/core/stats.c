@@ -139,6 +139,17 @@ stats_display_sys(struct stats_sys *sys)
 }
 #endif /* SYS_STATS */
 
+#if GRO_STATS
+void
+stats_display_gro(struct stats_gro *gro)
+{
+  LWIP_PLATFORM_DIAG(("\nGRO\n\t"));
+  LWIP_PLATFORM_DIAG(("recv: %"STAT_COUNTER_F"\n\t", gro->recv));
+  LWIP_PLATFORM_DIAG(("merged: %"STAT_COUNTER_F"\n\t", gro->merged));
+  LWIP_PLATFORM_DIAG(("flush: %"STAT_COUNTER_F"\n", gro->flush));
+}
+#endif /* GRO_STATS */
+
 void
 stats_display(void)
 {
@@ -157,6 +168,7 @@ stats_display(void)
   ICMP6_STATS_DISPLAY();
   UDP_STATS_DISPLAY();
   TCP_STATS_DISPLAY();
+  GRO_STATS_DISPLAY();
   MEM_STATS_DISPLAY();
   for (i = 0; i < MEMP_MAX; i++) {
     MEMP_STATS_DISPLAY(i);
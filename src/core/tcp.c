@@ -158,8 +158,10 @@ static const char *const tcp_state_str[] = {
 /* last local TCP port */
 static u16_t tcp_port = TCP_LOCAL_PORT_RANGE_START;
 
+#if !LWIP_TCP_PCB_TIMERS
 /* Incremented every coarse grained timer shot (typically every 500 ms). */
 u32_t tcp_ticks;
+#endif /* !LWIP_TCP_PCB_TIMERS */
 static const u8_t tcp_backoff[13] =
 { 1, 2, 3, 4, 5, 6, 7, 7, 7, 7, 7, 7, 7};
 /* Times per slowtmr hits */
@@ -182,14 +184,27 @@ struct tcp_pcb **const tcp_pcb_lists[] = {&tcp_listen_pcbs.pcbs, &tcp_bound_pcbs
          &tcp_active_pcbs, &tcp_tw_pcbs
 };
 
+#if LWIP_TCP_PCB_HASH
+/** Hash tables mirroring tcp_active_pcbs, tcp_tw_pcbs and tcp_listen_pcbs,
+ * chained through pcb->hash_next */
+static struct tcp_pcb *tcp_active_pcbs_hash[TCP_PCB_HASH_SIZE];
+static struct tcp_pcb *tcp_tw_pcbs_hash[TCP_PCB_HASH_SIZE];
+static struct tcp_pcb *tcp_listen_pcbs_hash[TCP_LISTEN_PCB_HASH_SIZE];
+#endif /* LWIP_TCP_PCB_HASH */
+
 u8_t tcp_active_pcbs_changed;
 
+#if !LWIP_TCP_PCB_TIMERS
 /** Timer counter to handle calling slow-timer from tcp_tmr() */
 static u8_t tcp_timer;
+#endif /* !LWIP_TCP_PCB_TIMERS */
 static u8_t tcp_timer_ctr;
 static u16_t tcp_new_port(void);
 
 static err_t tcp_close_shutdown_fin(struct tcp_pcb *pcb);
+#if LWIP_TCP_PCB_TIMERS
+static void tcp_timers_arm(struct tcp_pcb *pcb, u8_t expired);
+#endif /* LWIP_TCP_PCB_TIMERS */
 #if LWIP_TCP_PCB_NUM_EXT_ARGS
 static void tcp_ext_arg_invoke_callbacks_destroyed(struct tcp_pcb_ext_args *ext_args);
 #endif
@@ -205,11 +220,28 @@ tcp_init(void)
 #endif /* LWIP_RAND */
 }
 
+/**
+ * Current time of the TCP timers, the time base of pcb->tmr and pcb->rttest:
+ * milliseconds (sys_now()) with LWIP_TCP_PCB_TIMERS, else tcp_slowtmr() ticks.
+ */
+u32_t
+tcp_now(void)
+{
+#if LWIP_TCP_PCB_TIMERS
+  return sys_now();
+#else /* LWIP_TCP_PCB_TIMERS */
+  return tcp_ticks;
+#endif /* LWIP_TCP_PCB_TIMERS */
+}
+
 /** Free a tcp pcb */
 void
 tcp_free(struct tcp_pcb *pcb)
 {
   LWIP_ASSERT("tcp_free: LISTEN", pcb->state != LISTEN);
+#if LWIP_TCP_PCB_TIMERS
+  sys_timeout_stop(&pcb->timer);
+#endif /* LWIP_TCP_PCB_TIMERS */
 #if LWIP_TCP_PCB_NUM_EXT_ARGS
   tcp_ext_arg_invoke_callbacks_destroyed(pcb->ext_args);
 #endif
@@ -229,10 +261,12 @@ tcp_free_listen(struct tcp_pcb *pcb)
 
 /**
  * Called periodically to dispatch TCP timers.
+ * With LWIP_TCP_PCB_TIMERS, every pcb runs its own timer and this does nothing.
  */
 void
 tcp_tmr(void)
 {
+#if !LWIP_TCP_PCB_TIMERS
   /* Call tcp_fasttmr() every 250 ms */
   tcp_fasttmr();
 
@@ -241,6 +275,7 @@ tcp_tmr(void)
        tcp_tmr() is called. */
     tcp_slowtmr();
   }
+#endif /* !LWIP_TCP_PCB_TIMERS */
 }
 
 #if LWIP_CALLBACK_API || TCP_LISTEN_BACKLOG
@@ -400,6 +435,19 @@ tcp_close_shutdown(struct tcp_pcb *pcb, u8_t rst_on_unacked_data)
       MIB2_STATS_INC(mib2.tcpattemptfails);
       break;
     default:
+#if LWIP_TCP_TW_BUCKETS
+      if (rst_on_unacked_data) {
+        /* closing both directions: the application releases the pcb, so it
+           may be replaced by a tw-bucket once in TIME-WAIT */
+        err_t err;
+        tcp_set_flags(pcb, TF_ORPHANED);
+        err = tcp_close_shutdown_fin(pcb);
+        if (err != ERR_OK) {
+          tcp_clear_flags(pcb, TF_ORPHANED);
+        }
+        return err;
+      }
+#endif /* LWIP_TCP_TW_BUCKETS */
       return tcp_close_shutdown_fin(pcb);
   }
   return ERR_OK;
@@ -436,6 +484,17 @@ tcp_close_shutdown_fin(struct tcp_pcb *pcb)
       break;
     default:
       /* Has already been closed, do nothing. */
+#if LWIP_TCP_TW_BUCKETS
+      if ((pcb->state == TIME_WAIT) && (pcb->flags & TF_ORPHANED) &&
+          (tcp_input_pcb != pcb) && (tcp_tw_enter(pcb) == ERR_OK)) {
+        /* (but a released TIME-WAIT pcb is replaced by a tw-bucket) */
+        return ERR_OK;
+      }
+#endif /* LWIP_TCP_TW_BUCKETS */
+#if LWIP_TCP_PCB_TIMERS
+      /* (but TF_RXCLOSED may start the FIN-WAIT-2 timeout) */
+      tcp_timers_update(pcb);
+#endif /* LWIP_TCP_PCB_TIMERS */
       return ERR_OK;
   }
 
@@ -449,6 +508,9 @@ tcp_close_shutdown_fin(struct tcp_pcb *pcb)
   } else if (err == ERR_MEM) {
     /* Mark this pcb for closing. Closing is retried from tcp_tmr. */
     tcp_set_flags(pcb, TF_CLOSEPEND);
+#if LWIP_TCP_PCB_TIMERS
+    tcp_timers_update(pcb);
+#endif /* LWIP_TCP_PCB_TIMERS */
     /* We have to return ERR_OK from here to indicate to the callers that this
        pcb should not be used any more as it will be freed soon via tcp_tmr.
        This is OK here since sending FIN does not guarantee a time frime for
@@ -533,6 +595,9 @@ tcp_shutdown(struct tcp_pcb *pcb, int shut_rx, int shut_tx)
       pbuf_free(pcb->refused_data);
       pcb->refused_data = NULL;
     }
+#if LWIP_TCP_PCB_TIMERS
+    tcp_timers_update(pcb);
+#endif /* LWIP_TCP_PCB_TIMERS */
   }
   if (shut_tx) {
     /* This can't happen twice since if it succeeds, the pcb's state is changed.
@@ -735,6 +800,11 @@ tcp_bind(struct tcp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port)
         }
       }
     }
+#if LWIP_TCP_TW_BUCKETS
+    if ((max_pcb_list == NUM_TCP_PCB_LISTS) && tcp_tw_port_used(port, ipaddr)) {
+      return ERR_USE;
+    }
+#endif /* LWIP_TCP_TW_BUCKETS */
   }
 
   if (!ip_addr_isany(ipaddr)
@@ -1035,6 +1105,15 @@ again:
       }
     }
   }
+#if LWIP_TCP_TW_BUCKETS
+  if (tcp_tw_port_used(tcp_port, NULL)) {
+    n++;
+    if (n > (TCP_LOCAL_PORT_RANGE_END - TCP_LOCAL_PORT_RANGE_START)) {
+      return 0;
+    }
+    goto again;
+  }
+#endif /* LWIP_TCP_TW_BUCKETS */
   return tcp_port;
 }
 
@@ -1141,6 +1220,11 @@ tcp_connect(struct tcp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port,
           }
         }
       }
+#if LWIP_TCP_TW_BUCKETS
+      if (tcp_tw_find(pcb->local_port, &pcb->local_ip, ipaddr, port) != NULL) {
+        return ERR_USE;
+      }
+#endif /* LWIP_TCP_TW_BUCKETS */
     }
 #endif /* SO_REUSE */
   }
@@ -1185,6 +1269,80 @@ tcp_connect(struct tcp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port,
   return ret;
 }
 
+/**
+ * The persist timer expired: send a zero window probe or, if the window is
+ * not fully closed, fill it with the split head of the unsent queue.
+ *
+ * @param pcb the tcp_pcb in persist state
+ * @return 1 if the timer moved on to the next back-off slot (to be restarted),
+ *         0 if the probe has to be retried in the current slot
+ */
+static int
+tcp_persist_expired(struct tcp_pcb *pcb)
+{
+  int next_slot = 1; /* increment timer to next slot */
+  /* If snd_wnd is zero, send 1 byte probes */
+  if (pcb->snd_wnd == 0) {
+    if (tcp_zero_window_probe(pcb) != ERR_OK) {
+      next_slot = 0; /* try probe again with current slot */
+    }
+    /* snd_wnd not fully closed, split unsent head and fill window */
+  } else {
+    if (tcp_split_unsent_seg(pcb, (u16_t)pcb->snd_wnd) == ERR_OK) {
+      if (tcp_output(pcb) == ERR_OK) {
+        /* sending will cancel persist timer, else retry with current slot */
+        next_slot = 0;
+      }
+    }
+  }
+  if (next_slot) {
+    if (pcb->persist_backoff < sizeof(tcp_persist_backoff)) {
+      pcb->persist_backoff++;
+    }
+  }
+  return next_slot;
+}
+
+/**
+ * The retransmission timer expired: back off the RTO, reduce the congestion
+ * window and retransmit the unacked segments.
+ * The timer is restarted (pcb->rtime = 0) unless nothing could be sent.
+ *
+ * @param pcb the tcp_pcb whose retransmission timer expired
+ */
+static void
+tcp_rto_expired(struct tcp_pcb *pcb)
+{
+  /* If prepare phase fails but we have unsent data but no unacked data,
+     still execute the backoff calculations below, as this means we somehow
+     failed to send segment. */
+  if ((tcp_rexmit_rto_prepare(pcb) == ERR_OK) || ((pcb->unacked == NULL) && (pcb->unsent != NULL))) {
+    /* Double retransmission time-out unless we are trying to
+     * connect to somebody (i.e., we are in SYN_SENT). */
+    if (pcb->state != SYN_SENT) {
+      u8_t backoff_idx = LWIP_MIN(pcb->nrtx, sizeof(tcp_backoff) - 1);
+      s32_t calc_rto = (s32_t)TCP_RTO_CALC(pcb) << tcp_backoff[backoff_idx];
+      pcb->rto = (tcprto_t)LWIP_MIN(calc_rto, TCP_RTO_MAX);
+    }
+
+    /* Reset the retransmission timer. */
+    pcb->rtime = 0;
+
+    /* Reduce congestion window and ssthresh. */
+    TCP_CC_RTO(pcb);
+    pcb->cwnd = pcb->mss;
+    LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_rto_expired: cwnd %"TCPWNDSIZE_F
+                                 " ssthresh %"TCPWNDSIZE_F"\n",
+                                 pcb->cwnd, pcb->ssthresh));
+    pcb->bytes_acked = 0;
+
+    /* The following needs to be called AFTER cwnd is set to one
+       mss - STJ */
+    tcp_rexmit_rto_commit(pcb);
+  }
+}
+
+#if !LWIP_TCP_PCB_TIMERS
 /**
  * Called every 500 ms and implements the retransmission timer and the timer that
  * removes PCBs that have been in TIME-WAIT for enough time. It also increments
@@ -1196,7 +1354,6 @@ void
 tcp_slowtmr(void)
 {
   struct tcp_pcb *pcb, *prev;
-  tcpwnd_size_t eff_wnd;
   u8_t pcb_remove;      /* flag if a PCB should be removed */
   u8_t pcb_reset;       /* flag if a RST should be sent when removing */
   err_t err;
@@ -1247,26 +1404,8 @@ tcp_slowtmr_start:
             pcb->persist_cnt++;
           }
           if (pcb->persist_cnt >= backoff_cnt) {
-            int next_slot = 1; /* increment timer to next slot */
-            /* If snd_wnd is zero, send 1 byte probes */
-            if (pcb->snd_wnd == 0) {
-              if (tcp_zero_window_probe(pcb) != ERR_OK) {
-                next_slot = 0; /* try probe again with current slot */
-              }
-              /* snd_wnd not fully closed, split unsent head and fill window */
-            } else {
-              if (tcp_split_unsent_seg(pcb, (u16_t)pcb->snd_wnd) == ERR_OK) {
-                if (tcp_output(pcb) == ERR_OK) {
-                  /* sending will cancel persist timer, else retry with current slot */
-                  next_slot = 0;
-                }
-              }
-            }
-            if (next_slot) {
+            if (tcp_persist_expired(pcb)) {
               pcb->persist_cnt = 0;
-              if (pcb->persist_backoff < sizeof(tcp_persist_backoff)) {
-                pcb->persist_backoff++;
-              }
             }
           }
         }
@@ -1281,37 +1420,7 @@ tcp_slowtmr_start:
           LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_slowtmr: rtime %"S16_F
                                       " pcb->rto %"S16_F"\n",
                                       pcb->rtime, pcb->rto));
-          /* If prepare phase fails but we have unsent data but no unacked data,
-             still execute the backoff calculations below, as this means we somehow
-             failed to send segment. */
-          if ((tcp_rexmit_rto_prepare(pcb) == ERR_OK) || ((pcb->unacked == NULL) && (pcb->unsent != NULL))) {
-            /* Double retransmission time-out unless we are trying to
-             * connect to somebody (i.e., we are in SYN_SENT). */
-            if (pcb->state != SYN_SENT) {
-              u8_t backoff_idx = LWIP_MIN(pcb->nrtx, sizeof(tcp_backoff) - 1);
-              int calc_rto = ((pcb->sa >> 3) + pcb->sv) << tcp_backoff[backoff_idx];
-              pcb->rto = (s16_t)LWIP_MIN(calc_rto, 0x7FFF);
-            }
-
-            /* Reset the retransmission timer. */
-            pcb->rtime = 0;
-
-            /* Reduce congestion window and ssthresh. */
-            eff_wnd = LWIP_MIN(pcb->cwnd, pcb->snd_wnd);
-            pcb->ssthresh = eff_wnd >> 1;
-            if (pcb->ssthresh < (tcpwnd_size_t)(pcb->mss << 1)) {
-              pcb->ssthresh = (tcpwnd_size_t)(pcb->mss << 1);
-            }
-            pcb->cwnd = pcb->mss;
-            LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_slowtmr: cwnd %"TCPWNDSIZE_F
-                                         " ssthresh %"TCPWNDSIZE_F"\n",
-                                         pcb->cwnd, pcb->ssthresh));
-            pcb->bytes_acked = 0;
-
-            /* The following needs to be called AFTER cwnd is set to one
-               mss - STJ */
-            tcp_rexmit_rto_commit(pcb);
-          }
+          tcp_rto_expired(pcb);
         }
       }
     }
@@ -1397,6 +1506,7 @@ tcp_slowtmr_start:
         LWIP_ASSERT("tcp_slowtmr: first pcb == tcp_active_pcbs", tcp_active_pcbs == pcb);
         tcp_active_pcbs = pcb->next;
       }
+      TCP_PCB_HASH_RMV(&tcp_active_pcbs, pcb);
 
       if (pcb_reset) {
         tcp_rst(pcb, pcb->snd_nxt, pcb->rcv_nxt, &pcb->local_ip, &pcb->remote_ip,
@@ -1463,6 +1573,7 @@ tcp_slowtmr_start:
         LWIP_ASSERT("tcp_slowtmr: first pcb == tcp_tw_pcbs", tcp_tw_pcbs == pcb);
         tcp_tw_pcbs = pcb->next;
       }
+      TCP_PCB_HASH_RMV(&tcp_tw_pcbs, pcb);
       pcb2 = pcb;
       pcb = pcb->next;
       tcp_free(pcb2);
@@ -1471,6 +1582,9 @@ tcp_slowtmr_start:
       pcb = pcb->next;
     }
   }
+#if LWIP_TCP_TW_BUCKETS
+  tcp_tw_tmr();
+#endif /* LWIP_TCP_TW_BUCKETS */
 }
 
 /**
@@ -1506,6 +1620,12 @@ tcp_fasttmr_start:
         tcp_clear_flags(pcb, TF_CLOSEPEND);
         tcp_close_shutdown_fin(pcb);
       }
+#if LWIP_TCP_RACK
+      /* RACK reordering timer or tail loss probe */
+      if (pcb->rack_timer != TCP_RACK_TIMER_NONE) {
+        tcp_rack_tmr(pcb);
+      }
+#endif /* LWIP_TCP_RACK */
 
       next = pcb->next;
 
@@ -1524,6 +1644,330 @@ tcp_fasttmr_start:
     }
   }
 }
+#endif /* !LWIP_TCP_PCB_TIMERS */
+
+#if LWIP_TCP_PCB_TIMERS
+/** Check if the deadline 'when' has passed at 'now' */
+#define TCP_TIMER_EXPIRED(now, when) ((s32_t)((u32_t)(now) - (u32_t)(when)) >= 0)
+
+/** Move the deadline 'due' to 'when' if that is earlier */
+static void
+tcp_timer_due(u32_t *due, u8_t *armed, u32_t when)
+{
+  if (!*armed || ((s32_t)(when - *due) < 0)) {
+    *due = when;
+    *armed = 1;
+  }
+}
+
+/** Check if a pcb is still in tcp_active_pcbs after an application callback
+ * changed that list (the pcb may have been closed and deallocated) */
+static int
+tcp_pcb_is_active(const struct tcp_pcb *pcb)
+{
+  const struct tcp_pcb *p;
+  for (p = tcp_active_pcbs; p != NULL; p = p->next) {
+    if (p == pcb) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Timer callback of a pcb: does the work of tcp_slowtmr() and tcp_fasttmr()
+ * for this pcb for every deadline that has passed and re-arms the timer.
+ *
+ * @param arg the tcp_pcb
+ */
+static void
+tcp_pcb_timer(void *arg)
+{
+  struct tcp_pcb *pcb = (struct tcp_pcb *)arg;
+  u8_t pcb_remove = 0; /* flag if a PCB should be removed */
+  u8_t pcb_reset = 0;  /* flag if a RST should be sent when removing */
+  u32_t now = sys_now();
+  err_t err;
+
+  LWIP_ASSERT("tcp_pcb_timer: pcb->state != CLOSED", pcb->state != CLOSED);
+  LWIP_ASSERT("tcp_pcb_timer: pcb->state != LISTEN", pcb->state != LISTEN);
+
+  if (pcb->state == TIME_WAIT) {
+    /* Check if this PCB has stayed long enough in TIME-WAIT */
+    if (TCP_TIMER_EXPIRED(now, pcb->tmr + (u32_t)(2 * TCP_MSL))) {
+      tcp_pcb_purge(pcb);
+      TCP_RMV(&tcp_tw_pcbs, pcb);
+      tcp_free(pcb);
+    } else {
+      tcp_timers_arm(pcb, 1);
+    }
+    return;
+  }
+
+  if (pcb->persist_backoff > 0) {
+    u8_t backoff_cnt = tcp_persist_backoff[pcb->persist_backoff - 1];
+    LWIP_ASSERT("tcp_pcb_timer: persist ticking with in-flight data", pcb->unacked == NULL);
+    LWIP_ASSERT("tcp_pcb_timer: persist ticking with empty send buffer", pcb->unsent != NULL);
+    if ((pcb->persist_cnt != 0) &&
+        TCP_TIMER_EXPIRED(now, pcb->persist_start + (u32_t)backoff_cnt * TCP_SLOW_INTERVAL)) {
+      if (pcb->persist_probe >= TCP_MAXRTX) {
+        ++pcb_remove; /* max probes reached */
+      } else if (tcp_persist_expired(pcb)) {
+        /* restart the timer with the next back-off */
+        pcb->persist_cnt = 0;
+      }
+    }
+  } else if ((pcb->rtime > 0) && TCP_TIMER_EXPIRED(now, pcb->rto_start + (u32_t)pcb->rto)) {
+    if (pcb->state == SYN_SENT && pcb->nrtx >= TCP_SYNMAXRTX) {
+      ++pcb_remove;
+      LWIP_DEBUGF(TCP_DEBUG, ("tcp_pcb_timer: max SYN retries reached\n"));
+    } else if (pcb->nrtx >= TCP_MAXRTX) {
+      ++pcb_remove;
+      LWIP_DEBUGF(TCP_DEBUG, ("tcp_pcb_timer: max DATA retries reached\n"));
+    } else {
+      LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_pcb_timer: pcb->rto %"TCPRTO_F"\n", pcb->rto));
+      tcp_rto_expired(pcb);
+    }
+  }
+
+  /* Check if this PCB has stayed too long in FIN-WAIT-2 (unless it is there
+     because of SHUT_WR) */
+  if ((pcb->state == FIN_WAIT_2) && (pcb->flags & TF_RXCLOSED) &&
+      TCP_TIMER_EXPIRED(now, pcb->tmr + TCP_FIN_WAIT_TIMEOUT)) {
+    ++pcb_remove;
+    LWIP_DEBUGF(TCP_DEBUG, ("tcp_pcb_timer: removing pcb stuck in FIN-WAIT-2\n"));
+  }
+
+  /* Check if KEEPALIVE should be sent */
+  if (ip_get_option(pcb, SOF_KEEPALIVE) &&
+      ((pcb->state == ESTABLISHED) ||
+       (pcb->state == CLOSE_WAIT))) {
+    if (TCP_TIMER_EXPIRED(now, pcb->tmr + pcb->keep_idle + (u32_t)TCP_KEEP_DUR(pcb))) {
+      LWIP_DEBUGF(TCP_DEBUG, ("tcp_pcb_timer: KEEPALIVE timeout. Aborting connection to "));
+      ip_addr_debug_print_val(TCP_DEBUG, pcb->remote_ip);
+      LWIP_DEBUGF(TCP_DEBUG, ("\n"));
+
+      ++pcb_remove;
+      ++pcb_reset;
+    } else if (TCP_TIMER_EXPIRED(now, pcb->tmr + pcb->keep_idle +
+                                 pcb->keep_cnt_sent * (u32_t)TCP_KEEP_INTVL(pcb))) {
+      if (tcp_keepalive(pcb) == ERR_OK) {
+        pcb->keep_cnt_sent++;
+      }
+    }
+  }
+
+#if TCP_QUEUE_OOSEQ
+  /* Drop queued out of sequence data if the pcb has been inactive for too long */
+  if ((pcb->ooseq != NULL) &&
+      TCP_TIMER_EXPIRED(now, pcb->tmr + (u32_t)pcb->rto * TCP_OOSEQ_TIMEOUT)) {
+    LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_pcb_timer: dropping OOSEQ queued data\n"));
+    tcp_free_ooseq(pcb);
+  }
+#endif /* TCP_QUEUE_OOSEQ */
+
+  /* Check if this PCB has stayed too long in SYN-RCVD or LAST-ACK */
+  if ((pcb->state == SYN_RCVD) && TCP_TIMER_EXPIRED(now, pcb->tmr + TCP_SYN_RCVD_TIMEOUT)) {
+    ++pcb_remove;
+    LWIP_DEBUGF(TCP_DEBUG, ("tcp_pcb_timer: removing pcb stuck in SYN-RCVD\n"));
+  }
+  if ((pcb->state == LAST_ACK) && TCP_TIMER_EXPIRED(now, pcb->tmr + (u32_t)(2 * TCP_MSL))) {
+    ++pcb_remove;
+    LWIP_DEBUGF(TCP_DEBUG, ("tcp_pcb_timer: removing pcb stuck in LAST-ACK\n"));
+  }
+
+  if (pcb_remove) {
+#if LWIP_CALLBACK_API
+    tcp_err_fn err_fn = pcb->errf;
+#endif /* LWIP_CALLBACK_API */
+    void *err_arg = pcb->callback_arg;
+    enum tcp_state last_state = pcb->state;
+    tcp_pcb_purge(pcb);
+    TCP_RMV_ACTIVE(pcb);
+    if (pcb_reset) {
+      tcp_rst(pcb, pcb->snd_nxt, pcb->rcv_nxt, &pcb->local_ip, &pcb->remote_ip,
+              pcb->local_port, pcb->remote_port);
+    }
+    tcp_free(pcb);
+    TCP_EVENT_ERR(last_state, err_fn, err_arg, ERR_ABRT);
+    return;
+  }
+
+  /* Delayed ACK, pending FIN and data "refused" by the upper layer */
+  if (pcb->fast_running && TCP_TIMER_EXPIRED(now, pcb->fast_start + TCP_DELACK_TIMEOUT)) {
+    pcb->fast_running = 0;
+    if (pcb->flags & TF_ACK_DELAY) {
+      LWIP_DEBUGF(TCP_DEBUG, ("tcp_pcb_timer: delayed ACK\n"));
+      tcp_ack_now(pcb);
+      tcp_output(pcb);
+      tcp_clear_flags(pcb, TF_ACK_DELAY | TF_ACK_NOW);
+    }
+    if (pcb->flags & TF_CLOSEPEND) {
+      LWIP_DEBUGF(TCP_DEBUG, ("tcp_pcb_timer: pending FIN\n"));
+      tcp_clear_flags(pcb, TF_CLOSEPEND);
+      tcp_close_shutdown_fin(pcb);
+    }
+    if (pcb->refused_data != NULL) {
+      tcp_active_pcbs_changed = 0;
+      if ((tcp_process_refused_data(pcb) == ERR_ABRT) ||
+          (tcp_active_pcbs_changed && !tcp_pcb_is_active(pcb))) {
+        return;
+      }
+    }
+  }
+
+#if LWIP_TCP_RACK
+  /* RACK reordering timer or tail loss probe */
+  if ((pcb->rack_timer != TCP_RACK_TIMER_NONE) && TCP_TIMER_EXPIRED(now, pcb->rack_deadline)) {
+    tcp_rack_tmr(pcb);
+  }
+#endif /* LWIP_TCP_RACK */
+
+  /* Poll the application */
+  if ((pcb->polltmr != 0) &&
+      TCP_TIMER_EXPIRED(now, pcb->poll_start + (u32_t)LWIP_MAX(pcb->pollinterval, 1) * TCP_SLOW_INTERVAL)) {
+    pcb->polltmr = 0;
+    LWIP_DEBUGF(TCP_DEBUG, ("tcp_pcb_timer: polling application\n"));
+    tcp_active_pcbs_changed = 0;
+    TCP_EVENT_POLL(pcb, err);
+    /* if err == ERR_ABRT, 'pcb' is already deallocated */
+    if ((err == ERR_ABRT) || (tcp_active_pcbs_changed && !tcp_pcb_is_active(pcb))) {
+      return;
+    }
+    if (err == ERR_OK) {
+      tcp_output(pcb);
+    }
+  }
+
+  tcp_timers_arm(pcb, 1);
+}
+
+/**
+ * Arm the timer of a pcb to its earliest deadline or stop it if there is none.
+ * Timers that have just been (re)started (marked by rtime, persist_cnt and
+ * polltmr being 0) get their start time set to now.
+ *
+ * @param pcb the tcp_pcb to update
+ * @param expired 1 if called from the timer callback: deadlines that are still
+ *        due (because the work failed) are retried after TCP_FAST_INTERVAL
+ */
+static void
+tcp_timers_arm(struct tcp_pcb *pcb, u8_t expired)
+{
+  u32_t now = sys_now();
+  u32_t due = 0;
+  u8_t armed = 0;
+
+  if (pcb->state == TIME_WAIT) {
+    tcp_timer_due(&due, &armed, pcb->tmr + (u32_t)(2 * TCP_MSL));
+  } else if (pcb->state != CLOSED) {
+    if ((pcb->flags & (TF_ACK_DELAY | TF_CLOSEPEND)) || (pcb->refused_data != NULL)) {
+      if (!pcb->fast_running) {
+        pcb->fast_start = now;
+        pcb->fast_running = 1;
+      }
+      tcp_timer_due(&due, &armed, pcb->fast_start + TCP_DELACK_TIMEOUT);
+    } else {
+      pcb->fast_running = 0;
+    }
+#if LWIP_TCP_RACK
+    if (pcb->rack_timer != TCP_RACK_TIMER_NONE) {
+      tcp_timer_due(&due, &armed, pcb->rack_deadline);
+    }
+#endif /* LWIP_TCP_RACK */
+    if (pcb->persist_backoff > 0) {
+      if (pcb->persist_cnt == 0) {
+        pcb->persist_start = now;
+        pcb->persist_cnt = 1;
+      }
+      tcp_timer_due(&due, &armed, pcb->persist_start +
+                    (u32_t)tcp_persist_backoff[pcb->persist_backoff - 1] * TCP_SLOW_INTERVAL);
+    } else if (pcb->rtime >= 0) {
+      if (pcb->rtime == 0) {
+        pcb->rto_start = now;
+        pcb->rtime = 1;
+      }
+      tcp_timer_due(&due, &armed, pcb->rto_start + (u32_t)pcb->rto);
+    }
+    if ((pcb->state == FIN_WAIT_2) && (pcb->flags & TF_RXCLOSED)) {
+      tcp_timer_due(&due, &armed, pcb->tmr + TCP_FIN_WAIT_TIMEOUT);
+    }
+    if (ip_get_option(pcb, SOF_KEEPALIVE) &&
+        ((pcb->state == ESTABLISHED) || (pcb->state == CLOSE_WAIT))) {
+      /* next probe or, after the last one, abort */
+      tcp_timer_due(&due, &armed, pcb->tmr + pcb->keep_idle +
+                    pcb->keep_cnt_sent * (u32_t)TCP_KEEP_INTVL(pcb));
+    }
+#if TCP_QUEUE_OOSEQ
+    if (pcb->ooseq != NULL) {
+      tcp_timer_due(&due, &armed, pcb->tmr + (u32_t)pcb->rto * TCP_OOSEQ_TIMEOUT);
+    }
+#endif /* TCP_QUEUE_OOSEQ */
+    if (pcb->state == SYN_RCVD) {
+      tcp_timer_due(&due, &armed, pcb->tmr + TCP_SYN_RCVD_TIMEOUT);
+    } else if (pcb->state == LAST_ACK) {
+      tcp_timer_due(&due, &armed, pcb->tmr + (u32_t)(2 * TCP_MSL));
+    }
+    /* the poll timer also retries sending unsent data */
+#if LWIP_CALLBACK_API
+    if ((pcb->poll != NULL) || (pcb->unsent != NULL))
+#endif /* LWIP_CALLBACK_API */
+    {
+      if (pcb->polltmr == 0) {
+        pcb->poll_start = now;
+        pcb->polltmr = 1;
+      }
+      tcp_timer_due(&due, &armed, pcb->poll_start +
+                    (u32_t)LWIP_MAX(pcb->pollinterval, 1) * TCP_SLOW_INTERVAL);
+    }
+#if LWIP_CALLBACK_API
+    else {
+      pcb->polltmr = 0;
+    }
+#endif /* LWIP_CALLBACK_API */
+  }
+
+  if (!armed) {
+    /* a pending timer is left to fire: tcp_pcb_timer() finds nothing to do */
+    return;
+  }
+  if (TCP_TIMER_EXPIRED(now, due)) {
+    if (expired) {
+      due = now + TCP_FAST_INTERVAL;
+    } else {
+      due = now;
+    }
+  }
+  /* This runs on every tcp_output() and ACK, which mostly push the deadline
+     back (e.g. restarting the RTO). Moving a pending timeout costs a sorted
+     insert, so it is only moved to an earlier time: one that fires before
+     'due' finds nothing expired and re-arms the timer to the real deadline. */
+  if (!sys_timeout_pending(&pcb->timer) || !TCP_TIMER_EXPIRED(due, pcb->timer.time)) {
+    sys_timeout_start(&pcb->timer, due - now, tcp_pcb_timer, pcb);
+  }
+}
+
+/**
+ * @ingroup tcp_raw
+ * Re-arm the timer of a pcb after changing a timer related setting
+ * (e.g. SOF_KEEPALIVE, keep_idle, keep_intvl or keep_cnt) directly.
+ * The stack calls this itself when processing segments, sending and from
+ * the timer. Only available with LWIP_TCP_PCB_TIMERS.
+ *
+ * @param pcb the tcp_pcb to update
+ */
+void
+tcp_timers_update(struct tcp_pcb *pcb)
+{
+  LWIP_ASSERT_CORE_LOCKED();
+
+  LWIP_ERROR("tcp_timers_update: invalid pcb", pcb != NULL, return);
+
+  if (pcb->state != LISTEN) {
+    tcp_timers_arm(pcb, 0);
+  }
+}
+#endif /* LWIP_TCP_PCB_TIMERS */
 
 /** Call tcp_output for all active pcbs that have TF_NAGLEMEMERR set */
 void
@@ -1735,8 +2179,8 @@ tcp_kill_prio(u8_t prio)
         /* lower prio is always a kill candidate */
     if ((pcb->prio < mprio) ||
         /* longer inactivity is also a kill candidate */
-        ((pcb->prio == mprio) && ((u32_t)(tcp_ticks - pcb->tmr) >= inactivity))) {
-      inactivity = tcp_ticks - pcb->tmr;
+        ((pcb->prio == mprio) && ((u32_t)(tcp_now() - pcb->tmr) >= inactivity))) {
+      inactivity = tcp_now() - pcb->tmr;
       inactive   = pcb;
       mprio      = pcb->prio;
     }
@@ -1766,8 +2210,8 @@ tcp_kill_state(enum tcp_state state)
      CLOSING/LAST_ACK. */
   for (pcb = tcp_active_pcbs; pcb != NULL; pcb = pcb->next) {
     if (pcb->state == state) {
-      if ((u32_t)(tcp_ticks - pcb->tmr) >= inactivity) {
-        inactivity = tcp_ticks - pcb->tmr;
+      if ((u32_t)(tcp_now() - pcb->tmr) >= inactivity) {
+        inactivity = tcp_now() - pcb->tmr;
         inactive = pcb;
       }
     }
@@ -1794,8 +2238,8 @@ tcp_kill_timewait(void)
   inactive = NULL;
   /* Go through the list of TIME_WAIT pcbs and get the oldest pcb. */
   for (pcb = tcp_tw_pcbs; pcb != NULL; pcb = pcb->next) {
-    if ((u32_t)(tcp_ticks - pcb->tmr) >= inactivity) {
-      inactivity = tcp_ticks - pcb->tmr;
+    if ((u32_t)(tcp_now() - pcb->tmr) >= inactivity) {
+      inactivity = tcp_now() - pcb->tmr;
       inactive = pcb;
     }
   }
@@ -1903,11 +2347,11 @@ tcp_alloc(u8_t prio)
     pcb->mss = INITIAL_MSS;
     /* Set initial TCP's retransmission timeout to 3000 ms by default.
        This value could be configured in lwipopts */
-    pcb->rto = LWIP_TCP_RTO_TIME / TCP_SLOW_INTERVAL;
-    pcb->sv = LWIP_TCP_RTO_TIME / TCP_SLOW_INTERVAL;
+    pcb->rto = LWIP_TCP_RTO_TIME / TCP_TICK_MS;
+    pcb->sv = LWIP_TCP_RTO_TIME / TCP_TICK_MS;
     pcb->rtime = -1;
     pcb->cwnd = 1;
-    pcb->tmr = tcp_ticks;
+    pcb->tmr = tcp_now();
     pcb->last_timer = tcp_timer_ctr;
 
     /* RFC 5681 recommends setting ssthresh arbitrarily high and gives an example
@@ -1917,6 +2361,9 @@ tcp_alloc(u8_t prio)
     connection is established. To avoid these complications, we set ssthresh to the
     largest effective cwnd (amount of in-flight data) that the sender can have. */
     pcb->ssthresh = TCP_SND_BUF;
+#if LWIP_TCP_CC
+    pcb->cc_ops = TCP_CC_DEFAULT;
+#endif /* LWIP_TCP_CC */
 
 #if LWIP_CALLBACK_API
     pcb->recv = tcp_recv_null;
@@ -2124,6 +2571,9 @@ tcp_poll(struct tcp_pcb *pcb, tcp_poll_fn poll, u8_t interval)
   LWIP_UNUSED_ARG(poll);
 #endif /* LWIP_CALLBACK_API */
   pcb->pollinterval = interval;
+#if LWIP_TCP_PCB_TIMERS
+  tcp_timers_update(pcb);
+#endif /* LWIP_TCP_PCB_TIMERS */
 }
 
 /**
@@ -2208,6 +2658,12 @@ tcp_pcb_remove(struct tcp_pcb **pcblist, struct tcp_pcb *pcb)
 #endif /* TCP_QUEUE_OOSEQ */
   }
 
+#if LWIP_TCP_PCB_TIMERS
+  if (pcb->state != LISTEN) {
+    sys_timeout_stop(&pcb->timer);
+  }
+#endif /* LWIP_TCP_PCB_TIMERS */
+
   pcb->state = CLOSED;
   /* reset the local port to prevent the pcb from being 'bound' */
   pcb->local_port = 0;
@@ -2215,6 +2671,108 @@ tcp_pcb_remove(struct tcp_pcb **pcblist, struct tcp_pcb *pcb)
   LWIP_ASSERT("tcp_pcb_remove: tcp_pcbs_sane()", tcp_pcbs_sane());
 }
 
+#if LWIP_TCP_PCB_HASH
+/** Get the hash bucket a pcb with the given ports and remote address belongs
+ * to in the hash table mirroring 'pcbs'.
+ * Returns NULL for lists that are not hashed (tcp_bound_pcbs).
+ */
+static struct tcp_pcb **
+tcp_pcb_hash_slot(struct tcp_pcb **pcbs, u16_t local_port,
+                  const ip_addr_t *remote_ip, u16_t remote_port)
+{
+  u32_t h;
+
+  if (pcbs == &tcp_listen_pcbs.pcbs) {
+    h = (u32_t)local_port ^ ((u32_t)local_port >> 8);
+    return &tcp_listen_pcbs_hash[h & (TCP_LISTEN_PCB_HASH_SIZE - 1)];
+  }
+  if ((pcbs != &tcp_active_pcbs) && (pcbs != &tcp_tw_pcbs)) {
+    return NULL;
+  }
+
+  h = ((u32_t)local_port << 16) | remote_port;
+#if LWIP_IPV6
+  if (IP_IS_V6(remote_ip)) {
+    const u32_t *addr = ip_2_ip6(remote_ip)->addr;
+    h ^= addr[0] ^ addr[1] ^ addr[2] ^ addr[3];
+  }
+#endif /* LWIP_IPV6 */
+#if LWIP_IPV4
+  if (IP_IS_V4(remote_ip)) {
+    h ^= ip4_addr_get_u32(ip_2_ip4(remote_ip));
+  }
+#endif /* LWIP_IPV4 */
+  /* mix all bits into the low bits used as index */
+  h ^= h >> 16;
+  h *= 0x45d9f3bUL;
+  h ^= h >> 16;
+  h &= TCP_PCB_HASH_SIZE - 1;
+
+  return (pcbs == &tcp_active_pcbs) ? &tcp_active_pcbs_hash[h] : &tcp_tw_pcbs_hash[h];
+}
+
+/**
+ * Insert a pcb into the hash table mirroring a pcb list.
+ * Called from TCP_REG after the pcb has been added to 'pcbs'.
+ *
+ * @param pcbs the pcb list the pcb has been added to
+ * @param pcb the pcb to insert
+ */
+void
+tcp_pcb_hash_add(struct tcp_pcb **pcbs, struct tcp_pcb *pcb)
+{
+  struct tcp_pcb **slot = tcp_pcb_hash_slot(pcbs, pcb->local_port, &pcb->remote_ip, pcb->remote_port);
+  if (slot != NULL) {
+    pcb->hash_next = *slot;
+    *slot = pcb;
+  }
+}
+
+/**
+ * Remove a pcb from the hash table mirroring a pcb list.
+ * Called from TCP_RMV; the pcb's ports and addresses must not have been
+ * changed since it was inserted.
+ *
+ * @param pcbs the pcb list the pcb has been removed from
+ * @param pcb the pcb to remove
+ */
+void
+tcp_pcb_hash_remove(struct tcp_pcb **pcbs, struct tcp_pcb *pcb)
+{
+  struct tcp_pcb **slot = tcp_pcb_hash_slot(pcbs, pcb->local_port, &pcb->remote_ip, pcb->remote_port);
+  if (slot != NULL) {
+    for (; *slot != NULL; slot = &(*slot)->hash_next) {
+      if (*slot == pcb) {
+        *slot = pcb->hash_next;
+        break;
+      }
+    }
+  }
+  pcb->hash_next = NULL;
+}
+
+/**
+ * Get the first pcb of the hash bucket that may contain the pcb matching the
+ * given ports and remote address. The bucket is walked via pcb->hash_next and
+ * may contain pcbs that do not match: callers must still compare all fields.
+ * For tcp_listen_pcbs, remote_ip and remote_port are ignored.
+ *
+ * @param pcbs the pcb list to search (tcp_active_pcbs, tcp_tw_pcbs or tcp_listen_pcbs)
+ * @param local_port local port in host byte order
+ * @param remote_ip remote IP address
+ * @param remote_port remote port in host byte order
+ * @return the first pcb in the bucket (may be NULL)
+ */
+struct tcp_pcb *
+tcp_pcb_hash_bucket(struct tcp_pcb **pcbs, u16_t local_port,
+                    const ip_addr_t *remote_ip, u16_t remote_port)
+{
+  struct tcp_pcb **slot = tcp_pcb_hash_slot(pcbs, local_port, remote_ip, remote_port);
+  LWIP_ASSERT("tcp_pcb_hash_bucket: list not hashed", slot != NULL);
+  return *slot;
+}
+#endif /* LWIP_TCP_PCB_HASH */
+
 /**
  * Calculates a new initial sequence number for new connections.
  *
@@ -2232,7 +2790,7 @@ tcp_next_iss(struct tcp_pcb *pcb)
   LWIP_ASSERT("tcp_next_iss: invalid pcb", pcb != NULL);
   LWIP_UNUSED_ARG(pcb);
 
-  iss += tcp_ticks;       /* XXX */
+  iss += tcp_now();       /* XXX */
   return iss;
 #endif /* LWIP_HOOK_TCP_ISN */
 }
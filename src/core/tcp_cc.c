@@ -0,0 +1,333 @@
+/**
+ * @file
+ * Transmission Control Protocol, congestion control
+ *
+ * The congestion control algorithms that update cwnd and ssthresh:
+ * - NewReno (RFC 5681 with RFC 3465 byte counting), always built
+ * - CUBIC (RFC 9438), built with LWIP_TCP_CC_CUBIC
+ *
+ * With LWIP_TCP_CC, every pcb references a struct tcp_cc_ops that can be
+ * changed with @ref tcp_set_cc. Otherwise NewReno is called directly.
+ */
+
+/*
+ * Copyright (c) 2001-2004 Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ *
+ */
+
+#include "lwip/opt.h"
+
+#if LWIP_TCP /* don't build if not configured for use in lwipopts.h */
+
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/def.h"
+#include "lwip/sys.h"
+
+#include <string.h>
+
+/** Set ssthresh after a congestion event, the minimum value is 2 MSS */
+static void
+tcp_cc_set_ssthresh(struct tcp_pcb *pcb, tcpwnd_size_t ssthresh)
+{
+  if (ssthresh < (tcpwnd_size_t)(2U * pcb->mss)) {
+    LWIP_DEBUGF(TCP_FR_DEBUG,
+                ("tcp_cc: The minimum value for ssthresh %"TCPWNDSIZE_F
+                 " should be min 2 mss %"U16_F"...\n",
+                 ssthresh, (u16_t)(2 * pcb->mss)));
+    ssthresh = (tcpwnd_size_t)(2U * pcb->mss);
+  }
+  pcb->ssthresh = ssthresh;
+}
+
+/** RFC 3465, section 2.2 Slow Start */
+static void
+tcp_cc_slow_start(struct tcp_pcb *pcb, tcpwnd_size_t acked)
+{
+  tcpwnd_size_t increase;
+  /* limit to 1 SMSS segment during period following RTO */
+  u8_t num_seg = (pcb->flags & TF_RTO) ? 1 : 2;
+  increase = LWIP_MIN(acked, (tcpwnd_size_t)(num_seg * pcb->mss));
+  TCP_WND_INC(pcb->cwnd, increase);
+  LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: slow start cwnd %"TCPWNDSIZE_F"\n", pcb->cwnd));
+}
+
+/** NewReno: new data was acknowledged */
+void
+tcp_cc_newreno_ack(struct tcp_pcb *pcb, tcpwnd_size_t acked)
+{
+  if (pcb->cwnd < pcb->ssthresh) {
+    tcp_cc_slow_start(pcb, acked);
+  } else {
+    /* RFC 3465, section 2.1 Congestion Avoidance */
+    TCP_WND_INC(pcb->bytes_acked, acked);
+    if (pcb->bytes_acked >= pcb->cwnd) {
+      pcb->bytes_acked = (tcpwnd_size_t)(pcb->bytes_acked - pcb->cwnd);
+      TCP_WND_INC(pcb->cwnd, pcb->mss);
+    }
+    LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: congestion avoidance cwnd %"TCPWNDSIZE_F"\n", pcb->cwnd));
+  }
+}
+
+/** NewReno: fast retransmit or RTO */
+void
+tcp_cc_newreno_loss(struct tcp_pcb *pcb)
+{
+  /* Set ssthresh to half of the minimum of the current
+   * cwnd and the advertised window */
+  tcp_cc_set_ssthresh(pcb, LWIP_MIN(pcb->cwnd, pcb->snd_wnd) / 2);
+}
+
+#if LWIP_TCP_CC
+const struct tcp_cc_ops tcp_cc_newreno = {
+  "newreno",
+  NULL,
+  tcp_cc_newreno_ack,
+  tcp_cc_newreno_loss,
+  tcp_cc_newreno_loss,
+  NULL
+};
+
+#if LWIP_TCP_CC_CUBIC
+/* beta_cubic = 0.7 */
+#define CUBIC_BETA_NUM          7
+#define CUBIC_BETA_DEN          10
+/* fast convergence: W_max = cwnd * (1 + beta_cubic) / 2 */
+#define CUBIC_FC_NUM            17
+#define CUBIC_FC_DEN            20
+/* Reno-friendly estimate: alpha_cubic = 3 * (1 - beta_cubic) / (1 + beta_cubic) = 9/17 */
+#define CUBIC_ALPHA_NUM         9
+#define CUBIC_ALPHA_DEN         17
+/* With t in ms, C = 0.4 segments/s^3 is 1 / 2.5e9 segments/ms^3 */
+#define CUBIC_C_INV             2500000000UL
+/* Same constant after dividing t^3 by 1024 */
+#define CUBIC_C_INV_1024        2441406UL
+/* Limit |t - K| so that (t^3 >> 10) * mss does not overflow 64 bits */
+#define CUBIC_MAX_DT            0x1FFFFUL
+
+/** Per-pcb CUBIC state, kept in pcb->cc_priv */
+struct tcp_cubic {
+  /** sys_now() at the start of the current congestion avoidance epoch (0: none) */
+  u32_t epoch_start;
+  /** sys_now() of the last ACK or transmission after idle */
+  u32_t last_ack;
+  /** time in ms the cubic function needs to reach origin */
+  u32_t k;
+  /** cwnd before the last window reduction */
+  tcpwnd_size_t w_max;
+  /** plateau of the cubic function for this epoch */
+  tcpwnd_size_t origin;
+  /** Reno-friendly window estimate (W_est) */
+  tcpwnd_size_t w_est;
+  /** bytes acked towards the next W_est increment */
+  tcpwnd_size_t est_acked;
+};
+
+#define TCP_CUBIC(pcb) ((struct tcp_cubic *)(void *)(pcb)->cc_priv)
+
+/** Integer cube root (bitwise, Hacker's Delight) */
+static u32_t
+tcp_cubic_cbrt(u64_t x)
+{
+  u64_t y = 0;
+  u64_t b;
+  int s;
+
+  for (s = 63; s >= 0; s -= 3) {
+    y <<= 1;
+    b = 3 * y * (y + 1) + 1;
+    if ((x >> s) >= b) {
+      x -= b << s;
+      y++;
+    }
+  }
+  return (u32_t)y;
+}
+
+/** W_cubic(t) in bytes, t in ms since the epoch start (RFC 9438 section 4.2) */
+static tcpwnd_size_t
+tcp_cubic_window(const struct tcp_cubic *ca, u32_t t, u16_t mss)
+{
+  u32_t dt = (t > ca->k) ? (t - ca->k) : (ca->k - t);
+  u64_t delta;
+
+  dt = LWIP_MIN(dt, CUBIC_MAX_DT);
+  delta = ((((u64_t)dt * dt * dt) >> 10) * mss) / CUBIC_C_INV_1024;
+  if (t > ca->k) {
+    if (delta > (u64_t)(TCPWND_MAX - ca->origin)) {
+      return (tcpwnd_size_t)TCPWND_MAX;
+    }
+    return (tcpwnd_size_t)(ca->origin + delta);
+  }
+  if (delta >= ca->origin) {
+    return 0;
+  }
+  return (tcpwnd_size_t)(ca->origin - delta);
+}
+
+static void
+tcp_cubic_init(struct tcp_pcb *pcb)
+{
+  LWIP_ASSERT("TCP_CC_PRIV_WORDS too small for CUBIC",
+              sizeof(struct tcp_cubic) <= sizeof(pcb->cc_priv));
+  memset(pcb->cc_priv, 0, sizeof(struct tcp_cubic));
+  TCP_CUBIC(pcb)->last_ack = sys_now();
+}
+
+static void
+tcp_cubic_ack(struct tcp_pcb *pcb, tcpwnd_size_t acked)
+{
+  struct tcp_cubic *ca = TCP_CUBIC(pcb);
+  u32_t now = sys_now();
+  u32_t t, srtt;
+  tcpwnd_size_t cwnd = pcb->cwnd;
+  tcpwnd_size_t target;
+  u64_t thresh;
+
+  ca->last_ack = now;
+  if (cwnd < pcb->ssthresh) {
+    tcp_cc_slow_start(pcb, acked);
+    return;
+  }
+
+  if (ca->epoch_start == 0) {
+    /* start of a new congestion avoidance epoch (RFC 9438 section 4.2) */
+    ca->epoch_start = (now != 0) ? now : 1;
+    ca->w_est = cwnd;
+    ca->est_acked = 0;
+    if (cwnd < ca->w_max) {
+      ca->k = tcp_cubic_cbrt((u64_t)(ca->w_max - cwnd) * CUBIC_C_INV / pcb->mss);
+      ca->origin = ca->w_max;
+    } else {
+      ca->k = 0;
+      ca->origin = cwnd;
+    }
+  }
+
+  /* target is W_cubic(t + RTT) */
+  srtt = (pcb->sa > 0) ? (u32_t)(pcb->sa >> 3) * TCP_TICK_MS : 0;
+  t = now - ca->epoch_start + srtt;
+  target = tcp_cubic_window(ca, t, pcb->mss);
+
+  /* Reno-friendly region (RFC 9438 section 4.3): W_est grows by alpha_cubic
+     segments per cwnd acked */
+  TCP_WND_INC(ca->est_acked, acked);
+  thresh = (u64_t)cwnd * CUBIC_ALPHA_DEN / CUBIC_ALPHA_NUM;
+  if (ca->est_acked >= thresh) {
+    ca->est_acked = (tcpwnd_size_t)(ca->est_acked - thresh);
+    TCP_WND_INC(ca->w_est, pcb->mss);
+  }
+  if (target < ca->w_est) {
+    target = ca->w_est;
+  }
+
+  /* never grow by more than 50% per RTT */
+  target = (tcpwnd_size_t)LWIP_MIN(target, (u64_t)cwnd + (cwnd >> 1));
+  if (target > cwnd) {
+    /* increase cwnd by (target - cwnd) / cwnd per acked segment */
+    TCP_WND_INC(pcb->bytes_acked, acked);
+    thresh = (u64_t)cwnd * pcb->mss / (target - cwnd);
+    if (pcb->bytes_acked >= thresh) {
+      pcb->bytes_acked = (tcpwnd_size_t)(pcb->bytes_acked - thresh);
+      TCP_WND_INC(pcb->cwnd, pcb->mss);
+    }
+  }
+  LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_cubic_ack: cwnd %"TCPWNDSIZE_F" target %"TCPWNDSIZE_F"\n",
+                               pcb->cwnd, target));
+}
+
+/** Fast retransmit or RTO (RFC 9438 sections 4.6 to 4.8) */
+static void
+tcp_cubic_loss(struct tcp_pcb *pcb)
+{
+  struct tcp_cubic *ca = TCP_CUBIC(pcb);
+  tcpwnd_size_t cwnd = pcb->cwnd;
+
+  /* fast convergence: release bandwidth if the window is still shrinking */
+  if (cwnd < ca->w_max) {
+    ca->w_max = (tcpwnd_size_t)((u64_t)cwnd * CUBIC_FC_NUM / CUBIC_FC_DEN);
+  } else {
+    ca->w_max = cwnd;
+  }
+  ca->epoch_start = 0;
+  tcp_cc_set_ssthresh(pcb, (tcpwnd_size_t)((u64_t)LWIP_MIN(cwnd, pcb->snd_wnd) *
+                                           CUBIC_BETA_NUM / CUBIC_BETA_DEN));
+}
+
+/** Sending after idle: shift the epoch so that cwnd does not jump (RFC 9438 section 5.8) */
+static void
+tcp_cubic_idle(struct tcp_pcb *pcb)
+{
+  struct tcp_cubic *ca = TCP_CUBIC(pcb);
+  u32_t now = sys_now();
+
+  if ((ca->epoch_start != 0) && ((s32_t)(now - ca->last_ack) > 0)) {
+    ca->epoch_start += now - ca->last_ack;
+  }
+  ca->last_ack = now;
+}
+
+const struct tcp_cc_ops tcp_cc_cubic = {
+  "cubic",
+  tcp_cubic_init,
+  tcp_cubic_ack,
+  tcp_cubic_loss,
+  tcp_cubic_loss,
+  tcp_cubic_idle
+};
+#endif /* LWIP_TCP_CC_CUBIC */
+
+/**
+ * @ingroup tcp_raw
+ * Select the congestion control algorithm of a pcb.
+ * If the connection is already established, the algorithm starts from the
+ * current cwnd and ssthresh.
+ *
+ * @param pcb tcp_pcb to change
+ * @param ops congestion control (e.g. &tcp_cc_newreno; const since it is referenced, not copied!)
+ * @return ERR_OK on success, ERR_ARG or ERR_VAL for invalid arguments
+ */
+err_t
+tcp_set_cc(struct tcp_pcb *pcb, const struct tcp_cc_ops *ops)
+{
+  LWIP_ASSERT_CORE_LOCKED();
+
+  LWIP_ERROR("tcp_set_cc: invalid pcb", pcb != NULL, return ERR_ARG);
+  LWIP_ERROR("tcp_set_cc: invalid ops", (ops != NULL) && (ops->ack != NULL) &&
+             (ops->loss != NULL) && (ops->rto != NULL), return ERR_ARG);
+  LWIP_ERROR("tcp_set_cc: called on listen-pcb", pcb->state != LISTEN, return ERR_VAL);
+
+  pcb->cc_ops = ops;
+  memset(pcb->cc_priv, 0, sizeof(pcb->cc_priv));
+  if (pcb->state >= ESTABLISHED) {
+    TCP_CC_INIT(pcb);
+  }
+  return ERR_OK;
+}
+#endif /* LWIP_TCP_CC */
+
+#endif /* LWIP_TCP */
@@ -85,6 +85,14 @@ static u8_t flags;
 static u8_t recv_flags;
 static struct pbuf *recv_data;
 
+#if LWIP_TCP_SACK_IN
+/* 40 bytes of options hold at most 4 SACK blocks */
+#define TCP_IN_SACK_MAX 4
+/* SACK blocks of the incoming segment */
+static struct tcp_sack_range in_sacks[TCP_IN_SACK_MAX];
+static u8_t in_num_sacks;
+#endif /* LWIP_TCP_SACK_IN */
+
 struct tcp_pcb *tcp_input_pcb;
 
 /* Forward declarations. */
@@ -94,6 +102,9 @@ static void tcp_parseopt(struct tcp_pcb *pcb);
 
 static void tcp_listen_input(struct tcp_pcb_listen *pcb);
 static void tcp_timewait_input(struct tcp_pcb *pcb);
+#if LWIP_TCP_TW_BUCKETS
+static void tcp_timewait_input_tw(struct tcp_tw *tw);
+#endif /* LWIP_TCP_TW_BUCKETS */
 
 static int tcp_input_delayed_close(struct tcp_pcb *pcb);
 
@@ -104,6 +115,9 @@ static void tcp_remove_sacks_lt(struct tcp_pcb *pcb, u32_t seq);
 static void tcp_remove_sacks_gt(struct tcp_pcb *pcb, u32_t seq);
 #endif /* TCP_OOSEQ_BYTES_LIMIT || TCP_OOSEQ_PBUFS_LIMIT */
 #endif /* LWIP_TCP_SACK_OUT */
+#if LWIP_TCP_SACK_IN
+static void tcp_sack_update(struct tcp_pcb *pcb);
+#endif /* LWIP_TCP_SACK_IN */
 
 /**
  * The initial input processing of TCP. It verifies the TCP header, demultiplexes
@@ -247,7 +261,12 @@ tcp_input(struct pbuf *p, struct netif *inp)
      for an active connection. */
   prev = NULL;
 
+#if LWIP_TCP_PCB_HASH
+  for (pcb = tcp_pcb_hash_bucket(&tcp_active_pcbs, tcphdr->dest, ip_current_src_addr(), tcphdr->src);
+       pcb != NULL; pcb = pcb->hash_next) {
+#else /* LWIP_TCP_PCB_HASH */
   for (pcb = tcp_active_pcbs; pcb != NULL; pcb = pcb->next) {
+#endif /* LWIP_TCP_PCB_HASH */
     LWIP_ASSERT("tcp_input: active pcb->state != CLOSED", pcb->state != CLOSED);
     LWIP_ASSERT("tcp_input: active pcb->state != TIME-WAIT", pcb->state != TIME_WAIT);
     LWIP_ASSERT("tcp_input: active pcb->state != LISTEN", pcb->state != LISTEN);
@@ -263,6 +282,7 @@ tcp_input(struct pbuf *p, struct netif *inp)
         pcb->local_port == tcphdr->dest &&
         ip_addr_eq(&pcb->remote_ip, ip_current_src_addr()) &&
         ip_addr_eq(&pcb->local_ip, ip_current_dest_addr())) {
+#if !LWIP_TCP_PCB_HASH
       /* Move this PCB to the front of the list so that subsequent
          lookups will be faster (we exploit locality in TCP segment
          arrivals). */
@@ -275,6 +295,7 @@ tcp_input(struct pbuf *p, struct netif *inp)
         TCP_STATS_INC(tcp.cachehit);
       }
       LWIP_ASSERT("tcp_input: pcb->next != pcb (after cache)", pcb->next != pcb);
+#endif /* !LWIP_TCP_PCB_HASH */
       break;
     }
     prev = pcb;
@@ -283,7 +304,12 @@ tcp_input(struct pbuf *p, struct netif *inp)
   if (pcb == NULL) {
     /* If it did not go to an active connection, we check the connections
        in the TIME-WAIT state. */
+#if LWIP_TCP_PCB_HASH
+    for (pcb = tcp_pcb_hash_bucket(&tcp_tw_pcbs, tcphdr->dest, ip_current_src_addr(), tcphdr->src);
+         pcb != NULL; pcb = pcb->hash_next) {
+#else /* LWIP_TCP_PCB_HASH */
     for (pcb = tcp_tw_pcbs; pcb != NULL; pcb = pcb->next) {
+#endif /* LWIP_TCP_PCB_HASH */
       LWIP_ASSERT("tcp_input: TIME-WAIT pcb->state == TIME-WAIT", pcb->state == TIME_WAIT);
 
       /* check if PCB is bound to specific netif */
@@ -311,11 +337,31 @@ tcp_input(struct pbuf *p, struct netif *inp)
         return;
       }
     }
+#if LWIP_TCP_TW_BUCKETS
+    {
+      /* connections in TIME-WAIT that have been closed by the application */
+      struct tcp_tw *tw = tcp_tw_find(tcphdr->dest, ip_current_dest_addr(),
+                                      ip_current_src_addr(), tcphdr->src);
+      if ((tw != NULL) &&
+          ((tw->netif_idx == NETIF_NO_INDEX) ||
+           (tw->netif_idx == netif_get_index(ip_data.current_input_netif)))) {
+        LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_input: packed for TIME_WAITing connection (tw-bucket).\n"));
+        tcp_timewait_input_tw(tw);
+        pbuf_free(p);
+        return;
+      }
+    }
+#endif /* LWIP_TCP_TW_BUCKETS */
 
     /* Finally, if we still did not get a match, we check all PCBs that
        are LISTENing for incoming connections. */
     prev = NULL;
+#if LWIP_TCP_PCB_HASH
+    for (lpcb = (struct tcp_pcb_listen *)tcp_pcb_hash_bucket(&tcp_listen_pcbs.pcbs, tcphdr->dest, NULL, 0);
+         lpcb != NULL; lpcb = lpcb->hash_next) {
+#else /* LWIP_TCP_PCB_HASH */
     for (lpcb = tcp_listen_pcbs.listen_pcbs; lpcb != NULL; lpcb = lpcb->next) {
+#endif /* LWIP_TCP_PCB_HASH */
       /* check if PCB is bound to specific netif */
       if ((lpcb->netif_idx != NETIF_NO_INDEX) &&
           (lpcb->netif_idx != netif_get_index(ip_data.current_input_netif))) {
@@ -358,6 +404,10 @@ tcp_input(struct pbuf *p, struct netif *inp)
     }
 #endif /* SO_REUSE */
     if (lpcb != NULL) {
+#if LWIP_TCP_PCB_HASH
+      /* 'prev' is the predecessor in the hash bucket, not in the list */
+      LWIP_UNUSED_ARG(prev);
+#else /* LWIP_TCP_PCB_HASH */
       /* Move this PCB to the front of the list so that subsequent
          lookups will be faster (we exploit locality in TCP segment
          arrivals). */
@@ -370,6 +420,7 @@ tcp_input(struct pbuf *p, struct netif *inp)
       } else {
         TCP_STATS_INC(tcp.cachehit);
       }
+#endif /* LWIP_TCP_PCB_HASH */
 
       LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_input: packed for LISTENing connection.\n"));
 #ifdef LWIP_HOOK_TCP_INPACKET_PCB
@@ -551,6 +602,14 @@ tcp_input(struct pbuf *p, struct netif *inp)
         }
         /* Try to send something out. */
         tcp_output(pcb);
+#if LWIP_TCP_TW_BUCKETS
+        if ((pcb->state == TIME_WAIT) && (pcb->flags & TF_ORPHANED)) {
+          /* the application is done with this pcb: keep a tw-bucket only */
+          if (tcp_tw_enter(pcb) == ERR_OK) {
+            goto aborted;
+          }
+        }
+#endif /* LWIP_TCP_TW_BUCKETS */
 #if TCP_INPUT_DEBUG
 #if TCP_DEBUG
         tcp_debug_print_state(pcb->state);
@@ -765,7 +824,7 @@ tcp_timewait_input(struct tcp_pcb *pcb)
   } else if (flags & TCP_FIN) {
     /* - eighth, check the FIN bit: Remain in the TIME-WAIT state.
          Restart the 2 MSL time-wait timeout.*/
-    pcb->tmr = tcp_ticks;
+    pcb->tmr = tcp_now();
   }
 
   if ((tcplen > 0)) {
@@ -776,6 +835,40 @@ tcp_timewait_input(struct tcp_pcb *pcb)
   return;
 }
 
+#if LWIP_TCP_TW_BUCKETS
+/**
+ * Called by tcp_input() when a segment arrives for a connection in
+ * TIME_WAIT that only has a tw-bucket left. Does the same as
+ * tcp_timewait_input() for a pcb.
+ *
+ * @param tw the tw-bucket for which a segment arrived
+ */
+static void
+tcp_timewait_input_tw(struct tcp_tw *tw)
+{
+  if (flags & TCP_RST) {
+    return;
+  }
+
+  if (flags & TCP_SYN) {
+    if (TCP_SEQ_BETWEEN(seqno, tw->rcv_nxt, tw->rcv_nxt + tw->rcv_wnd)) {
+      /* If the SYN is in the window it is an error, send a reset */
+      tcp_rst_netif(ip_data.current_input_netif, ackno, seqno + tcplen, ip_current_dest_addr(),
+                    ip_current_src_addr(), tcphdr->dest, tcphdr->src);
+      return;
+    }
+  } else if (flags & TCP_FIN) {
+    /* Restart the 2 MSL time-wait timeout.*/
+    tcp_tw_restart(tw);
+  }
+
+  if ((tcplen > 0)) {
+    /* Acknowledge data, FIN or out-of-window SYN */
+    tcp_tw_send_ack(tw, ip_data.current_input_netif);
+  }
+}
+#endif /* LWIP_TCP_TW_BUCKETS */
+
 /**
  * Implements the TCP state machine. Called by tcp_input. In some
  * states tcp_receive() is called to receive data. The tcp_seg
@@ -845,7 +938,7 @@ tcp_process(struct tcp_pcb *pcb)
 
   if ((pcb->flags & TF_RXCLOSED) == 0) {
     /* Update the PCB (in)activity timer unless rx is closed (see tcp_shutdown) */
-    pcb->tmr = tcp_ticks;
+    pcb->tmr = tcp_now();
   }
   pcb->keep_cnt_sent = 0;
   pcb->persist_probe = 0;
@@ -881,6 +974,7 @@ tcp_process(struct tcp_pcb *pcb)
 #endif /* TCP_CALCULATE_EFF_SEND_MSS */
 
         pcb->cwnd = LWIP_TCP_CALC_INITIAL_CWND(pcb->mss);
+        TCP_CC_INIT(pcb);
         LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_process (SENT): cwnd %"TCPWNDSIZE_F
                                      " ssthresh %"TCPWNDSIZE_F"\n",
                                      pcb->cwnd, pcb->ssthresh));
@@ -974,6 +1068,7 @@ tcp_process(struct tcp_pcb *pcb)
           }
 
           pcb->cwnd = LWIP_TCP_CALC_INITIAL_CWND(pcb->mss);
+          TCP_CC_INIT(pcb);
           LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_process (SYN_RCVD): cwnd %"TCPWNDSIZE_F
                                        " ssthresh %"TCPWNDSIZE_F"\n",
                                        pcb->cwnd, pcb->ssthresh));
@@ -1125,6 +1220,11 @@ tcp_free_acked_segments(struct tcp_pcb *pcb, struct tcp_seg *seg_list, const cha
 
     pcb->snd_queuelen = (u16_t)(pcb->snd_queuelen - clen);
     recv_acked = (tcpwnd_size_t)(recv_acked + next->len);
+#if LWIP_TCP_RACK
+    if (!(next->flags & TF_SEG_SACKED)) {
+      tcp_rack_update(pcb, next);
+    }
+#endif /* LWIP_TCP_RACK */
     tcp_seg_free(next);
 
     LWIP_DEBUGF(TCP_QLEN_DEBUG, ("%"TCPWNDSIZE_F" (after freeing %s)\n",
@@ -1153,7 +1253,7 @@ tcp_free_acked_segments(struct tcp_pcb *pcb, struct tcp_seg *seg_list, const cha
 static void
 tcp_receive(struct tcp_pcb *pcb)
 {
-  s16_t m;
+  tcprto_t m;
   u32_t right_wnd_edge;
 
   LWIP_ASSERT("tcp_receive: invalid pcb", pcb != NULL);
@@ -1186,6 +1286,12 @@ tcp_receive(struct tcp_pcb *pcb)
 #endif /* TCP_WND_DEBUG */
     }
 
+#if LWIP_TCP_SACK_IN
+    if ((pcb->flags & TF_SACK) && (in_num_sacks > 0)) {
+      tcp_sack_update(pcb);
+    }
+#endif /* LWIP_TCP_SACK_IN */
+
     /* (From Stevens TCP/IP Illustrated Vol II, p970.) Its only a
      * duplicate ack if:
      * 1) It doesn't ACK new data
@@ -1219,7 +1325,7 @@ tcp_receive(struct tcp_pcb *pcb)
               if ((u8_t)(pcb->dupacks + 1) > pcb->dupacks) {
                 ++pcb->dupacks;
               }
-              if (pcb->dupacks > 3) {
+              if ((pcb->dupacks > 3) && !TCP_SACK_RECOVERY(pcb)) {
                 /* Inflate the congestion window */
                 TCP_WND_INC(pcb->cwnd, pcb->mss);
               }
@@ -1237,8 +1343,9 @@ tcp_receive(struct tcp_pcb *pcb)
 
       /* Reset the "IN Fast Retransmit" flag, since we are no longer
          in fast retransmit. Also reset the congestion window to the
-         slow start threshold. */
-      if (pcb->flags & TF_INFR) {
+         slow start threshold. With SACK, recovery only ends once
+         everything outstanding at its start is acknowledged. */
+      if ((pcb->flags & TF_INFR) && !TCP_SACK_PARTIAL_ACK(pcb, ackno)) {
         tcp_clear_flags(pcb, TF_INFR);
         pcb->cwnd = pcb->ssthresh;
         pcb->bytes_acked = 0;
@@ -1248,7 +1355,7 @@ tcp_receive(struct tcp_pcb *pcb)
       pcb->nrtx = 0;
 
       /* Reset the retransmission time-out. */
-      pcb->rto = (s16_t)((pcb->sa >> 3) + pcb->sv);
+      pcb->rto = TCP_RTO_CALC(pcb);
 
       /* Record how much data this ACK acks */
       acked = (tcpwnd_size_t)(ackno - pcb->lastack);
@@ -1259,24 +1366,8 @@ tcp_receive(struct tcp_pcb *pcb)
 
       /* Update the congestion control variables (cwnd and
          ssthresh). */
-      if (pcb->state >= ESTABLISHED) {
-        if (pcb->cwnd < pcb->ssthresh) {
-          tcpwnd_size_t increase;
-          /* limit to 1 SMSS segment during period following RTO */
-          u8_t num_seg = (pcb->flags & TF_RTO) ? 1 : 2;
-          /* RFC 3465, section 2.2 Slow Start */
-          increase = LWIP_MIN(acked, (tcpwnd_size_t)(num_seg * pcb->mss));
-          TCP_WND_INC(pcb->cwnd, increase);
-          LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: slow start cwnd %"TCPWNDSIZE_F"\n", pcb->cwnd));
-        } else {
-          /* RFC 3465, section 2.1 Congestion Avoidance */
-          TCP_WND_INC(pcb->bytes_acked, acked);
-          if (pcb->bytes_acked >= pcb->cwnd) {
-            pcb->bytes_acked = (tcpwnd_size_t)(pcb->bytes_acked - pcb->cwnd);
-            TCP_WND_INC(pcb->cwnd, pcb->mss);
-          }
-          LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: congestion avoidance cwnd %"TCPWNDSIZE_F"\n", pcb->cwnd));
-        }
+      if ((pcb->state >= ESTABLISHED) && !(pcb->flags & TF_INFR)) {
+        TCP_CC_ACK(pcb, acked);
       }
       LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_receive: ACK for %"U32_F", unacked->seqno %"U32_F":%"U32_F"\n",
                                     ackno,
@@ -1306,6 +1397,12 @@ tcp_receive(struct tcp_pcb *pcb)
 
       pcb->polltmr = 0;
 
+#if LWIP_TCP_RACK
+      /* new data was ACKed: a new tail loss probe may be sent */
+      pcb->rack_flags &= (u8_t)~TCP_RACK_F_TLP;
+      tcp_rack_arm_tlp(pcb);
+#endif /* LWIP_TCP_RACK */
+
 #if TCP_OVERSIZE
       if (pcb->unsent == NULL) {
         pcb->unsent_oversize = 0;
@@ -1349,27 +1446,44 @@ tcp_receive(struct tcp_pcb *pcb)
        round-trip time measurement. */
     if (pcb->rttest && TCP_SEQ_LT(pcb->rtseq, ackno)) {
       /* diff between this shouldn't exceed 32K since this are tcp timer ticks
-         and a round-trip shouldn't be that long... */
-      m = (s16_t)(tcp_ticks - pcb->rttest);
+         and a round-trip shouldn't be that long... (with per-pcb timers,
+         longer samples would only push the RTO beyond TCP_RTO_MAX) */
+      m = (tcprto_t)LWIP_MIN((u32_t)(tcp_now() - pcb->rttest), (u32_t)TCP_RTO_MAX);
 
-      LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_receive: experienced rtt %"U16_F" ticks (%"U16_F" msec).\n",
-                                  m, (u16_t)(m * TCP_SLOW_INTERVAL)));
+      LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_receive: experienced rtt %"TCPRTO_F" ticks (%"U32_F" msec).\n",
+                                  m, (u32_t)m * TCP_TICK_MS));
 
       /* This is taken directly from VJs original code in his paper */
-      m = (s16_t)(m - (pcb->sa >> 3));
-      pcb->sa = (s16_t)(pcb->sa + m);
+      m = (tcprto_t)(m - (pcb->sa >> 3));
+      pcb->sa = (tcprto_t)(pcb->sa + m);
       if (m < 0) {
-        m = (s16_t) - m;
+        m = (tcprto_t) - m;
       }
-      m = (s16_t)(m - (pcb->sv >> 2));
-      pcb->sv = (s16_t)(pcb->sv + m);
-      pcb->rto = (s16_t)((pcb->sa >> 3) + pcb->sv);
+      m = (tcprto_t)(m - (pcb->sv >> 2));
+      pcb->sv = (tcprto_t)(pcb->sv + m);
+      pcb->rto = TCP_RTO_CALC(pcb);
 
-      LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_receive: RTO %"U16_F" (%"U16_F" milliseconds)\n",
-                                  pcb->rto, (u16_t)(pcb->rto * TCP_SLOW_INTERVAL)));
+      LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_receive: RTO %"TCPRTO_F" (%"U32_F" milliseconds)\n",
+                                  pcb->rto, (u32_t)pcb->rto * TCP_TICK_MS));
 
       pcb->rttest = 0;
     }
+
+#if LWIP_TCP_SACK_IN
+    if ((pcb->flags & TF_SACK) && (pcb->unacked != NULL)) {
+#if LWIP_TCP_RACK
+      tcp_rack_detect_loss(pcb);
+#endif /* LWIP_TCP_RACK */
+      if (pcb->flags & TF_INFR) {
+        /* in recovery: repair further holes as far as pipe allows */
+        tcp_rexmit_sack(pcb);
+      } else if (tcp_sack_head_lost(pcb)) {
+        /* enough data SACKed above the first unacked segment to enter
+           recovery before the third dupack (RFC 6675 section 5, step 4) */
+        tcp_rexmit_fast(pcb);
+      }
+    }
+#endif /* LWIP_TCP_SACK_IN */
   }
 
   /* If the incoming segment contains data, we must process it
@@ -1629,6 +1743,12 @@ tcp_receive(struct tcp_pcb *pcb)
 
         /* Acknowledge the segment(s). */
         tcp_ack(pcb);
+#if LWIP_GRO
+        if ((recv_data != NULL) && (recv_data->flags & PBUF_FLAG_GRO)) {
+          /* coalesced from several segments: don't delay the ACK */
+          tcp_ack_now(pcb);
+        }
+#endif /* LWIP_GRO */
 
 #if LWIP_TCP_SACK_OUT
         if (LWIP_TCP_SACK_VALID(pcb, 0)) {
@@ -1922,6 +2042,10 @@ tcp_parseopt(struct tcp_pcb *pcb)
 
   LWIP_ASSERT("tcp_parseopt: invalid pcb", pcb != NULL);
 
+#if LWIP_TCP_SACK_IN
+  in_num_sacks = 0;
+#endif /* LWIP_TCP_SACK_IN */
+
   /* Parse the TCP MSS option, if present. */
   if (tcphdr_optlen != 0) {
     for (tcp_optidx = 0; tcp_optidx < tcphdr_optlen; ) {
@@ -2014,6 +2138,34 @@ tcp_parseopt(struct tcp_pcb *pcb)
           }
           break;
 #endif /* LWIP_TCP_SACK_OUT */
+#if LWIP_TCP_SACK_IN
+        case LWIP_TCP_OPT_SACK:
+          LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: SACK\n"));
+          data = tcp_get_next_optbyte();
+          if ((data < 10) || (((data - 2) & 7) != 0) || (tcp_optidx - 2 + data) > tcphdr_optlen) {
+            /* Bad length */
+            LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: bad length\n"));
+            return;
+          }
+          /* TCP SACK option with valid length: read the blocks (left and right edge) */
+          for (data = (u8_t)((data - 2) / 8); data > 0; data--) {
+            u32_t left, right;
+            left = (u32_t)tcp_get_next_optbyte() << 24;
+            left |= (u32_t)tcp_get_next_optbyte() << 16;
+            left |= (u32_t)tcp_get_next_optbyte() << 8;
+            left |= tcp_get_next_optbyte();
+            right = (u32_t)tcp_get_next_optbyte() << 24;
+            right |= (u32_t)tcp_get_next_optbyte() << 16;
+            right |= (u32_t)tcp_get_next_optbyte() << 8;
+            right |= tcp_get_next_optbyte();
+            if (in_num_sacks < TCP_IN_SACK_MAX) {
+              in_sacks[in_num_sacks].left = left;
+              in_sacks[in_num_sacks].right = right;
+              in_num_sacks++;
+            }
+          }
+          break;
+#endif /* LWIP_TCP_SACK_IN */
         default:
           LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: other\n"));
           data = tcp_get_next_optbyte();
@@ -2031,6 +2183,43 @@ tcp_parseopt(struct tcp_pcb *pcb)
   }
 }
 
+#if LWIP_TCP_SACK_IN
+/**
+ * Called by tcp_receive() to mark the segments on the unacked queue that
+ * are fully covered by a SACK block of the incoming segment.
+ * Blocks at or below ackno (D-SACK) or beyond snd_nxt are ignored.
+ *
+ * @param pcb the tcp_pcb for which a segment arrived
+ */
+static void
+tcp_sack_update(struct tcp_pcb *pcb)
+{
+  struct tcp_seg *seg;
+  u8_t i;
+
+  for (i = 0; i < in_num_sacks; i++) {
+    u32_t left = in_sacks[i].left;
+    u32_t right = in_sacks[i].right;
+    if (!TCP_SEQ_LT(left, right) || TCP_SEQ_LEQ(right, ackno) || TCP_SEQ_GT(right, pcb->snd_nxt)) {
+      continue;
+    }
+    for (seg = pcb->unacked; seg != NULL; seg = seg->next) {
+      u32_t seg_seqno = lwip_ntohl(seg->tcphdr->seqno);
+      if (TCP_SEQ_GEQ(seg_seqno, right)) {
+        break;
+      }
+      if (TCP_SEQ_GEQ(seg_seqno, left) && TCP_SEQ_LEQ(seg_seqno + TCP_TCPLEN(seg), right) &&
+          !(seg->flags & TF_SEG_SACKED)) {
+        seg->flags |= TF_SEG_SACKED;
+#if LWIP_TCP_RACK
+        tcp_rack_update(pcb, seg);
+#endif /* LWIP_TCP_RACK */
+      }
+    }
+  }
+}
+#endif /* LWIP_TCP_SACK_IN */
+
 void
 tcp_trigger_input_pcb_close(void)
 {
@@ -74,7 +74,7 @@
 #include "lwip/stats.h"
 #include "lwip/ip6.h"
 #include "lwip/ip6_addr.h"
-#if LWIP_TCP_TIMESTAMPS
+#if LWIP_TCP_TIMESTAMPS || LWIP_TCP_RACK
 #include "lwip/sys.h"
 #endif
 
@@ -126,6 +126,13 @@
 
 /* Forward declarations.*/
 static err_t tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb, struct netif *netif);
+static err_t tcp_write_internal(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags,
+                                struct pbuf *ref);
+#if LWIP_NETIF_TSO
+static u16_t tcp_tso_count(const struct tcp_pcb *pcb, const struct tcp_seg *seg, u32_t wnd);
+static err_t tcp_output_segments_tso(struct tcp_seg *seg, u16_t *count, struct tcp_pcb *pcb,
+                                     struct netif *netif);
+#endif /* LWIP_NETIF_TSO */
 static err_t tcp_output_control_segment_netif(const struct tcp_pcb *pcb, struct pbuf *p,
                                               const ip_addr_t *src, const ip_addr_t *dst,
                                               struct netif *netif);
@@ -350,6 +357,61 @@ tcp_write_checks(struct tcp_pcb *pcb, u16_t len)
   return ERR_OK;
 }
 
+#if LWIP_TCP_WRITE_REF
+#define TCP_WRITE_REF_NONE(ref) ((ref) == NULL)
+
+/** Free-callback function to free a 'struct pbuf_custom_ref' created by
+ * tcp_pbuf_nocopy(), called by pbuf_free. */
+static void
+tcp_free_pbuf_custom_ref(struct pbuf *p)
+{
+  struct pbuf_custom_ref *pcr = (struct pbuf_custom_ref *)p;
+  LWIP_ASSERT("pcr != NULL", pcr != NULL);
+  LWIP_ASSERT("pcr == p", (void *)pcr == (void *)p);
+  if (pcr->original != NULL) {
+    pbuf_free(pcr->original);
+  }
+  memp_free(MEMP_TCP_PBUF_REF, pcr);
+}
+#else /* LWIP_TCP_WRITE_REF */
+#define TCP_WRITE_REF_NONE(ref) 1
+#endif /* LWIP_TCP_WRITE_REF */
+
+/**
+ * Allocate a pbuf referencing non-copied data for tcp_write.
+ *
+ * Without 'ref', the data must stay valid until ACKed and a PBUF_ROM is used.
+ * Otherwise, a custom pbuf holding a reference on 'ref' is returned: the data
+ * is kept alive by that reference, so it can be treated as non-volatile, too.
+ */
+static struct pbuf *
+tcp_pbuf_nocopy(const u8_t *data, u16_t len, struct pbuf *ref)
+{
+  struct pbuf *p;
+#if LWIP_TCP_WRITE_REF
+  if (ref != NULL) {
+    struct pbuf_custom_ref *pcr = (struct pbuf_custom_ref *)memp_malloc(MEMP_TCP_PBUF_REF);
+    if (pcr == NULL) {
+      return NULL;
+    }
+    p = pbuf_alloced_custom(PBUF_RAW, len, PBUF_ROM, &pcr->pc, LWIP_CONST_CAST(u8_t *, data), len);
+    LWIP_ASSERT("tcp_pbuf_nocopy: pbuf_alloced_custom failed", p != NULL);
+    pbuf_ref(ref);
+    pcr->original = ref;
+    pcr->pc.custom_free_function = tcp_free_pbuf_custom_ref;
+    return p;
+  }
+#else /* LWIP_TCP_WRITE_REF */
+  LWIP_UNUSED_ARG(ref);
+#endif /* LWIP_TCP_WRITE_REF */
+  p = pbuf_alloc(PBUF_RAW, len, PBUF_ROM);
+  if (p != NULL) {
+    /* reference the non-volatile payload data */
+    ((struct pbuf_rom *)p)->payload = data;
+  }
+  return p;
+}
+
 /**
  * @ingroup tcp_raw
  * Write data for sending (but does not send it immediately).
@@ -391,6 +453,49 @@ tcp_write_checks(struct tcp_pcb *pcb, u16_t len)
  */
 err_t
 tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
+{
+  return tcp_write_internal(pcb, arg, len, apiflags, NULL);
+}
+
+#if LWIP_TCP_WRITE_REF
+/**
+ * @ingroup tcp_raw
+ * Write data for sending without copying it, holding a reference on the
+ * pbuf 'ref' that owns the memory behind dataptr.
+ *
+ * Works like tcp_write() without TCP_WRITE_FLAG_COPY, but instead of
+ * requiring the data to stay valid until ACKed, every pbuf enqueued for it
+ * holds a reference on 'ref'. The caller may pbuf_free() its own reference
+ * right after this call. If 'ref' is a pbuf_custom wrapping an application
+ * buffer (see pbuf_alloced_custom()), its custom_free_function is called as
+ * the completion callback once all bytes have been ACKed (or the connection
+ * has been aborted) and the stack does not reference the buffer any more.
+ *
+ * @param pcb Protocol control block for the TCP connection to enqueue data for.
+ * @param dataptr Pointer to the data to be enqueued for sending.
+ * @param len Data length in bytes
+ * @param apiflags combination of TCP_WRITE_FLAG_xxx (TCP_WRITE_FLAG_COPY is ignored)
+ * @param ref pbuf owning the memory behind dataptr
+ * @return ERR_OK if enqueued, another err_t on error
+ */
+err_t
+tcp_write_ref(struct tcp_pcb *pcb, const void *dataptr, u16_t len, u8_t apiflags,
+              struct pbuf *ref)
+{
+  LWIP_ERROR("tcp_write_ref: invalid ref", ref != NULL, return ERR_ARG);
+  return tcp_write_internal(pcb, dataptr, len, (u8_t)(apiflags & ~TCP_WRITE_FLAG_COPY), ref);
+}
+#endif /* LWIP_TCP_WRITE_REF */
+
+/**
+ * Enqueue data for tcp_write() and tcp_write_ref().
+ *
+ * @param ref pbuf to reference instead of using PBUF_ROM for non-copied data
+ *            (NULL for tcp_write())
+ */
+static err_t
+tcp_write_internal(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags,
+                   struct pbuf *ref)
 {
   struct pbuf *concat_p = NULL;
   struct tcp_seg *last_unsent = NULL, *seg = NULL, *prev_seg = NULL, *queue = NULL;
@@ -415,6 +520,9 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
   u16_t mss_local;
 
   LWIP_ERROR("tcp_write: invalid pcb", pcb != NULL, return ERR_ARG);
+#if !LWIP_TCP_WRITE_REF
+  LWIP_UNUSED_ARG(ref);
+#endif /* !LWIP_TCP_WRITE_REF */
 
   /* don't allocate segments bigger than half the maximum window we ever received */
   mss_local = LWIP_MIN(pcb->mss, TCPWND_MIN16(pcb->snd_wnd_max / 2));
@@ -559,18 +667,17 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
         /* If the last unsent pbuf is of type PBUF_ROM, try to extend it. */
         struct pbuf *p;
         for (p = last_unsent->p; p->next != NULL; p = p->next);
-        if (((p->type_internal & (PBUF_TYPE_FLAG_STRUCT_DATA_CONTIGUOUS | PBUF_TYPE_FLAG_DATA_VOLATILE)) == 0) &&
+        if ((TCP_WRITE_REF_NONE(ref)) &&
+            ((p->type_internal & (PBUF_TYPE_FLAG_STRUCT_DATA_CONTIGUOUS | PBUF_TYPE_FLAG_DATA_VOLATILE)) == 0) &&
             (const u8_t *)p->payload + p->len == (const u8_t *)arg) {
           LWIP_ASSERT("tcp_write: ROM pbufs cannot be oversized", pos == 0);
           extendlen = seglen;
         } else {
-          if ((concat_p = pbuf_alloc(PBUF_RAW, seglen, PBUF_ROM)) == NULL) {
+          if ((concat_p = tcp_pbuf_nocopy((const u8_t *)arg + pos, seglen, ref)) == NULL) {
             LWIP_DEBUGF(TCP_OUTPUT_DEBUG | LWIP_DBG_LEVEL_SERIOUS,
                         ("tcp_write: could not allocate memory for zero-copy pbuf\n"));
             goto memerr;
           }
-          /* reference the non-volatile payload data */
-          ((struct pbuf_rom *)concat_p)->payload = (const u8_t *)arg + pos;
           queuelen += pbuf_clen(concat_p);
         }
 #if TCP_CHECKSUM_ON_COPY
@@ -627,7 +734,7 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
 #if TCP_OVERSIZE
       LWIP_ASSERT("oversize == 0", oversize == 0);
 #endif /* TCP_OVERSIZE */
-      if ((p2 = pbuf_alloc(PBUF_TRANSPORT, seglen, PBUF_ROM)) == NULL) {
+      if ((p2 = tcp_pbuf_nocopy((const u8_t *)arg + pos, seglen, ref)) == NULL) {
         LWIP_DEBUGF(TCP_OUTPUT_DEBUG | LWIP_DBG_LEVEL_SERIOUS, ("tcp_write: could not allocate memory for zero-copy pbuf\n"));
         goto memerr;
       }
@@ -639,8 +746,6 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
         chksum = SWAP_BYTES_IN_WORD(chksum);
       }
 #endif /* TCP_CHECKSUM_ON_COPY */
-      /* reference the non-volatile payload data */
-      ((struct pbuf_rom *)p2)->payload = (const u8_t *)arg + pos;
 
       /* Second, allocate a pbuf for the headers. */
       if ((p = pbuf_alloc(PBUF_TRANSPORT, optlen, PBUF_RAM)) == NULL) {
@@ -1229,6 +1334,31 @@ tcp_build_wnd_scale_option(u32_t *opts)
 }
 #endif
 
+#if LWIP_TCP_PCB_TIMERS
+static err_t tcp_output_segments(struct tcp_pcb *pcb);
+
+/**
+ * @ingroup tcp_raw
+ * Find out what we can send and send it
+ *
+ * @param pcb Protocol control block for the TCP connection to send data
+ * @return ERR_OK if data has been sent or nothing to send
+ *         another err_t on error
+ */
+err_t
+tcp_output(struct tcp_pcb *pcb)
+{
+  err_t err = tcp_output_segments(pcb);
+  /* sending (re)starts or stops the retransmission, persist and delayed ACK
+     timers: re-arm the pcb timer */
+  tcp_timers_update(pcb);
+  return err;
+}
+
+/** Does the work of tcp_output() */
+static err_t
+tcp_output_segments(struct tcp_pcb *pcb)
+#else /* LWIP_TCP_PCB_TIMERS */
 /**
  * @ingroup tcp_raw
  * Find out what we can send and send it
@@ -1239,14 +1369,21 @@ tcp_build_wnd_scale_option(u32_t *opts)
  */
 err_t
 tcp_output(struct tcp_pcb *pcb)
+#endif /* LWIP_TCP_PCB_TIMERS */
 {
   struct tcp_seg *seg, *useg;
   u32_t wnd, snd_nxt;
   err_t err;
   struct netif *netif;
+#if LWIP_TCP_RACK
+  u32_t snd_nxt_start;
+#endif /* LWIP_TCP_RACK */
 #if TCP_CWND_DEBUG
   s16_t i = 0;
 #endif /* TCP_CWND_DEBUG */
+#if LWIP_NETIF_TSO
+  u16_t tso_left = 0;
+#endif /* LWIP_NETIF_TSO */
 
   LWIP_ASSERT_CORE_LOCKED();
 
@@ -1263,7 +1400,19 @@ tcp_output(struct tcp_pcb *pcb)
     return ERR_OK;
   }
 
+#if LWIP_TCP_RACK
+  snd_nxt_start = pcb->snd_nxt;
+#endif /* LWIP_TCP_RACK */
   wnd = LWIP_MIN(pcb->snd_wnd, pcb->cwnd);
+#if LWIP_TCP_SACK_IN
+  if (TCP_SACK_RECOVERY(pcb)) {
+    /* During SACK loss recovery, new data may use what is left of cwnd
+       after subtracting the estimated bytes in flight (RFC 6675 pipe) */
+    tcpwnd_size_t pipe = tcp_sack_pipe(pcb);
+    wnd = LWIP_MIN(pcb->snd_wnd, (pcb->snd_nxt - pcb->lastack) +
+                   ((pcb->cwnd > pipe) ? (u32_t)(pcb->cwnd - pipe) : 0));
+  }
+#endif /* LWIP_TCP_SACK_IN */
 
   seg = pcb->unsent;
 
@@ -1327,6 +1476,11 @@ tcp_output(struct tcp_pcb *pcb)
   /* Stop persist timer, above conditions are not active */
   pcb->persist_backoff = 0;
 
+  /* Nothing in flight: congestion control may need to account for the idle time */
+  if ((pcb->unacked == NULL) && (pcb->state >= ESTABLISHED)) {
+    TCP_CC_IDLE(pcb);
+  }
+
   /* useg should point to last segment on unacked queue */
   useg = pcb->unacked;
   if (useg != NULL) {
@@ -1344,8 +1498,13 @@ tcp_output(struct tcp_pcb *pcb)
      *   either seg->next != NULL or pcb->unacked == NULL;
      *   RST is no sent using tcp_write/tcp_output.
      */
-    if ((tcp_do_output_nagle(pcb) == 0) &&
-        ((pcb->flags & (TF_NAGLEMEMERR | TF_FIN)) == 0)) {
+    if (
+#if LWIP_NETIF_TSO
+      /* segments already sent as part of a super-segment must be queued */
+      (tso_left == 0) &&
+#endif /* LWIP_NETIF_TSO */
+      (tcp_do_output_nagle(pcb) == 0) &&
+      ((pcb->flags & (TF_NAGLEMEMERR | TF_FIN)) == 0)) {
       break;
     }
 #if TCP_CWND_DEBUG
@@ -1361,7 +1520,23 @@ tcp_output(struct tcp_pcb *pcb)
       TCPH_SET_FLAG(seg->tcphdr, TCP_ACK);
     }
 
+#if LWIP_NETIF_TSO
+    if (tso_left > 0) {
+      /* this segment was sent as part of the last super-segment */
+      tso_left--;
+      err = ERR_OK;
+    } else {
+      u16_t count = tcp_tso_count(pcb, seg, wnd);
+      if (count > 1) {
+        err = tcp_output_segments_tso(seg, &count, pcb, netif);
+        tso_left = (u16_t)(count - 1);
+      } else {
+        err = tcp_output_segment(seg, pcb, netif);
+      }
+    }
+#else /* LWIP_NETIF_TSO */
     err = tcp_output_segment(seg, pcb, netif);
+#endif /* LWIP_NETIF_TSO */
     if (err != ERR_OK) {
       /* segment could not be sent, for whatever reason */
       tcp_set_flags(pcb, TF_NAGLEMEMERR);
@@ -1417,6 +1592,12 @@ tcp_output(struct tcp_pcb *pcb)
     pcb->unsent_oversize = 0;
   }
 #endif /* TCP_OVERSIZE */
+#if LWIP_TCP_RACK
+  if (pcb->snd_nxt != snd_nxt_start) {
+    /* new data was sent: (re)schedule the tail loss probe */
+    tcp_rack_arm_tlp(pcb);
+  }
+#endif /* LWIP_TCP_RACK */
 
 output_done:
   tcp_clear_flags(pcb, TF_NAGLEMEMERR);
@@ -1449,32 +1630,19 @@ tcp_output_segment_busy(const struct tcp_seg *seg)
 }
 
 /**
- * Called by tcp_output() to actually send a TCP segment over IP.
+ * Fill in the per-transmission header fields (ackno, wnd, options) of a
+ * segment, start the timers and let seg->p start at the TCP header.
  *
  * @param seg the tcp_seg to send
  * @param pcb the tcp_pcb for the TCP connection used to send the segment
  * @param netif the netif used to send the segment
  */
-static err_t
-tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb, struct netif *netif)
+static void
+tcp_output_segment_prepare(struct tcp_seg *seg, struct tcp_pcb *pcb, struct netif *netif)
 {
-  err_t err;
   u16_t len;
   u32_t *opts;
-#if TCP_CHECKSUM_ON_COPY
-  int seg_chksum_was_swapped = 0;
-#endif
-
-  LWIP_ASSERT("tcp_output_segment: invalid seg", seg != NULL);
-  LWIP_ASSERT("tcp_output_segment: invalid pcb", pcb != NULL);
-  LWIP_ASSERT("tcp_output_segment: invalid netif", netif != NULL);
-
-  if (tcp_output_segment_busy(seg)) {
-    /* This should not happen: rexmit functions should have checked this.
-       However, since this function modifies p->len, we must not continue in this case. */
-    LWIP_DEBUGF(TCP_RTO_DEBUG | LWIP_DBG_LEVEL_SERIOUS, ("tcp_output_segment: segment busy\n"));
-    return ERR_OK;
-  }
+  LWIP_UNUSED_ARG(netif); /* without TCP_CALCULATE_EFF_SEND_MSS */
 
   /* The TCP header has already been constructed, but the ackno and
    wnd fields remain. */
@@ -1539,8 +1707,12 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb, struct netif *netif
     pcb->rtime = 0;
   }
 
+#if LWIP_TCP_RACK
+  seg->xmit_time = sys_now();
+#endif /* LWIP_TCP_RACK */
+
   if (pcb->rttest == 0) {
-    pcb->rttest = tcp_ticks;
+    pcb->rttest = tcp_now();
     pcb->rtseq = lwip_ntohl(seg->tcphdr->seqno);
 
     LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_output_segment: rtseq %"U32_F"\n", pcb->rtseq));
@@ -1566,6 +1738,35 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb, struct netif *netif
   opts = LWIP_HOOK_TCP_OUT_ADD_TCPOPTS(seg->p, seg->tcphdr, pcb, opts);
 #endif
   LWIP_ASSERT("options not filled", (u8_t *)opts == ((u8_t *)(seg->tcphdr + 1)) + LWIP_TCP_OPT_LENGTH_SEGMENT(seg->flags, pcb));
+}
+
+/**
+ * Called by tcp_output() to actually send a TCP segment over IP.
+ *
+ * @param seg the tcp_seg to send
+ * @param pcb the tcp_pcb for the TCP connection used to send the segment
+ * @param netif the netif used to send the segment
+ */
+static err_t
+tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb, struct netif *netif)
+{
+  err_t err;
+#if TCP_CHECKSUM_ON_COPY
+  int seg_chksum_was_swapped = 0;
+#endif
+
+  LWIP_ASSERT("tcp_output_segment: invalid seg", seg != NULL);
+  LWIP_ASSERT("tcp_output_segment: invalid pcb", pcb != NULL);
+  LWIP_ASSERT("tcp_output_segment: invalid netif", netif != NULL);
+
+  if (tcp_output_segment_busy(seg)) {
+    /* This should not happen: rexmit functions should have checked this.
+       However, since this function modifies p->len, we must not continue in this case. */
+    LWIP_DEBUGF(TCP_RTO_DEBUG | LWIP_DBG_LEVEL_SERIOUS, ("tcp_output_segment: segment busy\n"));
+    return ERR_OK;
+  }
+
+  tcp_output_segment_prepare(seg, pcb, netif);
 
 #if CHECKSUM_GEN_TCP
   IF__NETIF_CHECKSUM_ENABLED(netif, NETIF_CHECKSUM_GEN_TCP) {
@@ -1624,6 +1825,114 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb, struct netif *netif
   return err;
 }
 
+#if LWIP_NETIF_TSO
+/**
+ * Count the segments at the head of the unsent queue that can be sent as
+ * one TSO/GSO super-segment: data segments of equal size with the same
+ * options, fitting into the send window and TCP_TSO_MAX_SIZE.
+ *
+ * @param pcb the tcp_pcb to send on
+ * @param seg first segment to send (pcb->unsent)
+ * @param wnd the usable send window
+ * @return number of segments (only a value > 1 is useful)
+ */
+static u16_t
+tcp_tso_count(const struct tcp_pcb *pcb, const struct tcp_seg *seg, u32_t wnd)
+{
+  const struct tcp_seg *s;
+  u16_t count = 0;
+  u32_t len = 0;
+
+  if (!IP_IS_V4(&pcb->remote_ip) || (pcb->state < ESTABLISHED)) {
+    return 0;
+  }
+  for (s = seg; s != NULL; s = s->next) {
+    if ((s->len != seg->len) || (s->flags != seg->flags) ||
+        (TCPH_FLAGS(s->tcphdr) & (TCP_SYN | TCP_FIN | TCP_RST)) ||
+        (s->flags & (TF_SEG_OPTS_MSS | TF_SEG_OPTS_WND_SCALE | TF_SEG_OPTS_SACK_PERM)) ||
+        (len + s->len > TCP_TSO_MAX_SIZE) ||
+        (lwip_ntohl(s->tcphdr->seqno) - pcb->lastack + s->len > wnd) ||
+        tcp_output_segment_busy(s)) {
+      break;
+    }
+    len += s->len;
+    count++;
+  }
+  return count;
+}
+
+/**
+ * Send '*count' segments starting at 'seg' as one super-segment with one
+ * TCP header. The payload pbufs only reference the data of the segments,
+ * which stay on the queues for retransmission (each holds a reference on
+ * its segment's pbuf, so a queued super-segment keeps the segments busy). The netif (or the software
+ * GSO fallback in the IP layer) splits it up every p->gso_size bytes.
+ * The TCP checksum is left to whoever does the segmentation.
+ *
+ * If the super-segment cannot be allocated, only 'seg' is sent and
+ * '*count' is set to 1.
+ */
+static err_t
+tcp_output_segments_tso(struct tcp_seg *seg, u16_t *count, struct tcp_pcb *pcb, struct netif *netif)
+{
+  struct tcp_seg *s;
+  struct pbuf *p, *q, *r;
+  u16_t hdrlen = TCPH_HDRLEN_BYTES(seg->tcphdr);
+  u16_t i, off;
+  u8_t flags = 0;
+  struct tcp_hdr *tcphdr;
+  err_t err;
+
+  p = pbuf_alloc(PBUF_IP, hdrlen, PBUF_RAM);
+  for (s = seg, i = 0; (p != NULL) && (i < *count); s = s->next, i++) {
+    /* reference the data behind the TCP header of this segment */
+    off = (u16_t)(((u8_t *)s->tcphdr - (u8_t *)s->p->payload) + hdrlen);
+    for (q = s->p; q != NULL; q = q->next) {
+      if (off >= q->len) {
+        off = (u16_t)(off - q->len);
+        continue;
+      }
+      r = pbuf_alloc_tso_ref(s->p, (u8_t *)q->payload + off, (u16_t)(q->len - off));
+      if (r == NULL) {
+        pbuf_free(p);
+        p = NULL;
+        break;
+      }
+      pbuf_cat(p, r);
+      off = 0;
+    }
+  }
+  if (p == NULL) {
+    LWIP_DEBUGF(TCP_OUTPUT_DEBUG, ("tcp_output_segments_tso: out of pbufs, sending one segment\n"));
+    *count = 1;
+    return tcp_output_segment(seg, pcb, netif);
+  }
+
+  for (s = seg, i = 0; i < *count; s = s->next, i++) {
+    TCPH_SET_FLAG(s->tcphdr, TCP_ACK);
+    tcp_output_segment_prepare(s, pcb, netif);
+    flags |= TCPH_FLAGS(s->tcphdr);
+    TCP_STATS_INC(tcp.xmit);
+  }
+  /* the header of the first segment with the flags of all (PSH) */
+  MEMCPY(p->payload, seg->tcphdr, hdrlen);
+  tcphdr = (struct tcp_hdr *)p->payload;
+  TCPH_FLAGS_SET(tcphdr, flags);
+  tcphdr->chksum = 0;
+  p->gso_size = seg->len;
+
+  LWIP_DEBUGF(TCP_OUTPUT_DEBUG, ("tcp_output_segments_tso: %"U16_F" segments, %"U16_F" bytes\n",
+                                 *count, (u16_t)(p->tot_len - hdrlen)));
+
+  NETIF_SET_HINTS(netif, &(pcb->netif_hints));
+  err = ip_output_if(p, &pcb->local_ip, &pcb->remote_ip, pcb->ttl,
+                     pcb->tos, IP_PROTO_TCP, netif);
+  NETIF_RESET_HINTS(netif);
+  pbuf_free(p);
+  return err;
+}
+#endif /* LWIP_NETIF_TSO */
+
 /**
  * Requeue all unacked segments for retransmission
  *
@@ -1664,6 +1973,23 @@ tcp_rexmit_rto_prepare(struct tcp_pcb *pcb)
     pcb->unsent_oversize = seg->oversize_left;
   }
 #endif /* TCP_OVERSIZE_DBGCHECK */
+#if LWIP_TCP_SACK_IN
+  if (pcb->flags & TF_SACK) {
+    /* Everything is resent, so forget the SACK scoreboard and end recovery */
+    struct tcp_seg *s;
+    for (s = pcb->unacked; s != NULL; s = s->next) {
+      s->flags &= (u8_t)~(TF_SEG_SACKED | TF_SEG_SACK_REXMIT);
+#if LWIP_TCP_RACK
+      s->flags &= (u8_t)~TF_SEG_RACK_LOST;
+#endif /* LWIP_TCP_RACK */
+    }
+    tcp_clear_flags(pcb, TF_INFR);
+#if LWIP_TCP_RACK
+    pcb->rack_timer = TCP_RACK_TIMER_NONE;
+    pcb->rack_flags &= (u8_t)~TCP_RACK_F_TLP;
+#endif /* LWIP_TCP_RACK */
+  }
+#endif /* LWIP_TCP_SACK_IN */
   /* unsent queue is the concatenated queue (of unacked, unsent) */
   pcb->unsent = pcb->unacked;
   /* unacked queue is now empty */
@@ -1778,6 +2104,215 @@ tcp_rexmit(struct tcp_pcb *pcb)
 }
 
 
+#if LWIP_TCP_SACK_IN
+/** RFC 6675 DupThresh: SACKed segments above a hole that mark it lost */
+#define TCP_SACK_DUPTHRESH 3
+
+/** RFC 6675 IsLost(): DupThresh segments or more than (DupThresh - 1) * SMSS
+ * bytes have been SACKed above a segment */
+static u8_t
+tcp_sack_is_lost(const struct tcp_pcb *pcb, u32_t sacked_segs, u32_t sacked_bytes)
+{
+  return (u8_t)((sacked_segs >= TCP_SACK_DUPTHRESH) ||
+                (sacked_bytes > (u32_t)(TCP_SACK_DUPTHRESH - 1) * pcb->mss));
+}
+
+/** A segment is lost if IsLost() says so or if RACK marked it lost */
+#if LWIP_TCP_RACK
+#define TCP_SACK_SEG_LOST(pcb, seg, segs, bytes) \
+  (((seg)->flags & TF_SEG_RACK_LOST) || tcp_sack_is_lost(pcb, segs, bytes))
+#else /* LWIP_TCP_RACK */
+#define TCP_SACK_SEG_LOST(pcb, seg, segs, bytes) tcp_sack_is_lost(pcb, segs, bytes)
+#endif /* LWIP_TCP_RACK */
+
+/** Count the SACKed segments and bytes on the unacked queue */
+static void
+tcp_sack_count(const struct tcp_pcb *pcb, u32_t *sacked_segs, u32_t *sacked_bytes)
+{
+  const struct tcp_seg *seg;
+
+  *sacked_segs = 0;
+  *sacked_bytes = 0;
+  for (seg = pcb->unacked; seg != NULL; seg = seg->next) {
+    if (seg->flags & TF_SEG_SACKED) {
+      (*sacked_segs)++;
+      *sacked_bytes += TCP_TCPLEN(seg);
+    }
+  }
+}
+
+/**
+ * RFC 6675 SetPipe(): estimate the bytes still in flight. Segments that are
+ * neither SACKed nor lost count once, retransmitted ones count again.
+ *
+ * @param pcb the tcp_pcb to check
+ * @return the number of bytes in flight
+ */
+tcpwnd_size_t
+tcp_sack_pipe(const struct tcp_pcb *pcb)
+{
+  const struct tcp_seg *seg;
+  u32_t sacked_segs, sacked_bytes;
+  tcpwnd_size_t pipe = 0;
+
+  tcp_sack_count(pcb, &sacked_segs, &sacked_bytes);
+  for (seg = pcb->unacked; seg != NULL; seg = seg->next) {
+    if (seg->flags & TF_SEG_SACKED) {
+      /* after this, the counters only include SACKed data above the next segment */
+      sacked_segs--;
+      sacked_bytes -= TCP_TCPLEN(seg);
+      continue;
+    }
+    if (!TCP_SACK_SEG_LOST(pcb, seg, sacked_segs, sacked_bytes)) {
+      TCP_WND_INC(pipe, TCP_TCPLEN(seg));
+    }
+    if (seg->flags & TF_SEG_SACK_REXMIT) {
+      TCP_WND_INC(pipe, TCP_TCPLEN(seg));
+    }
+  }
+  return pipe;
+}
+
+/**
+ * Check if the first unacked segment is considered lost based on the SACK
+ * scoreboard (allows entering recovery before the third dupack).
+ *
+ * @param pcb the tcp_pcb to check
+ * @return 1 if the first unacked segment is lost
+ */
+u8_t
+tcp_sack_head_lost(const struct tcp_pcb *pcb)
+{
+  u32_t sacked_segs, sacked_bytes;
+
+  if ((pcb->unacked == NULL) || (pcb->unacked->flags & TF_SEG_SACKED)) {
+    return 0;
+  }
+  tcp_sack_count(pcb, &sacked_segs, &sacked_bytes);
+  return TCP_SACK_SEG_LOST(pcb, pcb->unacked, sacked_segs, sacked_bytes);
+}
+
+/** Retransmit a segment in place on the unacked queue */
+static err_t
+tcp_rexmit_sack_seg(struct tcp_pcb *pcb, struct tcp_seg *seg, struct netif *netif)
+{
+  err_t err;
+
+  /* Give up if the segment is still referenced by the netif driver
+     due to deferred transmission. */
+  if (tcp_output_segment_busy(seg)) {
+    LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_rexmit_sack_seg busy\n"));
+    return ERR_VAL;
+  }
+  LWIP_DEBUGF(TCP_FR_DEBUG, ("tcp_rexmit_sack_seg: %"U32_F"\n", lwip_ntohl(seg->tcphdr->seqno)));
+  err = tcp_output_segment(seg, pcb, netif);
+  /* Don't take any rtt measurements after retransmitting. */
+  pcb->rttest = 0;
+  if (err == ERR_OK) {
+    seg->flags |= TF_SEG_SACK_REXMIT;
+    MIB2_STATS_INC(mib2.tcpretranssegs);
+  }
+  return err;
+}
+
+/**
+ * Repair holes during SACK loss recovery (RFC 6675 NextSeg() rules 1 and 3):
+ * while cwnd - pipe allows another segment, retransmit segments that are lost;
+ * if there is no new data to send, also retransmit one unSACKed segment that
+ * lies below SACKed data.
+ *
+ * Called by tcp_receive() for every ACK while in recovery.
+ *
+ * @param pcb the tcp_pcb in SACK loss recovery
+ */
+void
+tcp_rexmit_sack(struct tcp_pcb *pcb)
+{
+  struct tcp_seg *seg;
+  struct netif *netif;
+  u32_t sacked_segs, sacked_bytes, pipe;
+
+  LWIP_ASSERT("tcp_rexmit_sack: invalid pcb", pcb != NULL);
+
+  netif = tcp_route(pcb, &pcb->local_ip, &pcb->remote_ip);
+  if (netif == NULL) {
+    return;
+  }
+  pipe = tcp_sack_pipe(pcb);
+  /* rule 1: lost segments */
+  tcp_sack_count(pcb, &sacked_segs, &sacked_bytes);
+  for (seg = pcb->unacked; seg != NULL; seg = seg->next) {
+    if (pipe + pcb->mss > pcb->cwnd) {
+      return;
+    }
+    if (seg->flags & TF_SEG_SACKED) {
+      sacked_segs--;
+      sacked_bytes -= TCP_TCPLEN(seg);
+    } else if (!(seg->flags & TF_SEG_SACK_REXMIT) &&
+               TCP_SACK_SEG_LOST(pcb, seg, sacked_segs, sacked_bytes)) {
+      if (tcp_rexmit_sack_seg(pcb, seg, netif) != ERR_OK) {
+        return;
+      }
+      /* a lost segment was not counted in pipe before */
+      pipe += TCP_TCPLEN(seg);
+    }
+  }
+  if (pcb->unsent != NULL) {
+    /* rule 2 (new data) comes before rule 3 and is done by tcp_output() */
+    return;
+  }
+  /* rule 3: one segment that is not lost yet but has SACKed data above */
+  tcp_sack_count(pcb, &sacked_segs, &sacked_bytes);
+  for (seg = pcb->unacked; (seg != NULL) && (sacked_segs > 0); seg = seg->next) {
+    if (seg->flags & TF_SEG_SACKED) {
+      sacked_segs--;
+    } else if (!(seg->flags & TF_SEG_SACK_REXMIT)) {
+      tcp_rexmit_sack_seg(pcb, seg, netif);
+      return;
+    }
+  }
+}
+#endif /* LWIP_TCP_SACK_IN */
+
+#if LWIP_TCP_RACK
+/**
+ * Send a Tail Loss Probe: retransmit the last segment sent in place so that
+ * the remote host ACKs (and SACKs) what it has received.
+ *
+ * @param pcb the tcp_pcb for which to send the probe
+ * @return ERR_OK if the probe was sent
+ */
+err_t
+tcp_rexmit_tlp(struct tcp_pcb *pcb)
+{
+  struct tcp_seg *seg;
+  struct netif *netif;
+  err_t err;
+
+  LWIP_ASSERT("tcp_rexmit_tlp: invalid pcb", pcb != NULL);
+
+  if (pcb->unacked == NULL) {
+    return ERR_VAL;
+  }
+  for (seg = pcb->unacked; seg->next != NULL; seg = seg->next);
+  if (tcp_output_segment_busy(seg)) {
+    LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_rexmit_tlp busy\n"));
+    return ERR_VAL;
+  }
+  netif = tcp_route(pcb, &pcb->local_ip, &pcb->remote_ip);
+  if (netif == NULL) {
+    return ERR_RTE;
+  }
+  err = tcp_output_segment(seg, pcb, netif);
+  /* Don't take any rtt measurements after retransmitting. */
+  pcb->rttest = 0;
+  if (err == ERR_OK) {
+    MIB2_STATS_INC(mib2.tcpretranssegs);
+  }
+  return err;
+}
+#endif /* LWIP_TCP_RACK */
+
 /**
  * Handle retransmission after three dupacks received
  *
@@ -1795,19 +2330,29 @@ tcp_rexmit_fast(struct tcp_pcb *pcb)
                  "), fast retransmit %"U32_F"\n",
                  (u16_t)pcb->dupacks, pcb->lastack,
                  lwip_ntohl(pcb->unacked->tcphdr->seqno)));
-    if (tcp_rexmit(pcb) == ERR_OK) {
-      /* Set ssthresh to half of the minimum of the current
-       * cwnd and the advertised window */
-      pcb->ssthresh = LWIP_MIN(pcb->cwnd, pcb->snd_wnd) / 2;
-
-      /* The minimum value for ssthresh should be 2 MSS */
-      if (pcb->ssthresh < (2U * pcb->mss)) {
-        LWIP_DEBUGF(TCP_FR_DEBUG,
-                    ("tcp_receive: The minimum value for ssthresh %"TCPWNDSIZE_F
-                     " should be min 2 mss %"U16_F"...\n",
-                     pcb->ssthresh, (u16_t)(2 * pcb->mss)));
-        pcb->ssthresh = 2 * pcb->mss;
+#if LWIP_TCP_SACK_IN
+    if (pcb->flags & TF_SACK) {
+      struct netif *netif = tcp_route(pcb, &pcb->local_ip, &pcb->remote_ip);
+      /* RFC 6675 loss recovery: retransmit the first segment now, further
+         holes are repaired by tcp_rexmit_sack() as pipe allows */
+      if ((netif != NULL) && (tcp_rexmit_sack_seg(pcb, pcb->unacked, netif) == ERR_OK)) {
+        if (pcb->nrtx < 0xFF) {
+          ++pcb->nrtx;
+        }
+        TCP_CC_LOSS(pcb);
+        pcb->cwnd = pcb->ssthresh;
+        pcb->recover = pcb->snd_nxt;
+        tcp_set_flags(pcb, TF_INFR);
+        /* Reset the retransmission timer to prevent immediate rto retransmissions */
+        pcb->rtime = 0;
+        tcp_rexmit_sack(pcb);
       }
+      return;
+    }
+#endif /* LWIP_TCP_SACK_IN */
+    if (tcp_rexmit(pcb) == ERR_OK) {
+      /* Let congestion control reduce ssthresh */
+      TCP_CC_LOSS(pcb);
 
       pcb->cwnd = pcb->ssthresh + 3 * pcb->mss;
       tcp_set_flags(pcb, TF_INFR);
@@ -2133,6 +2678,52 @@ tcp_send_empty_ack(struct tcp_pcb *pcb)
   return err;
 }
 
+#if LWIP_TCP_TW_BUCKETS
+/**
+ * Send an ACK for a connection in TIME-WAIT that only has a tw-bucket left.
+ *
+ * @param tw the tw-bucket
+ * @param netif the netif to send the ACK on (the one the segment came in on)
+ */
+err_t
+tcp_tw_send_ack(const struct tcp_tw *tw, struct netif *netif)
+{
+  struct pbuf *p;
+  u8_t optlen = 0;
+
+  LWIP_ASSERT("tcp_tw_send_ack: invalid tw", tw != NULL);
+
+  if (netif == NULL) {
+    LWIP_DEBUGF(TCP_OUTPUT_DEBUG, ("tcp_tw_send_ack: no netif given\n"));
+    return ERR_RTE;
+  }
+
+#if LWIP_TCP_TIMESTAMPS
+  if (tw->flags & TCP_TW_FLAG_TIMESTAMP) {
+    optlen = LWIP_TCP_OPT_LEN_TS_OUT;
+  }
+#endif
+  p = tcp_output_alloc_header_common(tw->rcv_nxt, optlen, 0, lwip_htonl(tw->snd_nxt),
+                                     tw->local_port, tw->remote_port, TCP_ACK, tw->ann_wnd);
+  if (p == NULL) {
+    LWIP_DEBUGF(TCP_OUTPUT_DEBUG, ("tcp_tw_send_ack: could not allocate pbuf\n"));
+    return ERR_BUF;
+  }
+#if LWIP_TCP_TIMESTAMPS
+  if (optlen != 0) {
+    u32_t *opts = (u32_t *)(void *)((struct tcp_hdr *)p->payload + 1);
+    opts[0] = PP_HTONL(0x0101080A);
+    opts[1] = lwip_htonl(sys_now());
+    opts[2] = lwip_htonl(tw->ts_recent);
+  }
+#endif
+
+  LWIP_DEBUGF(TCP_OUTPUT_DEBUG,
+              ("tcp_tw_send_ack: sending ACK for %"U32_F"\n", tw->rcv_nxt));
+  return tcp_output_control_segment_netif(NULL, p, &tw->local_ip, &tw->remote_ip, netif);
+}
+#endif /* LWIP_TCP_TW_BUCKETS */
+
 /**
  * Send keepalive packets to keep a connection active although
  * no data is sent over it.
@@ -2154,8 +2745,8 @@ tcp_keepalive(struct tcp_pcb *pcb)
   ip_addr_debug_print_val(TCP_DEBUG, pcb->remote_ip);
   LWIP_DEBUGF(TCP_DEBUG, ("\n"));
 
-  LWIP_DEBUGF(TCP_DEBUG, ("tcp_keepalive: tcp_ticks %"U32_F"   pcb->tmr %"U32_F" pcb->keep_cnt_sent %"U16_F"\n",
-                          tcp_ticks, pcb->tmr, (u16_t)pcb->keep_cnt_sent));
+  LWIP_DEBUGF(TCP_DEBUG, ("tcp_keepalive: tcp_now %"U32_F"   pcb->tmr %"U32_F" pcb->keep_cnt_sent %"U16_F"\n",
+                          tcp_now(), pcb->tmr, (u16_t)pcb->keep_cnt_sent));
 
   p = tcp_output_alloc_header(pcb, optlen, 0, lwip_htonl(pcb->snd_nxt - 1));
   if (p == NULL) {
@@ -2198,9 +2789,9 @@ tcp_zero_window_probe(struct tcp_pcb *pcb)
   LWIP_DEBUGF(TCP_DEBUG, ("\n"));
 
   LWIP_DEBUGF(TCP_DEBUG,
-              ("tcp_zero_window_probe: tcp_ticks %"U32_F
+              ("tcp_zero_window_probe: tcp_now %"U32_F
                "   pcb->tmr %"U32_F" pcb->keep_cnt_sent %"U16_F"\n",
-               tcp_ticks, pcb->tmr, (u16_t)pcb->keep_cnt_sent));
+               tcp_now(), pcb->tmr, (u16_t)pcb->keep_cnt_sent));
 
   /* Only consider unsent, persist timer should be off when there is data in-flight */
   seg = pcb->unsent;
@@ -0,0 +1,241 @@
+/**
+ * @file
+ * Transmission Control Protocol, RACK-TLP loss detection
+ *
+ * RACK-TLP (RFC 8985) for SACK-enabled connections, built with LWIP_TCP_RACK:
+ * - RACK marks a segment lost once a segment sent after it has been
+ *   delivered (cumulatively ACKed or SACKed) and a reordering window has
+ *   passed since the loss could have been detected
+ * - a Tail Loss Probe retransmits the last segment when no ACK arrives for
+ *   about two RTTs, so that the ACK for the probe lets RACK or SACK recovery
+ *   repair a tail loss instead of waiting for the RTO
+ *
+ * Times are taken from sys_now(); the timers are run by tcp_fasttmr() (or
+ * the pcb's own timer with LWIP_TCP_PCB_TIMERS).
+ */
+
+/*
+ * Copyright (c) 2001-2004 Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ *
+ */
+
+#include "lwip/opt.h"
+
+#if LWIP_TCP && LWIP_TCP_RACK /* don't build if not configured for use in lwipopts.h */
+
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/def.h"
+#include "lwip/sys.h"
+
+/** Worst case delayed ACK time (ms) added to the PTO when one segment is in flight */
+#define TCP_RACK_WC_DEL_ACK   200
+/** PTO (ms) used before the first RTT sample */
+#define TCP_RACK_INIT_PTO     1000
+
+/** Was (t1, seq1) sent after (t2, seq2)? Ties in time are broken by sequence number. */
+static int
+tcp_rack_sent_after(u32_t t1, u32_t seq1, u32_t t2, u32_t seq2)
+{
+  return ((s32_t)(t1 - t2) > 0) || ((t1 == t2) && TCP_SEQ_GT(seq1, seq2));
+}
+
+/**
+ * Called for every segment that is newly delivered, i.e. cumulatively ACKed
+ * or SACKed. Updates the RTT estimates and remembers the most recently sent
+ * delivered segment.
+ *
+ * @param pcb the tcp_pcb the segment belongs to
+ * @param seg the delivered segment
+ */
+void
+tcp_rack_update(struct tcp_pcb *pcb, const struct tcp_seg *seg)
+{
+  u32_t end_seq = lwip_ntohl(seg->tcphdr->seqno) + TCP_TCPLEN(seg);
+  u32_t rtt = sys_now() - seg->xmit_time;
+
+  if (pcb->rack_flags & TCP_RACK_F_RTT) {
+    if ((seg->flags & TF_SEG_SACK_REXMIT) && (rtt < pcb->rack_min_rtt)) {
+      /* too fast for the retransmission: the original was delivered */
+      return;
+    }
+    if (rtt < pcb->rack_min_rtt) {
+      pcb->rack_min_rtt = rtt;
+    }
+    pcb->rack_srtt = (u32_t)((s32_t)pcb->rack_srtt + ((s32_t)(rtt - pcb->rack_srtt) / 8));
+  } else {
+    pcb->rack_min_rtt = rtt;
+    pcb->rack_srtt = rtt;
+    pcb->rack_xmit_ts = seg->xmit_time;
+    pcb->rack_end_seq = end_seq;
+    pcb->rack_rtt = rtt;
+    pcb->rack_flags |= TCP_RACK_F_RTT;
+  }
+  if (tcp_rack_sent_after(seg->xmit_time, end_seq, pcb->rack_xmit_ts, pcb->rack_end_seq)) {
+    pcb->rack_xmit_ts = seg->xmit_time;
+    pcb->rack_end_seq = end_seq;
+    pcb->rack_rtt = rtt;
+  }
+}
+
+/**
+ * RACK loss detection (RFC 8985 section 6.2): mark every segment on the
+ * unacked queue that was sent before the most recently delivered segment
+ * and is overdue by more than the reordering window. If such a segment is
+ * not overdue yet, the reordering timer is started for it.
+ * Retransmissions can be marked lost again this way.
+ *
+ * @param pcb the tcp_pcb to check
+ * @return 1 if a segment was newly marked lost
+ */
+u8_t
+tcp_rack_detect_loss(struct tcp_pcb *pcb)
+{
+  struct tcp_seg *seg;
+  u32_t now, reo_wnd, timeout = 0;
+  u8_t lost = 0;
+
+  if (!(pcb->rack_flags & TCP_RACK_F_RTT)) {
+    return 0;
+  }
+  now = sys_now();
+  reo_wnd = LWIP_MIN(pcb->rack_min_rtt / 4, pcb->rack_srtt);
+  for (seg = pcb->unacked; seg != NULL; seg = seg->next) {
+    u32_t end_seq;
+    s32_t remaining;
+
+    if ((seg->flags & TF_SEG_SACKED) ||
+        ((seg->flags & (TF_SEG_RACK_LOST | TF_SEG_SACK_REXMIT)) == TF_SEG_RACK_LOST)) {
+      /* delivered, or lost and waiting for the retransmission */
+      continue;
+    }
+    end_seq = lwip_ntohl(seg->tcphdr->seqno) + TCP_TCPLEN(seg);
+    if (!tcp_rack_sent_after(pcb->rack_xmit_ts, pcb->rack_end_seq, seg->xmit_time, end_seq)) {
+      /* not sent before the delivered segment (retransmissions break the
+         sequence order, so continue with the next one) */
+      continue;
+    }
+    remaining = (s32_t)(seg->xmit_time + pcb->rack_rtt + reo_wnd - now);
+    if (remaining <= 0) {
+      LWIP_DEBUGF(TCP_FR_DEBUG, ("tcp_rack_detect_loss: %"U32_F" lost\n", lwip_ntohl(seg->tcphdr->seqno)));
+      seg->flags = (u8_t)((seg->flags | TF_SEG_RACK_LOST) & ~TF_SEG_SACK_REXMIT);
+      lost = 1;
+    } else if ((u32_t)remaining > timeout) {
+      timeout = (u32_t)remaining;
+    }
+  }
+  if (timeout > 0) {
+    pcb->rack_timer = TCP_RACK_TIMER_REO;
+    pcb->rack_deadline = now + timeout;
+  } else if (pcb->rack_timer == TCP_RACK_TIMER_REO) {
+    pcb->rack_timer = TCP_RACK_TIMER_NONE;
+  }
+  return lost;
+}
+
+/**
+ * Schedule a Tail Loss Probe (RFC 8985 section 7.2) after new data was sent
+ * or new data was acknowledged. Nothing is scheduled while in loss recovery,
+ * while a probe is outstanding or if the RTO would fire first.
+ *
+ * @param pcb the tcp_pcb to schedule the probe for
+ */
+void
+tcp_rack_arm_tlp(struct tcp_pcb *pcb)
+{
+  u32_t pto;
+  s32_t rto_left;
+
+  if (pcb->rack_timer == TCP_RACK_TIMER_REO) {
+    /* loss detection comes first, the probe is scheduled afterwards */
+    return;
+  }
+  pcb->rack_timer = TCP_RACK_TIMER_NONE;
+  if ((pcb->unacked == NULL) || (pcb->state < ESTABLISHED) || !(pcb->flags & TF_SACK) ||
+      (pcb->flags & TF_INFR) || (pcb->rack_flags & TCP_RACK_F_TLP)) {
+    return;
+  }
+  if (pcb->rack_flags & TCP_RACK_F_RTT) {
+    pto = 2 * pcb->rack_srtt;
+    if (pcb->unacked->next == NULL) {
+      /* the ACK for a single segment may be delayed */
+      pto += TCP_RACK_WC_DEL_ACK;
+    }
+  } else {
+    pto = TCP_RACK_INIT_PTO;
+  }
+  rto_left = (s32_t)pcb->rto * TCP_TICK_MS - TCP_RTO_ELAPSED(pcb);
+  if ((s32_t)pto >= rto_left) {
+    return;
+  }
+  pcb->rack_timer = TCP_RACK_TIMER_TLP;
+  pcb->rack_deadline = sys_now() + pto;
+}
+
+/**
+ * Called by tcp_fasttmr() for pcbs with a RACK timer running.
+ * Runs loss detection when the reordering timer expired or sends a
+ * Tail Loss Probe when the probe timer expired.
+ *
+ * @param pcb the tcp_pcb to check
+ */
+void
+tcp_rack_tmr(struct tcp_pcb *pcb)
+{
+  if ((pcb->unacked == NULL) || !(pcb->flags & TF_SACK)) {
+    pcb->rack_timer = TCP_RACK_TIMER_NONE;
+    return;
+  }
+  if ((s32_t)(sys_now() - pcb->rack_deadline) < 0) {
+    return;
+  }
+  if (pcb->rack_timer == TCP_RACK_TIMER_REO) {
+    pcb->rack_timer = TCP_RACK_TIMER_NONE;
+    if (tcp_rack_detect_loss(pcb)) {
+      if (pcb->flags & TF_INFR) {
+        tcp_rexmit_sack(pcb);
+      } else if (tcp_sack_head_lost(pcb)) {
+        tcp_rexmit_fast(pcb);
+      }
+    }
+    tcp_rack_arm_tlp(pcb);
+  } else {
+    pcb->rack_timer = TCP_RACK_TIMER_NONE;
+    if (pcb->flags & TF_INFR) {
+      /* recovery started after the probe was scheduled */
+      return;
+    }
+    LWIP_DEBUGF(TCP_FR_DEBUG, ("tcp_rack_tmr: tail loss probe\n"));
+    if (tcp_rexmit_tlp(pcb) == ERR_OK) {
+      pcb->rack_flags |= TCP_RACK_F_TLP;
+      /* restart the retransmission timer */
+      pcb->rtime = 0;
+    }
+  }
+}
+
+#endif /* LWIP_TCP && LWIP_TCP_RACK */
@@ -0,0 +1,346 @@
+/**
+ * @file
+ * Transmission Control Protocol, compact TIME-WAIT buckets
+ *
+ * Built with LWIP_TCP_TW_BUCKETS: when a connection the application has
+ * closed enters TIME-WAIT, its tcp_pcb is freed and replaced by a struct
+ * tcp_tw holding only what is needed to answer segments until 2*MSL have
+ * passed (see tcp_timewait_input()).
+ * Buckets are kept in a hash table for tcp_input() and in a list ordered by
+ * their start time, so that expiring them and reusing the oldest one when
+ * the pool is exhausted does not need to scan all of them.
+ */
+
+/*
+ * Copyright (c) 2001-2004 Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ *
+ */
+
+#include "lwip/opt.h"
+
+#if LWIP_TCP && LWIP_TCP_TW_BUCKETS /* don't build if not configured for use in lwipopts.h */
+
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/memp.h"
+#include "lwip/stats.h"
+#include "lwip/timeouts.h"
+
+/** All tw-buckets, oldest first */
+struct tcp_tw *tcp_tw_buckets;
+/** Youngest tw-bucket (end of tcp_tw_buckets) */
+static struct tcp_tw *tcp_tw_youngest;
+/** Hash table of all tw-buckets, chained through hash_next */
+static struct tcp_tw *tcp_tw_hash[TCP_TW_HASH_SIZE];
+/** Hash table of all tw-buckets by local port, chained through port_next */
+static struct tcp_tw *tcp_tw_port_hash[TCP_TW_HASH_SIZE];
+#define TCP_TW_PORT_SLOT(local_port) (&tcp_tw_port_hash[(local_port) & (TCP_TW_HASH_SIZE - 1)])
+
+#if LWIP_TCP_PCB_TIMERS
+/** One timer for all buckets, armed to the expiry of the oldest one */
+static struct sys_timeo tcp_tw_timer;
+static void tcp_tw_arm(void);
+#define TCP_TW_EXPIRED(tw) ((s32_t)(tcp_now() - ((tw)->tmr + (u32_t)(2 * TCP_MSL))) >= 0)
+#define TCP_TW_OLDEST_CHANGED() tcp_tw_arm()
+#else /* LWIP_TCP_PCB_TIMERS */
+#define TCP_TW_EXPIRED(tw) ((u32_t)(tcp_now() - (tw)->tmr) > 2 * TCP_MSL / TCP_SLOW_INTERVAL)
+#define TCP_TW_OLDEST_CHANGED()
+#endif /* LWIP_TCP_PCB_TIMERS */
+
+/** Get the hash chain for the given ports and remote address (the same
+ * hash as used for TIME-WAIT pcbs with LWIP_TCP_PCB_HASH) */
+static struct tcp_tw **
+tcp_tw_hash_slot(u16_t local_port, const ip_addr_t *remote_ip, u16_t remote_port)
+{
+  u32_t h = ((u32_t)local_port << 16) | remote_port;
+#if LWIP_IPV6
+  if (IP_IS_V6(remote_ip)) {
+    const u32_t *addr = ip_2_ip6(remote_ip)->addr;
+    h ^= addr[0] ^ addr[1] ^ addr[2] ^ addr[3];
+  }
+#endif /* LWIP_IPV6 */
+#if LWIP_IPV4
+  if (IP_IS_V4(remote_ip)) {
+    h ^= ip4_addr_get_u32(ip_2_ip4(remote_ip));
+  }
+#endif /* LWIP_IPV4 */
+  h ^= h >> 16;
+  h *= 0x45d9f3bUL;
+  h ^= h >> 16;
+  return &tcp_tw_hash[h & (TCP_TW_HASH_SIZE - 1)];
+}
+
+/** Insert a bucket into tcp_tw_buckets, ordered by start time */
+static void
+tcp_tw_insert(struct tcp_tw *tw)
+{
+  struct tcp_tw *older = tcp_tw_youngest;
+
+  /* usually the youngest one, unless a pcb has waited in TIME-WAIT for
+     the application to close it */
+  while ((older != NULL) && ((s32_t)(tw->tmr - older->tmr) < 0)) {
+    older = older->prev;
+  }
+  tw->prev = older;
+  if (older != NULL) {
+    tw->next = older->next;
+    older->next = tw;
+  } else {
+    tw->next = tcp_tw_buckets;
+    tcp_tw_buckets = tw;
+  }
+  if (tw->next != NULL) {
+    tw->next->prev = tw;
+  } else {
+    tcp_tw_youngest = tw;
+  }
+}
+
+/** Unlink a bucket from tcp_tw_buckets */
+static void
+tcp_tw_unlink(struct tcp_tw *tw)
+{
+  if (tw->prev != NULL) {
+    tw->prev->next = tw->next;
+  } else {
+    tcp_tw_buckets = tw->next;
+  }
+  if (tw->next != NULL) {
+    tw->next->prev = tw->prev;
+  } else {
+    tcp_tw_youngest = tw->prev;
+  }
+}
+
+/**
+ * Replace a TIME-WAIT pcb that has been released by the application by a
+ * tw-bucket. If the MEMP_TCP_TW pool is empty, the oldest bucket is reused.
+ *
+ * @param pcb the pcb in TIME-WAIT (on tcp_tw_pcbs), freed on success
+ * @return ERR_OK if the pcb has been freed, ERR_MEM if it is left untouched
+ */
+err_t
+tcp_tw_enter(struct tcp_pcb *pcb)
+{
+  struct tcp_tw *tw;
+  struct tcp_tw **slot;
+
+  LWIP_ASSERT("tcp_tw_enter: pcb->state == TIME-WAIT", pcb->state == TIME_WAIT);
+
+  tw = (struct tcp_tw *)memp_malloc(MEMP_TCP_TW);
+  if ((tw == NULL) && (tcp_tw_buckets != NULL)) {
+    LWIP_DEBUGF(TCP_DEBUG, ("tcp_tw_enter: reusing oldest tw-bucket %p\n", (void *)tcp_tw_buckets));
+    tcp_tw_remove(tcp_tw_buckets);
+    tw = (struct tcp_tw *)memp_malloc(MEMP_TCP_TW);
+    if (tw != NULL) {
+      /* adjust err stats: memp_malloc failed above */
+      MEMP_STATS_DEC(err, MEMP_TCP_TW);
+    }
+  }
+  if (tw == NULL) {
+    return ERR_MEM;
+  }
+
+  ip_addr_copy(tw->local_ip, pcb->local_ip);
+  ip_addr_copy(tw->remote_ip, pcb->remote_ip);
+  tw->local_port = pcb->local_port;
+  tw->remote_port = pcb->remote_port;
+  tw->rcv_nxt = pcb->rcv_nxt;
+  tw->snd_nxt = pcb->snd_nxt;
+  tw->tmr = pcb->tmr;
+  tw->rcv_wnd = pcb->rcv_wnd;
+  tw->ann_wnd = TCPWND_MIN16(RCV_WND_SCALE(pcb, pcb->rcv_ann_wnd));
+  tw->netif_idx = pcb->netif_idx;
+  tw->flags = 0;
+#if LWIP_TCP_TIMESTAMPS
+  tw->ts_recent = pcb->ts_recent;
+  if (pcb->flags & TF_TIMESTAMP) {
+    tw->flags |= TCP_TW_FLAG_TIMESTAMP;
+  }
+#endif /* LWIP_TCP_TIMESTAMPS */
+
+  slot = tcp_tw_hash_slot(tw->local_port, &tw->remote_ip, tw->remote_port);
+  tw->hash_next = *slot;
+  *slot = tw;
+  slot = TCP_TW_PORT_SLOT(tw->local_port);
+  tw->port_next = *slot;
+  if (tw->port_next != NULL) {
+    tw->port_next->port_pprev = &tw->port_next;
+  }
+  tw->port_pprev = slot;
+  *slot = tw;
+  tcp_tw_insert(tw);
+
+  LWIP_DEBUGF(TCP_DEBUG, ("tcp_tw_enter: pcb %p -> tw-bucket %p\n", (void *)pcb, (void *)tw));
+  tcp_pcb_remove(&tcp_tw_pcbs, pcb);
+  tcp_free(pcb);
+
+  if (tcp_tw_buckets == tw) {
+    TCP_TW_OLDEST_CHANGED();
+  }
+  tcp_timer_needed();
+  return ERR_OK;
+}
+
+/**
+ * Find the tw-bucket of a connection.
+ *
+ * @param local_port local port in host byte order
+ * @param local_ip local IP address
+ * @param remote_ip remote IP address
+ * @param remote_port remote port in host byte order
+ * @return the matching tw-bucket or NULL
+ */
+struct tcp_tw *
+tcp_tw_find(u16_t local_port, const ip_addr_t *local_ip,
+            const ip_addr_t *remote_ip, u16_t remote_port)
+{
+  struct tcp_tw *tw;
+
+  for (tw = *tcp_tw_hash_slot(local_port, remote_ip, remote_port); tw != NULL; tw = tw->hash_next) {
+    if ((tw->local_port == local_port) && (tw->remote_port == remote_port) &&
+        ip_addr_eq(&tw->remote_ip, remote_ip) &&
+        ip_addr_eq(&tw->local_ip, local_ip)) {
+      return tw;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Check if a local port is used by a tw-bucket (for tcp_bind() and
+ * tcp_new_port()).
+ *
+ * @param local_port local port in host byte order
+ * @param local_ip local IP address to bind to (any matches all buckets of
+ *        the same IP version) or NULL to check all buckets
+ * @return 1 if a tw-bucket uses the port, 0 otherwise
+ */
+u8_t
+tcp_tw_port_used(u16_t local_port, const ip_addr_t *local_ip)
+{
+  struct tcp_tw *tw;
+
+  for (tw = *TCP_TW_PORT_SLOT(local_port); tw != NULL; tw = tw->port_next) {
+    if ((tw->local_port == local_port) &&
+        ((local_ip == NULL) ||
+         ((IP_IS_V6(local_ip) == IP_IS_V6_VAL(tw->local_ip)) &&
+          (ip_addr_isany(local_ip) || ip_addr_eq(&tw->local_ip, local_ip))))) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Restart the 2 MSL time-wait timeout of a bucket (retransmitted FIN).
+ *
+ * @param tw the tw-bucket
+ */
+void
+tcp_tw_restart(struct tcp_tw *tw)
+{
+  u8_t was_oldest = (tcp_tw_buckets == tw);
+
+  tw->tmr = tcp_now();
+  tcp_tw_unlink(tw);
+  tcp_tw_insert(tw);
+  if (was_oldest) {
+    TCP_TW_OLDEST_CHANGED();
+  }
+}
+
+/**
+ * Remove a tw-bucket and return it to its pool.
+ *
+ * @param tw the tw-bucket
+ */
+void
+tcp_tw_remove(struct tcp_tw *tw)
+{
+  struct tcp_tw **slot;
+  u8_t was_oldest = (tcp_tw_buckets == tw);
+
+  for (slot = tcp_tw_hash_slot(tw->local_port, &tw->remote_ip, tw->remote_port);
+       *slot != NULL; slot = &(*slot)->hash_next) {
+    if (*slot == tw) {
+      *slot = tw->hash_next;
+      break;
+    }
+  }
+  *tw->port_pprev = tw->port_next;
+  if (tw->port_next != NULL) {
+    tw->port_next->port_pprev = tw->port_pprev;
+  }
+  tcp_tw_unlink(tw);
+  memp_free(MEMP_TCP_TW, tw);
+  if (was_oldest) {
+    TCP_TW_OLDEST_CHANGED();
+  }
+}
+
+/** Remove all buckets that have been in TIME-WAIT for 2 MSL */
+static void
+tcp_tw_expire(void)
+{
+  while ((tcp_tw_buckets != NULL) && TCP_TW_EXPIRED(tcp_tw_buckets)) {
+    LWIP_DEBUGF(TCP_DEBUG, ("tcp_tw_expire: removing tw-bucket %p\n", (void *)tcp_tw_buckets));
+    tcp_tw_remove(tcp_tw_buckets);
+  }
+}
+
+#if LWIP_TCP_PCB_TIMERS
+/** Timer callback: expire the oldest buckets */
+static void
+tcp_tw_timeout(void *arg)
+{
+  LWIP_UNUSED_ARG(arg);
+  tcp_tw_expire();
+  tcp_tw_arm();
+}
+
+/** Arm the bucket timer to the expiry of the oldest bucket */
+static void
+tcp_tw_arm(void)
+{
+  if (tcp_tw_buckets != NULL) {
+    s32_t left = (s32_t)(tcp_tw_buckets->tmr + (u32_t)(2 * TCP_MSL) - tcp_now());
+    sys_timeout_start(&tcp_tw_timer, (left > 0) ? (u32_t)left : 0, tcp_tw_timeout, NULL);
+  } else {
+    sys_timeout_stop(&tcp_tw_timer);
+  }
+}
+#else /* LWIP_TCP_PCB_TIMERS */
+/** Called from tcp_slowtmr(): expire the oldest buckets */
+void
+tcp_tw_tmr(void)
+{
+  tcp_tw_expire();
+}
+#endif /* LWIP_TCP_PCB_TIMERS */
+
+#endif /* LWIP_TCP && LWIP_TCP_TW_BUCKETS */
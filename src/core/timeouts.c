@@ -118,11 +118,293 @@ const int lwip_num_cyclic_timers = LWIP_ARRAYSIZE(lwip_cyclic_timers);
 
 #if LWIP_TIMERS && !LWIP_TIMERS_CUSTOM
 
+#if LWIP_TIMERS_WHEEL
+/*
+ * Hierarchical timer wheel: level n has 32 slots of 32^n ms each. A timeout
+ * is linked to the level its remaining time fits in, level 0 slots hold the
+ * timeouts due in one specific millisecond. When the wheel time reaches a
+ * multiple of 32^n, the level n slot starting there is moved down to the
+ * lower levels ("cascade").
+ */
+#define TIMEOUTS_WHEEL_BITS     5
+#define TIMEOUTS_WHEEL_SIZE     (1 << TIMEOUTS_WHEEL_BITS)
+#define TIMEOUTS_WHEEL_MASK     ((u32_t)TIMEOUTS_WHEEL_SIZE - 1)
+/** 6 levels cover 2^30 ms, more than sys_timeout() accepts */
+#define TIMEOUTS_WHEEL_LEVELS   6
+#define TIMEOUTS_WHEEL_SHIFT(level) ((level) * TIMEOUTS_WHEEL_BITS)
+
+/** The timeout lists, one per slot */
+static struct sys_timeo *timeouts_wheel[TIMEOUTS_WHEEL_LEVELS][TIMEOUTS_WHEEL_SIZE];
+/** bit n of entry m set: timeouts_wheel[m][n] is not empty */
+static u32_t timeouts_wheel_map[TIMEOUTS_WHEEL_LEVELS];
+/** all timeouts due before this time have expired */
+static u32_t timeouts_wheel_time;
+
+#if defined(__GNUC__)
+#define timeouts_wheel_ffs(x)   ((u32_t)__builtin_ctz(x))
+#else /* __GNUC__ */
+/** index of the least significant bit set in x (x != 0) */
+static u32_t
+timeouts_wheel_ffs(u32_t x)
+{
+  u32_t n = 0;
+  while ((x & 1) == 0) {
+    x >>= 1;
+    n++;
+  }
+  return n;
+}
+#endif /* __GNUC__ */
+
+/** rotate a slot bitmap right, i.e. make bit n the first one */
+#define timeouts_wheel_ror(map, n) (((n) == 0) ? (map) : (((map) >> (n)) | ((map) << (TIMEOUTS_WHEEL_SIZE - (n)))))
+
+static int
+timeouts_wheel_empty(void)
+{
+  int level;
+  for (level = 0; level < TIMEOUTS_WHEEL_LEVELS; level++) {
+    if (timeouts_wheel_map[level] != 0) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/** Link a timeout to the slot its due time maps to, relative to the wheel time */
+static void
+timeouts_wheel_place(struct sys_timeo *timeout)
+{
+  struct sys_timeo **head;
+  u32_t slot;
+  int level = 0;
+
+  if (TIME_LESS_THAN(timeout->time, timeouts_wheel_time)) {
+    /* overdue: expire with the current slot */
+    slot = timeouts_wheel_time & TIMEOUTS_WHEEL_MASK;
+  } else {
+    u32_t delta = timeout->time - timeouts_wheel_time;
+    while ((level < TIMEOUTS_WHEEL_LEVELS - 1) &&
+           (delta >= ((u32_t)1 << TIMEOUTS_WHEEL_SHIFT(level + 1)))) {
+      level++;
+    }
+    slot = (timeout->time >> TIMEOUTS_WHEEL_SHIFT(level)) & TIMEOUTS_WHEEL_MASK;
+  }
+  head = &timeouts_wheel[level][slot];
+  timeout->next = *head;
+  if (timeout->next != NULL) {
+    timeout->next->pprev = &timeout->next;
+  }
+  *head = timeout;
+  timeout->pprev = head;
+  timeout->wheel_pos = (u8_t)(((u32_t)level << TIMEOUTS_WHEEL_BITS) + slot);
+  timeouts_wheel_map[level] |= (u32_t)1 << slot;
+}
+
+static void
+timeouts_insert(struct sys_timeo *timeout)
+{
+  if (timeouts_wheel_empty()) {
+    /* nothing to catch up with */
+    timeouts_wheel_time = sys_now();
+  }
+  timeouts_wheel_place(timeout);
+}
+
+static void
+timeouts_remove(struct sys_timeo *timeout)
+{
+  int level = timeout->wheel_pos >> TIMEOUTS_WHEEL_BITS;
+  u32_t slot = timeout->wheel_pos & TIMEOUTS_WHEEL_MASK;
+
+  *timeout->pprev = timeout->next;
+  if (timeout->next != NULL) {
+    timeout->next->pprev = timeout->pprev;
+  }
+  if (timeouts_wheel[level][slot] == NULL) {
+    timeouts_wheel_map[level] &= ~((u32_t)1 << slot);
+  }
+}
+
+/** Move the slots starting at the current wheel time down the wheel */
+static void
+timeouts_wheel_cascade(void)
+{
+  struct sys_timeo *t, *next;
+  u32_t slot;
+  int level;
+
+  for (level = 1; level < TIMEOUTS_WHEEL_LEVELS; level++) {
+    if ((timeouts_wheel_time & (((u32_t)1 << TIMEOUTS_WHEEL_SHIFT(level)) - 1)) != 0) {
+      break;
+    }
+    slot = (timeouts_wheel_time >> TIMEOUTS_WHEEL_SHIFT(level)) & TIMEOUTS_WHEEL_MASK;
+    t = timeouts_wheel[level][slot];
+    timeouts_wheel[level][slot] = NULL;
+    timeouts_wheel_map[level] &= ~((u32_t)1 << slot);
+    for (; t != NULL; t = next) {
+      next = t->next;
+      timeouts_wheel_place(t);
+    }
+  }
+}
+
+/** Unlink and return a timeout that is due at 'now', NULL if there is none */
+static struct sys_timeo *
+timeouts_next_expired(u32_t now)
+{
+  struct sys_timeo *t;
+  u32_t slot, step, map;
+  int level;
+
+  while (!timeouts_wheel_empty() && !TIME_LESS_THAN(now, timeouts_wheel_time)) {
+    slot = timeouts_wheel_time & TIMEOUTS_WHEEL_MASK;
+    t = timeouts_wheel[0][slot];
+    if (t != NULL) {
+      timeouts_remove(t);
+      return t;
+    }
+    if (timeouts_wheel_time == now) {
+      break;
+    }
+    /* nothing due now: skip to the next slot in use in this round of level 0
+       or to the next cascade of the lowest level in use */
+    map = timeouts_wheel_map[0] & ~(((u32_t)2 << slot) - 1);
+    if (map != 0) {
+      step = timeouts_wheel_ffs(map) - slot;
+    } else {
+      for (level = 1; (level < TIMEOUTS_WHEEL_LEVELS - 1) && (timeouts_wheel_map[0] == 0) &&
+           (timeouts_wheel_map[level] == 0); level++) {
+      }
+      step = ((u32_t)1 << TIMEOUTS_WHEEL_SHIFT(level)) -
+             (timeouts_wheel_time & (((u32_t)1 << TIMEOUTS_WHEEL_SHIFT(level)) - 1));
+    }
+    if (step > (u32_t)(now - timeouts_wheel_time)) {
+      step = (u32_t)(now - timeouts_wheel_time);
+    }
+    timeouts_wheel_time += step;
+    if ((timeouts_wheel_time & TIMEOUTS_WHEEL_MASK) == 0) {
+      timeouts_wheel_cascade();
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Get the time the next timeout is due: exact for timeouts in level 0,
+ * the time of the cascade of their slot for higher levels.
+ *
+ * @return 0 if there is no timeout
+ */
+static int
+timeouts_next_due(u32_t *due)
+{
+  u32_t best = LWIP_UINT32_MAX;
+  u32_t cur, dist, shift;
+  int level;
+
+  if (timeouts_wheel_empty()) {
+    return 0;
+  }
+  for (level = 0; level < TIMEOUTS_WHEEL_LEVELS; level++) {
+    if (timeouts_wheel_map[level] == 0) {
+      continue;
+    }
+    shift = (u32_t)TIMEOUTS_WHEEL_SHIFT(level);
+    cur = (timeouts_wheel_time >> shift) & TIMEOUTS_WHEEL_MASK;
+    if (level == 0) {
+      /* first slot in use, starting at the current one */
+      dist = timeouts_wheel_ffs(timeouts_wheel_ror(timeouts_wheel_map[0], cur));
+    } else {
+      /* first slot in use after the current one, it is cascaded at the start
+         of its block */
+      cur = (cur + 1) & TIMEOUTS_WHEEL_MASK;
+      dist = ((timeouts_wheel_ffs(timeouts_wheel_ror(timeouts_wheel_map[level], cur)) + 1) << shift) -
+             (timeouts_wheel_time & (((u32_t)1 << shift) - 1));
+    }
+    if (dist < best) {
+      best = dist;
+    }
+  }
+  *due = timeouts_wheel_time + best;
+  return 1;
+}
+
+/** Find the first timeout due matching handler and arg */
+static struct sys_timeo *
+timeouts_find(sys_timeout_handler handler, void *arg)
+{
+  struct sys_timeo *t, *found = NULL;
+  int level, slot;
+
+  for (level = 0; level < TIMEOUTS_WHEEL_LEVELS; level++) {
+    if (timeouts_wheel_map[level] == 0) {
+      continue;
+    }
+    for (slot = 0; slot < TIMEOUTS_WHEEL_SIZE; slot++) {
+      for (t = timeouts_wheel[level][slot]; t != NULL; t = t->next) {
+        if ((t->h == handler) && (t->arg == arg) &&
+            ((found == NULL) || TIME_LESS_THAN(t->time, found->time))) {
+          found = t;
+        }
+      }
+    }
+  }
+  return found;
+}
+
+/** Unlink all timeouts from the wheel and return them as a list */
+static struct sys_timeo *
+timeouts_wheel_take_all(void)
+{
+  struct sys_timeo *list = NULL, *t, *next;
+  int level, slot;
+
+  for (level = 0; level < TIMEOUTS_WHEEL_LEVELS; level++) {
+    for (slot = 0; slot < TIMEOUTS_WHEEL_SIZE; slot++) {
+      for (t = timeouts_wheel[level][slot]; t != NULL; t = next) {
+        next = t->next;
+        t->next = list;
+        list = t;
+      }
+      timeouts_wheel[level][slot] = NULL;
+    }
+    timeouts_wheel_map[level] = 0;
+  }
+  return list;
+}
+
+/** Link a list of timeouts to the wheel */
+static void
+timeouts_wheel_put_all(struct sys_timeo *list)
+{
+  struct sys_timeo *next;
+
+  for (; list != NULL; list = next) {
+    next = list->next;
+    timeouts_insert(list);
+  }
+}
+
+#if LWIP_TESTMODE
+struct sys_timeo*
+sys_timeouts_take_all(void)
+{
+  return timeouts_wheel_take_all();
+}
+
+void
+sys_timeouts_put_all(struct sys_timeo *list)
+{
+  timeouts_wheel_put_all(list);
+}
+#endif
+
+#else /* LWIP_TIMERS_WHEEL */
+
 /** The one and only timeout list */
 static struct sys_timeo *next_timeout;
 
-static u32_t current_timeout_due_time;
-
 #if LWIP_TESTMODE
 struct sys_timeo**
 sys_timeouts_get_next_timeout(void)
@@ -131,10 +413,99 @@ sys_timeouts_get_next_timeout(void)
 }
 #endif
 
-#if LWIP_TCP
+/** Insert a timeout into the list, sorted by due time */
+static void
+timeouts_insert(struct sys_timeo *timeout)
+{
+  struct sys_timeo *t;
+
+  timeout->next = NULL;
+  if (next_timeout == NULL) {
+    next_timeout = timeout;
+    return;
+  }
+  if (TIME_LESS_THAN(timeout->time, next_timeout->time)) {
+    timeout->next = next_timeout;
+    next_timeout = timeout;
+  } else {
+    for (t = next_timeout; t != NULL; t = t->next) {
+      if ((t->next == NULL) || TIME_LESS_THAN(timeout->time, t->next->time)) {
+        timeout->next = t->next;
+        t->next = timeout;
+        break;
+      }
+    }
+  }
+}
+
+static void
+timeouts_remove(struct sys_timeo *timeout)
+{
+  struct sys_timeo **t;
+
+  for (t = &next_timeout; *t != NULL; t = &(*t)->next) {
+    if (*t == timeout) {
+      *t = timeout->next;
+      return;
+    }
+  }
+}
+
+/** Unlink and return a timeout that is due at 'now', NULL if there is none */
+static struct sys_timeo *
+timeouts_next_expired(u32_t now)
+{
+  struct sys_timeo *t = next_timeout;
+
+  if ((t == NULL) || TIME_LESS_THAN(now, t->time)) {
+    return NULL;
+  }
+  next_timeout = t->next;
+  return t;
+}
+
+/**
+ * Get the time the next timeout is due.
+ *
+ * @return 0 if there is no timeout
+ */
+static int
+timeouts_next_due(u32_t *due)
+{
+  if (next_timeout == NULL) {
+    return 0;
+  }
+  *due = next_timeout->time;
+  return 1;
+}
+
+/** Find the first timeout due matching handler and arg */
+static struct sys_timeo *
+timeouts_find(sys_timeout_handler handler, void *arg)
+{
+  struct sys_timeo *t;
+
+  for (t = next_timeout; t != NULL; t = t->next) {
+    if ((t->h == handler) && (t->arg == arg)) {
+      return t;
+    }
+  }
+  return NULL;
+}
+#endif /* LWIP_TIMERS_WHEEL */
+
+static u32_t current_timeout_due_time;
+
+#if LWIP_TCP && !LWIP_TCP_PCB_TIMERS
 /** global variable that shows if the tcp timer is currently scheduled or not */
 static int tcpip_tcp_timer_active;
 
+#if LWIP_TCP_TW_BUCKETS
+#define TCP_TIMER_PCBS_PENDING() (tcp_active_pcbs || tcp_tw_pcbs || tcp_tw_buckets)
+#else /* LWIP_TCP_TW_BUCKETS */
+#define TCP_TIMER_PCBS_PENDING() (tcp_active_pcbs || tcp_tw_pcbs)
+#endif /* LWIP_TCP_TW_BUCKETS */
+
 /**
  * Timer callback function that calls tcp_tmr() and reschedules itself.
  *
@@ -148,7 +519,7 @@ tcpip_tcp_timer(void *arg)
   /* call TCP timer handler */
   tcp_tmr();
   /* timer still needed? */
-  if (tcp_active_pcbs || tcp_tw_pcbs) {
+  if (TCP_TIMER_PCBS_PENDING()) {
     /* restart timer */
     sys_timeout(TCP_TMR_INTERVAL, tcpip_tcp_timer, NULL);
   } else {
@@ -168,13 +539,22 @@ tcp_timer_needed(void)
   LWIP_ASSERT_CORE_LOCKED();
 
   /* timer is off but needed again? */
-  if (!tcpip_tcp_timer_active && (tcp_active_pcbs || tcp_tw_pcbs)) {
+  if (!tcpip_tcp_timer_active && TCP_TIMER_PCBS_PENDING()) {
     /* enable and start timer */
     tcpip_tcp_timer_active = 1;
     sys_timeout(TCP_TMR_INTERVAL, tcpip_tcp_timer, NULL);
   }
 }
-#endif /* LWIP_TCP */
+#elif LWIP_TCP /* LWIP_TCP && !LWIP_TCP_PCB_TIMERS */
+/**
+ * Called from TCP_REG when registering a new PCB: nothing to do since
+ * every pcb runs its own timer (LWIP_TCP_PCB_TIMERS).
+ */
+void
+tcp_timer_needed(void)
+{
+}
+#endif /* LWIP_TCP && !LWIP_TCP_PCB_TIMERS */
 
 static void
 #if LWIP_DEBUG_TIMERNAMES
@@ -183,7 +563,7 @@ sys_timeout_abs(u32_t abs_time, sys_timeout_handler handler, void *arg, const ch
 sys_timeout_abs(u32_t abs_time, sys_timeout_handler handler, void *arg)
 #endif
 {
-  struct sys_timeo *timeout, *t;
+  struct sys_timeo *timeout;
 
   timeout = (struct sys_timeo *)memp_malloc(MEMP_SYS_TIMEOUT);
   if (timeout == NULL) {
@@ -191,7 +571,7 @@ sys_timeout_abs(u32_t abs_time, sys_timeout_handler handler, void *arg)
     return;
   }
 
-  timeout->next = NULL;
+  timeout->flags = 0;
   timeout->h = handler;
   timeout->arg = arg;
   timeout->time = abs_time;
@@ -202,22 +582,7 @@ sys_timeout_abs(u32_t abs_time, sys_timeout_handler handler, void *arg)
                              (void *)timeout, abs_time, handler_name, (void *)arg));
 #endif /* LWIP_DEBUG_TIMERNAMES */
 
-  if (next_timeout == NULL) {
-    next_timeout = timeout;
-    return;
-  }
-  if (TIME_LESS_THAN(timeout->time, next_timeout->time)) {
-    timeout->next = next_timeout;
-    next_timeout = timeout;
-  } else {
-    for (t = next_timeout; t != NULL; t = t->next) {
-      if ((t->next == NULL) || TIME_LESS_THAN(timeout->time, t->next->time)) {
-        timeout->next = t->next;
-        t->next = timeout;
-        break;
-      }
-    }
-  }
+  timeouts_insert(timeout);
 }
 
 /**
@@ -305,6 +670,61 @@ sys_timeout(u32_t msecs, sys_timeout_handler handler, void *arg)
 #endif
 }
 
+/**
+ * Start a timeout owned by the caller: like sys_timeout(), but the timeout
+ * is not allocated from MEMP_SYS_TIMEOUT and can be stopped without having
+ * to search for it (see sys_timeout_stop()). If the timeout is already
+ * pending, it is restarted.
+ *
+ * @param timeout the timeout to start, must be zeroed before first use
+ * @param msecs time in milliseconds after that the timer should expire
+ * @param handler callback function to call when msecs have elapsed
+ * @param arg argument to pass to the callback function
+ */
+#if LWIP_DEBUG_TIMERNAMES
+void
+sys_timeout_start_debug(struct sys_timeo *timeout, u32_t msecs, sys_timeout_handler handler, void *arg, const char *handler_name)
+#else /* LWIP_DEBUG_TIMERNAMES */
+void
+sys_timeout_start(struct sys_timeo *timeout, u32_t msecs, sys_timeout_handler handler, void *arg)
+#endif /* LWIP_DEBUG_TIMERNAMES */
+{
+  LWIP_ASSERT_CORE_LOCKED();
+
+  LWIP_ASSERT("Timeout time too long, max is LWIP_UINT32_MAX/4 msecs", msecs <= (LWIP_UINT32_MAX / 4));
+
+  if (sys_timeout_pending(timeout)) {
+    timeouts_remove(timeout);
+  }
+  timeout->flags = SYS_TIMEO_FLAG_STATIC | SYS_TIMEO_FLAG_PENDING;
+  timeout->h = handler;
+  timeout->arg = arg;
+  timeout->time = (u32_t)(sys_now() + msecs); /* overflow handled by TIME_LESS_THAN macro */
+#if LWIP_DEBUG_TIMERNAMES
+  timeout->handler_name = handler_name;
+  LWIP_DEBUGF(TIMERS_DEBUG, ("sys_timeout_start: %p msecs=%"U32_F" handler=%s arg=%p\n",
+                             (void *)timeout, msecs, handler_name, (void *)arg));
+#endif /* LWIP_DEBUG_TIMERNAMES */
+  timeouts_insert(timeout);
+}
+
+/**
+ * Stop a timeout started with sys_timeout_start(). Nothing happens if it is
+ * not pending (it has already expired or been stopped).
+ *
+ * @param timeout the timeout to stop
+ */
+void
+sys_timeout_stop(struct sys_timeo *timeout)
+{
+  LWIP_ASSERT_CORE_LOCKED();
+
+  if (sys_timeout_pending(timeout)) {
+    timeouts_remove(timeout);
+    timeout->flags &= (u8_t)~SYS_TIMEO_FLAG_PENDING;
+  }
+}
+
 /**
  * Go through timeout list (for this task only) and remove the first matching
  * entry (subsequent entries remain untouched), even though the timeout has not
@@ -316,28 +736,20 @@ sys_timeout(u32_t msecs, sys_timeout_handler handler, void *arg)
 void
 sys_untimeout(sys_timeout_handler handler, void *arg)
 {
-  struct sys_timeo *prev_t, *t;
+  struct sys_timeo *t;
 
   LWIP_ASSERT_CORE_LOCKED();
 
-  if (next_timeout == NULL) {
-    return;
-  }
-
-  for (t = next_timeout, prev_t = NULL; t != NULL; prev_t = t, t = t->next) {
-    if ((t->h == handler) && (t->arg == arg)) {
-      /* We have a match */
-      /* Unlink from previous in list */
-      if (prev_t == NULL) {
-        next_timeout = t->next;
-      } else {
-        prev_t->next = t->next;
-      }
+  t = timeouts_find(handler, arg);
+  if (t != NULL) {
+    /* We have a match */
+    timeouts_remove(t);
+    if (t->flags & SYS_TIMEO_FLAG_STATIC) {
+      t->flags &= (u8_t)~SYS_TIMEO_FLAG_PENDING;
+    } else {
       memp_free(MEMP_SYS_TIMEOUT, t);
-      return;
     }
   }
-  return;
 }
 
 /**
@@ -365,17 +777,12 @@ sys_check_timeouts(void)
 
     PBUF_CHECK_FREE_OOSEQ();
 
-    tmptimeout = next_timeout;
+    tmptimeout = timeouts_next_expired(now);
     if (tmptimeout == NULL) {
       return;
     }
 
-    if (TIME_LESS_THAN(now, tmptimeout->time)) {
-      return;
-    }
-
     /* Timeout has expired */
-    next_timeout = tmptimeout->next;
     handler = tmptimeout->h;
     arg = tmptimeout->arg;
     current_timeout_due_time = tmptimeout->time;
@@ -385,7 +792,11 @@ sys_check_timeouts(void)
                                  tmptimeout->handler_name, sys_now() - tmptimeout->time, arg));
     }
 #endif /* LWIP_DEBUG_TIMERNAMES */
-    memp_free(MEMP_SYS_TIMEOUT, tmptimeout);
+    if (tmptimeout->flags & SYS_TIMEO_FLAG_STATIC) {
+      tmptimeout->flags &= (u8_t)~SYS_TIMEO_FLAG_PENDING;
+    } else {
+      memp_free(MEMP_SYS_TIMEOUT, tmptimeout);
+    }
     if (handler != NULL) {
       handler(arg);
     }
@@ -406,6 +817,26 @@ sys_restart_timeouts(void)
   u32_t now;
   u32_t base;
   struct sys_timeo *t;
+#if LWIP_TIMERS_WHEEL
+  struct sys_timeo *list;
+
+  list = timeouts_wheel_take_all();
+  if (list == NULL) {
+    return;
+  }
+
+  now = sys_now();
+  base = list->time;
+  for (t = list; t != NULL; t = t->next) {
+    if (TIME_LESS_THAN(t->time, base)) {
+      base = t->time;
+    }
+  }
+  for (t = list; t != NULL; t = t->next) {
+    t->time = (t->time - base) + now;
+  }
+  timeouts_wheel_put_all(list);
+#else /* LWIP_TIMERS_WHEEL */
 
   if (next_timeout == NULL) {
     return;
@@ -417,6 +848,7 @@ sys_restart_timeouts(void)
   for (t = next_timeout; t != NULL; t = t->next) {
     t->time = (t->time - base) + now;
   }
+#endif /* LWIP_TIMERS_WHEEL */
 }
 
 /** Return the time left before the next timeout is due. If no timeouts are
@@ -426,17 +858,18 @@ u32_t
 sys_timeouts_sleeptime(void)
 {
   u32_t now;
+  u32_t due;
 
   LWIP_ASSERT_CORE_LOCKED();
 
-  if (next_timeout == NULL) {
+  if (!timeouts_next_due(&due)) {
     return SYS_TIMEOUTS_SLEEPTIME_INFINITE;
   }
   now = sys_now();
-  if (TIME_LESS_THAN(next_timeout->time, now)) {
+  if (TIME_LESS_THAN(due, now)) {
     return 0;
   } else {
-    u32_t ret = (u32_t)(next_timeout->time - now);
+    u32_t ret = (u32_t)(due - now);
     LWIP_ASSERT("invalid sleeptime", ret <= LWIP_MAX_TIMEOUT);
     return ret;
   }
@@ -80,6 +80,22 @@ static u16_t udp_port = UDP_LOCAL_PORT_RANGE_START;
 /* exported in udp.h (was static) */
 struct udp_pcb *udp_pcbs;
 
+#if LWIP_UDP_PCB_HASH
+/* Bound UDP PCBs hashed by local port, chained through pcb->hash_next.
+   Like udp_pcbs without the hash table, a bucket gets new pcbs and pcbs
+   matched by udp_input() at the front, and a pcb rebound to its port keeps
+   its place. Only a pcb rebound to another port differs: it goes to the
+   front of its new bucket, while it keeps its place in udp_pcbs. */
+static struct udp_pcb *udp_pcbs_hash[UDP_PCB_HASH_SIZE];
+#define UDP_PCB_HASH_BUCKET(port) udp_pcbs_hash[((port) ^ ((port) >> 8)) & (UDP_PCB_HASH_SIZE - 1)]
+/** Iterate over all pcbs that may be bound to 'port' */
+#define UDP_PCB_FOREACH_PORT(pcb, port) \
+  for ((pcb) = UDP_PCB_HASH_BUCKET(port); (pcb) != NULL; (pcb) = (pcb)->hash_next)
+#else /* LWIP_UDP_PCB_HASH */
+#define UDP_PCB_FOREACH_PORT(pcb, port) \
+  for ((pcb) = udp_pcbs; (pcb) != NULL; (pcb) = (pcb)->next)
+#endif /* LWIP_UDP_PCB_HASH */
+
 /**
  * Initialize this module.
  */
@@ -107,7 +123,7 @@ again:
     udp_port = UDP_LOCAL_PORT_RANGE_START;
   }
   /* Check all PCBs. */
-  for (pcb = udp_pcbs; pcb != NULL; pcb = pcb->next) {
+  UDP_PCB_FOREACH_PORT(pcb, udp_port) {
     if (pcb->local_port == udp_port) {
       if (++n > (UDP_LOCAL_PORT_RANGE_END - UDP_LOCAL_PORT_RANGE_START)) {
         return 0;
@@ -118,6 +134,36 @@ again:
   return udp_port;
 }
 
+#if LWIP_UDP_PCB_HASH
+/** Insert a pcb at the front of the hash bucket of its local port */
+static void
+udp_pcb_hash_add(struct udp_pcb *pcb)
+{
+  pcb->hash_next = UDP_PCB_HASH_BUCKET(pcb->local_port);
+  UDP_PCB_HASH_BUCKET(pcb->local_port) = pcb;
+}
+
+/** Remove a pcb from the hash bucket of its local port (if it is in there) */
+static void
+udp_pcb_hash_remove(struct udp_pcb *pcb)
+{
+  struct udp_pcb **ppcb;
+
+  for (ppcb = &UDP_PCB_HASH_BUCKET(pcb->local_port); *ppcb != NULL; ppcb = &(*ppcb)->hash_next) {
+    if (*ppcb == pcb) {
+      *ppcb = pcb->hash_next;
+      break;
+    }
+  }
+  pcb->hash_next = NULL;
+}
+#define UDP_PCB_HASH_ADD(pcb) udp_pcb_hash_add(pcb)
+#define UDP_PCB_HASH_RMV(pcb) udp_pcb_hash_remove(pcb)
+#else /* LWIP_UDP_PCB_HASH */
+#define UDP_PCB_HASH_ADD(pcb)
+#define UDP_PCB_HASH_RMV(pcb)
+#endif /* LWIP_UDP_PCB_HASH */
+
 /** Common code to see if the current input packet matches the pcb
  * (current input packet is accessed via ip(4/6)_current_* macros)
  *
@@ -250,7 +296,7 @@ udp_input(struct pbuf *p, struct netif *inp)
    * 'Perfect match' pcbs (connected to the remote port & ip address) are
    * preferred. If no perfect match is found, the first unconnected pcb that
    * matches the local port and ip address gets the datagram. */
-  for (pcb = udp_pcbs; pcb != NULL; pcb = pcb->next) {
+  UDP_PCB_FOREACH_PORT(pcb, dest) {
     /* print the PCB local and remote address */
     LWIP_DEBUGF(UDP_DEBUG, ("pcb ("));
     ip_addr_debug_print_val(UDP_DEBUG, pcb->local_ip);
@@ -291,11 +337,19 @@ udp_input(struct pbuf *p, struct netif *inp)
            ip_addr_eq(&pcb->remote_ip, ip_current_src_addr()))) {
         /* the first fully matching PCB */
         if (prev != NULL) {
+#if LWIP_UDP_PCB_HASH
+          /* move the pcb to the front of its hash bucket so that is
+             found faster next time */
+          prev->hash_next = pcb->hash_next;
+          pcb->hash_next = UDP_PCB_HASH_BUCKET(dest);
+          UDP_PCB_HASH_BUCKET(dest) = pcb;
+#else /* LWIP_UDP_PCB_HASH */
           /* move the pcb to the front of udp_pcbs so that is
              found faster next time */
           prev->next = pcb->next;
           pcb->next = udp_pcbs;
           udp_pcbs = pcb;
+#endif /* LWIP_UDP_PCB_HASH */
         } else {
           UDP_STATS_INC(udp.cachehit);
         }
@@ -380,7 +434,7 @@ udp_input(struct pbuf *p, struct netif *inp)
         /* pass broadcast- or multicast packets to all multicast pcbs
            if SOF_REUSEADDR is set on the first match */
         struct udp_pcb *mpcb;
-        for (mpcb = udp_pcbs; mpcb != NULL; mpcb = mpcb->next) {
+        UDP_PCB_FOREACH_PORT(mpcb, dest) {
           if (mpcb != pcb) {
             /* compare PCB local addr+port to UDP destination addr+port */
             if ((mpcb->local_port == dest) &&
@@ -956,7 +1010,7 @@ udp_bind(struct udp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port)
 
   rebind = 0;
   /* Check for double bind and rebind of the same pcb */
-  for (ipcb = udp_pcbs; ipcb != NULL; ipcb = ipcb->next) {
+  UDP_PCB_FOREACH_PORT(ipcb, pcb->local_port) {
     /* is this UDP PCB already on active list? */
     if (pcb == ipcb) {
       rebind = 1;
@@ -985,7 +1039,7 @@ udp_bind(struct udp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port)
       return ERR_USE;
     }
   } else {
-    for (ipcb = udp_pcbs; ipcb != NULL; ipcb = ipcb->next) {
+    UDP_PCB_FOREACH_PORT(ipcb, port) {
       if (pcb != ipcb) {
         /* By default, we don't allow to bind to a port that any other udp
            PCB is already bound to, unless *all* PCBs with that port have tha
@@ -1016,6 +1070,12 @@ udp_bind(struct udp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port)
 
   ip_addr_set_ipaddr(&pcb->local_ip, ipaddr);
 
+  if ((rebind != 0) && (pcb->local_port != port)) {
+    /* the pcb is hashed by its old port */
+    UDP_PCB_HASH_RMV(pcb);
+    pcb->local_port = port;
+    UDP_PCB_HASH_ADD(pcb);
+  }
   pcb->local_port = port;
   mib2_udp_bind(pcb);
   /* pcb not active yet? */
@@ -1023,6 +1083,7 @@ udp_bind(struct udp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port)
     /* place the PCB on the active list if not already there */
     pcb->next = udp_pcbs;
     udp_pcbs = pcb;
+    UDP_PCB_HASH_ADD(pcb);
   }
   LWIP_DEBUGF(UDP_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_STATE, ("udp_bind: bound to "));
   ip_addr_debug_print_val(UDP_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_STATE, pcb->local_ip);
@@ -1107,7 +1168,7 @@ udp_connect(struct udp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port)
   LWIP_DEBUGF(UDP_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_STATE, (", port %"U16_F")\n", pcb->remote_port));
 
   /* Insert UDP PCB into the list of active UDP PCBs. */
-  for (ipcb = udp_pcbs; ipcb != NULL; ipcb = ipcb->next) {
+  UDP_PCB_FOREACH_PORT(ipcb, pcb->local_port) {
     if (pcb == ipcb) {
       /* already on the list, just return */
       return ERR_OK;
@@ -1116,6 +1177,7 @@ udp_connect(struct udp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port)
   /* PCB not yet on the list, add PCB now */
   pcb->next = udp_pcbs;
   udp_pcbs = pcb;
+  UDP_PCB_HASH_ADD(pcb);
   return ERR_OK;
 }
 
@@ -1189,6 +1251,7 @@ udp_remove(struct udp_pcb *pcb)
   LWIP_ERROR("udp_remove: invalid pcb", pcb != NULL, return);
 
   mib2_udp_unbind(pcb);
+  UDP_PCB_HASH_RMV(pcb);
   /* pcb to be removed is first in list? */
   if (udp_pcbs == pcb) {
     /* make list start at 2nd pcb */
@@ -115,6 +115,9 @@ err_t altcp_close(struct altcp_pcb *conn);
 err_t altcp_shutdown(struct altcp_pcb *conn, int shut_rx, int shut_tx);
 
 err_t altcp_write(struct altcp_pcb *conn, const void *dataptr, u16_t len, u8_t apiflags);
+#if LWIP_TCP_WRITE_REF
+err_t altcp_write_ref(struct altcp_pcb *conn, const void *dataptr, u16_t len, u8_t apiflags, struct pbuf *ref);
+#endif
 err_t altcp_output(struct altcp_pcb *conn);
 
 u16_t altcp_mss(struct altcp_pcb *conn);
@@ -185,6 +188,7 @@ enum tcp_state altcp_dbg_get_tcp_state(struct altcp_pcb *conn);
 #define altcp_shutdown tcp_shutdown
 
 #define altcp_write tcp_write
+#define altcp_write_ref tcp_write_ref
 #define altcp_output tcp_output
 
 #define altcp_mss tcp_mss
@@ -0,0 +1,89 @@
+/**
+ * @file
+ * IPv4 routing table (FIB) with longest-prefix match
+ */
+
+/*
+ * Copyright (c) 2001-2004 Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ *
+ */
+
+#ifndef LWIP_HDR_IP4_FIB_H
+#define LWIP_HDR_IP4_FIB_H
+
+#include "lwip/opt.h"
+
+#if LWIP_IPV4 && LWIP_IPV4_FIB /* don't build if not configured for use in lwipopts.h */
+
+#include "lwip/err.h"
+#include "lwip/ip4_addr.h"
+#include "lwip/netif.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** A node of the routing table trie: a route or a branch between prefixes.
+ * This is exported because memp needs to know the size.
+ */
+struct ip4_fib_node {
+  /** more specific prefixes, by the first bit after prefix_len */
+  struct ip4_fib_node *child[2];
+  /** prefix in host byte order, the bits after prefix_len are 0 */
+  u32_t prefix;
+  u8_t prefix_len;
+  /** 0 for a branch node */
+  u8_t is_route;
+  /** route: the netif to send on and the next hop (any: on-link) */
+  struct netif *netif;
+  ip4_addr_t gw;
+};
+
+err_t ip4_fib_add(const ip4_addr_t *prefix, u8_t prefix_len, const ip4_addr_t *gw, struct netif *netif);
+err_t ip4_fib_delete(const ip4_addr_t *prefix, u8_t prefix_len);
+struct netif *ip4_fib_lookup(const ip4_addr_t *dest, ip4_addr_t *gw);
+
+/* used by the stack */
+struct netif *ip4_fib_route(const ip4_addr_t *dest);
+const ip4_addr_t *ip4_fib_gateway(struct netif *netif, const ip4_addr_t *dest);
+void ip4_fib_cache_flush(void);
+void ip4_fib_netif_removed(struct netif *netif);
+
+#define IP4_FIB_CACHE_FLUSH() ip4_fib_cache_flush()
+
+#ifdef __cplusplus
+}
+#endif
+
+#else /* LWIP_IPV4 && LWIP_IPV4_FIB */
+
+#define IP4_FIB_CACHE_FLUSH()
+
+#endif /* LWIP_IPV4 && LWIP_IPV4_FIB */
+
+#endif /* LWIP_HDR_IP4_FIB_H */
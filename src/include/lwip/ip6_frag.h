@@ -90,6 +90,7 @@ extern "C" {
 struct ip6_reassdata {
   struct ip6_reassdata *next;
   struct pbuf *p;
+  struct pbuf *p_last; /* fragment with the highest offset */
   struct ip6_hdr *iphdr; /* pointer to the first (original) IPv6 header */
 #if IPV6_FRAG_COPYHEADER
   ip6_addr_p_t src; /* copy of the source address in the IP header */
@@ -103,6 +104,8 @@ struct ip6_reassdata {
 #endif /* IPV6_FRAG_COPYHEADER */
   u32_t identification;
   u16_t datagram_len;
+  u16_t recv_len; /* payload bytes received so far */
+  u16_t pbufcount; /* pbufs enqueued for this datagram */
   u8_t nexth;
   u8_t timer;
 #if LWIP_IPV6_SCOPES
@@ -148,6 +148,18 @@ void *memp_malloc(memp_t type);
 #endif
 void  memp_free(memp_t type, void *mem);
 
+#if MEMP_CACHE
+/** Per-thread cache of free pool elements, see @ref LWIP_HOOK_MEMP_CACHE */
+struct memp_cache {
+  /** Number of cached elements per pool */
+  u16_t num[MEMP_MAX];
+  /** Cached elements per pool, the most recently freed one last */
+  void *elems[MEMP_MAX][MEMP_CACHE_SIZE];
+};
+
+void  memp_cache_flush(struct memp_cache *cache);
+#endif /* MEMP_CACHE */
+
 #ifdef __cplusplus
 }
 #endif
@@ -105,6 +105,10 @@ extern "C" {
 /** If set, the netif has MLD6 capability.
  * Set by the netif driver in its init function. */
 #define NETIF_FLAG_MLD6         0x40U
+/** If set, the netif segments TCP super-segments (p->gso_size != 0) itself,
+ * computing the TCP checksum of each segment (see LWIP_NETIF_TSO).
+ * Set by the netif driver in its init function. */
+#define NETIF_FLAG_TSO          0x80U
 
 /**
  * @}
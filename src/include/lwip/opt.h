@@ -120,6 +120,20 @@
 #if !defined LWIP_TIMERS_CUSTOM || defined __DOXYGEN__
 #define LWIP_TIMERS_CUSTOM              0
 #endif
+
+/**
+ * LWIP_TIMERS_WHEEL==1: Keep timeouts in a hierarchical timer wheel instead of
+ * a sorted list. sys_timeout(), sys_timeout_start() and sys_timeout_stop() are
+ * then O(1) independent of the number of timeouts armed, at the cost of a
+ * table of 192 pointers. sys_untimeout() still has to search all timeouts.
+ * Timeouts due in the same millisecond may expire in any order, and
+ * sys_timeouts_sleeptime() may return a shorter time than the next timeout
+ * is due in (when timeouts more than 32 ms in the future have to be moved
+ * down the wheel).
+ */
+#if !defined LWIP_TIMERS_WHEEL || defined __DOXYGEN__
+#define LWIP_TIMERS_WHEEL               0
+#endif
 /**
  * @}
  */
@@ -202,6 +216,24 @@
 #define LWIP_TCPIP_CORE_LOCKING_INPUT   0
 #endif
 
+/**
+ * LWIP_TCPIP_INPUT_BATCH==1: Enable tcpip_input_batch(), which lets a netif
+ * driver pass up to TCPIP_INPUT_BATCH_SIZE received packets to tcpip_thread
+ * in one message. This saves one mbox post (and one thread wakeup) per
+ * packet when the driver can read several frames per interrupt/wakeup.
+ */
+#if !defined LWIP_TCPIP_INPUT_BATCH || defined __DOXYGEN__
+#define LWIP_TCPIP_INPUT_BATCH          0
+#endif
+
+/**
+ * TCPIP_INPUT_BATCH_SIZE: the maximum number of packets passed to
+ * tcpip_input_batch() in one call.
+ */
+#if !defined TCPIP_INPUT_BATCH_SIZE || defined __DOXYGEN__
+#define TCPIP_INPUT_BATCH_SIZE          16
+#endif
+
 /**
  * SYS_LIGHTWEIGHT_PROT==1: enable inter-task protection (and task-vs-interrupt
  * protection) for certain critical regions during buffer allocation, deallocation
@@ -273,6 +305,32 @@
 #define MEMP_MEM_INIT                   0
 #endif
 
+/**
+ * MEMP_CACHE==1: Put a per-thread cache of free elements in front of each
+ * memp pool (see @ref LWIP_HOOK_MEMP_CACHE). memp_malloc() and memp_free()
+ * then only take SYS_ARCH_PROTECT when a cache runs empty or full and move
+ * a batch of elements between the cache and the pool at once.
+ * Elements held in a thread cache count as used in MEMP_STATS until they are
+ * returned to the pool, memp_cache_flush() returns all of them.
+ * memp_malloc() only sees the pool and the cache of the calling thread: it
+ * fails when the pool is empty even if other threads still cache free
+ * elements (up to 1/4 of a pool per thread). Size the pools for that or flush
+ * the caches of threads that go idle.
+ * Pools with less than 16 elements and private pools are not cached. The cache
+ * is bypassed when MEMP_OVERFLOW_CHECK is enabled.
+ */
+#if !defined MEMP_CACHE || defined __DOXYGEN__
+#define MEMP_CACHE                      0
+#endif
+
+/**
+ * MEMP_CACHE_SIZE: Maximum number of elements a thread cache keeps per pool.
+ * Refills and flushes move half of this (but at most 1/8 of the pool) at once.
+ */
+#if !defined MEMP_CACHE_SIZE || defined __DOXYGEN__
+#define MEMP_CACHE_SIZE                 16
+#endif
+
 /**
  * MEM_ALIGNMENT: should be set to the alignment of the CPU
  *    4 byte alignment -> \#define MEM_ALIGNMENT 4
@@ -342,6 +400,29 @@
 #define MEM_USE_POOLS                   0
 #endif
 
+/**
+ * MEM_TLSF==1: Use a two-level segregated fit (TLSF) heap instead of the
+ * default first-fit heap. mem_malloc(), mem_free() and mem_trim() then run in
+ * bounded time independent of heap fragmentation, at the cost of some
+ * internal fragmentation (requests are rounded up to the next of
+ * 2^MEM_TLSF_SL_LOG2 size classes per power of two) and a free list table of
+ * a few hundred bytes.
+ * With LWIP_ALLOW_MEM_FREE_FROM_OTHER_CONTEXT, mem_malloc() holds
+ * SYS_ARCH_PROTECT for the whole (short) allocation.
+ */
+#if !defined MEM_TLSF || defined __DOXYGEN__
+#define MEM_TLSF                        0
+#endif
+
+/**
+ * MEM_TLSF_SL_LOG2: log2 of the number of size classes per power of two in
+ * the TLSF heap (1..5). Higher values reduce internal fragmentation but need
+ * a bigger free list table.
+ */
+#if !defined MEM_TLSF_SL_LOG2 || defined __DOXYGEN__
+#define MEM_TLSF_SL_LOG2                4
+#endif
+
 /**
  * MEM_USE_POOLS_TRY_BIGGER_POOL==1: if one malloc-pool is empty, try the next
  * bigger pool - WARNING: THIS MIGHT WASTE MEMORY but it can make a system more
@@ -445,6 +526,34 @@
 #define MEMP_NUM_TCP_SEG                16
 #endif
 
+/**
+ * MEMP_NUM_TCP_PBUF_REF: the number of pbufs referencing data enqueued by
+ * tcp_write_ref() (one per segment, more if the data is split by phase 2 of
+ * tcp_write). (requires the LWIP_TCP_WRITE_REF option)
+ */
+#if !defined MEMP_NUM_TCP_PBUF_REF || defined __DOXYGEN__
+#define MEMP_NUM_TCP_PBUF_REF           MEMP_NUM_TCP_SEG
+#endif
+
+/**
+ * MEMP_NUM_TSO_PBUF_REF: the number of pbufs referencing segment data from
+ * TSO super-segments and from the packets software GSO splits them into
+ * (at least one per segment of a super-segment, plus the ones still queued
+ * by netif drivers). (requires the LWIP_NETIF_TSO option)
+ */
+#if !defined MEMP_NUM_TSO_PBUF_REF || defined __DOXYGEN__
+#define MEMP_NUM_TSO_PBUF_REF           (2 * MEMP_NUM_TCP_SEG)
+#endif
+
+/**
+ * MEMP_NUM_TCP_TW: the number of connections that can be kept in TIME-WAIT
+ * as compact tw-buckets. When exhausted, the oldest bucket is reused.
+ * (requires the LWIP_TCP_TW_BUCKETS option)
+ */
+#if !defined MEMP_NUM_TCP_TW || defined __DOXYGEN__
+#define MEMP_NUM_TCP_TW                 (4 * MEMP_NUM_TCP_PCB)
+#endif
+
 /**
  * MEMP_NUM_ALTCP_PCB: the number of simultaneously active altcp layer pcbs.
  * (requires the LWIP_ALTCP option)
@@ -474,6 +583,16 @@
 #define MEMP_NUM_FRAG_PBUF              15
 #endif
 
+/**
+ * MEMP_NUM_IP4_FIB_NODE: the number of nodes in the IPv4 routing table.
+ * Each route needs one, and up to one more is needed per route where
+ * prefixes branch.
+ * (requires the LWIP_IPV4_FIB option)
+ */
+#if !defined MEMP_NUM_IP4_FIB_NODE || defined __DOXYGEN__
+#define MEMP_NUM_IP4_FIB_NODE           16
+#endif
+
 /**
  * MEMP_NUM_ARP_QUEUE: the number of simultaneously queued outgoing
  * packets (pbufs) that are waiting for an ARP request (to resolve
@@ -534,6 +653,15 @@
 #define MEMP_NUM_SELECT_CB              4
 #endif
 
+/**
+ * MEMP_NUM_EPOLL_ITEM: the number of sockets that can be registered with
+ * epoll instances (one per socket and instance).
+ * (only needed if LWIP_SOCKET_EPOLL is enabled)
+ */
+#if !defined MEMP_NUM_EPOLL_ITEM || defined __DOXYGEN__
+#define MEMP_NUM_EPOLL_ITEM             MEMP_NUM_NETCONN
+#endif
+
 /**
  * MEMP_NUM_TCPIP_MSG_API: the number of struct tcpip_msg, which are used
  * for callback/timeout API communication.
@@ -552,6 +680,16 @@
 #define MEMP_NUM_TCPIP_MSG_INPKT        8
 #endif
 
+/**
+ * MEMP_NUM_TCPIP_MSG_INBATCH: the number of batch messages, which are used
+ * for incoming packets passed with tcpip_input_batch(). Each one holds up to
+ * TCPIP_INPUT_BATCH_SIZE packet pointers.
+ * (only needed if LWIP_TCPIP_INPUT_BATCH is enabled)
+ */
+#if !defined MEMP_NUM_TCPIP_MSG_INBATCH || defined __DOXYGEN__
+#define MEMP_NUM_TCPIP_MSG_INBATCH      4
+#endif
+
 /**
  * MEMP_NUM_NETDB: the number of concurrently running lwip_addrinfo() calls
  * (before freeing the corresponding memory using lwip_freeaddrinfo()).
@@ -711,6 +849,23 @@
 #if !defined ETHARP_TABLE_MATCH_NETIF || defined __DOXYGEN__
 #define ETHARP_TABLE_MATCH_NETIF        !LWIP_SINGLE_NETIF
 #endif
+
+/** ETHARP_TABLE_HASH==1: Index the ARP table by IP address with a hash table
+ * and keep the used entries on a least-recently-used list. Looking up,
+ * adding and updating entries then doesn't scan all ARP_TABLE_SIZE entries,
+ * and the least recently used entry is recycled if the table is full.
+ * Worth it for big ARP tables, e.g. when routing for many hosts on a link.
+ */
+#if !defined ETHARP_TABLE_HASH || defined __DOXYGEN__
+#define ETHARP_TABLE_HASH               0
+#endif
+
+/** ETHARP_TABLE_HASH_SIZE: Number of hash buckets for the ARP table.
+ * Must be a power of 2. Only used if ETHARP_TABLE_HASH is enabled.
+ */
+#if !defined ETHARP_TABLE_HASH_SIZE || defined __DOXYGEN__
+#define ETHARP_TABLE_HASH_SIZE          64
+#endif
 /**
  * @}
  */
@@ -759,6 +914,19 @@
 #define IP_FRAG                         1
 #endif
 
+/**
+ * IP_FRAG_BATCH==1: ip4_frag() and ip6_frag() slice a datagram in one pass,
+ * taking the header and payload pbufs of all its fragments from a single heap
+ * allocation (which holds one reference to the datagram until the last
+ * fragment is freed) instead of allocating a header pbuf and one
+ * MEMP_FRAG_PBUF per referenced pbuf for every fragment.
+ * If the heap allocation fails, fragments are allocated one by one.
+ * Requires LWIP_NETIF_TX_SINGLE_PBUF==0.
+ */
+#if !defined IP_FRAG_BATCH || defined __DOXYGEN__
+#define IP_FRAG_BATCH                   0
+#endif
+
 #if !LWIP_IPV4
 /* disable IPv4 extensions when IPv4 is disabled */
 #undef IP_FORWARD
@@ -799,6 +967,26 @@
 #define IP_REASS_MAX_PBUFS              10
 #endif
 
+/**
+ * IP_REASS_MAX_PBUFS_PER_SOURCE: Maximum amount of pbufs one source address
+ * may have waiting to be reassembled (counted for IPv4 and IPv6 separately).
+ * When exceeded, the oldest datagram of that source is freed (or the fragment
+ * is dropped), so that a single peer cannot use up all of IP_REASS_MAX_PBUFS.
+ * The default of IP_REASS_MAX_PBUFS disables the per-source limit.
+ */
+#if !defined IP_REASS_MAX_PBUFS_PER_SOURCE || defined __DOXYGEN__
+#define IP_REASS_MAX_PBUFS_PER_SOURCE   IP_REASS_MAX_PBUFS
+#endif
+
+/**
+ * IP_REASS_HASH_SIZE: Number of lists the IPv4 and IPv6 datagrams being
+ * reassembled are hashed into by source address. Must be a power of 2.
+ * The default of 1 keeps a single list.
+ */
+#if !defined IP_REASS_HASH_SIZE || defined __DOXYGEN__
+#define IP_REASS_HASH_SIZE              1
+#endif
+
 /**
  * IP_DEFAULT_TTL: Default value for Time-To-Live used by transport layers.
  */
@@ -833,6 +1021,24 @@
 #if !defined IP_FORWARD_ALLOW_TX_ON_RX_NETIF || defined __DOXYGEN__
 #define IP_FORWARD_ALLOW_TX_ON_RX_NETIF 0
 #endif
+
+/**
+ * LWIP_IPV4_FIB==1: Enable an IPv4 routing table (see ip4_fib_add()) with
+ * longest-prefix match over static routes and the subnets of the netifs,
+ * and a next-hop gateway per route. ip4_route() and the gateway selection
+ * of etharp_output() go through a small per-destination route cache.
+ */
+#if !defined LWIP_IPV4_FIB || defined __DOXYGEN__
+#define LWIP_IPV4_FIB                   0
+#endif
+
+/**
+ * IP4_FIB_CACHE_SIZE: Number of entries in the per-destination route cache
+ * (must be a power of 2).
+ */
+#if !defined IP4_FIB_CACHE_SIZE || defined __DOXYGEN__
+#define IP4_FIB_CACHE_SIZE              8
+#endif
 /**
  * @}
  */
@@ -1226,6 +1432,27 @@
 #define UDP_TTL                         IP_DEFAULT_TTL
 #endif
 
+/**
+ * LWIP_UDP_PCB_HASH==1: Keep bound UDP pcbs in a hash table keyed by local
+ * port in addition to the pcb list. udp_input(), udp_bind() and ephemeral
+ * port allocation then only look at pcbs that may use the port in question
+ * instead of scanning all pcbs. Worth it if many UDP pcbs are bound.
+ * Pcbs sharing a port (SO_REUSE) are matched in the same order as without
+ * the hash table, except after one of them was rebound from another port:
+ * that pcb is then looked at first.
+ */
+#if !defined LWIP_UDP_PCB_HASH || defined __DOXYGEN__
+#define LWIP_UDP_PCB_HASH               0
+#endif
+
+/**
+ * UDP_PCB_HASH_SIZE: Number of hash buckets for bound UDP pcbs.
+ * Must be a power of 2. Only used if LWIP_UDP_PCB_HASH is enabled.
+ */
+#if !defined UDP_PCB_HASH_SIZE || defined __DOXYGEN__
+#define UDP_PCB_HASH_SIZE               16
+#endif
+
 /**
  * LWIP_NETBUF_RECVINFO==1: append destination addr and port to every netbuf.
  */
@@ -1300,6 +1527,28 @@
 #define LWIP_TCP_SACK_OUT               0
 #endif
 
+/**
+ * LWIP_TCP_SACK_IN==1: TCP will use the SACK blocks received from the remote
+ * host for loss recovery (RFC 6675): SACKed segments are marked on the unacked
+ * queue and several holes can be retransmitted per round-trip while in fast
+ * recovery. SACK is negotiated by LWIP_TCP_SACK_OUT, which must be enabled.
+ */
+#if !defined LWIP_TCP_SACK_IN || defined __DOXYGEN__
+#define LWIP_TCP_SACK_IN                0
+#endif
+
+/**
+ * LWIP_TCP_RACK==1: Enable RACK-TLP (RFC 8985) for SACK-enabled connections.
+ * A segment is marked lost once a segment sent after it has been delivered
+ * and a reordering window has passed, instead of counting dupacks. When no
+ * ACK arrives for the tail of a flight, a Tail Loss Probe is sent after about
+ * two RTTs, so that tail losses are repaired without waiting for the RTO.
+ * The timers are checked from tcp_fasttmr(). Requires LWIP_TCP_SACK_IN.
+ */
+#if !defined LWIP_TCP_RACK || defined __DOXYGEN__
+#define LWIP_TCP_RACK                   0
+#endif
+
 /**
  * LWIP_TCP_MAX_SACK_NUM: The maximum number of SACK values to include in TCP segments.
  * Must be at least 1, but is only used if LWIP_TCP_SACK_OUT is enabled.
@@ -1461,6 +1710,17 @@
 #define TCP_OVERSIZE                    TCP_MSS
 #endif
 
+/**
+ * LWIP_TCP_WRITE_REF==1: Enable tcp_write_ref() (and altcp_write_ref(),
+ * netconn_write_ref_partly()) to enqueue data without copying it while
+ * holding a reference on a pbuf that owns the data. Wrapping a caller buffer
+ * in a pbuf_custom gives a completion callback when all of its bytes are
+ * ACKed and no longer referenced by the stack.
+ */
+#if !defined LWIP_TCP_WRITE_REF || defined __DOXYGEN__
+#define LWIP_TCP_WRITE_REF              0
+#endif
+
 /**
  * LWIP_TCP_TIMESTAMPS==1: support the TCP timestamp option.
  * The timestamp option is currently only used to help remote hosts, it is not
@@ -1520,6 +1780,108 @@
 #define LWIP_TCP_PCB_NUM_EXT_ARGS       0
 #endif
 
+/**
+ * LWIP_TCP_PCB_HASH==1: Keep active, TIME-WAIT and listening TCP pcbs in hash
+ * tables in addition to their lists, so that tcp_input() can find the pcb an
+ * incoming segment belongs to without scanning all connections.
+ * This costs one pointer per pcb plus the bucket arrays and is only worth it
+ * if many connections are open at the same time.
+ */
+#if !defined LWIP_TCP_PCB_HASH || defined __DOXYGEN__
+#define LWIP_TCP_PCB_HASH               0
+#endif
+
+/**
+ * TCP_PCB_HASH_SIZE: Number of hash buckets for active and TIME-WAIT pcbs
+ * (each list has its own table). Must be a power of 2.
+ * Only used if LWIP_TCP_PCB_HASH is enabled.
+ */
+#if !defined TCP_PCB_HASH_SIZE || defined __DOXYGEN__
+#define TCP_PCB_HASH_SIZE               64
+#endif
+
+/**
+ * TCP_LISTEN_PCB_HASH_SIZE: Number of hash buckets for listening pcbs (hashed
+ * by local port). Must be a power of 2.
+ * Only used if LWIP_TCP_PCB_HASH is enabled.
+ */
+#if !defined TCP_LISTEN_PCB_HASH_SIZE || defined __DOXYGEN__
+#define TCP_LISTEN_PCB_HASH_SIZE        16
+#endif
+
+/**
+ * LWIP_TCP_TW_BUCKETS==1: When a connection that has been closed by the
+ * application enters TIME-WAIT, free its tcp_pcb and keep only a compact
+ * tw-bucket (addresses, ports, sequence numbers, timestamp and start time)
+ * from the MEMP_TCP_TW pool. Buckets are found by hash and expire in order.
+ * Segments arriving for them are handled like for a TIME-WAIT pcb.
+ * Connections the application still holds stay full pcbs in TIME-WAIT.
+ */
+#if !defined LWIP_TCP_TW_BUCKETS || defined __DOXYGEN__
+#define LWIP_TCP_TW_BUCKETS             0
+#endif
+
+/**
+ * TCP_TW_HASH_SIZE: Number of hash buckets for tw-buckets. Must be a power of 2.
+ * Only used if LWIP_TCP_TW_BUCKETS is enabled.
+ */
+#if !defined TCP_TW_HASH_SIZE || defined __DOXYGEN__
+#define TCP_TW_HASH_SIZE                64
+#endif
+
+/**
+ * LWIP_TCP_PCB_TIMERS==1: Run the TCP timers per pcb instead of from
+ * tcp_fasttmr()/tcp_slowtmr(): each connection arms one sys_timeout to its
+ * earliest deadline (retransmission, persist, delayed ACK, keepalive, poll,
+ * FIN-WAIT-2/SYN-RCVD/LAST-ACK/TIME-WAIT timeouts). Deadlines have millisecond
+ * resolution (the RTO is kept between TCP_RTO_MIN and TCP_RTO_MAX, 200 ms and
+ * 60 s by default) and idle connections are not visited periodically.
+ * A pending timer is only moved to an earlier deadline; when it fires early,
+ * it is re-armed to the current one.
+ * tcp_tmr() does nothing in this mode and timers must be run through
+ * sys_check_timeouts(). Requires LWIP_TIMERS and !LWIP_TIMERS_CUSTOM;
+ * LWIP_TIMERS_WHEEL is recommended for many connections.
+ */
+#if !defined LWIP_TCP_PCB_TIMERS || defined __DOXYGEN__
+#define LWIP_TCP_PCB_TIMERS             0
+#endif
+
+/**
+ * LWIP_TCP_CC==1: Make congestion control pluggable per pcb: each tcp_pcb
+ * carries a pointer to a struct tcp_cc_ops that is invoked on ACK, loss,
+ * RTO and idle events (see tcp_set_cc()).
+ * When disabled, NewReno is called directly.
+ */
+#if !defined LWIP_TCP_CC || defined __DOXYGEN__
+#define LWIP_TCP_CC                     0
+#endif
+
+/**
+ * LWIP_TCP_CC_CUBIC==1: Build the CUBIC congestion control algorithm
+ * (RFC 9438, tcp_cc_cubic) that can be selected per pcb via tcp_set_cc().
+ * Requires LWIP_TCP_CC and LWIP_HAVE_INT64.
+ */
+#if !defined LWIP_TCP_CC_CUBIC || defined __DOXYGEN__
+#define LWIP_TCP_CC_CUBIC               0
+#endif
+
+/**
+ * TCP_CC_DEFAULT: The congestion control algorithm new pcbs start with.
+ * Only used if LWIP_TCP_CC is enabled.
+ */
+#if !defined TCP_CC_DEFAULT || defined __DOXYGEN__
+#define TCP_CC_DEFAULT                  (&tcp_cc_newreno)
+#endif
+
+/**
+ * TCP_CC_PRIV_WORDS: Number of u32_t words each pcb reserves for private
+ * congestion control state. Must be big enough for every algorithm used.
+ * Only used if LWIP_TCP_CC is enabled.
+ */
+#if !defined TCP_CC_PRIV_WORDS || defined __DOXYGEN__
+#define TCP_CC_PRIV_WORDS               8
+#endif
+
 /** LWIP_ALTCP==1: enable the altcp API.
  * altcp is an abstraction layer that prevents applications linking against the
  * tcp.h functions but provides the same functionality. It is used to e.g. add
@@ -1604,6 +1966,51 @@
 #if !defined LWIP_PBUF_CUSTOM_DATA || defined __DOXYGEN__
 #define LWIP_PBUF_CUSTOM_DATA
 #endif
+
+/**
+ * PBUF_POOL_TELEMETRY==1: track the use of PBUF_POOL over time to size it
+ * from data: high-water marks per time window, allocation failures per
+ * pbuf_layer and the time from falling to the low watermark to running
+ * empty (see pbuf_pool_telemetry_get()). pbuf_pool_set_watermarks() installs
+ * a callback for crossing the watermarks, e.g. for drivers to pause RX DMA
+ * refill before packets are dropped.
+ */
+#if !defined PBUF_POOL_TELEMETRY || defined __DOXYGEN__
+#define PBUF_POOL_TELEMETRY             0
+#endif
+
+/**
+ * PBUF_POOL_TELEMETRY_WINDOW: length of a high-water mark time window
+ * in milliseconds.
+ */
+#if !defined PBUF_POOL_TELEMETRY_WINDOW || defined __DOXYGEN__
+#define PBUF_POOL_TELEMETRY_WINDOW      1000
+#endif
+
+/**
+ * PBUF_POOL_TELEMETRY_WINDOWS: number of time windows for which a
+ * high-water mark is kept (including the current one).
+ */
+#if !defined PBUF_POOL_TELEMETRY_WINDOWS || defined __DOXYGEN__
+#define PBUF_POOL_TELEMETRY_WINDOWS     8
+#endif
+
+/**
+ * PBUF_POOL_LOW_WATERMARK: default number of free PBUF_POOL pbufs at or below
+ * which the pool is considered low (can be changed at runtime with
+ * pbuf_pool_set_watermarks()).
+ */
+#if !defined PBUF_POOL_LOW_WATERMARK || defined __DOXYGEN__
+#define PBUF_POOL_LOW_WATERMARK         (PBUF_POOL_SIZE / 8)
+#endif
+
+/**
+ * PBUF_POOL_HIGH_WATERMARK: default number of free PBUF_POOL pbufs at or
+ * above which a low pool is considered recovered.
+ */
+#if !defined PBUF_POOL_HIGH_WATERMARK || defined __DOXYGEN__
+#define PBUF_POOL_HIGH_WATERMARK        (PBUF_POOL_SIZE / 4)
+#endif
 /**
  * @}
  */
@@ -1707,6 +2114,56 @@
 #define LWIP_NETIF_TX_SINGLE_PBUF       0
 #endif /* LWIP_NETIF_TX_SINGLE_PBUF */
 
+/**
+ * LWIP_NETIF_TSO==1: TCP over IPv4 sends runs of equally sized segments as
+ * one super-segment (one TCP header followed by the data of all segments,
+ * chained by reference) with p->gso_size set to the segment size.
+ * Netifs setting NETIF_FLAG_TSO get these directly and have to segment them
+ * (including TCP checksums). For all other netifs, the IP layer segments
+ * them in software (GSO) before calling netif->output.
+ * Requires LWIP_NETIF_TX_SINGLE_PBUF==0.
+ */
+#if !defined LWIP_NETIF_TSO || defined __DOXYGEN__
+#define LWIP_NETIF_TSO                  0
+#endif
+
+/**
+ * TCP_TSO_MAX_SIZE: maximum TCP payload of one super-segment with
+ * LWIP_NETIF_TSO. Must leave room for all headers in the u16_t pbuf length.
+ */
+#if !defined TCP_TSO_MAX_SIZE || defined __DOXYGEN__
+#define TCP_TSO_MAX_SIZE                0xFF00
+#endif
+
+/**
+ * LWIP_GRO==1: Coalesce consecutive in-order TCP/IPv4 segments of the same
+ * flow received in one input batch into a single packet (generic receive
+ * offload). tcpip_thread holds packets passed via tcpip_input() until its
+ * mbox runs empty (or another message is handled) and then passes one
+ * pbuf chain per flow to the stack, so each flow gets one ACK and one recv
+ * upcall per batch. NO_SYS ports can call gro_input() and gro_flush()
+ * themselves.
+ */
+#if !defined LWIP_GRO || defined __DOXYGEN__
+#define LWIP_GRO                        0
+#endif
+
+/**
+ * LWIP_GRO_MAX_FLOWS: Number of flows for which segments can be held
+ * at the same time with LWIP_GRO.
+ */
+#if !defined LWIP_GRO_MAX_FLOWS || defined __DOXYGEN__
+#define LWIP_GRO_MAX_FLOWS              8
+#endif
+
+/**
+ * LWIP_GRO_MAX_SEGS: Maximum number of segments coalesced into one
+ * packet with LWIP_GRO (the IPv4 length limit applies, too).
+ */
+#if !defined LWIP_GRO_MAX_SEGS || defined __DOXYGEN__
+#define LWIP_GRO_MAX_SEGS               32
+#endif
+
 /**
  * LWIP_NUM_NETIF_CLIENT_DATA: Number of clients that may store
  * data in client_data member array of struct netif (max. 256).
@@ -2135,6 +2592,53 @@
 #if !defined LWIP_SOCKET_POLL || defined __DOXYGEN__
 #define LWIP_SOCKET_POLL                1
 #endif
+
+/**
+ * LWIP_SOCKET_EPOLL==1: enable lwip_epoll_create(), lwip_epoll_ctl() and
+ * lwip_epoll_wait(). Unlike select() and poll(), the set of sockets to watch
+ * is registered once and sockets are put on a ready list by the event
+ * callback, so the cost per event does not depend on the number of sockets
+ * or waiting threads. Requires LWIP_SOCKET_SELECT or LWIP_SOCKET_POLL.
+ */
+#if !defined LWIP_SOCKET_EPOLL || defined __DOXYGEN__
+#define LWIP_SOCKET_EPOLL               0
+#endif
+
+/**
+ * LWIP_SOCKET_MAX_EPOLL: the number of epoll instances that can be open at
+ * the same time. Their descriptors follow the socket descriptors.
+ */
+#if !defined LWIP_SOCKET_MAX_EPOLL || defined __DOXYGEN__
+#define LWIP_SOCKET_MAX_EPOLL           1
+#endif
+
+/**
+ * LWIP_SOCKET_ZEROCOPY_RECV==1: enable lwip_recv_zc() and lwip_recv_zc_done()
+ * to receive data as references to the pbufs received by the stack instead
+ * of copying it into application memory. For TCP, the receive window is
+ * only opened again when the pbufs are returned by lwip_recv_zc_done().
+ */
+#if !defined LWIP_SOCKET_ZEROCOPY_RECV || defined __DOXYGEN__
+#define LWIP_SOCKET_ZEROCOPY_RECV       0
+#endif
+
+/**
+ * LWIP_SOCKET_MMSG==1: enable lwip_recvmmsg() and lwip_sendmmsg() for UDP
+ * and RAW sockets. Datagrams are passed to the tcpip_thread and taken from
+ * the receive mbox in batches instead of one call per datagram.
+ */
+#if !defined LWIP_SOCKET_MMSG || defined __DOXYGEN__
+#define LWIP_SOCKET_MMSG                0
+#endif
+
+/**
+ * LWIP_SOCKET_MMSG_BATCH: the maximum number of datagrams handled per batch
+ * by lwip_recvmmsg() and lwip_sendmmsg(). lwip_sendmmsg() keeps this many
+ * struct netbuf on the stack.
+ */
+#if !defined LWIP_SOCKET_MMSG_BATCH || defined __DOXYGEN__
+#define LWIP_SOCKET_MMSG_BATCH          8
+#endif
 /**
  * @}
  */
@@ -2224,6 +2728,14 @@
 #define TCP_STATS                       (LWIP_TCP)
 #endif
 
+/**
+ * GRO_STATS==1: Enable receive coalescing stats. Default is on if
+ * LWIP_GRO is enabled, otherwise off.
+ */
+#if !defined GRO_STATS || defined __DOXYGEN__
+#define GRO_STATS                       (LWIP_GRO)
+#endif
+
 /**
  * MEM_STATS==1: Enable mem.c stats.
  */
@@ -2297,6 +2809,7 @@
 #define IGMP_STATS                      0
 #define UDP_STATS                       0
 #define TCP_STATS                       0
+#define GRO_STATS                       0
 #define MEM_STATS                       0
 #define MEMP_STATS                      0
 #define SYS_STATS                       0
@@ -2615,6 +3128,9 @@
 
 /**
  * LWIP_ND6_NUM_NEIGHBORS: Number of entries in IPv6 neighbor cache
+ * (at most 127). The neighbor cache does not scale to large numbers of
+ * neighbors: nd6_tmr() visits every entry, and when the cache is full, every
+ * new neighbor scans all entries to pick one to recycle.
  */
 #if !defined LWIP_ND6_NUM_NEIGHBORS || defined __DOXYGEN__
 #define LWIP_ND6_NUM_NEIGHBORS          10
@@ -2627,6 +3143,37 @@
 #define LWIP_ND6_NUM_DESTINATIONS       10
 #endif
 
+/**
+ * LWIP_ND6_CACHE_HASH==1: Index the IPv6 neighbor and destination caches by
+ * address with hash tables and keep the destination cache entries on a
+ * least-recently-used list. Finding an entry then doesn't scan the whole
+ * cache, and a full destination cache recycles the least recently used
+ * entry. Free neighbor cache entries are kept on a free list, too.
+ * Worth it for big caches, e.g. with many IPv6 peers.
+ * The on-link prefix and default router lists are still scanned: they only
+ * have LWIP_ND6_NUM_PREFIXES and LWIP_ND6_NUM_ROUTERS entries and a router
+ * is selected by reachability, not looked up by destination address.
+ */
+#if !defined LWIP_ND6_CACHE_HASH || defined __DOXYGEN__
+#define LWIP_ND6_CACHE_HASH             0
+#endif
+
+/**
+ * LWIP_ND6_NEIGHBOR_HASH_SIZE: Number of hash buckets for the neighbor cache.
+ * Must be a power of 2. Only used if LWIP_ND6_CACHE_HASH is enabled.
+ */
+#if !defined LWIP_ND6_NEIGHBOR_HASH_SIZE || defined __DOXYGEN__
+#define LWIP_ND6_NEIGHBOR_HASH_SIZE     16
+#endif
+
+/**
+ * LWIP_ND6_DESTINATION_HASH_SIZE: Number of hash buckets for the destination
+ * cache. Must be a power of 2. Only used if LWIP_ND6_CACHE_HASH is enabled.
+ */
+#if !defined LWIP_ND6_DESTINATION_HASH_SIZE || defined __DOXYGEN__
+#define LWIP_ND6_DESTINATION_HASH_SIZE  64
+#endif
+
 /**
  * LWIP_ND6_NUM_PREFIXES: number of entries in IPv6 on-link prefixes cache
  */
@@ -3107,6 +3654,23 @@
 #define LWIP_HOOK_MEMP_AVAILABLE(memp_t_type)
 #endif
 
+/**
+ * LWIP_HOOK_MEMP_CACHE():
+ * Called from memp_malloc() and memp_free() if @ref MEMP_CACHE is enabled to
+ * get the memp cache of the calling thread. Caches must be zero-initialized
+ * and may only be used by one thread; call memp_cache_flush() before a cache
+ * is discarded.
+ * Signature:\code{.c}
+ *   struct memp_cache *my_hook(void);
+ * \endcode
+ * Return values:
+ * - the cache of the calling thread
+ * - NULL: use the pools directly (e.g. from interrupt context)
+ */
+#ifdef __DOXYGEN__
+#define LWIP_HOOK_MEMP_CACHE()
+#endif
+
 /**
  * LWIP_HOOK_UNKNOWN_ETH_PROTOCOL(pbuf, netif):
  * Called from ethernet_input() when an unknown eth type is encountered.
@@ -3389,6 +3953,13 @@
 #define IP_REASS_DEBUG                  LWIP_DBG_OFF
 #endif
 
+/**
+ * GRO_DEBUG: Enable debugging in gro.c.
+ */
+#if !defined GRO_DEBUG || defined __DOXYGEN__
+#define GRO_DEBUG                       LWIP_DBG_OFF
+#endif
+
 /**
  * RAW_DEBUG: Enable debugging in raw.c.
  */
@@ -52,7 +52,7 @@ extern "C" {
  * Currently, the pbuf_custom code is only needed for one specific configuration
  * of IP_FRAG, unless required by external driver/application code. */
 #ifndef LWIP_SUPPORT_CUSTOM_PBUF
-#define LWIP_SUPPORT_CUSTOM_PBUF ((IP_FRAG && !LWIP_NETIF_TX_SINGLE_PBUF) || (LWIP_IPV6 && LWIP_IPV6_FRAG))
+#define LWIP_SUPPORT_CUSTOM_PBUF ((IP_FRAG && !LWIP_NETIF_TX_SINGLE_PBUF) || (LWIP_IPV6 && LWIP_IPV6_FRAG) || (LWIP_TCP && LWIP_TCP_WRITE_REF) || LWIP_NETIF_TSO)
 #endif
 
 /** @ingroup pbuf
@@ -181,6 +181,8 @@ typedef enum {
 #define PBUF_FLAG_LLMCAST   0x10U
 /** indicates this pbuf includes a TCP FIN flag */
 #define PBUF_FLAG_TCP_FIN   0x20U
+/** indicates this packet was coalesced from several TCP segments (LWIP_GRO) */
+#define PBUF_FLAG_GRO       0x40U
 
 /** Main packet buffer struct */
 struct pbuf {
@@ -220,6 +222,12 @@ struct pbuf {
   /** For incoming packets, this contains the input netif's index */
   u8_t if_idx;
 
+#if LWIP_NETIF_TSO
+  /** For outgoing TCP super-segments: the segment size to split the payload
+      into (see LWIP_NETIF_TSO), 0 for normal packets */
+  u16_t gso_size;
+#endif /* LWIP_NETIF_TSO */
+
   /** In case the user needs to store data custom data on a pbuf */
   LWIP_PBUF_CUSTOM_DATA
 };
@@ -250,6 +258,21 @@ struct pbuf_custom {
 };
 #endif /* LWIP_SUPPORT_CUSTOM_PBUF */
 
+#if LWIP_NETIF_TSO
+#ifndef LWIP_PBUF_CUSTOM_REF_DEFINED
+#define LWIP_PBUF_CUSTOM_REF_DEFINED
+/** A custom pbuf that holds a reference to another pbuf, which is freed
+ * when this custom pbuf is freed. This is used to create a custom PBUF_REF
+ * that points into the original pbuf. */
+struct pbuf_custom_ref {
+  /** 'base class' */
+  struct pbuf_custom pc;
+  /** pointer to the original pbuf that is referenced */
+  struct pbuf *original;
+};
+#endif /* LWIP_PBUF_CUSTOM_REF_DEFINED */
+#endif /* LWIP_NETIF_TSO */
+
 /** Define this to 0 to prevent freeing ooseq pbufs when the PBUF_POOL is empty */
 #ifndef PBUF_POOL_FREE_OOSEQ
 #define PBUF_POOL_FREE_OOSEQ 1
@@ -269,6 +292,56 @@ void pbuf_free_ooseq(void);
   #define PBUF_CHECK_FREE_OOSEQ()
 #endif /* LWIP_TCP && TCP_QUEUE_OOSEQ && NO_SYS && PBUF_POOL_FREE_OOSEQ*/
 
+#if PBUF_POOL_TELEMETRY
+/** Classes of pbuf_layer for which PBUF_POOL allocation failures are counted */
+typedef enum {
+  PBUF_POOL_LAYER_TRANSPORT,
+  PBUF_POOL_LAYER_IP,
+  PBUF_POOL_LAYER_LINK,
+  PBUF_POOL_LAYER_RAW_TX,
+  /** PBUF_RAW, normally RX buffers of netif drivers */
+  PBUF_POOL_LAYER_RAW,
+  PBUF_POOL_LAYER_OTHER,
+  PBUF_POOL_LAYER_MAX
+} pbuf_pool_layer;
+
+/** Events passed to a pbuf_pool_watermark_fn */
+enum pbuf_pool_watermark_event {
+  /** the number of free pbufs fell to the low watermark */
+  PBUF_POOL_WATERMARK_LOW,
+  /** the number of free pbufs rose to the high watermark again */
+  PBUF_POOL_WATERMARK_HIGH
+};
+
+/** Function called when PBUF_POOL crosses a watermark. It is called from the
+ * context allocating or freeing the pbuf (which may be an interrupt if a
+ * driver allocates there), so it must not block. */
+typedef void (*pbuf_pool_watermark_fn)(enum pbuf_pool_watermark_event event, u16_t free_pbufs, void *arg);
+
+/** PBUF_POOL usage telemetry */
+struct pbuf_pool_telemetry {
+  /** pbufs currently allocated */
+  u16_t used;
+  /** highest number of pbufs allocated at the same time */
+  u16_t max_used;
+  /** highest number of pbufs allocated per time window of
+   * PBUF_POOL_TELEMETRY_WINDOW ms, [0] is the current window */
+  u16_t window_max[PBUF_POOL_TELEMETRY_WINDOWS];
+  /** failed allocations per pbuf_pool_layer */
+  u32_t alloc_fail[PBUF_POOL_LAYER_MAX];
+  /** number of times the pool ran empty */
+  u32_t exhausted;
+  /** ms from the last fall to the low watermark to running empty */
+  u32_t time_to_exhaustion_last;
+  /** shortest time_to_exhaustion_last seen */
+  u32_t time_to_exhaustion_min;
+};
+
+void pbuf_pool_telemetry_get(struct pbuf_pool_telemetry *telemetry);
+void pbuf_pool_telemetry_reset(void);
+err_t pbuf_pool_set_watermarks(u16_t low, u16_t high, pbuf_pool_watermark_fn fn, void *arg);
+#endif /* PBUF_POOL_TELEMETRY */
+
 /* Initializes the pbuf module. This call is empty for now, but may not be in future. */
 #define pbuf_init()
 
@@ -279,6 +352,9 @@ struct pbuf *pbuf_alloced_custom(pbuf_layer l, u16_t length, pbuf_type type,
                                  struct pbuf_custom *p, void *payload_mem,
                                  u16_t payload_mem_len);
 #endif /* LWIP_SUPPORT_CUSTOM_PBUF */
+#if LWIP_NETIF_TSO
+struct pbuf *pbuf_alloc_tso_ref(struct pbuf *original, void *payload, u16_t len);
+#endif /* LWIP_NETIF_TSO */
 void pbuf_realloc(struct pbuf *p, u16_t size);
 #define pbuf_get_allocsrc(p)          ((p)->type_internal & PBUF_TYPE_ALLOC_SRC_MASK)
 #define pbuf_match_allocsrc(p, type)  (pbuf_get_allocsrc(p) == ((type) & PBUF_TYPE_ALLOC_SRC_MASK))
@@ -68,6 +68,9 @@ typedef err_t (*altcp_close_fn)(struct altcp_pcb *conn);
 typedef err_t (*altcp_shutdown_fn)(struct altcp_pcb *conn, int shut_rx, int shut_tx);
 
 typedef err_t (*altcp_write_fn)(struct altcp_pcb *conn, const void *dataptr, u16_t len, u8_t apiflags);
+#if LWIP_TCP_WRITE_REF
+typedef err_t (*altcp_write_ref_fn)(struct altcp_pcb *conn, const void *dataptr, u16_t len, u8_t apiflags, struct pbuf *ref);
+#endif
 typedef err_t (*altcp_output_fn)(struct altcp_pcb *conn);
 
 typedef u16_t (*altcp_mss_fn)(struct altcp_pcb *conn);
@@ -123,6 +126,10 @@ struct altcp_functions {
 #ifdef LWIP_DEBUG
   altcp_dbg_get_tcp_state_fn  dbg_get_tcp_state;
 #endif
+#if LWIP_TCP_WRITE_REF
+  /** may be NULL: altcp_write_ref() then copies the data */
+  altcp_write_ref_fn          write_ref;
+#endif
 };
 
 void  altcp_default_set_poll(struct altcp_pcb *conn, u8_t interval);
@@ -130,6 +137,9 @@ void  altcp_default_recved(struct altcp_pcb *conn, u16_t len);
 err_t altcp_default_bind(struct altcp_pcb *conn, const ip_addr_t *ipaddr, u16_t port);
 err_t altcp_default_shutdown(struct altcp_pcb *conn, int shut_rx, int shut_tx);
 err_t altcp_default_write(struct altcp_pcb *conn, const void *dataptr, u16_t len, u8_t apiflags);
+#if LWIP_TCP_WRITE_REF
+err_t altcp_default_write_ref(struct altcp_pcb *conn, const void *dataptr, u16_t len, u8_t apiflags, struct pbuf *ref);
+#endif
 err_t altcp_default_output(struct altcp_pcb *conn);
 u16_t altcp_default_mss(struct altcp_pcb *conn);
 u16_t altcp_default_sndbuf(struct altcp_pcb *conn);
@@ -86,6 +86,13 @@ struct api_msg {
   union {
     /** used for lwip_netconn_do_send */
     struct netbuf *b;
+    /** used for lwip_netconn_do_send_batch */
+    struct {
+      /** netbufs to send */
+      struct netbuf *const *bufs;
+      /** in: number of netbufs, out: number of netbufs sent */
+      u16_t count;
+    } sb;
     /** used for lwip_netconn_do_newconn */
     struct {
       u8_t proto;
@@ -115,6 +122,10 @@ struct api_msg {
       /** offset into total length/output of bytes written when err == ERR_OK */
       size_t offset;
       u8_t apiflags;
+#if LWIP_TCP_WRITE_REF
+      /** pbuf owning the data for tcp_write_ref() or NULL to use tcp_write() */
+      struct pbuf *ref;
+#endif /* LWIP_TCP_WRITE_REF */
 #if LWIP_SO_SNDTIMEO
       u32_t time_started;
 #endif /* LWIP_SO_SNDTIMEO */
@@ -199,6 +210,7 @@ void lwip_netconn_do_connect         (void *m);
 void lwip_netconn_do_disconnect      (void *m);
 void lwip_netconn_do_listen          (void *m);
 void lwip_netconn_do_send            (void *m);
+void lwip_netconn_do_send_batch      (void *m);
 void lwip_netconn_do_recv            (void *m);
 #if TCP_LISTEN_BACKLOG
 void lwip_netconn_do_accepted        (void *m);
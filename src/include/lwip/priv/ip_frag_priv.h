@@ -0,0 +1,63 @@
+/**
+ * @file
+ * IP fragmentation internal implementations (do not use in application code)
+ */
+
+/*
+ * Copyright (c) 2001-2004 Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ *
+ */
+#ifndef LWIP_HDR_IP_FRAG_PRIV_H
+#define LWIP_HDR_IP_FRAG_PRIV_H
+
+#include "lwip/opt.h"
+
+#if IP_FRAG_BATCH && ((LWIP_IPV4 && IP_FRAG) || (LWIP_IPV6 && LWIP_IPV6_FRAG)) /* don't build if not configured for use in lwipopts.h */
+
+#include "lwip/pbuf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Slices one datagram into fragments. Header pbufs and payload PBUF_REFs of
+ * all fragments live in one heap block, which holds a reference to the
+ * datagram until the builder and the last fragment pbuf are freed. */
+struct ip_frag_batch;
+
+struct ip_frag_batch *ip_frag_batch_alloc(struct pbuf *p, u16_t poff, u16_t fragsize, u16_t hdr_len);
+struct pbuf *ip_frag_batch_next(struct ip_frag_batch *batch, u16_t len);
+void ip_frag_batch_free(struct ip_frag_batch *batch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IP_FRAG_BATCH && ((LWIP_IPV4 && IP_FRAG) || (LWIP_IPV6 && LWIP_IPV6_FRAG)) */
+
+#endif /* LWIP_HDR_IP_FRAG_PRIV_H */
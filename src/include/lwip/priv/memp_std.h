@@ -50,6 +50,15 @@ LWIP_MEMPOOL(UDP_PCB,        MEMP_NUM_UDP_PCB,         sizeof(struct udp_pcb),
 LWIP_MEMPOOL(TCP_PCB,        MEMP_NUM_TCP_PCB,         sizeof(struct tcp_pcb),        "TCP_PCB")
 LWIP_MEMPOOL(TCP_PCB_LISTEN, MEMP_NUM_TCP_PCB_LISTEN,  sizeof(struct tcp_pcb_listen), "TCP_PCB_LISTEN")
 LWIP_MEMPOOL(TCP_SEG,        MEMP_NUM_TCP_SEG,         sizeof(struct tcp_seg),        "TCP_SEG")
+#if LWIP_TCP_WRITE_REF
+LWIP_MEMPOOL(TCP_PBUF_REF,   MEMP_NUM_TCP_PBUF_REF,    sizeof(struct pbuf_custom_ref),"TCP_PBUF_REF")
+#endif /* LWIP_TCP_WRITE_REF */
+#if LWIP_NETIF_TSO
+LWIP_MEMPOOL(TSO_PBUF_REF,   MEMP_NUM_TSO_PBUF_REF,    sizeof(struct pbuf_custom_ref),"TSO_PBUF_REF")
+#endif /* LWIP_NETIF_TSO */
+#if LWIP_TCP_TW_BUCKETS
+LWIP_MEMPOOL(TCP_TW,         MEMP_NUM_TCP_TW,          sizeof(struct tcp_tw),         "TCP_TW")
+#endif /* LWIP_TCP_TW_BUCKETS */
 #endif /* LWIP_TCP */
 
 #if LWIP_ALTCP && LWIP_TCP
@@ -62,11 +71,17 @@ LWIP_MEMPOOL(REASSDATA,      MEMP_NUM_REASSDATA,       sizeof(struct ip_reassdat
 #if (IP_FRAG && !LWIP_NETIF_TX_SINGLE_PBUF) || (LWIP_IPV6 && LWIP_IPV6_FRAG)
 LWIP_MEMPOOL(FRAG_PBUF,      MEMP_NUM_FRAG_PBUF,       sizeof(struct pbuf_custom_ref),"FRAG_PBUF")
 #endif /* IP_FRAG && !LWIP_NETIF_TX_SINGLE_PBUF || (LWIP_IPV6 && LWIP_IPV6_FRAG) */
+#if LWIP_IPV4 && LWIP_IPV4_FIB
+LWIP_MEMPOOL(IP4_FIB_NODE,   MEMP_NUM_IP4_FIB_NODE,    sizeof(struct ip4_fib_node),   "IP4_FIB_NODE")
+#endif /* LWIP_IPV4 && LWIP_IPV4_FIB */
 
 #if LWIP_NETCONN || LWIP_SOCKET
 LWIP_MEMPOOL(NETBUF,         MEMP_NUM_NETBUF,          sizeof(struct netbuf),         "NETBUF")
 LWIP_MEMPOOL(NETCONN,        MEMP_NUM_NETCONN,         sizeof(struct netconn),        "NETCONN")
 #endif /* LWIP_NETCONN || LWIP_SOCKET */
+#if LWIP_SOCKET && LWIP_SOCKET_EPOLL
+LWIP_MEMPOOL(EPOLL_ITEM,     MEMP_NUM_EPOLL_ITEM,      sizeof(struct lwip_epoll_item), "EPOLL_ITEM")
+#endif /* LWIP_SOCKET && LWIP_SOCKET_EPOLL */
 
 #if NO_SYS==0
 LWIP_MEMPOOL(TCPIP_MSG_API,  MEMP_NUM_TCPIP_MSG_API,   sizeof(struct tcpip_msg),      "TCPIP_MSG_API")
@@ -87,6 +102,9 @@ LWIP_MEMPOOL(NETIFAPI_MSG,   MEMP_NUM_NETIFAPI_MSG,    sizeof(struct netifapi_ms
 #endif /* LWIP_MPU_COMPATIBLE */
 #if !LWIP_TCPIP_CORE_LOCKING_INPUT
 LWIP_MEMPOOL(TCPIP_MSG_INPKT,MEMP_NUM_TCPIP_MSG_INPKT, sizeof(struct tcpip_msg),      "TCPIP_MSG_INPKT")
+#if LWIP_TCPIP_INPUT_BATCH
+LWIP_MEMPOOL(TCPIP_MSG_INBATCH, MEMP_NUM_TCPIP_MSG_INBATCH, sizeof(struct tcpip_msg_inbatch), "TCPIP_MSG_INBATCH")
+#endif /* LWIP_TCPIP_INPUT_BATCH */
 #endif /* !LWIP_TCPIP_CORE_LOCKING_INPUT */
 #endif /* NO_SYS==0 */
 
@@ -88,6 +88,10 @@ struct nd6_neighbor_cache_entry {
     u32_t probes_sent;
     u32_t stale_time;     /* ticks (ND6_TMR_INTERVAL) */
   } counter;
+#if LWIP_ND6_CACHE_HASH
+  /** next entry in the same hash bucket (index + 1, 0 ends the chain) */
+  u8_t hash_next;
+#endif /* LWIP_ND6_CACHE_HASH */
 };
 
 struct nd6_destination_cache_entry {
@@ -96,6 +100,12 @@ struct nd6_destination_cache_entry {
   u16_t pmtu;
   u8_t cached_neighbor_idx;
   u32_t age;
+#if LWIP_ND6_CACHE_HASH
+  /** next entry in the same hash bucket or on the free list, neighbours on
+      the LRU list (index + 1, 0 ends a list) */
+  u16_t hash_next;
+  u16_t lru_prev, lru_next;
+#endif /* LWIP_ND6_CACHE_HASH */
 };
 
 struct nd6_prefix_list_entry {
@@ -58,6 +58,10 @@ extern "C" {
 #define SELWAIT_T u8_t
 #endif
 
+#if LWIP_SOCKET_EPOLL
+struct lwip_epoll_item;
+#endif /* LWIP_SOCKET_EPOLL */
+
 union lwip_sock_lastdata {
   struct netbuf *netbuf;
   struct pbuf *pbuf;
@@ -81,6 +85,10 @@ struct lwip_sock {
   /** counter of how many threads are waiting for this socket using select */
   SELWAIT_T select_waiting;
 #endif /* LWIP_SOCKET_SELECT || LWIP_SOCKET_POLL */
+#if LWIP_SOCKET_EPOLL
+  /** epoll registrations of this socket (one per epoll instance) */
+  struct lwip_epoll_item *epoll_items;
+#endif /* LWIP_SOCKET_EPOLL */
 #if LWIP_NETCONN_FULLDUPLEX
   /* counter of how many threads are using a struct lwip_sock (not the 'int') */
   u8_t fd_used;
@@ -170,6 +178,45 @@ struct lwip_select_cb {
 };
 #endif /* LWIP_SOCKET_SELECT || LWIP_SOCKET_POLL */
 
+#if LWIP_SOCKET_EPOLL
+/** A socket registered with an epoll instance */
+struct lwip_epoll_item {
+  /** next registration of the same socket */
+  struct lwip_epoll_item *sock_next;
+  /** interest list of the epoll instance */
+  struct lwip_epoll_item *next;
+  struct lwip_epoll_item *prev;
+  /** ready list of the epoll instance */
+  struct lwip_epoll_item *rdy_next;
+  struct lwip_epoll_item *rdy_prev;
+  /** the epoll instance this item belongs to */
+  struct lwip_epoll *ep;
+  /** the registered socket */
+  struct lwip_sock *sock;
+  /** events and flags passed to epoll_ctl */
+  u32_t events;
+  /** user data passed to epoll_ctl */
+  epoll_data_t data;
+  /** 1 while on the ready list */
+  u8_t ready;
+  /** 1 if reported with EPOLLONESHOT and not rearmed yet */
+  u8_t disabled;
+};
+
+/** An epoll instance */
+struct lwip_epoll {
+  /** all registered sockets */
+  struct lwip_epoll_item *items;
+  /** registered sockets that (probably) have events, oldest first */
+  struct lwip_epoll_item *rdy_head;
+  struct lwip_epoll_item *rdy_tail;
+  /** tasks waiting in epoll_wait */
+  struct lwip_select_cb *waiters;
+  /** 1 if this instance is allocated */
+  u8_t used;
+};
+#endif /* LWIP_SOCKET_EPOLL */
+
 #endif /* LWIP_SOCKET */
 
 #endif /* LWIP_HDR_SOCKETS_PRIV_H */
@@ -62,10 +62,12 @@ void             tcp_init    (void);  /* Initialize this module. */
 void             tcp_tmr     (void);  /* Must be called every
                                          TCP_TMR_INTERVAL
                                          ms. (Typically 250 ms). */
+#if !LWIP_TCP_PCB_TIMERS
 /* It is also possible to call these two functions at the right
    intervals (instead of calling tcp_tmr()). */
 void             tcp_slowtmr (void);
 void             tcp_fasttmr (void);
+#endif /* !LWIP_TCP_PCB_TIMERS */
 
 /* Call this from a netif driver (watch out for threading issues!) that has
    returned a memory error on transmit and now has free buffers to send more.
@@ -76,6 +78,7 @@ void             tcp_txnow   (void);
 /* Only used by IP to pass a TCP segment to TCP: */
 void             tcp_input   (struct pbuf *p, struct netif *inp);
 /* Used within the TCP code only: */
+u32_t            tcp_now     (void);
 struct tcp_pcb * tcp_alloc   (u8_t prio);
 void             tcp_free    (struct tcp_pcb *pcb);
 void             tcp_abandon (struct tcp_pcb *pcb, int reset);
@@ -85,6 +88,32 @@ err_t            tcp_rexmit_rto_prepare(struct tcp_pcb *pcb);
 void             tcp_rexmit_rto_commit(struct tcp_pcb *pcb);
 void             tcp_rexmit_rto  (struct tcp_pcb *pcb);
 void             tcp_rexmit_fast (struct tcp_pcb *pcb);
+#if LWIP_TCP_SACK_IN
+/* In loss recovery driven by SACK information */
+#define TCP_SACK_RECOVERY(pcb) (((pcb)->flags & (TF_SACK | TF_INFR)) == (TF_SACK | TF_INFR))
+/* ACK for new data that does not end SACK loss recovery yet */
+#define TCP_SACK_PARTIAL_ACK(pcb, ackno) (TCP_SACK_RECOVERY(pcb) && TCP_SEQ_LT(ackno, (pcb)->recover))
+void             tcp_rexmit_sack (struct tcp_pcb *pcb);
+u8_t             tcp_sack_head_lost(const struct tcp_pcb *pcb);
+tcpwnd_size_t    tcp_sack_pipe   (const struct tcp_pcb *pcb);
+#else /* LWIP_TCP_SACK_IN */
+#define TCP_SACK_RECOVERY(pcb) 0
+#define TCP_SACK_PARTIAL_ACK(pcb, ackno) 0
+#endif /* LWIP_TCP_SACK_IN */
+#if LWIP_TCP_RACK
+/* values for tcp_pcb.rack_timer */
+#define TCP_RACK_TIMER_NONE 0
+#define TCP_RACK_TIMER_REO  1 /* reordering window of a possibly lost segment */
+#define TCP_RACK_TIMER_TLP  2 /* Tail Loss Probe */
+/* flags for tcp_pcb.rack_flags */
+#define TCP_RACK_F_RTT      0x01U /* a segment was delivered, RTT values are valid */
+#define TCP_RACK_F_TLP      0x02U /* a Tail Loss Probe is outstanding */
+void             tcp_rack_update (struct tcp_pcb *pcb, const struct tcp_seg *seg);
+u8_t             tcp_rack_detect_loss(struct tcp_pcb *pcb);
+void             tcp_rack_arm_tlp(struct tcp_pcb *pcb);
+void             tcp_rack_tmr    (struct tcp_pcb *pcb);
+err_t            tcp_rexmit_tlp  (struct tcp_pcb *pcb);
+#endif /* LWIP_TCP_RACK */
 u32_t            tcp_update_rcv_ann_wnd(struct tcp_pcb *pcb);
 err_t            tcp_process_refused_data(struct tcp_pcb *pcb);
 
@@ -125,6 +154,36 @@ err_t            tcp_process_refused_data(struct tcp_pcb *pcb);
 #define TCP_SLOW_INTERVAL      (2*TCP_TMR_INTERVAL)  /* the coarse grained timeout in milliseconds */
 #endif /* TCP_SLOW_INTERVAL */
 
+#if LWIP_TCP_PCB_TIMERS
+/* Per-pcb timers count tcp_now(), rto and RTT estimates in milliseconds */
+#define TCP_TICK_MS            1
+#ifndef TCP_DELACK_TIMEOUT
+#define TCP_DELACK_TIMEOUT     100  /* delayed ACK timeout in milliseconds */
+#endif /* TCP_DELACK_TIMEOUT */
+#ifndef TCP_RTO_MIN
+#define TCP_RTO_MIN            200  /* lower bound of the RTO in milliseconds */
+#endif /* TCP_RTO_MIN */
+#ifndef TCP_RTO_MAX
+#define TCP_RTO_MAX            60000 /* upper bound of the RTO in milliseconds (RFC 6298) */
+#endif /* TCP_RTO_MAX */
+#define TCPRTO_F               S32_F
+#else /* LWIP_TCP_PCB_TIMERS */
+#define TCP_TICK_MS            TCP_SLOW_INTERVAL
+/* upper bound of the RTO in TCP_SLOW_INTERVAL ticks (limited by tcprto_t) */
+#define TCP_RTO_MAX            0x7FFF
+#define TCPRTO_F               S16_F
+#endif /* LWIP_TCP_PCB_TIMERS */
+
+/* Retransmission timeout from the RTT estimators and the time the
+   retransmission timer has been running in milliseconds */
+#if LWIP_TCP_PCB_TIMERS
+#define TCP_RTO_CALC(pcb)      ((tcprto_t)LWIP_MIN(LWIP_MAX(((pcb)->sa >> 3) + (pcb)->sv, TCP_RTO_MIN), TCP_RTO_MAX))
+#define TCP_RTO_ELAPSED(pcb)   (((pcb)->rtime > 0) ? (s32_t)(sys_now() - (pcb)->rto_start) : 0)
+#else /* LWIP_TCP_PCB_TIMERS */
+#define TCP_RTO_CALC(pcb)      ((tcprto_t)(((pcb)->sa >> 3) + (pcb)->sv))
+#define TCP_RTO_ELAPSED(pcb)   ((s32_t)LWIP_MAX((pcb)->rtime, 0) * TCP_SLOW_INTERVAL)
+#endif /* LWIP_TCP_PCB_TIMERS */
+
 #define TCP_FIN_WAIT_TIMEOUT 20000 /* milliseconds */
 #define TCP_SYN_RCVD_TIMEOUT 20000 /* milliseconds */
 
@@ -246,6 +305,21 @@ err_t            tcp_process_refused_data(struct tcp_pcb *pcb);
 /** Don't generate checksum on copy if CHECKSUM_GEN_TCP is disabled */
 #define TCP_CHECKSUM_ON_COPY  (LWIP_CHECKSUM_ON_COPY && CHECKSUM_GEN_TCP)
 
+#if LWIP_TCP_WRITE_REF
+#ifndef LWIP_PBUF_CUSTOM_REF_DEFINED
+#define LWIP_PBUF_CUSTOM_REF_DEFINED
+/** A custom pbuf that holds a reference to another pbuf, which is freed
+ * when this custom pbuf is freed. This is used to create a custom PBUF_REF
+ * that points into the original pbuf. */
+struct pbuf_custom_ref {
+  /** 'base class' */
+  struct pbuf_custom pc;
+  /** pointer to the original pbuf that is referenced */
+  struct pbuf *original;
+};
+#endif /* LWIP_PBUF_CUSTOM_REF_DEFINED */
+#endif /* LWIP_TCP_WRITE_REF */
+
 /* This structure represents a TCP segment on the unsent, unacked and ooseq queues */
 struct tcp_seg {
   struct tcp_seg *next;    /* used when putting segments on a queue */
@@ -267,6 +341,14 @@ struct tcp_seg {
                                                checksummed into 'chksum' */
 #define TF_SEG_OPTS_WND_SCALE   (u8_t)0x08U /* Include WND SCALE option (only used in SYN segments) */
 #define TF_SEG_OPTS_SACK_PERM   (u8_t)0x10U /* Include SACK Permitted option (only used in SYN segments) */
+#if LWIP_TCP_SACK_IN
+#define TF_SEG_SACKED           (u8_t)0x20U /* Segment was SACKed by the remote host */
+#define TF_SEG_SACK_REXMIT      (u8_t)0x40U /* Segment was retransmitted in the current SACK recovery */
+#endif /* LWIP_TCP_SACK_IN */
+#if LWIP_TCP_RACK
+#define TF_SEG_RACK_LOST        (u8_t)0x80U /* Segment was marked lost by RACK */
+  u32_t xmit_time;         /* sys_now() of the last transmission */
+#endif /* LWIP_TCP_RACK */
   struct tcp_hdr *tcphdr;  /* the TCP header */
 };
 
@@ -275,6 +357,7 @@ struct tcp_seg {
 #define LWIP_TCP_OPT_MSS        2
 #define LWIP_TCP_OPT_WS         3
 #define LWIP_TCP_OPT_SACK_PERM  4
+#define LWIP_TCP_OPT_SACK       5
 #define LWIP_TCP_OPT_TS         8
 
 #define LWIP_TCP_OPT_LEN_MSS    4
@@ -321,7 +404,9 @@ struct tcp_seg {
 
 /* Global variables: */
 extern struct tcp_pcb *tcp_input_pcb;
+#if !LWIP_TCP_PCB_TIMERS
 extern u32_t tcp_ticks;
+#endif /* !LWIP_TCP_PCB_TIMERS */
 extern u8_t tcp_active_pcbs_changed;
 
 /* The TCP PCB lists. */
@@ -346,6 +431,87 @@ extern struct tcp_pcb ** const tcp_pcb_lists[NUM_TCP_PCB_LISTS];
    3) All PCBs in the tcp_listen_pcbs list is in LISTEN state.
    4) All PCBs in the tcp_tw_pcbs list is in TIME-WAIT state.
 */
+#if LWIP_TCP_PCB_HASH
+/* The hash tables mirror tcp_active_pcbs, tcp_tw_pcbs and tcp_listen_pcbs.
+   Active and TIME-WAIT pcbs are hashed by local port, remote port and remote
+   IP address, listening pcbs by local port only. tcp_bound_pcbs is not hashed. */
+void tcp_pcb_hash_add(struct tcp_pcb **pcbs, struct tcp_pcb *pcb);
+void tcp_pcb_hash_remove(struct tcp_pcb **pcbs, struct tcp_pcb *pcb);
+struct tcp_pcb *tcp_pcb_hash_bucket(struct tcp_pcb **pcbs, u16_t local_port,
+                                    const ip_addr_t *remote_ip, u16_t remote_port);
+#define TCP_PCB_HASH_ADD(pcbs, npcb) tcp_pcb_hash_add(pcbs, npcb)
+#define TCP_PCB_HASH_RMV(pcbs, npcb) tcp_pcb_hash_remove(pcbs, npcb)
+#else /* LWIP_TCP_PCB_HASH */
+#define TCP_PCB_HASH_ADD(pcbs, npcb)
+#define TCP_PCB_HASH_RMV(pcbs, npcb)
+#endif /* LWIP_TCP_PCB_HASH */
+
+#if LWIP_TCP_TW_BUCKETS
+/** Compact TIME-WAIT state of a connection whose tcp_pcb has been freed */
+struct tcp_tw {
+  /** next bucket in the same hash chain */
+  struct tcp_tw *hash_next;
+  /** next bucket in the same local port chain and the link pointing here */
+  struct tcp_tw *port_next;
+  struct tcp_tw **port_pprev;
+  /** next (younger) and previous (older) bucket in tcp_tw_buckets */
+  struct tcp_tw *next;
+  struct tcp_tw *prev;
+  ip_addr_t local_ip;
+  ip_addr_t remote_ip;
+  /* ports are in host byte order */
+  u16_t local_port;
+  u16_t remote_port;
+  u32_t rcv_nxt;
+  u32_t snd_nxt;
+  /** start of TIME-WAIT (tcp_now()), restarted by a retransmitted FIN */
+  u32_t tmr;
+#if LWIP_TCP_TIMESTAMPS
+  u32_t ts_recent;
+#endif /* LWIP_TCP_TIMESTAMPS */
+  tcpwnd_size_t rcv_wnd;
+  /** window announced in ACKs (already scaled) */
+  u16_t ann_wnd;
+  u8_t netif_idx;
+  /** TCP_TW_FLAG_* */
+  u8_t flags;
+};
+/** ACKs carry a timestamp option */
+#define TCP_TW_FLAG_TIMESTAMP 0x01U
+
+/* All tw-buckets, oldest first: this is also the order in which they expire */
+extern struct tcp_tw *tcp_tw_buckets;
+
+err_t tcp_tw_enter(struct tcp_pcb *pcb);
+struct tcp_tw *tcp_tw_find(u16_t local_port, const ip_addr_t *local_ip,
+                           const ip_addr_t *remote_ip, u16_t remote_port);
+u8_t tcp_tw_port_used(u16_t local_port, const ip_addr_t *local_ip);
+void tcp_tw_restart(struct tcp_tw *tw);
+void tcp_tw_remove(struct tcp_tw *tw);
+#if !LWIP_TCP_PCB_TIMERS
+void tcp_tw_tmr(void);
+#endif /* !LWIP_TCP_PCB_TIMERS */
+err_t tcp_tw_send_ack(const struct tcp_tw *tw, struct netif *netif);
+#endif /* LWIP_TCP_TW_BUCKETS */
+
+/* Congestion control events (see struct tcp_cc_ops). NewReno is always built
+   and is called directly if congestion control is not pluggable. */
+void tcp_cc_newreno_ack(struct tcp_pcb *pcb, tcpwnd_size_t acked);
+void tcp_cc_newreno_loss(struct tcp_pcb *pcb);
+#if LWIP_TCP_CC
+#define TCP_CC_INIT(pcb)        do { if ((pcb)->cc_ops->init != NULL) { (pcb)->cc_ops->init(pcb); } } while(0)
+#define TCP_CC_ACK(pcb, acked)  (pcb)->cc_ops->ack(pcb, acked)
+#define TCP_CC_LOSS(pcb)        (pcb)->cc_ops->loss(pcb)
+#define TCP_CC_RTO(pcb)         (pcb)->cc_ops->rto(pcb)
+#define TCP_CC_IDLE(pcb)        do { if ((pcb)->cc_ops->idle != NULL) { (pcb)->cc_ops->idle(pcb); } } while(0)
+#else /* LWIP_TCP_CC */
+#define TCP_CC_INIT(pcb)
+#define TCP_CC_ACK(pcb, acked)  tcp_cc_newreno_ack(pcb, acked)
+#define TCP_CC_LOSS(pcb)        tcp_cc_newreno_loss(pcb)
+#define TCP_CC_RTO(pcb)         tcp_cc_newreno_loss(pcb)
+#define TCP_CC_IDLE(pcb)
+#endif /* LWIP_TCP_CC */
+
 /* Define two macros, TCP_REG and TCP_RMV that registers a TCP PCB
    with a PCB list or removes a PCB from a list, respectively. */
 #ifndef TCP_DEBUG_PCB_LISTS
@@ -364,6 +530,7 @@ extern struct tcp_pcb ** const tcp_pcb_lists[NUM_TCP_PCB_LISTS];
                             (npcb)->next = *(pcbs); \
                             LWIP_ASSERT("TCP_REG: npcb->next != npcb", (npcb)->next != (npcb)); \
                             *(pcbs) = (npcb); \
+                            TCP_PCB_HASH_ADD(pcbs, npcb); \
                             LWIP_ASSERT("TCP_REG: tcp_pcbs sane", tcp_pcbs_sane()); \
               tcp_timer_needed(); \
                             } while(0)
@@ -380,6 +547,7 @@ extern struct tcp_pcb ** const tcp_pcb_lists[NUM_TCP_PCB_LISTS];
                                } \
                             } \
                             (npcb)->next = NULL; \
+                            TCP_PCB_HASH_RMV(pcbs, npcb); \
                             LWIP_ASSERT("TCP_RMV: tcp_pcbs sane", tcp_pcbs_sane()); \
                             LWIP_DEBUGF(TCP_DEBUG, ("TCP_RMV: removed %p from %p\n", (void *)(npcb), (void *)(*(pcbs)))); \
                             } while(0)
@@ -390,6 +558,7 @@ extern struct tcp_pcb ** const tcp_pcb_lists[NUM_TCP_PCB_LISTS];
   do {                                             \
     (npcb)->next = *pcbs;                          \
     *(pcbs) = (npcb);                              \
+    TCP_PCB_HASH_ADD(pcbs, npcb);                  \
     tcp_timer_needed();                            \
   } while (0)
 
@@ -410,6 +579,7 @@ extern struct tcp_pcb ** const tcp_pcb_lists[NUM_TCP_PCB_LISTS];
       }                                            \
     }                                              \
     (npcb)->next = NULL;                           \
+    TCP_PCB_HASH_RMV(pcbs, npcb);                  \
   } while(0)
 
 #endif /* LWIP_DEBUG */
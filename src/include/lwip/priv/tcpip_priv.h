@@ -117,6 +117,9 @@ enum tcpip_msg_type {
 #endif /* !LWIP_TCPIP_CORE_LOCKING */
 #if !LWIP_TCPIP_CORE_LOCKING_INPUT
   TCPIP_MSG_INPKT,
+#if LWIP_TCPIP_INPUT_BATCH
+  TCPIP_MSG_INBATCH,
+#endif /* LWIP_TCPIP_INPUT_BATCH */
 #endif /* !LWIP_TCPIP_CORE_LOCKING_INPUT */
 #if LWIP_TCPIP_TIMEOUT && LWIP_TIMERS
   TCPIP_MSG_TIMEOUT,
@@ -152,6 +155,13 @@ struct tcpip_msg {
       struct netif *netif;
       netif_input_fn input_fn;
     } inp;
+#if LWIP_TCPIP_INPUT_BATCH
+    struct {
+      struct netif *netif;
+      netif_input_fn input_fn;
+      u16_t num;
+    } inbatch;
+#endif /* LWIP_TCPIP_INPUT_BATCH */
 #endif /* !LWIP_TCPIP_CORE_LOCKING_INPUT */
     struct {
       tcpip_callback_fn function;
@@ -167,6 +177,14 @@ struct tcpip_msg {
   } msg;
 };
 
+#if LWIP_TCPIP_INPUT_BATCH && !LWIP_TCPIP_CORE_LOCKING_INPUT
+/** A TCPIP_MSG_INBATCH message followed by its packets */
+struct tcpip_msg_inbatch {
+  struct tcpip_msg msg;
+  struct pbuf *p[TCPIP_INPUT_BATCH_SIZE];
+};
+#endif /* LWIP_TCPIP_INPUT_BATCH && !LWIP_TCPIP_CORE_LOCKING_INPUT */
+
 #ifdef __cplusplus
 }
 #endif
@@ -147,6 +147,15 @@ struct msghdr {
 #define MSG_TRUNC   0x04
 #define MSG_CTRUNC  0x08
 
+#if LWIP_SOCKET_MMSG
+/** A message and the number of bytes transferred for
+ * lwip_recvmmsg() and lwip_sendmmsg() */
+struct mmsghdr {
+  struct msghdr msg_hdr;
+  unsigned int  msg_len;
+};
+#endif /* LWIP_SOCKET_MMSG */
+
 /* RFC 3542, Section 20: Ancillary Data */
 struct cmsghdr {
   socklen_t  cmsg_len;   /* number of bytes, including header */
@@ -272,6 +281,7 @@ struct linger {
 #define MSG_DONTWAIT   0x08    /* Nonblocking i/o for this operation only */
 #define MSG_MORE       0x10    /* Sender will send more */
 #define MSG_NOSIGNAL   0x20    /* Uninmplemented: Requests not to send the SIGPIPE signal if an attempt to send is made on a stream-oriented socket that is no longer connected. */
+#define MSG_WAITFORONE 0x40    /* recvmmsg: Only wait for the first message (always the case in lwIP) */
 
 
 /*
@@ -492,7 +502,7 @@ typedef struct fd_set
   unsigned char fd_bits [(FD_SETSIZE+7)/8];
 } fd_set;
 
-#elif FD_SETSIZE < (LWIP_SOCKET_OFFSET + MEMP_NUM_NETCONN)
+#elif LWIP_SOCKET_SELECT && (FD_SETSIZE < (LWIP_SOCKET_OFFSET + MEMP_NUM_NETCONN))
 #error "external FD_SETSIZE too small for number of sockets"
 #else
 #define LWIP_SELECT_MAXNFDS FD_SETSIZE
@@ -521,6 +531,40 @@ struct pollfd
 };
 #endif
 
+#if LWIP_SOCKET_EPOLL
+/* epoll-related defines and types */
+#if !defined(EPOLLIN) && !defined(EPOLLOUT)
+#define EPOLLIN       0x001U
+#define EPOLLOUT      0x004U
+#define EPOLLERR      0x008U
+/* Below values are unimplemented (never reported) */
+#define EPOLLPRI      0x002U
+#define EPOLLHUP      0x010U
+#define EPOLLRDHUP    0x2000U
+/* Input flags */
+#define EPOLLONESHOT  (1U << 30)
+#define EPOLLET       (1U << 31)
+
+#define EPOLL_CTL_ADD 1
+#define EPOLL_CTL_DEL 2
+#define EPOLL_CTL_MOD 3
+
+typedef union epoll_data
+{
+  void *ptr;
+  int fd;
+  u32_t u32;
+  u64_t u64;
+} epoll_data_t;
+
+struct epoll_event
+{
+  u32_t events;
+  epoll_data_t data;
+};
+#endif
+#endif /* LWIP_SOCKET_EPOLL */
+
 /** LWIP_TIMEVAL_PRIVATE: if you want to use the struct timeval provided
  * by your system, set this to 0 and include <sys/time.h> in cc.h */
 #ifndef LWIP_TIMEVAL_PRIVATE
@@ -573,6 +617,15 @@ void lwip_socket_thread_cleanup(void); /* LWIP_NETCONN_SEM_PER_THREAD==1: destro
 #if LWIP_SOCKET_POLL
 #define lwip_poll         poll
 #endif
+#if LWIP_SOCKET_EPOLL
+#define lwip_epoll_create epoll_create
+#define lwip_epoll_ctl    epoll_ctl
+#define lwip_epoll_wait   epoll_wait
+#endif
+#if LWIP_SOCKET_MMSG
+#define lwip_recvmmsg     recvmmsg
+#define lwip_sendmmsg     sendmmsg
+#endif
 #define lwip_ioctl        ioctlsocket
 #define lwip_inet_ntop    inet_ntop
 #define lwip_inet_pton    inet_pton
@@ -622,6 +675,21 @@ int lwip_select(int maxfdp1, fd_set *readset, fd_set *writeset, fd_set *exceptse
 #if LWIP_SOCKET_POLL
 int lwip_poll(struct pollfd *fds, nfds_t nfds, int timeout);
 #endif
+#if LWIP_SOCKET_EPOLL
+int lwip_epoll_create(int size);
+int lwip_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event);
+int lwip_epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout);
+#endif
+#if LWIP_SOCKET_ZEROCOPY_RECV
+ssize_t lwip_recv_zc(int s, struct pbuf **p, int flags,
+      struct sockaddr *from, socklen_t *fromlen);
+int lwip_recv_zc_done(int s, struct pbuf *p);
+#endif
+#if LWIP_SOCKET_MMSG
+int lwip_recvmmsg(int s, struct mmsghdr *msgvec, unsigned int vlen, int flags,
+                  struct timeval *timeout);
+int lwip_sendmmsg(int s, struct mmsghdr *msgvec, unsigned int vlen, int flags);
+#endif
 int lwip_ioctl(int s, long cmd, void *argp);
 int lwip_fcntl(int s, int cmd, int val);
 const char *lwip_inet_ntop(int af, const void *src, char *dst, socklen_t size);
@@ -671,6 +739,20 @@ int lwip_inet_pton(int af, const char *src, void *dst);
 /** @ingroup socket */
 #define poll(fds,nfds,timeout)                    lwip_poll(fds,nfds,timeout)
 #endif
+#if LWIP_SOCKET_EPOLL
+/** @ingroup socket */
+#define epoll_create(size)                        lwip_epoll_create(size)
+/** @ingroup socket */
+#define epoll_ctl(epfd,op,fd,event)               lwip_epoll_ctl(epfd,op,fd,event)
+/** @ingroup socket */
+#define epoll_wait(epfd,events,maxevents,timeout) lwip_epoll_wait(epfd,events,maxevents,timeout)
+#endif
+#if LWIP_SOCKET_MMSG
+/** @ingroup socket */
+#define recvmmsg(s,msgvec,vlen,flags,timeout)     lwip_recvmmsg(s,msgvec,vlen,flags,timeout)
+/** @ingroup socket */
+#define sendmmsg(s,msgvec,vlen,flags)             lwip_sendmmsg(s,msgvec,vlen,flags)
+#endif
 /** @ingroup socket */
 #define ioctlsocket(s,cmd,argp)                   lwip_ioctl(s,cmd,argp)
 /** @ingroup socket */
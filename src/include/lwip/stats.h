@@ -76,6 +76,13 @@ struct stats_proto {
   STAT_COUNTER cachehit;
 };
 
+/** Receive coalescing stats */
+struct stats_gro {
+  STAT_COUNTER recv;             /* TCP segments offered for coalescing. */
+  STAT_COUNTER merged;           /* Segments appended to a held packet. */
+  STAT_COUNTER flush;            /* Held packets passed to the stack. */
+};
+
 /** IGMP stats */
 struct stats_igmp {
   STAT_COUNTER xmit;             /* Transmitted packets. */
@@ -262,6 +269,10 @@ struct stats_ {
   /** TCP */
   struct stats_proto tcp;
 #endif
+#if GRO_STATS
+  /** Receive coalescing */
+  struct stats_gro gro;
+#endif
 #if MEM_STATS
   /** Heap */
   struct stats_mem mem;
@@ -329,6 +340,14 @@ void stats_init(void);
 #define TCP_STATS_DISPLAY()
 #endif
 
+#if GRO_STATS
+#define GRO_STATS_INC(x) STATS_INC(x)
+#define GRO_STATS_DISPLAY() stats_display_gro(&lwip_stats.gro)
+#else
+#define GRO_STATS_INC(x)
+#define GRO_STATS_DISPLAY()
+#endif
+
 #if UDP_STATS
 #define UDP_STATS_INC(x) STATS_INC(x)
 #define UDP_STATS_DISPLAY() stats_display_proto(&lwip_stats.udp, "UDP")
@@ -475,6 +494,7 @@ void stats_display_igmp(struct stats_igmp *igmp, const char *name);
 void stats_display_mem(struct stats_mem *mem, const char *name);
 void stats_display_memp(struct stats_mem *mem, int index);
 void stats_display_sys(struct stats_sys *sys);
+void stats_display_gro(struct stats_gro *gro);
 #else /* LWIP_STATS_DISPLAY */
 #define stats_display()
 #define stats_display_proto(proto, name)
@@ -482,6 +502,7 @@ void stats_display_sys(struct stats_sys *sys);
 #define stats_display_mem(mem, name)
 #define stats_display_memp(mem, index)
 #define stats_display_sys(sys)
+#define stats_display_gro(gro)
 #endif /* LWIP_STATS_DISPLAY */
 
 #ifdef __cplusplus
@@ -50,6 +50,9 @@
 #include "lwip/err.h"
 #include "lwip/ip6.h"
 #include "lwip/ip6_addr.h"
+#if LWIP_TCP_PCB_TIMERS
+#include "lwip/timeouts.h"
+#endif /* LWIP_TCP_PCB_TIMERS */
 
 #ifdef __cplusplus
 extern "C" {
@@ -203,6 +206,41 @@ struct tcp_pcb_ext_args {
 #define TCP_PCB_EXTARGS
 #endif
 
+#if LWIP_TCP_PCB_HASH
+/* Link to the next pcb in the same hash bucket */
+#define TCP_PCB_HASH_NEXT(type) type *hash_next;
+#else
+#define TCP_PCB_HASH_NEXT(type)
+#endif
+
+#if LWIP_TCP_CC
+/**
+ * @ingroup tcp_raw
+ * A congestion control algorithm. All functions are called from the tcpip
+ * thread with the pcb's cwnd/ssthresh as the state to update; private state
+ * can be kept in pcb->cc_priv (TCP_CC_PRIV_WORDS). 'init' and 'idle' may be NULL.
+ */
+struct tcp_cc_ops {
+  /** name for debugging/selection */
+  const char *name;
+  /** connection entered ESTABLISHED (or the algorithm was switched) */
+  void (*init)(struct tcp_pcb *pcb);
+  /** 'acked' bytes of new data were acknowledged (not in fast recovery) */
+  void (*ack)(struct tcp_pcb *pcb, tcpwnd_size_t acked);
+  /** fast retransmit: set ssthresh (cwnd is inflated to ssthresh + 3 mss by the caller) */
+  void (*loss)(struct tcp_pcb *pcb);
+  /** retransmission timeout: set ssthresh (cwnd is reset to 1 mss by the caller) */
+  void (*rto)(struct tcp_pcb *pcb);
+  /** new data is sent after the connection was idle (nothing in flight) */
+  void (*idle)(struct tcp_pcb *pcb);
+};
+
+extern const struct tcp_cc_ops tcp_cc_newreno;
+#if LWIP_TCP_CC_CUBIC
+extern const struct tcp_cc_ops tcp_cc_cubic;
+#endif /* LWIP_TCP_CC_CUBIC */
+#endif /* LWIP_TCP_CC */
+
 typedef u16_t tcpflags_t;
 #define TCP_ALLFLAGS 0xffffU
 
@@ -211,6 +249,7 @@ typedef u16_t tcpflags_t;
  */
 #define TCP_PCB_COMMON(type) \
   type *next; /* for the linked list */ \
+  TCP_PCB_HASH_NEXT(type) \
   void *callback_arg; \
   TCP_PCB_EXTARGS \
   enum tcp_state state; /* TCP state */ \
@@ -269,6 +308,9 @@ struct tcp_pcb {
 #define TF_RTO         0x0800U /* RTO timer has fired, in-flight data moved to unsent and being retransmitted */
 #if LWIP_TCP_SACK_OUT
 #define TF_SACK        0x1000U /* Selective ACKs enabled */
+#endif
+#if LWIP_TCP_TW_BUCKETS
+#define TF_ORPHANED    0x2000U /* Released by tcp_close(): replaced by a tw-bucket in TIME-WAIT */
 #endif
 
   /* the rest of the fields are in host byte order
@@ -297,20 +339,38 @@ struct tcp_pcb {
   u16_t mss;   /* maximum segment size */
 
   /* RTT (round trip time) estimation variables */
-  u32_t rttest; /* RTT estimate in 500ms ticks */
+  u32_t rttest; /* start of the RTT measurement (tcp_now()) */
   u32_t rtseq;  /* sequence number being timed */
-  s16_t sa, sv; /* @see "Congestion Avoidance and Control" by Van Jacobson and Karels */
+  tcprto_t sa, sv; /* @see "Congestion Avoidance and Control" by Van Jacobson and Karels */
 
-  s16_t rto;    /* retransmission time-out (in ticks of TCP_SLOW_INTERVAL) */
+  tcprto_t rto; /* retransmission time-out (in ticks of TCP_TICK_MS) */
   u8_t nrtx;    /* number of retransmissions */
 
   /* fast retransmit/recovery */
   u8_t dupacks;
   u32_t lastack; /* Highest acknowledged seqno. */
+#if LWIP_TCP_SACK_IN
+  u32_t recover; /* snd_nxt when SACK loss recovery started (RFC 6675 RecoveryPoint) */
+#endif /* LWIP_TCP_SACK_IN */
+#if LWIP_TCP_RACK
+  /* RACK-TLP state, times are in milliseconds (sys_now()) */
+  u32_t rack_xmit_ts;  /* send time of the most recently sent segment delivered */
+  u32_t rack_end_seq;  /* end of that segment */
+  u32_t rack_rtt;      /* RTT measured for that segment */
+  u32_t rack_min_rtt;
+  u32_t rack_srtt;
+  u32_t rack_deadline; /* expiry time of rack_timer */
+  u8_t rack_timer;     /* TCP_RACK_TIMER_* */
+  u8_t rack_flags;     /* TCP_RACK_F_* */
+#endif /* LWIP_TCP_RACK */
 
   /* congestion avoidance/control variables */
   tcpwnd_size_t cwnd;
   tcpwnd_size_t ssthresh;
+#if LWIP_TCP_CC
+  const struct tcp_cc_ops *cc_ops;
+  u32_t cc_priv[TCP_CC_PRIV_WORDS];
+#endif /* LWIP_TCP_CC */
 
   /* first byte following last rto byte */
   u32_t rto_end;
@@ -382,6 +442,18 @@ struct tcp_pcb {
   /* KEEPALIVE counter */
   u8_t keep_cnt_sent;
 
+#if LWIP_TCP_PCB_TIMERS
+  /* Armed to the earliest deadline of this pcb by tcp_timers_update() */
+  struct sys_timeo timer;
+  /* sys_now() when the retransmission, persist, poll and delayed ACK timers
+     were started (rtime, persist_cnt and polltmr only mark them started) */
+  u32_t rto_start;
+  u32_t persist_start;
+  u32_t poll_start;
+  u32_t fast_start;
+  u8_t fast_running;
+#endif /* LWIP_TCP_PCB_TIMERS */
+
 #if LWIP_WND_SCALE
   u8_t snd_scale;
   u8_t rcv_scale;
@@ -419,6 +491,9 @@ void             tcp_err     (struct tcp_pcb *pcb, tcp_err_fn err);
 void             tcp_accept  (struct tcp_pcb *pcb, tcp_accept_fn accept);
 #endif /* LWIP_CALLBACK_API */
 void             tcp_poll    (struct tcp_pcb *pcb, tcp_poll_fn poll, u8_t interval);
+#if LWIP_TCP_PCB_TIMERS
+void             tcp_timers_update(struct tcp_pcb *pcb);
+#endif /* LWIP_TCP_PCB_TIMERS */
 
 #define          tcp_set_flags(pcb, set_flags)     do { (pcb)->flags = (tcpflags_t)((pcb)->flags |  (set_flags)); } while(0)
 #define          tcp_clear_flags(pcb, clr_flags)   do { (pcb)->flags = (tcpflags_t)((pcb)->flags & (tcpflags_t)(~(clr_flags) & TCP_ALLFLAGS)); } while(0)
@@ -472,6 +547,10 @@ err_t            tcp_shutdown(struct tcp_pcb *pcb, int shut_rx, int shut_tx);
 
 err_t            tcp_write   (struct tcp_pcb *pcb, const void *dataptr, u16_t len,
                               u8_t apiflags);
+#if LWIP_TCP_WRITE_REF
+err_t            tcp_write_ref(struct tcp_pcb *pcb, const void *dataptr, u16_t len,
+                               u8_t apiflags, struct pbuf *ref);
+#endif /* LWIP_TCP_WRITE_REF */
 
 void             tcp_setprio (struct tcp_pcb *pcb, u8_t prio);
 
@@ -484,6 +563,10 @@ err_t            tcp_tcp_get_tcp_addrinfo(struct tcp_pcb *pcb, int local, ip_add
 /* for compatibility with older implementation */
 #define tcp_new_ip6() tcp_new_ip_type(IPADDR_TYPE_V6)
 
+#if LWIP_TCP_CC
+err_t tcp_set_cc(struct tcp_pcb *pcb, const struct tcp_cc_ops *ops);
+#endif /* LWIP_TCP_CC */
+
 #if LWIP_TCP_PCB_NUM_EXT_ARGS
 u8_t tcp_ext_arg_alloc_id(void);
 void tcp_ext_arg_set_callbacks(struct tcp_pcb *pcb, u8_t id, const struct tcp_ext_arg_callbacks * const callbacks);
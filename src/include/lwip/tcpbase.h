@@ -53,6 +53,13 @@ typedef u32_t tcpwnd_size_t;
 typedef u16_t tcpwnd_size_t;
 #endif
 
+#if LWIP_TCP_PCB_TIMERS
+/* RTO and RTT estimators in milliseconds, up to TCP_RTO_MAX */
+typedef s32_t tcprto_t;
+#else
+typedef s16_t tcprto_t;
+#endif
+
 enum tcp_state {
   CLOSED      = 0,
   LISTEN      = 1,
@@ -78,6 +78,9 @@ void   tcpip_init(tcpip_init_done_fn tcpip_init_done, void *arg);
 
 err_t  tcpip_inpkt(struct pbuf *p, struct netif *inp, netif_input_fn input_fn);
 err_t  tcpip_input(struct pbuf *p, struct netif *inp);
+#if LWIP_TCPIP_INPUT_BATCH
+err_t  tcpip_input_batch(struct pbuf **p, u16_t num, struct netif *inp);
+#endif /* LWIP_TCPIP_INPUT_BATCH */
 
 err_t  tcpip_try_callback(tcpip_callback_fn function, void *ctx);
 err_t  tcpip_callback(tcpip_callback_fn function, void *ctx);
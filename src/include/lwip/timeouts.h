@@ -92,6 +92,14 @@ typedef void (* sys_timeout_handler)(void *arg);
 
 struct sys_timeo {
   struct sys_timeo *next;
+#if LWIP_TIMERS_WHEEL
+  /** the pointer pointing to this timeout (to unlink it in O(1)) */
+  struct sys_timeo **pprev;
+  /** wheel level * 32 + slot this timeout is linked to */
+  u8_t wheel_pos;
+#endif /* LWIP_TIMERS_WHEEL */
+  /** SYS_TIMEO_FLAG_* */
+  u8_t flags;
   u32_t time;
   sys_timeout_handler h;
   void *arg;
@@ -100,6 +108,15 @@ struct sys_timeo {
 #endif /* LWIP_DEBUG_TIMERNAMES */
 };
 
+/** Timeout is owned by the caller (sys_timeout_start()), not by the pool */
+#define SYS_TIMEO_FLAG_STATIC   0x01U
+/** Timeout owned by the caller is armed */
+#define SYS_TIMEO_FLAG_PENDING  0x02U
+
+/** Check if a timeout started with sys_timeout_start() has not expired or
+ * been stopped yet */
+#define sys_timeout_pending(timeout) (((timeout)->flags & SYS_TIMEO_FLAG_PENDING) != 0)
+
 void sys_timeouts_init(void);
 
 #if LWIP_DEBUG_TIMERNAMES
@@ -109,13 +126,26 @@ void sys_timeout_debug(u32_t msecs, sys_timeout_handler handler, void *arg, cons
 void sys_timeout(u32_t msecs, sys_timeout_handler handler, void *arg);
 #endif /* LWIP_DEBUG_TIMERNAMES */
 
+#if LWIP_DEBUG_TIMERNAMES
+void sys_timeout_start_debug(struct sys_timeo *timeout, u32_t msecs, sys_timeout_handler handler, void *arg, const char* handler_name);
+#define sys_timeout_start(timeout, msecs, handler, arg) sys_timeout_start_debug(timeout, msecs, handler, arg, #handler)
+#else /* LWIP_DEBUG_TIMERNAMES */
+void sys_timeout_start(struct sys_timeo *timeout, u32_t msecs, sys_timeout_handler handler, void *arg);
+#endif /* LWIP_DEBUG_TIMERNAMES */
+void sys_timeout_stop(struct sys_timeo *timeout);
+
 void sys_untimeout(sys_timeout_handler handler, void *arg);
 void sys_restart_timeouts(void);
 void sys_check_timeouts(void);
 u32_t sys_timeouts_sleeptime(void);
 
 #if LWIP_TESTMODE
+#if LWIP_TIMERS_WHEEL
+struct sys_timeo* sys_timeouts_take_all(void);
+void sys_timeouts_put_all(struct sys_timeo *list);
+#else /* LWIP_TIMERS_WHEEL */
 struct sys_timeo** sys_timeouts_get_next_timeout(void);
+#endif /* LWIP_TIMERS_WHEEL */
 void lwip_cyclic_timer(void *arg);
 #endif
 
@@ -653,6 +653,116 @@ sockets_stresstest_listener_loop(void *arg)
   }
 }
 
+#if LWIP_SOCKET_EPOLL
+#ifndef TEST_EPOLL_STEP_MS
+#define TEST_EPOLL_STEP_MS    1000
+#endif
+
+/* Send datagrams to random ones of the first 'num_socks' sockets for
+ * TEST_EPOLL_STEP_MS and return the rate of events per second */
+static u32_t
+sockets_stresstest_epoll_step(int ep, int stx, const int *socks, const struct sockaddr_in *addrs, int num_socks)
+{
+  u32_t num_events = 0;
+  u32_t start = sys_now();
+  u32_t elapsed;
+  char buf[4];
+  int i, ret;
+
+  do {
+    struct epoll_event ev;
+    i = (int)(LWIP_RAND() % (u32_t)num_socks);
+    ret = lwip_sendto(stx, "test", 4, 0, (const struct sockaddr *)&addrs[i], sizeof(struct sockaddr_in));
+    LWIP_ASSERT("ret == 4", ret == 4);
+    ret = lwip_epoll_wait(ep, &ev, 1, TEST_MAX_RXWAIT_MS);
+    LWIP_ASSERT("one event", ret == 1);
+    LWIP_ASSERT("event for the right socket", ev.data.u32 == (u32_t)i);
+    ret = lwip_recv(socks[i], buf, sizeof(buf), MSG_DONTWAIT);
+    LWIP_ASSERT("ret == 4", ret == 4);
+    num_events++;
+    elapsed = sys_now() - start;
+  } while (elapsed < TEST_EPOLL_STEP_MS);
+  return (u32_t)(num_events * 1000 / elapsed);
+}
+
+/* epoll scaling test: idle UDP sockets are registered with one epoll
+ * instance, the event rate is measured with 10, 100, 1000... and finally
+ * 'num_sockets' sockets. It should not depend on the number of sockets. */
+void
+sockets_stresstest_epoll_run(int num_sockets)
+{
+  int num_socks = num_sockets;
+  int *socks;
+  struct sockaddr_in *addrs;
+  int ep, stx, i, ret;
+  int step = 10;
+
+  /* leave one socket for sending */
+  num_socks = LWIP_MIN(num_socks, MEMP_NUM_NETCONN - 1);
+  num_socks = LWIP_MIN(num_socks, MEMP_NUM_EPOLL_ITEM);
+  LWIP_ASSERT("num_socks > 0", num_socks > 0);
+  socks = (int *)mem_malloc((mem_size_t)(num_socks * sizeof(int)));
+  addrs = (struct sockaddr_in *)mem_malloc((mem_size_t)(num_socks * sizeof(struct sockaddr_in)));
+  LWIP_ASSERT("OOM", (socks != NULL) && (addrs != NULL));
+
+  ep = lwip_epoll_create(1);
+  LWIP_ASSERT("ep >= 0", ep >= 0);
+  stx = lwip_socket(AF_INET, SOCK_DGRAM, 0);
+  LWIP_ASSERT("stx >= 0", stx >= 0);
+  for (i = 0; i < num_socks; i++) {
+    struct epoll_event ev;
+    socklen_t addr_len = sizeof(struct sockaddr_in);
+
+    socks[i] = lwip_socket(AF_INET, SOCK_DGRAM, 0);
+    LWIP_ASSERT("s >= 0", socks[i] >= 0);
+    memset(&addrs[i], 0, sizeof(struct sockaddr_in));
+    addrs[i].sin_family = AF_INET;
+    addrs[i].sin_addr.s_addr = inet_addr("127.0.0.1");
+    ret = lwip_bind(socks[i], (struct sockaddr *)&addrs[i], sizeof(struct sockaddr_in));
+    LWIP_ASSERT("ret == 0", ret == 0);
+    ret = lwip_getsockname(socks[i], (struct sockaddr *)&addrs[i], &addr_len);
+    LWIP_ASSERT("ret == 0", ret == 0);
+    ev.events = EPOLLIN;
+    ev.data.u32 = (u32_t)i;
+    ret = lwip_epoll_ctl(ep, EPOLL_CTL_ADD, socks[i], &ev);
+    LWIP_ASSERT("ret == 0", ret == 0);
+
+    if ((i + 1 == step) || (i + 1 == num_socks)) {
+      u32_t rate = sockets_stresstest_epoll_step(ep, stx, socks, addrs, i + 1);
+      LWIP_DEBUGF(TEST_SOCKETS_STRESS | LWIP_DBG_STATE, ("sockets_stresstest_epoll: %d sockets, %"U32_F" events/s\n",
+        i + 1, rate));
+      step *= 10;
+    }
+  }
+
+  ret = lwip_close(stx);
+  LWIP_ASSERT("ret == 0", ret == 0);
+  for (i = 0; i < num_socks; i++) {
+    ret = lwip_close(socks[i]);
+    LWIP_ASSERT("ret == 0", ret == 0);
+  }
+  ret = lwip_close(ep);
+  LWIP_ASSERT("ret == 0", ret == 0);
+  mem_free(addrs);
+  mem_free(socks);
+}
+
+static void
+sockets_stresstest_epoll(void *arg)
+{
+  sockets_stresstest_epoll_run((int)(size_t)arg);
+}
+
+void
+sockets_stresstest_init_epoll(int num_sockets)
+{
+  sys_thread_t t;
+
+  t = sys_thread_new("sockets_stresstest_epoll", sockets_stresstest_epoll, (void *)(size_t)num_sockets, 0, 0);
+  LWIP_ASSERT("thread != NULL", t != 0);
+}
+#endif /* LWIP_SOCKET_EPOLL */
+
 void
 sockets_stresstest_init_loopback(int addr_family)
 {
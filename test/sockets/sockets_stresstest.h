@@ -36,5 +36,9 @@
 void sockets_stresstest_init_loopback(int addr_family);
 void sockets_stresstest_init_server(int addr_family, u16_t server_port);
 void sockets_stresstest_init_client(const char *remote_ip, u16_t remote_port);
+#if LWIP_SOCKET_EPOLL
+void sockets_stresstest_init_epoll(int num_sockets);
+void sockets_stresstest_epoll_run(int num_sockets);
+#endif
 
 #endif /* LWIP_HDR_TEST_SOCKETS_STRESSTEST */
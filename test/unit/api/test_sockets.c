@@ -48,6 +48,11 @@ sockets_teardown(void)
     tcp_abort(tcp_tw_pcbs);
     tcpip_thread_poll_one();
   }
+#if LWIP_TCP_TW_BUCKETS
+  while (tcp_tw_buckets) {
+    tcp_tw_remove(tcp_tw_buckets);
+  }
+#endif /* LWIP_TCP_TW_BUCKETS */
   tcpip_thread_poll_one();
   /* ensure full free heap */
   lwip_check_ensure_no_alloc(SKIP_POOL(MEMP_SYS_TIMEOUT));
@@ -828,6 +833,388 @@ cleanup:
 }
 END_TEST
 
+#if LWIP_SOCKET_ZEROCOPY_RECV
+static void test_sockets_recv_zc_tcp(int domain)
+{
+  int s, s2, s3, ret, one = 1;
+  struct sockaddr_storage addr, addr2;
+  socklen_t addrlen, addr2len;
+  struct lwip_sock *sock;
+  struct tcp_pcb *pcb;
+  struct pbuf *p;
+
+  test_sockets_init_loopback_addr(domain, &addr, &addrlen);
+  s = lwip_socket(domain, SOCK_STREAM, 0);
+  fail_unless(s >= 0);
+  ret = lwip_bind(s, (struct sockaddr*)&addr, addrlen);
+  fail_unless(ret == 0);
+  ret = lwip_listen(s, 0);
+  fail_unless(ret == 0);
+  ret = lwip_getsockname(s, (struct sockaddr*)&addr, &addrlen);
+  fail_unless(ret == 0);
+
+  s2 = test_sockets_alloc_socket_nonblocking(domain, SOCK_STREAM);
+  fail_unless(s2 >= 0);
+  ret = lwip_connect(s2, (struct sockaddr*)&addr, addrlen);
+  fail_unless(ret == -1);
+  fail_unless(errno == EINPROGRESS);
+  while(tcpip_thread_poll_one());
+  addr2len = sizeof(addr2);
+  s3 = lwip_accept(s, (struct sockaddr*)&addr2, &addr2len);
+  fail_unless(s3 >= 0);
+  /* the delayed ACK must not hold back the second write */
+  ret = lwip_setsockopt(s3, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  fail_unless(ret == 0);
+
+  sock = lwip_socket_dbg_get_socket(s2);
+  fail_unless(sock != NULL);
+  pcb = sock->conn->pcb.tcp;
+  fail_unless(pcb != NULL);
+
+  /* nothing received yet */
+  ret = (int)lwip_recv_zc(s2, &p, MSG_DONTWAIT, NULL, NULL);
+  fail_unless(ret == -1);
+  fail_unless(errno == EWOULDBLOCK);
+  fail_unless(p == NULL);
+
+  ret = lwip_write(s3, "test", 4);
+  fail_unless(ret == 4);
+  while(tcpip_thread_poll_one());
+
+  /* the received pbuf is handed out, the window stays closed by its size */
+  addr2len = sizeof(addr2);
+  ret = (int)lwip_recv_zc(s2, &p, 0, (struct sockaddr*)&addr2, &addr2len);
+  fail_unless(ret == 4);
+  fail_unless(p != NULL);
+  fail_unless(p->tot_len == 4);
+  fail_unless(pbuf_memcmp(p, 0, "test", 4) == 0);
+  fail_unless(addr2len == addrlen);
+  fail_unless(pcb->rcv_wnd == TCP_WND_MAX(pcb) - 4);
+
+  ret = lwip_recv_zc_done(s2, p);
+  fail_unless(ret == 0);
+  fail_unless(pcb->rcv_wnd == TCP_WND_MAX(pcb));
+
+  /* data left by a partial read is handed out, too */
+  ret = lwip_write(s3, "test", 4);
+  fail_unless(ret == 4);
+  while(tcpip_thread_poll_one());
+  ret = lwip_read(s2, &addr2, 1);
+  fail_unless(ret == 1);
+  ret = (int)lwip_recv_zc(s2, &p, 0, NULL, NULL);
+  fail_unless(ret == 3);
+  fail_unless(pbuf_memcmp(p, 0, "est", 3) == 0);
+  fail_unless(pcb->rcv_wnd == TCP_WND_MAX(pcb) - 3);
+  ret = lwip_recv_zc_done(s2, p);
+  fail_unless(ret == 0);
+  fail_unless(pcb->rcv_wnd == TCP_WND_MAX(pcb));
+
+  /* FIN */
+  ret = lwip_shutdown(s3, SHUT_WR);
+  fail_unless(ret == 0);
+  while(tcpip_thread_poll_one());
+  ret = (int)lwip_recv_zc(s2, &p, 0, NULL, NULL);
+  fail_unless(ret == 0);
+  fail_unless(p == NULL);
+
+  ret = lwip_close(s2);
+  fail_unless(ret == 0);
+  ret = lwip_close(s3);
+  fail_unless(ret == 0);
+  ret = lwip_close(s);
+  fail_unless(ret == 0);
+  while(tcpip_thread_poll_one());
+}
+
+static void test_sockets_recv_zc_udp(int domain)
+{
+  int s, ret;
+  struct sockaddr_storage addr, from;
+  socklen_t addrlen, fromlen;
+  struct pbuf *p;
+
+  test_sockets_init_loopback_addr(domain, &addr, &addrlen);
+  s = test_sockets_alloc_socket_nonblocking(domain, SOCK_DGRAM);
+  fail_unless(s >= 0);
+  ret = lwip_bind(s, (struct sockaddr*)&addr, addrlen);
+  fail_unless(ret == 0);
+  ret = lwip_getsockname(s, (struct sockaddr*)&addr, &addrlen);
+  fail_unless(ret == 0);
+
+  ret = (int)lwip_sendto(s, "test", 4, 0, (struct sockaddr*)&addr, addrlen);
+  fail_unless(ret == 4);
+  while(tcpip_thread_poll_one());
+
+  fromlen = sizeof(from);
+  ret = (int)lwip_recv_zc(s, &p, 0, (struct sockaddr*)&from, &fromlen);
+  fail_unless(ret == 4);
+  fail_unless(p != NULL);
+  fail_unless(pbuf_memcmp(p, 0, "test", 4) == 0);
+  fail_unless(fromlen == addrlen);
+  fail_unless(memcmp(&from, &addr, addrlen) == 0);
+  ret = lwip_recv_zc_done(s, p);
+  fail_unless(ret == 0);
+
+  ret = (int)lwip_recv_zc(s, &p, 0, NULL, NULL);
+  fail_unless(ret == -1);
+  fail_unless(errno == EWOULDBLOCK);
+
+  ret = lwip_close(s);
+  fail_unless(ret == 0);
+}
+#endif /* LWIP_SOCKET_ZEROCOPY_RECV */
+
+/** Receive pbufs without copying and return them later */
+START_TEST(test_sockets_recv_zc)
+{
+  LWIP_UNUSED_ARG(_i);
+#if LWIP_SOCKET_ZEROCOPY_RECV
+#if LWIP_IPV4
+  test_sockets_recv_zc_tcp(AF_INET);
+  test_sockets_recv_zc_udp(AF_INET);
+#endif
+#if LWIP_IPV6
+  test_sockets_recv_zc_tcp(AF_INET6);
+  test_sockets_recv_zc_udp(AF_INET6);
+#endif
+#endif /* LWIP_SOCKET_ZEROCOPY_RECV */
+}
+END_TEST
+
+#if LWIP_SOCKET_EPOLL
+static void test_sockets_epoll_domain(int domain)
+{
+  int ep, s1, s2, ret;
+  struct sockaddr_storage addr1, addr2;
+  socklen_t addr1len, addr2len;
+  struct epoll_event ev, evs[4];
+  char buf[4];
+
+  test_sockets_init_loopback_addr(domain, &addr1, &addr1len);
+  test_sockets_init_loopback_addr(domain, &addr2, &addr2len);
+  s1 = test_sockets_alloc_socket_nonblocking(domain, SOCK_DGRAM);
+  fail_unless(s1 >= 0);
+  s2 = test_sockets_alloc_socket_nonblocking(domain, SOCK_DGRAM);
+  fail_unless(s2 >= 0);
+  fail_unless(lwip_bind(s1, (struct sockaddr*)&addr1, addr1len) == 0);
+  fail_unless(lwip_bind(s2, (struct sockaddr*)&addr2, addr2len) == 0);
+  fail_unless(lwip_getsockname(s1, (struct sockaddr*)&addr1, &addr1len) == 0);
+  fail_unless(lwip_getsockname(s2, (struct sockaddr*)&addr2, &addr2len) == 0);
+
+  ep = lwip_epoll_create(1);
+  fail_unless(ep >= 0);
+
+  /* s1 level-triggered, s2 edge-triggered */
+  ev.events = EPOLLIN;
+  ev.data.fd = s1;
+  fail_unless(lwip_epoll_ctl(ep, EPOLL_CTL_ADD, s1, &ev) == 0);
+  fail_unless(lwip_epoll_ctl(ep, EPOLL_CTL_ADD, s1, &ev) == -1);
+  fail_unless(errno == EEXIST);
+  ev.events = EPOLLIN | EPOLLET;
+  ev.data.fd = s2;
+  fail_unless(lwip_epoll_ctl(ep, EPOLL_CTL_ADD, s2, &ev) == 0);
+  fail_unless(lwip_epoll_wait(ep, evs, 4, 0) == 0);
+
+  /* a datagram for each socket */
+  ret = (int)lwip_sendto(s1, "test", 4, 0, (struct sockaddr*)&addr2, addr2len);
+  fail_unless(ret == 4);
+  ret = (int)lwip_sendto(s2, "test", 4, 0, (struct sockaddr*)&addr1, addr1len);
+  fail_unless(ret == 4);
+  while(tcpip_thread_poll_one());
+
+  /* both are reported, in the order of their events */
+  ret = lwip_epoll_wait(ep, evs, 4, 0);
+  fail_unless(ret == 2);
+  fail_unless(evs[0].data.fd == s2);
+  fail_unless(evs[0].events == EPOLLIN);
+  fail_unless(evs[1].data.fd == s1);
+  fail_unless(evs[1].events == EPOLLIN);
+
+  /* only the level-triggered one is reported again */
+  ret = lwip_epoll_wait(ep, evs, 4, 0);
+  fail_unless(ret == 1);
+  fail_unless(evs[0].data.fd == s1);
+  fail_unless(lwip_read(s1, buf, sizeof(buf)) == 4);
+  fail_unless(lwip_epoll_wait(ep, evs, 4, 0) == 0);
+
+  /* new data is a new edge, even if older data is still unread */
+  ret = (int)lwip_sendto(s1, "test", 4, 0, (struct sockaddr*)&addr2, addr2len);
+  fail_unless(ret == 4);
+  while(tcpip_thread_poll_one());
+  ret = lwip_epoll_wait(ep, evs, 4, 0);
+  fail_unless(ret == 1);
+  fail_unless(evs[0].data.fd == s2);
+  fail_unless(lwip_read(s2, buf, sizeof(buf)) == 4);
+  fail_unless(lwip_read(s2, buf, sizeof(buf)) == 4);
+
+  /* one-shot: disabled after one event until modified */
+  ev.events = EPOLLIN | EPOLLONESHOT;
+  ev.data.fd = s1;
+  fail_unless(lwip_epoll_ctl(ep, EPOLL_CTL_MOD, s1, &ev) == 0);
+  ret = (int)lwip_sendto(s2, "test", 4, 0, (struct sockaddr*)&addr1, addr1len);
+  fail_unless(ret == 4);
+  while(tcpip_thread_poll_one());
+  fail_unless(lwip_epoll_wait(ep, evs, 4, 0) == 1);
+  fail_unless(lwip_epoll_wait(ep, evs, 4, 0) == 0);
+  fail_unless(lwip_epoll_ctl(ep, EPOLL_CTL_MOD, s1, &ev) == 0);
+  fail_unless(lwip_epoll_wait(ep, evs, 4, 0) == 1);
+
+  /* writability is reported if asked for, and limited by maxevents */
+  ev.events = EPOLLIN | EPOLLOUT;
+  ev.data.fd = s1;
+  fail_unless(lwip_epoll_ctl(ep, EPOLL_CTL_MOD, s1, &ev) == 0);
+  ev.events = EPOLLOUT;
+  ev.data.fd = s2;
+  fail_unless(lwip_epoll_ctl(ep, EPOLL_CTL_MOD, s2, &ev) == 0);
+  ret = lwip_epoll_wait(ep, evs, 1, 0);
+  fail_unless(ret == 1);
+  fail_unless(evs[0].data.fd == s1);
+  fail_unless(evs[0].events == (EPOLLIN | EPOLLOUT));
+  ret = lwip_epoll_wait(ep, evs, 1, 0);
+  fail_unless(ret == 1);
+  fail_unless(evs[0].data.fd == s2);
+  fail_unless(evs[0].events == EPOLLOUT);
+
+  /* removed sockets are not reported any more */
+  fail_unless(lwip_epoll_ctl(ep, EPOLL_CTL_DEL, s2, NULL) == 0);
+  fail_unless(lwip_epoll_ctl(ep, EPOLL_CTL_DEL, s2, NULL) == -1);
+  fail_unless(errno == ENOENT);
+  ret = lwip_epoll_wait(ep, evs, 4, 0);
+  fail_unless(ret == 1);
+  fail_unless(evs[0].data.fd == s1);
+
+  /* closing a socket removes it from the instance */
+  fail_unless(lwip_close(s1) == 0);
+  fail_unless(lwip_epoll_wait(ep, evs, 4, 0) == 0);
+  fail_unless(lwip_epoll_ctl(ep, EPOLL_CTL_ADD, s1, &ev) == -1);
+  fail_unless(errno == EBADF);
+
+  fail_unless(lwip_close(ep) == 0);
+  fail_unless(lwip_epoll_wait(ep, evs, 4, 0) == -1);
+  fail_unless(errno == EBADF);
+  fail_unless(lwip_close(s2) == 0);
+}
+#endif /* LWIP_SOCKET_EPOLL */
+
+/** epoll with level- and edge-triggered sockets */
+START_TEST(test_sockets_epoll)
+{
+  LWIP_UNUSED_ARG(_i);
+#if LWIP_SOCKET_EPOLL
+#if LWIP_IPV4
+  test_sockets_epoll_domain(AF_INET);
+#endif
+#if LWIP_IPV6
+  test_sockets_epoll_domain(AF_INET6);
+#endif
+#endif /* LWIP_SOCKET_EPOLL */
+}
+END_TEST
+
+#if LWIP_SOCKET_MMSG
+#define TEST_MMSG_COUNT (LWIP_SOCKET_MMSG_BATCH + 3)
+
+static void test_sockets_mmsg_domain(int domain)
+{
+  int s1, s2, ret;
+  unsigned int i;
+  struct sockaddr_storage addr1, addr2, from[TEST_MMSG_COUNT];
+  socklen_t addr1len, addr2len;
+  struct mmsghdr msgs[TEST_MMSG_COUNT];
+  struct iovec iovs[TEST_MMSG_COUNT];
+  char bufs[TEST_MMSG_COUNT][TEST_MMSG_COUNT + 4];
+
+  test_sockets_init_loopback_addr(domain, &addr1, &addr1len);
+  test_sockets_init_loopback_addr(domain, &addr2, &addr2len);
+  s1 = test_sockets_alloc_socket_nonblocking(domain, SOCK_DGRAM);
+  fail_unless(s1 >= 0);
+  s2 = test_sockets_alloc_socket_nonblocking(domain, SOCK_DGRAM);
+  fail_unless(s2 >= 0);
+  fail_unless(lwip_bind(s1, (struct sockaddr*)&addr1, addr1len) == 0);
+  fail_unless(lwip_bind(s2, (struct sockaddr*)&addr2, addr2len) == 0);
+  fail_unless(lwip_getsockname(s1, (struct sockaddr*)&addr1, &addr1len) == 0);
+  fail_unless(lwip_getsockname(s2, (struct sockaddr*)&addr2, &addr2len) == 0);
+
+  /* nothing queued */
+  memset(msgs, 0, sizeof(msgs));
+  for (i = 0; i < TEST_MMSG_COUNT; i++) {
+    iovs[i].iov_base = bufs[i];
+    iovs[i].iov_len = sizeof(bufs[i]);
+    msgs[i].msg_hdr.msg_iov = &iovs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  fail_unless(lwip_recvmmsg(s2, msgs, TEST_MMSG_COUNT, 0, NULL) == -1);
+  fail_unless(errno == EWOULDBLOCK);
+
+  /* datagrams of 1..TEST_MMSG_COUNT bytes, more than one batch */
+  for (i = 0; i < TEST_MMSG_COUNT; i++) {
+    memset(bufs[i], 'a' + (int)i, sizeof(bufs[i]));
+    iovs[i].iov_len = i + 1;
+    msgs[i].msg_hdr.msg_name = &addr2;
+    msgs[i].msg_hdr.msg_namelen = addr2len;
+  }
+  /* the last one is too big for the receive buffers */
+  iovs[TEST_MMSG_COUNT - 1].iov_len = sizeof(bufs[0]);
+  ret = lwip_sendmmsg(s1, msgs, TEST_MMSG_COUNT, 0);
+  fail_unless(ret == TEST_MMSG_COUNT);
+  for (i = 0; i < TEST_MMSG_COUNT; i++) {
+    fail_unless(msgs[i].msg_len == iovs[i].iov_len);
+  }
+  while(tcpip_thread_poll_one());
+
+  /* receive them all: the first one is peeked before */
+  memset(msgs, 0, sizeof(msgs));
+  memset(bufs, 0, sizeof(bufs));
+  for (i = 0; i < TEST_MMSG_COUNT; i++) {
+    iovs[i].iov_len = sizeof(bufs[i]) - 1;
+    msgs[i].msg_hdr.msg_iov = &iovs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+    msgs[i].msg_hdr.msg_name = &from[i];
+    msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+  }
+  fail_unless(lwip_recvfrom(s2, bufs[0], 1, MSG_PEEK, NULL, NULL) == 1);
+  ret = lwip_recvmmsg(s2, msgs, TEST_MMSG_COUNT, MSG_WAITFORONE, NULL);
+  fail_unless(ret == TEST_MMSG_COUNT);
+  for (i = 0; i < TEST_MMSG_COUNT - 1; i++) {
+    fail_unless(msgs[i].msg_len == i + 1);
+    fail_unless(msgs[i].msg_hdr.msg_flags == 0);
+    fail_unless(bufs[i][0] == 'a' + (int)i);
+    fail_unless(bufs[i][i + 1] == 0);
+    fail_unless(msgs[i].msg_hdr.msg_namelen == addr1len);
+    fail_unless(!memcmp(&from[i], &addr1, addr1len));
+  }
+  fail_unless(msgs[TEST_MMSG_COUNT - 1].msg_len == sizeof(bufs[0]));
+  fail_unless(msgs[TEST_MMSG_COUNT - 1].msg_hdr.msg_flags == MSG_TRUNC);
+  fail_unless(lwip_recvmmsg(s2, msgs, TEST_MMSG_COUNT, 0, NULL) == -1);
+  fail_unless(errno == EWOULDBLOCK);
+
+  /* not for stream sockets */
+  fail_unless(lwip_close(s1) == 0);
+  s1 = test_sockets_alloc_socket_nonblocking(domain, SOCK_STREAM);
+  fail_unless(s1 >= 0);
+  fail_unless(lwip_sendmmsg(s1, msgs, 1, 0) == -1);
+  fail_unless(errno == EOPNOTSUPP);
+
+  fail_unless(lwip_close(s1) == 0);
+  fail_unless(lwip_close(s2) == 0);
+}
+#endif /* LWIP_SOCKET_MMSG */
+
+/** Send and receive several datagrams per call */
+START_TEST(test_sockets_mmsg)
+{
+  LWIP_UNUSED_ARG(_i);
+#if LWIP_SOCKET_MMSG
+#if LWIP_IPV4
+  test_sockets_mmsg_domain(AF_INET);
+#endif
+#if LWIP_IPV6
+  test_sockets_mmsg_domain(AF_INET6);
+#endif
+#endif /* LWIP_SOCKET_MMSG */
+}
+END_TEST
+
 /** Create the suite including all tests for this module */
 Suite *
 sockets_suite(void)
@@ -838,6 +1225,9 @@ sockets_suite(void)
     TESTFUNC(test_sockets_msgapis),
     TESTFUNC(test_sockets_select),
     TESTFUNC(test_sockets_recv_after_rst),
+    TESTFUNC(test_sockets_recv_zc),
+    TESTFUNC(test_sockets_epoll),
+    TESTFUNC(test_sockets_mmsg),
   };
   return create_suite("SOCKETS", tests, sizeof(tests)/sizeof(testfunc), sockets_setup, sockets_teardown);
 }
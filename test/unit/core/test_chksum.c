@@ -0,0 +1,160 @@
+#include "test_chksum.h"
+
+#include "lwip/inet_chksum.h"
+
+#include <stdlib.h>
+
+#define CHKSUM_TEST_BUFSIZE   (70000 + 64)
+#define CHKSUM_TEST_ROUNDS    2000
+#define MAGIC_UNTOUCHED_BYTE  0x7a
+
+static u8_t chksum_src[CHKSUM_TEST_BUFSIZE];
+static u8_t chksum_dst[CHKSUM_TEST_BUFSIZE];
+
+/** Reference: add up 16-bit words one by one (non-inverted, host order) */
+static u16_t
+chksum_ref(const u8_t *data, int len)
+{
+  u32_t sum = 0;
+  u16_t t;
+  int i;
+
+  for (i = 0; i + 1 < len; i += 2) {
+    memcpy(&t, &data[i], 2);
+    sum += t;
+    sum = FOLD_U32T(sum);
+  }
+  if (len & 1) {
+    t = 0;
+    ((u8_t *)&t)[0] = data[len - 1];
+    sum += t;
+    sum = FOLD_U32T(sum);
+  }
+  return (u16_t)FOLD_U32T(sum);
+}
+
+/** The result of inet_chksum() is inverted */
+static u16_t
+chksum_inv(u16_t chksum)
+{
+  return (u16_t)~chksum;
+}
+
+static void
+chksum_fill_random(u8_t *data, int len)
+{
+  int i;
+  for (i = 0; i < len; i++) {
+    data[i] = (u8_t)rand();
+  }
+}
+
+/* Setups/teardown functions */
+
+static void
+chksum_setup(void)
+{
+  srand(1234);
+}
+
+static void
+chksum_teardown(void)
+{
+}
+
+
+/* Test functions */
+
+/** inet_chksum() and LWIP_CHKSUM_COPY() match the reference for random
+ * lengths and alignments */
+START_TEST(test_chksum_random)
+{
+  int round, off, len;
+  u16_t ref;
+  LWIP_UNUSED_ARG(_i);
+
+  for (round = 0; round < CHKSUM_TEST_ROUNDS; round++) {
+    off = rand() % 32;
+    len = rand() % 2048;
+    chksum_fill_random(&chksum_src[off], len);
+    ref = chksum_ref(&chksum_src[off], len);
+    fail_unless(chksum_inv(inet_chksum(&chksum_src[off], (u16_t)len)) == ref);
+#if LWIP_CHECKSUM_ON_COPY
+    {
+      int dst_off = rand() % 32;
+      memset(chksum_dst, MAGIC_UNTOUCHED_BYTE, (size_t)(dst_off + len + 32));
+      fail_unless(LWIP_CHKSUM_COPY(&chksum_dst[dst_off], &chksum_src[off], (u16_t)len) == ref);
+      fail_unless(memcmp(&chksum_dst[dst_off], &chksum_src[off], (size_t)len) == 0);
+      fail_unless(chksum_dst[dst_off + len] == MAGIC_UNTOUCHED_BYTE);
+      if (dst_off > 0) {
+        fail_unless(chksum_dst[dst_off - 1] == MAGIC_UNTOUCHED_BYTE);
+      }
+    }
+#endif /* LWIP_CHECKSUM_ON_COPY */
+  }
+}
+END_TEST
+
+/** Sums that need many end-around carries */
+START_TEST(test_chksum_carry)
+{
+  u16_t len;
+  LWIP_UNUSED_ARG(_i);
+
+  memset(chksum_src, 0xff, 0xffff);
+  for (len = 0; len < 64; len++) {
+    fail_unless(chksum_inv(inet_chksum(chksum_src, len)) == chksum_ref(chksum_src, len));
+  }
+  fail_unless(chksum_inv(inet_chksum(chksum_src, 0xffff)) == chksum_ref(chksum_src, 0xffff));
+  fail_unless(chksum_inv(inet_chksum(&chksum_src[1], 0xfffe)) == chksum_ref(chksum_src, 0xfffe));
+  /* all-zero data sums up to 0 */
+  memset(chksum_src, 0, 1500);
+  fail_unless(inet_chksum(chksum_src, 1500) == 0xffff);
+}
+END_TEST
+
+#ifdef LWIP_ARCH_CHKSUM_H
+/** Every kernel of the unix port supported by this CPU matches the reference,
+ * including lengths above 64k */
+START_TEST(test_chksum_port_kernels)
+{
+  const struct lwip_unix_chksum_impl *impls;
+  int num, n, round, off, dst_off, len;
+  u16_t ref;
+  LWIP_UNUSED_ARG(_i);
+
+  impls = lwip_unix_chksum_impls(&num);
+  fail_unless(num >= 1);
+  for (round = 0; round < CHKSUM_TEST_ROUNDS; round++) {
+    off = rand() % 64;
+    dst_off = rand() % 64;
+    len = (round % 10 == 0) ? (rand() % 70000) : (rand() % 2048);
+    chksum_fill_random(&chksum_src[off], len);
+    ref = chksum_ref(&chksum_src[off], len);
+    for (n = 0; n < num; n++) {
+      fail_unless(impls[n].chksum(&chksum_src[off], len) == ref, "%s len %d", impls[n].name, len);
+      if (len <= 0xffff) {
+        memset(&chksum_dst[dst_off + len], MAGIC_UNTOUCHED_BYTE, 1);
+        fail_unless(impls[n].chksum_copy(&chksum_dst[dst_off], &chksum_src[off], (u16_t)len) == ref);
+        fail_unless(memcmp(&chksum_dst[dst_off], &chksum_src[off], (size_t)len) == 0);
+        fail_unless(chksum_dst[dst_off + len] == MAGIC_UNTOUCHED_BYTE);
+      }
+    }
+  }
+}
+END_TEST
+#endif /* LWIP_ARCH_CHKSUM_H */
+
+/** Create the suite including all tests for this module */
+Suite *
+chksum_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_chksum_random),
+    TESTFUNC(test_chksum_carry),
+#ifdef LWIP_ARCH_CHKSUM_H
+    TESTFUNC(test_chksum_port_kernels),
+#endif /* LWIP_ARCH_CHKSUM_H */
+  };
+  return create_suite("CHKSUM", tests, sizeof(tests)/sizeof(testfunc), chksum_setup, chksum_teardown);
+}
@@ -207,6 +207,53 @@ START_TEST(test_mem_double_free)
 }
 END_TEST
 
+/** Fragment the heap with mixed sizes, free everything in an interleaved
+ * order and check the free blocks are merged back into one */
+START_TEST(test_mem_coalesce)
+{
+#define NUM_BLOCKS 64
+  void *p[NUM_BLOCKS];
+  void *big;
+  mem_size_t size;
+  int i, num;
+  LWIP_UNUSED_ARG(_i);
+
+  fail_unless(lwip_stats.mem.used == 0);
+
+  for (num = 0; num < NUM_BLOCKS; num++) {
+    size = (mem_size_t)(((num * 37) % 200) + 1);
+    p[num] = mem_malloc(size);
+    if (p[num] == NULL) {
+      break;
+    }
+    /* shrink every fourth block to leave gaps next to used blocks */
+    if ((num % 4) == 3) {
+      fail_unless(mem_trim(p[num], (mem_size_t)(size / 2 + 1)) == p[num]);
+    }
+  }
+  fail_unless(num > 2);
+
+  /* free every other block, leaving used blocks between the holes */
+  for (i = 0; i < num; i += 2) {
+    mem_free(p[i]);
+  }
+  /* free the rest from the top down: every free merges with both neighbours */
+  for (i = ((num - 1) | 1); i > 0; i -= 2) {
+    if (i < num) {
+      mem_free(p[i]);
+    }
+  }
+  fail_unless(lwip_stats.mem.used == 0);
+  fail_unless(lwip_stats.mem.illegal == 0);
+
+  big = mem_malloc(MEM_SIZE / 2);
+  fail_unless(big != NULL);
+  mem_free(big);
+  fail_unless(lwip_stats.mem.used == 0);
+#undef NUM_BLOCKS
+}
+END_TEST
+
 /** Create the suite including all tests for this module */
 Suite *
 mem_suite(void)
@@ -215,7 +262,8 @@ mem_suite(void)
     TESTFUNC(test_mem_one),
     TESTFUNC(test_mem_random),
     TESTFUNC(test_mem_invalid_free),
-    TESTFUNC(test_mem_double_free)
+    TESTFUNC(test_mem_double_free),
+    TESTFUNC(test_mem_coalesce)
   };
   return create_suite("MEM", tests, sizeof(tests)/sizeof(testfunc), mem_setup, mem_teardown);
 }
@@ -0,0 +1,188 @@
+#include "test_memp.h"
+
+#include "lwip/def.h"
+#include "lwip/memp.h"
+#include "lwip/stats.h"
+
+#if !LWIP_STATS || !MEMP_STATS
+#error "This tests needs MEMP-statistics enabled"
+#endif
+
+#if MEMP_CACHE
+
+/* returned by LWIP_HOOK_MEMP_CACHE(), see lwipopts.h */
+struct memp_cache *test_memp_cache;
+
+static struct memp_cache memp_test_cache;
+
+#define MEMP_TEST_BATCH LWIP_MIN(PBUF_POOL_SIZE / 8, MEMP_CACHE_SIZE / 2)
+
+/* Setups/teardown functions */
+
+static void
+memp_setup(void)
+{
+  memset(&memp_test_cache, 0, sizeof(memp_test_cache));
+  test_memp_cache = &memp_test_cache;
+  lwip_check_ensure_no_alloc(SKIP_POOL(MEMP_SYS_TIMEOUT));
+}
+
+static void
+memp_teardown(void)
+{
+  memp_cache_flush(&memp_test_cache);
+  test_memp_cache = NULL;
+  lwip_check_ensure_no_alloc(SKIP_POOL(MEMP_SYS_TIMEOUT));
+}
+
+
+/* Test functions */
+
+/** Elements are taken from and returned to the pool in batches */
+START_TEST(test_memp_cache_batch)
+{
+  struct stats_mem *stats = lwip_stats.memp[MEMP_PBUF_POOL];
+  void *elems[3 * MEMP_CACHE_SIZE];
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  elems[0] = memp_malloc(MEMP_PBUF_POOL);
+  fail_unless(elems[0] != NULL);
+  /* a whole batch is counted as used, the rest of it stays in the cache */
+  fail_unless(stats->used == MEMP_TEST_BATCH);
+  fail_unless(memp_test_cache.num[MEMP_PBUF_POOL] == MEMP_TEST_BATCH - 1);
+
+  /* the same element is handed out again */
+  memp_free(MEMP_PBUF_POOL, elems[0]);
+  fail_unless(memp_test_cache.num[MEMP_PBUF_POOL] == MEMP_TEST_BATCH);
+  fail_unless(memp_malloc(MEMP_PBUF_POOL) == elems[0]);
+
+  for (i = 1; i < (int)LWIP_ARRAYSIZE(elems); i++) {
+    elems[i] = memp_malloc(MEMP_PBUF_POOL);
+    fail_unless(elems[i] != NULL);
+  }
+  fail_unless(stats->used >= LWIP_ARRAYSIZE(elems));
+  fail_unless(stats->used < LWIP_ARRAYSIZE(elems) + MEMP_TEST_BATCH);
+  for (i = 0; i < (int)LWIP_ARRAYSIZE(elems); i++) {
+    memp_free(MEMP_PBUF_POOL, elems[i]);
+    /* the cache never grows beyond two batches */
+    fail_unless(memp_test_cache.num[MEMP_PBUF_POOL] <= 2 * MEMP_TEST_BATCH);
+    fail_unless(stats->used == (mem_size_t)(LWIP_ARRAYSIZE(elems) - i - 1 + memp_test_cache.num[MEMP_PBUF_POOL]));
+  }
+
+  memp_cache_flush(&memp_test_cache);
+  fail_unless(memp_test_cache.num[MEMP_PBUF_POOL] == 0);
+  fail_unless(stats->used == 0);
+}
+END_TEST
+
+/** All elements of a pool can be allocated through a cache */
+START_TEST(test_memp_cache_exhaust)
+{
+  struct stats_mem *stats = lwip_stats.memp[MEMP_PBUF_POOL];
+  static void *elems[PBUF_POOL_SIZE];
+  STAT_COUNTER err = stats->err;
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  for (i = 0; i < PBUF_POOL_SIZE; i++) {
+    elems[i] = memp_malloc(MEMP_PBUF_POOL);
+    fail_unless(elems[i] != NULL);
+  }
+  fail_unless(stats->used == PBUF_POOL_SIZE);
+  fail_unless(stats->max == PBUF_POOL_SIZE);
+  fail_unless(memp_malloc(MEMP_PBUF_POOL) == NULL);
+  fail_unless(stats->err == err + 1);
+
+  /* elements freed without a cache go to the pool directly */
+  test_memp_cache = NULL;
+  memp_free(MEMP_PBUF_POOL, elems[0]);
+  fail_unless(stats->used == PBUF_POOL_SIZE - 1);
+  test_memp_cache = &memp_test_cache;
+  elems[0] = memp_malloc(MEMP_PBUF_POOL);
+  fail_unless(elems[0] != NULL);
+
+  for (i = 0; i < PBUF_POOL_SIZE; i++) {
+    memp_free(MEMP_PBUF_POOL, elems[i]);
+  }
+  fail_unless(stats->used == memp_test_cache.num[MEMP_PBUF_POOL]);
+}
+END_TEST
+
+/** Elements cached by one thread are not available to others until flushed */
+START_TEST(test_memp_cache_other_thread)
+{
+  struct stats_mem *stats = lwip_stats.memp[MEMP_PBUF_POOL];
+  static void *elems[PBUF_POOL_SIZE];
+  static struct memp_cache other_cache;
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  for (i = 0; i < PBUF_POOL_SIZE; i++) {
+    elems[i] = memp_malloc(MEMP_PBUF_POOL);
+    fail_unless(elems[i] != NULL);
+  }
+  memp_free(MEMP_PBUF_POOL, elems[0]);
+  fail_unless(memp_test_cache.num[MEMP_PBUF_POOL] == 1);
+
+  memset(&other_cache, 0, sizeof(other_cache));
+  test_memp_cache = &other_cache;
+  fail_unless(memp_malloc(MEMP_PBUF_POOL) == NULL);
+  memp_cache_flush(&memp_test_cache);
+  elems[0] = memp_malloc(MEMP_PBUF_POOL);
+  fail_unless(elems[0] != NULL);
+  memp_free(MEMP_PBUF_POOL, elems[0]);
+  memp_cache_flush(&other_cache);
+
+  test_memp_cache = &memp_test_cache;
+  for (i = 1; i < PBUF_POOL_SIZE; i++) {
+    memp_free(MEMP_PBUF_POOL, elems[i]);
+  }
+  memp_cache_flush(&memp_test_cache);
+  fail_unless(stats->used == 0);
+}
+END_TEST
+
+#if LWIP_TCP && LWIP_TCP_TW_BUCKETS && (MEMP_NUM_TCP_TW < 16)
+/** Pools with less than 16 elements bypass the cache */
+START_TEST(test_memp_cache_small_pool)
+{
+  struct stats_mem *stats = lwip_stats.memp[MEMP_TCP_TW];
+  void *elem;
+  LWIP_UNUSED_ARG(_i);
+
+  elem = memp_malloc(MEMP_TCP_TW);
+  fail_unless(elem != NULL);
+  fail_unless(stats->used == 1);
+  fail_unless(memp_test_cache.num[MEMP_TCP_TW] == 0);
+  memp_free(MEMP_TCP_TW, elem);
+  fail_unless(stats->used == 0);
+  fail_unless(memp_test_cache.num[MEMP_TCP_TW] == 0);
+}
+END_TEST
+#endif
+
+
+/** Create the suite including all tests for this module */
+Suite *
+memp_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_memp_cache_batch),
+    TESTFUNC(test_memp_cache_exhaust),
+    TESTFUNC(test_memp_cache_other_thread),
+#if LWIP_TCP && LWIP_TCP_TW_BUCKETS && (MEMP_NUM_TCP_TW < 16)
+    TESTFUNC(test_memp_cache_small_pool),
+#endif
+  };
+  return create_suite("MEMP", tests, sizeof(tests)/sizeof(testfunc), memp_setup, memp_teardown);
+}
+
+#else /* MEMP_CACHE */
+
+Suite *
+memp_suite(void)
+{
+  return create_suite("MEMP", NULL, 0, NULL, NULL);
+}
+#endif /* MEMP_CACHE */
@@ -2,6 +2,8 @@
 
 #include "lwip/pbuf.h"
 #include "lwip/stats.h"
+#include "lwip/tcpip.h"
+#include "arch/sys_arch.h"
 
 #if !LWIP_STATS || !MEM_STATS ||!MEMP_STATS
 #error "This tests needs MEM- and MEMP-statistics enabled"
@@ -341,6 +343,92 @@ START_TEST(test_pbuf_get_put_at_edge)
 }
 END_TEST
 
+#if PBUF_POOL_TELEMETRY
+static struct pbuf *test_pbuf_pool[PBUF_POOL_SIZE];
+static int test_pbuf_wm_low;
+static int test_pbuf_wm_high;
+
+static void
+test_pbuf_watermark_cb(enum pbuf_pool_watermark_event event, u16_t free_pbufs, void *arg)
+{
+  fail_unless(arg == &test_pbuf_wm_low);
+  if (event == PBUF_POOL_WATERMARK_LOW) {
+    fail_unless(free_pbufs == 10);
+    test_pbuf_wm_low++;
+  } else {
+    fail_unless(event == PBUF_POOL_WATERMARK_HIGH);
+    fail_unless(free_pbufs == 20);
+    test_pbuf_wm_high++;
+  }
+}
+#endif /* PBUF_POOL_TELEMETRY */
+
+/** PBUF_POOL telemetry: high-water marks per window, failures per layer,
+ * time to exhaustion and watermark callbacks */
+START_TEST(test_pbuf_pool_telemetry)
+{
+#if PBUF_POOL_TELEMETRY
+  struct pbuf_pool_telemetry tm;
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  fail_unless(pbuf_pool_set_watermarks(10, 10, NULL, NULL) == ERR_VAL);
+  fail_unless(pbuf_pool_set_watermarks(10, 20, test_pbuf_watermark_cb, &test_pbuf_wm_low) == ERR_OK);
+  pbuf_pool_telemetry_reset();
+  test_pbuf_wm_low = test_pbuf_wm_high = 0;
+
+  /* run the pool empty, taking 50 ms from the low watermark */
+  for (i = 0; i < PBUF_POOL_SIZE; i++) {
+    if (i == PBUF_POOL_SIZE - 10) {
+      fail_unless(test_pbuf_wm_low == 1);
+      lwip_sys_now += 50;
+    }
+    test_pbuf_pool[i] = pbuf_alloc(PBUF_RAW, 1, PBUF_POOL);
+    fail_unless(test_pbuf_pool[i] != NULL);
+  }
+  fail_unless(pbuf_alloc(PBUF_RAW, 1, PBUF_POOL) == NULL);
+  fail_unless(pbuf_alloc(PBUF_TRANSPORT, 1, PBUF_POOL) == NULL);
+  fail_unless(test_pbuf_wm_low == 1);
+  pbuf_pool_telemetry_get(&tm);
+  fail_unless(tm.used == PBUF_POOL_SIZE);
+  fail_unless(tm.max_used == PBUF_POOL_SIZE);
+  fail_unless(tm.window_max[0] == PBUF_POOL_SIZE);
+  fail_unless(tm.window_max[1] == 0);
+  fail_unless(tm.exhausted == 1);
+  fail_unless(tm.time_to_exhaustion_last == 50);
+  fail_unless(tm.time_to_exhaustion_min == 50);
+  fail_unless(tm.alloc_fail[PBUF_POOL_LAYER_RAW] == 1);
+  fail_unless(tm.alloc_fail[PBUF_POOL_LAYER_TRANSPORT] == 1);
+  fail_unless(tm.alloc_fail[PBUF_POOL_LAYER_IP] == 0);
+
+  /* recover in the next window */
+  lwip_sys_now += PBUF_POOL_TELEMETRY_WINDOW;
+  for (i = PBUF_POOL_SIZE - 1; i >= 20; i--) {
+    pbuf_free(test_pbuf_pool[i]);
+    fail_unless(test_pbuf_wm_high == (i <= PBUF_POOL_SIZE - 20));
+  }
+  lwip_sys_now += PBUF_POOL_TELEMETRY_WINDOW;
+  pbuf_pool_telemetry_get(&tm);
+  fail_unless(tm.used == 20);
+  fail_unless(tm.max_used == PBUF_POOL_SIZE);
+  fail_unless(tm.window_max[0] == 20);
+  fail_unless(tm.window_max[1] == PBUF_POOL_SIZE);
+  fail_unless(tm.window_max[2] == PBUF_POOL_SIZE);
+
+  for (i = 0; i < 20; i++) {
+    pbuf_free(test_pbuf_pool[i]);
+  }
+  fail_unless(test_pbuf_wm_low == 1);
+  fail_unless(test_pbuf_wm_high == 1);
+  fail_unless(pbuf_pool_set_watermarks(PBUF_POOL_LOW_WATERMARK, PBUF_POOL_HIGH_WATERMARK, NULL, NULL) == ERR_OK);
+  /* run the pbuf_free_ooseq callback queued when the pool was empty */
+  while(tcpip_thread_poll_one());
+#else /* PBUF_POOL_TELEMETRY */
+  LWIP_UNUSED_ARG(_i);
+#endif /* PBUF_POOL_TELEMETRY */
+}
+END_TEST
+
 /** Create the suite including all tests for this module */
 Suite *
 pbuf_suite(void)
@@ -353,7 +441,8 @@ pbuf_suite(void)
     TESTFUNC(test_pbuf_split_64k_on_small_pbufs),
     TESTFUNC(test_pbuf_queueing_bigger_than_64k),
     TESTFUNC(test_pbuf_take_at_edge),
-    TESTFUNC(test_pbuf_get_put_at_edge)
+    TESTFUNC(test_pbuf_get_put_at_edge),
+    TESTFUNC(test_pbuf_pool_telemetry)
   };
   return create_suite("PBUF", tests, sizeof(tests)/sizeof(testfunc), pbuf_setup, pbuf_teardown);
 }
@@ -11,19 +11,40 @@ static struct sys_timeo* old_list_head;
 static void
 timers_setup(void)
 {
+#if LWIP_TIMERS_WHEEL
+  old_list_head = sys_timeouts_take_all();
+#else
   struct sys_timeo** list_head = sys_timeouts_get_next_timeout();
   old_list_head = *list_head;
   *list_head = NULL;
+#endif
 }
 
 static void
 timers_teardown(void)
 {
+#if LWIP_TIMERS_WHEEL
+  fail_unless(sys_timeouts_take_all() == NULL);
+  sys_timeouts_put_all(old_list_head);
+#else
   struct sys_timeo** list_head = sys_timeouts_get_next_timeout();
   *list_head = old_list_head;
+#endif
   lwip_sys_now = 0;
 }
 
+/* due time of the first timeout */
+static u32_t
+next_due_time(void)
+{
+#if LWIP_TIMERS_WHEEL
+  /* exact for timeouts due within 32 ms */
+  return lwip_sys_now + sys_timeouts_sleeptime();
+#else
+  return (*sys_timeouts_get_next_timeout())->time;
+#endif
+}
+
 static int fired[3];
 static void
 dummy_handler(void* arg)
@@ -46,8 +67,6 @@ struct lwip_cyclic_timer test_cyclic = {10, dummy_cyclic_handler};
 static void
 do_test_cyclic_timers(u32_t offset)
 {
-  struct sys_timeo** list_head = sys_timeouts_get_next_timeout();
-
   /* verify normal timer expiration */
   lwip_sys_now = offset + 0;
   sys_timeout(test_cyclic.interval_ms, lwip_cyclic_timer, &test_cyclic);
@@ -60,7 +79,7 @@ do_test_cyclic_timers(u32_t offset)
   sys_check_timeouts();
   fail_unless(cyclic_fired == 1);
 
-  fail_unless((*list_head)->time == (u32_t)(lwip_sys_now + test_cyclic.interval_ms - HANDLER_EXECUTION_TIME));
+  fail_unless(next_due_time() == (u32_t)(lwip_sys_now + test_cyclic.interval_ms - HANDLER_EXECUTION_TIME));
   
   sys_untimeout(lwip_cyclic_timer, &test_cyclic);
 
@@ -77,7 +96,9 @@ do_test_cyclic_timers(u32_t offset)
   sys_check_timeouts();
   fail_unless(cyclic_fired == 1);
 
-  fail_unless((*list_head)->time == (u32_t)(lwip_sys_now + test_cyclic.interval_ms));
+  fail_unless(next_due_time() == (u32_t)(lwip_sys_now + test_cyclic.interval_ms));
+
+  sys_untimeout(lwip_cyclic_timer, &test_cyclic);
 }
 
 START_TEST(test_cyclic_timers)
@@ -127,7 +148,9 @@ END_TEST
 static void
 do_test_timers(u32_t offset)
 {
+#if !LWIP_TIMERS_WHEEL
   struct sys_timeo** list_head = sys_timeouts_get_next_timeout();
+#endif
   
   lwip_sys_now = offset + 0;
 
@@ -138,10 +161,12 @@ do_test_timers(u32_t offset)
   sys_timeout( 5, dummy_handler, LWIP_PTR_NUMERIC_CAST(void*, 2));
   fail_unless(sys_timeouts_sleeptime() == 5);
 
+#if !LWIP_TIMERS_WHEEL
   /* linked list correctly sorted? */
   fail_unless((*list_head)->time             == (u32_t)(lwip_sys_now + 5));
   fail_unless((*list_head)->next->time       == (u32_t)(lwip_sys_now + 10));
   fail_unless((*list_head)->next->next->time == (u32_t)(lwip_sys_now + 20));
+#endif
   
   /* check timers expire in correct order */
   memset(&fired, 0, sizeof(fired));
@@ -195,7 +220,12 @@ START_TEST(test_long_timer)
   lwip_sys_now = 0;
 
   sys_timeout(LWIP_UINT32_MAX / 4, dummy_handler, LWIP_PTR_NUMERIC_CAST(void*, 0));
+#if LWIP_TIMERS_WHEEL
+  /* the wheel wakes up early to move the timeout down */
+  fail_unless(sys_timeouts_sleeptime() <= LWIP_UINT32_MAX / 4);
+#else
   fail_unless(sys_timeouts_sleeptime() == LWIP_UINT32_MAX / 4);
+#endif
 
   sys_check_timeouts();
   fail_unless(fired[0] == 0);
@@ -219,6 +249,141 @@ START_TEST(test_long_timer)
 }
 END_TEST
 
+static struct sys_timeo static_timeo[3];
+static void
+static_handler(void* arg)
+{
+  int index = LWIP_PTR_NUMERIC_CAST(int, arg);
+  fired[index]++;
+  if (index == 2) {
+    /* restart from its own handler */
+    sys_timeout_start(&static_timeo[2], 10, static_handler, arg);
+  }
+}
+
+/** Start, restart and stop timeouts owned by the caller */
+START_TEST(test_timeout_start_stop)
+{
+  LWIP_UNUSED_ARG(_i);
+
+  memset(&fired, 0, sizeof(fired));
+  memset(static_timeo, 0, sizeof(static_timeo));
+  lwip_sys_now = 100;
+
+  fail_unless(!sys_timeout_pending(&static_timeo[0]));
+  sys_timeout_start(&static_timeo[0], 10, static_handler, LWIP_PTR_NUMERIC_CAST(void*, 0));
+  sys_timeout_start(&static_timeo[1], 20, static_handler, LWIP_PTR_NUMERIC_CAST(void*, 1));
+  sys_timeout_start(&static_timeo[2], 10, static_handler, LWIP_PTR_NUMERIC_CAST(void*, 2));
+  fail_unless(sys_timeout_pending(&static_timeo[0]));
+  fail_unless(sys_timeouts_sleeptime() == 10);
+
+  /* restarting moves the due time */
+  lwip_sys_now = 105;
+  sys_timeout_start(&static_timeo[0], 10, static_handler, LWIP_PTR_NUMERIC_CAST(void*, 0));
+  lwip_sys_now = 110;
+  sys_check_timeouts();
+  fail_unless(fired[0] == 0);
+  fail_unless(fired[2] == 1);
+  fail_unless(sys_timeout_pending(&static_timeo[0]));
+  fail_unless(sys_timeout_pending(&static_timeo[2]));
+
+  lwip_sys_now = 115;
+  sys_check_timeouts();
+  fail_unless(fired[0] == 1);
+  fail_unless(!sys_timeout_pending(&static_timeo[0]));
+
+  /* stopping twice is fine, a stopped timeout does not fire */
+  sys_timeout_stop(&static_timeo[1]);
+  sys_timeout_stop(&static_timeo[1]);
+  fail_unless(!sys_timeout_pending(&static_timeo[1]));
+  lwip_sys_now = 200;
+  sys_check_timeouts();
+  fail_unless(fired[0] == 1);
+  fail_unless(fired[1] == 0);
+  fail_unless(fired[2] == 2);
+
+  /* sys_untimeout() finds timeouts owned by the caller, too */
+  sys_untimeout(static_handler, LWIP_PTR_NUMERIC_CAST(void*, 2));
+  fail_unless(!sys_timeout_pending(&static_timeo[2]));
+  fail_unless(sys_timeouts_sleeptime() == SYS_TIMEOUTS_SLEEPTIME_INFINITE);
+}
+END_TEST
+
+#define RANDOM_TIMEOUTS 200
+/* Check if t is before compare_to, caring about u32_t wraparounds */
+#define TIME_BEFORE(t, compare_to) (((u32_t)((t) - (compare_to))) > 0x7fffffff)
+static struct sys_timeo random_timeo[RANDOM_TIMEOUTS];
+static u32_t random_due[RANDOM_TIMEOUTS];
+static u8_t random_fired[RANDOM_TIMEOUTS];
+static u32_t random_fired_count;
+static u32_t random_last_check;
+
+static void
+random_handler(void* arg)
+{
+  int index = LWIP_PTR_NUMERIC_CAST(int, arg);
+  /* due now, but not yet at the previous check */
+  fail_unless(!TIME_BEFORE(lwip_sys_now, random_due[index]));
+  fail_unless(TIME_BEFORE(random_last_check, random_due[index]));
+  fail_unless(!random_fired[index]);
+  random_fired[index] = 1;
+  random_fired_count++;
+}
+
+static void
+do_test_timers_random(u32_t offset)
+{
+  u32_t seed = 1, i, num_started = 0, num_stopped = 0, step;
+
+  memset(random_timeo, 0, sizeof(random_timeo));
+  memset(random_fired, 0, sizeof(random_fired));
+  random_fired_count = 0;
+  lwip_sys_now = offset;
+  random_last_check = offset - 1;
+
+  /* delays from a few ms to several minutes hit all levels of a timer wheel */
+  for (i = 0; i < RANDOM_TIMEOUTS; i++) {
+    u32_t msecs;
+    seed = seed * 1103515245 + 12345;
+    msecs = (seed >> 8) % ((i % 4 == 0) ? 500000 : 3000);
+    random_due[i] = lwip_sys_now + msecs;
+    sys_timeout_start(&random_timeo[i], msecs, random_handler, LWIP_PTR_NUMERIC_CAST(void*, i));
+    num_started++;
+    if ((i % 7) == 3) {
+      sys_timeout_stop(&random_timeo[i / 2]);
+    }
+    lwip_sys_now += seed % 5;
+  }
+  for (i = 0; i < RANDOM_TIMEOUTS; i++) {
+    if (!sys_timeout_pending(&random_timeo[i])) {
+      num_stopped++;
+    }
+  }
+
+  /* advance time in irregular steps: every timeout fires at the first check
+     at or after its due time */
+  while (sys_timeouts_sleeptime() != SYS_TIMEOUTS_SLEEPTIME_INFINITE) {
+    seed = seed * 1103515245 + 12345;
+    step = (seed >> 8) % 1000;
+    if (step > sys_timeouts_sleeptime()) {
+      step = sys_timeouts_sleeptime();
+    }
+    lwip_sys_now += step;
+    sys_check_timeouts();
+    random_last_check = lwip_sys_now;
+  }
+  fail_unless(random_fired_count + num_stopped == num_started);
+}
+
+START_TEST(test_timers_random)
+{
+  LWIP_UNUSED_ARG(_i);
+
+  do_test_timers_random(0);
+  do_test_timers_random(0xfff00000);
+}
+END_TEST
+
 /** Create the suite including all tests for this module */
 Suite *
 timers_suite(void)
@@ -228,6 +393,8 @@ timers_suite(void)
     TESTFUNC(test_cyclic_timers),
     TESTFUNC(test_timers),
     TESTFUNC(test_long_timer),
+    TESTFUNC(test_timeout_start_stop),
+    TESTFUNC(test_timers_random),
   };
   return create_suite("TIMERS", tests, LWIP_ARRAYSIZE(tests), timers_setup, timers_teardown);
 }
@@ -262,12 +262,98 @@ START_TEST(test_etharp_table)
 END_TEST
 
 
+#if ETHARP_TABLE_HASH
+/** Send a packet to 'adr', answer the ARP request if the address is unknown */
+static void
+etharp_test_sendto(struct udp_pcb *pcb, ip4_addr_t *adr)
+{
+  struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, 10, PBUF_RAM);
+  const ip4_addr_t *unused_ipaddr;
+  struct eth_addr *unused_ethaddr;
+  ip_addr_t dst;
+  int ctr = linkoutput_ctr;
+  int known = etharp_find_addr(NULL, adr, &unused_ethaddr, &unused_ipaddr) >= 0;
+
+  fail_unless(p != NULL);
+  if (p != NULL) {
+    ip_addr_copy_from_ip4(dst, *adr);
+    fail_unless(udp_sendto(pcb, p, &dst, 123) == ERR_OK);
+    pbuf_free(p);
+    /* packet sent or ARP request sent */
+    fail_unless(linkoutput_ctr == ctr + 1);
+    if (!known) {
+      create_arp_response(adr);
+      /* queued packet sent */
+      fail_unless(linkoutput_ctr == ctr + 2);
+    }
+  }
+}
+
+/** The least recently used entry is recycled, not the oldest one */
+START_TEST(test_etharp_table_lru)
+{
+  ssize_t idx, idx0, idx1;
+  const ip4_addr_t *unused_ipaddr;
+  struct eth_addr *unused_ethaddr;
+  struct udp_pcb* pcb;
+  ip4_addr_t adrs[ARP_TABLE_SIZE + 1];
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  pcb = udp_new();
+  fail_unless(pcb != NULL);
+  if (pcb == NULL) {
+    return;
+  }
+  for(i = 0; i < ARP_TABLE_SIZE + 1; i++) {
+    IP4_ADDR(&adrs[i], 192,168,0,i+2);
+  }
+  linkoutput_ctr = 0;
+  for(i = 0; i < ARP_TABLE_SIZE; i++) {
+    etharp_test_sendto(pcb, &adrs[i]);
+    fail_unless(linkoutput_ctr == 2 * (i + 1));
+    etharp_tmr();
+  }
+  /* adrs[0] has the oldest entry, but is used again */
+  etharp_test_sendto(pcb, &adrs[0]);
+  fail_unless(linkoutput_ctr == 2 * ARP_TABLE_SIZE + 1);
+  idx0 = etharp_find_addr(NULL, &adrs[0], &unused_ethaddr, &unused_ipaddr);
+  idx1 = etharp_find_addr(NULL, &adrs[1], &unused_ethaddr, &unused_ipaddr);
+  fail_unless((idx0 >= 0) && (idx1 >= 0));
+
+  /* a new address recycles the least recently used entry: adrs[1] */
+  etharp_test_sendto(pcb, &adrs[ARP_TABLE_SIZE]);
+  fail_unless(linkoutput_ctr == 2 * ARP_TABLE_SIZE + 3);
+  idx = etharp_find_addr(NULL, &adrs[ARP_TABLE_SIZE], &unused_ethaddr, &unused_ipaddr);
+  fail_unless(idx == idx1);
+  idx = etharp_find_addr(NULL, &adrs[1], &unused_ethaddr, &unused_ipaddr);
+  fail_unless(idx == -1);
+  idx = etharp_find_addr(NULL, &adrs[0], &unused_ethaddr, &unused_ipaddr);
+  fail_unless(idx == idx0);
+
+  /* entries are found after others are removed from their buckets */
+  etharp_cleanup_netif(&test_netif);
+  for(i = 0; i < ARP_TABLE_SIZE; i++) {
+    etharp_test_sendto(pcb, &adrs[ARP_TABLE_SIZE - i]);
+  }
+  for(i = 0; i < ARP_TABLE_SIZE; i += 2) {
+    etharp_test_sendto(pcb, &adrs[ARP_TABLE_SIZE - i]);
+    fail_unless(etharp_find_addr(NULL, &adrs[ARP_TABLE_SIZE - i], &unused_ethaddr, &unused_ipaddr) >= 0);
+  }
+  udp_remove(pcb);
+}
+END_TEST
+#endif /* ETHARP_TABLE_HASH */
+
 /** Create the suite including all tests for this module */
 Suite *
 etharp_suite(void)
 {
   testfunc tests[] = {
-    TESTFUNC(test_etharp_table)
+    TESTFUNC(test_etharp_table),
+#if ETHARP_TABLE_HASH
+    TESTFUNC(test_etharp_table_lru),
+#endif /* ETHARP_TABLE_HASH */
   };
   return create_suite("ETHARP", tests, sizeof(tests)/sizeof(testfunc), etharp_setup, etharp_teardown);
 }
@@ -4,6 +4,7 @@
 #include "lwip/ip4.h"
 #include "lwip/etharp.h"
 #include "lwip/inet_chksum.h"
+#include "lwip/mem.h"
 #include "lwip/stats.h"
 #include "lwip/prot/ip.h"
 #include "lwip/prot/ip4.h"
@@ -71,7 +72,7 @@ test_netif_remove(void)
 
 /* Helper functions */
 static void
-create_ip4_input_fragment(u16_t ip_id, u16_t start, u16_t len, int last)
+create_ip4_input_fragment_from(u8_t src_offset, u16_t ip_id, u16_t start, u16_t len, int last)
 {
   struct pbuf *p;
   struct netif *input_netif = netif_list; /* just use any netif */
@@ -97,7 +98,7 @@ create_ip4_input_fragment(u16_t ip_id, u16_t start, u16_t len, int last)
     IPH_PROTO_SET(iphdr, IP_PROTO_UDP);
     IPH_CHKSUM_SET(iphdr, 0);
     ip4_addr_copy(iphdr->src, *netif_ip4_addr(input_netif));
-    iphdr->src.addr = lwip_htonl(lwip_htonl(iphdr->src.addr) + 1);
+    iphdr->src.addr = lwip_htonl(lwip_htonl(iphdr->src.addr) + src_offset);
     ip4_addr_copy(iphdr->dest, *netif_ip4_addr(input_netif));
     IPH_CHKSUM_SET(iphdr, inet_chksum(iphdr, sizeof(struct ip_hdr)));
 
@@ -109,12 +110,43 @@ create_ip4_input_fragment(u16_t ip_id, u16_t start, u16_t len, int last)
   }
 }
 
+static void
+create_ip4_input_fragment(u16_t ip_id, u16_t start, u16_t len, int last)
+{
+  create_ip4_input_fragment_from(1, ip_id, start, len, last);
+}
+
 static err_t arpless_output(struct netif *netif, struct pbuf *p,
                             const ip4_addr_t *ipaddr) {
   LWIP_UNUSED_ARG(ipaddr);
   return netif->linkoutput(netif, p);
 }
 
+static u8_t frag_payload[3300];
+static struct pbuf *frag_held;
+
+/* Reassemble the payload of sent fragments and hold on to the first one */
+static err_t
+frag_linkoutput(struct netif *netif, struct pbuf *p)
+{
+  struct ip_hdr iphdr;
+  u16_t off, len;
+  fail_unless(netif == &test_netif);
+  fail_unless(pbuf_copy_partial(p, &iphdr, IP_HLEN, 0) == IP_HLEN);
+  fail_unless(inet_chksum(&iphdr, IP_HLEN) == 0);
+  off = (u16_t)((lwip_ntohs(IPH_OFFSET(&iphdr)) & IP_OFFMASK) * 8);
+  len = (u16_t)(lwip_ntohs(IPH_LEN(&iphdr)) - IP_HLEN);
+  fail_unless(p->tot_len == len + IP_HLEN);
+  fail_unless(off + len <= sizeof(frag_payload));
+  fail_unless(pbuf_copy_partial(p, &frag_payload[off], len, IP_HLEN) == len);
+  if (frag_held == NULL) {
+    pbuf_ref(p);
+    frag_held = p;
+  }
+  linkoutput_ctr++;
+  return ERR_OK;
+}
+
 /* Setups/teardown functions */
 
 static void
@@ -162,6 +194,124 @@ START_TEST(test_ip4_frag)
 }
 END_TEST
 
+static void *frag_heap[128];
+static u16_t frag_heap_num;
+
+/* Use up the heap except for one block that is big enough for the header
+   pbufs of single fragments, but not for a batch of fragments */
+static void
+frag_exhaust_heap(void)
+{
+  mem_size_t size;
+  void *m;
+
+  frag_heap_num = 0;
+  for (size = 200; size > 0; size /= 2) {
+    while ((frag_heap_num < LWIP_ARRAYSIZE(frag_heap)) && ((m = mem_malloc(size)) != NULL)) {
+      frag_heap[frag_heap_num++] = m;
+    }
+  }
+  fail_unless(frag_heap_num < LWIP_ARRAYSIZE(frag_heap));
+  mem_free(frag_heap[0]);
+  frag_heap[0] = NULL;
+}
+
+static void
+frag_release_heap(void)
+{
+  u16_t i;
+  for (i = 0; i < frag_heap_num; i++) {
+    if (frag_heap[i] != NULL) {
+      mem_free(frag_heap[i]);
+    }
+  }
+  frag_heap_num = 0;
+}
+
+/* Fragment a chain of pbufs with boundaries in the middle of pbufs */
+static void
+test_ip4_frag_chain_output(int exhaust_heap)
+{
+  const u16_t lens[] = {1000, 1501, 777};
+  struct pbuf *data = NULL;
+  ip_addr_t peer_ip = IPADDR4_INIT_BYTES(192,168,0,5);
+  u16_t i, total = 0;
+  err_t err;
+
+  for (i = 0; i < LWIP_ARRAYSIZE(lens); i++) {
+    struct pbuf *q = pbuf_alloc(i == 0 ? PBUF_IP : PBUF_RAW, lens[i], PBUF_RAM);
+    fail_unless(q != NULL);
+    if (data == NULL) {
+      data = q;
+    } else {
+      pbuf_cat(data, q);
+    }
+    total = (u16_t)(total + lens[i]);
+  }
+  for (i = 0; i < total; i++) {
+    u8_t b = (u8_t)(i * 7);
+    fail_unless(pbuf_take_at(data, &b, 1, i) == ERR_OK);
+  }
+  memset(frag_payload, 0, sizeof(frag_payload));
+  frag_held = NULL;
+  linkoutput_ctr = 0;
+
+  test_netif_add();
+  test_netif.output = arpless_output;
+  test_netif.linkoutput = frag_linkoutput;
+  if (exhaust_heap) {
+    frag_exhaust_heap();
+  }
+  err = ip4_output_if_src(data, &test_ipaddr, ip_2_ip4(&peer_ip),
+                          16, 0, IP_PROTO_UDP, &test_netif);
+  fail_unless(err == ERR_OK);
+  fail_unless(linkoutput_ctr == 3);
+  for (i = 0; i < total; i++) {
+    fail_unless(frag_payload[i] == (u8_t)(i * 7));
+  }
+  fail_unless(frag_held != NULL);
+#if !LWIP_NETIF_TX_SINGLE_PBUF
+  /* a batch slices the fragments without references from MEMP_FRAG_PBUF */
+  if (IP_FRAG_BATCH && !exhaust_heap) {
+    fail_unless(MEMP_STATS_GET(used, MEMP_FRAG_PBUF) == 0);
+  } else {
+    fail_unless(MEMP_STATS_GET(used, MEMP_FRAG_PBUF) > 0);
+  }
+  /* the held fragment keeps the datagram referenced */
+  fail_unless(data->ref == 2);
+  pbuf_free(frag_held);
+  fail_unless(data->ref == 1);
+  fail_unless(MEMP_STATS_GET(used, MEMP_FRAG_PBUF) == 0);
+#else /* !LWIP_NETIF_TX_SINGLE_PBUF */
+  /* fragments are copied and do not reference the datagram */
+  fail_unless(data->ref == 1);
+  pbuf_free(frag_held);
+#endif /* !LWIP_NETIF_TX_SINGLE_PBUF */
+  frag_release_heap();
+  pbuf_free(data);
+  test_netif_remove();
+}
+
+START_TEST(test_ip4_frag_chain)
+{
+  LWIP_UNUSED_ARG(_i);
+
+  test_ip4_frag_chain_output(0);
+}
+END_TEST
+
+#if !LWIP_NETIF_TX_SINGLE_PBUF
+/* Without memory for a batch, fragments are allocated one by one
+   (copied fragments always need heap memory) */
+START_TEST(test_ip4_frag_chain_no_batch)
+{
+  LWIP_UNUSED_ARG(_i);
+
+  test_ip4_frag_chain_output(1);
+}
+END_TEST
+#endif /* !LWIP_NETIF_TX_SINGLE_PBUF */
+
 START_TEST(test_ip4_reass)
 {
   const u16_t ip_id = 128;
@@ -234,6 +384,81 @@ START_TEST(test_ip4_reass)
 }
 END_TEST
 
+/* Fragments arriving out of order are inserted in place, duplicate,
+ * overlapping and oversized fragments are dropped */
+START_TEST(test_ip4_reass_overlap)
+{
+  const u16_t ip_id = 129;
+  LWIP_UNUSED_ARG(_i);
+
+  memset(&lwip_stats.mib2, 0, sizeof(lwip_stats.mib2));
+  memset(&lwip_stats.ip_frag, 0, sizeof(lwip_stats.ip_frag));
+
+  create_ip4_input_fragment(ip_id, 400, 200, 0);
+  /* last fragment: the datagram is 900 bytes long */
+  create_ip4_input_fragment(ip_id, 800, 100, 1);
+  fail_unless(lwip_stats.ip_frag.drop == 0);
+
+  /* duplicate */
+  create_ip4_input_fragment(ip_id, 400, 200, 0);
+  fail_unless(lwip_stats.ip_frag.drop == 1);
+  /* overlaps with the fragment at 400 */
+  create_ip4_input_fragment(ip_id, 480, 200, 0);
+  fail_unless(lwip_stats.ip_frag.drop == 2);
+  /* beyond the end of the datagram */
+  create_ip4_input_fragment(ip_id, 1000, 8, 0);
+  fail_unless(lwip_stats.ip_frag.drop == 3);
+  /* new lowest offset */
+  create_ip4_input_fragment(ip_id, 0, 200, 0);
+  fail_unless(lwip_stats.ip_frag.drop == 3);
+  /* overlaps with the fragment at 400 from below */
+  create_ip4_input_fragment(ip_id, 200, 208, 0);
+  fail_unless(lwip_stats.ip_frag.drop == 4);
+  /* fills the hole between 400 and 800 */
+  create_ip4_input_fragment(ip_id, 600, 200, 0);
+  fail_unless(lwip_stats.ip_frag.drop == 4);
+  fail_unless(lwip_stats.mib2.ipreasmoks == 0);
+
+  create_ip4_input_fragment(ip_id, 200, 200, 0);
+  fail_unless(lwip_stats.ip_frag.drop == 4);
+  fail_unless(lwip_stats.ip_frag.memerr == 0);
+  fail_unless(lwip_stats.mib2.ipreasmoks == 1);
+}
+END_TEST
+
+#if IP_REASS_MAX_PBUFS_PER_SOURCE < IP_REASS_MAX_PBUFS
+/* A source exceeding its quota frees its own oldest datagram, not the
+ * datagrams of other sources */
+START_TEST(test_ip4_reass_source_quota)
+{
+  const u16_t ip_id = 130;
+  u16_t i;
+  LWIP_UNUSED_ARG(_i);
+
+  memset(&lwip_stats.mib2, 0, sizeof(lwip_stats.mib2));
+  memset(&lwip_stats.ip_frag, 0, sizeof(lwip_stats.ip_frag));
+
+  create_ip4_input_fragment_from(2, ip_id, 0, 200, 0);
+  for (i = 0; i < IP_REASS_MAX_PBUFS_PER_SOURCE; i++) {
+    create_ip4_input_fragment_from(1, ip_id + 1, (u16_t)(i * 200), 200, 0);
+  }
+  fail_unless(lwip_stats.mib2.ipreasmfails == 0);
+
+  /* over quota: the first datagram of this source is freed */
+  create_ip4_input_fragment_from(1, ip_id + 2, 0, 200, 0);
+  fail_unless(lwip_stats.mib2.ipreasmfails == 1);
+  fail_unless(lwip_stats.ip_frag.memerr == 0);
+  fail_unless(lwip_stats.ip_frag.drop == 0);
+
+  /* the other source is not affected */
+  create_ip4_input_fragment_from(2, ip_id, 200, 200, 1);
+  fail_unless(lwip_stats.mib2.ipreasmoks == 1);
+  create_ip4_input_fragment_from(1, ip_id + 2, 200, 200, 1);
+  fail_unless(lwip_stats.mib2.ipreasmoks == 2);
+}
+END_TEST
+#endif /* IP_REASS_MAX_PBUFS_PER_SOURCE < IP_REASS_MAX_PBUFS */
+
 /* packets to 127.0.0.1 shall not be sent out to netif_default */
 START_TEST(test_127_0_0_1)
 {
@@ -332,7 +557,15 @@ ip4_suite(void)
 {
   testfunc tests[] = {
     TESTFUNC(test_ip4_frag),
+    TESTFUNC(test_ip4_frag_chain),
+#if !LWIP_NETIF_TX_SINGLE_PBUF
+    TESTFUNC(test_ip4_frag_chain_no_batch),
+#endif
     TESTFUNC(test_ip4_reass),
+    TESTFUNC(test_ip4_reass_overlap),
+#if IP_REASS_MAX_PBUFS_PER_SOURCE < IP_REASS_MAX_PBUFS
+    TESTFUNC(test_ip4_reass_source_quota),
+#endif /* IP_REASS_MAX_PBUFS_PER_SOURCE < IP_REASS_MAX_PBUFS */
     TESTFUNC(test_127_0_0_1),
     TESTFUNC(test_ip4addr_aton),
     TESTFUNC(test_ip4_icmp_replylen_short),
@@ -0,0 +1,282 @@
+#include "test_ip4_fib.h"
+
+#include "lwip/ip4.h"
+#include "lwip/ip4_fib.h"
+#include "lwip/etharp.h"
+#include "lwip/stats.h"
+#include "lwip/prot/ethernet.h"
+#include "lwip/prot/etharp.h"
+
+#if !LWIP_STATS || !MEMP_STATS
+#error "This tests needs MEMP-statistics enabled"
+#endif
+
+#if LWIP_IPV4_FIB
+
+static struct netif test_netif1, test_netif2;
+static struct netif *old_netif_list;
+static struct netif *old_netif_default;
+static struct netif *linkoutput_netif;
+static u8_t linkoutput_pkt[SIZEOF_ETH_HDR + SIZEOF_ETHARP_HDR];
+
+static err_t
+test_ip4_fib_linkoutput(struct netif *netif, struct pbuf *p)
+{
+  linkoutput_netif = netif;
+  pbuf_copy_partial(p, linkoutput_pkt, sizeof(linkoutput_pkt), 0);
+  return ERR_OK;
+}
+
+static err_t
+test_ip4_fib_netif_init(struct netif *netif)
+{
+  netif->linkoutput = test_ip4_fib_linkoutput;
+  netif->output = etharp_output;
+  netif->mtu = 1500;
+  netif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP | NETIF_FLAG_LINK_UP;
+  netif->hwaddr_len = ETHARP_HWADDR_LEN;
+  return ERR_OK;
+}
+
+static void
+test_ip4_fib_netif_add(struct netif *netif, const char *ipaddr, const char *gw)
+{
+  ip4_addr_t addr, netmask, gwaddr;
+  fail_unless(ip4addr_aton(ipaddr, &addr));
+  fail_unless(ip4addr_aton("255.255.255.0", &netmask));
+  fail_unless(ip4addr_aton(gw, &gwaddr));
+  fail_unless(netif_add(netif, &addr, &netmask, &gwaddr, NULL, test_ip4_fib_netif_init, netif_input) == netif);
+  netif_set_up(netif);
+}
+
+static err_t
+test_ip4_fib_add(const char *prefix, u8_t prefix_len, const char *gw, struct netif *netif)
+{
+  ip4_addr_t prefix_addr, gw_addr;
+  fail_unless(ip4addr_aton(prefix, &prefix_addr));
+  if (gw != NULL) {
+    fail_unless(ip4addr_aton(gw, &gw_addr));
+  }
+  return ip4_fib_add(&prefix_addr, prefix_len, (gw != NULL) ? &gw_addr : NULL, netif);
+}
+
+static err_t
+test_ip4_fib_delete(const char *prefix, u8_t prefix_len)
+{
+  ip4_addr_t prefix_addr;
+  fail_unless(ip4addr_aton(prefix, &prefix_addr));
+  return ip4_fib_delete(&prefix_addr, prefix_len);
+}
+
+/** Check the netif and next hop chosen for 'dest' ("dest" for on-link,
+ * NULL for the netif gateway) */
+static void
+test_ip4_fib_check(const char *dest, struct netif *netif, const char *gw)
+{
+  ip4_addr_t dest_addr, gw_addr;
+  const ip4_addr_t *next_hop;
+
+  fail_unless(ip4addr_aton(dest, &dest_addr));
+  fail_unless(ip4_route(&dest_addr) == netif, "wrong netif for %s", dest);
+  if (netif == NULL) {
+    return;
+  }
+  next_hop = ip4_fib_gateway(netif, &dest_addr);
+  if (gw == NULL) {
+    fail_unless(next_hop == NULL, "unexpected next hop for %s", dest);
+  } else {
+    fail_unless(ip4addr_aton(gw, &gw_addr));
+    fail_unless(next_hop != NULL, "no next hop for %s", dest);
+    if (next_hop != NULL) {
+      fail_unless(ip4_addr_eq(next_hop, &gw_addr), "wrong next hop for %s", dest);
+    }
+  }
+}
+
+/* Setups/teardown functions */
+
+static void
+ip4_fib_setup(void)
+{
+  old_netif_list = netif_list;
+  old_netif_default = netif_default;
+  netif_list = NULL;
+  netif_default = NULL;
+  test_ip4_fib_netif_add(&test_netif1, "192.168.1.1", "192.168.1.254");
+  test_ip4_fib_netif_add(&test_netif2, "10.0.0.1", "0.0.0.0");
+  netif_set_default(&test_netif1);
+  lwip_check_ensure_no_alloc(SKIP_POOL(MEMP_SYS_TIMEOUT));
+}
+
+static void
+ip4_fib_teardown(void)
+{
+  netif_remove(&test_netif1);
+  netif_remove(&test_netif2);
+  netif_list = old_netif_list;
+  netif_default = old_netif_default;
+  lwip_check_ensure_no_alloc(SKIP_POOL(MEMP_SYS_TIMEOUT));
+}
+
+/* Test functions */
+
+/** The longest prefix of routes and netif subnets wins */
+START_TEST(test_ip4_fib_lpm)
+{
+  LWIP_UNUSED_ARG(_i);
+
+  /* netif found by the gateway */
+  fail_unless(test_ip4_fib_add("172.16.0.0", 12, "10.0.0.254", NULL) == ERR_OK);
+  fail_unless(test_ip4_fib_add("172.16.5.0", 24, "192.168.1.253", &test_netif1) == ERR_OK);
+  /* on-link */
+  fail_unless(test_ip4_fib_add("172.16.5.128", 25, NULL, &test_netif2) == ERR_OK);
+  fail_unless(test_ip4_fib_add("192.168.1.77", 32, "10.0.0.253", NULL) == ERR_OK);
+
+  fail_unless(test_ip4_fib_add("172.16.5.0", 24, "192.168.1.253", &test_netif1) == ERR_USE);
+  fail_unless(test_ip4_fib_add("172.16.5.1", 24, "192.168.1.253", &test_netif1) == ERR_ARG);
+  fail_unless(test_ip4_fib_add("172.17.0.0", 16, "10.1.0.1", NULL) == ERR_RTE);
+  fail_unless(MEMP_STATS_GET(used, MEMP_IP4_FIB_NODE) == 5);
+
+  test_ip4_fib_check("172.16.1.1", &test_netif2, "10.0.0.254");
+  test_ip4_fib_check("172.16.5.1", &test_netif1, "192.168.1.253");
+  test_ip4_fib_check("172.16.5.200", &test_netif2, "172.16.5.200");
+  /* a host route is more specific than the subnet */
+  test_ip4_fib_check("192.168.1.77", &test_netif2, "10.0.0.253");
+  test_ip4_fib_check("192.168.1.78", &test_netif1, NULL);
+  test_ip4_fib_check("10.0.0.5", &test_netif2, NULL);
+  test_ip4_fib_check("8.8.8.8", &test_netif1, NULL);
+
+  /* deleting a route takes effect immediately (cached decisions are dropped) */
+  fail_unless(test_ip4_fib_delete("172.16.5.0", 24) == ERR_OK);
+  fail_unless(test_ip4_fib_delete("172.16.5.0", 24) == ERR_VAL);
+  fail_unless(test_ip4_fib_delete("172.16.6.0", 24) == ERR_VAL);
+  test_ip4_fib_check("172.16.5.1", &test_netif2, "10.0.0.254");
+  test_ip4_fib_check("172.16.5.200", &test_netif2, "172.16.5.200");
+
+  /* a default route replaces the default netif */
+  fail_unless(test_ip4_fib_add("0.0.0.0", 0, "10.0.0.254", NULL) == ERR_OK);
+  test_ip4_fib_check("8.8.8.8", &test_netif2, "10.0.0.254");
+
+  fail_unless(test_ip4_fib_delete("0.0.0.0", 0) == ERR_OK);
+  fail_unless(test_ip4_fib_delete("172.16.0.0", 12) == ERR_OK);
+  fail_unless(test_ip4_fib_delete("172.16.5.128", 25) == ERR_OK);
+  fail_unless(test_ip4_fib_delete("192.168.1.77", 32) == ERR_OK);
+  fail_unless(MEMP_STATS_GET(used, MEMP_IP4_FIB_NODE) == 0);
+  test_ip4_fib_check("172.16.1.1", &test_netif1, NULL);
+}
+END_TEST
+
+/** Routes via a netif without link are skipped, routes via a removed netif
+ * are deleted */
+START_TEST(test_ip4_fib_netif_state)
+{
+  LWIP_UNUSED_ARG(_i);
+
+  fail_unless(test_ip4_fib_add("172.16.0.0", 12, "192.168.1.253", NULL) == ERR_OK);
+  fail_unless(test_ip4_fib_add("172.16.5.0", 24, "10.0.0.254", NULL) == ERR_OK);
+  test_ip4_fib_check("172.16.5.1", &test_netif2, "10.0.0.254");
+
+  netif_set_link_down(&test_netif2);
+  test_ip4_fib_check("172.16.5.1", &test_netif1, "192.168.1.253");
+  netif_set_link_up(&test_netif2);
+  test_ip4_fib_check("172.16.5.1", &test_netif2, "10.0.0.254");
+
+  netif_remove(&test_netif2);
+  fail_unless(MEMP_STATS_GET(used, MEMP_IP4_FIB_NODE) == 1);
+  test_ip4_fib_check("172.16.5.1", &test_netif1, "192.168.1.253");
+  fail_unless(test_ip4_fib_delete("172.16.0.0", 12) == ERR_OK);
+}
+END_TEST
+
+/** etharp_output() resolves the next hop of the route */
+START_TEST(test_ip4_fib_etharp_next_hop)
+{
+  struct etharp_hdr *hdr = (struct etharp_hdr *)&linkoutput_pkt[SIZEOF_ETH_HDR];
+  ip4_addr_t dest, gw, target;
+  struct pbuf *p;
+  LWIP_UNUSED_ARG(_i);
+
+  fail_unless(test_ip4_fib_add("172.16.0.0", 12, "10.0.0.254", NULL) == ERR_OK);
+  fail_unless(ip4addr_aton("172.16.1.1", &dest));
+  fail_unless(ip4addr_aton("10.0.0.254", &gw));
+
+  p = pbuf_alloc(PBUF_IP, 10, PBUF_RAM);
+  fail_unless(p != NULL);
+  linkoutput_netif = NULL;
+  fail_unless(etharp_output(ip4_route(&dest), p, &dest) == ERR_OK);
+  pbuf_free(p);
+  /* an ARP request for the gateway was sent */
+  fail_unless(linkoutput_netif == &test_netif2);
+  fail_unless(hdr->opcode == PP_HTONS(ARP_REQUEST));
+  IPADDR_WORDALIGNED_COPY_TO_IP4_ADDR_T(&target, &hdr->dipaddr);
+  fail_unless(ip4_addr_eq(&target, &gw));
+
+  etharp_cleanup_netif(&test_netif2);
+  fail_unless(test_ip4_fib_delete("172.16.0.0", 12) == ERR_OK);
+
+  /* a route more specific than the subnet of the netif is used, too */
+  fail_unless(test_ip4_fib_add("192.168.1.128", 25, "192.168.1.253", NULL) == ERR_OK);
+  fail_unless(ip4addr_aton("192.168.1.200", &dest));
+  fail_unless(ip4addr_aton("192.168.1.253", &gw));
+  p = pbuf_alloc(PBUF_IP, 10, PBUF_RAM);
+  fail_unless(p != NULL);
+  linkoutput_netif = NULL;
+  fail_unless(etharp_output(ip4_route(&dest), p, &dest) == ERR_OK);
+  pbuf_free(p);
+  fail_unless(linkoutput_netif == &test_netif1);
+  fail_unless(hdr->opcode == PP_HTONS(ARP_REQUEST));
+  IPADDR_WORDALIGNED_COPY_TO_IP4_ADDR_T(&target, &hdr->dipaddr);
+  fail_unless(ip4_addr_eq(&target, &gw));
+
+  etharp_cleanup_netif(&test_netif1);
+  fail_unless(test_ip4_fib_delete("192.168.1.128", 25) == ERR_OK);
+}
+END_TEST
+
+/** Deleting routes removes the branch nodes that are left over */
+START_TEST(test_ip4_fib_delete_branches)
+{
+  LWIP_UNUSED_ARG(_i);
+
+  fail_unless(test_ip4_fib_add("172.16.0.0", 16, "10.0.0.254", NULL) == ERR_OK);
+  fail_unless(test_ip4_fib_add("172.16.1.0", 24, "192.168.1.253", NULL) == ERR_OK);
+  fail_unless(test_ip4_fib_add("172.16.2.0", 24, "10.0.0.254", NULL) == ERR_OK);
+  fail_unless(test_ip4_fib_add("172.16.3.0", 24, "10.0.0.254", NULL) == ERR_OK);
+  fail_unless(test_ip4_fib_add("172.16.4.0", 24, "10.0.0.254", NULL) == ERR_OK);
+  fail_unless(test_ip4_fib_add("10.9.0.0", 16, "192.168.1.253", NULL) == ERR_OK);
+
+  /* all routes via a removed netif go at once, with their branch nodes */
+  netif_remove(&test_netif2);
+  fail_unless(MEMP_STATS_GET(used, MEMP_IP4_FIB_NODE) == 3);
+  test_ip4_fib_check("172.16.1.1", &test_netif1, "192.168.1.253");
+  test_ip4_fib_check("172.16.2.1", &test_netif1, NULL);
+  test_ip4_fib_check("10.9.1.1", &test_netif1, "192.168.1.253");
+
+  fail_unless(test_ip4_fib_delete("172.16.1.0", 24) == ERR_OK);
+  fail_unless(MEMP_STATS_GET(used, MEMP_IP4_FIB_NODE) == 1);
+  fail_unless(test_ip4_fib_delete("10.9.0.0", 16) == ERR_OK);
+  fail_unless(MEMP_STATS_GET(used, MEMP_IP4_FIB_NODE) == 0);
+}
+END_TEST
+
+/** Create the suite including all tests for this module */
+Suite *
+ip4_fib_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_ip4_fib_lpm),
+    TESTFUNC(test_ip4_fib_netif_state),
+    TESTFUNC(test_ip4_fib_etharp_next_hop),
+    TESTFUNC(test_ip4_fib_delete_branches),
+  };
+  return create_suite("IP4_FIB", tests, sizeof(tests)/sizeof(testfunc), ip4_fib_setup, ip4_fib_teardown);
+}
+
+#else /* LWIP_IPV4_FIB */
+
+Suite *
+ip4_fib_suite(void)
+{
+  return create_suite("IP4_FIB", NULL, 0, NULL, NULL);
+}
+#endif /* LWIP_IPV4_FIB */
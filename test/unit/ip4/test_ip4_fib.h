@@ -0,0 +1,8 @@
+#ifndef LWIP_HDR_TEST_IP4_FIB_H
+#define LWIP_HDR_TEST_IP4_FIB_H
+
+#include "../lwip_check.h"
+
+Suite* ip4_fib_suite(void);
+
+#endif
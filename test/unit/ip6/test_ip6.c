@@ -4,7 +4,9 @@
 #include "lwip/ip6.h"
 #include "lwip/icmp6.h"
 #include "lwip/inet_chksum.h"
+#include "lwip/mem.h"
 #include "lwip/nd6.h"
+#include "lwip/priv/nd6_priv.h"
 #include "lwip/stats.h"
 #include "lwip/prot/ethernet.h"
 #include "lwip/prot/ip.h"
@@ -432,6 +434,394 @@ START_TEST(test_ip6_frag)
 }
 END_TEST
 
+static u8_t frag_payload[3300];
+static struct pbuf *frag_held;
+
+/* Reassemble the payload of sent fragments and hold on to the first one */
+static err_t
+frag_linkoutput(struct netif *netif, struct pbuf *p)
+{
+  struct ip6_hdr ip6hdr;
+  struct ip6_frag_hdr fraghdr;
+  u16_t off, len;
+  fail_unless(netif == &test_netif6);
+  fail_unless(pbuf_copy_partial(p, &ip6hdr, IP6_HLEN, 0) == IP6_HLEN);
+  fail_unless(IP6H_NEXTH(&ip6hdr) == IP6_NEXTH_FRAGMENT);
+  fail_unless(pbuf_copy_partial(p, &fraghdr, IP6_FRAG_HLEN, IP6_HLEN) == IP6_FRAG_HLEN);
+  off = (u16_t)(lwip_ntohs(fraghdr._fragment_offset) & IP6_FRAG_OFFSET_MASK);
+  len = (u16_t)(IP6H_PLEN(&ip6hdr) - IP6_FRAG_HLEN);
+  fail_unless(p->tot_len == len + IP6_HLEN + IP6_FRAG_HLEN);
+  fail_unless(off + len <= sizeof(frag_payload));
+  fail_unless(pbuf_copy_partial(p, &frag_payload[off], len, IP6_HLEN + IP6_FRAG_HLEN) == len);
+  if (frag_held == NULL) {
+    pbuf_ref(p);
+    frag_held = p;
+  }
+  linkoutput_ctr++;
+  return ERR_OK;
+}
+
+static void *frag_heap[128];
+static u16_t frag_heap_num;
+
+/* Use up the heap except for one block that is big enough for the header
+   pbufs of single fragments, but not for a batch of fragments */
+static void
+frag_exhaust_heap(void)
+{
+  mem_size_t size;
+  void *m;
+
+  frag_heap_num = 0;
+  for (size = 200; size > 0; size /= 2) {
+    while ((frag_heap_num < LWIP_ARRAYSIZE(frag_heap)) && ((m = mem_malloc(size)) != NULL)) {
+      frag_heap[frag_heap_num++] = m;
+    }
+  }
+  fail_unless(frag_heap_num < LWIP_ARRAYSIZE(frag_heap));
+  mem_free(frag_heap[0]);
+  frag_heap[0] = NULL;
+}
+
+static void
+frag_release_heap(void)
+{
+  u16_t i;
+  for (i = 0; i < frag_heap_num; i++) {
+    if (frag_heap[i] != NULL) {
+      mem_free(frag_heap[i]);
+    }
+  }
+  frag_heap_num = 0;
+}
+
+/* Fragment a chain of pbufs with boundaries in the middle of pbufs */
+static void
+test_ip6_frag_chain_output(int exhaust_heap)
+{
+  const u16_t lens[] = {1000, 1501, 777};
+  ip_addr_t my_addr = IPADDR6_INIT_HOST(0x20010db8, 0x0, 0x0, 0x1);
+  ip_addr_t peer_addr = IPADDR6_INIT_HOST(0x20010db8, 0x0, 0x0, 0x4);
+  struct pbuf *data = NULL;
+  u16_t i, total = 0;
+  err_t err;
+
+  for (i = 0; i < LWIP_ARRAYSIZE(lens); i++) {
+    struct pbuf *q = pbuf_alloc(i == 0 ? PBUF_IP : PBUF_RAW, lens[i], PBUF_RAM);
+    fail_unless(q != NULL);
+    if (data == NULL) {
+      data = q;
+    } else {
+      pbuf_cat(data, q);
+    }
+    total = (u16_t)(total + lens[i]);
+  }
+  for (i = 0; i < total; i++) {
+    u8_t b = (u8_t)(i * 7);
+    fail_unless(pbuf_take_at(data, &b, 1, i) == ERR_OK);
+  }
+  memset(frag_payload, 0, sizeof(frag_payload));
+  frag_held = NULL;
+
+  /* Configure and enable local address */
+  test_netif6.mtu = 1500;
+  netif_set_up(&test_netif6);
+  netif_ip6_addr_set(&test_netif6, 0, ip_2_ip6(&my_addr));
+  netif_ip6_addr_set_state(&test_netif6, 0, IP6_ADDR_VALID);
+  test_netif6.output_ip6 = direct_output;
+  test_netif6.linkoutput = frag_linkoutput;
+  /* Reset counters after multicast traffic */
+  linkoutput_ctr = 0;
+
+  if (exhaust_heap) {
+    frag_exhaust_heap();
+  }
+  err = ip6_output_if_src(data, ip_2_ip6(&my_addr), ip_2_ip6(&peer_addr),
+                          15, 0, IP_PROTO_UDP, &test_netif6);
+  fail_unless(err == ERR_OK);
+  fail_unless(linkoutput_ctr == 3);
+  for (i = 0; i < total; i++) {
+    fail_unless(frag_payload[i] == (u8_t)(i * 7));
+  }
+  fail_unless(frag_held != NULL);
+#if !LWIP_NETIF_TX_SINGLE_PBUF
+  /* a batch slices the fragments without references from MEMP_FRAG_PBUF */
+  if (IP_FRAG_BATCH && !exhaust_heap) {
+    fail_unless(MEMP_STATS_GET(used, MEMP_FRAG_PBUF) == 0);
+  } else {
+    fail_unless(MEMP_STATS_GET(used, MEMP_FRAG_PBUF) > 0);
+  }
+  /* the held fragment keeps the datagram referenced */
+  fail_unless(data->ref == 2);
+  pbuf_free(frag_held);
+  fail_unless(data->ref == 1);
+  fail_unless(MEMP_STATS_GET(used, MEMP_FRAG_PBUF) == 0);
+#else /* !LWIP_NETIF_TX_SINGLE_PBUF */
+  /* fragments are copied and do not reference the datagram */
+  fail_unless(data->ref == 1);
+  pbuf_free(frag_held);
+#endif /* !LWIP_NETIF_TX_SINGLE_PBUF */
+  frag_release_heap();
+  pbuf_free(data);
+  test_netif6.linkoutput = default_netif_linkoutput;
+}
+
+START_TEST(test_ip6_frag_chain)
+{
+  LWIP_UNUSED_ARG(_i);
+
+  test_ip6_frag_chain_output(0);
+}
+END_TEST
+
+#if !LWIP_NETIF_TX_SINGLE_PBUF
+/* Without memory for a batch, fragments are allocated one by one
+   (copied fragments always need heap memory) */
+START_TEST(test_ip6_frag_chain_no_batch)
+{
+  LWIP_UNUSED_ARG(_i);
+
+  test_ip6_frag_chain_output(1);
+}
+END_TEST
+#endif /* !LWIP_NETIF_TX_SINGLE_PBUF */
+
+#if LWIP_IPV6_REASS
+/** Input a fragment from 2001:db8::'src' to 2001:db8::1 without upper layer */
+static void
+test_ip6_input_fragment_from(u32_t src, u32_t id, u16_t start, u16_t len, int last)
+{
+  ip_addr_t my_addr = IPADDR6_INIT_HOST(0x20010db8, 0x0, 0x0, 0x1);
+  ip_addr_t peer_addr = IPADDR6_INIT_HOST(0x20010db8, 0x0, 0x0, src);
+  struct ip6_hdr *ip6hdr;
+  struct ip6_frag_hdr *fraghdr;
+  struct pbuf *p;
+
+  fail_unless((start & 7) == 0);
+  p = pbuf_alloc(PBUF_RAW, (u16_t)(IP6_HLEN + IP6_FRAG_HLEN + len), PBUF_RAM);
+  fail_unless(p != NULL);
+  if (p != NULL) {
+    memset(p->payload, 0, p->len);
+    ip6hdr = (struct ip6_hdr *)p->payload;
+    IP6H_VTCFL_SET(ip6hdr, 6, 0, 0);
+    IP6H_PLEN_SET(ip6hdr, (u16_t)(IP6_FRAG_HLEN + len));
+    IP6H_NEXTH_SET(ip6hdr, IP6_NEXTH_FRAGMENT);
+    IP6H_HOPLIM_SET(ip6hdr, 64);
+    ip6_addr_copy_to_packed(ip6hdr->src, *ip_2_ip6(&peer_addr));
+    ip6_addr_copy_to_packed(ip6hdr->dest, *ip_2_ip6(&my_addr));
+    fraghdr = (struct ip6_frag_hdr *)(ip6hdr + 1);
+    fraghdr->_nexth = IP6_NEXTH_NONE;
+    fraghdr->_fragment_offset = lwip_htons((u16_t)(start | (last ? 0 : IP6_FRAG_MORE_FLAG)));
+    fraghdr->_identification = lwip_htonl(id);
+    ip6_input(p, &test_netif6);
+  }
+}
+
+/** Input a fragment from 2001:db8::4 to 2001:db8::1 without upper layer */
+static void
+test_ip6_input_fragment(u32_t id, u16_t start, u16_t len, int last)
+{
+  test_ip6_input_fragment_from(4, id, start, len, last);
+}
+
+/* Fragments arriving out of order are inserted in place, duplicate,
+ * overlapping and oversized fragments are dropped */
+START_TEST(test_ip6_reass_overlap)
+{
+  ip_addr_t my_addr = IPADDR6_INIT_HOST(0x20010db8, 0x0, 0x0, 0x1);
+  const u32_t id = 0x1234;
+  LWIP_UNUSED_ARG(_i);
+
+  netif_set_up(&test_netif6);
+  netif_ip6_addr_set(&test_netif6, 0, ip_2_ip6(&my_addr));
+  netif_ip6_addr_set_state(&test_netif6, 0, IP6_ADDR_VALID);
+  memset(&lwip_stats.ip6_frag, 0, sizeof(lwip_stats.ip6_frag));
+
+  test_ip6_input_fragment(id, 400, 200, 0);
+  /* last fragment: the datagram is 900 bytes long */
+  test_ip6_input_fragment(id, 800, 100, 1);
+  fail_unless(lwip_stats.ip6_frag.drop == 0);
+
+  /* duplicate */
+  test_ip6_input_fragment(id, 400, 200, 0);
+  fail_unless(lwip_stats.ip6_frag.drop == 1);
+  fail_unless(lwip_stats.ip6_frag.proterr == 0);
+  /* overlaps with the fragment at 400 */
+  test_ip6_input_fragment(id, 480, 200, 0);
+  fail_unless(lwip_stats.ip6_frag.drop == 2);
+  fail_unless(lwip_stats.ip6_frag.proterr == 1);
+  /* beyond the end of the datagram */
+  test_ip6_input_fragment(id, 1000, 8, 0);
+  fail_unless(lwip_stats.ip6_frag.drop == 3);
+  /* new lowest offset */
+  test_ip6_input_fragment(id, 0, 200, 0);
+  /* overlaps with the fragment at 400 from below */
+  test_ip6_input_fragment(id, 200, 208, 0);
+  fail_unless(lwip_stats.ip6_frag.drop == 4);
+  /* fills the hole between 400 and 800 */
+  test_ip6_input_fragment(id, 600, 200, 0);
+  fail_unless(lwip_stats.ip6_frag.drop == 4);
+  fail_unless(MEMP_STATS_GET(used, MEMP_IP6_REASSDATA) == 1);
+
+  test_ip6_input_fragment(id, 200, 200, 0);
+  fail_unless(lwip_stats.ip6_frag.drop == 4);
+  fail_unless(lwip_stats.ip6_frag.memerr == 0);
+  fail_unless(MEMP_STATS_GET(used, MEMP_IP6_REASSDATA) == 0);
+}
+END_TEST
+
+#if IP_REASS_MAX_PBUFS_PER_SOURCE < IP_REASS_MAX_PBUFS
+/* A source exceeding its quota frees its own oldest datagram */
+START_TEST(test_ip6_reass_source_quota)
+{
+  ip_addr_t my_addr = IPADDR6_INIT_HOST(0x20010db8, 0x0, 0x0, 0x1);
+  const u32_t id = 0x1300;
+  u16_t i;
+  LWIP_UNUSED_ARG(_i);
+
+  netif_set_up(&test_netif6);
+  netif_ip6_addr_set(&test_netif6, 0, ip_2_ip6(&my_addr));
+  netif_ip6_addr_set_state(&test_netif6, 0, IP6_ADDR_VALID);
+  memset(&lwip_stats.ip6_frag, 0, sizeof(lwip_stats.ip6_frag));
+
+  test_ip6_input_fragment_from(5, id, 0, 200, 0);
+  /* the first fragments are missing: no ICMPv6 time exceeded when freed */
+  for (i = 0; i < IP_REASS_MAX_PBUFS_PER_SOURCE; i++) {
+    test_ip6_input_fragment_from(4, id + 1, (u16_t)((i + 1) * 200), 200, 0);
+  }
+  fail_unless(MEMP_STATS_GET(used, MEMP_IP6_REASSDATA) == 2);
+
+  /* over quota: the first datagram of this source is freed */
+  test_ip6_input_fragment_from(4, id + 2, 200, 200, 1);
+  fail_unless(MEMP_STATS_GET(used, MEMP_IP6_REASSDATA) == 2);
+  fail_unless(lwip_stats.ip6_frag.memerr == 0);
+  fail_unless(lwip_stats.ip6_frag.drop == 0);
+
+  /* the other source is not affected */
+  test_ip6_input_fragment_from(5, id, 200, 200, 1);
+  fail_unless(MEMP_STATS_GET(used, MEMP_IP6_REASSDATA) == 1);
+  test_ip6_input_fragment_from(4, id + 2, 0, 200, 0);
+  fail_unless(MEMP_STATS_GET(used, MEMP_IP6_REASSDATA) == 0);
+  fail_unless(lwip_stats.ip6_frag.drop == 0);
+}
+END_TEST
+#endif /* IP_REASS_MAX_PBUFS_PER_SOURCE < IP_REASS_MAX_PBUFS */
+#endif /* LWIP_IPV6_REASS */
+
+#if LWIP_ND6_CACHE_HASH
+static int
+test_ip6_nd6_dest_cached(const ip6_addr_t *addr)
+{
+  int i;
+  for (i = 0; i < LWIP_ND6_NUM_DESTINATIONS; i++) {
+    if (ip6_addr_eq(addr, &destination_cache[i].destination_addr)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void
+test_ip6_nd6_output(const ip6_addr_t *addr)
+{
+  const u8_t *hwaddr;
+  struct pbuf *p = pbuf_alloc(PBUF_IP, 10, PBUF_RAM);
+  fail_unless(p != NULL);
+  fail_unless(nd6_get_next_hop_addr_or_queue(&test_netif6, p, addr, &hwaddr) == ERR_OK);
+  pbuf_free(p);
+  fail_unless(test_ip6_nd6_dest_cached(addr));
+}
+
+/** A full destination cache recycles the least recently used entry */
+START_TEST(test_ip6_nd6_destination_lru)
+{
+  ip6_addr_t dests[LWIP_ND6_NUM_DESTINATIONS + 1];
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  netif_set_up(&test_netif6);
+  netif_set_link_up(&test_netif6);
+  netif_create_ip6_linklocal_address(&test_netif6, 1);
+  for (i = 0; i < LWIP_ND6_NUM_DESTINATIONS + 1; i++) {
+    IP6_ADDR(&dests[i], PP_HTONL(0xfe800000UL), 0, 0, PP_HTONL(0x100 + (u32_t)i));
+    ip6_addr_assign_zone(&dests[i], IP6_UNICAST, &test_netif6);
+  }
+
+  for (i = 0; i < LWIP_ND6_NUM_DESTINATIONS; i++) {
+    test_ip6_nd6_output(&dests[i]);
+  }
+  /* dests[0] is the oldest entry, but is used again */
+  test_ip6_nd6_output(&dests[0]);
+  for (i = 0; i < LWIP_ND6_NUM_DESTINATIONS; i++) {
+    fail_unless(test_ip6_nd6_dest_cached(&dests[i]));
+  }
+
+  /* a new destination recycles the least recently used entry: dests[1] */
+  test_ip6_nd6_output(&dests[LWIP_ND6_NUM_DESTINATIONS]);
+  fail_unless(!test_ip6_nd6_dest_cached(&dests[1]));
+  fail_unless(test_ip6_nd6_dest_cached(&dests[0]));
+  for (i = 2; i < LWIP_ND6_NUM_DESTINATIONS + 1; i++) {
+    fail_unless(test_ip6_nd6_dest_cached(&dests[i]));
+  }
+  /* and dests[1] comes back */
+  test_ip6_nd6_output(&dests[1]);
+  fail_unless(!test_ip6_nd6_dest_cached(&dests[2]));
+
+  nd6_clear_destination_cache();
+  fail_unless(!test_ip6_nd6_dest_cached(&dests[0]));
+  test_ip6_nd6_output(&dests[0]);
+
+  netif_set_down(&test_netif6);
+  netif_set_link_down(&test_netif6);
+  nd6_cleanup_netif(&test_netif6);
+}
+END_TEST
+
+static int
+test_ip6_nd6_neighbors(const ip6_addr_t *addr)
+{
+  int i, n = 0;
+  for (i = 0; i < LWIP_ND6_NUM_NEIGHBORS; i++) {
+    if (neighbor_cache[i].state != ND6_NO_ENTRY) {
+      n++;
+      if ((addr != NULL) && ip6_addr_eq(addr, &neighbor_cache[i].next_hop_address)) {
+        return 1;
+      }
+    }
+  }
+  return (addr != NULL) ? 0 : n;
+}
+
+/** Freed neighbor cache entries are reused, a full cache recycles one */
+START_TEST(test_ip6_nd6_neighbor_reuse)
+{
+  ip6_addr_t addr;
+  int round, i;
+  LWIP_UNUSED_ARG(_i);
+
+  netif_set_up(&test_netif6);
+  netif_set_link_up(&test_netif6);
+  netif_create_ip6_linklocal_address(&test_netif6, 1);
+
+  for (round = 0; round < 3; round++) {
+    for (i = 0; i < LWIP_ND6_NUM_NEIGHBORS + 1; i++) {
+      IP6_ADDR(&addr, PP_HTONL(0xfe800000UL), 0, 0, PP_HTONL(0x200 + 0x100 * (u32_t)round + (u32_t)i));
+      ip6_addr_assign_zone(&addr, IP6_UNICAST, &test_netif6);
+      test_ip6_nd6_output(&addr);
+      fail_unless(test_ip6_nd6_neighbors(&addr));
+      fail_unless(test_ip6_nd6_neighbors(NULL) == LWIP_MIN(i + 1, LWIP_ND6_NUM_NEIGHBORS));
+    }
+    nd6_cleanup_netif(&test_netif6);
+    fail_unless(test_ip6_nd6_neighbors(NULL) == 0);
+  }
+
+  netif_set_down(&test_netif6);
+  netif_set_link_down(&test_netif6);
+  nd6_cleanup_netif(&test_netif6);
+}
+END_TEST
+#endif /* LWIP_ND6_CACHE_HASH */
+
 /** Create the suite including all tests for this module */
 Suite *
 ip6_suite(void)
@@ -444,7 +834,21 @@ ip6_suite(void)
     TESTFUNC(test_ip6_lladdr),
     TESTFUNC(test_ip6_dest_unreachable_chained_pbuf),
     TESTFUNC(test_ip6_frag_pbuf_len_assert),
-    TESTFUNC(test_ip6_frag)
+    TESTFUNC(test_ip6_frag),
+    TESTFUNC(test_ip6_frag_chain),
+#if !LWIP_NETIF_TX_SINGLE_PBUF
+    TESTFUNC(test_ip6_frag_chain_no_batch),
+#endif
+#if LWIP_IPV6_REASS
+    TESTFUNC(test_ip6_reass_overlap),
+#if IP_REASS_MAX_PBUFS_PER_SOURCE < IP_REASS_MAX_PBUFS
+    TESTFUNC(test_ip6_reass_source_quota),
+#endif /* IP_REASS_MAX_PBUFS_PER_SOURCE < IP_REASS_MAX_PBUFS */
+#endif /* LWIP_IPV6_REASS */
+#if LWIP_ND6_CACHE_HASH
+    TESTFUNC(test_ip6_nd6_destination_lru),
+    TESTFUNC(test_ip6_nd6_neighbor_reuse),
+#endif /* LWIP_ND6_CACHE_HASH */
   };
   return create_suite("IPv6", tests, sizeof(tests)/sizeof(testfunc), ip6_setup, ip6_teardown);
 }
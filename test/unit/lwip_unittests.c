@@ -1,13 +1,20 @@
 #include "lwip_check.h"
 
 #include "ip4/test_ip4.h"
+#include "ip4/test_ip4_fib.h"
 #include "ip6/test_ip6.h"
 #include "udp/test_udp.h"
 #include "tcp/test_tcp.h"
 #include "tcp/test_tcp_oos.h"
+#include "tcp/test_tcp_cc.h"
+#include "tcp/test_tcp_gro.h"
+#include "tcp/test_tcp_timers.h"
+#include "tcp/test_tcp_tw.h"
+#include "core/test_chksum.h"
 #include "core/test_def.h"
 #include "core/test_dns.h"
 #include "core/test_mem.h"
+#include "core/test_memp.h"
 #include "core/test_netif.h"
 #include "core/test_pbuf.h"
 #include "core/test_timers.h"
@@ -74,13 +81,20 @@ int main(void)
   size_t i;
   suite_getter_fn* suites[] = {
     ip4_suite,
+    ip4_fib_suite,
     ip6_suite,
     udp_suite,
     tcp_suite,
     tcp_oos_suite,
+    tcp_cc_suite,
+    tcp_gro_suite,
+    tcp_timers_suite,
+    tcp_tw_suite,
+    chksum_suite,
     def_suite,
     dns_suite,
     mem_suite,
+    memp_suite,
     netif_suite,
     pbuf_suite,
     timers_suite,
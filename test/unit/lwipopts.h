@@ -40,6 +40,16 @@
 #define TCP_CHECKSUM_ON_COPY_SANITY_CHECK 1
 #define TCP_CHECKSUM_ON_COPY_SANITY_CHECK_FAIL(printfmsg) LWIP_ASSERT("TCP_CHECKSUM_ON_COPY_SANITY_CHECK_FAIL", 0)
 
+/* Test the SIMD checksum routines of the unix port (ignored by other ports) */
+#define LWIP_UNIX_CHKSUM                1
+
+/* Enable the memp thread cache, it is only used while the MEMP tests point
+   test_memp_cache to a cache */
+#define MEMP_CACHE                      1
+struct memp_cache;
+extern struct memp_cache *test_memp_cache;
+#define LWIP_HOOK_MEMP_CACHE()          test_memp_cache
+
 /* We link to special sys_arch.c (for basic non-waiting API layers unit tests) */
 #define NO_SYS                          0
 #define SYS_LIGHTWEIGHT_PROT            0
@@ -48,6 +58,11 @@
 #define LWIP_NETCONN_FULLDUPLEX         LWIP_SOCKET
 #define LWIP_NETCONN_SEM_PER_THREAD     1
 #define LWIP_NETBUF_RECVINFO            1
+#define LWIP_SOCKET_ZEROCOPY_RECV       1
+#define LWIP_SOCKET_EPOLL               1
+#define LWIP_SOCKET_MAX_EPOLL           2
+#define LWIP_SOCKET_MMSG                1
+#define MEMP_NUM_NETBUF                 (LWIP_SOCKET_MMSG_BATCH + 4)
 #define LWIP_HAVE_LOOPIF                1
 #define TCPIP_THREAD_TEST
 
@@ -67,6 +82,42 @@
 #define LWIP_WND_SCALE                  1
 #define TCP_RCV_SCALE                   0
 #define PBUF_POOL_SIZE                  400 /* pbuf tests need ~200KByte */
+#define PBUF_POOL_TELEMETRY             1
+
+/* Test tcp_input() pcb lookup through the hash tables */
+#define LWIP_TCP_PCB_HASH               1
+#define TCP_PCB_HASH_SIZE               256
+
+/* Test udp_input() pcb lookup through the hash table */
+#define LWIP_UDP_PCB_HASH               1
+
+/* Test longest-prefix-match IPv4 routing */
+#define LWIP_IPV4_FIB                   1
+
+/* Test pluggable congestion control including CUBIC */
+#define LWIP_TCP_CC                     1
+#define LWIP_TCP_CC_CUBIC               1
+
+/* Test SACK-based loss recovery and RACK-TLP */
+#define LWIP_TCP_SACK_OUT               1
+#define LWIP_TCP_SACK_IN                1
+#define LWIP_TCP_RACK                   1
+
+/* Test compact TIME-WAIT buckets */
+#define LWIP_TCP_TW_BUCKETS             1
+#define MEMP_NUM_TCP_TW                 8
+
+/* Test zero-copy tcp_write_ref() */
+#define LWIP_TCP_WRITE_REF              1
+
+/* Test TCP super-segments with software GSO */
+#define LWIP_NETIF_TSO                  1
+
+/* Test coalescing of received TCP segments */
+#define LWIP_GRO                        1
+
+/* Test batched input to tcpip_thread */
+#define LWIP_TCPIP_INPUT_BATCH          1
 
 /* Enable IGMP and MDNS for MDNS tests */
 #define LWIP_IGMP                       1
@@ -76,6 +127,25 @@
 /* Minimal changes to opt.h required for etharp unit tests: */
 #define ETHARP_SUPPORT_STATIC_ENTRIES   1
 
+/* Test the hashed ARP table (with few buckets to get collisions) */
+#define ETHARP_TABLE_HASH               1
+#define ETHARP_TABLE_HASH_SIZE          4
+
+/* Test the hashed ND6 caches (with few buckets to get collisions) */
+#define LWIP_ND6_CACHE_HASH             1
+#define LWIP_ND6_NEIGHBOR_HASH_SIZE     4
+#define LWIP_ND6_DESTINATION_HASH_SIZE  4
+
+/* Test hashed reassembly with a per-source limit (IPv6 reassembly needs
+   IPV6_FRAG_COPYHEADER on 64-bit hosts) */
+#define IP_REASS_MAX_PBUFS              16
+#define IP_REASS_MAX_PBUFS_PER_SOURCE   9
+#define IP_REASS_HASH_SIZE              4
+#define IPV6_FRAG_COPYHEADER            1
+
+/* Test slicing fragments from one batch allocation */
+#define IP_FRAG_BATCH                   1
+
 #define MEMP_NUM_SYS_TIMEOUT            (LWIP_NUM_SYS_TIMEOUT_INTERNAL + 8)
 
 /* MIB2 stats are required to check IPv4 reassembly results */
@@ -6,6 +6,9 @@
 #include "lwip/inet.h"
 #include "lwip/inet_chksum.h"
 #include "lwip/ip_addr.h"
+#include "lwip/timeouts.h"
+#include "lwip/ip4_fib.h"
+#include "arch/sys_arch.h"
 
 #if !LWIP_STATS || !TCP_STATS || !MEMP_STATS
 #error "This tests needs TCP- and MEMP-statistics enabled"
@@ -33,10 +36,19 @@ tcp_remove(struct tcp_pcb* pcb_list)
 void
 tcp_remove_all(void)
 {
+  /* test netifs are linked into netif_list directly (not via netif_add()/
+     netif_remove()), so don't let aborted pcbs use stale cached routes */
+  IP4_FIB_CACHE_FLUSH();
   tcp_remove(tcp_listen_pcbs.pcbs);
   tcp_remove(tcp_bound_pcbs);
   tcp_remove(tcp_active_pcbs);
   tcp_remove(tcp_tw_pcbs);
+#if LWIP_TCP_TW_BUCKETS
+  while (tcp_tw_buckets != NULL) {
+    tcp_tw_remove(tcp_tw_buckets);
+  }
+  fail_unless(MEMP_STATS_GET(used, MEMP_TCP_TW) == 0);
+#endif /* LWIP_TCP_TW_BUCKETS */
   fail_unless(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
   fail_unless(MEMP_STATS_GET(used, MEMP_TCP_PCB_LISTEN) == 0);
   fail_unless(MEMP_STATS_GET(used, MEMP_TCP_SEG) == 0);
@@ -45,23 +57,26 @@ tcp_remove_all(void)
 
 /** Create a TCP segment usable for passing to tcp_input */
 static struct pbuf*
-tcp_create_segment_wnd(ip_addr_t* src_ip, ip_addr_t* dst_ip,
+tcp_create_segment_opt(ip_addr_t* src_ip, ip_addr_t* dst_ip,
                    u16_t src_port, u16_t dst_port, void* data, size_t data_len,
-                   u32_t seqno, u32_t ackno, u8_t headerflags, u16_t wnd)
+                   u32_t seqno, u32_t ackno, u8_t headerflags, u16_t wnd,
+                   const u8_t* opts, u8_t optlen)
 {
   struct pbuf *p, *q;
   struct ip_hdr* iphdr;
   struct tcp_hdr* tcphdr;
-  u16_t pbuf_len = (u16_t)(sizeof(struct ip_hdr) + sizeof(struct tcp_hdr) + data_len);
+  u16_t hdr_len = (u16_t)(sizeof(struct tcp_hdr) + optlen);
+  u16_t pbuf_len = (u16_t)(sizeof(struct ip_hdr) + hdr_len + data_len);
   LWIP_ASSERT("data_len too big", data_len <= 0xFFFF);
+  LWIP_ASSERT("optlen must be a multiple of 4", (optlen & 3) == 0);
 
   p = pbuf_alloc(PBUF_RAW, pbuf_len, PBUF_POOL);
   EXPECT_RETNULL(p != NULL);
   /* first pbuf must be big enough to hold the headers */
-  EXPECT_RETNULL(p->len >= (sizeof(struct ip_hdr) + sizeof(struct tcp_hdr)));
+  EXPECT_RETNULL(p->len >= (sizeof(struct ip_hdr) + hdr_len));
   if (data_len > 0) {
     /* first pbuf must be big enough to hold at least 1 data byte, too */
-    EXPECT_RETNULL(p->len > (sizeof(struct ip_hdr) + sizeof(struct tcp_hdr)));
+    EXPECT_RETNULL(p->len > (sizeof(struct ip_hdr) + hdr_len));
   }
 
   for(q = p; q != NULL; q = q->next) {
@@ -75,6 +90,8 @@ tcp_create_segment_wnd(ip_addr_t* src_ip, ip_addr_t* dst_ip,
   IPH_VHL_SET(iphdr, 4, IP_HLEN / 4);
   IPH_TOS_SET(iphdr, 0);
   IPH_LEN_SET(iphdr, htons(p->tot_len));
+  IPH_TTL_SET(iphdr, 64);
+  IPH_PROTO_SET(iphdr, IP_PROTO_TCP);
   IPH_CHKSUM_SET(iphdr, inet_chksum(iphdr, IP_HLEN));
 
   /* let p point to TCP header */
@@ -85,17 +102,20 @@ tcp_create_segment_wnd(ip_addr_t* src_ip, ip_addr_t* dst_ip,
   tcphdr->dest  = htons(dst_port);
   tcphdr->seqno = htonl(seqno);
   tcphdr->ackno = htonl(ackno);
-  TCPH_HDRLEN_SET(tcphdr, sizeof(struct tcp_hdr)/4);
+  TCPH_HDRLEN_SET(tcphdr, hdr_len/4);
   TCPH_FLAGS_SET(tcphdr, headerflags);
   tcphdr->wnd   = htons(wnd);
+  if (optlen > 0) {
+    MEMCPY(tcphdr + 1, opts, optlen);
+  }
 
   if (data_len > 0) {
     /* let p point to TCP data */
-    pbuf_header(p, -(s16_t)sizeof(struct tcp_hdr));
+    pbuf_header(p, -(s16_t)hdr_len);
     /* copy data */
     pbuf_take(p, data, (u16_t)data_len);
     /* let p point to TCP header again */
-    pbuf_header(p, sizeof(struct tcp_hdr));
+    pbuf_header(p, hdr_len);
   }
 
   /* calculate checksum */
@@ -108,6 +128,16 @@ tcp_create_segment_wnd(ip_addr_t* src_ip, ip_addr_t* dst_ip,
   return p;
 }
 
+/** Create a TCP segment without options usable for passing to tcp_input */
+static struct pbuf*
+tcp_create_segment_wnd(ip_addr_t* src_ip, ip_addr_t* dst_ip,
+                   u16_t src_port, u16_t dst_port, void* data, size_t data_len,
+                   u32_t seqno, u32_t ackno, u8_t headerflags, u16_t wnd)
+{
+  return tcp_create_segment_opt(src_ip, dst_ip, src_port, dst_port, data,
+    data_len, seqno, ackno, headerflags, wnd, NULL, 0);
+}
+
 /** Create a TCP segment usable for passing to tcp_input */
 struct pbuf*
 tcp_create_segment(ip_addr_t* src_ip, ip_addr_t* dst_ip,
@@ -142,6 +172,32 @@ struct pbuf* tcp_create_rx_segment_wnd(struct tcp_pcb* pcb, void* data, size_t d
     data, data_len, pcb->rcv_nxt + seqno_offset, pcb->lastack + ackno_offset, headerflags, wnd);
 }
 
+/** Create an ACK carrying a SACK option usable for passing to tcp_input
+ * - IP-addresses, ports, seqno and ackno are taken from pcb
+ * - ackno can be altered with an offset
+ * - edges holds num_blocks pairs of absolute left/right sequence numbers
+ */
+struct pbuf* tcp_create_rx_ack_sack(struct tcp_pcb* pcb, u32_t ackno_offset,
+                   const u32_t* edges, u8_t num_blocks)
+{
+  u8_t opts[40];
+  u8_t i, optlen = 0;
+  LWIP_ASSERT("too many SACK blocks", num_blocks <= 4);
+
+  opts[optlen++] = 1; /* NOP */
+  opts[optlen++] = 1; /* NOP */
+  opts[optlen++] = 5; /* SACK */
+  opts[optlen++] = (u8_t)(2 + 8 * num_blocks);
+  for (i = 0; i < 2 * num_blocks; i++) {
+    opts[optlen++] = (u8_t)(edges[i] >> 24);
+    opts[optlen++] = (u8_t)(edges[i] >> 16);
+    opts[optlen++] = (u8_t)(edges[i] >> 8);
+    opts[optlen++] = (u8_t)edges[i];
+  }
+  return tcp_create_segment_opt(&pcb->remote_ip, &pcb->local_ip, pcb->remote_port, pcb->local_port,
+    NULL, 0, pcb->rcv_nxt, pcb->lastack + ackno_offset, TCP_ACK, TCP_WND, opts, optlen);
+}
+
 /** Safely bring a tcp_pcb into the requested state */
 void
 tcp_set_state(struct tcp_pcb* pcb, enum tcp_state state, const ip_addr_t* local_ip,
@@ -159,22 +215,23 @@ tcp_set_state(struct tcp_pcb* pcb, enum tcp_state state, const ip_addr_t* local_
   pcb->lastack = iss;
   pcb->snd_lbb = iss;
   
+  /* addresses and ports must be set before registering (pcb hash key) */
   if (state == ESTABLISHED) {
-    TCP_REG(&tcp_active_pcbs, pcb);
     ip_addr_copy(pcb->local_ip, *local_ip);
     pcb->local_port = local_port;
     ip_addr_copy(pcb->remote_ip, *remote_ip);
     pcb->remote_port = remote_port;
+    TCP_REG(&tcp_active_pcbs, pcb);
   } else if(state == LISTEN) {
-    TCP_REG(&tcp_listen_pcbs.pcbs, pcb);
     ip_addr_copy(pcb->local_ip, *local_ip);
     pcb->local_port = local_port;
+    TCP_REG(&tcp_listen_pcbs.pcbs, pcb);
   } else if(state == TIME_WAIT) {
-    TCP_REG(&tcp_tw_pcbs, pcb);
     ip_addr_copy(pcb->local_ip, *local_ip);
     pcb->local_port = local_port;
     ip_addr_copy(pcb->remote_ip, *remote_ip);
     pcb->remote_port = remote_port;
+    TCP_REG(&tcp_tw_pcbs, pcb);
   } else {
     fail();
   }
@@ -259,6 +316,7 @@ void test_tcp_input(struct pbuf *p, struct netif *inp)
   ip_addr_copy_from_ip4(*ip_current_dest_addr(), iphdr->dest);
   ip_addr_copy_from_ip4(*ip_current_src_addr(), iphdr->src);
   ip_current_netif() = inp;
+  ip_current_input_netif() = inp;
   ip_data.current_ip4_header = iphdr;
 
   /* since adding IPv6, p->payload must point to tcp header, not ip header */
@@ -269,6 +327,7 @@ void test_tcp_input(struct pbuf *p, struct netif *inp)
   ip_addr_set_zero(ip_current_dest_addr());
   ip_addr_set_zero(ip_current_src_addr());
   ip_current_netif() = NULL;
+  ip_current_input_netif() = NULL;
   ip_data.current_ip4_header = NULL;
 }
 
@@ -317,4 +376,46 @@ void test_tcp_init_netif(struct netif *netif, struct test_tcp_txcounters *txcoun
   }
   netif->next = NULL;
   netif_list = netif;
+  IP4_FIB_CACHE_FLUSH();
+}
+
+#if LWIP_TCP_PCB_TIMERS
+static struct sys_timeo *test_tcp_old_timeouts;
+
+/** Park all timeouts (i.e. the cyclic timers) so that sys_check_timeouts()
+ * only runs the timers of the pcbs created by a test */
+void
+test_tcp_timers_setup(void)
+{
+#if LWIP_TIMERS_WHEEL
+  test_tcp_old_timeouts = sys_timeouts_take_all();
+#else
+  struct sys_timeo **list_head = sys_timeouts_get_next_timeout();
+  test_tcp_old_timeouts = *list_head;
+  *list_head = NULL;
+#endif
+}
+
+/** Restore the timeouts parked by test_tcp_timers_setup(), all pcbs must
+ * have been freed (which stops their timers) */
+void
+test_tcp_timers_teardown(void)
+{
+#if LWIP_TIMERS_WHEEL
+  fail_unless(sys_timeouts_take_all() == NULL);
+  sys_timeouts_put_all(test_tcp_old_timeouts);
+#else
+  struct sys_timeo **list_head = sys_timeouts_get_next_timeout();
+  fail_unless(*list_head == NULL);
+  *list_head = test_tcp_old_timeouts;
+#endif
+}
+
+/** Advance the time by 'msecs' and run the pcb timers that are due */
+void
+test_tcp_timers_run(u32_t msecs)
+{
+  lwip_sys_now += msecs;
+  sys_check_timeouts();
 }
+#endif /* LWIP_TCP_PCB_TIMERS */
@@ -5,6 +5,10 @@
 #include "lwip/inet.h"
 #include "tcp_helper.h"
 #include "lwip/inet_chksum.h"
+#include "arch/sys_arch.h"
+
+#include <stdio.h>
+#include <time.h>
 
 #ifdef _MSC_VER
 #pragma warning(disable: 4307) /* we explicitly wrap around TCP seqnos */
@@ -28,6 +32,30 @@ static u32_t seqnos[] = {
     SEQNO1 + (4 * TCP_MSS),
     SEQNO1 + (5 * TCP_MSS) };
 
+#if LWIP_TCP_PCB_TIMERS
+/* tcp_now() is sys_now() with per-pcb timers */
+#define test_tcp_ticks lwip_sys_now
+/* test_tcp_tmr() calls until a timer of 'ticks' slow intervals expires */
+#define TEST_TCP_TMR_CALLS(ticks) ((ticks) * (TCP_SLOW_INTERVAL / TCP_TMR_INTERVAL))
+
+/* one tcp_tmr() interval passes, the pcb timers that are due fire */
+static void
+test_tcp_tmr(void)
+{
+  test_tcp_timers_run(TCP_TMR_INTERVAL);
+}
+
+/* run the RACK timers that are due */
+static void
+test_tcp_fasttmr(void)
+{
+  test_tcp_timers_run(0);
+}
+#else /* LWIP_TCP_PCB_TIMERS */
+#define test_tcp_ticks tcp_ticks
+/* the slow timer runs on the first and then on every 2nd test_tcp_tmr() */
+#define TEST_TCP_TMR_CALLS(ticks) ((ticks) * (TCP_SLOW_INTERVAL / TCP_TMR_INTERVAL) - 1)
+
 static u8_t test_tcp_timer;
 
 /* our own version of tcp_tmr so we can reset fast/slow timer state */
@@ -40,9 +68,19 @@ test_tcp_tmr(void)
   }
 }
 
+static void
+test_tcp_fasttmr(void)
+{
+  tcp_fasttmr();
+}
+#endif /* LWIP_TCP_PCB_TIMERS */
+
 /* Setups/teardown functions */
 static struct netif *old_netif_list;
 static struct netif *old_netif_default;
+#if LWIP_TCP_PCB_TIMERS
+static u32_t old_sys_now;
+#endif /* LWIP_TCP_PCB_TIMERS */
 
 static void
 tcp_setup(void)
@@ -53,13 +91,20 @@ tcp_setup(void)
   old_netif_default = netif_default;
   netif_list = NULL;
   netif_default = NULL;
+#if LWIP_TCP_PCB_TIMERS
+  old_sys_now = lwip_sys_now;
+#endif /* LWIP_TCP_PCB_TIMERS */
   /* reset iss to default (6510) */
-  tcp_ticks = 0;
-  tcp_ticks = 0 - (tcp_next_iss(&dummy_pcb) - 6510);
+  test_tcp_ticks = 0;
+  test_tcp_ticks = 0 - (tcp_next_iss(&dummy_pcb) - 6510);
   tcp_next_iss(&dummy_pcb);
-  tcp_ticks = 0;
+  test_tcp_ticks = 0;
 
+#if LWIP_TCP_PCB_TIMERS
+  test_tcp_timers_setup();
+#else /* LWIP_TCP_PCB_TIMERS */
   test_tcp_timer = 0;
+#endif /* LWIP_TCP_PCB_TIMERS */
   tcp_remove_all();
   lwip_check_ensure_no_alloc(SKIP_POOL(MEMP_SYS_TIMEOUT));
 }
@@ -70,6 +115,10 @@ tcp_teardown(void)
   netif_list = NULL;
   netif_default = NULL;
   tcp_remove_all();
+#if LWIP_TCP_PCB_TIMERS
+  test_tcp_timers_teardown();
+  lwip_sys_now = old_sys_now;
+#endif /* LWIP_TCP_PCB_TIMERS */
   /* restore netif_list for next tests (e.g. loopif) */
   netif_list = old_netif_list;
   netif_default = old_netif_default;
@@ -646,7 +695,7 @@ START_TEST(test_tcp_fast_rexmit_wraparound)
   memset(&counters, 0, sizeof(counters));
 
   /* create and initialize the pcb */
-  tcp_ticks = SEQNO1 - ISS;
+  test_tcp_ticks = SEQNO1 - ISS;
   pcb = test_tcp_new_counters_pcb(&counters);
   EXPECT_RET(pcb != NULL);
   tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
@@ -711,6 +760,694 @@ START_TEST(test_tcp_fast_rexmit_wraparound)
 }
 END_TEST
 
+#if LWIP_TCP_SACK_IN
+/** Return the seqno of the idx'th full-sized segment in txcounters->tx_packets */
+static u32_t
+get_tx_seqno(struct test_tcp_txcounters *txcounters, u16_t idx)
+{
+  u32_t seqno = 0;
+  u16_t ret = pbuf_copy_partial(txcounters->tx_packets, &seqno, 4,
+                                (u16_t)(idx * (TCP_MSS + 40U) + 24U));
+  EXPECT(ret == 4);
+  return lwip_ntohl(seqno);
+}
+
+/** Lose several segments of one window and check that SACK loss recovery
+ * repairs all holes without waiting for an RTO or a partial ACK per hole. */
+START_TEST(test_tcp_sack_rexmit_holes)
+{
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb* pcb;
+  struct pbuf* p;
+  err_t err;
+  u32_t base, edges[6];
+  u16_t i;
+  LWIP_UNUSED_ARG(_i);
+
+  for (i = 0; i < sizeof(tx_data); i++) {
+    tx_data[i] = (u8_t)i;
+  }
+
+  /* initialize local vars */
+  test_tcp_init_netif(&netif, &txcounters, &test_local_ip, &test_netmask);
+  memset(&counters, 0, sizeof(counters));
+
+  /* create and initialize the pcb */
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  pcb->mss = TCP_MSS;
+  pcb->cwnd = 10 * TCP_MSS;
+  /* SACK permitted by the peer */
+  tcp_set_flags(pcb, TF_SACK);
+  base = pcb->snd_nxt;
+
+  /* send 10 mss-sized segments: 1, 4 and 7 are lost */
+  for (i = 0; i < 10; i++) {
+    err = tcp_write(pcb, tx_data, TCP_MSS, TCP_WRITE_FLAG_COPY);
+    EXPECT_RET(err == ERR_OK);
+  }
+  err = tcp_output(pcb);
+  EXPECT_RET(err == ERR_OK);
+  EXPECT(txcounters.num_tx_calls == 10);
+  memset(&txcounters, 0, sizeof(txcounters));
+  /* ACKs arrive one RTT later (RACK must not mark the holes lost at once) */
+  lwip_sys_now += 100;
+
+  /* ACK the first segment */
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, TCP_MSS, TCP_ACK);
+  test_tcp_input(p, &netif);
+  EXPECT(txcounters.num_tx_calls == 0);
+
+  /* 1st dupack: segments 2 and 3 arrived, not enough to call 1 lost */
+  edges[0] = base + 2 * TCP_MSS;
+  edges[1] = base + 4 * TCP_MSS;
+  p = tcp_create_rx_ack_sack(pcb, 0, edges, 1);
+  test_tcp_input(p, &netif);
+  EXPECT(txcounters.num_tx_calls == 0);
+  EXPECT(!(pcb->flags & TF_INFR));
+
+  /* 2nd dupack: 4 segments SACKed above segment 1 -> recovery starts
+     before the 3rd dupack and segment 1 is retransmitted */
+  edges[2] = base + 5 * TCP_MSS;
+  edges[3] = base + 7 * TCP_MSS;
+  txcounters.copy_tx_packets = 1;
+  p = tcp_create_rx_ack_sack(pcb, 0, edges, 2);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->flags & TF_INFR);
+  EXPECT(pcb->cwnd == pcb->ssthresh);
+  EXPECT(txcounters.num_tx_calls == 1);
+  if (txcounters.tx_packets != NULL) {
+    EXPECT(get_tx_seqno(&txcounters, 0) == base + 1 * TCP_MSS);
+    pbuf_free(txcounters.tx_packets);
+  }
+  memset(&txcounters, 0, sizeof(txcounters));
+
+  /* 3rd dupack: segments 8 and 9 arrived, too. Segment 4 is now lost and
+     segment 7 is the last hole below SACKed data: both are retransmitted */
+  edges[4] = base + 8 * TCP_MSS;
+  edges[5] = base + 10 * TCP_MSS;
+  txcounters.copy_tx_packets = 1;
+  p = tcp_create_rx_ack_sack(pcb, 0, edges, 3);
+  test_tcp_input(p, &netif);
+  EXPECT(txcounters.num_tx_calls == 2);
+  if (txcounters.tx_packets != NULL) {
+    EXPECT(get_tx_seqno(&txcounters, 0) == base + 4 * TCP_MSS);
+    EXPECT(get_tx_seqno(&txcounters, 1) == base + 7 * TCP_MSS);
+    pbuf_free(txcounters.tx_packets);
+  }
+  memset(&txcounters, 0, sizeof(txcounters));
+
+  /* further dupacks don't send anything again */
+  p = tcp_create_rx_ack_sack(pcb, 0, edges, 3);
+  test_tcp_input(p, &netif);
+  EXPECT(txcounters.num_tx_calls == 0);
+  /* all holes were repaired before the retransmission timer fired */
+  EXPECT(pcb->nrtx == 1);
+
+  /* a partial ACK (up to the hole at segment 4) keeps recovery going */
+  p = tcp_create_rx_ack_sack(pcb, 3 * TCP_MSS, &edges[2], 2);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->flags & TF_INFR);
+  EXPECT(txcounters.num_tx_calls == 0);
+
+  /* ACK everything: recovery ends */
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, 6 * TCP_MSS, TCP_ACK);
+  test_tcp_input(p, &netif);
+  EXPECT(!(pcb->flags & TF_INFR));
+  EXPECT(pcb->unacked == NULL);
+  EXPECT(pcb->cwnd >= pcb->ssthresh);
+  EXPECT(counters.err_calls == 0);
+
+  /* make sure the pcb is freed */
+  EXPECT_RET(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 1);
+  tcp_abort(pcb);
+  EXPECT_RET(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
+}
+END_TEST
+#endif /* LWIP_TCP_SACK_IN */
+
+#if LWIP_TCP_RACK
+/** Lose the last two segments of a response: no dupacks arrive, so only the
+ * Tail Loss Probe followed by RACK loss detection can repair this without
+ * waiting for the RTO. */
+START_TEST(test_tcp_rack_tail_loss_probe)
+{
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb* pcb;
+  struct pbuf* p;
+  err_t err;
+  u32_t base, start, edges[2];
+  u16_t i;
+  LWIP_UNUSED_ARG(_i);
+
+  /* initialize local vars */
+  test_tcp_init_netif(&netif, &txcounters, &test_local_ip, &test_netmask);
+  memset(&counters, 0, sizeof(counters));
+
+  /* create and initialize the pcb */
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  pcb->mss = TCP_MSS;
+  pcb->cwnd = 10 * TCP_MSS;
+  tcp_set_flags(pcb, TF_SACK);
+  base = pcb->snd_nxt;
+
+  /* one segment to get an RTT sample of 20 ms */
+  err = tcp_write(pcb, tx_data, TCP_MSS, TCP_WRITE_FLAG_COPY);
+  EXPECT_RET(err == ERR_OK);
+  EXPECT_RET(tcp_output(pcb) == ERR_OK);
+  lwip_sys_now += 20;
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, TCP_MSS, TCP_ACK);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->rack_flags & TCP_RACK_F_RTT);
+  EXPECT(pcb->rack_srtt == 20);
+  EXPECT(pcb->unacked == NULL);
+  EXPECT(pcb->rack_timer == TCP_RACK_TIMER_NONE);
+  memset(&txcounters, 0, sizeof(txcounters));
+
+  /* send 4 segments, the last two are lost */
+  for (i = 0; i < 4; i++) {
+    err = tcp_write(pcb, tx_data, TCP_MSS, TCP_WRITE_FLAG_COPY);
+    EXPECT_RET(err == ERR_OK);
+  }
+  EXPECT_RET(tcp_output(pcb) == ERR_OK);
+  EXPECT(txcounters.num_tx_calls == 4);
+  memset(&txcounters, 0, sizeof(txcounters));
+  start = lwip_sys_now;
+
+  /* the first two are ACKed: the probe is scheduled 2 * srtt later */
+  lwip_sys_now += 20;
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, 2 * TCP_MSS, TCP_ACK);
+  test_tcp_input(p, &netif);
+  EXPECT(txcounters.num_tx_calls == 0);
+  EXPECT(pcb->rack_timer == TCP_RACK_TIMER_TLP);
+  EXPECT(pcb->rack_deadline == lwip_sys_now + 40);
+
+  lwip_sys_now += 39;
+  test_tcp_fasttmr();
+  EXPECT(txcounters.num_tx_calls == 0);
+
+  /* PTO expired: the last segment is retransmitted as probe */
+  lwip_sys_now += 1;
+  txcounters.copy_tx_packets = 1;
+  test_tcp_fasttmr();
+  EXPECT(txcounters.num_tx_calls == 1);
+  EXPECT(pcb->rack_flags & TCP_RACK_F_TLP);
+  if (txcounters.tx_packets != NULL) {
+    EXPECT(get_tx_seqno(&txcounters, 0) == base + 4 * TCP_MSS);
+    pbuf_free(txcounters.tx_packets);
+  }
+  memset(&txcounters, 0, sizeof(txcounters));
+
+  /* the probe is SACKed: RACK marks the segment before it lost and
+     recovery retransmits it */
+  lwip_sys_now += 20;
+  edges[0] = base + 4 * TCP_MSS;
+  edges[1] = base + 5 * TCP_MSS;
+  txcounters.copy_tx_packets = 1;
+  p = tcp_create_rx_ack_sack(pcb, 0, edges, 1);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->flags & TF_INFR);
+  EXPECT(txcounters.num_tx_calls == 1);
+  if (txcounters.tx_packets != NULL) {
+    EXPECT(get_tx_seqno(&txcounters, 0) == base + 3 * TCP_MSS);
+    pbuf_free(txcounters.tx_packets);
+  }
+  memset(&txcounters, 0, sizeof(txcounters));
+
+  /* everything is ACKed long before the RTO would have fired */
+  lwip_sys_now += 20;
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, 2 * TCP_MSS, TCP_ACK);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->unacked == NULL);
+  EXPECT(!(pcb->flags & TF_INFR));
+  EXPECT(pcb->rack_timer == TCP_RACK_TIMER_NONE);
+  EXPECT(lwip_sys_now - start < (u32_t)pcb->rto * TCP_TICK_MS);
+  EXPECT(counters.err_calls == 0);
+
+  tcp_abort(pcb);
+  EXPECT_RET(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
+}
+END_TEST
+
+/** A hole is only marked lost by RACK once the reordering window passed:
+ * reordered segments are not retransmitted, lost ones are. */
+START_TEST(test_tcp_rack_reordering_window)
+{
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb* pcb;
+  struct pbuf* p;
+  err_t err;
+  u32_t base, edges[2];
+  u16_t i;
+  LWIP_UNUSED_ARG(_i);
+
+  /* initialize local vars */
+  test_tcp_init_netif(&netif, &txcounters, &test_local_ip, &test_netmask);
+  memset(&counters, 0, sizeof(counters));
+
+  /* create and initialize the pcb */
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  pcb->mss = TCP_MSS;
+  pcb->cwnd = 10 * TCP_MSS;
+  tcp_set_flags(pcb, TF_SACK);
+  base = pcb->snd_nxt;
+
+  for (i = 0; i < 4; i++) {
+    err = tcp_write(pcb, tx_data, TCP_MSS, TCP_WRITE_FLAG_COPY);
+    EXPECT_RET(err == ERR_OK);
+  }
+  EXPECT_RET(tcp_output(pcb) == ERR_OK);
+  EXPECT(txcounters.num_tx_calls == 4);
+  memset(&txcounters, 0, sizeof(txcounters));
+
+  /* segment 1 overtakes segment 0: RACK waits min_rtt / 4 = 5 ms */
+  lwip_sys_now += 20;
+  edges[0] = base + 1 * TCP_MSS;
+  edges[1] = base + 2 * TCP_MSS;
+  p = tcp_create_rx_ack_sack(pcb, 0, edges, 1);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->rack_timer == TCP_RACK_TIMER_REO);
+  EXPECT(pcb->rack_deadline == lwip_sys_now + 5);
+  EXPECT(txcounters.num_tx_calls == 0);
+
+  /* segment 0 arrives within the reordering window */
+  lwip_sys_now += 3;
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, 2 * TCP_MSS, TCP_ACK);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->rack_timer != TCP_RACK_TIMER_REO);
+  lwip_sys_now += 5;
+  test_tcp_fasttmr();
+  EXPECT(txcounters.num_tx_calls == 0);
+
+  /* segment 3 arrives, segment 2 doesn't: retransmitted after the window */
+  edges[0] = base + 3 * TCP_MSS;
+  edges[1] = base + 4 * TCP_MSS;
+  p = tcp_create_rx_ack_sack(pcb, 0, edges, 1);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->rack_timer == TCP_RACK_TIMER_REO);
+  EXPECT(txcounters.num_tx_calls == 0);
+  lwip_sys_now += 4;
+  test_tcp_fasttmr();
+  EXPECT(txcounters.num_tx_calls == 0);
+  lwip_sys_now += 1;
+  txcounters.copy_tx_packets = 1;
+  test_tcp_fasttmr();
+  EXPECT(txcounters.num_tx_calls == 1);
+  EXPECT(pcb->flags & TF_INFR);
+  if (txcounters.tx_packets != NULL) {
+    EXPECT(get_tx_seqno(&txcounters, 0) == base + 2 * TCP_MSS);
+    pbuf_free(txcounters.tx_packets);
+  }
+  memset(&txcounters, 0, sizeof(txcounters));
+  EXPECT(counters.err_calls == 0);
+
+  tcp_abort(pcb);
+  EXPECT_RET(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
+}
+END_TEST
+#endif /* LWIP_TCP_RACK */
+
+#if LWIP_TCP_WRITE_REF
+static u8_t write_ref_buf[3 * TCP_MSS];
+static int write_ref_free_calls;
+
+static void
+write_ref_free(struct pbuf *p)
+{
+  LWIP_UNUSED_ARG(p);
+  write_ref_free_calls++;
+}
+
+static struct pbuf *
+write_ref_wrap(struct pbuf_custom *pc)
+{
+  struct pbuf *p;
+  pc->custom_free_function = write_ref_free;
+  p = pbuf_alloced_custom(PBUF_RAW, sizeof(write_ref_buf), PBUF_REF, pc,
+                          write_ref_buf, sizeof(write_ref_buf));
+  fail_unless(p != NULL);
+  return p;
+}
+
+/** Data written with tcp_write_ref() is not copied and the referenced
+ * buffer is released exactly once: after all of its data is ACKed or
+ * when the connection is aborted. */
+START_TEST(test_tcp_write_ref_completion)
+{
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb* pcb;
+  struct pbuf_custom pc;
+  struct pbuf* ref;
+  struct pbuf* p;
+  err_t err;
+  LWIP_UNUSED_ARG(_i);
+
+  /* initialize local vars */
+  test_tcp_init_netif(&netif, &txcounters, &test_local_ip, &test_netmask);
+  memset(&counters, 0, sizeof(counters));
+  write_ref_free_calls = 0;
+
+  /* create and initialize the pcb */
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  pcb->mss = TCP_MSS;
+  pcb->cwnd = 10 * TCP_MSS;
+
+  /* one reference per segment, the caller's reference can be dropped */
+  ref = write_ref_wrap(&pc);
+  err = tcp_write_ref(pcb, ref->payload, ref->len, 0, ref);
+  EXPECT_RET(err == ERR_OK);
+  pbuf_free(ref);
+  EXPECT(write_ref_free_calls == 0);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PBUF_REF) == 3);
+  EXPECT_RET(tcp_output(pcb) == ERR_OK);
+  EXPECT(txcounters.num_tx_calls == 3);
+  EXPECT(txcounters.num_tx_bytes == 3 * (TCP_MSS + 40U));
+
+  /* partial ACKs don't complete the write */
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, 2 * TCP_MSS, TCP_ACK);
+  test_tcp_input(p, &netif);
+  EXPECT(write_ref_free_calls == 0);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PBUF_REF) == 1);
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, TCP_MSS, TCP_ACK);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->unacked == NULL);
+  EXPECT(write_ref_free_calls == 1);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PBUF_REF) == 0);
+
+  /* adjacent writes are chained, not merged into one reference */
+  ref = write_ref_wrap(&pc);
+  err = tcp_write_ref(pcb, write_ref_buf, 100, TCP_WRITE_FLAG_MORE, ref);
+  EXPECT_RET(err == ERR_OK);
+  err = tcp_write_ref(pcb, write_ref_buf + 100, 100, 0, ref);
+  EXPECT_RET(err == ERR_OK);
+  pbuf_free(ref);
+  EXPECT(pcb->unsent != NULL && pcb->unsent->next == NULL);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PBUF_REF) == 2);
+  EXPECT(write_ref_free_calls == 1);
+  EXPECT_RET(tcp_output(pcb) == ERR_OK);
+
+  /* aborting the connection releases the buffer, too */
+  tcp_abort(pcb);
+  EXPECT(write_ref_free_calls == 2);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PBUF_REF) == 0);
+  EXPECT(counters.err_calls == 1);
+  EXPECT_RET(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
+}
+END_TEST
+#endif /* LWIP_TCP_WRITE_REF */
+
+#if LWIP_NETIF_TSO
+/** Return the number of segments on the unacked queue */
+static u16_t
+count_unacked(const struct tcp_pcb *pcb)
+{
+  const struct tcp_seg *seg;
+  u16_t n = 0;
+  for (seg = pcb->unacked; seg != NULL; seg = seg->next) {
+    n++;
+  }
+  return n;
+}
+
+/** Check the idx'th full-sized packet in txcounters->tx_packets: return its
+ * TCP flags if seqno, IP and TCP checksums are as expected, 0xffff if not */
+static u16_t
+check_tx_packet(struct test_tcp_txcounters *txcounters, u16_t idx, u32_t seqno)
+{
+  u8_t pkt[TCP_MSS + 40];
+  struct ip_hdr *iphdr = (struct ip_hdr *)pkt;
+  struct tcp_hdr *tcphdr = (struct tcp_hdr *)(pkt + 20);
+  ip4_addr_t src, dest;
+  struct pbuf *p;
+  u16_t chksum;
+
+  if (pbuf_copy_partial(txcounters->tx_packets, pkt, sizeof(pkt),
+                        (u16_t)(idx * sizeof(pkt))) != sizeof(pkt)) {
+    return 0xffff;
+  }
+  if ((lwip_ntohs(IPH_LEN(iphdr)) != sizeof(pkt)) || (inet_chksum(pkt, 20) != 0) ||
+      (lwip_ntohl(tcphdr->seqno) != seqno)) {
+    return 0xffff;
+  }
+  ip4_addr_copy(src, iphdr->src);
+  ip4_addr_copy(dest, iphdr->dest);
+  p = pbuf_alloc(PBUF_RAW, sizeof(pkt) - 20, PBUF_ROM);
+  fail_unless(p != NULL);
+  ((struct pbuf_rom *)p)->payload = tcphdr;
+  chksum = inet_chksum_pseudo(p, IP_PROTO_TCP, p->tot_len, &src, &dest);
+  pbuf_free(p);
+  return (chksum == 0) ? TCPH_FLAGS(tcphdr) : 0xffff;
+}
+
+/** Full-sized segments are sent as one super-segment to netifs supporting
+ * TSO and are split up in software (GSO) for all other netifs. */
+START_TEST(test_tcp_tso_gso)
+{
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb* pcb;
+  struct pbuf* p;
+  err_t err;
+  u32_t base;
+  u16_t i;
+  LWIP_UNUSED_ARG(_i);
+
+  /* initialize local vars */
+  test_tcp_init_netif(&netif, &txcounters, &test_local_ip, &test_netmask);
+  memset(&counters, 0, sizeof(counters));
+
+  /* create and initialize the pcb */
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  pcb->mss = TCP_MSS;
+  pcb->cwnd = 10 * TCP_MSS;
+  base = pcb->snd_nxt;
+
+  /* software GSO: one packet per segment with valid checksums,
+     PSH only on the last one */
+  err = tcp_write(pcb, tx_data, 4 * TCP_MSS, TCP_WRITE_FLAG_COPY);
+  EXPECT_RET(err == ERR_OK);
+  txcounters.copy_tx_packets = 1;
+  EXPECT_RET(tcp_output(pcb) == ERR_OK);
+  EXPECT(txcounters.num_tx_calls == 4);
+  EXPECT(txcounters.num_tx_bytes == 4 * (TCP_MSS + 40U));
+  EXPECT(pcb->unsent == NULL);
+  EXPECT(pcb->snd_nxt == base + 4 * TCP_MSS);
+  if (txcounters.tx_packets != NULL) {
+    for (i = 0; i < 4; i++) {
+      u16_t flags = check_tx_packet(&txcounters, i, base + i * TCP_MSS);
+      EXPECT(flags == ((i == 3) ? (TCP_ACK | TCP_PSH) : TCP_ACK));
+    }
+    pbuf_free(txcounters.tx_packets);
+    txcounters.tx_packets = NULL;
+  }
+  txcounters.copy_tx_packets = 0;
+
+  /* TSO netif: one super-segment, but still one tcp_seg per MSS */
+  netif.flags |= NETIF_FLAG_TSO;
+  memset(&txcounters, 0, sizeof(txcounters));
+  err = tcp_write(pcb, tx_data, 4 * TCP_MSS, TCP_WRITE_FLAG_COPY);
+  EXPECT_RET(err == ERR_OK);
+  EXPECT_RET(tcp_output(pcb) == ERR_OK);
+  EXPECT(txcounters.num_tx_calls == 1);
+  EXPECT(txcounters.num_tx_bytes == 40U + 4 * TCP_MSS);
+  EXPECT(pcb->snd_nxt == base + 8 * TCP_MSS);
+  EXPECT(count_unacked(pcb) == 8);
+
+  /* a partial ACK frees only the acknowledged segments */
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, 6 * TCP_MSS, TCP_ACK);
+  test_tcp_input(p, &netif);
+  EXPECT(count_unacked(pcb) == 2);
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, 2 * TCP_MSS, TCP_ACK);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->unacked == NULL);
+  EXPECT(counters.err_calls == 0);
+
+  tcp_abort(pcb);
+  EXPECT_RET(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
+}
+END_TEST
+
+static struct pbuf *tso_held[8];
+static u16_t tso_held_num;
+
+/** netif->output of a driver with deferred transmission: keeps the packets */
+static err_t
+tso_hold_output(struct netif *netif, struct pbuf *p, const ip4_addr_t *ipaddr)
+{
+  LWIP_UNUSED_ARG(netif);
+  LWIP_UNUSED_ARG(ipaddr);
+  EXPECT_RETX(tso_held_num < LWIP_ARRAYSIZE(tso_held), ERR_MEM);
+  pbuf_ref(p);
+  tso_held[tso_held_num++] = p;
+  return ERR_OK;
+}
+
+/** Packets (super-segments or GSO packets) queued by a driver keep the
+ * segment data alive (and the segments busy) after the segments are ACKed. */
+START_TEST(test_tcp_tso_gso_held)
+{
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb* pcb;
+  struct pbuf* p;
+  struct pbuf* segp;
+  u8_t data[TCP_MSS];
+  u16_t i;
+  int tso;
+  err_t err;
+  LWIP_UNUSED_ARG(_i);
+
+  for (i = 0; i < 4 * TCP_MSS; i++) {
+    tx_data[i] = (u8_t)(i * 3);
+  }
+  test_tcp_init_netif(&netif, &txcounters, &test_local_ip, &test_netmask);
+  netif.output = tso_hold_output;
+  memset(&counters, 0, sizeof(counters));
+
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  pcb->mss = TCP_MSS;
+  pcb->cwnd = 10 * TCP_MSS;
+
+  for (tso = 1; tso >= 0; tso--) {
+    if (tso) {
+      netif.flags |= NETIF_FLAG_TSO;
+    } else {
+      netif.flags &= (u8_t)~NETIF_FLAG_TSO;
+    }
+    tso_held_num = 0;
+    err = tcp_write(pcb, tx_data, 4 * TCP_MSS, TCP_WRITE_FLAG_COPY);
+    EXPECT_RET(err == ERR_OK);
+    err = tcp_output(pcb);
+    EXPECT_RET(err == ERR_OK);
+    EXPECT_RET(tso_held_num == (tso ? 1 : 4));
+    EXPECT_RET(pcb->unacked != NULL);
+    segp = pcb->unacked->p;
+    /* the queued data must not be retransmitted (headers rewritten) */
+    EXPECT(segp->ref > 1);
+    EXPECT(tcp_rexmit_rto_prepare(pcb) == ERR_VAL);
+
+    p = tcp_create_rx_segment(pcb, NULL, 0, 0, 4 * TCP_MSS, TCP_ACK);
+    test_tcp_input(p, &netif);
+    EXPECT(pcb->unacked == NULL);
+    EXPECT(MEMP_STATS_GET(used, MEMP_TCP_SEG) == 0);
+    /* only referenced by the queued packets now */
+    EXPECT(segp->ref == 1);
+
+    for (i = 0; i < 4; i++) {
+      struct pbuf *q = tso_held[tso ? 0 : i];
+      u16_t off = (u16_t)(40 + (tso ? i * TCP_MSS : 0));
+      EXPECT(pbuf_copy_partial(q, data, TCP_MSS, off) == TCP_MSS);
+      EXPECT(memcmp(data, &tx_data[i * TCP_MSS], TCP_MSS) == 0);
+    }
+    for (i = 0; i < tso_held_num; i++) {
+      pbuf_free(tso_held[i]);
+    }
+    EXPECT(MEMP_STATS_GET(used, MEMP_TSO_PBUF_REF) == 0);
+  }
+
+  EXPECT(counters.err_calls == 0);
+  tso_held_num = 0;
+  tcp_abort(pcb);
+  /* free the RST */
+  for (i = 0; i < tso_held_num; i++) {
+    pbuf_free(tso_held[i]);
+  }
+  EXPECT_RET(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
+}
+END_TEST
+
+static u16_t tso_ok_left;
+
+/** netif->output that sends tso_ok_left packets and fails after that */
+static err_t
+tso_fail_output(struct netif *netif, struct pbuf *p, const ip4_addr_t *ipaddr)
+{
+  LWIP_UNUSED_ARG(netif);
+  LWIP_UNUSED_ARG(p);
+  LWIP_UNUSED_ARG(ipaddr);
+  if (tso_ok_left == 0) {
+    return ERR_MEM;
+  }
+  tso_ok_left--;
+  return ERR_OK;
+}
+
+/** Once software GSO has sent a packet of a super-segment, the peer may ACK
+ * it: the segments count as sent (snd_nxt must not stay behind that ACK),
+ * the packets that failed are left to retransmission. */
+START_TEST(test_tcp_tso_gso_partial)
+{
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb* pcb;
+  struct pbuf* p;
+  u32_t base;
+  err_t err;
+  LWIP_UNUSED_ARG(_i);
+
+  test_tcp_init_netif(&netif, &txcounters, &test_local_ip, &test_netmask);
+  netif.output = tso_fail_output;
+  memset(&counters, 0, sizeof(counters));
+
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  pcb->mss = TCP_MSS;
+  pcb->cwnd = 10 * TCP_MSS;
+  base = pcb->snd_nxt;
+
+  /* nothing goes out: the segments stay unsent */
+  tso_ok_left = 0;
+  err = tcp_write(pcb, tx_data, 4 * TCP_MSS, TCP_WRITE_FLAG_COPY);
+  EXPECT_RET(err == ERR_OK);
+  EXPECT(tcp_output(pcb) == ERR_MEM);
+  EXPECT(pcb->snd_nxt == base);
+  EXPECT(pcb->unacked == NULL);
+
+  /* the first packet goes out: all segments are in flight */
+  tso_ok_left = 1;
+  EXPECT(tcp_output(pcb) == ERR_OK);
+  EXPECT(pcb->unsent == NULL);
+  EXPECT(pcb->snd_nxt == base + 4 * TCP_MSS);
+  EXPECT(count_unacked(pcb) == 4);
+
+  /* the ACK for the first packet is valid (not answered with an ACK) */
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, TCP_MSS, TCP_ACK);
+  test_tcp_input(p, &netif);
+  EXPECT(count_unacked(pcb) == 3);
+  EXPECT(pcb->lastack == base + TCP_MSS);
+  EXPECT((pcb->flags & TF_ACK_NOW) == 0);
+  EXPECT(counters.err_calls == 0);
+
+  tso_ok_left = 0xffff;
+  tcp_abort(pcb);
+  EXPECT_RET(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
+}
+END_TEST
+#endif /* LWIP_NETIF_TSO */
+
 /** Send data with sequence numbers that wrap around the u32_t range.
  * Then, provoke RTO retransmission and check that all
  * segment lists are still properly sorted. */
@@ -735,9 +1472,9 @@ START_TEST(test_tcp_rto_rexmit_wraparound)
   memset(&counters, 0, sizeof(counters));
 
   /* create and initialize the pcb */
-  tcp_ticks = 0;
-  tcp_ticks = 0 - tcp_next_iss(&dummy_pcb_for_iss);
-  tcp_ticks = SEQNO1 - tcp_next_iss(&dummy_pcb_for_iss);
+  test_tcp_ticks = 0;
+  test_tcp_ticks = 0 - tcp_next_iss(&dummy_pcb_for_iss);
+  test_tcp_ticks = SEQNO1 - tcp_next_iss(&dummy_pcb_for_iss);
   pcb = test_tcp_new_counters_pcb(&counters);
   EXPECT_RET(pcb != NULL);
   tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
@@ -763,11 +1500,11 @@ START_TEST(test_tcp_rto_rexmit_wraparound)
   check_seqnos(pcb->unsent, 4, &seqnos[2]);
 
   /* call the tcp timer some times */
-  for (i = 0; i < 10; i++) {
+  for (i = 0; i < TEST_TCP_TMR_CALLS(LWIP_TCP_RTO_TIME / TCP_SLOW_INTERVAL) - 1; i++) {
     test_tcp_tmr();
     EXPECT(txcounters.num_tx_calls == 0);
   }
-  /* 11th call to tcp_tmr: RTO rexmit fires */
+  /* last call to tcp_tmr: RTO rexmit fires */
   test_tcp_tmr();
   EXPECT(txcounters.num_tx_calls == 1);
   check_seqnos(pcb->unacked, 1, seqnos);
@@ -897,8 +1634,9 @@ static void test_tcp_tx_full_window_lost(u8_t zero_window_probe_from_unsent)
   } else {
     EXPECT(pcb->persist_backoff == 1);
 
-    /* call tcp_timer some more times to let persist timer count up */
-    for (i = 0; i < 4; i++) {
+    /* call tcp_timer some more times to let persist timer count up
+       (the first probe is due after 3 slow timer ticks) */
+    for (i = 0; i < TEST_TCP_TMR_CALLS(3) - 1; i++) {
       test_tcp_tmr();
       EXPECT(txcounters.num_tx_calls == 0);
       EXPECT(txcounters.num_tx_bytes == 0);
@@ -1086,7 +1824,7 @@ START_TEST(test_tcp_rto_tracking)
   memset(&counters, 0, sizeof(counters));
 
   /* create and initialize the pcb */
-  tcp_ticks = SEQNO1 - ISS;
+  test_tcp_ticks = SEQNO1 - ISS;
   pcb = test_tcp_new_counters_pcb(&counters);
   EXPECT_RET(pcb != NULL);
   tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
@@ -1208,7 +1946,7 @@ static void test_tcp_rto_timeout_impl(int link_down)
   memset(&counters, 0, sizeof(counters));
 
   /* create and initialize the pcb */
-  tcp_ticks = SEQNO1 - ISS;
+  test_tcp_ticks = SEQNO1 - ISS;
   pcb = test_tcp_new_counters_pcb(&counters);
   EXPECT_RET(pcb != NULL);
   tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
@@ -1307,7 +2045,7 @@ static void test_tcp_rto_timeout_syn_sent_impl(int link_down)
   memset(&counters, 0, sizeof(counters));
 
   /* create and initialize the pcb */
-  tcp_ticks = SEQNO1 - ISS;
+  test_tcp_ticks = SEQNO1 - ISS;
   pcb = test_tcp_new_counters_pcb(&counters);
   EXPECT_RET(pcb != NULL);
   err = tcp_connect(pcb, &netif.gw, 123, NULL);
@@ -1402,7 +2140,7 @@ static void test_tcp_zwp_timeout_impl(int link_down)
   memset(&counters, 0, sizeof(counters));
 
   /* create and initialize the pcb */
-  tcp_ticks = SEQNO1 - ISS;
+  test_tcp_ticks = SEQNO1 - ISS;
   pcb = test_tcp_new_counters_pcb(&counters);
   EXPECT_RET(pcb != NULL);
   tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
@@ -1532,7 +2270,7 @@ START_TEST(test_tcp_persist_split)
   memset(&counters, 0, sizeof(counters));
 
   /* create and initialize the pcb */
-  tcp_ticks = SEQNO1 - ISS;
+  test_tcp_ticks = SEQNO1 - ISS;
   pcb = test_tcp_new_counters_pcb(&counters);
   EXPECT_RET(pcb != NULL);
   tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
@@ -1583,8 +2321,9 @@ START_TEST(test_tcp_persist_split)
   EXPECT(counters.err_calls == 0);
   EXPECT(counters.last_err == ERR_OK);
 
-  /* call tcp_timer some more times to let persist timer count up */
-    for (i = 0; i < 4; i++) {
+  /* call tcp_timer some more times to let persist timer count up
+     (the first probe is due after 3 slow timer ticks) */
+    for (i = 0; i < TEST_TCP_TMR_CALLS(3) - 1; i++) {
       test_tcp_tmr();
       EXPECT(txcounters.num_tx_calls == 0);
       EXPECT(txcounters.num_tx_bytes == 0);
@@ -1669,6 +2408,81 @@ START_TEST(test_tcp_persist_split)
 }
 END_TEST
 
+#define TEST_TCP_LOOKUP_MAX_PCBS  1024
+#define TEST_TCP_LOOKUP_BATCH     256
+#define TEST_TCP_LOOKUP_SEGMENTS  (32 * TEST_TCP_LOOKUP_BATCH)
+static struct tcp_pcb test_tcp_lookup_pcbs[TEST_TCP_LOOKUP_MAX_PCBS];
+
+/** Register a growing number of ESTABLISHED pcbs and measure how long tcp_input()
+ * takes to deliver a segment to one of them. With LWIP_TCP_PCB_HASH enabled, the
+ * cost per segment should stay (nearly) constant as the number of pcbs grows.
+ * The pcbs are not allocated from MEMP_TCP_PCB to not depend on MEMP_NUM_TCP_PCB. */
+START_TEST(test_tcp_pcb_lookup_scaling)
+{
+  static const int num_pcbs[] = {16, 128, TEST_TCP_LOOKUP_MAX_PCBS};
+  struct test_tcp_counters counters;
+  struct tcp_pcb *template_pcb;
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct pbuf *batch[TEST_TCP_LOOKUP_BATCH];
+  char data = 0x55;
+  u32_t expected_recv_calls = 0;
+  int registered = 0;
+  size_t n;
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  test_tcp_init_netif(&netif, &txcounters, &test_local_ip, &test_netmask);
+  memset(&counters, 0, sizeof(counters));
+  template_pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(template_pcb != NULL);
+
+  for (n = 0; n < LWIP_ARRAYSIZE(num_pcbs); n++) {
+    clock_t ticks = 0;
+    int sent = 0;
+    int batch_len = LWIP_MIN(num_pcbs[n], TEST_TCP_LOOKUP_BATCH);
+
+    /* add pcbs with different remote ports up to the requested number */
+    for (; registered < num_pcbs[n]; registered++) {
+      struct tcp_pcb *pcb = &test_tcp_lookup_pcbs[registered];
+      memcpy(pcb, template_pcb, sizeof(struct tcp_pcb));
+      tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip,
+                    TEST_LOCAL_PORT, (u16_t)(TEST_REMOTE_PORT + 1 + registered));
+    }
+
+    while (sent < TEST_TCP_LOOKUP_SEGMENTS) {
+      clock_t start;
+      /* at most one segment per pcb and batch (seqnos are taken from the pcb),
+         round-robin over all pcbs so that list reordering in tcp_input() does not help */
+      for (i = 0; i < batch_len; i++) {
+        struct tcp_pcb *pcb = &test_tcp_lookup_pcbs[(sent + i) % num_pcbs[n]];
+        batch[i] = tcp_create_rx_segment(pcb, &data, 1, 0, 0, 0);
+        EXPECT_RET(batch[i] != NULL);
+      }
+      start = clock();
+      for (i = 0; i < batch_len; i++) {
+        test_tcp_input(batch[i], &netif);
+      }
+      ticks += clock() - start;
+      sent += batch_len;
+      expected_recv_calls += (u32_t)batch_len;
+    }
+    /* every segment must have been delivered to its pcb */
+    EXPECT(counters.recv_calls == expected_recv_calls);
+    EXPECT(counters.err_calls == 0);
+
+    printf("tcp_input lookup: %4d pcbs: %7.1f ns/segment\n", num_pcbs[n],
+           ((double)ticks * 1e9 / CLOCKS_PER_SEC) / sent);
+  }
+
+  for (i = 0; i < registered; i++) {
+    tcp_pcb_remove(&tcp_active_pcbs, &test_tcp_lookup_pcbs[i]);
+  }
+  tcp_abort(template_pcb);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
+}
+END_TEST
+
 /** Create the suite including all tests for this module */
 Suite *
 tcp_suite(void)
@@ -1683,6 +2497,21 @@ tcp_suite(void)
     TESTFUNC(test_tcp_malformed_header),
     TESTFUNC(test_tcp_fast_retx_recover),
     TESTFUNC(test_tcp_fast_rexmit_wraparound),
+#if LWIP_TCP_SACK_IN
+    TESTFUNC(test_tcp_sack_rexmit_holes),
+#endif
+#if LWIP_TCP_RACK
+    TESTFUNC(test_tcp_rack_tail_loss_probe),
+    TESTFUNC(test_tcp_rack_reordering_window),
+#endif
+#if LWIP_TCP_WRITE_REF
+    TESTFUNC(test_tcp_write_ref_completion),
+#endif
+#if LWIP_NETIF_TSO
+    TESTFUNC(test_tcp_tso_gso),
+    TESTFUNC(test_tcp_tso_gso_held),
+    TESTFUNC(test_tcp_tso_gso_partial),
+#endif
     TESTFUNC(test_tcp_rto_rexmit_wraparound),
     TESTFUNC(test_tcp_tx_full_window_lost_from_unacked),
     TESTFUNC(test_tcp_tx_full_window_lost_from_unsent),
@@ -1694,7 +2523,9 @@ tcp_suite(void)
     TESTFUNC(test_tcp_rto_timeout_syn_sent_link_down),
     TESTFUNC(test_tcp_zwp_timeout),
     TESTFUNC(test_tcp_zwp_timeout_link_down),
-    TESTFUNC(test_tcp_persist_split)
+    TESTFUNC(test_tcp_persist_split),
+    TESTFUNC(test_tcp_pcb_lookup_scaling)
   };
   return create_suite("TCP", tests, sizeof(tests)/sizeof(testfunc), tcp_setup, tcp_teardown);
 }
+
@@ -0,0 +1,264 @@
+#include "test_tcp_cc.h"
+
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/stats.h"
+#include "lwip/inet.h"
+#include "lwip/prot/ip4.h"
+#include "tcp_helper.h"
+#include "lwip/timeouts.h"
+#include "arch/sys_arch.h"
+
+#if !LWIP_STATS || !TCP_STATS || !MEMP_STATS
+#error "This tests needs TCP- and MEMP-statistics enabled"
+#endif
+
+#if LWIP_TCP_CC
+
+/* Simulated path: data segments and ACKs are delayed by SIM_DELAY_MS each way
+   and every SIM_DROP_EVERY'th data segment sent is lost. */
+#define SIM_DELAY_MS    100
+#define SIM_DROP_EVERY  100
+#define SIM_DURATION_MS 60000
+#define SIM_QUEUE_LEN   64
+
+struct sim_pkt {
+  u32_t due;
+  u32_t seqno;
+  u32_t len;
+};
+
+struct sim_queue {
+  struct sim_pkt pkts[SIM_QUEUE_LEN];
+  int head, tail;
+};
+
+static struct {
+  struct sim_queue data;      /* sender -> receiver */
+  struct sim_queue acks;      /* receiver -> sender (len unused) */
+  u32_t tx_count;
+  u32_t rcv_nxt;
+  /* out-of-order data held by the receiver */
+  struct sim_pkt ooseq[SIM_QUEUE_LEN];
+  int num_ooseq;
+} sim;
+
+static u8_t sim_tx_data[TCP_MSS];
+
+static void
+sim_push(struct sim_queue *q, u32_t due, u32_t seqno, u32_t len)
+{
+  int next = (q->tail + 1) % SIM_QUEUE_LEN;
+  fail_unless(next != q->head);
+  q->pkts[q->tail].due = due;
+  q->pkts[q->tail].seqno = seqno;
+  q->pkts[q->tail].len = len;
+  q->tail = next;
+}
+
+static struct sim_pkt *
+sim_pop_due(struct sim_queue *q)
+{
+  struct sim_pkt *pkt;
+  if ((q->head == q->tail) || (q->pkts[q->head].due > lwip_sys_now)) {
+    return NULL;
+  }
+  pkt = &q->pkts[q->head];
+  q->head = (q->head + 1) % SIM_QUEUE_LEN;
+  return pkt;
+}
+
+/* netif output: put data segments on the path (or lose them) */
+static err_t
+sim_netif_output(struct netif *netif, struct pbuf *p, const ip4_addr_t *ipaddr)
+{
+  struct tcp_hdr tcphdr;
+  u32_t len;
+  LWIP_UNUSED_ARG(netif);
+  LWIP_UNUSED_ARG(ipaddr);
+
+  fail_unless(pbuf_copy_partial(p, &tcphdr, sizeof(tcphdr), IP_HLEN) == sizeof(tcphdr));
+  len = p->tot_len - IP_HLEN - TCPH_HDRLEN_BYTES(&tcphdr);
+  if (len > 0) {
+    if ((++sim.tx_count % SIM_DROP_EVERY) != 0) {
+      sim_push(&sim.data, lwip_sys_now + SIM_DELAY_MS, lwip_ntohl(tcphdr.seqno), len);
+    }
+  }
+  return ERR_OK;
+}
+
+/* receiver: cumulative ACK for every data segment, dupACKs for holes */
+static void
+sim_receive(const struct sim_pkt *pkt)
+{
+  int i;
+  if (TCP_SEQ_LEQ(pkt->seqno, sim.rcv_nxt)) {
+    if (TCP_SEQ_GT(pkt->seqno + pkt->len, sim.rcv_nxt)) {
+      sim.rcv_nxt = pkt->seqno + pkt->len;
+    }
+    /* pull in out-of-order data that is now contiguous */
+    for (i = 0; i < sim.num_ooseq; ) {
+      if (TCP_SEQ_LEQ(sim.ooseq[i].seqno, sim.rcv_nxt)) {
+        if (TCP_SEQ_GT(sim.ooseq[i].seqno + sim.ooseq[i].len, sim.rcv_nxt)) {
+          sim.rcv_nxt = sim.ooseq[i].seqno + sim.ooseq[i].len;
+        }
+        sim.ooseq[i] = sim.ooseq[--sim.num_ooseq];
+        i = 0;
+      } else {
+        i++;
+      }
+    }
+  } else {
+    fail_unless(sim.num_ooseq < SIM_QUEUE_LEN);
+    sim.ooseq[sim.num_ooseq++] = *pkt;
+  }
+  sim_push(&sim.acks, lwip_sys_now + SIM_DELAY_MS, sim.rcv_nxt, 0);
+}
+
+/** Run a bulk transfer over the simulated path, return the bytes delivered */
+static u32_t
+sim_run(const struct tcp_cc_ops *ops)
+{
+  struct netif netif;
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  struct sim_pkt *pkt;
+  u32_t start, iss;
+  err_t err;
+
+  memset(&sim, 0, sizeof(sim));
+  memset(&counters, 0, sizeof(counters));
+  test_tcp_init_netif(&netif, NULL, &test_local_ip, &test_netmask);
+  netif.output = sim_netif_output;
+  start = lwip_sys_now;
+
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RETX(pcb != NULL, 0);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  pcb->mss = TCP_MSS;
+  pcb->cwnd = 4 * TCP_MSS;
+  EXPECT(tcp_set_cc(pcb, ops) == ERR_OK);
+  iss = pcb->snd_nxt;
+  sim.rcv_nxt = iss;
+
+  while (lwip_sys_now - start < SIM_DURATION_MS) {
+    while ((pkt = sim_pop_due(&sim.data)) != NULL) {
+      sim_receive(pkt);
+    }
+    while ((pkt = sim_pop_due(&sim.acks)) != NULL) {
+      struct pbuf *p = tcp_create_segment(&pcb->remote_ip, &pcb->local_ip, pcb->remote_port,
+                                          pcb->local_port, NULL, 0, pcb->rcv_nxt, pkt->seqno, TCP_ACK);
+      EXPECT_RETX(p != NULL, 0);
+      test_tcp_input(p, &netif);
+    }
+#if LWIP_TCP_PCB_TIMERS
+    sys_check_timeouts();
+#else /* LWIP_TCP_PCB_TIMERS */
+    if (((lwip_sys_now - start) % TCP_TMR_INTERVAL) == 0) {
+      tcp_tmr();
+    }
+#endif /* LWIP_TCP_PCB_TIMERS */
+    do {
+      err = tcp_write(pcb, sim_tx_data, sizeof(sim_tx_data), 0);
+    } while (err == ERR_OK);
+    tcp_output(pcb);
+    lwip_sys_now++;
+  }
+
+  EXPECT(counters.err_calls == 0);
+  tcp_abort(pcb);
+  netif_list = NULL;
+  return sim.rcv_nxt - iss;
+}
+
+/* Setups/teardown functions */
+static struct netif *old_netif_list;
+static struct netif *old_netif_default;
+
+static void
+tcp_cc_setup(void)
+{
+  old_netif_list = netif_list;
+  old_netif_default = netif_default;
+  netif_list = NULL;
+  netif_default = NULL;
+  tcp_remove_all();
+#if LWIP_TCP_PCB_TIMERS
+  test_tcp_timers_setup();
+#endif /* LWIP_TCP_PCB_TIMERS */
+  lwip_check_ensure_no_alloc(SKIP_POOL(MEMP_SYS_TIMEOUT));
+}
+
+static void
+tcp_cc_teardown(void)
+{
+  netif_list = NULL;
+  netif_default = NULL;
+  tcp_remove_all();
+#if LWIP_TCP_PCB_TIMERS
+  test_tcp_timers_teardown();
+#endif /* LWIP_TCP_PCB_TIMERS */
+  netif_list = old_netif_list;
+  netif_default = old_netif_default;
+  lwip_check_ensure_no_alloc(SKIP_POOL(MEMP_SYS_TIMEOUT));
+}
+
+
+/* Test functions */
+
+/** tcp_set_cc() selects the algorithm and rejects invalid arguments */
+START_TEST(test_tcp_cc_select)
+{
+  struct tcp_pcb *pcb;
+  LWIP_UNUSED_ARG(_i);
+
+  pcb = tcp_new();
+  fail_unless(pcb != NULL);
+  fail_unless(pcb->cc_ops == TCP_CC_DEFAULT);
+  fail_unless(tcp_set_cc(pcb, NULL) == ERR_ARG);
+#if LWIP_TCP_CC_CUBIC
+  fail_unless(tcp_set_cc(pcb, &tcp_cc_cubic) == ERR_OK);
+  fail_unless(pcb->cc_ops == &tcp_cc_cubic);
+#endif
+  fail_unless(tcp_set_cc(pcb, &tcp_cc_newreno) == ERR_OK);
+  fail_unless(pcb->cc_ops == &tcp_cc_newreno);
+  tcp_abort(pcb);
+}
+END_TEST
+
+#if LWIP_TCP_CC_CUBIC
+/** CUBIC keeps a lossy high-latency path fuller than NewReno */
+START_TEST(test_tcp_cc_cubic_lossy_path)
+{
+  u32_t newreno, cubic;
+  LWIP_UNUSED_ARG(_i);
+
+  newreno = sim_run(&tcp_cc_newreno);
+  cubic = sim_run(&tcp_cc_cubic);
+  /* sanity check: data kept flowing for both */
+  fail_unless(newreno > (SIM_DURATION_MS / (2 * SIM_DELAY_MS)) * TCP_MSS);
+  fail_unless(cubic > newreno + newreno / 20);
+}
+END_TEST
+#endif /* LWIP_TCP_CC_CUBIC */
+
+/** Create the suite including all tests for this module */
+Suite *
+tcp_cc_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_tcp_cc_select),
+#if LWIP_TCP_CC_CUBIC
+    TESTFUNC(test_tcp_cc_cubic_lossy_path),
+#endif
+  };
+  return create_suite("TCP_CC", tests, sizeof(tests)/sizeof(testfunc), tcp_cc_setup, tcp_cc_teardown);
+}
+
+#else /* LWIP_TCP_CC */
+
+Suite *
+tcp_cc_suite(void)
+{
+  return create_suite("TCP_CC", NULL, 0, NULL, NULL);
+}
+#endif /* LWIP_TCP_CC */
@@ -0,0 +1,249 @@
+#include "test_tcp_gro.h"
+
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/gro.h"
+#include "lwip/ip.h"
+#include "lwip/stats.h"
+#include "tcp_helper.h"
+
+#if !LWIP_STATS || !TCP_STATS || !MEMP_STATS
+#error "This tests needs TCP- and MEMP-statistics enabled"
+#endif
+
+#if LWIP_GRO
+
+#define GRO_TEST_SEGS 4
+
+static char gro_test_data[GRO_TEST_SEGS * TCP_MSS];
+
+static u32_t gro_test_rcv_isn;
+static struct netif test_netif;
+static struct test_tcp_txcounters test_txcounters;
+
+/** Create an established pcb receiving into counters that check the data */
+static struct tcp_pcb *
+gro_test_pcb(struct test_tcp_counters *counters)
+{
+  struct tcp_pcb *pcb;
+  size_t i;
+
+  for (i = 0; i < sizeof(gro_test_data); i++) {
+    gro_test_data[i] = (char)(i * 7);
+  }
+  memset(counters, 0, sizeof(*counters));
+  counters->expected_data = gro_test_data;
+  counters->expected_data_len = sizeof(gro_test_data);
+
+  pcb = test_tcp_new_counters_pcb(counters);
+  EXPECT_RETNULL(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  gro_test_rcv_isn = pcb->rcv_nxt;
+  return pcb;
+}
+
+/** Pass a received segment carrying gro_test_data[off..off+len) to GRO */
+static void
+gro_test_rx(struct tcp_pcb *pcb, u32_t off, u16_t len, u8_t flags)
+{
+  struct pbuf *p = tcp_create_rx_segment(pcb, &gro_test_data[off], len,
+                                         gro_test_rcv_isn + off - pcb->rcv_nxt, 0, flags);
+  EXPECT_RET(p != NULL);
+  if (gro_input(p, &test_netif, ip_input) != ERR_OK) {
+    pbuf_free(p);
+  }
+}
+
+/* Setups/teardown functions */
+static struct netif *old_netif_list;
+static struct netif *old_netif_default;
+
+static void
+tcp_gro_setup(void)
+{
+  old_netif_list = netif_list;
+  old_netif_default = netif_default;
+  netif_list = NULL;
+  netif_default = NULL;
+  tcp_remove_all();
+  test_tcp_init_netif(&test_netif, &test_txcounters, &test_local_ip, &test_netmask);
+  memset(&lwip_stats.gro, 0, sizeof(lwip_stats.gro));
+  memset(&lwip_stats.tcp, 0, sizeof(lwip_stats.tcp));
+  lwip_check_ensure_no_alloc(SKIP_POOL(MEMP_SYS_TIMEOUT));
+}
+
+static void
+tcp_gro_teardown(void)
+{
+  gro_netif_remove(&test_netif);
+  netif_list = NULL;
+  netif_default = NULL;
+  tcp_remove_all();
+  netif_list = old_netif_list;
+  netif_default = old_netif_default;
+  lwip_check_ensure_no_alloc(SKIP_POOL(MEMP_SYS_TIMEOUT));
+}
+
+
+/* Test functions */
+
+/** In-order segments are delivered as one chain with one upcall and one ACK */
+START_TEST(test_tcp_gro_coalesce)
+{
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  u32_t rcv_nxt, i;
+  LWIP_UNUSED_ARG(_i);
+
+  pcb = gro_test_pcb(&counters);
+  rcv_nxt = pcb->rcv_nxt;
+
+  for (i = 0; i < GRO_TEST_SEGS; i++) {
+    gro_test_rx(pcb, i * TCP_MSS, TCP_MSS, TCP_ACK);
+  }
+  /* everything is held until the end of the batch */
+  EXPECT(gro_pending());
+  EXPECT(counters.recv_calls == 0);
+  EXPECT(pcb->rcv_nxt == rcv_nxt);
+
+  gro_flush();
+  EXPECT(!gro_pending());
+  EXPECT(counters.recv_calls == 1);
+  EXPECT(counters.recved_bytes == GRO_TEST_SEGS * TCP_MSS);
+  EXPECT(pcb->rcv_nxt == rcv_nxt + GRO_TEST_SEGS * TCP_MSS);
+  EXPECT(lwip_stats.gro.recv == GRO_TEST_SEGS);
+  EXPECT(lwip_stats.gro.merged == GRO_TEST_SEGS - 1);
+  EXPECT(lwip_stats.gro.flush == 1);
+  EXPECT(lwip_stats.tcp.recv == 1);
+  /* the ACK is not delayed */
+  EXPECT(test_txcounters.num_tx_calls == 1);
+  EXPECT((pcb->flags & (TF_ACK_NOW | TF_ACK_DELAY)) == 0);
+
+  tcp_abort(pcb);
+}
+END_TEST
+
+/** Odd-sized segments starting at odd offsets get a valid checksum, a PSH
+ * segment ends the coalesced packet */
+START_TEST(test_tcp_gro_odd_len_push)
+{
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  u32_t rcv_nxt;
+  LWIP_UNUSED_ARG(_i);
+
+  pcb = gro_test_pcb(&counters);
+  rcv_nxt = pcb->rcv_nxt;
+
+  gro_test_rx(pcb, 0, 101, TCP_ACK);
+  gro_test_rx(pcb, 101, 101, TCP_ACK);
+  gro_test_rx(pcb, 202, 101, TCP_ACK | TCP_PSH);
+  /* PSH flushed the flow */
+  EXPECT(!gro_pending());
+  EXPECT(counters.recv_calls == 1);
+  EXPECT(counters.recved_bytes == 303);
+  EXPECT(lwip_stats.tcp.chkerr == 0);
+  EXPECT(pcb->rcv_nxt == rcv_nxt + 303);
+
+  /* a shorter segment ends the packet, too */
+  gro_test_rx(pcb, 303, 101, TCP_ACK);
+  gro_test_rx(pcb, 404, 50, TCP_ACK);
+  EXPECT(!gro_pending());
+  EXPECT(counters.recv_calls == 2);
+  EXPECT(counters.recved_bytes == 454);
+  EXPECT(lwip_stats.gro.merged == 3);
+  EXPECT(lwip_stats.gro.flush == 2);
+
+  tcp_abort(pcb);
+}
+END_TEST
+
+/** A corrupted segment makes the coalesced packet fail the checksum check */
+START_TEST(test_tcp_gro_bad_chksum)
+{
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  struct pbuf *p;
+  u32_t rcv_nxt;
+  LWIP_UNUSED_ARG(_i);
+
+  pcb = gro_test_pcb(&counters);
+  rcv_nxt = pcb->rcv_nxt;
+
+  gro_test_rx(pcb, 0, TCP_MSS, TCP_ACK);
+  p = tcp_create_rx_segment(pcb, &gro_test_data[TCP_MSS], TCP_MSS, TCP_MSS, 0, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  /* flip a payload bit */
+  ((u8_t *)p->payload)[IP_HLEN + TCP_HLEN + 10] ^= 1;
+  EXPECT(gro_input(p, &test_netif, ip_input) == ERR_OK);
+  gro_flush();
+#if CHECKSUM_CHECK_TCP
+  EXPECT(lwip_stats.tcp.chkerr == 1);
+  EXPECT(counters.recv_calls == 0);
+  EXPECT(pcb->rcv_nxt == rcv_nxt);
+#else
+  LWIP_UNUSED_ARG(rcv_nxt);
+#endif
+
+  tcp_abort(pcb);
+}
+END_TEST
+
+/** Out-of-order and non-data segments are not coalesced and keep their order */
+START_TEST(test_tcp_gro_out_of_order)
+{
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  struct pbuf *p;
+  u32_t rcv_nxt;
+  LWIP_UNUSED_ARG(_i);
+
+  pcb = gro_test_pcb(&counters);
+  rcv_nxt = pcb->rcv_nxt;
+
+  gro_test_rx(pcb, 0, TCP_MSS, TCP_ACK);
+  /* skip the second segment: the first one is flushed, the third one held */
+  gro_test_rx(pcb, 2 * TCP_MSS, TCP_MSS, TCP_ACK);
+  EXPECT(counters.recv_calls == 1);
+  EXPECT(gro_pending());
+  /* a pure ACK of the same flow flushes the held segment before it */
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, 0, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  if (gro_input(p, &test_netif, ip_input) != ERR_OK) {
+    pbuf_free(p);
+  }
+  EXPECT(!gro_pending());
+  EXPECT(pcb->ooseq != NULL);
+  EXPECT(pcb->rcv_nxt == rcv_nxt + TCP_MSS);
+  /* fill the hole */
+  gro_test_rx(pcb, TCP_MSS, TCP_MSS, TCP_ACK);
+  gro_flush();
+  EXPECT(counters.recv_calls == 2);
+  EXPECT(counters.recved_bytes == 3 * TCP_MSS);
+  EXPECT(pcb->rcv_nxt == rcv_nxt + 3 * TCP_MSS);
+  EXPECT(lwip_stats.gro.merged == 0);
+
+  tcp_abort(pcb);
+}
+END_TEST
+
+/** Create the suite including all tests for this module */
+Suite *
+tcp_gro_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_tcp_gro_coalesce),
+    TESTFUNC(test_tcp_gro_odd_len_push),
+    TESTFUNC(test_tcp_gro_bad_chksum),
+    TESTFUNC(test_tcp_gro_out_of_order),
+  };
+  return create_suite("TCP_GRO", tests, sizeof(tests)/sizeof(testfunc), tcp_gro_setup, tcp_gro_teardown);
+}
+
+#else /* LWIP_GRO */
+
+Suite *
+tcp_gro_suite(void)
+{
+  return create_suite("TCP_GRO", NULL, 0, NULL, NULL);
+}
+#endif /* LWIP_GRO */
@@ -0,0 +1,8 @@
+#ifndef LWIP_HDR_TEST_TCP_GRO_H
+#define LWIP_HDR_TEST_TCP_GRO_H
+
+#include "../lwip_check.h"
+
+Suite *tcp_gro_suite(void);
+
+#endif
@@ -0,0 +1,327 @@
+#include "test_tcp_timers.h"
+
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/stats.h"
+#include "lwip/timeouts.h"
+#include "tcp_helper.h"
+#include "arch/sys_arch.h"
+
+#if !LWIP_STATS || !TCP_STATS || !MEMP_STATS
+#error "This tests needs TCP- and MEMP-statistics enabled"
+#endif
+
+#if LWIP_TCP_PCB_TIMERS
+
+#if LWIP_TCP_KEEPALIVE
+#define TEST_KEEP_INTVL 200
+#define TEST_KEEP_CNT   2
+#else
+#define TEST_KEEP_INTVL TCP_KEEPINTVL_DEFAULT
+#define TEST_KEEP_CNT   TCP_KEEPCNT_DEFAULT
+#endif
+
+static u8_t test_tcp_timers_data[100];
+static struct netif test_netif;
+static struct test_tcp_txcounters test_txcounters;
+
+/** Create an established pcb */
+static struct tcp_pcb *
+test_tcp_timers_pcb(struct test_tcp_counters *counters)
+{
+  struct tcp_pcb *pcb;
+
+  memset(counters, 0, sizeof(*counters));
+  pcb = test_tcp_new_counters_pcb(counters);
+  EXPECT_RETNULL(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  pcb->mss = TCP_MSS;
+  pcb->cwnd = 10 * TCP_MSS;
+  return pcb;
+}
+
+/* Setups/teardown functions */
+static struct netif *old_netif_list;
+static struct netif *old_netif_default;
+static u32_t old_sys_now;
+
+static void
+tcp_timers_setup(void)
+{
+  old_netif_list = netif_list;
+  old_netif_default = netif_default;
+  netif_list = NULL;
+  netif_default = NULL;
+  tcp_remove_all();
+  test_tcp_init_netif(&test_netif, &test_txcounters, &test_local_ip, &test_netmask);
+  test_tcp_timers_setup();
+  old_sys_now = lwip_sys_now;
+  lwip_sys_now = 1000;
+  lwip_check_ensure_no_alloc(SKIP_POOL(MEMP_SYS_TIMEOUT));
+}
+
+static void
+tcp_timers_teardown(void)
+{
+  tcp_remove_all();
+  test_tcp_timers_teardown();
+  lwip_sys_now = old_sys_now;
+  netif_list = old_netif_list;
+  netif_default = old_netif_default;
+  lwip_check_ensure_no_alloc(SKIP_POOL(MEMP_SYS_TIMEOUT));
+}
+
+
+/* Test functions */
+
+/** An idle connection has no timer, a retransmission fires exactly after RTO */
+START_TEST(test_tcp_timers_rto)
+{
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  u32_t rto;
+  LWIP_UNUSED_ARG(_i);
+
+  pcb = test_tcp_timers_pcb(&counters);
+  tcp_output(pcb);
+  EXPECT(!sys_timeout_pending(&pcb->timer));
+
+  EXPECT(tcp_write(pcb, test_tcp_timers_data, sizeof(test_tcp_timers_data), TCP_WRITE_FLAG_COPY) == ERR_OK);
+  EXPECT(tcp_output(pcb) == ERR_OK);
+  EXPECT(test_txcounters.num_tx_calls == 1);
+  EXPECT(sys_timeout_pending(&pcb->timer));
+  rto = (u32_t)pcb->rto;
+  EXPECT(rto == LWIP_TCP_RTO_TIME);
+
+  test_tcp_timers_run(rto - 1);
+  EXPECT(test_txcounters.num_tx_calls == 1);
+  test_tcp_timers_run(1);
+  EXPECT(test_txcounters.num_tx_calls == 2);
+  EXPECT(pcb->nrtx == 1);
+  /* backed off */
+  EXPECT((u32_t)pcb->rto > rto);
+
+  tcp_abort(pcb);
+}
+END_TEST
+
+/** RTT samples are taken in milliseconds, the RTO is limited by TCP_RTO_MIN */
+START_TEST(test_tcp_timers_rtt)
+{
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  struct pbuf *p;
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  pcb = test_tcp_timers_pcb(&counters);
+  for (i = 0; i < 40; i++) {
+    EXPECT(tcp_write(pcb, test_tcp_timers_data, sizeof(test_tcp_timers_data), TCP_WRITE_FLAG_COPY) == ERR_OK);
+    EXPECT(tcp_output(pcb) == ERR_OK);
+    lwip_sys_now += 40;
+    p = tcp_create_rx_segment(pcb, NULL, 0, 0, sizeof(test_tcp_timers_data), TCP_ACK);
+    EXPECT_RET(p != NULL);
+    test_tcp_input(p, &test_netif);
+    EXPECT(pcb->unacked == NULL);
+  }
+  /* smoothed RTT of 40 ms */
+  EXPECT((pcb->sa >> 3) == 40);
+  EXPECT(pcb->rto == TCP_RTO_MIN);
+  /* nothing in flight: the timer fires once, does nothing and is not re-armed */
+  test_tcp_timers_run(LWIP_TCP_RTO_TIME);
+  EXPECT(test_txcounters.num_tx_calls == 40);
+  EXPECT(!sys_timeout_pending(&pcb->timer));
+
+  /* RTT samples of several seconds are not clamped */
+  for (i = 0; i < 40; i++) {
+    EXPECT(tcp_write(pcb, test_tcp_timers_data, sizeof(test_tcp_timers_data), TCP_WRITE_FLAG_COPY) == ERR_OK);
+    EXPECT(tcp_output(pcb) == ERR_OK);
+    lwip_sys_now += 5000;
+    p = tcp_create_rx_segment(pcb, NULL, 0, 0, sizeof(test_tcp_timers_data), TCP_ACK);
+    EXPECT_RET(p != NULL);
+    test_tcp_input(p, &test_netif);
+  }
+  EXPECT((pcb->sa >> 3) > 4900);
+  EXPECT(pcb->rto > 4900);
+
+  tcp_abort(pcb);
+}
+END_TEST
+
+/** The RTO backs off beyond 0x7FFF ms up to TCP_RTO_MAX */
+START_TEST(test_tcp_timers_rto_max)
+{
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  tcprto_t max_rto = 0;
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  pcb = test_tcp_timers_pcb(&counters);
+  EXPECT(tcp_write(pcb, test_tcp_timers_data, sizeof(test_tcp_timers_data), TCP_WRITE_FLAG_COPY) == ERR_OK);
+  EXPECT(tcp_output(pcb) == ERR_OK);
+  for (i = 0; (i < TCP_MAXRTX) && (pcb->nrtx < TCP_MAXRTX); i++) {
+    test_tcp_timers_run((u32_t)pcb->rto);
+    EXPECT(pcb->nrtx == i + 1);
+    EXPECT(pcb->rto <= TCP_RTO_MAX);
+    max_rto = LWIP_MAX(max_rto, pcb->rto);
+  }
+  EXPECT(max_rto == TCP_RTO_MAX);
+  EXPECT(counters.err_calls == 0);
+
+  tcp_abort(pcb);
+}
+END_TEST
+
+/** A pending timer is not moved back when the RTO restarts: it fires early,
+ * does nothing and is re-armed to the real deadline */
+START_TEST(test_tcp_timers_lazy_rearm)
+{
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  struct pbuf *p;
+  u32_t first_due, due;
+  LWIP_UNUSED_ARG(_i);
+
+  pcb = test_tcp_timers_pcb(&counters);
+  tcp_nagle_disable(pcb);
+  EXPECT(tcp_write(pcb, test_tcp_timers_data, sizeof(test_tcp_timers_data), TCP_WRITE_FLAG_COPY) == ERR_OK);
+  EXPECT(tcp_output(pcb) == ERR_OK);
+  first_due = pcb->timer.time;
+  EXPECT(first_due == lwip_sys_now + LWIP_TCP_RTO_TIME);
+
+  lwip_sys_now += 1000;
+  EXPECT(tcp_write(pcb, test_tcp_timers_data, sizeof(test_tcp_timers_data), TCP_WRITE_FLAG_COPY) == ERR_OK);
+  EXPECT(tcp_output(pcb) == ERR_OK);
+  EXPECT(test_txcounters.num_tx_calls == 2);
+  /* the ACK for the first segment restarts the RTO */
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, sizeof(test_tcp_timers_data), TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &test_netif);
+  due = pcb->rto_start + (u32_t)pcb->rto;
+  EXPECT_RET((s32_t)(due - first_due) > 0);
+  EXPECT(pcb->timer.time == first_due);
+
+  test_tcp_timers_run(first_due - lwip_sys_now);
+  EXPECT(test_txcounters.num_tx_calls == 2);
+  EXPECT(sys_timeout_pending(&pcb->timer));
+  EXPECT(pcb->timer.time == due);
+  test_tcp_timers_run(due - lwip_sys_now - 1);
+  EXPECT(test_txcounters.num_tx_calls == 2);
+  test_tcp_timers_run(1);
+  EXPECT(test_txcounters.num_tx_calls == 3);
+  EXPECT(pcb->nrtx == 1);
+
+  tcp_abort(pcb);
+}
+END_TEST
+
+/** A delayed ACK is sent after TCP_DELACK_TIMEOUT */
+START_TEST(test_tcp_timers_delayed_ack)
+{
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  struct pbuf *p;
+  LWIP_UNUSED_ARG(_i);
+
+  pcb = test_tcp_timers_pcb(&counters);
+  p = tcp_create_rx_segment(pcb, test_tcp_timers_data, 10, 0, 0, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &test_netif);
+  EXPECT(counters.recved_bytes == 10);
+  EXPECT(pcb->flags & TF_ACK_DELAY);
+  EXPECT(test_txcounters.num_tx_calls == 0);
+
+  test_tcp_timers_run(TCP_DELACK_TIMEOUT - 1);
+  EXPECT(test_txcounters.num_tx_calls == 0);
+  test_tcp_timers_run(1);
+  EXPECT(test_txcounters.num_tx_calls == 1);
+  EXPECT(!(pcb->flags & TF_ACK_DELAY));
+  EXPECT(!sys_timeout_pending(&pcb->timer));
+
+  tcp_abort(pcb);
+}
+END_TEST
+
+/** Keepalive probes are sent at keep_idle + n * keep_intvl, then the
+ * connection is aborted */
+START_TEST(test_tcp_timers_keepalive)
+{
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  u32_t i;
+  LWIP_UNUSED_ARG(_i);
+
+  pcb = test_tcp_timers_pcb(&counters);
+  pcb->keep_idle = 1000;
+#if LWIP_TCP_KEEPALIVE
+  pcb->keep_intvl = TEST_KEEP_INTVL;
+  pcb->keep_cnt = TEST_KEEP_CNT;
+#endif
+  ip_set_option(pcb, SOF_KEEPALIVE);
+  tcp_timers_update(pcb);
+  EXPECT(sys_timeout_pending(&pcb->timer));
+
+  test_tcp_timers_run(999);
+  EXPECT(test_txcounters.num_tx_calls == 0);
+  test_tcp_timers_run(1);
+  EXPECT(test_txcounters.num_tx_calls == 1);
+  for (i = 1; i < TEST_KEEP_CNT; i++) {
+    test_tcp_timers_run(TEST_KEEP_INTVL - 1);
+    EXPECT(test_txcounters.num_tx_calls == i);
+    test_tcp_timers_run(1);
+    EXPECT(test_txcounters.num_tx_calls == i + 1);
+  }
+  EXPECT(counters.err_calls == 0);
+  /* no answer to the last probe: abort with RST */
+  test_tcp_timers_run(TEST_KEEP_INTVL);
+  EXPECT(counters.err_calls == 1);
+  EXPECT(counters.last_err == ERR_ABRT);
+  EXPECT(test_txcounters.num_tx_calls == TEST_KEEP_CNT + 1);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
+}
+END_TEST
+
+/** A TIME-WAIT pcb is freed after 2 * MSL */
+START_TEST(test_tcp_timers_time_wait)
+{
+  struct tcp_pcb *pcb;
+  LWIP_UNUSED_ARG(_i);
+
+  pcb = tcp_new();
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, TIME_WAIT, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  pcb->tmr = tcp_now();
+  tcp_timers_update(pcb);
+
+  test_tcp_timers_run(2 * TCP_MSL - 1);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 1);
+  test_tcp_timers_run(1);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
+  EXPECT(tcp_tw_pcbs == NULL);
+}
+END_TEST
+
+/** Create the suite including all tests for this module */
+Suite *
+tcp_timers_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_tcp_timers_rto),
+    TESTFUNC(test_tcp_timers_rtt),
+    TESTFUNC(test_tcp_timers_rto_max),
+    TESTFUNC(test_tcp_timers_lazy_rearm),
+    TESTFUNC(test_tcp_timers_delayed_ack),
+    TESTFUNC(test_tcp_timers_keepalive),
+    TESTFUNC(test_tcp_timers_time_wait),
+  };
+  return create_suite("TCP_TIMERS", tests, sizeof(tests)/sizeof(testfunc), tcp_timers_setup, tcp_timers_teardown);
+}
+
+#else /* LWIP_TCP_PCB_TIMERS */
+
+Suite *
+tcp_timers_suite(void)
+{
+  return create_suite("TCP_TIMERS", NULL, 0, NULL, NULL);
+}
+#endif /* LWIP_TCP_PCB_TIMERS */
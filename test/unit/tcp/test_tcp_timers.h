@@ -0,0 +1,8 @@
+#ifndef LWIP_HDR_TEST_TCP_TIMERS_H
+#define LWIP_HDR_TEST_TCP_TIMERS_H
+
+#include "../lwip_check.h"
+
+Suite *tcp_timers_suite(void);
+
+#endif
@@ -0,0 +1,255 @@
+#include "test_tcp_tw.h"
+
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/stats.h"
+#include "lwip/timeouts.h"
+#include "tcp_helper.h"
+#include "arch/sys_arch.h"
+
+#if !LWIP_STATS || !TCP_STATS || !MEMP_STATS
+#error "This tests needs TCP- and MEMP-statistics enabled"
+#endif
+
+#if LWIP_TCP_TW_BUCKETS
+
+static struct netif test_netif;
+static struct test_tcp_txcounters test_txcounters;
+
+/** Create an established pcb to the given remote port */
+static struct tcp_pcb *
+test_tcp_tw_pcb(struct test_tcp_counters *counters, u16_t remote_port)
+{
+  struct tcp_pcb *pcb;
+
+  memset(counters, 0, sizeof(*counters));
+  pcb = test_tcp_new_counters_pcb(counters);
+  EXPECT_RETNULL(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, remote_port);
+  return pcb;
+}
+
+/** Input a segment from the remote end of a connection */
+static void
+test_tcp_tw_input(u16_t remote_port, u32_t seqno, u32_t ackno, u8_t flags)
+{
+  ip_addr_t src_ip = test_remote_ip;
+  ip_addr_t dst_ip = test_local_ip;
+  struct pbuf *p = tcp_create_segment(&src_ip, &dst_ip, remote_port, TEST_LOCAL_PORT,
+                                      NULL, 0, seqno, ackno, flags);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &test_netif);
+}
+
+/** Answer the FIN of an actively closed pcb with FIN+ACK: TIME-WAIT.
+ * Returns the sequence number of the remote FIN. */
+static u32_t
+test_tcp_tw_fin(struct tcp_pcb *pcb)
+{
+  u32_t seqno = pcb->rcv_nxt;
+  EXPECT(pcb->state == FIN_WAIT_1);
+  test_tcp_tw_input(pcb->remote_port, seqno, pcb->snd_nxt, TCP_FIN | TCP_ACK);
+  return seqno;
+}
+
+/** Let 2 MSL pass */
+static void
+test_tcp_tw_wait_2msl(void)
+{
+#if LWIP_TCP_PCB_TIMERS
+  lwip_sys_now += 2 * TCP_MSL;
+  sys_check_timeouts();
+#else /* LWIP_TCP_PCB_TIMERS */
+  u32_t i;
+  for (i = 0; i <= 2 * TCP_MSL / TCP_SLOW_INTERVAL; i++) {
+    tcp_slowtmr();
+  }
+#endif /* LWIP_TCP_PCB_TIMERS */
+}
+
+/* Setups/teardown functions */
+static struct netif *old_netif_list;
+static struct netif *old_netif_default;
+
+static void
+tcp_tw_setup(void)
+{
+  old_netif_list = netif_list;
+  old_netif_default = netif_default;
+  netif_list = NULL;
+  netif_default = NULL;
+  tcp_remove_all();
+  test_tcp_init_netif(&test_netif, &test_txcounters, &test_local_ip, &test_netmask);
+#if LWIP_TCP_PCB_TIMERS
+  test_tcp_timers_setup();
+#endif /* LWIP_TCP_PCB_TIMERS */
+  lwip_check_ensure_no_alloc(SKIP_POOL(MEMP_SYS_TIMEOUT));
+}
+
+static void
+tcp_tw_teardown(void)
+{
+  tcp_remove_all();
+#if LWIP_TCP_PCB_TIMERS
+  test_tcp_timers_teardown();
+#endif /* LWIP_TCP_PCB_TIMERS */
+  netif_list = old_netif_list;
+  netif_default = old_netif_default;
+  lwip_check_ensure_no_alloc(SKIP_POOL(MEMP_SYS_TIMEOUT));
+}
+
+
+/* Test functions */
+
+/** A closed connection entering TIME-WAIT is replaced by a tw-bucket that
+ * answers segments like a TIME-WAIT pcb and expires after 2 MSL */
+START_TEST(test_tcp_tw_bucket)
+{
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  struct tcp_tw *tw;
+  u32_t fin_seqno, snd_nxt;
+  LWIP_UNUSED_ARG(_i);
+
+  pcb = test_tcp_tw_pcb(&counters, TEST_REMOTE_PORT);
+  EXPECT(tcp_close(pcb) == ERR_OK);
+  EXPECT(test_txcounters.num_tx_calls == 1);
+  snd_nxt = pcb->snd_nxt;
+  fin_seqno = test_tcp_tw_fin(pcb);
+  /* FIN is ACKed, the pcb is gone */
+  EXPECT(test_txcounters.num_tx_calls == 2);
+  EXPECT(counters.close_calls == 1);
+  EXPECT(tcp_tw_pcbs == NULL);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_TW) == 1);
+  tw = tcp_tw_find(TEST_LOCAL_PORT, &test_local_ip, &test_remote_ip, TEST_REMOTE_PORT);
+  EXPECT_RET(tw != NULL);
+  EXPECT(tw->rcv_nxt == fin_seqno + 1);
+  EXPECT(tw->snd_nxt == snd_nxt);
+
+  /* retransmitted FIN: ACK again */
+  test_tcp_tw_input(TEST_REMOTE_PORT, fin_seqno, snd_nxt, TCP_FIN | TCP_ACK);
+  EXPECT(test_txcounters.num_tx_calls == 3);
+  /* RST: ignored (RFC 1337) */
+  test_tcp_tw_input(TEST_REMOTE_PORT, fin_seqno + 1, snd_nxt, TCP_RST | TCP_ACK);
+  EXPECT(test_txcounters.num_tx_calls == 3);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_TW) == 1);
+  /* SYN in the window: RST */
+  test_tcp_tw_input(TEST_REMOTE_PORT, fin_seqno + 1, 0, TCP_SYN);
+  EXPECT(test_txcounters.num_tx_calls == 4);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_TW) == 1);
+
+  test_tcp_tw_wait_2msl();
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_TW) == 0);
+  EXPECT(tcp_tw_buckets == NULL);
+  EXPECT(tcp_tw_find(TEST_LOCAL_PORT, &test_local_ip, &test_remote_ip, TEST_REMOTE_PORT) == NULL);
+}
+END_TEST
+
+/** A pcb still held by the application stays a pcb in TIME-WAIT until it
+ * is closed */
+START_TEST(test_tcp_tw_held_pcb)
+{
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  LWIP_UNUSED_ARG(_i);
+
+  pcb = test_tcp_tw_pcb(&counters, TEST_REMOTE_PORT);
+  EXPECT(tcp_shutdown(pcb, 0, 1) == ERR_OK);
+  test_tcp_tw_fin(pcb);
+  EXPECT(pcb->state == TIME_WAIT);
+  EXPECT(tcp_tw_pcbs == pcb);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_TW) == 0);
+
+  EXPECT(tcp_close(pcb) == ERR_OK);
+  EXPECT(tcp_tw_pcbs == NULL);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_TW) == 1);
+}
+END_TEST
+
+/** When the pool is exhausted, the oldest bucket is reused; buckets keep
+ * their local port in use */
+START_TEST(test_tcp_tw_reuse_oldest)
+{
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  u16_t i;
+  LWIP_UNUSED_ARG(_i);
+
+  for (i = 0; i <= MEMP_NUM_TCP_TW; i++) {
+    pcb = test_tcp_tw_pcb(&counters, (u16_t)(TEST_REMOTE_PORT + i));
+    EXPECT_RET(pcb != NULL);
+    EXPECT(tcp_close(pcb) == ERR_OK);
+    test_tcp_tw_fin(pcb);
+    EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
+  }
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_TW) == MEMP_NUM_TCP_TW);
+  EXPECT(tcp_tw_find(TEST_LOCAL_PORT, &test_local_ip, &test_remote_ip, TEST_REMOTE_PORT) == NULL);
+  EXPECT(tcp_tw_find(TEST_LOCAL_PORT, &test_local_ip, &test_remote_ip, TEST_REMOTE_PORT + 1) == tcp_tw_buckets);
+  EXPECT(tcp_tw_find(TEST_LOCAL_PORT, &test_local_ip, &test_remote_ip, TEST_REMOTE_PORT + MEMP_NUM_TCP_TW) != NULL);
+
+  pcb = tcp_new();
+  EXPECT_RET(pcb != NULL);
+  EXPECT(tcp_bind(pcb, &test_local_ip, TEST_LOCAL_PORT) == ERR_USE);
+  EXPECT(tcp_bind(pcb, &test_local_ip, TEST_LOCAL_PORT + 1) == ERR_OK);
+  EXPECT(tcp_close(pcb) == ERR_OK);
+}
+END_TEST
+
+/** Buckets are found by their local port until they expire */
+START_TEST(test_tcp_tw_port_used)
+{
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  u16_t i;
+  LWIP_UNUSED_ARG(_i);
+
+  for (i = 0; i < 3; i++) {
+    pcb = test_tcp_tw_pcb(&counters, (u16_t)(TEST_REMOTE_PORT + i));
+    EXPECT_RET(pcb != NULL);
+    EXPECT(tcp_close(pcb) == ERR_OK);
+    test_tcp_tw_fin(pcb);
+  }
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_TW) == 3);
+  EXPECT(tcp_tw_port_used(TEST_LOCAL_PORT, NULL));
+  EXPECT(tcp_tw_port_used(TEST_LOCAL_PORT, IP_ADDR_ANY));
+  EXPECT(tcp_tw_port_used(TEST_LOCAL_PORT, &test_local_ip));
+  EXPECT(!tcp_tw_port_used(TEST_LOCAL_PORT, &test_remote_ip));
+  /* same chain, other port */
+  EXPECT(!tcp_tw_port_used(TEST_LOCAL_PORT + TCP_TW_HASH_SIZE, NULL));
+
+  pcb = tcp_new();
+  EXPECT_RET(pcb != NULL);
+  EXPECT(tcp_bind(pcb, IP_ADDR_ANY, TEST_LOCAL_PORT) == ERR_USE);
+
+  tcp_tw_remove(tcp_tw_find(TEST_LOCAL_PORT, &test_local_ip, &test_remote_ip, TEST_REMOTE_PORT + 1));
+  EXPECT(tcp_tw_port_used(TEST_LOCAL_PORT, NULL));
+  test_tcp_tw_wait_2msl();
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_TW) == 0);
+  EXPECT(!tcp_tw_port_used(TEST_LOCAL_PORT, NULL));
+  EXPECT(tcp_bind(pcb, IP_ADDR_ANY, TEST_LOCAL_PORT) == ERR_OK);
+  EXPECT(tcp_close(pcb) == ERR_OK);
+}
+END_TEST
+
+/** Create the suite including all tests for this module */
+Suite *
+tcp_tw_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_tcp_tw_bucket),
+    TESTFUNC(test_tcp_tw_held_pcb),
+    TESTFUNC(test_tcp_tw_reuse_oldest),
+    TESTFUNC(test_tcp_tw_port_used),
+  };
+  return create_suite("TCP_TW", tests, sizeof(tests)/sizeof(testfunc), tcp_tw_setup, tcp_tw_teardown);
+}
+
+#else /* LWIP_TCP_TW_BUCKETS */
+
+Suite *
+tcp_tw_suite(void)
+{
+  return create_suite("TCP_TW", NULL, 0, NULL, NULL);
+}
+#endif /* LWIP_TCP_TW_BUCKETS */
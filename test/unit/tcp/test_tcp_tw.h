@@ -0,0 +1,8 @@
+#ifndef LWIP_HDR_TEST_TCP_TW_H
+#define LWIP_HDR_TEST_TCP_TW_H
+
+#include "../lwip_check.h"
+
+Suite *tcp_tw_suite(void);
+
+#endif
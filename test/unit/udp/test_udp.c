@@ -3,6 +3,7 @@
 #include "lwip/udp.h"
 #include "lwip/stats.h"
 #include "lwip/inet_chksum.h"
+#include "lwip/tcpip.h"
 
 #if !LWIP_STATS || !UDP_STATS || !MEMP_STATS
 #error "This tests needs UDP- and MEMP-statistics enabled"
@@ -459,6 +460,179 @@ START_TEST(test_udp_bind)
 }
 END_TEST
 
+static void
+test_udp_input_port(u16_t port)
+{
+  struct pbuf *p = test_udp_create_test_packet(16, port, test_ipaddr1.addr);
+  EXPECT_RET(p != NULL);
+  fail_unless(ip4_input(p, &test_netif1) == ERR_OK);
+}
+
+/* check demultiplexing of pcbs bound to ports that share a hash bucket
+   (with LWIP_UDP_PCB_HASH), across rebind and removal */
+START_TEST(test_udp_demux_ports)
+{
+  struct udp_pcb *pcb1, *pcb2, *pcb3, *pcb4;
+  struct test_udp_rxdata ctr1, ctr2, ctr3, ctr4;
+  const u16_t port_a = 2000;
+  const u16_t port_b = port_a + UDP_PCB_HASH_SIZE;
+  const u16_t port_c = port_a + 2 * UDP_PCB_HASH_SIZE;
+  err_t err;
+  LWIP_UNUSED_ARG(_i);
+
+  memset(&ctr1, 0, sizeof(ctr1));
+  memset(&ctr2, 0, sizeof(ctr2));
+  memset(&ctr3, 0, sizeof(ctr3));
+  memset(&ctr4, 0, sizeof(ctr4));
+
+  pcb1 = udp_new();
+  fail_unless(pcb1 != NULL);
+  pcb2 = udp_new();
+  fail_unless(pcb2 != NULL);
+  pcb3 = udp_new();
+  fail_unless(pcb3 != NULL);
+  ctr1.pcb = pcb1;
+  ctr2.pcb = pcb2;
+  ctr3.pcb = pcb3;
+  udp_recv(pcb1, test_recv, &ctr1);
+  udp_recv(pcb2, test_recv, &ctr2);
+  udp_recv(pcb3, test_recv, &ctr3);
+
+  err = udp_bind(pcb1, NULL, port_a);
+  fail_unless(err == ERR_OK);
+  err = udp_bind(pcb2, NULL, port_b);
+  fail_unless(err == ERR_OK);
+  /* ephemeral port must not collide with the ports in use */
+  err = udp_bind(pcb3, NULL, 0);
+  fail_unless(err == ERR_OK);
+  fail_unless(pcb3->local_port != 0);
+  fail_unless(pcb3->local_port != port_a);
+  fail_unless(pcb3->local_port != port_b);
+  /* binding to a port in use must still be detected */
+  err = udp_bind(pcb3, NULL, port_b);
+  fail_unless(err == ERR_USE);
+
+  test_udp_input_port(port_a);
+  test_udp_input_port(port_b);
+  test_udp_input_port(pcb3->local_port);
+  fail_unless(ctr1.rx_cnt == 1);
+  fail_unless(ctr2.rx_cnt == 1);
+  fail_unless(ctr3.rx_cnt == 1);
+
+  /* rebind pcb2: the old port must not match any more */
+  err = udp_bind(pcb2, NULL, port_c);
+  fail_unless(err == ERR_OK);
+  test_udp_input_port(port_b);
+  fail_unless(ctr2.rx_cnt == 1);
+  test_udp_input_port(port_c);
+  fail_unless(ctr2.rx_cnt == 2);
+
+  /* remove pcb1 and let a connected pcb take over its port */
+  udp_remove(pcb1);
+  test_udp_input_port(port_a);
+  fail_unless(ctr1.rx_cnt == 1);
+  pcb4 = udp_new();
+  fail_unless(pcb4 != NULL);
+  ctr4.pcb = pcb4;
+  udp_recv(pcb4, test_recv, &ctr4);
+  err = udp_bind(pcb4, NULL, port_a);
+  fail_unless(err == ERR_OK);
+  err = udp_connect(pcb4, IP4_ADDR_ANY, port_a);
+  fail_unless(err == ERR_OK);
+  test_udp_input_port(port_a);
+  fail_unless(ctr4.rx_cnt == 1);
+  test_udp_input_port(port_c);
+  fail_unless(ctr2.rx_cnt == 3);
+  fail_unless(ctr3.rx_cnt == 1);
+}
+END_TEST
+
+#if SO_REUSE
+/* rebinding a pcb to its port must not change which one of the pcbs
+   sharing the port receives (with LWIP_UDP_PCB_HASH, it keeps its place in
+   the hash bucket like it does in udp_pcbs) */
+START_TEST(test_udp_rebind_same_port)
+{
+  struct udp_pcb *pcb1, *pcb2;
+  struct test_udp_rxdata ctr1, ctr2;
+  const u16_t port = 2000;
+  err_t err;
+  LWIP_UNUSED_ARG(_i);
+
+  memset(&ctr1, 0, sizeof(ctr1));
+  memset(&ctr2, 0, sizeof(ctr2));
+
+  pcb1 = udp_new();
+  fail_unless(pcb1 != NULL);
+  pcb2 = udp_new();
+  fail_unless(pcb2 != NULL);
+  ctr1.pcb = pcb1;
+  ctr2.pcb = pcb2;
+  udp_recv(pcb1, test_recv, &ctr1);
+  udp_recv(pcb2, test_recv, &ctr2);
+  ip_set_option(pcb1, SOF_REUSEADDR);
+  ip_set_option(pcb2, SOF_REUSEADDR);
+
+  err = udp_bind(pcb1, NULL, port);
+  fail_unless(err == ERR_OK);
+  err = udp_bind(pcb2, NULL, port);
+  fail_unless(err == ERR_OK);
+  /* the pcb bound last is looked at first */
+  test_udp_input_port(port);
+  fail_unless(ctr1.rx_cnt == 0);
+  fail_unless(ctr2.rx_cnt == 1);
+
+  err = udp_bind(pcb1, NULL, port);
+  fail_unless(err == ERR_OK);
+  test_udp_input_port(port);
+  fail_unless(ctr1.rx_cnt == 0);
+  fail_unless(ctr2.rx_cnt == 2);
+}
+END_TEST
+#endif /* SO_REUSE */
+
+#if LWIP_TCPIP_INPUT_BATCH
+/* pass several packets to tcpip_thread in one message */
+START_TEST(test_udp_tcpip_input_batch)
+{
+  struct udp_pcb *pcb;
+  struct test_udp_rxdata ctr;
+  struct pbuf *p[TCPIP_INPUT_BATCH_SIZE + 1];
+  const u16_t port = 12345;
+  u16_t i;
+  LWIP_UNUSED_ARG(_i);
+
+  pcb = udp_new();
+  fail_unless(pcb != NULL);
+  fail_unless(udp_bind(pcb, NULL, port) == ERR_OK);
+  memset(&ctr, 0, sizeof(ctr));
+  ctr.pcb = pcb;
+  udp_recv(pcb, test_recv, &ctr);
+  /* pass IP packets without ethernet header */
+  test_netif1.flags &= (u8_t)~NETIF_FLAG_ETHARP;
+
+  for (i = 0; i < TCPIP_INPUT_BATCH_SIZE; i++) {
+    p[i] = test_udp_create_test_packet(16, port, test_ipaddr1.addr);
+    EXPECT_RET(p[i] != NULL);
+  }
+  fail_unless(tcpip_input_batch(p, 0, &test_netif1) == ERR_OK);
+  fail_unless(tcpip_input_batch(p, TCPIP_INPUT_BATCH_SIZE + 1, &test_netif1) == ERR_ARG);
+  fail_unless(tcpip_input_batch(p, TCPIP_INPUT_BATCH_SIZE, &test_netif1) == ERR_OK);
+#if !LWIP_TCPIP_CORE_LOCKING_INPUT
+  fail_unless(MEMP_STATS_GET(used, MEMP_TCPIP_MSG_INBATCH) == 1);
+  fail_unless(ctr.rx_cnt == 0);
+  while (tcpip_thread_poll_one());
+  fail_unless(MEMP_STATS_GET(used, MEMP_TCPIP_MSG_INBATCH) == 0);
+#endif /* !LWIP_TCPIP_CORE_LOCKING_INPUT */
+  fail_unless(ctr.rx_cnt == TCPIP_INPUT_BATCH_SIZE);
+  fail_unless(ctr.rx_bytes == TCPIP_INPUT_BATCH_SIZE * 16);
+
+  test_netif1.flags |= NETIF_FLAG_ETHARP;
+  udp_remove(pcb);
+}
+END_TEST
+#endif /* LWIP_TCPIP_INPUT_BATCH */
+
 /** Create the suite including all tests for this module */
 Suite *
 udp_suite(void)
@@ -466,7 +640,14 @@ udp_suite(void)
   testfunc tests[] = {
     TESTFUNC(test_udp_new_remove),
     TESTFUNC(test_udp_broadcast_rx_with_2_netifs),
-    TESTFUNC(test_udp_bind)
+    TESTFUNC(test_udp_bind),
+    TESTFUNC(test_udp_demux_ports),
+#if SO_REUSE
+    TESTFUNC(test_udp_rebind_same_port),
+#endif /* SO_REUSE */
+#if LWIP_TCPIP_INPUT_BATCH
+    TESTFUNC(test_udp_tcpip_input_batch),
+#endif /* LWIP_TCPIP_INPUT_BATCH */
   };
   return create_suite("UDP", tests, sizeof(tests)/sizeof(testfunc), udp_setup, udp_teardown);
 }